@@ -11,7 +11,38 @@
 // "dstAddr" (network) - destination address of flow
 // "srcAddr" (network) - source address of flow
 // "clientAddr" (storage) - address of the client sending requests
+// Enforcers are sent the parameters of the flows whose priority or rate limits changed since they were last sent, including flows
+// re-optimized by an admission, with one batched RPC per enforcer, and the enforcers are updated in parallel.
 // Priority is determined with the BySLO policy where the tightest SLO is assigned the highest priority.
+// Placements can also be probed without admitting the workload (ProbeClients RPC), which leaves the system unchanged.
+// The HeadroomClientsTyped RPC similarly finds the largest scale factor of a workload's arrival curves at which it would still be admitted,
+// so that a server's remaining capacity for the workload (e.g., for best-fit placement) is found without adding the workload.
+// Clients can be sent either as JSON (version 1 RPCs) or with a typed XDR encoding (version 2 RPCs; see prot/AdmissionController_prot.x), which avoids formatting and parsing JSON.
+// When several AdmissionController servers hold replicas of the same workloads, the AddClients RPC of one server returns
+// the parameters it optimized, and the other servers add the workloads with those parameters (ApplyClients RPC) instead of re-optimizing.
+//
+// RPCs are handled concurrently by a pool of threads, one RPC at a time per connection.
+// The committed state (queues and admitted workloads) is protected by a reader/writer lock, and RPCs that change it are serialized.
+// Probes are evaluated on a per-thread snapshot of the committed state without holding the lock, so probes run in parallel with each other.
+// Snapshots are brought up to date at the start of each probe by replaying the changes committed since their last probe.
+// Only the last few commits are kept for replaying, so a snapshot that falls further behind (e.g., of an idle thread) is copied again instead.
+//
+// NFSEnforcer can periodically publish the r-b curves it observes for its workloads (UpdateArrivalCurves RPC).
+// The arrival curves of the workloads' flows are replaced with the observed curves, and the rate limit parameters of the affected flows are re-optimized and sent to the enforcers.
+// Workloads are not evicted if they no longer meet their SLO with their observed behavior, but they are reported.
+//
+// The committed state can be saved so that a restarted server does not need to re-add every workload.
+// Every commit is appended to a delta log, and a binary checkpoint of the committed state (see NC::writeCheckpoint) replaces the log every few commits.
+// On start, the checkpoint is memory mapped and restored, and the commits in the log are replayed on top of it.
+// Only the enforcer addresses of the workloads' flows are kept alongside the state, rather than the workloads' clientInfos.
+//
+// Command line parameters:
+// -s solverName (optional) - LP solver backend (glpk, glpk-simplex, or glpk-exact); defaults to glpk
+// -c lpCaptureFilename (optional) - append each solved LP to this file for benchmarking solver backends (see DNC-LibraryBenchmark); only LPs of committed state are captured
+// -t numThreads (optional) - number of threads handling RPCs; 0 uses the number of cores, and 1 handles RPCs serially; defaults to 0
+// -k checkpointFilename (optional) - save the committed state to this file and its delta log to checkpointFilename.log, restoring it on start if the file exists
+// -i checkpointInterval (optional) - number of commits between checkpoints; defaults to 1000
+// -l snapshotMaxLag (optional) - number of commits kept for bringing snapshots up to date; snapshots further behind are copied from the committed state; defaults to 1000
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -22,7 +53,18 @@
 #include <string>
 #include <map>
 #include <set>
+#include <deque>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
 #include <rpc/rpc.h>
 #include <rpc/pmap_clnt.h>
 #include <json/json.h>
@@ -30,72 +72,291 @@
 #include "../prot/net_clnt.hpp"
 #include "../prot/storage_clnt.hpp"
 #include "../common/common.hpp"
+#include "../common/ThreadPool.hpp"
+#include "../common/SpanTrace.hpp"
+#include "../common/serializeBinary.hpp"
 #include "../DNC-Library/NC.hpp"
 #include "../DNC-Library/NCConfig.hpp"
 #include "../DNC-Library/WorkloadCompactor.hpp"
 
 using namespace std;
 
-// Global network calculus calculator
-NC* nc = NULL;
+// Change to the committed state
+enum CommitType {
+    COMMIT_ADD_CLIENT,
+    COMMIT_DEL_CLIENT,
+    COMMIT_ADD_QUEUE,
+    COMMIT_DEL_QUEUE,
+    COMMIT_SET_ARRIVAL_INFO,
+};
+
+struct Commit {
+    enum CommitType type;
+    Json::Value info; // clientInfo or queueInfo for COMMIT_ADD_CLIENT/COMMIT_ADD_QUEUE, or flowInfo with the new arrivalInfo for COMMIT_SET_ARRIVAL_INFO
+    string name; // client, queue, or flow name for COMMIT_DEL_CLIENT/COMMIT_DEL_QUEUE/COMMIT_SET_ARRIVAL_INFO
+};
+
+// Enforcer of an admitted flow (see file header)
+struct EnforcerInfo {
+    string enforcerType;
+    string enforcerAddr;
+    string srcAddr;
+    string dstAddr;
+    string clientAddr;
+    Json::Value sentParameters; // {"priority", "rateLimiters"} last sent to the enforcer; null if unknown to the enforcer
+};
+
+// Flows to update or remove at one enforcer with one RPC
+struct EnforcerBatch {
+    string enforcerType;
+    string enforcerAddr;
+    bool remove;
+    Json::Value flowInfos;
+    vector<FlowId> flowIds; // flow of each flowInfo
+    vector<Json::Value> parameters; // parameters sent for each flowInfo
+    bool success;
+};
 
-// Global storage for clientInfos
-map<ClientId, Json::Value> clientInfoStore;
+// Checkpoint file header
+#define CHECKPOINT_MAGIC 0x574b4350 // "PCKW"
+#define CHECKPOINT_FORMAT_VERSION 1
 
-// Send RPC to NetEnforcer to update workload
-void updateNetEnforcerClient(Json::Value& flowInfo)
+// Per-thread copy of the committed state used for probes
+struct Snapshot {
+    WorkloadCompactor* nc;
+    uint64_t version; // number of commits applied
+};
+
+//
+// Globals fixed at init
+//
+string g_solverName; // solver backend for snapshots
+pthread_key_t g_snapshotKey; // calling thread's Snapshot
+ThreadPool* g_pThreadPool = NULL; // handles RPCs; NULL if RPCs are handled serially
+int g_wakePipe[2]; // written to when a connection is done with an RPC, so that svcRunThreaded polls it again
+string g_checkpointFilename; // checkpoints are disabled if empty
+unsigned int g_checkpointInterval = 1000; // number of commits between checkpoints
+unsigned int g_snapshotMaxLag = 1000; // number of commits kept in g_commits for snapshots that have not applied them
+
+//
+// Globals protected by g_stateLock (read-locked to read the committed state, write-locked to change it)
+//
+pthread_rwlock_t g_stateLock = PTHREAD_RWLOCK_INITIALIZER;
+// Global network calculus calculator of the committed state
+WorkloadCompactor* nc = NULL;
+// Enforcers of the admitted flows that have one
+map<FlowId, EnforcerInfo> g_enforcerInfos;
+// Commits not yet applied to every snapshot, up to the last g_snapshotMaxLag commits; g_commits[i] is commit number g_firstCommit + i
+deque<Commit> g_commits;
+uint64_t g_firstCommit = 0;
+uint64_t g_version = 0; // number of commits
+int g_logFd = -1; // delta log of the commits since the last checkpoint; -1 if checkpoints are disabled
+uint64_t g_checkpointVersion = 0; // number of commits included in the last checkpoint
+
+//
+// Globals protected by g_snapshotsMutex
+//
+pthread_mutex_t g_snapshotsMutex = PTHREAD_MUTEX_INITIALIZER;
+vector<Snapshot*> g_snapshots;
+
+//
+// Globals protected by g_busyMutex
+//
+pthread_mutex_t g_busyMutex = PTHREAD_MUTEX_INITIALIZER;
+set<int> g_busyFds; // connections with an RPC being handled by g_pThreadPool
+
+// Store the enforcers of a client's flows.
+// Assumes g_stateLock is write-locked
+void storeEnforcerInfos(ClientId clientId, const Json::Value& clientInfo)
 {
-    if (!flowInfo.isMember("enforcerAddr") || !flowInfo.isMember("dstAddr") || !flowInfo.isMember("srcAddr")) {
-        return;
+    const Client* c = nc->getClient(clientId);
+    const Json::Value& clientFlows = clientInfo["flows"];
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        const Json::Value& flowInfo = clientFlows[flowIndex];
+        if (flowInfo.isMember("enforcerType")) {
+            EnforcerInfo& enforcerInfo = g_enforcerInfos[c->flowIds[flowIndex]];
+            enforcerInfo.enforcerType = flowInfo["enforcerType"].asString();
+            enforcerInfo.enforcerAddr = flowInfo.get("enforcerAddr", "").asString();
+            enforcerInfo.srcAddr = flowInfo.get("srcAddr", "").asString();
+            enforcerInfo.dstAddr = flowInfo.get("dstAddr", "").asString();
+            enforcerInfo.clientAddr = flowInfo.get("clientAddr", "").asString();
+        }
     }
-    net_clnt clnt(flowInfo["enforcerAddr"].asString());
-    setFlowParameters(flowInfo, nc);
-    clnt.updateClient(flowInfo);
 }
 
-// Send RPC to NetEnforcer to remove workload
-void removeNetEnforcerClient(Json::Value& flowInfo)
+// Forget the enforcers of a client's flows.
+// Assumes g_stateLock is write-locked
+void eraseEnforcerInfos(ClientId clientId)
 {
-    if (!flowInfo.isMember("enforcerAddr") || !flowInfo.isMember("dstAddr") || !flowInfo.isMember("srcAddr")) {
-        return;
+    const Client* c = nc->getClient(clientId);
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        g_enforcerInfos.erase(c->flowIds[flowIndex]);
     }
-    net_clnt clnt(flowInfo["enforcerAddr"].asString());
-    clnt.removeClient(flowInfo);
 }
 
-// Send RPC to NFSEnforcer to update workload
-void updateNFSEnforcerClient(Json::Value& flowInfo)
+// Get the flowInfo members used by the enforcer of a flow.
+// Returns false if the flow does not have an enforcer.
+// Assumes g_stateLock is locked
+bool getEnforcerFlowInfo(FlowId flowId, Json::Value& flowInfo)
 {
-    if (!flowInfo.isMember("enforcerAddr") || !flowInfo.isMember("clientAddr")) {
-        return;
+    map<FlowId, EnforcerInfo>::const_iterator it = g_enforcerInfos.find(flowId);
+    if (it == g_enforcerInfos.end()) {
+        return false;
+    }
+    const EnforcerInfo& enforcerInfo = it->second;
+    flowInfo["name"] = Json::Value(nc->getFlow(flowId)->name);
+    flowInfo["enforcerType"] = Json::Value(enforcerInfo.enforcerType);
+    const char* members[] = {"enforcerAddr", "srcAddr", "dstAddr", "clientAddr"};
+    const string* values[] = {&enforcerInfo.enforcerAddr, &enforcerInfo.srcAddr, &enforcerInfo.dstAddr, &enforcerInfo.clientAddr};
+    for (unsigned int index = 0; index < sizeof(members) / sizeof(members[0]); index++) {
+        if (!values[index]->empty()) {
+            flowInfo[members[index]] = Json::Value(*values[index]);
+        }
     }
-    storage_clnt clnt(flowInfo["enforcerAddr"].asString());
-    setFlowParameters(flowInfo, nc);
-    clnt.updateClient(flowInfo);
+    return true;
 }
 
-// Send RPC to NFSEnforcer to remove workload
-void removeNFSEnforcerClient(Json::Value& flowInfo)
+// Send a batch of updates or removals to its enforcer; arg is an EnforcerBatch
+void* sendEnforcerBatch(void* arg)
 {
-    if (!flowInfo.isMember("enforcerAddr") || !flowInfo.isMember("clientAddr")) {
-        return;
+    TRACE_SPAN("sendEnforcerBatch");
+    EnforcerBatch* batch = (EnforcerBatch*)arg;
+    if (batch->enforcerType == "network") {
+        net_clnt clnt(batch->enforcerAddr);
+        batch->success = batch->remove ? clnt.removeClients(batch->flowInfos) : clnt.updateClients(batch->flowInfos);
+    } else {
+        // NFSEnforcer reverts a client to defaults when it is updated without rate limits
+        storage_clnt clnt(batch->enforcerAddr);
+        batch->success = clnt.updateClients(batch->flowInfos);
     }
-    storage_clnt clnt(flowInfo["enforcerAddr"].asString());
-    flowInfo["priority"] = Json::Value(0);
-    flowInfo.removeMember("rateLimiters");
-    clnt.updateClient(flowInfo);
+    return NULL;
 }
 
+// Send batches to their enforcers in parallel, and record the parameters that the enforcers now have.
+// Assumes g_stateLock is write-locked
+void sendEnforcerBatches(map<pair<string, string>, EnforcerBatch>& batches)
+{
+    vector<pthread_t> threads;
+    vector<EnforcerBatch*> threadBatches;
+    for (map<pair<string, string>, EnforcerBatch>::iterator it = batches.begin(); it != batches.end(); it++) {
+        EnforcerBatch* batch = &it->second;
+        pthread_t thread;
+        // The last batch is sent by the calling thread
+        if ((batches.size() > 1) && (pthread_create(&thread, NULL, sendEnforcerBatch, batch) == 0)) {
+            threads.push_back(thread);
+            threadBatches.push_back(batch);
+        } else {
+            sendEnforcerBatch(batch);
+        }
+    }
+    for (unsigned int i = 0; i < threads.size(); i++) {
+        pthread_join(threads[i], NULL);
+    }
+    for (map<pair<string, string>, EnforcerBatch>::const_iterator it = batches.begin(); it != batches.end(); it++) {
+        const EnforcerBatch& batch = it->second;
+        for (unsigned int i = 0; i < batch.flowIds.size(); i++) {
+            map<FlowId, EnforcerInfo>::iterator infoIt = g_enforcerInfos.find(batch.flowIds[i]);
+            if (infoIt != g_enforcerInfos.end()) {
+                // Resend next time if the RPC failed, since the enforcer's parameters are unknown
+                infoIt->second.sentParameters = batch.success ? batch.parameters[i] : Json::Value();
+            }
+        }
+    }
+}
+
+// Get the batch of a flow's enforcer, or NULL if the flowInfo does not describe the flow's enforcer client (see file header)
+EnforcerBatch* getEnforcerBatch(map<pair<string, string>, EnforcerBatch>& batches, const Json::Value& flowInfo, bool remove)
+{
+    string enforcerType = flowInfo["enforcerType"].asString();
+    if (!flowInfo.isMember("enforcerAddr") ||
+        ((enforcerType == "network") && (!flowInfo.isMember("dstAddr") || !flowInfo.isMember("srcAddr"))) ||
+        ((enforcerType == "storage") && !flowInfo.isMember("clientAddr")) ||
+        ((enforcerType != "network") && (enforcerType != "storage"))) {
+        return NULL;
+    }
+    pair<string, string> key(enforcerType, flowInfo["enforcerAddr"].asString());
+    map<pair<string, string>, EnforcerBatch>::iterator it = batches.find(key);
+    if (it == batches.end()) {
+        EnforcerBatch& batch = batches[key];
+        batch.enforcerType = key.first;
+        batch.enforcerAddr = key.second;
+        batch.remove = remove;
+        batch.flowInfos = Json::arrayValue;
+        batch.success = false;
+        return &batch;
+    }
+    return &it->second;
+}
+
+// Send the priorities and rate limits of the flows whose parameters changed since they were last sent, with one RPC per enforcer.
+// Assumes g_stateLock is write-locked and the shaper parameters are up to date
+void updateEnforcers(const set<FlowId>& flowIds)
+{
+    TRACE_SPAN("updateEnforcers");
+    map<pair<string, string>, EnforcerBatch> batches;
+    for (set<FlowId>::const_iterator it = flowIds.begin(); it != flowIds.end(); it++) {
+        Json::Value flowInfo;
+        if (!getEnforcerFlowInfo(*it, flowInfo)) {
+            continue;
+        }
+        setFlowParameters(flowInfo, nc);
+        Json::Value parameters;
+        parameters["priority"] = flowInfo["priority"];
+        parameters["rateLimiters"] = flowInfo["rateLimiters"];
+        if (parameters == g_enforcerInfos[*it].sentParameters) {
+            continue;
+        }
+        EnforcerBatch* batch = getEnforcerBatch(batches, flowInfo, false);
+        if (batch != NULL) {
+            batch->flowInfos.append(flowInfo);
+            batch->flowIds.push_back(*it);
+            batch->parameters.push_back(parameters);
+        }
+    }
+    sendEnforcerBatches(batches);
+}
+
+// Remove flows from their enforcers, with one RPC per enforcer.
+// Assumes g_stateLock is write-locked
+void removeEnforcers(const vector<FlowId>& flowIds)
+{
+    TRACE_SPAN("removeEnforcers");
+    map<pair<string, string>, EnforcerBatch> batches;
+    for (unsigned int i = 0; i < flowIds.size(); i++) {
+        Json::Value flowInfo;
+        if (!getEnforcerFlowInfo(flowIds[i], flowInfo)) {
+            continue;
+        }
+        if (flowInfo["enforcerType"].asString() == "storage") {
+            flowInfo["priority"] = Json::Value(0);
+            flowInfo.removeMember("name"); // stop publishing the client's observed r-b curve
+        }
+        EnforcerBatch* batch = getEnforcerBatch(batches, flowInfo, true);
+        if (batch != NULL) {
+            batch->flowInfos.append(flowInfo);
+            batch->flowIds.push_back(flowIds[i]);
+            batch->parameters.push_back(Json::Value());
+        }
+    }
+    sendEnforcerBatches(batches);
+}
+
+// Queues and long-term rate of a flow that is not yet admitted, collected while checking its flowInfo so that checkOverload does not need to parse JSON
+struct FlowLoad {
+    vector<QueueId> queueIds;
+    double rate; // slope of the last segment of the flow's arrival curve
+};
+
 // Check the JSON flowInfo format.
 // Returns error for invalid arguments.
-AdmissionStatus checkFlowInfo(set<string>& flowNames, const Json::Value& flowInfo)
+AdmissionStatus checkFlowInfo(NC* model, set<string>& flowNames, const Json::Value& flowInfo, FlowLoad* flowLoad)
 {
     // Check name
     if (!flowInfo.isMember("name")) {
         return ADMISSION_ERR_MISSING_ARGUMENT;
     }
     string name = flowInfo["name"].asString();
-    if (nc->getFlowIdByName(name) != InvalidFlowId) {
+    if (model->getFlowIdByName(name) != InvalidFlowId) {
         return ADMISSION_ERR_FLOW_NAME_IN_USE;
     }
     if (flowNames.find(name) != flowNames.end()) {
@@ -112,27 +373,35 @@ AdmissionStatus checkFlowInfo(set<string>& flowNames, const Json::Value& flowInf
     }
     for (unsigned int index = 0; index < flowQueues.size(); index++) {
         string queueName = flowQueues[index].asString();
-        if (nc->getQueueIdByName(queueName) == InvalidQueueId) {
+        QueueId queueId = model->getQueueIdByName(queueName);
+        if (queueId == InvalidQueueId) {
             return ADMISSION_ERR_QUEUE_NAME_NONEXISTENT;
         }
+        if (flowLoad) {
+            flowLoad->queueIds.push_back(queueId);
+        }
     }
     // Check arrivalInfo
     if (!flowInfo.isMember("arrivalInfo")) {
         return ADMISSION_ERR_MISSING_ARGUMENT;
     }
+    if (flowLoad) {
+        const Json::Value& arrivalInfo = flowInfo["arrivalInfo"];
+        flowLoad->rate = ((arrivalInfo.isArray()) && (arrivalInfo.size() > 0)) ? arrivalInfo[arrivalInfo.size() - 1]["slope"].asDouble() : 0;
+    }
     return ADMISSION_SUCCESS;
 }
 
 // Check the JSON clientInfo format.
 // Returns error for invalid arguments.
-AdmissionStatus checkClientInfo(set<string>& clientNames, set<string>& flowNames, const Json::Value& clientInfo)
+AdmissionStatus checkClientInfo(NC* model, set<string>& clientNames, set<string>& flowNames, const Json::Value& clientInfo, vector<FlowLoad>& flowLoads)
 {
     // Check name
     if (!clientInfo.isMember("name")) {
         return ADMISSION_ERR_MISSING_ARGUMENT;
     }
     string name = clientInfo["name"].asString();
-    if (nc->getClientIdByName(name) != InvalidClientId) {
+    if (model->getClientIdByName(name) != InvalidClientId) {
         return ADMISSION_ERR_CLIENT_NAME_IN_USE;
     }
     if (clientNames.find(name) != clientNames.end()) {
@@ -162,8 +431,15 @@ AdmissionStatus checkClientInfo(set<string>& clientNames, set<string>& flowNames
     if (!clientFlows.isArray()) {
         return ADMISSION_ERR_INVALID_ARGUMENT;
     }
+    // Admitted clients are skipped by checkOverload, since they may require shaper curve recomputation
+    bool admitted = clientInfo.isMember("admitted") && clientInfo["admitted"].asBool();
     for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
-        AdmissionStatus status = checkFlowInfo(flowNames, clientFlows[flowIndex]);
+        FlowLoad* flowLoad = NULL;
+        if (!admitted) {
+            flowLoads.push_back(FlowLoad());
+            flowLoad = &flowLoads.back();
+        }
+        AdmissionStatus status = checkFlowInfo(model, flowNames, clientFlows[flowIndex], flowLoad);
         if (status != ADMISSION_SUCCESS) {
             return status;
         }
@@ -172,9 +448,11 @@ AdmissionStatus checkClientInfo(set<string>& clientNames, set<string>& flowNames
 }
 
 // Check list of JSON clientInfo format.
+// Appends the queues and rate of each flow of the clients that are not yet admitted to flowLoads.
 // Returns error for invalid arguments.
-AdmissionStatus checkClientInfos(const Json::Value& clientInfos)
+AdmissionStatus checkClientInfos(NC* model, const Json::Value& clientInfos, vector<FlowLoad>& flowLoads)
 {
+    TRACE_SPAN("checkClientInfos");
     // Check clientInfos is an array
     if (!clientInfos.isArray()) {
         return ADMISSION_ERR_INVALID_ARGUMENT;
@@ -182,7 +460,7 @@ AdmissionStatus checkClientInfos(const Json::Value& clientInfos)
     set<string> clientNames; // ensure no duplicate names
     set<string> flowNames; // ensure no duplicate names
     for (unsigned int i = 0; i < clientInfos.size(); i++) {
-        AdmissionStatus status = checkClientInfo(clientNames, flowNames, clientInfos[i]);
+        AdmissionStatus status = checkClientInfo(model, clientNames, flowNames, clientInfos[i], flowLoads);
         if (status != ADMISSION_SUCCESS) {
             return status;
         }
@@ -190,153 +468,441 @@ AdmissionStatus checkClientInfos(const Json::Value& clientInfos)
     return ADMISSION_SUCCESS;
 }
 
-// FlowIndex less-than function
-bool operator< (const FlowIndex& fi1, const FlowIndex& fi2)
+// Check latency of added clients
+bool checkLatency(NC* model, const set<ClientId>& clientIds)
 {
-    if (fi1.flowId == fi2.flowId) {
-        return (fi1.index < fi2.index);
+    TRACE_SPAN("checkLatency");
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        ClientId clientId = *it;
+        model->calcClientLatency(clientId);
+        const Client* c = model->getClient(clientId);
+        if (c->latency > c->SLO) {
+            return false;
+        }
+    }
+    // Check latency of other clients affected by the added clients (i.e., with flows whose latency needs to be recalculated)
+    set<ClientId> affectedClientIds;
+    model->getDirtyClients(affectedClientIds);
+    for (set<ClientId>::const_iterator it = affectedClientIds.begin(); it != affectedClientIds.end(); it++) {
+        ClientId clientId = *it;
+        model->calcClientLatency(clientId);
+        const Client* c = model->getClient(clientId);
+        if (c->latency > c->SLO) {
+            return false;
+        }
     }
-    return (fi1.flowId < fi2.flowId);
+    return true;
 }
 
-// Mark flows affected at a priority level starting from a flow at a given index.
-void markAffectedFlows(set<FlowIndex>& affectedFlows, const FlowIndex& fi, unsigned int priority)
+// Check if we should exit early since server is full.
+// Uses the total shaper rate that DNC keeps for each queue, so the check takes time proportional to the number of queues of the flows.
+bool checkOverload(NC* model, const vector<FlowLoad>& flowLoads)
 {
-    const Flow* f = nc->getFlow(fi.flowId);
-    // If f is higher priority, it is unaffected
-    if (f->priority < priority) {
-        return;
-    }
-    // If we've already marked flow at given index, stop
-    if (affectedFlows.find(fi) != affectedFlows.end()) {
-        return;
+    TRACE_SPAN("checkOverload");
+    bool possibleOverload = false;
+    DNC* dnc = dynamic_cast<DNC*>(model);
+    if (dnc) {
+        for (vector<FlowLoad>::const_iterator it = flowLoads.begin(); it != flowLoads.end(); it++) {
+            for (vector<QueueId>::const_iterator queueIt = it->queueIds.begin(); queueIt != it->queueIds.end(); queueIt++) {
+                double shaperRate;
+                if (!dnc->getQueueShaperRate(*queueIt, shaperRate)) {
+                    // Uninitialized shaper curves require recomputation
+                    return false;
+                }
+                if (it->rate + shaperRate > 0.999999 * model->getQueue(*queueIt)->bandwidth) {
+                    possibleOverload = true;
+                }
+            }
+        }
     }
-    affectedFlows.insert(fi);
-    // Loop through queues affected by flow starting at index
-    for (unsigned int index = fi.index; index < f->queueIds.size(); index++) {
-        const Queue* q = nc->getQueue(f->queueIds[index]);
-        // Try marking other flows sharing queue
-        for (vector<FlowIndex>::const_iterator itFi = q->flows.begin(); itFi != q->flows.end(); itFi++) {
-            markAffectedFlows(affectedFlows, *itFi, f->priority);
+    return possibleOverload;
+}
+
+// Check if all clients are marked as admitted already
+bool checkAdmitOverride(const Json::Value& clientInfos)
+{
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        const Json::Value& clientInfo = clientInfos[i];
+        if (!clientInfo.isMember("admitted") || !clientInfo["admitted"].asBool()) {
+            return false;
         }
     }
+    return true;
 }
 
-// Check latency of added clients
-bool checkLatency(const set<ClientId>& clientIds)
+// Apply a commit to a snapshot
+void applyCommit(NC* model, const Commit& commit)
 {
-    bool admitted = true;
-    set<FlowIndex> affectedFlows;
-    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
-        ClientId clientId = *it;
-        nc->calcClientLatency(clientId);
-        const Client* c = nc->getClient(clientId);
-        if (c->latency > c->SLO) {
-            admitted = false;
+    switch (commit.type) {
+        case COMMIT_ADD_CLIENT:
+            model->addClient(commit.info);
+            break;
+
+        case COMMIT_DEL_CLIENT:
+            model->delClient(model->getClientIdByName(commit.name));
+            break;
+
+        case COMMIT_ADD_QUEUE:
+            model->addQueue(commit.info);
+            break;
+
+        case COMMIT_DEL_QUEUE:
+            model->delQueue(model->getQueueIdByName(commit.name));
+            break;
+
+        case COMMIT_SET_ARRIVAL_INFO:
+            dynamic_cast<DNC*>(model)->updateArrivalInfo(model->getFlowIdByName(commit.name), commit.info);
             break;
+    }
+}
+
+// Append a commit to the delta log.
+// Assumes g_stateLock is write-locked
+void logCommit(const Commit& commit)
+{
+    TRACE_SPAN("logCommit");
+    BinaryWriter writer;
+    writer.write(g_version);
+    writer.write(static_cast<uint32_t>(commit.type));
+    writer.write(commit.info.isNull() ? string() : Json::FastWriter().write(commit.info));
+    writer.write(commit.name);
+    if (!writer.writeFd(g_logFd)) {
+        perror("Failed to write delta log");
+    }
+}
+
+// Record a change to the committed state, and discard the commits that every snapshot has applied.
+// Commits beyond the last g_snapshotMaxLag are discarded anyway, so that a snapshot that is not used does not keep the log growing;
+// such a snapshot is copied from the committed state on its next use.
+// Assumes g_stateLock is write-locked
+void addCommit(const Commit& commit)
+{
+    if (g_logFd >= 0) {
+        logCommit(commit);
+    }
+    g_commits.push_back(commit);
+    g_version++;
+    uint64_t minVersion = g_version;
+    pthread_mutex_lock(&g_snapshotsMutex);
+    for (vector<Snapshot*>::const_iterator it = g_snapshots.begin(); it != g_snapshots.end(); it++) {
+        minVersion = min(minVersion, (*it)->version);
+    }
+    pthread_mutex_unlock(&g_snapshotsMutex);
+    if (g_version - minVersion > g_snapshotMaxLag) {
+        minVersion = g_version - g_snapshotMaxLag;
+    }
+    while (g_firstCommit < minVersion) {
+        g_commits.pop_front();
+        g_firstCommit++;
+    }
+}
+
+// Write a checkpoint of the committed state, and truncate the delta log since its commits are included.
+// Returns false on error, in which case the delta log is kept.
+// Assumes g_stateLock is write-locked
+bool writeCheckpoint()
+{
+    TRACE_SPAN("writeCheckpoint");
+    BinaryWriter writer;
+    writer.write(static_cast<uint32_t>(CHECKPOINT_MAGIC));
+    writer.write(static_cast<uint32_t>(CHECKPOINT_FORMAT_VERSION));
+    writer.write(g_version);
+    nc->writeCheckpoint(writer);
+    writer.write(static_cast<uint32_t>(g_enforcerInfos.size()));
+    for (map<FlowId, EnforcerInfo>::const_iterator it = g_enforcerInfos.begin(); it != g_enforcerInfos.end(); it++) {
+        writer.write(static_cast<uint32_t>(it->first));
+        writer.write(it->second.enforcerType);
+        writer.write(it->second.enforcerAddr);
+        writer.write(it->second.srcAddr);
+        writer.write(it->second.dstAddr);
+        writer.write(it->second.clientAddr);
+    }
+    if (!writer.writeFile(g_checkpointFilename)) {
+        perror("Failed to write checkpoint");
+        return false;
+    }
+    // Commits in the log are skipped when restoring if the checkpoint includes them, so a failed truncate leaves a valid log
+    if (ftruncate(g_logFd, 0) != 0) {
+        perror("Failed to truncate delta log");
+    }
+    g_checkpointVersion = g_version;
+    return true;
+}
+
+// Write a checkpoint if there have been checkpointInterval commits since the last checkpoint.
+// Called once the committed state includes all recorded commits (i.e., after the commits of an RPC).
+// Assumes g_stateLock is write-locked
+void checkpointIfNeeded()
+{
+    if ((g_logFd >= 0) && (g_version - g_checkpointVersion >= g_checkpointInterval)) {
+        writeCheckpoint();
+    }
+}
+
+// Read a checkpoint written by writeCheckpoint into the empty committed state.
+// Returns false if the checkpoint is malformed.
+bool readCheckpoint(const MappedFile& file)
+{
+    BinaryReader reader(file.data(), file.size());
+    uint32_t magic = 0;
+    uint32_t formatVersion = 0;
+    reader.read(magic);
+    reader.read(formatVersion);
+    reader.read(g_version);
+    if (!reader.ok() || (magic != CHECKPOINT_MAGIC) || (formatVersion != CHECKPOINT_FORMAT_VERSION) || !nc->readCheckpoint(reader)) {
+        return false;
+    }
+    uint32_t numEnforcerInfos = 0;
+    reader.readCount(numEnforcerInfos, 6 * sizeof(uint32_t));
+    for (unsigned int i = 0; i < numEnforcerInfos; i++) {
+        uint32_t flowId = InvalidFlowId;
+        reader.read(flowId);
+        EnforcerInfo& enforcerInfo = g_enforcerInfos[flowId];
+        reader.read(enforcerInfo.enforcerType);
+        reader.read(enforcerInfo.enforcerAddr);
+        reader.read(enforcerInfo.srcAddr);
+        reader.read(enforcerInfo.dstAddr);
+        reader.read(enforcerInfo.clientAddr);
+        if (nc->getFlow(flowId) == NULL) {
+            return false;
         }
-        // Add affected flows
-        for (vector<FlowId>::const_iterator itF = c->flowIds.begin(); itF != c->flowIds.end(); itF++) {
-            FlowIndex fi;
-            fi.flowId = *itF;
-            fi.index = 0;
-            markAffectedFlows(affectedFlows, fi, 0);
+    }
+    return reader.ok() && reader.atEnd();
+}
+
+// Replay a commit from the delta log on the committed state.
+// Returns false if the commit does not apply to the committed state.
+bool replayCommit(const Commit& commit)
+{
+    switch (commit.type) {
+        case COMMIT_ADD_CLIENT: {
+            Json::Value clientInfos = Json::arrayValue;
+            clientInfos.append(commit.info);
+            vector<FlowLoad> flowLoads;
+            if (checkClientInfos(nc, clientInfos, flowLoads) != ADMISSION_SUCCESS) {
+                return false;
+            }
+            ClientId clientId = nc->addClient(commit.info);
+            storeEnforcerInfos(clientId, commit.info);
+            return true;
         }
+
+        case COMMIT_DEL_CLIENT:
+            if (nc->getClientIdByName(commit.name) == InvalidClientId) {
+                return false;
+            }
+            eraseEnforcerInfos(nc->getClientIdByName(commit.name));
+            break;
+
+        case COMMIT_ADD_QUEUE:
+            if (nc->getQueueIdByName(commit.info["name"].asString()) != InvalidQueueId) {
+                return false;
+            }
+            break;
+
+        case COMMIT_DEL_QUEUE:
+            if ((nc->getQueueIdByName(commit.name) == InvalidQueueId) || !nc->getQueue(nc->getQueueIdByName(commit.name))->flows.empty()) {
+                return false;
+            }
+            break;
+
+        case COMMIT_SET_ARRIVAL_INFO:
+            if (nc->getFlowIdByName(commit.name) == InvalidFlowId) {
+                return false;
+            }
+            break;
+
+        default:
+            return false;
     }
-    if (admitted) {
-        // Get clientIds of affected flows
-        set<ClientId> affectedClientIds;
-        for (set<FlowIndex>::const_iterator it = affectedFlows.begin(); it != affectedFlows.end(); it++) {
-            const Flow* f = nc->getFlow(it->flowId);
-            affectedClientIds.insert(f->clientId);
+    applyCommit(nc, commit);
+    return true;
+}
+
+// Restore the committed state from the checkpoint and delta log, if any, and start a new delta log.
+// The log may end with a partially written commit if the server was stopped while writing it, which is discarded.
+// Returns false on error.
+bool restoreCommittedState()
+{
+    MappedFile file;
+    if (file.map(g_checkpointFilename)) {
+        if (!readCheckpoint(file)) {
+            cerr << "Malformed checkpoint " << g_checkpointFilename << endl;
+            return false;
         }
-        // Check latency of other affected clients
-        for (set<ClientId>::const_iterator it = affectedClientIds.begin(); it != affectedClientIds.end(); it++) {
-            ClientId clientId = *it;
-            if (clientIds.find(clientId) == clientIds.end()) {
-                nc->calcClientLatency(clientId);
-                const Client* c = nc->getClient(clientId);
-                if (c->latency > c->SLO) {
-                    admitted = false;
-                    break;
-                }
+    } else if (errno != ENOENT) {
+        perror("Failed to open checkpoint");
+        return false;
+    }
+    file.unmap();
+    string logFilename = g_checkpointFilename + ".log";
+    if (file.map(logFilename)) {
+        BinaryReader reader(file.data(), file.size());
+        while (!reader.atEnd()) {
+            uint64_t commitNumber = 0;
+            uint32_t type = 0;
+            string info;
+            Commit commit;
+            reader.read(commitNumber);
+            reader.read(type);
+            reader.read(info);
+            reader.read(commit.name);
+            if (!reader.ok()) {
+                cerr << "Discarding partially written commit at the end of " << logFilename << endl;
+                break;
             }
+            // Skip commits included in the checkpoint
+            if (commitNumber < g_version) {
+                continue;
+            }
+            commit.type = static_cast<CommitType>(type);
+            if ((commitNumber != g_version) || (!info.empty() && !stringToJson(info, commit.info)) || !replayCommit(commit)) {
+                cerr << "Malformed commit " << commitNumber << " in " << logFilename << endl;
+                return false;
+            }
+            g_version++;
         }
+    } else if (errno != ENOENT) {
+        perror("Failed to open delta log");
+        return false;
     }
-    return admitted;
+    file.unmap();
+    g_firstCommit = g_version;
+    g_logFd = open(logFilename.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (g_logFd < 0) {
+        perror("Failed to open delta log");
+        return false;
+    }
+    // Replace the replayed log with a checkpoint
+    return writeCheckpoint();
 }
 
-// Check if we should exit early since server is full
-bool checkOverload(const Json::Value& clientInfos)
+// Copy the committed state into a snapshot from a checkpoint of the committed state.
+// Assumes g_stateLock is read-locked
+void copySnapshot(Snapshot* snapshot)
 {
-    bool possibleOverload = false;
-    DNC* dnc = dynamic_cast<DNC*>(nc);
-    if (dnc) {
-        for (unsigned int i = 0; i < clientInfos.size(); i++) {
-            const Json::Value& clientInfo = clientInfos[i];
-            if (clientInfo.isMember("admitted") && clientInfo["admitted"].asBool()) {
-                // Must skip checking admitted clients, since they may require shaper curve recomputation
-                continue;
+    TRACE_SPAN("copySnapshot");
+    delete snapshot->nc;
+    snapshot->nc = new WorkloadCompactor(true, 1);
+    snapshot->nc->setSolver(g_solverName);
+    BinaryWriter writer;
+    nc->writeCheckpoint(writer);
+    BinaryReader reader(writer.data(), writer.size());
+    bool restored = snapshot->nc->readCheckpoint(reader);
+    assert(restored);
+    snapshot->version = g_version;
+}
+
+// Get the calling thread's snapshot of the committed state, updated to the latest commit.
+// The snapshot is copied from the committed state on the first call from a thread, and whenever the commits it is missing have been discarded.
+WorkloadCompactor* getSnapshot()
+{
+    TRACE_SPAN("getSnapshot");
+    Snapshot* snapshot = static_cast<Snapshot*>(pthread_getspecific(g_snapshotKey));
+    pthread_rwlock_rdlock(&g_stateLock);
+    if (snapshot == NULL) {
+        snapshot = new Snapshot;
+        snapshot->nc = NULL;
+        copySnapshot(snapshot);
+        pthread_setspecific(g_snapshotKey, snapshot);
+        pthread_mutex_lock(&g_snapshotsMutex);
+        g_snapshots.push_back(snapshot);
+        pthread_mutex_unlock(&g_snapshotsMutex);
+    } else if (snapshot->version < g_firstCommit) {
+        // Fell more than g_snapshotMaxLag commits behind
+        copySnapshot(snapshot);
+    } else {
+        for (; snapshot->version < g_version; snapshot->version++) {
+            applyCommit(snapshot->nc, g_commits[snapshot->version - g_firstCommit]);
+        }
+    }
+    pthread_rwlock_unlock(&g_stateLock);
+    return snapshot->nc;
+}
+
+// Decode typed clientInfos into JSON clientInfos.
+// Absent members are omitted, so that the clientInfos are the same as those sent as JSON.
+void decodeClientInfos(const AdmissionClientInfos& xdrClientInfos, Json::Value& clientInfos)
+{
+    TRACE_SPAN("decodeClientInfos");
+    clientInfos = Json::arrayValue;
+    clientInfos.resize(xdrClientInfos.AdmissionClientInfos_len);
+    for (unsigned int i = 0; i < xdrClientInfos.AdmissionClientInfos_len; i++) {
+        const AdmissionClientInfo& xdrClientInfo = xdrClientInfos.AdmissionClientInfos_val[i];
+        Json::Value& clientInfo = clientInfos[i];
+        clientInfo["name"] = Json::Value(xdrClientInfo.name);
+        clientInfo["SLO"] = Json::Value(xdrClientInfo.SLO);
+        if (xdrClientInfo.SLOpercentile != 0) {
+            clientInfo["SLOpercentile"] = Json::Value(xdrClientInfo.SLOpercentile);
+        }
+        if (xdrClientInfo.closedLoop) {
+            clientInfo["closedLoop"] = Json::Value(true);
+        }
+        if (xdrClientInfo.bestEffort) {
+            clientInfo["bestEffort"] = Json::Value(true);
+        }
+        if (xdrClientInfo.admitted) {
+            clientInfo["admitted"] = Json::Value(true);
+        }
+        Json::Value& clientFlows = clientInfo["flows"];
+        clientFlows = Json::arrayValue;
+        clientFlows.resize(xdrClientInfo.flows.flows_len);
+        for (unsigned int flowIndex = 0; flowIndex < xdrClientInfo.flows.flows_len; flowIndex++) {
+            const AdmissionFlowInfo& xdrFlowInfo = xdrClientInfo.flows.flows_val[flowIndex];
+            Json::Value& flowInfo = clientFlows[flowIndex];
+            flowInfo["name"] = Json::Value(xdrFlowInfo.name);
+            Json::Value& flowQueues = flowInfo["queues"];
+            flowQueues = Json::arrayValue;
+            flowQueues.resize(xdrFlowInfo.queues.queues_len);
+            for (unsigned int index = 0; index < xdrFlowInfo.queues.queues_len; index++) {
+                flowQueues[index] = Json::Value(xdrFlowInfo.queues.queues_val[index]);
             }
-            const Json::Value& clientFlows = clientInfo["flows"];
-            for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
-                const Json::Value& flowInfo = clientFlows[flowIndex];
-                Curve arrivalCurve;
-                deserializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
-                const Json::Value& flowQueues = flowInfo["queues"];
-                for (unsigned int index = 0; index < flowQueues.size(); index++) {
-                    string queueName = flowQueues[index].asString();
-                    QueueId queueId = nc->getQueueIdByName(queueName);
-                    const Queue* queue = nc->getQueue(queueId);
-                    double load = arrivalCurve.back().slope;
-                    for (vector<FlowIndex>::const_iterator it = queue->flows.begin(); it != queue->flows.end(); it++) {
-                        if (dnc) {
-                            SimpleArrivalCurve shaperCurve = dnc->getShaperCurve(it->flowId);
-                            if ((shaperCurve.r == 0) && (shaperCurve.b == 0)) {
-                                // Uninitialized shaper curves require recomputation
-                                return false;
-                            } else {
-                                load += shaperCurve.r;
-                            }
-                        }
-                    }
-                    if (load > 0.999999 * queue->bandwidth) {
-                        possibleOverload = true;
-                    }
+            if (xdrFlowInfo.arrivalInfo.arrivalInfo_len > 0) {
+                Json::Value& arrivalInfo = flowInfo["arrivalInfo"];
+                arrivalInfo.resize(xdrFlowInfo.arrivalInfo.arrivalInfo_len);
+                for (unsigned int index = 0; index < xdrFlowInfo.arrivalInfo.arrivalInfo_len; index++) {
+                    const AdmissionPointSlope& xdrPoint = xdrFlowInfo.arrivalInfo.arrivalInfo_val[index];
+                    Json::Value& point = arrivalInfo[index];
+                    point["x"] = Json::Value(xdrPoint.x);
+                    point["y"] = Json::Value(xdrPoint.y);
+                    point["slope"] = Json::Value(xdrPoint.slope);
+                }
+            }
+            if (xdrFlowInfo.hasPriority) {
+                flowInfo["priority"] = Json::Value(xdrFlowInfo.priority);
+            }
+            const char* members[] = {"enforcerType", "enforcerAddr", "srcAddr", "dstAddr", "clientAddr"};
+            const char* values[] = {xdrFlowInfo.enforcerType, xdrFlowInfo.enforcerAddr, xdrFlowInfo.srcAddr, xdrFlowInfo.dstAddr, xdrFlowInfo.clientAddr};
+            for (unsigned int index = 0; index < sizeof(members) / sizeof(members[0]); index++) {
+                if (values[index][0] != '\0') {
+                    flowInfo[members[index]] = Json::Value(values[index]);
                 }
             }
         }
     }
-    return possibleOverload;
 }
 
-// AddClients RPC - performs admission control check on a set of clients and adds clients to system if admitted.
-// Assumes RPCs are not multi-threaded
-AdmissionAddClientsRes* admission_controller_add_clients_svc(AdmissionAddClientsArgs* argp, struct svc_req* rqstp)
+// Perform admission control check on a set of clients and add clients to system if admitted.
+// Admissions are serialized with other changes to the committed state.
+void addClients(Json::Value& clientInfos, bool fastFirstFit, AdmissionAddClientsRes* result)
 {
-    static AdmissionAddClientsRes result;
-    // Initialize result
-    result.admitted = true;
-    result.status = ADMISSION_SUCCESS;
-    // Parse input
-    Json::Value clientInfos;
-    if (!stringToJson(argp->clientInfos, clientInfos)) {
-        result.status = ADMISSION_ERR_INVALID_ARGUMENT;
-        result.admitted = false;
-        return &result;
-    }
+    TRACE_SPAN("addClients");
+    pthread_rwlock_wrlock(&g_stateLock);
     // Check parameters
-    result.status = checkClientInfos(clientInfos);
-    if (result.status != ADMISSION_SUCCESS) {
-        result.admitted = false;
-        return &result;
+    vector<FlowLoad> flowLoads;
+    result->status = checkClientInfos(nc, clientInfos, flowLoads);
+    if (result->status != ADMISSION_SUCCESS) {
+        result->admitted = false;
+        pthread_rwlock_unlock(&g_stateLock);
+        return;
     }
     // Check fast first fit
-    if (argp->fastFirstFit) {
+    if (fastFirstFit) {
         // Check overload
-        if (checkOverload(clientInfos)) {
-            result.admitted = false;
-            return &result;
+        if (checkOverload(nc, flowLoads)) {
+            result->admitted = false;
+            pthread_rwlock_unlock(&g_stateLock);
+            return;
         }
     }
     // Add clients
@@ -345,209 +911,762 @@ AdmissionAddClientsRes* admission_controller_add_clients_svc(AdmissionAddClients
         const Json::Value& clientInfo = clientInfos[i];
         ClientId clientId = nc->addClient(clientInfo);
         clientIds.insert(clientId);
-        clientInfoStore[clientId] = clientInfo;
+        storeEnforcerInfos(clientId, clientInfo);
     }
-    if (result.status == ADMISSION_SUCCESS) {
-        bool admitOverride = true;
-        for (unsigned int i = 0; i < clientInfos.size(); i++) {
-            const Json::Value& clientInfo = clientInfos[i];
-            if (!clientInfo.isMember("admitted") || !clientInfo["admitted"].asBool()) {
-                admitOverride = false;
-                break;
-            }
-        }
-        if (!admitOverride) {
+    set<FlowId> affectedFlowIds;
+    nc->getAffectedFlows(affectedFlowIds);
+    if (result->status == ADMISSION_SUCCESS) {
+        if (!checkAdmitOverride(clientInfos)) {
             // Check latency of added clients
-            result.admitted = checkLatency(clientIds);
+            result->admitted = checkLatency(nc, clientIds);
         }
     }
-    if (result.admitted) {
-        // Send RPC to NetEnforcer/NFSEnforcer to update client
+    if (result->admitted) {
+        // Return re-optimized parameters
+        nc->updateShaperParameters();
+        Json::Value flowParameters = Json::arrayValue;
+        for (set<FlowId>::const_iterator it = affectedFlowIds.begin(); it != affectedFlowIds.end(); it++) {
+            Json::Value flowInfo;
+            flowInfo["name"] = Json::Value(nc->getFlow(*it)->name);
+            setFlowParameters(flowInfo, nc);
+            flowParameters.append(flowInfo);
+        }
+        free(result->flowParameters);
+        result->flowParameters = strdup(jsonToString(flowParameters).c_str());
+        // Record commits
         for (unsigned int i = 0; i < clientInfos.size(); i++) {
-            Json::Value& clientInfo = clientInfos[i];
-            Json::Value& clientFlows = clientInfo["flows"];
-            for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
-                Json::Value& flowInfo = clientFlows[flowIndex];
-                if (flowInfo.isMember("enforcerType")) {
-                    if (flowInfo["enforcerType"].asString() == "network") {
-                        updateNetEnforcerClient(flowInfo);
-                    } else if (flowInfo["enforcerType"].asString() == "storage") {
-                        updateNFSEnforcerClient(flowInfo);
-                    }
-                }
-            }
+            Commit commit;
+            commit.type = COMMIT_ADD_CLIENT;
+            commit.info = clientInfos[i];
+            addCommit(commit);
+        }
+        // Send RPCs to NetEnforcer/NFSEnforcer to update the added clients and the re-optimized flows whose parameters changed
+        for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+            const Client* c = nc->getClient(*it);
+            affectedFlowIds.insert(c->flowIds.begin(), c->flowIds.end());
         }
+        updateEnforcers(affectedFlowIds);
     } else {
         // Delete clients
         for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
             ClientId clientId = *it;
-            clientInfoStore.erase(clientId);
+            eraseEnforcerInfos(clientId);
             nc->delClient(clientId);
         }
     }
-    return &result;
+    checkpointIfNeeded();
+    pthread_rwlock_unlock(&g_stateLock);
+}
+
+// AddClients RPC - performs admission control check on a set of clients and adds clients to system if admitted.
+bool_t admission_controller_add_clients_svc(AdmissionAddClientsArgs* argp, AdmissionAddClientsRes* result, struct svc_req* rqstp)
+{
+    // Initialize result
+    result->admitted = true;
+    result->status = ADMISSION_SUCCESS;
+    result->flowParameters = strdup("");
+    // Parse input
+    Json::Value clientInfos;
+    if (!stringToJson(argp->clientInfos, clientInfos)) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        result->admitted = false;
+        return TRUE;
+    }
+    addClients(clientInfos, argp->fastFirstFit, result);
+    return TRUE;
+}
+
+// AddClientsTyped RPC - AddClients RPC with typed clientInfos.
+bool_t admission_controller_add_clients_typed_svc(AdmissionAddClientsTypedArgs* argp, AdmissionAddClientsRes* result, struct svc_req* rqstp)
+{
+    // Initialize result
+    result->admitted = true;
+    result->status = ADMISSION_SUCCESS;
+    result->flowParameters = strdup("");
+    Json::Value clientInfos;
+    decodeClientInfos(argp->clientInfos, clientInfos);
+    addClients(clientInfos, argp->fastFirstFit, result);
+    return TRUE;
+}
+
+// Add a set of clients admitted by another AdmissionController with the same workloads.
+// The clients' and affected flows' shaper curves and priorities are set from the other AdmissionController's flowParameters
+// rather than re-optimized. NetEnforcer/NFSEnforcer are not updated, since they are updated by the other AdmissionController.
+void applyClients(const Json::Value& clientInfos, const Json::Value& flowParameters, AdmissionApplyClientsRes* result)
+{
+    TRACE_SPAN("applyClients");
+    pthread_rwlock_wrlock(&g_stateLock);
+    // Check parameters
+    vector<FlowLoad> flowLoads;
+    result->status = checkClientInfos(nc, clientInfos, flowLoads);
+    if (result->status != ADMISSION_SUCCESS) {
+        pthread_rwlock_unlock(&g_stateLock);
+        return;
+    }
+    // Add clients
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        const Json::Value& clientInfo = clientInfos[i];
+        ClientId clientId = nc->addClient(clientInfo);
+        storeEnforcerInfos(clientId, clientInfo);
+        Commit commit;
+        commit.type = COMMIT_ADD_CLIENT;
+        commit.info = clientInfo;
+        addCommit(commit);
+    }
+    // Set parameters
+    for (unsigned int i = 0; i < flowParameters.size(); i++) {
+        const Json::Value& flowInfo = flowParameters[i];
+        FlowId flowId = nc->getFlowIdByName(flowInfo["name"].asString());
+        if (flowId == InvalidFlowId) {
+            result->status = ADMISSION_ERR_FLOW_NAME_NONEXISTENT;
+            continue;
+        }
+        const Json::Value& rateLimit = flowInfo["rateLimiters"][0u];
+        SimpleArrivalCurve shaperCurve;
+        shaperCurve.r = rateLimit["rate"].asDouble();
+        shaperCurve.b = rateLimit["burst"].asDouble();
+        nc->setShaperCurve(flowId, shaperCurve);
+        nc->setFlowPriority(flowId, flowInfo["priority"].asUInt());
+    }
+    // Parameters of unknown flows are missing, so they must be re-optimized
+    if (result->status == ADMISSION_SUCCESS) {
+        nc->clearAffectedQueues();
+    }
+    checkpointIfNeeded();
+    pthread_rwlock_unlock(&g_stateLock);
+}
+
+// ApplyClients RPC - adds a set of clients admitted by another AdmissionController with the same workloads.
+bool_t admission_controller_apply_clients_svc(AdmissionApplyClientsArgs* argp, AdmissionApplyClientsRes* result, struct svc_req* rqstp)
+{
+    // Parse input
+    Json::Value clientInfos;
+    Json::Value flowParameters;
+    if (!stringToJson(argp->clientInfos, clientInfos) || !stringToJson(argp->flowParameters, flowParameters) || !flowParameters.isArray()) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return TRUE;
+    }
+    applyClients(clientInfos, flowParameters, result);
+    return TRUE;
+}
+
+// ApplyClientsTyped RPC - ApplyClients RPC with typed clientInfos.
+bool_t admission_controller_apply_clients_typed_svc(AdmissionApplyClientsTypedArgs* argp, AdmissionApplyClientsRes* result, struct svc_req* rqstp)
+{
+    // Parse input
+    Json::Value clientInfos;
+    Json::Value flowParameters;
+    if (!stringToJson(argp->flowParameters, flowParameters) || !flowParameters.isArray()) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return TRUE;
+    }
+    decodeClientInfos(argp->clientInfos, clientInfos);
+    applyClients(clientInfos, flowParameters, result);
+    return TRUE;
+}
+
+// Check if a set of clients would be admitted on a snapshot.
+// The clients are tentatively added to the snapshot within a what-if evaluation (see NC::beginWhatIf),
+// so the snapshot is left unchanged and does not need to be re-optimized, as opposed to adding and then deleting the clients.
+// The LPs of the snapshot's client groups are kept across evaluations, so each evaluation is warm started from the last one.
+bool whatIfAdmitted(WorkloadCompactor* snapshot, const Json::Value& clientInfos)
+{
+    snapshot->beginWhatIf();
+    set<ClientId> clientIds;
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        clientIds.insert(snapshot->addClient(clientInfos[i]));
+    }
+    bool admitted = checkLatency(snapshot, clientIds);
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        snapshot->delClient(*it);
+    }
+    snapshot->endWhatIf();
+    return admitted;
+}
+
+// Perform admission control check on a set of clients without adding clients to system.
+// The clients are evaluated on the calling thread's snapshot (see whatIfAdmitted).
+// Probes do not hold g_stateLock while evaluating, so they run in parallel with each other.
+void probeClients(const Json::Value& clientInfos, bool fastFirstFit, AdmissionProbeClientsRes* result)
+{
+    TRACE_SPAN("probeClients");
+    WorkloadCompactor* snapshot = getSnapshot();
+    // Check parameters
+    vector<FlowLoad> flowLoads;
+    result->status = checkClientInfos(snapshot, clientInfos, flowLoads);
+    if (result->status != ADMISSION_SUCCESS) {
+        result->admitted = false;
+        return;
+    }
+    // Check fast first fit
+    if (fastFirstFit) {
+        // Check overload
+        if (checkOverload(snapshot, flowLoads)) {
+            result->admitted = false;
+            return;
+        }
+    }
+    if (checkAdmitOverride(clientInfos)) {
+        return;
+    }
+    // Tentatively add clients and check latency
+    result->admitted = whatIfAdmitted(snapshot, clientInfos);
+}
+
+// ProbeClients RPC - performs admission control check on a set of clients without adding clients to system.
+bool_t admission_controller_probe_clients_svc(AdmissionAddClientsArgs* argp, AdmissionProbeClientsRes* result, struct svc_req* rqstp)
+{
+    // Initialize result
+    result->admitted = true;
+    result->status = ADMISSION_SUCCESS;
+    // Parse input
+    Json::Value clientInfos;
+    if (!stringToJson(argp->clientInfos, clientInfos)) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        result->admitted = false;
+        return TRUE;
+    }
+    probeClients(clientInfos, argp->fastFirstFit, result);
+    return TRUE;
+}
+
+// ProbeClientsTyped RPC - ProbeClients RPC with typed clientInfos.
+bool_t admission_controller_probe_clients_typed_svc(AdmissionAddClientsTypedArgs* argp, AdmissionProbeClientsRes* result, struct svc_req* rqstp)
+{
+    // Initialize result
+    result->admitted = true;
+    result->status = ADMISSION_SUCCESS;
+    Json::Value clientInfos;
+    decodeClientInfos(argp->clientInfos, clientInfos);
+    probeClients(clientInfos, argp->fastFirstFit, result);
+    return TRUE;
+}
+
+// Check if a set of clients would be admitted on a snapshot with their arrival curves scaled by scale.
+bool scaledWhatIfAdmitted(WorkloadCompactor* snapshot, const Json::Value& clientInfos, double scale)
+{
+    Json::Value scaledClientInfos = clientInfos;
+    for (unsigned int i = 0; i < scaledClientInfos.size(); i++) {
+        Json::Value& clientFlows = scaledClientInfos[i]["flows"];
+        for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+            DNC::scaleArrivalInfo(clientFlows[flowIndex], scale);
+        }
+    }
+    return whatIfAdmitted(snapshot, scaledClientInfos);
+}
+
+// Find the largest scale factor in [minScale, maxScale] of a set of clients' arrival curves at which they would be admitted, without adding them to system.
+// Since more load takes longer to serve, admission is assumed to be monotonic in the scale factor, which is found by bisection.
+// Each step is a what-if evaluation on the calling thread's snapshot, which warm starts the LPs from the previous step (see whatIfAdmitted).
+void headroomClients(const Json::Value& clientInfos, bool fastFirstFit, double minScale, double maxScale, double tolerance, AdmissionHeadroomClientsRes* result)
+{
+    TRACE_SPAN("headroomClients");
+    result->headroom = 0;
+    if (!(minScale > 0) || !(maxScale >= minScale) || !(tolerance > 0)) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return;
+    }
+    WorkloadCompactor* snapshot = getSnapshot();
+    // Check parameters
+    vector<FlowLoad> flowLoads;
+    result->status = checkClientInfos(snapshot, clientInfos, flowLoads);
+    if (result->status != ADMISSION_SUCCESS) {
+        return;
+    }
+    // Check fast first fit at the smallest scale
+    if (fastFirstFit) {
+        for (unsigned int i = 0; i < flowLoads.size(); i++) {
+            flowLoads[i].rate *= minScale;
+        }
+        if (checkOverload(snapshot, flowLoads)) {
+            return;
+        }
+    }
+    if (checkAdmitOverride(clientInfos)) {
+        result->headroom = maxScale;
+        return;
+    }
+    // Bisect between an admitted scale and a rejected scale
+    if (!scaledWhatIfAdmitted(snapshot, clientInfos, minScale)) {
+        return;
+    }
+    if ((maxScale == minScale) || scaledWhatIfAdmitted(snapshot, clientInfos, maxScale)) {
+        result->headroom = maxScale;
+        return;
+    }
+    double admittedScale = minScale;
+    double rejectedScale = maxScale;
+    while (rejectedScale - admittedScale > tolerance * admittedScale) {
+        double scale = (admittedScale + rejectedScale) / 2;
+        if (scaledWhatIfAdmitted(snapshot, clientInfos, scale)) {
+            admittedScale = scale;
+        } else {
+            rejectedScale = scale;
+        }
+    }
+    result->headroom = admittedScale;
+}
+
+// HeadroomClientsTyped RPC - finds how much the arrival curves of a set of clients could be scaled and still be admitted, without adding clients to system.
+bool_t admission_controller_headroom_clients_typed_svc(AdmissionHeadroomClientsTypedArgs* argp, AdmissionHeadroomClientsRes* result, struct svc_req* rqstp)
+{
+    Json::Value clientInfos;
+    decodeClientInfos(argp->clientInfos, clientInfos);
+    headroomClients(clientInfos, argp->fastFirstFit, argp->minScale, argp->maxScale, argp->tolerance, result);
+    return TRUE;
 }
 
 // DelClient RPC - delete a client from system.
-// Assumes RPCs are not multi-threaded
-AdmissionDelClientRes* admission_controller_del_client_svc(AdmissionDelClientArgs* argp, struct svc_req* rqstp)
+bool_t admission_controller_del_client_svc(AdmissionDelClientArgs* argp, AdmissionDelClientRes* result, struct svc_req* rqstp)
 {
-    static AdmissionDelClientRes result;
+    TRACE_SPAN("DelClient RPC");
     string name(argp->name);
+    pthread_rwlock_wrlock(&g_stateLock);
     ClientId clientId = nc->getClientIdByName(name);
     // Check that client exists
     if (clientId == InvalidClientId) {
-        result.status = ADMISSION_ERR_CLIENT_NAME_NONEXISTENT;
-        return &result;
-    }
-    // Send RPC to NetEnforcer/NFSEnforcer to remove client
-    assert(clientInfoStore.find(clientId) != clientInfoStore.end());
-    Json::Value& clientInfo = clientInfoStore[clientId];
-    Json::Value& clientFlows = clientInfo["flows"];
-    for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
-        Json::Value& flowInfo = clientFlows[flowIndex];
-        if (flowInfo.isMember("enforcerType")) {
-            if (flowInfo["enforcerType"].asString() == "network") {
-                removeNetEnforcerClient(flowInfo);
-            } else if (flowInfo["enforcerType"].asString() == "storage") {
-                removeNFSEnforcerClient(flowInfo);
-            }
-        }
+        result->status = ADMISSION_ERR_CLIENT_NAME_NONEXISTENT;
+        pthread_rwlock_unlock(&g_stateLock);
+        return TRUE;
     }
+    // Send RPCs to NetEnforcer/NFSEnforcer to remove client
+    removeEnforcers(nc->getClient(clientId)->flowIds);
     // Delete client
-    clientInfoStore.erase(clientId);
+    eraseEnforcerInfos(clientId);
     nc->delClient(clientId);
-    result.status = ADMISSION_SUCCESS;
-    return &result;
+    Commit commit;
+    commit.type = COMMIT_DEL_CLIENT;
+    commit.name = name;
+    addCommit(commit);
+    checkpointIfNeeded();
+    pthread_rwlock_unlock(&g_stateLock);
+    result->status = ADMISSION_SUCCESS;
+    return TRUE;
 }
 
 // AddQueue RPC - add a queue to system.
-// Assumes RPCs are not multi-threaded
-AdmissionAddQueueRes* admission_controller_add_queue_svc(AdmissionAddQueueArgs* argp, struct svc_req* rqstp)
+bool_t admission_controller_add_queue_svc(AdmissionAddQueueArgs* argp, AdmissionAddQueueRes* result, struct svc_req* rqstp)
 {
-    static AdmissionAddQueueRes result;
+    TRACE_SPAN("AddQueue RPC");
     // Parse input
     Json::Value queueInfo;
     if (!stringToJson(argp->queueInfo, queueInfo)) {
-        result.status = ADMISSION_ERR_INVALID_ARGUMENT;
-        return &result;
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return TRUE;
     }
     // Check for valid name
     if (!queueInfo.isMember("name")) {
-        result.status = ADMISSION_ERR_MISSING_ARGUMENT;
-        return &result;
-    }
-    if (nc->getQueueIdByName(queueInfo["name"].asString()) != InvalidQueueId) {
-        result.status = ADMISSION_ERR_QUEUE_NAME_IN_USE;
-        return &result;
+        result->status = ADMISSION_ERR_MISSING_ARGUMENT;
+        return TRUE;
     }
     // Check for valid bandwidth
     if (!queueInfo.isMember("bandwidth")) {
-        result.status = ADMISSION_ERR_MISSING_ARGUMENT;
-        return &result;
+        result->status = ADMISSION_ERR_MISSING_ARGUMENT;
+        return TRUE;
     }
     if (queueInfo["bandwidth"].asDouble() <= 0) {
-        result.status = ADMISSION_ERR_INVALID_ARGUMENT;
-        return &result;
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return TRUE;
+    }
+    pthread_rwlock_wrlock(&g_stateLock);
+    if (nc->getQueueIdByName(queueInfo["name"].asString()) != InvalidQueueId) {
+        result->status = ADMISSION_ERR_QUEUE_NAME_IN_USE;
+        pthread_rwlock_unlock(&g_stateLock);
+        return TRUE;
     }
     // Add queue
     nc->addQueue(queueInfo);
-    result.status = ADMISSION_SUCCESS;
-    return &result;
+    Commit commit;
+    commit.type = COMMIT_ADD_QUEUE;
+    commit.info = queueInfo;
+    addCommit(commit);
+    checkpointIfNeeded();
+    pthread_rwlock_unlock(&g_stateLock);
+    result->status = ADMISSION_SUCCESS;
+    return TRUE;
 }
 
 // DelQueue RPC - delete a queue from system.
-// Assumes RPCs are not multi-threaded
-AdmissionDelQueueRes* admission_controller_del_queue_svc(AdmissionDelQueueArgs* argp, struct svc_req* rqstp)
+bool_t admission_controller_del_queue_svc(AdmissionDelQueueArgs* argp, AdmissionDelQueueRes* result, struct svc_req* rqstp)
 {
-    static AdmissionDelQueueRes result;
+    TRACE_SPAN("DelQueue RPC");
     string name(argp->name);
+    pthread_rwlock_wrlock(&g_stateLock);
     QueueId queueId = nc->getQueueIdByName(name);
     // Check that queue exists
     if (queueId == InvalidQueueId) {
-        result.status = ADMISSION_ERR_QUEUE_NAME_NONEXISTENT;
-        return &result;
+        result->status = ADMISSION_ERR_QUEUE_NAME_NONEXISTENT;
+        pthread_rwlock_unlock(&g_stateLock);
+        return TRUE;
     }
     // Check that queue is empty
     const Queue* q = nc->getQueue(queueId);
     assert(q != NULL);
     if (!q->flows.empty()) {
-        result.status = ADMISSION_ERR_QUEUE_HAS_ACTIVE_FLOWS;
-        return &result;
+        result->status = ADMISSION_ERR_QUEUE_HAS_ACTIVE_FLOWS;
+        pthread_rwlock_unlock(&g_stateLock);
+        return TRUE;
     }
     // Delete queue
     nc->delQueue(queueId);
-    result.status = ADMISSION_SUCCESS;
-    return &result;
+    Commit commit;
+    commit.type = COMMIT_DEL_QUEUE;
+    commit.name = name;
+    addCommit(commit);
+    checkpointIfNeeded();
+    pthread_rwlock_unlock(&g_stateLock);
+    result->status = ADMISSION_SUCCESS;
+    return TRUE;
 }
 
-// Main RPC handler
-void admission_controller_program(struct svc_req* rqstp, register SVCXPRT* transp)
+// UpdateArrivalCurves RPC - replaces the arrival curves of admitted flows with observed r-b curves.
+// The rate limit parameters of the affected flows are re-optimized, and NetEnforcer/NFSEnforcer are updated with the new parameters.
+// Changes are serialized with other changes to the committed state.
+bool_t admission_controller_update_arrival_curves_svc(AdmissionUpdateArrivalCurvesArgs* argp, AdmissionUpdateArrivalCurvesRes* result, struct svc_req* rqstp)
 {
+    TRACE_SPAN("UpdateArrivalCurves RPC");
+    result->status = ADMISSION_SUCCESS;
+    // Parse input
+    Json::Value rbCurves;
+    if (!stringToJson(argp->rbCurves, rbCurves) || !rbCurves.isArray()) {
+        result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+        return TRUE;
+    }
+    pthread_rwlock_wrlock(&g_stateLock);
+    // Set arrival curves
+    set<ClientId> clientIds;
+    for (unsigned int i = 0; i < rbCurves.size(); i++) {
+        const Json::Value& rbCurve = rbCurves[i];
+        string name = rbCurve["name"].asString();
+        FlowId flowId = nc->getFlowIdByName(name);
+        if (flowId == InvalidFlowId) {
+            result->status = ADMISSION_ERR_FLOW_NAME_NONEXISTENT;
+            continue;
+        }
+        const Json::Value& rbRates = rbCurve["rates"];
+        const Json::Value& rbBursts = rbCurve["bursts"];
+        if (!rbRates.isArray() || !rbBursts.isArray() || (rbRates.size() != rbBursts.size()) || (rbRates.size() == 0)) {
+            result->status = ADMISSION_ERR_INVALID_ARGUMENT;
+            continue;
+        }
+        vector<double> rates;
+        vector<double> bursts;
+        for (unsigned int index = 0; index < rbRates.size(); index++) {
+            rates.push_back(rbRates[index].asDouble());
+            bursts.push_back(rbBursts[index].asDouble());
+        }
+        Json::Value flowInfo;
+        DNC::setArrivalInfo(flowInfo, rates, bursts);
+        nc->updateArrivalInfo(flowId, flowInfo);
+        clientIds.insert(nc->getFlow(flowId)->clientId);
+        Commit commit;
+        commit.type = COMMIT_SET_ARRIVAL_INFO;
+        commit.info = flowInfo;
+        commit.name = name;
+        addCommit(commit);
+    }
+    if (clientIds.empty()) {
+        pthread_rwlock_unlock(&g_stateLock);
+        return TRUE;
+    }
+    // Re-optimize parameters
+    set<FlowId> affectedFlowIds;
+    nc->getAffectedFlows(affectedFlowIds);
+    nc->updateShaperParameters();
+    // Send RPCs to NetEnforcer/NFSEnforcer to update affected flows whose parameters changed
+    updateEnforcers(affectedFlowIds);
+    // Report clients that no longer meet their SLO
+    nc->getDirtyClients(clientIds);
+    for (set<ClientId>::const_iterator it = clientIds.begin(); it != clientIds.end(); it++) {
+        ClientId clientId = *it;
+        nc->calcClientLatency(clientId);
+        const Client* c = nc->getClient(clientId);
+        if (c->latency > c->SLO) {
+            cerr << "Client " << c->name << " with latency " << c->latency << " exceeds its SLO " << c->SLO << " with its observed arrival curves" << endl;
+        }
+    }
+    checkpointIfNeeded();
+    pthread_rwlock_unlock(&g_stateLock);
+    return TRUE;
+}
+
+// Decoded RPC waiting to be handled
+struct PendingRequest {
+    SVCXPRT* transp;
+    xdrproc_t xdrArgument;
+    xdrproc_t xdrResult;
+    bool_t (*local)(char*, void*, struct svc_req*);
     union {
         AdmissionAddClientsArgs admission_controller_add_clients_arg;
         AdmissionDelClientArgs admission_controller_del_client_arg;
         AdmissionAddQueueArgs admission_controller_add_queue_arg;
         AdmissionDelQueueArgs admission_controller_del_queue_arg;
+        AdmissionAddClientsArgs admission_controller_probe_clients_arg;
+        AdmissionApplyClientsArgs admission_controller_apply_clients_arg;
+        AdmissionUpdateArrivalCurvesArgs admission_controller_update_arrival_curves_arg;
+        AdmissionAddClientsTypedArgs admission_controller_add_clients_typed_arg;
+        AdmissionAddClientsTypedArgs admission_controller_probe_clients_typed_arg;
+        AdmissionApplyClientsTypedArgs admission_controller_apply_clients_typed_arg;
+        AdmissionHeadroomClientsTypedArgs admission_controller_headroom_clients_typed_arg;
     } argument;
-    char* result;
-    xdrproc_t _xdr_argument, _xdr_result;
-    char* (*local)(char*, struct svc_req*);
+    union {
+        AdmissionAddClientsRes admission_controller_add_clients_res;
+        AdmissionDelClientRes admission_controller_del_client_res;
+        AdmissionAddQueueRes admission_controller_add_queue_res;
+        AdmissionDelQueueRes admission_controller_del_queue_res;
+        AdmissionProbeClientsRes admission_controller_probe_clients_res;
+        AdmissionApplyClientsRes admission_controller_apply_clients_res;
+        AdmissionUpdateArrivalCurvesRes admission_controller_update_arrival_curves_res;
+        AdmissionHeadroomClientsRes admission_controller_headroom_clients_res;
+    } result;
+};
+
+// Handle a decoded RPC and send its reply; arg is a PendingRequest. Run on g_pThreadPool or the main thread.
+void handleRequest(void* arg)
+{
+    TRACE_SPAN("handleRequest");
+    PendingRequest* request = static_cast<PendingRequest*>(arg);
+    SVCXPRT* transp = request->transp;
+    memset((char*)&request->result, 0, sizeof(request->result));
+    bool_t retval = request->local((char*)&request->argument, (void*)&request->result, NULL);
+    if (retval && !svc_sendreply(transp, request->xdrResult, (caddr_t)&request->result)) {
+        svcerr_systemerr(transp);
+    }
+    if (!svc_freeargs(transp, request->xdrArgument, (caddr_t)&request->argument)) {
+        cerr << "Unable to free arguments" << endl;
+    }
+    xdr_free(request->xdrResult, (caddr_t)&request->result);
+    delete request;
+    // Let svcRunThreaded receive the connection's next RPC
+    pthread_mutex_lock(&g_busyMutex);
+    if (g_busyFds.erase(transp->xp_sock) == 1) {
+        char c = 0;
+        if (write(g_wakePipe[1], &c, 1) < 0) {
+            cerr << "Unable to wake RPC server" << endl;
+        }
+    }
+    pthread_mutex_unlock(&g_busyMutex);
+}
+
+// Main RPC handler for versions 1 and 2 (version 2 adds RPCs with typed clientInfos)
+// Decodes the RPC and queues it on g_pThreadPool. The connection is not polled until the reply has been sent (see svcRunThreaded),
+// since a connection's receive and reply share its XDR stream.
+void admission_controller_program(struct svc_req* rqstp, register SVCXPRT* transp)
+{
+    PendingRequest* request = new PendingRequest;
+    request->transp = transp;
 
     switch (rqstp->rq_proc) {
         case ADMISSION_CONTROLLER_NULL:
             svc_sendreply(transp, (xdrproc_t)xdr_void, (caddr_t)NULL);
+            delete request;
             return;
 
         case ADMISSION_CONTROLLER_ADD_CLIENTS:
-            _xdr_argument = (xdrproc_t)xdr_AdmissionAddClientsArgs;
-            _xdr_result = (xdrproc_t)xdr_AdmissionAddClientsRes;
-            local = (char* (*)(char*, struct svc_req*))admission_controller_add_clients_svc;
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionAddClientsArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionAddClientsRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_add_clients_svc;
             break;
 
         case ADMISSION_CONTROLLER_DEL_CLIENT:
-            _xdr_argument = (xdrproc_t)xdr_AdmissionDelClientArgs;
-            _xdr_result = (xdrproc_t)xdr_AdmissionDelClientRes;
-            local = (char* (*)(char*, struct svc_req*))admission_controller_del_client_svc;
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionDelClientArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionDelClientRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_del_client_svc;
             break;
 
         case ADMISSION_CONTROLLER_ADD_QUEUE:
-            _xdr_argument = (xdrproc_t)xdr_AdmissionAddQueueArgs;
-            _xdr_result = (xdrproc_t)xdr_AdmissionAddQueueRes;
-            local = (char* (*)(char*, struct svc_req*))admission_controller_add_queue_svc;
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionAddQueueArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionAddQueueRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_add_queue_svc;
             break;
 
         case ADMISSION_CONTROLLER_DEL_QUEUE:
-            _xdr_argument = (xdrproc_t)xdr_AdmissionDelQueueArgs;
-            _xdr_result = (xdrproc_t)xdr_AdmissionDelQueueRes;
-            local = (char* (*)(char*, struct svc_req*))admission_controller_del_queue_svc;
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionDelQueueArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionDelQueueRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_del_queue_svc;
+            break;
+
+        case ADMISSION_CONTROLLER_PROBE_CLIENTS:
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionAddClientsArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionProbeClientsRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_probe_clients_svc;
+            break;
+
+        case ADMISSION_CONTROLLER_APPLY_CLIENTS:
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionApplyClientsArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionApplyClientsRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_apply_clients_svc;
+            break;
+
+        case ADMISSION_CONTROLLER_UPDATE_ARRIVAL_CURVES:
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionUpdateArrivalCurvesArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionUpdateArrivalCurvesRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_update_arrival_curves_svc;
+            break;
+
+        case ADMISSION_CONTROLLER_ADD_CLIENTS_TYPED:
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionAddClientsTypedArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionAddClientsRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_add_clients_typed_svc;
+            break;
+
+        case ADMISSION_CONTROLLER_PROBE_CLIENTS_TYPED:
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionAddClientsTypedArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionProbeClientsRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_probe_clients_typed_svc;
+            break;
+
+        case ADMISSION_CONTROLLER_APPLY_CLIENTS_TYPED:
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionApplyClientsTypedArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionApplyClientsRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_apply_clients_typed_svc;
+            break;
+
+        case ADMISSION_CONTROLLER_HEADROOM_CLIENTS_TYPED:
+            request->xdrArgument = (xdrproc_t)xdr_AdmissionHeadroomClientsTypedArgs;
+            request->xdrResult = (xdrproc_t)xdr_AdmissionHeadroomClientsRes;
+            request->local = (bool_t (*)(char*, void*, struct svc_req*))admission_controller_headroom_clients_typed_svc;
             break;
 
         default:
             svcerr_noproc(transp);
+            delete request;
             return;
     }
-    memset((char*)&argument, 0, sizeof(argument));
-    if (!svc_getargs(transp, (xdrproc_t)_xdr_argument, (caddr_t)&argument)) {
+    memset((char*)&request->argument, 0, sizeof(request->argument));
+    if (!svc_getargs(transp, request->xdrArgument, (caddr_t)&request->argument)) {
         svcerr_decode(transp);
+        delete request;
         return;
     }
-    result = (*local)((char*)&argument, rqstp);
-    if (result != NULL && !svc_sendreply(transp, (xdrproc_t)_xdr_result, result)) {
-        svcerr_systemerr(transp);
+    // Handle serially if there is no thread pool or if the client has already sent its next RPC,
+    // since svc_getreq_common receives buffered RPCs before returning
+    if ((g_pThreadPool == NULL) || (SVC_STAT(transp) == XPRT_MOREREQS)) {
+        handleRequest(request);
+    } else {
+        pthread_mutex_lock(&g_busyMutex);
+        g_busyFds.insert(transp->xp_sock);
+        pthread_mutex_unlock(&g_busyMutex);
+        g_pThreadPool->addTask(handleRequest, request);
     }
-    if (!svc_freeargs(transp, (xdrproc_t)_xdr_argument, (caddr_t)&argument)) {
-        cerr << "Unable to free arguments" << endl;
+}
+
+// Run the RPC server, like svc_run, except connections with an RPC being handled by g_pThreadPool are not polled.
+void svcRunThreaded()
+{
+    vector<struct pollfd> pollfds;
+    while (true) {
+        // Poll the wake pipe and the connections that are not busy
+        pollfds.resize(1);
+        pollfds[0].fd = g_wakePipe[0];
+        pollfds[0].events = POLLIN;
+        pollfds[0].revents = 0;
+        pthread_mutex_lock(&g_busyMutex);
+        for (int i = 0; i < svc_max_pollfd; i++) {
+            int fd = svc_pollfd[i].fd;
+            if ((fd != -1) && (g_busyFds.find(fd) == g_busyFds.end())) {
+                struct pollfd p;
+                p.fd = fd;
+                p.events = POLLIN | POLLPRI | POLLRDNORM | POLLRDBAND;
+                p.revents = 0;
+                pollfds.push_back(p);
+            }
+        }
+        pthread_mutex_unlock(&g_busyMutex);
+        if (poll(&pollfds[0], pollfds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("svcRunThreaded: poll failed");
+            return;
+        }
+        if (pollfds[0].revents != 0) {
+            char buf[64];
+            while (read(g_wakePipe[0], buf, sizeof(buf)) > 0);
+        }
+        for (unsigned int i = 1; i < pollfds.size(); i++) {
+            if (pollfds[i].revents != 0) {
+                svc_getreq_common(pollfds[i].fd);
+            }
+        }
     }
 }
 
 int main(int argc, char** argv)
 {
+    int opt = 0;
+    string lpCaptureFilename;
+    unsigned int numThreads = 0;
+    g_solverName = defaultSolverName;
+    do {
+        opt = getopt(argc, argv, "s:c:t:k:i:l:");
+        switch (opt) {
+            case 's':
+                g_solverName.assign(optarg);
+                break;
+
+            case 'c':
+                lpCaptureFilename.assign(optarg);
+                break;
+
+            case 't':
+                numThreads = atoi(optarg);
+                break;
+
+            case 'k':
+                g_checkpointFilename.assign(optarg);
+                break;
+
+            case 'i':
+                g_checkpointInterval = atoi(optarg);
+                break;
+
+            case 'l':
+                g_snapshotMaxLag = atoi(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                cerr << "Usage: " << argv[0] << " [-s solverName] [-c lpCaptureFilename] [-t numThreads] [-k checkpointFilename] [-i checkpointInterval] [-l snapshotMaxLag]" << endl;
+                return -1;
+        }
+    } while (opt != -1);
+
     // Create NC
-    nc = new WorkloadCompactor();
+    WorkloadCompactor* wc = new WorkloadCompactor();
+    if (!wc->setSolver(g_solverName)) {
+        delete wc;
+        return -1;
+    }
+    wc->setLPCaptureFile(lpCaptureFilename);
+    nc = wc;
+    pthread_key_create(&g_snapshotKey, NULL);
+
+    // Dump tracing spans on SIGUSR2 (see common/SpanTrace.hpp)
+    TRACE_DUMP_ON_SIGNAL(SIGUSR2, "AdmissionController");
+
+    // Restore committed state
+    if (!g_checkpointFilename.empty() && !restoreCommittedState()) {
+        delete nc;
+        return 1;
+    }
+
+    // Create RPC threads
+    if (numThreads != 1) {
+        if ((pipe(g_wakePipe) != 0) || (fcntl(g_wakePipe[0], F_SETFL, O_NONBLOCK) != 0)) {
+            perror("Failed to create pipe");
+            delete nc;
+            return 1;
+        }
+        signal(SIGPIPE, SIG_IGN);
+        g_pThreadPool = new ThreadPool(numThreads);
+    }
 
     // Unregister AdmissionController RPC handlers
     pmap_unset(ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1);
+    pmap_unset(ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V2);
 
     // Replace tcp RPC handlers
     register SVCXPRT *transp;
@@ -557,14 +1676,19 @@ int main(int argc, char** argv)
         delete nc;
         return 1;
     }
-    if (!svc_register(transp, ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1, admission_controller_program, IPPROTO_TCP)) {
+    if (!svc_register(transp, ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1, admission_controller_program, IPPROTO_TCP) ||
+        !svc_register(transp, ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V2, admission_controller_program, IPPROTO_TCP)) {
         cerr << "Failed to register tcp AdmissionController" << endl;
         delete nc;
         return 1;
     }
 
     // Run proxy
-    svc_run();
+    if (g_pThreadPool != NULL) {
+        svcRunThreaded();
+    } else {
+        svc_run();
+    }
     cerr << "svc_run returned" << endl;
     delete nc;
     return 1;
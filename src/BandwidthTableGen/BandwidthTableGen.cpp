@@ -1,6 +1,9 @@
 // BandwidthTableGen.cpp - tool for building storage profiles for WorkloadCompactor.
 // Calculates read and write bandwidth as a function of request size ranging from 512b to 256kb.
 // Bandwidth tests will perform random I/O to a target file of a given size, and is meant for profiling SSDs.
+// Each request size is profiled at a sweep of queue depths (number of outstanding requests) and read/write mixes, recording
+// bandwidth and latency percentiles. The sync engine keeps one thread per outstanding request, while the io_uring and libaio
+// engines keep all requests outstanding from a single thread, which drives the high queue depths of NVMe devices more cheaply.
 //
 // Command line parameters:
 // -s sizeMB (required) - size of target file to read/write from
@@ -10,6 +13,16 @@
 // -n numThreads (optional) - number of threads to use; defaults to 32
 // -r numReadThreads (optional) - number of threads to use for read bandwidth tests; defaults to numThreads
 // -w numWriteThreads (optional) - number of threads to use for write bandwidth tests; defaults to numThreads
+// -e engine (optional) - I/O engine: sync, io_uring, or libaio; defaults to sync
+//                        io_uring falls back to libaio, and libaio falls back to sync, if the kernel does not support it
+// -q queueDepths (optional) - comma separated queue depths to profile; defaults to numReadThreads for reads,
+//                             numWriteThreads for writes, and numThreads for mixes
+// -m readPercents (optional) - comma separated read percentages of mixed workloads to profile in addition to pure reads and writes
+// -z requestSizes (optional) - comma separated request sizes in bytes; defaults to 65536,98304
+// -p pauseSec (optional) - seconds to pause between tests; defaults to 10
+//
+// The bandwidth table has an entry per request size with the read and write bandwidth at the largest queue depth, which
+// is followed by the bandwidth and latency at each queue depth ("queueDepths") and of each mix ("mixes").
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -18,29 +31,30 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <map>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <cassert>
+#include <cstring>
 #include <random>
+#include <sstream>
 #include "../common/time.hpp"
 #include "../common/common.hpp"
+#include "../common/LatencyHistogram.hpp"
+#include "IOEngine.hpp"
 #include <json/json.h>
 
 using namespace std;
 
-typedef enum {
-    OP_READ,
-    OP_WRITE,
-    OP_MAX
-} disk_op_t;
-
 typedef struct {
-    disk_op_t diskOp;
     string filename;
     vector<uint64_t> offset;
+    vector<bool> isRead; // whether each request is a read or write
     int* count;
     uint64_t requestSize;
+    LatencyHistogram* readLatency;
+    LatencyHistogram* writeLatency;
 } bandwidth_test_t;
 
 // Allocate 512 byte aligned buffer
@@ -81,9 +95,7 @@ void* workerThread(void *arg)
     bandwidth_test_t* args = (bandwidth_test_t*)arg;
     char* buf = allocBuf(args->requestSize); // O_DIRECT requires 512 byte aligned buffer for local filesystems (but not for NFS)
 
-    if (args->diskOp == OP_WRITE) {
-        getRandomData(buf, args->requestSize);
-    }
+    getRandomData(buf, args->requestSize);
 
     // Open file
     int fd = open(args->filename.c_str(), O_RDWR | O_DIRECT);
@@ -97,15 +109,18 @@ void* workerThread(void *arg)
     while ((index = __sync_fetch_and_add(args->count, 1)) < totalCount) {
         uint64_t offset = args->offset[index];
         uint64_t numb = 0;
-        if (args->diskOp == OP_READ) {
+        uint64_t startTime = GetTime();
+        if (args->isRead[index]) {
             numb = pread(fd, buf, args->requestSize, offset);
-        } else if (args->diskOp == OP_WRITE) {
+        } else {
             numb = pwrite(fd, buf, args->requestSize, offset);
         }
         if (numb != args->requestSize) {
             cerr << "Failed to pread/pwrite " << numb << " errno: " << errno << endl;
             exit(-1);
         }
+        uint64_t latency = GetTime() - startTime;
+        (args->isRead[index] ? args->readLatency : args->writeLatency)->record(latency);
     }
     // Close file
     close(fd);
@@ -114,6 +129,117 @@ void* workerThread(void *arg)
     return NULL;
 }
 
+// Performs the requests of args with queueDepth requests outstanding using pEngine
+void asyncTest(bandwidth_test_t* args, IOEngine* pEngine, unsigned int queueDepth)
+{
+    unsigned int totalCount = args->offset.size();
+    if (queueDepth > totalCount) {
+        queueDepth = totalCount;
+    }
+    vector<char*> bufs(queueDepth);
+    vector<unsigned int> slotIndex(queueDepth);
+    vector<uint64_t> slotStartTime(queueDepth);
+    unsigned int nextIndex = 0;
+    unsigned int numCompleted = 0;
+    for (unsigned int slot = 0; slot < queueDepth; slot++) {
+        bufs[slot] = allocBuf(args->requestSize);
+        getRandomData(bufs[slot], args->requestSize);
+    }
+    // Start the first queueDepth requests, then start the next request in each slot as a request completes
+    for (unsigned int slot = 0; slot < queueDepth; slot++) {
+        slotIndex[slot] = nextIndex;
+        slotStartTime[slot] = GetTime();
+        pEngine->queue(slot, args->isRead[nextIndex], bufs[slot], args->requestSize, args->offset[nextIndex]);
+        nextIndex++;
+    }
+    vector<pair<unsigned int, int64_t> > completions;
+    while (numCompleted < totalCount) {
+        completions.clear();
+        if (!pEngine->wait(completions)) {
+            exit(-1);
+        }
+        uint64_t now = GetTime();
+        for (unsigned int i = 0; i < completions.size(); i++) {
+            unsigned int slot = completions[i].first;
+            int64_t numb = completions[i].second;
+            if (numb != (int64_t)args->requestSize) {
+                cerr << "Failed to read/write " << numb << endl;
+                exit(-1);
+            }
+            unsigned int index = slotIndex[slot];
+            (args->isRead[index] ? args->readLatency : args->writeLatency)->record(now - slotStartTime[slot]);
+            numCompleted++;
+            if (nextIndex < totalCount) {
+                slotIndex[slot] = nextIndex;
+                slotStartTime[slot] = now;
+                pEngine->queue(slot, args->isRead[nextIndex], bufs[slot], args->requestSize, args->offset[nextIndex]);
+                nextIndex++;
+            }
+        }
+    }
+    for (unsigned int slot = 0; slot < queueDepth; slot++) {
+        freeBuf(bufs[slot]);
+    }
+}
+
+// Parse a comma separated list of positive integers. Returns false on error.
+bool parseList(const char* s, vector<unsigned int>& values)
+{
+    values.clear();
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        int value = atoi(item.c_str());
+        if (value <= 0) {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+// Summarize the latencies in a histogram (in seconds)
+Json::Value latencyToJson(const LatencyHistogram& histogram)
+{
+    unsigned int firstBucket;
+    vector<uint64_t> counts;
+    histogram.snapshot(firstBucket, counts);
+    uint64_t count = 0;
+    for (unsigned int i = 0; i < counts.size(); i++) {
+        count += counts[i];
+    }
+    Json::Value summary;
+    summary["count"] = (Json::UInt64)count;
+    summary["p50"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.5));
+    summary["p90"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.9));
+    summary["p99"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.99));
+    summary["p999"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.999));
+    summary["max"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 1));
+    return summary;
+}
+
+// Check whether an async engine is supported for target, falling back from io_uring to libaio to sync
+string selectEngine(const string& engine, const string& target)
+{
+    if (engine == "sync") {
+        return engine;
+    }
+    int fd = open(target.c_str(), O_RDWR | O_DIRECT);
+    if (fd == -1) {
+        cerr << "Failed open errno: " << errno << endl;
+        exit(-1);
+    }
+    IOEngine* pEngine = IOEngine::create(engine.c_str(), fd, 1);
+    close(fd);
+    if (pEngine != NULL) {
+        delete pEngine;
+        return engine;
+    }
+    string fallback = (engine == "io_uring") ? "libaio" : "sync";
+    cerr << "Engine " << engine << " is not supported, falling back to " << fallback << endl;
+    return selectEngine(fallback, target);
+}
+
 int main(int argc, char** argv)
 {
     // Process command line options
@@ -123,13 +249,19 @@ int main(int argc, char** argv)
     int numReadThreads = 0;
     int numWriteThreads = 0;
     int sizeMB = 0;
+    int pauseSec = 10;
     string target = "";
     string configFilename;
+    string engine = "sync";
+    vector<unsigned int> queueDepths;
+    vector<unsigned int> readPercents;
+    vector<unsigned int> requestSizes;
+    bool validLists = true;
     mt19937_64 generator;
     random_device rd;
     generator.seed(rd());
     do {
-        opt = getopt(argc, argv, "s:t:f:c:n:r:w:");
+        opt = getopt(argc, argv, "s:t:f:c:n:r:w:e:q:m:z:p:");
         switch (opt) {
             case 's':
                 sizeMB = atoi(optarg);
@@ -159,11 +291,31 @@ int main(int argc, char** argv)
                 numWriteThreads = atoi(optarg);
                 break;
 
+            case 'e':
+                engine.assign(optarg);
+                break;
+
+            case 'q':
+                validLists = validLists && parseList(optarg, queueDepths);
+                break;
+
+            case 'm':
+                validLists = validLists && parseList(optarg, readPercents);
+                break;
+
+            case 'z':
+                validLists = validLists && parseList(optarg, requestSizes);
+                break;
+
+            case 'p':
+                pauseSec = atoi(optarg);
+                break;
+
             case -1:
                 break;
 
             default:
-                cerr << "Usage: " << argv[0] << " -s sizeMB -t target [-f configFilename] [-c count] [-n numThreads] [-r numReadThreads] [-w numWriteThreads]" << endl;
+                cerr << "Usage: " << argv[0] << " -s sizeMB -t target [-f configFilename] [-c count] [-n numThreads] [-r numReadThreads] [-w numWriteThreads] [-e engine] [-q queueDepths] [-m readPercents] [-z requestSizes] [-p pauseSec]" << endl;
                 exit(-1);
                 break;
         }
@@ -174,12 +326,19 @@ int main(int argc, char** argv)
     if (numWriteThreads <= 0) {
         numWriteThreads = numThreads;
     }
+    for (unsigned int i = 0; i < readPercents.size(); i++) {
+        if (readPercents[i] >= 100) {
+            validLists = false;
+        }
+    }
 
     // Check arguments
-    if ((sizeMB < 1) || (target == "") || (count < 1) || (numReadThreads < 1) || (numWriteThreads < 1)) {
-        cerr << "Usage: " << argv[0] << " -s sizeMB -t target [-f configFilename] [-c count] [-n numThreads] [-r numReadThreads] [-w numWriteThreads]" << endl;
+    if ((sizeMB < 1) || (target == "") || (count < 1) || (numThreads < 1) || (numReadThreads < 1) || (numWriteThreads < 1) || (pauseSec < 0) || !validLists ||
+        ((engine != "sync") && (engine != "io_uring") && (engine != "libaio"))) {
+        cerr << "Usage: " << argv[0] << " -s sizeMB -t target [-f configFilename] [-c count] [-n numThreads] [-r numReadThreads] [-w numWriteThreads] [-e engine] [-q queueDepths] [-m readPercents] [-z requestSizes] [-p pauseSec]" << endl;
         exit(-1);
     }
+    engine = selectEngine(engine, target);
 
     // Open base config file
     Json::Value root;
@@ -194,84 +353,139 @@ int main(int argc, char** argv)
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_t* threadArray = new pthread_t[max(numReadThreads, numWriteThreads)];
-    if (threadArray == NULL) {
-        cerr << "Failed to create thread array" << endl;
-        exit(1);
-    }
 
-    vector<unsigned int> requestSizes;
-    //for (unsigned int requestSize = 512; requestSize < 65536; requestSize += 512) {
-    //    requestSizes.push_back(requestSize);
-    //}
-    requestSizes.push_back(64 * 1024);
-    requestSizes.push_back(96 * 1024);
-    //requestSizes.push_back(128 * 1024);
-    //requestSizes.push_back(192 * 1024);
-    //requestSizes.push_back(256 * 1024);
-    vector<double> bwReadTable;
-    vector<double> bwWriteTable;
+    if (requestSizes.empty()) {
+        requestSizes.push_back(64 * 1024);
+        requestSizes.push_back(96 * 1024);
+    }
+    // Pure reads, pure writes, then mixes
+    readPercents.insert(readPercents.begin(), 0);
+    readPercents.insert(readPercents.begin(), 100);
 
+    Json::Value& bwTable = root["bandwidthTable"];
+    bwTable.clear();
     for (unsigned int j = 0; j < requestSizes.size(); j++) { // for each request size
-        for (int diskOp = OP_READ; diskOp < OP_MAX; diskOp++) { // for each operation type
-            int index = 0;
-            bandwidth_test_t args;
-            args.diskOp = (disk_op_t)diskOp;
-            args.filename = target;
-            args.count = &index;
-            args.requestSize = requestSizes[j];
-            int maxBlock = ((((uint64_t)sizeMB) * 1024ull * 1024ull) / args.requestSize) - 1;
-            uniform_int_distribution<uint64_t> distribution(0, maxBlock);
-            for (int i = 0; i < count; i++) {
-                args.offset.push_back(args.requestSize * distribution(generator));
+        Json::Value& bwTableEntry = bwTable[j];
+        bwTableEntry["requestSize"] = requestSizes[j]; // in B
+        map<unsigned int, Json::Value> qdResults; // pure read and write results by queue depth
+        for (unsigned int m = 0; m < readPercents.size(); m++) { // for each read/write mix
+            unsigned int readPercent = readPercents[m];
+            vector<unsigned int> mixQueueDepths = queueDepths;
+            if (mixQueueDepths.empty()) {
+                mixQueueDepths.push_back((readPercent == 100) ? numReadThreads : ((readPercent == 0) ? numWriteThreads : numThreads));
             }
-
-            uint64_t startTime = GetTime();
-            // Create worker threads
-            numThreads = (diskOp == OP_READ) ? numReadThreads : numWriteThreads;
-            for (int i = 0; i < numThreads; i++) {
-                int rc = pthread_create(&threadArray[i],
-                                        &attr,
-                                        workerThread,
-                                        (void*)&args);
-                if (rc) {
-                    cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            for (unsigned int d = 0; d < mixQueueDepths.size(); d++) { // for each queue depth
+                unsigned int queueDepth = mixQueueDepths[d];
+                int index = 0;
+                LatencyHistogram readLatency;
+                LatencyHistogram writeLatency;
+                bandwidth_test_t args;
+                args.filename = target;
+                args.count = &index;
+                args.requestSize = requestSizes[j];
+                args.readLatency = &readLatency;
+                args.writeLatency = &writeLatency;
+                int maxBlock = ((((uint64_t)sizeMB) * 1024ull * 1024ull) / args.requestSize) - 1;
+                if (maxBlock < 0) {
+                    cerr << "Request size " << args.requestSize << " is larger than the target file" << endl;
                     exit(-1);
                 }
-            }
+                uniform_int_distribution<uint64_t> distribution(0, maxBlock);
+                uniform_int_distribution<unsigned int> percentDistribution(0, 99);
+                uint64_t numReads = 0;
+                for (int i = 0; i < count; i++) {
+                    args.offset.push_back(args.requestSize * distribution(generator));
+                    bool isRead = (percentDistribution(generator) < readPercent);
+                    args.isRead.push_back(isRead);
+                    numReads += isRead ? 1 : 0;
+                }
 
-            // Join all threads
-            for (int i = 0; i < numThreads; i++) {
-                int rc = pthread_join(threadArray[i], NULL);
-                if (rc) {
-                    cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
-                    exit(-1);
+                uint64_t startTime = GetTime();
+                if (engine == "sync") {
+                    // Create worker threads, one per outstanding request
+                    vector<pthread_t> threadArray(queueDepth);
+                    for (unsigned int i = 0; i < queueDepth; i++) {
+                        int rc = pthread_create(&threadArray[i],
+                                                &attr,
+                                                workerThread,
+                                                (void*)&args);
+                        if (rc) {
+                            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+                            exit(-1);
+                        }
+                    }
+
+                    // Join all threads
+                    for (unsigned int i = 0; i < queueDepth; i++) {
+                        int rc = pthread_join(threadArray[i], NULL);
+                        if (rc) {
+                            cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
+                            exit(-1);
+                        }
+                    }
+                } else {
+                    int fd = open(target.c_str(), O_RDWR | O_DIRECT);
+                    if (fd == -1) {
+                        cerr << "Failed open errno: " << errno << endl;
+                        exit(-1);
+                    }
+                    IOEngine* pEngine = IOEngine::create(engine.c_str(), fd, queueDepth);
+                    if (pEngine == NULL) {
+                        cerr << "Failed to create " << engine << " engine with queue depth " << queueDepth << endl;
+                        exit(-1);
+                    }
+                    asyncTest(&args, pEngine, queueDepth);
+                    delete pEngine;
+                    close(fd);
                 }
-            }
 
-            // Record bandwidth
-            uint64_t endTime = GetTime();
-            double duration = ConvertTimeToSeconds(endTime - startTime);
-            double bw = ((double)args.requestSize * (double)count) / duration;
-            if (diskOp == OP_READ) {
-                bwReadTable.push_back(bw);
-                cout << "Read " << args.requestSize << ": " << (bw / 1024.0 / 1024.0) << " MB/s" << endl;
-            } else if (diskOp == OP_WRITE) {
-                bwWriteTable.push_back(bw);
-                cout << "Write " << args.requestSize << ": " << (bw / 1024.0 / 1024.0) << " MB/s" << endl;
+                // Record bandwidth
+                uint64_t endTime = GetTime();
+                double duration = ConvertTimeToSeconds(endTime - startTime);
+                double readBw = ((double)args.requestSize * (double)numReads) / duration;
+                double writeBw = ((double)args.requestSize * (double)(count - numReads)) / duration;
+                if (readPercent == 100) {
+                    // Pure reads and writes at the same queue depth share an entry
+                    Json::Value& result = qdResults[queueDepth];
+                    result["queueDepth"] = queueDepth;
+                    result["readBandwidth"] = readBw; // bw in B/s
+                    result["readLatency"] = latencyToJson(readLatency);
+                    cout << "Read " << args.requestSize << " QD " << queueDepth << ": " << (readBw / 1024.0 / 1024.0) << " MB/s" << endl;
+                } else if (readPercent == 0) {
+                    Json::Value& result = qdResults[queueDepth];
+                    result["queueDepth"] = queueDepth;
+                    result["writeBandwidth"] = writeBw; // bw in B/s
+                    result["writeLatency"] = latencyToJson(writeLatency);
+                    cout << "Write " << args.requestSize << " QD " << queueDepth << ": " << (writeBw / 1024.0 / 1024.0) << " MB/s" << endl;
+                } else {
+                    Json::Value result;
+                    result["queueDepth"] = queueDepth;
+                    result["readPercent"] = readPercent;
+                    result["readBandwidth"] = readBw; // bw in B/s
+                    result["writeBandwidth"] = writeBw; // bw in B/s
+                    result["readLatency"] = latencyToJson(readLatency);
+                    result["writeLatency"] = latencyToJson(writeLatency);
+                    bwTableEntry["mixes"].append(result);
+                    cout << "Mix " << readPercent << "% read " << args.requestSize << " QD " << queueDepth << ": " << (readBw / 1024.0 / 1024.0) << " MB/s read, "
+                         << (writeBw / 1024.0 / 1024.0) << " MB/s write" << endl;
+                }
+                RelativeSleepUninterruptible(ConvertSecondsToTime(pauseSec));
             }
-            RelativeSleepUninterruptible(ConvertSecondsToTime(10));
         }
-    }
 
-    // Fill in bandwidth table
-    Json::Value& bwTable = root["bandwidthTable"];
-    bwTable.clear();
-    for (unsigned int j = 0; j < requestSizes.size(); j++) {
-        Json::Value& bwTableEntry = bwTable[j];
-        bwTableEntry["requestSize"] = requestSizes[j]; // in B
-        bwTableEntry["readBandwidth"] = bwReadTable[j]; // bw in B/s
-        bwTableEntry["writeBandwidth"] = bwWriteTable[j];  // bw in B/s
+        // List queue depths in increasing order, and use the bandwidth at the largest queue depth as the request size's bandwidth
+        Json::Value& qdTable = bwTableEntry["queueDepths"];
+        qdTable = Json::Value(Json::arrayValue);
+        for (map<unsigned int, Json::Value>::const_iterator it = qdResults.begin(); it != qdResults.end(); ++it) {
+            const Json::Value& result = it->second;
+            qdTable.append(result);
+            if (result.isMember("readBandwidth")) {
+                bwTableEntry["readBandwidth"] = result["readBandwidth"];
+            }
+            if (result.isMember("writeBandwidth")) {
+                bwTableEntry["writeBandwidth"] = result["writeBandwidth"];
+            }
+        }
     }
 
     // Output results
@@ -284,6 +498,5 @@ int main(int argc, char** argv)
 
     // Cleanup
     pthread_attr_destroy(&attr);
-    delete[] threadArray;
     return 0;
 }
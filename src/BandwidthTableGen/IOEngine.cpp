@@ -0,0 +1,208 @@
+// IOEngine.cpp - Code for the asynchronous I/O engines.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cstring>
+#include <iostream>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "IOEngine.hpp"
+
+using namespace std;
+
+IOEngine* IOEngine::create(const char* name, int fd, unsigned int queueDepth)
+{
+    if (strcmp(name, "io_uring") == 0) {
+        IoUringEngine* pEngine = new IoUringEngine(fd);
+        if (pEngine->init(queueDepth)) {
+            return pEngine;
+        }
+        delete pEngine;
+    } else if (strcmp(name, "libaio") == 0) {
+        AioEngine* pEngine = new AioEngine(fd);
+        if (pEngine->init(queueDepth)) {
+            return pEngine;
+        }
+        delete pEngine;
+    }
+    return NULL;
+}
+
+IoUringEngine::IoUringEngine(int fd)
+    : _fd(fd),
+      _ringFd(-1),
+      _sqRing(MAP_FAILED),
+      _sqRingSize(0),
+      _cqRing(MAP_FAILED),
+      _cqRingSize(0),
+      _sqes((struct io_uring_sqe*)MAP_FAILED),
+      _sqesSize(0),
+      _numQueued(0)
+{
+}
+
+IoUringEngine::~IoUringEngine()
+{
+    if (_sqes != MAP_FAILED) {
+        munmap(_sqes, _sqesSize);
+    }
+    if (_cqRing != MAP_FAILED) {
+        munmap(_cqRing, _cqRingSize);
+    }
+    if (_sqRing != MAP_FAILED) {
+        munmap(_sqRing, _sqRingSize);
+    }
+    if (_ringFd >= 0) {
+        close(_ringFd);
+    }
+}
+
+bool IoUringEngine::init(unsigned int queueDepth)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _ringFd = syscall(__NR_io_uring_setup, queueDepth, &params);
+    if (_ringFd < 0) {
+        return false;
+    }
+    // Map the rings of submission queue indexes and completions, and the array of submission queue entries
+    _sqRingSize = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+    _cqRingSize = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+    _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqRing = mmap(NULL, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQ_RING);
+    _cqRing = mmap(NULL, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_CQ_RING);
+    _sqes = (struct io_uring_sqe*)mmap(NULL, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ringFd, IORING_OFF_SQES);
+    if ((_sqRing == MAP_FAILED) || (_cqRing == MAP_FAILED) || (_sqes == MAP_FAILED)) {
+        perror("Failed to map io_uring");
+        return false;
+    }
+    char* sqRing = (char*)_sqRing;
+    char* cqRing = (char*)_cqRing;
+    _sqTail = (unsigned int*)(sqRing + params.sq_off.tail);
+    _sqMask = *(unsigned int*)(sqRing + params.sq_off.ring_mask);
+    _sqArray = (unsigned int*)(sqRing + params.sq_off.array);
+    _cqHead = (unsigned int*)(cqRing + params.cq_off.head);
+    _cqTail = (unsigned int*)(cqRing + params.cq_off.tail);
+    _cqMask = *(unsigned int*)(cqRing + params.cq_off.ring_mask);
+    _cqes = (struct io_uring_cqe*)(cqRing + params.cq_off.cqes);
+    return true;
+}
+
+void IoUringEngine::queue(unsigned int slot, bool isRead, char* buf, uint64_t len, uint64_t offset)
+{
+    // At most queueDepth requests are outstanding, so the submission queue has room
+    unsigned int tail = *_sqTail + _numQueued;
+    unsigned int index = tail & _sqMask;
+    struct io_uring_sqe* sqe = &_sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = isRead ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = _fd;
+    sqe->addr = (uint64_t)(uintptr_t)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = slot;
+    _sqArray[index] = index;
+    _numQueued++;
+}
+
+bool IoUringEngine::wait(vector<pair<unsigned int, int64_t> >& completions)
+{
+    // Publish the queued entries before the kernel reads the new tail
+    __sync_synchronize();
+    *_sqTail += _numQueued;
+    unsigned int numSubmit = _numQueued;
+    _numQueued = 0;
+    while (true) {
+        int rc = syscall(__NR_io_uring_enter, _ringFd, numSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc >= 0) {
+            numSubmit -= (rc < (int)numSubmit) ? rc : numSubmit;
+            if (numSubmit == 0) {
+                break;
+            }
+        } else if (errno != EINTR) {
+            perror("Failed io_uring_enter");
+            return false;
+        }
+    }
+    // Reap completions
+    unsigned int head = *_cqHead;
+    unsigned int tail = *_cqTail;
+    __sync_synchronize();
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &_cqes[head & _cqMask];
+        completions.push_back(make_pair((unsigned int)cqe->user_data, (int64_t)cqe->res));
+        head++;
+    }
+    // Release the completion entries after reading them
+    __sync_synchronize();
+    *_cqHead = head;
+    return true;
+}
+
+AioEngine::AioEngine(int fd)
+    : _fd(fd),
+      _ctx(0)
+{
+}
+
+AioEngine::~AioEngine()
+{
+    if (_ctx != 0) {
+        syscall(__NR_io_destroy, _ctx);
+    }
+}
+
+bool AioEngine::init(unsigned int queueDepth)
+{
+    if (syscall(__NR_io_setup, queueDepth, &_ctx) < 0) {
+        _ctx = 0;
+        return false;
+    }
+    _iocbs.resize(queueDepth);
+    _events.resize(queueDepth);
+    return true;
+}
+
+void AioEngine::queue(unsigned int slot, bool isRead, char* buf, uint64_t len, uint64_t offset)
+{
+    struct iocb& cb = _iocbs[slot];
+    memset(&cb, 0, sizeof(cb));
+    cb.aio_data = slot;
+    cb.aio_lio_opcode = isRead ? IOCB_CMD_PREAD : IOCB_CMD_PWRITE;
+    cb.aio_fildes = _fd;
+    cb.aio_buf = (uint64_t)(uintptr_t)buf;
+    cb.aio_nbytes = len;
+    cb.aio_offset = offset;
+    _queued.push_back(&cb);
+}
+
+bool AioEngine::wait(vector<pair<unsigned int, int64_t> >& completions)
+{
+    unsigned int numSubmitted = 0;
+    while (numSubmitted < _queued.size()) {
+        long rc = syscall(__NR_io_submit, _ctx, _queued.size() - numSubmitted, &_queued[numSubmitted]);
+        if (rc > 0) {
+            numSubmitted += rc;
+        } else if ((rc < 0) && (errno != EINTR) && (errno != EAGAIN)) {
+            perror("Failed io_submit");
+            return false;
+        }
+    }
+    _queued.clear();
+    long numEvents;
+    do {
+        numEvents = syscall(__NR_io_getevents, _ctx, 1, _events.size(), &_events[0], NULL);
+    } while ((numEvents < 0) && (errno == EINTR));
+    if (numEvents < 0) {
+        perror("Failed io_getevents");
+        return false;
+    }
+    for (long i = 0; i < numEvents; i++) {
+        completions.push_back(make_pair((unsigned int)_events[i].data, (int64_t)_events[i].res));
+    }
+    return true;
+}
@@ -0,0 +1,86 @@
+// IOEngine.hpp - Asynchronous I/O engines for keeping many requests outstanding from one thread.
+// The engines use the io_uring and Linux AIO system calls directly, so liburing and libaio are not needed.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _IO_ENGINE_HPP
+#define _IO_ENGINE_HPP
+
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include <linux/aio_abi.h>
+#include <linux/io_uring.h>
+
+using namespace std;
+
+class IOEngine
+{
+public:
+    virtual ~IOEngine() {}
+
+    // Queue a read/write of len bytes at offset of the engine's file; slot (< queueDepth) identifies the request when it completes.
+    virtual void queue(unsigned int slot, bool isRead, char* buf, uint64_t len, uint64_t offset) = 0;
+    // Submit the queued requests and wait for at least one request to complete.
+    // Appends the slot and result (bytes transferred or -errno) of each completed request. Returns false on error.
+    virtual bool wait(vector<pair<unsigned int, int64_t> >& completions) = 0;
+
+    // Create an io_uring ("io_uring") or Linux AIO ("libaio") engine for up to queueDepth outstanding requests on fd.
+    // Returns NULL if the engine is unknown or unavailable (e.g., io_uring is disabled).
+    static IOEngine* create(const char* name, int fd, unsigned int queueDepth);
+};
+
+// Engine using an io_uring submission/completion ring pair
+class IoUringEngine : public IOEngine
+{
+private:
+    int _fd;
+    int _ringFd;
+    void* _sqRing;
+    size_t _sqRingSize;
+    void* _cqRing;
+    size_t _cqRingSize;
+    struct io_uring_sqe* _sqes;
+    size_t _sqesSize;
+    volatile unsigned int* _sqTail;
+    unsigned int _sqMask;
+    unsigned int* _sqArray;
+    volatile unsigned int* _cqHead;
+    volatile unsigned int* _cqTail;
+    unsigned int _cqMask;
+    struct io_uring_cqe* _cqes;
+    unsigned int _numQueued; // requests queued since the last submit
+
+public:
+    IoUringEngine(int fd);
+    virtual ~IoUringEngine();
+    // Set up the rings. Returns false on error.
+    bool init(unsigned int queueDepth);
+
+    virtual void queue(unsigned int slot, bool isRead, char* buf, uint64_t len, uint64_t offset);
+    virtual bool wait(vector<pair<unsigned int, int64_t> >& completions);
+};
+
+// Engine using the Linux AIO system calls (io_submit/io_getevents)
+class AioEngine : public IOEngine
+{
+private:
+    int _fd;
+    aio_context_t _ctx;
+    vector<struct iocb> _iocbs; // iocb of each slot
+    vector<struct iocb*> _queued;
+    vector<struct io_event> _events;
+
+public:
+    AioEngine(int fd);
+    virtual ~AioEngine();
+    // Set up the AIO context. Returns false on error.
+    bool init(unsigned int queueDepth);
+
+    virtual void queue(unsigned int slot, bool isRead, char* buf, uint64_t len, uint64_t offset);
+    virtual bool wait(vector<pair<unsigned int, int64_t> >& completions);
+};
+
+#endif // _IO_ENGINE_HPP
@@ -0,0 +1,342 @@
+// ArrivalCurveCache.cpp - Code for a persistent cache of arrival curves.
+// See ArrivalCurveCache.hpp for details.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <json/json.h>
+#include "../common/SpanTrace.hpp"
+#include "ArrivalCurveCache.hpp"
+
+using namespace std;
+
+// Size of each read when hashing a trace.
+#define TRACE_HASH_CHUNK_SIZE (1024 * 1024)
+
+uint64_t hashFNV1a(const void* data, size_t size, uint64_t hash)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+ArrivalCurveCache::ArrivalCurveCache(string filename, unsigned int capacity)
+    : _filename(filename),
+      _capacity(capacity),
+      _map(NULL),
+      _mapSize(0),
+      _indexedSize(0)
+{
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+ArrivalCurveCache::~ArrivalCurveCache()
+{
+    if (_map != NULL) {
+        munmap(_map, _mapSize);
+    }
+    pthread_mutex_destroy(&_mutex);
+}
+
+string ArrivalCurveCache::getDescription(string trace, const Json::Value& estimatorInfo, double maxRate)
+{
+    Json::FastWriter writer;
+    ostringstream oss;
+    oss << trace << "\n" << writer.write(estimatorInfo) << setprecision(17) << maxRate;
+    return oss.str();
+}
+
+bool ArrivalCurveCache::getTraceHash(uint64_t& hash, uint64_t& size, string trace)
+{
+    struct stat st;
+    if (stat(trace.c_str(), &st) != 0) {
+        return false;
+    }
+    pthread_mutex_lock(&_mutex);
+    map<string, TraceHash>::const_iterator it = _traceHashes.find(trace);
+    if ((it != _traceHashes.end()) &&
+        (it->second.size == st.st_size) &&
+        (it->second.mtime == st.st_mtim.tv_sec) &&
+        (it->second.mtimeNsec == st.st_mtim.tv_nsec)) {
+        hash = it->second.hash;
+        size = it->second.size;
+        pthread_mutex_unlock(&_mutex);
+        return true;
+    }
+    pthread_mutex_unlock(&_mutex);
+    // Hash the trace without holding the mutex; concurrent callers may hash the same trace, but they compute the same hash
+    int fd = open(trace.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    vector<char> buf(TRACE_HASH_CHUNK_SIZE);
+    uint64_t h = hashFNV1a(NULL, 0);
+    ssize_t bytes;
+    while ((bytes = read(fd, &buf[0], buf.size())) > 0) {
+        h = hashFNV1a(&buf[0], bytes, h);
+    }
+    close(fd);
+    if (bytes < 0) {
+        return false;
+    }
+    pthread_mutex_lock(&_mutex);
+    TraceHash& traceHash = _traceHashes[trace];
+    traceHash.size = st.st_size;
+    traceHash.mtime = st.st_mtim.tv_sec;
+    traceHash.mtimeNsec = st.st_mtim.tv_nsec;
+    traceHash.hash = h;
+    pthread_mutex_unlock(&_mutex);
+    hash = h;
+    size = st.st_size;
+    return true;
+}
+
+bool ArrivalCurveCache::getKey(Key& key, string trace, const Json::Value& estimatorInfo, double maxRate)
+{
+    if (!getTraceHash(key.traceHash, key.traceSize, trace)) {
+        return false;
+    }
+    Json::FastWriter writer;
+    key.estimatorConfig = writer.write(estimatorInfo);
+    key.maxRate = maxRate;
+    key.hash = hashFNV1a(&key.traceHash, sizeof(key.traceHash));
+    key.hash = hashFNV1a(&key.traceSize, sizeof(key.traceSize), key.hash);
+    key.hash = hashFNV1a(key.estimatorConfig.data(), key.estimatorConfig.size(), key.hash);
+    key.hash = hashFNV1a(&key.maxRate, sizeof(key.maxRate), key.hash);
+    return true;
+}
+
+// Size of the estimator configuration in a record, including padding.
+static size_t paddedConfigSize(size_t size)
+{
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+size_t ArrivalCurveCache::indexStore(int fd)
+{
+    struct stat st;
+    if ((fstat(fd, &st) != 0) || (st.st_size < ARRIVAL_CURVE_CACHE_MAGIC_SIZE)) {
+        return 0;
+    }
+    size_t fileSize = st.st_size;
+    if (fileSize < _indexedSize) {
+        // Store was replaced; index it again
+        _storeIndex.clear();
+        _indexedSize = 0;
+    }
+    if (fileSize != _mapSize) {
+        void* map = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            cerr << "Unable to mmap " << _filename << endl;
+            return _indexedSize;
+        }
+        if (_map != NULL) {
+            munmap(_map, _mapSize);
+        }
+        _map = map;
+        _mapSize = fileSize;
+    }
+    const char* base = static_cast<const char*>(_map);
+    if (_indexedSize == 0) {
+        if (memcmp(base, ARRIVAL_CURVE_CACHE_MAGIC, ARRIVAL_CURVE_CACHE_MAGIC_SIZE) != 0) {
+            cerr << "Invalid arrival curve cache " << _filename << endl;
+            return 0;
+        }
+        _indexedSize = ARRIVAL_CURVE_CACHE_MAGIC_SIZE;
+    }
+    // Index complete records; a partial record at the end is left by an interrupted writer
+    while (_indexedSize + sizeof(ArrivalCurveRecordHeader) <= _mapSize) {
+        ArrivalCurveRecordHeader header;
+        memcpy(&header, base + _indexedSize, sizeof(header));
+        // Bound the sizes by the file size before computing the record size so that it cannot overflow
+        if ((header.estimatorConfigSize > _mapSize) || (header.numPoints > _mapSize / (3 * sizeof(double)))) {
+            break;
+        }
+        size_t recordSize = sizeof(header) + paddedConfigSize(header.estimatorConfigSize) + header.numPoints * 3 * sizeof(double);
+        if (_indexedSize + recordSize > _mapSize) {
+            break;
+        }
+        _storeIndex.insert(make_pair(header.hash, _indexedSize));
+        _indexedSize += recordSize;
+    }
+    return _indexedSize;
+}
+
+size_t ArrivalCurveCache::findStore(const Key& key)
+{
+    const char* base = static_cast<const char*>(_map);
+    pair<multimap<uint64_t, size_t>::const_iterator, multimap<uint64_t, size_t>::const_iterator> range = _storeIndex.equal_range(key.hash);
+    for (multimap<uint64_t, size_t>::const_iterator it = range.first; it != range.second; it++) {
+        // Compare the full key, since different keys can have the same hash
+        ArrivalCurveRecordHeader header;
+        memcpy(&header, base + it->second, sizeof(header));
+        if ((header.traceHash == key.traceHash) &&
+            (header.traceSize == key.traceSize) &&
+            (memcmp(&header.maxRate, &key.maxRate, sizeof(key.maxRate)) == 0) &&
+            (header.estimatorConfigSize == key.estimatorConfig.size()) &&
+            (memcmp(base + it->second + sizeof(header), key.estimatorConfig.data(), key.estimatorConfig.size()) == 0)) {
+            return it->second;
+        }
+    }
+    return 0;
+}
+
+bool ArrivalCurveCache::readStore(Curve& arrivalCurve, const Key& key)
+{
+    size_t offset = findStore(key);
+    if (offset == 0) {
+        // Index records added by other processes
+        int fd = open(_filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        flock(fd, LOCK_SH);
+        indexStore(fd);
+        flock(fd, LOCK_UN);
+        close(fd);
+        offset = findStore(key);
+        if (offset == 0) {
+            return false;
+        }
+    }
+    // Records are never modified once written, so they can be read without the flock
+    const char* record = static_cast<const char*>(_map) + offset;
+    ArrivalCurveRecordHeader header;
+    memcpy(&header, record, sizeof(header));
+    const char* points = record + sizeof(header) + paddedConfigSize(header.estimatorConfigSize);
+    arrivalCurve.resize(header.numPoints);
+    for (unsigned int i = 0; i < header.numPoints; i++) {
+        double p[3];
+        memcpy(p, points + i * sizeof(p), sizeof(p));
+        arrivalCurve[i] = PointSlope(p[0], p[1], p[2]);
+    }
+    return true;
+}
+
+void ArrivalCurveCache::writeStore(const Curve& arrivalCurve, const Key& key)
+{
+    int fd = open(_filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return;
+    }
+    flock(fd, LOCK_EX);
+    size_t end = indexStore(fd);
+    if (end == 0) {
+        // Initialize a new store, replacing one that is incomplete or has a different magic string (e.g., an older version)
+        char magic[ARRIVAL_CURVE_CACHE_MAGIC_SIZE];
+        if (((pread(fd, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic))) ||
+             (memcmp(magic, ARRIVAL_CURVE_CACHE_MAGIC, sizeof(magic)) != 0)) &&
+            (ftruncate(fd, 0) == 0) &&
+            (pwrite(fd, ARRIVAL_CURVE_CACHE_MAGIC, ARRIVAL_CURVE_CACHE_MAGIC_SIZE, 0) == ARRIVAL_CURVE_CACHE_MAGIC_SIZE)) {
+            end = indexStore(fd);
+        }
+    }
+    if ((end > 0) && (findStore(key) == 0)) {
+        // Drop any partial record left by an interrupted writer
+        if (ftruncate(fd, end) != 0) {
+            cerr << "Unable to truncate " << _filename << endl;
+        } else {
+            ArrivalCurveRecordHeader header;
+            header.hash = key.hash;
+            header.traceHash = key.traceHash;
+            header.traceSize = key.traceSize;
+            header.maxRate = key.maxRate;
+            header.estimatorConfigSize = key.estimatorConfig.size();
+            header.numPoints = arrivalCurve.size();
+            size_t pointsOffset = sizeof(header) + paddedConfigSize(header.estimatorConfigSize);
+            vector<char> record(pointsOffset + header.numPoints * 3 * sizeof(double), 0);
+            memcpy(&record[0], &header, sizeof(header));
+            memcpy(&record[sizeof(header)], key.estimatorConfig.data(), key.estimatorConfig.size());
+            for (unsigned int i = 0; i < arrivalCurve.size(); i++) {
+                double p[3] = {arrivalCurve[i].x, arrivalCurve[i].y, arrivalCurve[i].slope};
+                memcpy(&record[pointsOffset + i * sizeof(p)], p, sizeof(p));
+            }
+            if (pwrite(fd, &record[0], record.size(), end) != static_cast<ssize_t>(record.size())) {
+                cerr << "Unable to write " << _filename << endl;
+            }
+        }
+    }
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+void ArrivalCurveCache::addLRU(const string& description, const Curve& arrivalCurve)
+{
+    map<string, LRUList::iterator>::iterator it = _lruIndex.find(description);
+    if (it != _lruIndex.end()) {
+        it->second->second = arrivalCurve;
+        _lru.splice(_lru.begin(), _lru, it->second);
+        return;
+    }
+    if (_capacity == 0) {
+        return;
+    }
+    if (_lru.size() >= _capacity) {
+        _lruIndex.erase(_lru.back().first);
+        _lru.pop_back();
+    }
+    _lru.push_front(make_pair(description, arrivalCurve));
+    _lruIndex[description] = _lru.begin();
+}
+
+bool ArrivalCurveCache::get(Curve& arrivalCurve, string trace, const Json::Value& estimatorInfo, double maxRate)
+{
+    TRACE_SPAN("ArrivalCurveCache::get");
+    string description = getDescription(trace, estimatorInfo, maxRate);
+    pthread_mutex_lock(&_mutex);
+    map<string, LRUList::iterator>::iterator it = _lruIndex.find(description);
+    if (it != _lruIndex.end()) {
+        _lru.splice(_lru.begin(), _lru, it->second);
+        arrivalCurve = it->second->second;
+        pthread_mutex_unlock(&_mutex);
+        return true;
+    }
+    pthread_mutex_unlock(&_mutex);
+    // Compute the key (which may hash the trace) without holding the mutex
+    Key key;
+    if ((_filename == "") || !getKey(key, trace, estimatorInfo, maxRate)) {
+        return false;
+    }
+    pthread_mutex_lock(&_mutex);
+    bool found = readStore(arrivalCurve, key);
+    if (found) {
+        addLRU(description, arrivalCurve);
+    }
+    pthread_mutex_unlock(&_mutex);
+    return found;
+}
+
+void ArrivalCurveCache::put(const Curve& arrivalCurve, string trace, const Json::Value& estimatorInfo, double maxRate)
+{
+    string description = getDescription(trace, estimatorInfo, maxRate);
+    // Compute the key (which may hash the trace) without holding the mutex
+    Key key;
+    bool hasKey = (_filename != "") && getKey(key, trace, estimatorInfo, maxRate);
+    pthread_mutex_lock(&_mutex);
+    addLRU(description, arrivalCurve);
+    if (hasKey) {
+        writeStore(arrivalCurve, key);
+    }
+    pthread_mutex_unlock(&_mutex);
+}
+
+unsigned int ArrivalCurveCache::size()
+{
+    pthread_mutex_lock(&_mutex);
+    unsigned int size = _lru.size();
+    pthread_mutex_unlock(&_mutex);
+    return size;
+}
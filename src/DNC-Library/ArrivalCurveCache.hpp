@@ -0,0 +1,127 @@
+// ArrivalCurveCache.hpp - Class definitions for a persistent cache of arrival curves.
+// Arrival curves are expensive to calculate, so they are cached across placements and across processes.
+// Curves are content-addressed: the key is the hash and size of the trace contents, the estimator configuration, and the max rate,
+// so changing any of them (e.g., a reprofiled estimator) results in a different key rather than a stale curve.
+// Records are indexed by a hash of the key, and a hit is confirmed by comparing the record's full key, so that a hash collision is a miss.
+//
+// The persistent store is a single binary file (in host byte order) consisting of:
+// 1) magic string ARRIVAL_CURVE_CACHE_MAGIC
+// 2) records appended one after another, each consisting of an ArrivalCurveRecordHeader, the estimator configuration
+//    (padded with zeros to a multiple of 8 bytes), and numPoints (x, y, slope) doubles
+// A store with a different magic string (e.g., from an older version) is replaced by the first write.
+// Records are only ever appended. Writers hold an exclusive flock while appending and readers hold a shared flock while indexing,
+// so concurrent processes only ever see complete records. The store is memory mapped and indexed by key on first use.
+//
+// Lookups first check an in-process LRU keyed by the trace name, estimator configuration, and max rate,
+// so repeated lookups of the same workload do not touch the filesystem.
+// The LRU assumes traces are not modified while the process is running; the persistent store is keyed by content and is never stale.
+// ArrivalCurveCache is thread-safe.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _ARRIVAL_CURVE_CACHE_HPP
+#define _ARRIVAL_CURVE_CACHE_HPP
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <list>
+#include <map>
+#include <string>
+#include <json/json.h>
+#include "DNC.hpp"
+
+using namespace std;
+
+// Arrival curve cache files start with this magic string.
+#define ARRIVAL_CURVE_CACHE_MAGIC "WCCURVE2"
+#define ARRIVAL_CURVE_CACHE_MAGIC_SIZE 8
+// Default number of curves kept in the in-process LRU.
+#define ARRIVAL_CURVE_CACHE_LRU_SIZE 1024
+
+// Header of each record in an arrival curve cache file.
+struct ArrivalCurveRecordHeader {
+    uint64_t hash; // hash of the key
+    // Key
+    uint64_t traceHash;
+    uint64_t traceSize;
+    double maxRate;
+    uint64_t estimatorConfigSize; // bytes of estimator configuration, excluding padding
+    uint64_t numPoints;
+};
+
+class ArrivalCurveCache
+{
+private:
+    typedef list<pair<string, Curve> > LRUList;
+
+    // Key of a curve in the persistent store
+    struct Key {
+        uint64_t traceHash;
+        uint64_t traceSize;
+        string estimatorConfig;
+        double maxRate;
+        uint64_t hash;
+    };
+
+    // Content hash of a trace, valid as long as the trace's size and modification time are unchanged.
+    struct TraceHash {
+        off_t size;
+        time_t mtime;
+        long mtimeNsec;
+        uint64_t hash;
+    };
+
+    string _filename;
+    unsigned int _capacity;
+    // Protects all state below
+    pthread_mutex_t _mutex;
+    // Most recently used curves first, keyed by description
+    LRUList _lru;
+    map<string, LRUList::iterator> _lruIndex;
+    map<string, TraceHash> _traceHashes;
+    // Offset of each record in the persistent store by the hash of its key
+    multimap<uint64_t, size_t> _storeIndex;
+    void* _map;
+    size_t _mapSize;
+    // Bytes of the persistent store that have been indexed
+    size_t _indexedSize;
+
+    // Describes a curve for the in-process LRU.
+    static string getDescription(string trace, const Json::Value& estimatorInfo, double maxRate);
+    // Calculate the content hash and size of a trace, reusing the previous hash if the trace is unchanged.
+    // Takes the mutex only to look up and save the hash, so that traces are hashed without holding it.
+    bool getTraceHash(uint64_t& hash, uint64_t& size, string trace);
+    // Calculate the key of a curve. Assumes mutex not held.
+    bool getKey(Key& key, string trace, const Json::Value& estimatorInfo, double maxRate);
+    // Returns the offset of the record with key in the mapped store, or 0 if none is indexed. Assumes mutex held.
+    size_t findStore(const Key& key);
+    // Map and index any new records in the store open as fd. Returns the end of the last complete record.
+    // Assumes mutex and flock held.
+    size_t indexStore(int fd);
+    // Read a curve from the mapped store. Assumes mutex held.
+    bool readStore(Curve& arrivalCurve, const Key& key);
+    // Append a curve to the store if not already present. Assumes mutex held.
+    void writeStore(const Curve& arrivalCurve, const Key& key);
+    // Add a curve to the in-process LRU, evicting the least recently used curve if full. Assumes mutex held.
+    void addLRU(const string& description, const Curve& arrivalCurve);
+
+public:
+    // Creates a cache backed by the store in filename; an empty filename keeps curves in memory only.
+    ArrivalCurveCache(string filename = "", unsigned int capacity = ARRIVAL_CURVE_CACHE_LRU_SIZE);
+    ~ArrivalCurveCache();
+
+    // Get a cached arrival curve. Returns false if not cached.
+    bool get(Curve& arrivalCurve, string trace, const Json::Value& estimatorInfo, double maxRate);
+    // Cache an arrival curve.
+    void put(const Curve& arrivalCurve, string trace, const Json::Value& estimatorInfo, double maxRate);
+    // Returns the number of curves in the in-process LRU.
+    unsigned int size();
+};
+
+// Return the 64-bit FNV-1a hash of data, continuing from hash.
+uint64_t hashFNV1a(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+#endif // _ARRIVAL_CURVE_CACHE_HPP
@@ -5,6 +5,7 @@
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>
 #include <string>
@@ -15,12 +16,21 @@
 #include <map>
 #include <set>
 #include <limits>
+#include <list>
+#include <queue>
 #include <json/json.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RB_KERNEL_SIMD
+#include <immintrin.h>
+#endif
 #include "../TraceCommon/ProcessedTrace.hpp"
 #include "../common/time.hpp"
 #include "../common/serializeJSON.hpp"
+#include "../common/ThreadPool.hpp"
+#include "../common/SpanTrace.hpp"
 #include "NC.hpp"
 #include "DNC.hpp"
+#include "ArrivalCurveCache.hpp"
 
 using namespace std;
 
@@ -30,14 +40,24 @@ double calcMinRate(ProcessedTrace* pTrace)
     pTrace->reset();
     // Sum work over trace
     double rate = 0;
-    ProcessedTraceEntry traceEntry;
-    if (pTrace->nextEntry(traceEntry)) {
-        uint64_t firstTimestamp = traceEntry.arrivalTime;
-        do {
-            rate += traceEntry.work;
-        } while (pTrace->nextEntry(traceEntry));
+    bool empty = true;
+    uint64_t firstTimestamp = 0;
+    uint64_t lastTimestamp = 0;
+    vector<ProcessedTraceEntry> traceEntries(PROCESSED_TRACE_BATCH_SIZE);
+    unsigned int count;
+    while ((count = pTrace->nextEntries(&traceEntries[0], traceEntries.size())) > 0) {
+        if (empty) {
+            empty = false;
+            firstTimestamp = traceEntries[0].arrivalTime;
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            rate += traceEntries[i].work;
+        }
+        lastTimestamp = traceEntries[count - 1].arrivalTime;
+    }
+    if (!empty) {
         // Divide by total duration to get average
-        double duration = ConvertTimeToSeconds(traceEntry.arrivalTime - firstTimestamp);
+        double duration = ConvertTimeToSeconds(lastTimestamp - firstTimestamp);
         rate /= duration;
     } else {
         cerr << "Empty trace file" << endl;
@@ -45,37 +65,233 @@ double calcMinRate(ProcessedTrace* pTrace)
     return rate;
 }
 
+// Kernels that advance the virtual token buckets (rbGen) or segment summaries (rbSegment) of all rates by one request
+typedef void (*RbGenKernel)(const double* rates, double* virtualBucket, double* bursts, unsigned int numRates, double interarrival, double work);
+typedef void (*RbSegmentKernel)(const double* rates, double* offsets, double* levels, double* offsetBursts, double* bursts, unsigned int numRates, double interarrival, double work);
+
+// Advance the virtual token buckets of all rates by one request.
+// Drains each bucket for the time since the last request, adds the request's work, and records the max burst.
+static void rbGenKernelScalar(const double* __restrict__ rates, double* __restrict__ virtualBucket, double* __restrict__ bursts, unsigned int numRates, double interarrival, double work)
+{
+    for (unsigned int i = 0; i < numRates; i++) {
+        // Drain token bucket for time since last request
+        double bucket = virtualBucket[i] - rates[i] * interarrival;
+        bucket = (bucket < 0) ? 0 : bucket;
+        // Add tokens for current request
+        bucket += work;
+        virtualBucket[i] = bucket;
+        // Record max burst
+        bursts[i] = (bucket > bursts[i]) ? bucket : bursts[i];
+    }
+}
+
+// Advance the summaries of all rates by one request (see RbSegmentSummary).
+// Each request maps a bucket level x to max(x - rate * interarrival, 0) + work, so the levels after the request are still
+// of the form max(x + offset, level), with the offset tracking the bucket if it never empties and the level tracking it otherwise.
+static void rbSegmentKernelScalar(const double* __restrict__ rates, double* __restrict__ offsets, double* __restrict__ levels,
+                                  double* __restrict__ offsetBursts, double* __restrict__ bursts, unsigned int numRates, double interarrival, double work)
+{
+    for (unsigned int i = 0; i < numRates; i++) {
+        double drain = rates[i] * interarrival;
+        double offset = offsets[i] - drain + work;
+        double level = levels[i] - drain;
+        level = (level < 0) ? 0 : level;
+        level += work;
+        offsets[i] = offset;
+        levels[i] = level;
+        offsetBursts[i] = (offset > offsetBursts[i]) ? offset : offsetBursts[i];
+        bursts[i] = (level > bursts[i]) ? level : bursts[i];
+    }
+}
+
+#ifdef RB_KERNEL_SIMD
+// Vector versions of the kernels above, which process 4 (AVX2) or 8 (AVX-512) rates at a time.
+// The build's -O2 does not auto-vectorize the scalar loops, so intrinsics are used, and the functions are compiled for their
+// instruction set with target attributes and selected at runtime (see selectRbKernels), so the build does not need -mavx2.
+// Floating point contraction is disabled so that multiplies and subtracts are not fused, since the vector kernels must give
+// bit-identical bursts to the scalar kernels (and to RbEstimator). max(a, b) is a > b ? a : b, the same as the scalar comparisons.
+#define RB_KERNEL_TARGET(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+
+RB_KERNEL_TARGET("avx2")
+static void rbGenKernelAVX2(const double* __restrict__ rates, double* __restrict__ virtualBucket, double* __restrict__ bursts, unsigned int numRates, double interarrival, double work)
+{
+    __m256d interarrivals = _mm256_set1_pd(interarrival);
+    __m256d works = _mm256_set1_pd(work);
+    __m256d zeros = _mm256_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 4 <= numRates; i += 4) {
+        __m256d bucket = _mm256_sub_pd(_mm256_loadu_pd(virtualBucket + i), _mm256_mul_pd(_mm256_loadu_pd(rates + i), interarrivals));
+        bucket = _mm256_add_pd(_mm256_max_pd(zeros, bucket), works);
+        _mm256_storeu_pd(virtualBucket + i, bucket);
+        _mm256_storeu_pd(bursts + i, _mm256_max_pd(bucket, _mm256_loadu_pd(bursts + i)));
+    }
+    rbGenKernelScalar(rates + i, virtualBucket + i, bursts + i, numRates - i, interarrival, work);
+}
+
+// Same as _mm512_max_pd, which GCC 12 warns leaves part of its result uninitialized, although all of the result is written.
+RB_KERNEL_TARGET("avx512f")
+static inline __m512d maxAVX512(__m512d a, __m512d b)
+{
+    return _mm512_mask_max_pd(a, (__mmask8)-1, a, b);
+}
+
+RB_KERNEL_TARGET("avx512f")
+static void rbGenKernelAVX512(const double* __restrict__ rates, double* __restrict__ virtualBucket, double* __restrict__ bursts, unsigned int numRates, double interarrival, double work)
+{
+    __m512d interarrivals = _mm512_set1_pd(interarrival);
+    __m512d works = _mm512_set1_pd(work);
+    __m512d zeros = _mm512_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 8 <= numRates; i += 8) {
+        __m512d bucket = _mm512_sub_pd(_mm512_loadu_pd(virtualBucket + i), _mm512_mul_pd(_mm512_loadu_pd(rates + i), interarrivals));
+        bucket = _mm512_add_pd(maxAVX512(zeros, bucket), works);
+        _mm512_storeu_pd(virtualBucket + i, bucket);
+        _mm512_storeu_pd(bursts + i, maxAVX512(bucket, _mm512_loadu_pd(bursts + i)));
+    }
+    rbGenKernelScalar(rates + i, virtualBucket + i, bursts + i, numRates - i, interarrival, work);
+}
+
+RB_KERNEL_TARGET("avx2")
+static void rbSegmentKernelAVX2(const double* __restrict__ rates, double* __restrict__ offsets, double* __restrict__ levels,
+                                double* __restrict__ offsetBursts, double* __restrict__ bursts, unsigned int numRates, double interarrival, double work)
+{
+    __m256d interarrivals = _mm256_set1_pd(interarrival);
+    __m256d works = _mm256_set1_pd(work);
+    __m256d zeros = _mm256_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 4 <= numRates; i += 4) {
+        __m256d drain = _mm256_mul_pd(_mm256_loadu_pd(rates + i), interarrivals);
+        __m256d offset = _mm256_add_pd(_mm256_sub_pd(_mm256_loadu_pd(offsets + i), drain), works);
+        __m256d level = _mm256_add_pd(_mm256_max_pd(zeros, _mm256_sub_pd(_mm256_loadu_pd(levels + i), drain)), works);
+        _mm256_storeu_pd(offsets + i, offset);
+        _mm256_storeu_pd(levels + i, level);
+        _mm256_storeu_pd(offsetBursts + i, _mm256_max_pd(offset, _mm256_loadu_pd(offsetBursts + i)));
+        _mm256_storeu_pd(bursts + i, _mm256_max_pd(level, _mm256_loadu_pd(bursts + i)));
+    }
+    rbSegmentKernelScalar(rates + i, offsets + i, levels + i, offsetBursts + i, bursts + i, numRates - i, interarrival, work);
+}
+
+RB_KERNEL_TARGET("avx512f")
+static void rbSegmentKernelAVX512(const double* __restrict__ rates, double* __restrict__ offsets, double* __restrict__ levels,
+                                  double* __restrict__ offsetBursts, double* __restrict__ bursts, unsigned int numRates, double interarrival, double work)
+{
+    __m512d interarrivals = _mm512_set1_pd(interarrival);
+    __m512d works = _mm512_set1_pd(work);
+    __m512d zeros = _mm512_setzero_pd();
+    unsigned int i = 0;
+    for (; i + 8 <= numRates; i += 8) {
+        __m512d drain = _mm512_mul_pd(_mm512_loadu_pd(rates + i), interarrivals);
+        __m512d offset = _mm512_add_pd(_mm512_sub_pd(_mm512_loadu_pd(offsets + i), drain), works);
+        __m512d level = _mm512_add_pd(maxAVX512(zeros, _mm512_sub_pd(_mm512_loadu_pd(levels + i), drain)), works);
+        _mm512_storeu_pd(offsets + i, offset);
+        _mm512_storeu_pd(levels + i, level);
+        _mm512_storeu_pd(offsetBursts + i, maxAVX512(offset, _mm512_loadu_pd(offsetBursts + i)));
+        _mm512_storeu_pd(bursts + i, maxAVX512(level, _mm512_loadu_pd(bursts + i)));
+    }
+    rbSegmentKernelScalar(rates + i, offsets + i, levels + i, offsetBursts + i, bursts + i, numRates - i, interarrival, work);
+}
+#endif // RB_KERNEL_SIMD
+
+// Kernels for one instruction set.
+struct RbKernels {
+    const char* isa;
+    bool (*supported)();
+    RbGenKernel rbGen;
+    RbSegmentKernel rbSegment;
+};
+
+#ifdef RB_KERNEL_SIMD
+static bool avx512Supported()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+
+static bool avx2Supported()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+static bool scalarSupported()
+{
+    return true;
+}
+
+// Kernels in order of preference
+static const RbKernels s_rbKernels[] = {
+#ifdef RB_KERNEL_SIMD
+    {"avx512f", avx512Supported, rbGenKernelAVX512, rbSegmentKernelAVX512},
+    {"avx2", avx2Supported, rbGenKernelAVX2, rbSegmentKernelAVX2},
+#endif
+    {"scalar", scalarSupported, rbGenKernelScalar, rbSegmentKernelScalar}
+};
+
+// Get the most preferred kernels supported by the CPU.
+static const RbKernels* selectRbKernels()
+{
+    unsigned int i = 0;
+    while (!s_rbKernels[i].supported()) {
+        i++;
+    }
+    return &s_rbKernels[i];
+}
+
+// Kernels used by rbGen and rbGenSegmented; selected at static initialization, so that threads do not race to select them
+static const RbKernels* s_pRbKernels = selectRbKernels();
+
+// Select the instruction set of the kernels used by rbGen and rbGenSegmented.
+bool setRbGenISA(string isa)
+{
+    for (unsigned int i = 0; i < sizeof(s_rbKernels) / sizeof(s_rbKernels[0]); i++) {
+        if ((isa == s_rbKernels[i].isa) && s_rbKernels[i].supported()) {
+            s_pRbKernels = &s_rbKernels[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Get the instruction set of the kernels used by rbGen and rbGenSegmented.
+string getRbGenISA()
+{
+    return s_pRbKernels->isa;
+}
+
 // Calculate the r-b curve for a given workload for a given set of rates.
-void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, map<double, double>& bursts)
+// bursts[i] is the burst corresponding to rates[i].
+void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, vector<double>& bursts)
 {
     // reset bursts to 0 just in case it has old or uninitialized data
-    map<double, double> virtualBucket;
-    for (unsigned int i = 0; i < rates.size(); i++) {
-        double rate = rates[i];
-        virtualBucket[rate] = 0;
-        bursts[rate] = 0;
+    unsigned int numRates = rates.size();
+    bursts.assign(numRates, 0);
+    if (numRates == 0) {
+        return;
     }
+    vector<double> virtualBucket(numRates, 0);
+    RbGenKernel kernel = s_pRbKernels->rbGen;
     // Calculate bursts
     pTrace->reset();
     uint64_t prevTimestamp = 0;
-    ProcessedTraceEntry traceEntry;
-    while (pTrace->nextEntry(traceEntry)) {
-        double interarrival = ConvertTimeToSeconds(traceEntry.arrivalTime - prevTimestamp);
-        for (unsigned int i = 0; i < rates.size(); i++) {
-            double rate = rates[i];
-            // Drain token bucket for time since last request
-            virtualBucket[rate] -= rate * interarrival;
-            if (virtualBucket[rate] < 0) {
-                virtualBucket[rate] = 0;
-            }
-            // Add tokens for current request
-            virtualBucket[rate] += traceEntry.work;
-            // Record max burst
-            if (virtualBucket[rate] > bursts[rate]) {
-                bursts[rate] = virtualBucket[rate];
-            }
+    vector<ProcessedTraceEntry> traceEntries(PROCESSED_TRACE_BATCH_SIZE);
+    unsigned int count;
+    while ((count = pTrace->nextEntries(&traceEntries[0], traceEntries.size())) > 0) {
+        for (unsigned int i = 0; i < count; i++) {
+            double interarrival = ConvertTimeToSeconds(traceEntries[i].arrivalTime - prevTimestamp);
+            kernel(&rates[0], &virtualBucket[0], &bursts[0], numRates, interarrival, traceEntries[i].work);
+            prevTimestamp = traceEntries[i].arrivalTime;
         }
-        prevTimestamp = traceEntry.arrivalTime;
+    }
+}
+
+// Calculate the r-b curve for a given workload for a given set of rates.
+void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, map<double, double>& bursts)
+{
+    vector<double> burstArray;
+    rbGen(pTrace, rates, burstArray);
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        bursts[rates[i]] = burstArray[i];
     }
 }
 
@@ -108,14 +324,14 @@ PointSlope calcPointSlopeIntersection(const PointSlope& p1, const PointSlope& p2
 
 // Generate an arrival curve from an r-b curve.
 // Assumes rates is decreasing
-void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, map<double, double>& bursts)
+void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, const vector<double>& bursts)
 {
     // Initialize arrival curve
     PointSlope initialPoint(0, 0, numeric_limits<double>::infinity());
     arrivalCurve.assign(1, initialPoint);
     for (unsigned int i = 0; i < rates.size(); i++) {
         double rate = rates[i];
-        PointSlope point(0, bursts[rate], rate);
+        PointSlope point(0, bursts[i], rate);
         while (arrivalCurve.size() > 1) {
             PointSlope& lastPoint = arrivalCurve.back();
             PointSlope intersectionPoint = calcPointSlopeIntersection(point, lastPoint);
@@ -129,7 +345,35 @@ void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, map
     }
 }
 
+// Generate an arrival curve from an r-b curve.
+// Assumes rates is decreasing
+void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, map<double, double>& bursts)
+{
+    vector<double> burstArray(rates.size());
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        burstArray[i] = bursts[rates[i]];
+    }
+    rbCurveToArrivalCurve(arrivalCurve, rates, burstArray);
+}
+
+// A point that is a candidate for removal in pruneArrivalCurve.
+// Ordered so that a priority_queue returns the smallest y gap to the next point first, breaking ties by position.
+struct PruneCandidate {
+    double diffY;
+    unsigned int index;
+    unsigned int version;
+    bool operator<(const PruneCandidate& other) const
+    {
+        if (diffY != other.diffY) {
+            return diffY > other.diffY;
+        }
+        return index > other.index;
+    }
+};
+
 // Approximate an arrival curve by an arrival curve with n points.
+// Points are kept in a linked list with a priority queue of y gaps, so pruning takes O(m log m) for m points.
+// Gaps that change when a neighbor is removed are pushed again, and outdated entries are skipped by version.
 void pruneArrivalCurve(Curve& arrivalCurve, unsigned int n)
 {
     n++; // compensate for the initial (0, 0) point
@@ -141,40 +385,546 @@ void pruneArrivalCurve(Curve& arrivalCurve, unsigned int n)
         }
         arrivalCurve.pop_back();
     }
+    if (arrivalCurve.size() <= n) {
+        return;
+    }
     // Remove points that are close together in the y dimension
-    while (arrivalCurve.size() > n) {
-        int toRemove = 1;
-        double minDiffY = numeric_limits<double>::infinity();
-        for (unsigned int i = 1; i < (arrivalCurve.size() - 1); i++) {
-            const PointSlope& p1 = arrivalCurve[i];
-            const PointSlope& p2 = arrivalCurve[i + 1];
-            if (p2.y - p1.y < minDiffY) {
-                minDiffY = p2.y - p1.y;
-                toRemove = i;
+    unsigned int size = arrivalCurve.size();
+    vector<unsigned int> prev(size);
+    vector<unsigned int> next(size);
+    vector<unsigned int> version(size, 0);
+    vector<bool> removed(size, false);
+    priority_queue<PruneCandidate> candidates;
+    for (unsigned int i = 0; i < size; i++) {
+        prev[i] = i - 1;
+        next[i] = i + 1;
+        if ((i >= 1) && (i < (size - 1))) {
+            PruneCandidate candidate = {arrivalCurve[i + 1].y - arrivalCurve[i].y, i, 0};
+            candidates.push(candidate);
+        }
+    }
+    unsigned int remaining = size;
+    while ((remaining > n) && !candidates.empty()) {
+        PruneCandidate candidate = candidates.top();
+        candidates.pop();
+        unsigned int i = candidate.index;
+        if (removed[i] || (candidate.version != version[i])) {
+            continue;
+        }
+        removed[i] = true;
+        remaining--;
+        unsigned int p = prev[i];
+        unsigned int q = next[i];
+        next[p] = q;
+        prev[q] = p;
+        arrivalCurve[q] = calcPointSlopeIntersection(arrivalCurve[q], arrivalCurve[p]);
+        // The gaps before and after the updated point have changed
+        if (p >= 1) {
+            PruneCandidate updated = {arrivalCurve[q].y - arrivalCurve[p].y, p, ++version[p]};
+            candidates.push(updated);
+        }
+        if (q < (size - 1)) {
+            PruneCandidate updated = {arrivalCurve[next[q]].y - arrivalCurve[q].y, q, ++version[q]};
+            candidates.push(updated);
+        }
+    }
+    unsigned int numPoints = 0;
+    for (unsigned int i = 0; i < size; i++) {
+        if (!removed[i]) {
+            arrivalCurve[numPoints++] = arrivalCurve[i];
+        }
+    }
+    arrivalCurve.resize(numPoints);
+}
+
+// Number of requests read from a trace at a time by calcArrivalCurves.
+#define ARRIVAL_CURVE_BLOCK_SIZE 65536
+// Spacing of the rates on the grid sampled by the initial sweep of an adaptive calcArrivalCurves.
+#define ARRIVAL_CURVE_COARSE_STEP 32
+
+// A block of requests from a trace.
+struct TraceBlock {
+    vector<ProcessedTraceEntry> traceEntries;
+    vector<double> interarrivals;
+    vector<double> works;
+};
+
+// State for building one arrival curve in calcArrivalCurves.
+struct ArrivalCurveJob {
+    ProcessedTrace* pTrace;
+    double maxRate;
+    double minRate; // calculated before the sweep if adaptive
+    // Trace statistics for calculating the min rate
+    bool empty;
+    uint64_t firstTimestamp;
+    uint64_t prevTimestamp;
+    double totalWork;
+    bool done;
+    // Blocks of requests; one is filled while the other is processed
+    TraceBlock blocks[2];
+    unsigned int fillIndex;
+    unsigned int processIndex;
+    // Candidate rates and their bursts
+    vector<double> rates;
+    vector<double> bursts;
+};
+
+// A contiguous range of rates within an ArrivalCurveJob.
+struct RateSlice {
+    ArrivalCurveJob* job;
+    unsigned int begin;
+    unsigned int end;
+    vector<double> virtualBucket;
+};
+
+// Read the next block of requests from a trace, and update the statistics for the min rate.
+static void readArrivalCurveBlock(void* ptr)
+{
+    ArrivalCurveJob* job = (ArrivalCurveJob*)ptr;
+    TraceBlock& block = job->blocks[job->fillIndex];
+    block.traceEntries.resize(ARRIVAL_CURVE_BLOCK_SIZE);
+    unsigned int count = job->pTrace->nextEntries(&block.traceEntries[0], ARRIVAL_CURVE_BLOCK_SIZE);
+    block.interarrivals.resize(count);
+    block.works.resize(count);
+    if ((count > 0) && job->empty) {
+        job->empty = false;
+        job->firstTimestamp = block.traceEntries[0].arrivalTime;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        const ProcessedTraceEntry& traceEntry = block.traceEntries[i];
+        job->totalWork += traceEntry.work;
+        block.interarrivals[i] = ConvertTimeToSeconds(traceEntry.arrivalTime - job->prevTimestamp);
+        block.works[i] = traceEntry.work;
+        job->prevTimestamp = traceEntry.arrivalTime;
+    }
+    if (count < ARRIVAL_CURVE_BLOCK_SIZE) {
+        job->done = true;
+    }
+}
+
+// Update the bursts for a range of rates with a block of requests.
+static void rbGenSlice(void* ptr)
+{
+    RateSlice* slice = (RateSlice*)ptr;
+    ArrivalCurveJob* job = slice->job;
+    const TraceBlock& block = job->blocks[job->processIndex];
+    unsigned int numRates = slice->end - slice->begin;
+    const double* rates = &job->rates[slice->begin];
+    double* bursts = &job->bursts[slice->begin];
+    RbGenKernel kernel = s_pRbKernels->rbGen;
+    for (unsigned int i = 0; i < block.works.size(); i++) {
+        kernel(rates, &slice->virtualBucket[0], bursts, numRates, block.interarrivals[i], block.works[i]);
+    }
+}
+
+// Calculate the bursts for the rates of a set of jobs in a single pass over their traces.
+// The rates of each trace are split into slices that are processed in parallel on the thread pool.
+// Traces are read in fixed-size blocks, reading the next block while processing the current block.
+static void rbGenPass(const vector<ArrivalCurveJob*>& jobs, ThreadPool& pool)
+{
+    list<RateSlice> slices;
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        ArrivalCurveJob& job = *jobs[i];
+        job.pTrace->reset();
+        job.empty = true;
+        job.firstTimestamp = 0;
+        job.prevTimestamp = 0;
+        job.totalWork = 0;
+        job.done = false;
+        job.bursts.assign(job.rates.size(), 0);
+        // Use at most one slice per thread and at least 32 rates per slice
+        unsigned int numSlices = min(pool.numThreads(), static_cast<unsigned int>(job.rates.size() / 32 + 1));
+        unsigned int sliceSize = (job.rates.size() + numSlices - 1) / numSlices;
+        for (unsigned int begin = 0; begin < job.rates.size(); begin += sliceSize) {
+            RateSlice slice;
+            slice.job = &job;
+            slice.begin = begin;
+            slice.end = min(begin + sliceSize, static_cast<unsigned int>(job.rates.size()));
+            slice.virtualBucket.assign(slice.end - slice.begin, 0);
+            slices.push_back(slice);
+        }
+    }
+    bool pending = true;
+    for (unsigned int round = 0; pending; round++) {
+        pending = false;
+        for (unsigned int i = 0; i < jobs.size(); i++) {
+            ArrivalCurveJob& job = *jobs[i];
+            job.fillIndex = round % 2;
+            job.processIndex = job.fillIndex ^ 1;
+            if (job.done) {
+                job.blocks[job.fillIndex].interarrivals.clear();
+                job.blocks[job.fillIndex].works.clear();
+            } else {
+                pool.addTask(readArrivalCurveBlock, &job);
+                pending = true;
+            }
+        }
+        for (list<RateSlice>::iterator it = slices.begin(); it != slices.end(); ++it) {
+            if (!it->job->blocks[it->job->processIndex].works.empty()) {
+                pool.addTask(rbGenSlice, &(*it));
+                pending = true;
+            }
+        }
+        pool.wait();
+    }
+}
+
+// Initialize the summary of an empty segment.
+void initRbSegmentSummary(RbSegmentSummary& summary, unsigned int numRates)
+{
+    // A bucket passes through an empty segment unchanged and does not reach a level within it
+    summary.offsets.assign(numRates, 0);
+    summary.levels.assign(numRates, -numeric_limits<double>::infinity());
+    summary.offsetBursts.assign(numRates, -numeric_limits<double>::infinity());
+    summary.bursts.assign(numRates, -numeric_limits<double>::infinity());
+}
+
+// Add count requests to the end of a summarized segment.
+void addRbSegmentSummary(RbSegmentSummary& summary, const vector<double>& rates, const double* interarrivals, const double* works, unsigned int count)
+{
+    unsigned int numRates = rates.size();
+    if (numRates == 0) {
+        return;
+    }
+    RbSegmentKernel kernel = s_pRbKernels->rbSegment;
+    for (unsigned int j = 0; j < count; j++) {
+        kernel(&rates[0], &summary.offsets[0], &summary.levels[0], &summary.offsetBursts[0], &summary.bursts[0], numRates, interarrivals[j], works[j]);
+    }
+}
+
+// Append the segment summarized by next to the segment summarized by summary.
+void mergeRbSegmentSummary(RbSegmentSummary& summary, const RbSegmentSummary& next)
+{
+    // Substitute the exit level max(x + offset, level) of the first segment for the entry level of the second segment
+    for (unsigned int i = 0; i < summary.offsets.size(); i++) {
+        summary.offsetBursts[i] = max(summary.offsetBursts[i], summary.offsets[i] + next.offsetBursts[i]);
+        summary.bursts[i] = max(summary.bursts[i], max(summary.levels[i] + next.offsetBursts[i], next.bursts[i]));
+        summary.levels[i] = max(summary.levels[i] + next.offsets[i], next.levels[i]);
+        summary.offsets[i] += next.offsets[i];
+    }
+}
+
+// A segment of requests from a trace and its summary.
+struct RbSegment {
+    TraceBlock block;
+    RbSegmentSummary summary;
+    const vector<double>* rates;
+};
+
+// State for reading a trace into segments in rbGenSegmented.
+struct RbSegmentReader {
+    ProcessedTrace* pTrace;
+    unsigned int segmentSize;
+    uint64_t prevTimestamp;
+    bool done;
+    vector<ProcessedTraceEntry> traceEntries;
+    // Segments; one group is filled while the other is summarized
+    vector<RbSegment> groups[2];
+    unsigned int fillIndex;
+};
+
+// Read the next group of segments from a trace.
+static void readRbSegments(void* ptr)
+{
+    RbSegmentReader* reader = (RbSegmentReader*)ptr;
+    vector<RbSegment>& group = reader->groups[reader->fillIndex];
+    for (unsigned int i = 0; i < group.size(); i++) {
+        TraceBlock& block = group[i].block;
+        unsigned int count = reader->done ? 0 : reader->pTrace->nextEntries(&reader->traceEntries[0], reader->segmentSize);
+        block.interarrivals.resize(count);
+        block.works.resize(count);
+        for (unsigned int j = 0; j < count; j++) {
+            const ProcessedTraceEntry& traceEntry = reader->traceEntries[j];
+            block.interarrivals[j] = ConvertTimeToSeconds(traceEntry.arrivalTime - reader->prevTimestamp);
+            block.works[j] = traceEntry.work;
+            reader->prevTimestamp = traceEntry.arrivalTime;
+        }
+        if (count < reader->segmentSize) {
+            reader->done = true;
+        }
+    }
+}
+
+// Summarize a segment of requests.
+static void summarizeRbSegment(void* ptr)
+{
+    RbSegment* segment = (RbSegment*)ptr;
+    initRbSegmentSummary(segment->summary, segment->rates->size());
+    addRbSegmentSummary(segment->summary, *segment->rates, &segment->block.interarrivals[0], &segment->block.works[0], segment->block.works.size());
+}
+
+// Calculate the r-b curve for a given workload for a given set of rates with segments summarized in parallel.
+// Segments are read in groups of one segment per thread, reading the next group while summarizing the current group.
+void rbGenSegmented(ProcessedTrace* pTrace, const vector<double>& rates, vector<double>& bursts, unsigned int numThreads, unsigned int segmentSize)
+{
+    assert(segmentSize > 0);
+    unsigned int numRates = rates.size();
+    bursts.assign(numRates, 0);
+    if (numRates == 0) {
+        return;
+    }
+    ThreadPool pool(numThreads);
+    RbSegmentReader reader;
+    reader.pTrace = pTrace;
+    reader.segmentSize = segmentSize;
+    reader.prevTimestamp = 0;
+    reader.done = false;
+    reader.traceEntries.resize(segmentSize);
+    for (unsigned int g = 0; g < 2; g++) {
+        reader.groups[g].resize(pool.numThreads());
+        for (unsigned int i = 0; i < reader.groups[g].size(); i++) {
+            reader.groups[g][i].rates = &rates;
+        }
+    }
+    pTrace->reset();
+    RbSegmentSummary total;
+    initRbSegmentSummary(total, numRates);
+    bool pending = true;
+    for (unsigned int round = 0; pending; round++) {
+        pending = false;
+        reader.fillIndex = round % 2;
+        vector<RbSegment>& processGroup = reader.groups[reader.fillIndex ^ 1];
+        if (!reader.done) {
+            pool.addTask(readRbSegments, &reader);
+            pending = true;
+        } else {
+            for (unsigned int i = 0; i < reader.groups[reader.fillIndex].size(); i++) {
+                reader.groups[reader.fillIndex][i].block.works.clear();
+            }
+        }
+        unsigned int numSegments = 0;
+        while ((numSegments < processGroup.size()) && !processGroup[numSegments].block.works.empty()) {
+            pool.addTask(summarizeRbSegment, &processGroup[numSegments]);
+            numSegments++;
+            pending = true;
+        }
+        pool.wait();
+        // Merge summaries in trace order
+        for (unsigned int i = 0; i < numSegments; i++) {
+            mergeRbSegmentSummary(total, processGroup[i].summary);
+        }
+    }
+    // Buckets start empty
+    for (unsigned int i = 0; i < numRates; i++) {
+        bursts[i] = max(bursts[i], max(total.offsetBursts[i], total.bursts[i]));
+    }
+}
+
+// Calculate the min rate needed to sustain the workload of a job after a pass over its trace (see calcMinRate).
+static double arrivalCurveJobMinRate(const ArrivalCurveJob& job)
+{
+    if (job.empty) {
+        cerr << "Empty trace file" << endl;
+        return 0;
+    }
+    return job.totalWork / ConvertTimeToSeconds(job.prevTimestamp - job.firstTimestamp);
+}
+
+// Calculate the min rate of a job's trace before the sweep (see calcMinRate).
+static void calcArrivalCurveJobMinRate(void* ptr)
+{
+    ArrivalCurveJob* job = (ArrivalCurveJob*)ptr;
+    job->minRate = calcMinRate(job->pTrace);
+}
+
+// Calculate the largest gap between the r-b curve interpolated between two sampled rates and the true r-b curve.
+// The r-b curve is convex and decreasing in the rate, so it lies above the burst at the higher rate
+// and above the extensions of the secants through the neighboring samples (if they exist).
+// The gap is maximized where these lower bounds intersect, so only those points need to be checked.
+static double rbInterpolationError(const map<unsigned int, double>& samples, map<unsigned int, double>::const_iterator a, map<unsigned int, double>::const_iterator b, const vector<double>& grid)
+{
+    // Lines are represented as burst = intercept + slope * rate
+    vector<double> intercepts;
+    vector<double> slopes;
+    intercepts.push_back(a->second);
+    slopes.push_back(0);
+    if (a != samples.begin()) {
+        map<unsigned int, double>::const_iterator p = a;
+        --p;
+        double slope = (p->second - a->second) / (grid[p->first] - grid[a->first]);
+        intercepts.push_back(a->second - slope * grid[a->first]);
+        slopes.push_back(slope);
+    }
+    map<unsigned int, double>::const_iterator q = b;
+    ++q;
+    if (q != samples.end()) {
+        double slope = (b->second - q->second) / (grid[b->first] - grid[q->first]);
+        intercepts.push_back(b->second - slope * grid[b->first]);
+        slopes.push_back(slope);
+    }
+    double highRate = grid[a->first];
+    double lowRate = grid[b->first];
+    vector<double> checkRates;
+    checkRates.push_back(highRate);
+    checkRates.push_back(lowRate);
+    for (unsigned int i = 0; i < slopes.size(); i++) {
+        for (unsigned int j = i + 1; j < slopes.size(); j++) {
+            if (slopes[i] != slopes[j]) {
+                double rate = (intercepts[j] - intercepts[i]) / (slopes[i] - slopes[j]);
+                if ((rate > lowRate) && (rate < highRate)) {
+                    checkRates.push_back(rate);
+                }
             }
         }
-        arrivalCurve.erase(arrivalCurve.begin() + toRemove);
-        arrivalCurve[toRemove] = calcPointSlopeIntersection(arrivalCurve[toRemove], arrivalCurve[toRemove - 1]);
     }
+    double chordSlope = (a->second - b->second) / (highRate - lowRate);
+    double maxError = 0;
+    for (unsigned int i = 0; i < checkRates.size(); i++) {
+        double rate = checkRates[i];
+        double lowerBound = intercepts[0];
+        for (unsigned int j = 1; j < slopes.size(); j++) {
+            lowerBound = max(lowerBound, intercepts[j] + slopes[j] * rate);
+        }
+        double chord = a->second + chordSlope * (rate - highRate);
+        maxError = max(maxError, chord - lowerBound);
+    }
+    return maxError;
 }
 
 // Calculate an arrival curve from a trace.
-void calcArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate)
+void calcArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate, double tolerance)
 {
-    double minRate = calcMinRate(pTrace);
-    vector<double> rates;
-    for (double rate = maxRate; rate >= minRate; rate -= 0.001 * maxRate) {
-        rates.push_back(rate);
+    vector<Curve> arrivalCurves;
+    calcArrivalCurves(arrivalCurves, vector<ProcessedTrace*>(1, pTrace), vector<double>(1, maxRate), 0, tolerance);
+    arrivalCurve.swap(arrivalCurves[0]);
+}
+
+// Calculate arrival curves for a set of traces in parallel.
+// arrivalCurves[i] is calculated from pTraces[i] with maxRates[i].
+// The rates of each trace are split across a thread pool of numThreads threads (0 uses the number of cores).
+// Traces are read in fixed-size blocks, so memory use does not grow with the trace length.
+void calcArrivalCurves(vector<Curve>& arrivalCurves, const vector<ProcessedTrace*>& pTraces, const vector<double>& maxRates, unsigned int numThreads, double tolerance, unsigned int numPoints)
+{
+    assert(pTraces.size() == maxRates.size());
+    ThreadPool pool(numThreads);
+    vector<ArrivalCurveJob> jobs(pTraces.size());
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        jobs[i].pTrace = pTraces[i];
+        jobs[i].maxRate = maxRates[i];
+        jobs[i].minRate = 0;
+    }
+    if (tolerance > 0) {
+        // The adaptive sweep takes several passes anyway, so take one more to get the min rate,
+        // which keeps the sweep from sampling rates below it (down to 0) that are dropped afterwards
+        for (unsigned int i = 0; i < jobs.size(); i++) {
+            pool.addTask(calcArrivalCurveJobMinRate, &jobs[i]);
+        }
+        pool.wait();
+    }
+    // Candidate rates are a grid from the max rate down to the min rate (or down to 0 if not yet known)
+    vector<vector<double> > grids(jobs.size());
+    vector<vector<unsigned int> > sampleIndices(jobs.size());
+    vector<ArrivalCurveJob*> pendingJobs;
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        ArrivalCurveJob& job = jobs[i];
+        if (job.maxRate > 0) {
+            for (double rate = job.maxRate; rate >= job.minRate; rate -= 0.001 * job.maxRate) {
+                grids[i].push_back(rate);
+            }
+        }
+        if (tolerance > 0) {
+            // Start with a coarse sweep of the grid including the lowest rate
+            for (unsigned int index = 0; index < grids[i].size(); index += ARRIVAL_CURVE_COARSE_STEP) {
+                sampleIndices[i].push_back(index);
+            }
+            if (!grids[i].empty() && (sampleIndices[i].back() != (grids[i].size() - 1))) {
+                sampleIndices[i].push_back(grids[i].size() - 1);
+            }
+            for (unsigned int j = 0; j < sampleIndices[i].size(); j++) {
+                job.rates.push_back(grids[i][sampleIndices[i][j]]);
+            }
+        } else {
+            job.rates = grids[i];
+        }
+        pendingJobs.push_back(&job);
+    }
+    // Without a tolerance, the min rate is not known until the whole trace is read, so bursts are calculated for
+    // candidate rates down to 0 in a single pass, and the rates below the min rate are dropped afterwards
+    rbGenPass(pendingJobs, pool);
+    arrivalCurves.resize(jobs.size());
+    if (tolerance <= 0) {
+        for (unsigned int i = 0; i < jobs.size(); i++) {
+            ArrivalCurveJob& job = jobs[i];
+            double minRate = arrivalCurveJobMinRate(job);
+            unsigned int numRates = 0;
+            while ((numRates < job.rates.size()) && (job.rates[numRates] >= minRate)) {
+                numRates++;
+            }
+            job.rates.resize(numRates);
+            job.bursts.resize(numRates);
+            rbCurveToArrivalCurve(arrivalCurves[i], job.rates, job.bursts);
+            if (numPoints > 0) {
+                pruneArrivalCurve(arrivalCurves[i], numPoints);
+            }
+        }
+        return;
+    }
+    // Refine the grid where interpolating between samples could overestimate a burst by more than the tolerance.
+    // Then every rate on the grid has some pair of sampled r-b lines below its own r-b line scaled by 1 + tolerance,
+    // so the arrival curve is within the tolerance of the arrival curve calculated from the whole grid.
+    vector<map<unsigned int, double> > samples(jobs.size());
+    vector<unsigned int> numRates(jobs.size(), 0);
+    while (!pendingJobs.empty()) {
+        pendingJobs.clear();
+        for (unsigned int i = 0; i < jobs.size(); i++) {
+            ArrivalCurveJob& job = jobs[i];
+            if (sampleIndices[i].empty()) {
+                continue;
+            }
+            for (unsigned int j = 0; j < sampleIndices[i].size(); j++) {
+                samples[i][sampleIndices[i][j]] = job.bursts[j];
+            }
+            sampleIndices[i].clear();
+            // The grid stops at the min rate, and its lowest rate is always sampled
+            numRates[i] = grids[i].size();
+            if (numRates[i] == 0) {
+                continue;
+            }
+            unsigned int lastIndex = numRates[i] - 1;
+            if (samples[i].find(lastIndex) == samples[i].end()) {
+                sampleIndices[i].push_back(lastIndex);
+            }
+            // Split segments between samples at their midpoints
+            map<unsigned int, double>::const_iterator a = samples[i].begin();
+            map<unsigned int, double>::const_iterator b = a;
+            for (++b; (b != samples[i].end()) && (b->first <= lastIndex); a = b, ++b) {
+                if (((b->first - a->first) > 1) && (rbInterpolationError(samples[i], a, b, grids[i]) > (tolerance * a->second))) {
+                    sampleIndices[i].push_back((a->first + b->first) / 2);
+                }
+            }
+            if (!sampleIndices[i].empty()) {
+                sort(sampleIndices[i].begin(), sampleIndices[i].end());
+                job.rates.clear();
+                for (unsigned int j = 0; j < sampleIndices[i].size(); j++) {
+                    job.rates.push_back(grids[i][sampleIndices[i][j]]);
+                }
+                pendingJobs.push_back(&job);
+            }
+        }
+        if (!pendingJobs.empty()) {
+            rbGenPass(pendingJobs, pool);
+        }
+    }
+    // Build arrival curves from the sampled rates
+    for (unsigned int i = 0; i < jobs.size(); i++) {
+        ArrivalCurveJob& job = jobs[i];
+        job.rates.clear();
+        job.bursts.clear();
+        for (map<unsigned int, double>::const_iterator it = samples[i].begin(); (it != samples[i].end()) && (it->first < numRates[i]); ++it) {
+            job.rates.push_back(grids[i][it->first]);
+            job.bursts.push_back(it->second);
+        }
+        rbCurveToArrivalCurve(arrivalCurves[i], job.rates, job.bursts);
+        if (numPoints > 0) {
+            pruneArrivalCurve(arrivalCurves[i], numPoints);
+        }
     }
-    map<double, double> bursts;
-    rbGen(pTrace, rates, bursts);
-    rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
-    pruneArrivalCurve(arrivalCurve, 12);
 }
 
 // Read an arrival curve from a file.
 bool readArrivalCurve(Curve& arrivalCurve, string arrivalCurveFilename)
 {
+    TRACE_SPAN("readArrivalCurve");
     if (arrivalCurveFilename == "") {
         return false;
     }
@@ -378,8 +1128,103 @@ void DNC::hopByHopAnalysis(DNCFlow* flow)
     flow->latency = latency;
 }
 
+// Aggregate of the flows with priority value <= priority (or < priority if not inclusive).
+static SimpleArrivalCurve higherPriorityArrivalCurve(const PriorityAggregates& aggregates, unsigned int priority, bool inclusive)
+{
+    PriorityAggregates::const_iterator it = inclusive ? aggregates.upper_bound(priority) : aggregates.lower_bound(priority);
+    if (it == aggregates.begin()) {
+        return ZeroArrivalCurve();
+    }
+    it--;
+    return it->second.higherOrEqual;
+}
+
+// Aggregate of the flows with a given priority.
+static SimpleArrivalCurve samePriorityArrivalCurve(const PriorityAggregates& aggregates, unsigned int priority)
+{
+    PriorityAggregates::const_iterator it = aggregates.find(priority);
+    return (it != aggregates.end()) ? it->second.atPriority : ZeroArrivalCurve();
+}
+
+// Aggregates of the flows in a first queue that go to a second queue.
+static const PriorityAggregates& nextQueueAggregates(const DNCQueue* q, QueueId secondQueueId)
+{
+    static const PriorityAggregates emptyAggregates;
+    map<QueueId, PriorityAggregates>::const_iterator it = q->nextQueueAggregates.find(secondQueueId);
+    return (it != q->nextQueueAggregates.end()) ? it->second : emptyAggregates;
+}
+
+// Aggregate of the flows in A that are not in B, where the flows in B are a subset of the flows in A.
+// Rounding errors are clamped so that the result is never negative.
+static SimpleArrivalCurve RemainingArrivalCurve(const SimpleArrivalCurve& A, const SimpleArrivalCurve& B)
+{
+    SimpleArrivalCurve remaining;
+    remaining.r = max(A.r - B.r, 0.0);
+    remaining.b = max(A.b - B.b, 0.0);
+    return remaining;
+}
+
+// Add a flow's shaper curve to the aggregate of its priority.
+static void addPriorityAggregate(PriorityAggregates& aggregates, const DNCFlow* f)
+{
+    PriorityAggregates::iterator it = aggregates.find(f->priority);
+    if (it == aggregates.end()) {
+        PriorityAggregate& aggregate = aggregates[f->priority];
+        aggregate.atPriority = f->shaperCurve;
+    } else {
+        it->second.atPriority = AggregateArrivalCurve(f->shaperCurve, it->second.atPriority);
+    }
+}
+
+// Calculate the cumulative aggregates of each priority from the aggregates at each priority.
+static void accumulatePriorityAggregates(PriorityAggregates& aggregates)
+{
+    SimpleArrivalCurve higherOrEqual = ZeroArrivalCurve();
+    for (PriorityAggregates::iterator it = aggregates.begin(); it != aggregates.end(); it++) {
+        higherOrEqual = AggregateArrivalCurve(it->second.atPriority, higherOrEqual);
+        it->second.higherOrEqual = higherOrEqual;
+    }
+}
+
+const DNCQueue* DNC::getAggregatedQueue(QueueId queueId)
+{
+    DNCQueue* q = getDNCQueue(queueId);
+    if (q->aggregatesDirty) {
+        q->firstHopAggregates.clear();
+        q->nextQueueAggregates.clear();
+        q->prevQueuePriorities.clear();
+        for (vector<FlowIndex>::const_iterator it = q->flows.begin(); it != q->flows.end(); it++) {
+            const DNCFlow* f = getDNCFlow(it->flowId);
+            if (it->index == 0) {
+                addPriorityAggregate(q->firstHopAggregates, f);
+                if (f->queueIds.size() > 1) {
+                    addPriorityAggregate(q->nextQueueAggregates[f->queueIds[1]], f);
+                }
+            } else if (it->index == 1) {
+                q->prevQueuePriorities[f->queueIds[0]].insert(f->priority);
+            }
+        }
+        accumulatePriorityAggregates(q->firstHopAggregates);
+        for (map<QueueId, PriorityAggregates>::iterator it = q->nextQueueAggregates.begin(); it != q->nextQueueAggregates.end(); it++) {
+            accumulatePriorityAggregates(it->second);
+        }
+        q->aggregatesDirty = false;
+    }
+    return q;
+}
+
+void DNC::invalidateQueueAggregates(FlowId flowId)
+{
+    const DNCFlow* f = getDNCFlow(flowId);
+    for (unsigned int index = 0; index < f->queueIds.size(); index++) {
+        getDNCQueue(f->queueIds[index])->aggregatesDirty = true;
+    }
+}
+
 // DNC algorithm that takes a similar analysis approach as in the SNC-Meister paper, except using DNC operators.
 // Currently supported for flows with up to two queues, as is the case when modeling end-host network links.
+// The leftover service after a set of higher priority flows equals the leftover service after their aggregate,
+// so the analysis uses the priority aggregates of the queues rather than going through their flows.
 void DNC::aggregateAnalysisTwoHop(DNCFlow* flow)
 {
     assert(flow->queueIds.size() <= 2);
@@ -388,102 +1233,56 @@ void DNC::aggregateAnalysisTwoHop(DNCFlow* flow)
         // One hop
         //
         // Calculate leftover service from higher priority flows and arrival of flow at first hop
-        QueueId firstQueueId = flow->queueIds[0];
-        const Queue* firstQueue = getQueue(firstQueueId);
-        SimpleArrivalCurve arrivalCurve = ZeroArrivalCurve();
-        SimpleServiceCurve serviceCurve = ConstantServiceCurve(firstQueue);
-        for (unsigned int i = 0; i < firstQueue->flows.size(); i++) {
-            assert(firstQueue->flows[i].index == 0);
-            const DNCFlow* f = getDNCFlow(firstQueue->flows[i].flowId);
-            assert(f->queueIds[0] == firstQueueId);
-            // Only consider flows of higher (or equal) priority (i.e. <= flow->priority)
-            if (f->priority <= flow->priority) {
-                // Aggregate equal priority flows
-                if (f->priority == flow->priority) {
-                    arrivalCurve = AggregateArrivalCurve(f->shaperCurve, arrivalCurve);
-                } else {
-                    serviceCurve = LeftoverServiceCurve(f->shaperCurve, serviceCurve);
-                }
-            }
-        }
+        const DNCQueue* firstQueue = getAggregatedQueue(flow->queueIds[0]);
+        // Aggregate equal priority flows
+        SimpleArrivalCurve arrivalCurve = samePriorityArrivalCurve(firstQueue->firstHopAggregates, flow->priority);
+        // Only consider flows of higher priority (i.e. < flow->priority)
+        SimpleServiceCurve serviceCurve = LeftoverServiceCurve(higherPriorityArrivalCurve(firstQueue->firstHopAggregates, flow->priority, false),
+                                                               ConstantServiceCurve(firstQueue));
         // Calculate latency
         flow->latency = DNCLatencyBound(arrivalCurve, serviceCurve);
     } else if (flow->queueIds.size() == 2) {
         //
         // Two hops
         //
-        // Identify ids of first queues that feed into this particular second queue
         QueueId firstQueueId = flow->queueIds[0];
         QueueId secondQueueId = flow->queueIds[1];
-        const Queue* secondQueue = getQueue(secondQueueId);
-        map<QueueId, unsigned int> firstQueueIds; // first QueueId -> priority
-        for (unsigned int i = 0; i < secondQueue->flows.size(); i++) {
-            assert(secondQueue->flows[i].index == 1);
-            const DNCFlow* f = getDNCFlow(secondQueue->flows[i].flowId);
-            assert(f->queueIds[1] == secondQueueId);
+        const DNCQueue* secondQueue = getAggregatedQueue(secondQueueId);
+        // Loop through the other first queues that feed into this particular second queue to calculate second queue leftover service
+        SimpleServiceCurve secondQueueServiceCurve = ConstantServiceCurve(secondQueue);
+        for (map<QueueId, set<unsigned int> >::const_iterator it = secondQueue->prevQueuePriorities.begin(); it != secondQueue->prevQueuePriorities.end(); it++) {
             // Exclude first queue
-            if (f->queueIds[0] != firstQueueId) {
-                // Only consider flows of higher (or equal) priority (i.e. <= flow->priority)
-                if (f->priority <= flow->priority) {
-                    map<QueueId, unsigned int>::iterator it = firstQueueIds.find(f->queueIds[0]);
-                    if (it == firstQueueIds.end()) {
-                        firstQueueIds[f->queueIds[0]] = f->priority;
-                    // Of the competing high priority flows for a given first queue, identify the lowest priority (i.e., max value)
-                    } else if (f->priority > it->second) {
-                        it->second = f->priority;
-                    }
-                }
+            if (it->first == firstQueueId) {
+                continue;
             }
-        }
-        // Loop through first queues to calculate second queue leftover service and aggregate arrival
-        SimpleServiceCurve secondQueueServiceCurve = ConstantServiceCurve(secondQueue);
-        for (map<QueueId, unsigned int>::const_iterator it = firstQueueIds.begin(); it != firstQueueIds.end(); it++) {
-            const Queue* q = getQueue(it->first);
-            SimpleArrivalCurve firstQueueArrivalCurve = ZeroArrivalCurve();
-            SimpleServiceCurve firstQueueServiceCurve = ConstantServiceCurve(q);
-            for (unsigned int i = 0; i < q->flows.size(); i++) {
-                assert(q->flows[i].index == 0);
-                const DNCFlow* f = getDNCFlow(q->flows[i].flowId);
-                assert(f->queueIds[0] == it->first);
-                // Only consider flows of higher (or equal) priority than the lowest priority competing flow as identified in firstQueueIds
-                if (f->priority <= it->second) {
-                    // Check if sharing second queue
-                    if (f->queueIds[1] == secondQueueId) {
-                        firstQueueArrivalCurve = AggregateArrivalCurve(f->shaperCurve, firstQueueArrivalCurve);
-                    } else {
-                        firstQueueServiceCurve = LeftoverServiceCurve(f->shaperCurve, firstQueueServiceCurve);
-                    }
-                }
+            // Of the competing high priority flows (i.e., <= flow->priority) for a given first queue, identify the lowest priority (i.e., max value)
+            set<unsigned int>::const_iterator itPriority = it->second.upper_bound(flow->priority);
+            if (itPriority == it->second.begin()) {
+                continue;
             }
+            itPriority--;
+            unsigned int priority = *itPriority;
+            // Only consider flows of higher (or equal) priority than the lowest priority competing flow
+            const DNCQueue* q = getAggregatedQueue(it->first);
+            SimpleArrivalCurve firstQueueArrivalCurve = higherPriorityArrivalCurve(nextQueueAggregates(q, secondQueueId), priority, true);
+            SimpleArrivalCurve otherArrivalCurve = RemainingArrivalCurve(higherPriorityArrivalCurve(q->firstHopAggregates, priority, true), firstQueueArrivalCurve);
+            SimpleServiceCurve firstQueueServiceCurve = LeftoverServiceCurve(otherArrivalCurve, ConstantServiceCurve(q));
             // Generate output bound on high priority flows that share second queue
             SimpleArrivalCurve outputArrivalCurve = OutputArrivalCurve(firstQueueArrivalCurve, firstQueueServiceCurve);
             // Subtract output from second queue service
             secondQueueServiceCurve = LeftoverServiceCurve(outputArrivalCurve, secondQueueServiceCurve);
         }
         // Calculate first hop service for convolution
-        const Queue* firstQueue = getQueue(firstQueueId);
-        SimpleArrivalCurve arrivalCurve = ZeroArrivalCurve();
-        SimpleArrivalCurve shareArrivalCurve = ZeroArrivalCurve();
-        SimpleServiceCurve serviceCurveForConvolution = ConstantServiceCurve(firstQueue);
-        for (unsigned int i = 0; i < firstQueue->flows.size(); i++) {
-            assert(firstQueue->flows[i].index == 0);
-            const DNCFlow* f = getDNCFlow(firstQueue->flows[i].flowId);
-            assert(f->queueIds[0] == firstQueueId);
-            // Only consider flows of higher (or equal) priority (i.e. <= flow->priority)
-            if (f->priority <= flow->priority) {
-                // Check if sharing second queue
-                if (f->queueIds[1] == secondQueueId) {
-                    // Aggregate equal priority flows
-                    if (f->priority == flow->priority) {
-                        arrivalCurve = AggregateArrivalCurve(f->shaperCurve, arrivalCurve);
-                    } else {
-                        shareArrivalCurve = AggregateArrivalCurve(f->shaperCurve, shareArrivalCurve);
-                    }
-                } else {
-                    serviceCurveForConvolution = LeftoverServiceCurve(f->shaperCurve, serviceCurveForConvolution);
-                }
-            }
-        }
+        const DNCQueue* firstQueue = getAggregatedQueue(firstQueueId);
+        const PriorityAggregates& shareAggregates = nextQueueAggregates(firstQueue, secondQueueId);
+        // Aggregate equal priority flows sharing second queue
+        SimpleArrivalCurve arrivalCurve = samePriorityArrivalCurve(shareAggregates, flow->priority);
+        // Aggregate higher priority flows sharing second queue
+        SimpleArrivalCurve shareArrivalCurve = higherPriorityArrivalCurve(shareAggregates, flow->priority, false);
+        // Higher (or equal) priority flows not sharing second queue
+        SimpleArrivalCurve otherArrivalCurve = RemainingArrivalCurve(higherPriorityArrivalCurve(firstQueue->firstHopAggregates, flow->priority, true),
+                                                                     higherPriorityArrivalCurve(shareAggregates, flow->priority, true));
+        SimpleServiceCurve serviceCurveForConvolution = LeftoverServiceCurve(otherArrivalCurve, ConstantServiceCurve(firstQueue));
         // Calculate latency
         SimpleServiceCurve convolutedServiceCurve = ConvolutionServiceCurve(serviceCurveForConvolution, secondQueueServiceCurve);
         SimpleServiceCurve finalService = LeftoverServiceCurve(shareArrivalCurve, convolutedServiceCurve);
@@ -495,7 +1294,13 @@ void DNC::aggregateAnalysisTwoHop(DNCFlow* flow)
 // Assumes priorities are set.
 double DNC::calcFlowLatency(FlowId flowId)
 {
+    updateDirtyFlows();
     DNCFlow* f = getDNCFlow(flowId);
+    if (!f->latencyDirty) {
+        return f->latency;
+    }
+    prepareFlowUpdate(flowId);
+    clearFlowLatencyDirty(flowId);
     if (f->ignoreLatency) {
         f->latency = 0;
         return f->latency;
@@ -520,6 +1325,76 @@ double DNC::calcFlowLatency(FlowId flowId)
     return f->latency;
 }
 
+void DNC::saveFlowState(FlowId flowId)
+{
+    _whatIfShaperCurves[flowId] = getDNCFlow(flowId)->shaperCurve;
+}
+
+void DNC::restoreFlowState(FlowId flowId)
+{
+    map<FlowId, SimpleArrivalCurve>::iterator it = _whatIfShaperCurves.find(flowId);
+    DNCFlow* f = getDNCFlow(flowId);
+    addQueueShaperRate(f, f->shaperCurve, -1);
+    f->shaperCurve = it->second;
+    addQueueShaperRate(f, f->shaperCurve, 1);
+    _whatIfShaperCurves.erase(it);
+    // The flow's priority and shaper curve are restored
+    invalidateQueueAggregates(flowId);
+}
+
+void DNC::addQueueShaperRate(const DNCFlow* f, const SimpleArrivalCurve& shaperCurve, int sign)
+{
+    bool zero = (shaperCurve.r == 0) && (shaperCurve.b == 0);
+    for (unsigned int index = 0; index < f->queueIds.size(); index++) {
+        DNCQueue* q = getDNCQueue(f->queueIds[index]);
+        if (inWhatIf() && (_whatIfQueueShaperRates.find(q->queueId) == _whatIfQueueShaperRates.end())) {
+            _whatIfQueueShaperRates[q->queueId] = make_pair(q->shaperRate, q->numZeroShapers);
+        }
+        if (zero) {
+            q->numZeroShapers += sign;
+        } else {
+            q->shaperRate += sign * shaperCurve.r;
+        }
+    }
+}
+
+void DNC::delClient(ClientId clientId)
+{
+    // Remove the client's flows from the shaper rates of their queues
+    const Client* c = getClient(clientId);
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        const DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+        addQueueShaperRate(f, f->shaperCurve, -1);
+    }
+    NC::delClient(clientId);
+}
+
+void DNC::endWhatIf()
+{
+    NC::endWhatIf();
+    for (map<QueueId, pair<double, unsigned int> >::const_iterator it = _whatIfQueueShaperRates.begin(); it != _whatIfQueueShaperRates.end(); it++) {
+        DNCQueue* q = getDNCQueue(it->first);
+        q->shaperRate = it->second.first;
+        q->numZeroShapers = it->second.second;
+    }
+    _whatIfQueueShaperRates.clear();
+}
+
+void DNC::invalidateFlowLatency(FlowId flowId, unsigned int priority)
+{
+    NC::invalidateFlowLatency(flowId, priority);
+    invalidateQueueAggregates(flowId);
+}
+
+// Replace the arrival curve of a flow.
+void DNC::setArrivalCurve(FlowId flowId, const Curve& arrivalCurve)
+{
+    assert(!inWhatIf());
+    DNCFlow* f = getDNCFlow(flowId);
+    f->arrivalCurve = arrivalCurve;
+    invalidateFlowLatency(flowId, f->priority);
+}
+
 FlowId DNC::initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId)
 {
     if (f == NULL) {
@@ -533,21 +1408,154 @@ FlowId DNC::initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId)
     dsf->arrivalCurve.insert(dsf->arrivalCurve.begin(), initialPoint);
     // Initialize shaper curve to 0
     dsf->shaperCurve = ZeroArrivalCurve();
+    addQueueShaperRate(dsf, dsf->shaperCurve, 1);
     return flowId;
 }
 
-void DNC::setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate, string arrivalCurveFilename)
+QueueId DNC::initQueue(Queue* q, const Json::Value& queueInfo)
 {
-    Curve arrivalCurve;
-    if (!readArrivalCurve(arrivalCurve, arrivalCurveFilename)) {
-        // Init estimator
-        Estimator* pEst = Estimator::create(estimatorInfo);
-        // Read trace
-        ProcessedTrace* pTrace = new ProcessedTrace(trace, pEst);
-        calcArrivalCurve(arrivalCurve, pTrace, maxRate);
-        delete pTrace;
-        writeArrivalCurve(arrivalCurve, arrivalCurveFilename);
+    if (q == NULL) {
+        q = new DNCQueue;
+    }
+    QueueId queueId = NC::initQueue(q, queueInfo);
+    DNCQueue* dsq = getDNCQueue(queueId);
+    dsq->aggregatesDirty = true;
+    dsq->shaperRate = 0;
+    dsq->numZeroShapers = 0;
+    return queueId;
+}
+
+void DNC::writeFlowCheckpoint(BinaryWriter& writer, const Flow* f) const
+{
+    NC::writeFlowCheckpoint(writer, f);
+    const DNCFlow* dsf = static_cast<const DNCFlow*>(f);
+    writer.write(static_cast<uint32_t>(dsf->arrivalCurve.size()));
+    for (Curve::const_iterator it = dsf->arrivalCurve.begin(); it != dsf->arrivalCurve.end(); it++) {
+        writer.write(it->x);
+        writer.write(it->y);
+        writer.write(it->slope);
     }
+    writer.write(dsf->shaperCurve.r);
+    writer.write(dsf->shaperCurve.b);
+}
+
+FlowId DNC::readFlowCheckpoint(Flow* f, BinaryReader& reader, ClientId clientId)
+{
+    if (f == NULL) {
+        f = new DNCFlow;
+    }
+    FlowId flowId = NC::readFlowCheckpoint(f, reader, clientId);
+    if (flowId == InvalidFlowId) {
+        return InvalidFlowId;
+    }
+    DNCFlow* dsf = getDNCFlow(flowId);
+    uint32_t numPoints = 0;
+    reader.readCount(numPoints, 3 * sizeof(double));
+    dsf->arrivalCurve.resize(numPoints);
+    for (Curve::iterator it = dsf->arrivalCurve.begin(); it != dsf->arrivalCurve.end(); it++) {
+        reader.read(it->x);
+        reader.read(it->y);
+        reader.read(it->slope);
+    }
+    dsf->shaperCurve = ZeroArrivalCurve();
+    reader.read(dsf->shaperCurve.r);
+    reader.read(dsf->shaperCurve.b);
+    addQueueShaperRate(dsf, dsf->shaperCurve, 1);
+    return reader.ok() ? flowId : InvalidFlowId;
+}
+
+QueueId DNC::readQueueCheckpoint(Queue* q, BinaryReader& reader)
+{
+    if (q == NULL) {
+        q = new DNCQueue;
+    }
+    QueueId queueId = NC::readQueueCheckpoint(q, reader);
+    if (queueId == InvalidQueueId) {
+        return InvalidQueueId;
+    }
+    DNCQueue* dsq = getDNCQueue(queueId);
+    dsq->aggregatesDirty = true;
+    dsq->shaperRate = 0;
+    dsq->numZeroShapers = 0;
+    return queueId;
+}
+
+void DNC::setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate, string arrivalCurveFilename, ArrivalCurveCache* pCache)
+{
+    setArrivalInfos(vector<Json::Value*>(1, &flowInfo), trace, vector<Json::Value>(1, estimatorInfo), vector<double>(1, maxRate), vector<string>(1, arrivalCurveFilename), pCache);
+}
+
+void DNC::setArrivalInfos(const vector<Json::Value*>& flowInfos, string trace, const vector<Json::Value>& estimatorInfos, const vector<double>& maxRates, const vector<string>& arrivalCurveFilenames, ArrivalCurveCache* pCache)
+{
+    TRACE_SPAN("DNC::setArrivalInfos");
+    assert(flowInfos.size() == estimatorInfos.size());
+    assert(flowInfos.size() == maxRates.size());
+    assert(flowInfos.size() == arrivalCurveFilenames.size());
+    vector<Curve> arrivalCurves(flowInfos.size());
+    // Find arrival curves that are not cached
+    vector<unsigned int> uncachedIndices;
+    vector<ProcessedTrace*> pTraces;
+    vector<double> uncachedMaxRates;
+    for (unsigned int i = 0; i < flowInfos.size(); i++) {
+        bool cached = (pCache != NULL) ? pCache->get(arrivalCurves[i], trace, estimatorInfos[i], maxRates[i])
+                                       : readArrivalCurve(arrivalCurves[i], arrivalCurveFilenames[i]);
+        if (!cached) {
+            // Init estimator and read trace
+            Estimator* pEst = Estimator::create(estimatorInfos[i]);
+            pTraces.push_back(ProcessedTrace::create(trace, pEst));
+            uncachedIndices.push_back(i);
+            uncachedMaxRates.push_back(maxRates[i]);
+        }
+    }
+    // Calculate uncached arrival curves together
+    if (!uncachedIndices.empty()) {
+        TRACE_SPAN("DNC::calcArrivalCurves");
+        vector<Curve> uncachedArrivalCurves;
+        calcArrivalCurves(uncachedArrivalCurves, pTraces, uncachedMaxRates);
+        for (unsigned int i = 0; i < uncachedIndices.size(); i++) {
+            delete pTraces[i];
+            unsigned int index = uncachedIndices[i];
+            arrivalCurves[index].swap(uncachedArrivalCurves[i]);
+            writeArrivalCurve(arrivalCurves[index], arrivalCurveFilenames[index]);
+            if (pCache != NULL) {
+                pCache->put(arrivalCurves[index], trace, estimatorInfos[index], maxRates[index]);
+            }
+        }
+    }
+    for (unsigned int i = 0; i < flowInfos.size(); i++) {
+        arrivalCurves[i].erase(arrivalCurves[i].begin());
+        serializeJSON(*flowInfos[i], "arrivalInfo", arrivalCurves[i]);
+    }
+}
+
+// Set the arrivalInfo in a flow from an r-b curve.
+void DNC::setArrivalInfo(Json::Value& flowInfo, const vector<double>& rates, const vector<double>& bursts)
+{
+    Curve arrivalCurve;
+    rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
+    pruneArrivalCurve(arrivalCurve, 12);
     arrivalCurve.erase(arrivalCurve.begin());
     serializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
 }
+
+// Scale the arrivalInfo in a flow by scale.
+void DNC::scaleArrivalInfo(Json::Value& flowInfo, double scale)
+{
+    Curve arrivalCurve;
+    deserializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+    for (unsigned int i = 0; i < arrivalCurve.size(); i++) {
+        arrivalCurve[i].y *= scale;
+        arrivalCurve[i].slope *= scale;
+    }
+    serializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+}
+
+// Replace the arrival curve of a flow with the arrivalInfo in flowInfo.
+void DNC::updateArrivalInfo(FlowId flowId, const Json::Value& flowInfo)
+{
+    Curve arrivalCurve;
+    deserializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+    PointSlope initialPoint(0, 0, numeric_limits<double>::infinity());
+    arrivalCurve.insert(arrivalCurve.begin(), initialPoint);
+    setArrivalCurve(flowId, arrivalCurve);
+}
@@ -9,6 +9,8 @@
 
 #include <string>
 #include <vector>
+#include <set>
+#include <map>
 #include "../common/serializeJSON.hpp"
 #include "../TraceCommon/ProcessedTrace.hpp"
 #include "NC.hpp"
@@ -65,20 +67,48 @@ struct SimpleServiceCurve {
 
 // Extends the Flow structure with DNC-specific information.
 struct DNCFlow : Flow {
+    OBJECT_POOL_OPERATORS(DNCFlow)
+
     Curve arrivalCurve;
     SimpleArrivalCurve shaperCurve;
 };
 
+// Aggregate shaper curves of the flows of a priority level in a queue.
+struct PriorityAggregate {
+    SimpleArrivalCurve atPriority; // aggregate of flows with the priority
+    SimpleArrivalCurve higherOrEqual; // aggregate of flows with the priority or higher (i.e., priority value <= the priority)
+};
+// Priority -> aggregate, for the priorities with flows.
+typedef map<unsigned int, PriorityAggregate> PriorityAggregates;
+
+// Extends the Queue structure with DNC-specific information.
+// The aggregates cover the flows whose first queue is the queue, which lets the aggregate analysis look up the
+// traffic at or above a priority rather than scanning the queue's flows. They are recalculated on first use after a flow in the queue changes.
+struct DNCQueue : Queue {
+    OBJECT_POOL_OPERATORS(DNCQueue)
+
+    bool aggregatesDirty; // aggregates need to be recalculated
+    PriorityAggregates firstHopAggregates; // aggregates of flows whose first queue is the queue
+    map<QueueId, PriorityAggregates> nextQueueAggregates; // second queue -> aggregates of flows whose first queue is the queue and that go to the second queue
+    map<QueueId, set<unsigned int> > prevQueuePriorities; // first queue -> priorities of flows whose second queue is the queue
+    double shaperRate; // sum of the shaper rates of the queue's flows; kept up to date as flows and shaper curves change
+    unsigned int numZeroShapers; // number of the queue's flows with zero (i.e., not yet optimized) shaper curves
+};
+
 enum DNCAlgorithm {
     DNC_SIMPLE_ALGORITHM_AGGREGATE,
     DNC_SIMPLE_ALGORITHM_HOP_BY_HOP,
 };
 
+class ArrivalCurveCache;
+
 // DNC algorithms for calculating latency.
 class DNC : public NC
 {
 private:
     DNCAlgorithm _algorithm;
+    map<FlowId, SimpleArrivalCurve> _whatIfShaperCurves; // original shaper curves of flows modified during a what-if evaluation
+    map<QueueId, pair<double, unsigned int> > _whatIfQueueShaperRates; // original shaperRate/numZeroShapers of queues modified during a what-if evaluation
 
     // DNC algorithm that analyzes a flow's latency by considering each queue (a.k.a., "hop") one at a time.
     void calcArrivalCurveAtQueue(const DNCFlow* f, unsigned int index, SimpleArrivalCurve& arrivalCurve);
@@ -87,11 +117,26 @@ private:
     // DNC algorithm that takes a similar analysis approach as in the SNC-Meister paper, except using DNC operators.
     // Currently supported for flows with up to two queues, as is the case when modeling end-host network links.
     void aggregateAnalysisTwoHop(DNCFlow* flow);
+    // Get a queue with its aggregates up to date.
+    const DNCQueue* getAggregatedQueue(QueueId queueId);
+    // Mark the aggregates of a flow's queues to be recalculated.
+    void invalidateQueueAggregates(FlowId flowId);
+    // Add (sign = 1) or remove (sign = -1) a flow's shaper curve to/from the shaper rates of its queues.
+    void addQueueShaperRate(const DNCFlow* f, const SimpleArrivalCurve& shaperCurve, int sign);
 
 protected:
     virtual FlowId initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId);
+    virtual QueueId initQueue(Queue* q, const Json::Value& queueInfo);
+    virtual void writeFlowCheckpoint(BinaryWriter& writer, const Flow* f) const;
+    virtual FlowId readFlowCheckpoint(Flow* f, BinaryReader& reader, ClientId clientId);
+    virtual QueueId readQueueCheckpoint(Queue* q, BinaryReader& reader);
 
     DNCFlow* getDNCFlow(FlowId flowId) { return static_cast<DNCFlow*>(const_cast<Flow*>(getFlow(flowId))); }
+    DNCQueue* getDNCQueue(QueueId queueId) { return static_cast<DNCQueue*>(const_cast<Queue*>(getQueue(queueId))); }
+
+    virtual void saveFlowState(FlowId flowId);
+    virtual void restoreFlowState(FlowId flowId);
+    virtual void invalidateFlowLatency(FlowId flowId, unsigned int priority);
 
 public:
     DNC(DNCAlgorithm algorithm = DNC_SIMPLE_ALGORITHM_AGGREGATE)
@@ -100,18 +145,54 @@ public:
     virtual ~DNC()
     {}
 
+    virtual void delClient(ClientId clientId);
+    // Queue shaper rates are restored exactly, rather than with the rounding of undoing each change.
+    virtual void endWhatIf();
+
     // Calculate the latency for a flow.
     // Assumes priorities are set.
+    // The latency is cached and only recalculated if the flow or a flow it depends on has changed (see NC::invalidateFlowLatency).
     virtual double calcFlowLatency(FlowId flowId);
 
     // Get the arrival curve representing the flow's behavior.
     const Curve& getArrivalCurve(FlowId flowId) { return getDNCFlow(flowId)->arrivalCurve; }
+    // Replace the arrival curve of a flow (e.g., when the workload's behavior has been re-characterized).
+    // Not supported during a what-if evaluation.
+    virtual void setArrivalCurve(FlowId flowId, const Curve& arrivalCurve);
 
     // Get/set the shaper curve that representing the flow's (r,b) rate limit parameters.
     const SimpleArrivalCurve& getShaperCurve(FlowId flowId) { return getDNCFlow(flowId)->shaperCurve; }
-    void setShaperCurve(FlowId flowId, const SimpleArrivalCurve& shaperCurve) { getDNCFlow(flowId)->shaperCurve = shaperCurve; }
+    void setShaperCurve(FlowId flowId, const SimpleArrivalCurve& shaperCurve) {
+        prepareFlowUpdate(flowId);
+        DNCFlow* f = getDNCFlow(flowId);
+        if ((f->shaperCurve.r != shaperCurve.r) || (f->shaperCurve.b != shaperCurve.b)) {
+            addQueueShaperRate(f, f->shaperCurve, -1);
+            f->shaperCurve = shaperCurve;
+            addQueueShaperRate(f, f->shaperCurve, 1);
+            invalidateFlowLatency(flowId, f->priority);
+        }
+    }
+    // Get the sum of the shaper rates of the flows in a queue (e.g., for a quick overload check).
+    // Returns false if a flow in the queue has a zero (i.e., not yet optimized) shaper curve.
+    bool getQueueShaperRate(QueueId queueId, double& shaperRate) {
+        const DNCQueue* q = getDNCQueue(queueId);
+        shaperRate = q->shaperRate;
+        return (q->numZeroShapers == 0);
+    }
 
-    static void setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate, string arrivalCurveFilename);
+    // Set the arrivalInfo in a flow, reading the arrival curve from arrivalCurveFilename if cached or else calculating it from the trace.
+    // If pCache is given, curves are looked up in and added to pCache instead, and arrivalCurveFilename is only written as an export.
+    static void setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate, string arrivalCurveFilename, ArrivalCurveCache* pCache = NULL);
+    // Set the arrivalInfo in a flow from an r-b curve (e.g., observed by an enforcer; see TraceCommon/RbEstimator.hpp).
+    // The arrival curve is pruned in the same manner as calcArrivalCurves. Assumes rates is decreasing.
+    static void setArrivalInfo(Json::Value& flowInfo, const vector<double>& rates, const vector<double>& bursts);
+    // Scale the arrivalInfo in a flow by scale, as if the flow's arrivals were scale times as large (e.g., to find how much more load fits).
+    static void scaleArrivalInfo(Json::Value& flowInfo, double scale);
+    // Replace the arrival curve of a flow with the arrivalInfo in flowInfo (see setArrivalCurve).
+    void updateArrivalInfo(FlowId flowId, const Json::Value& flowInfo);
+    // Set the arrivalInfo in a set of flows that share the same trace.
+    // Uncached arrival curves are calculated in parallel.
+    static void setArrivalInfos(const vector<Json::Value*>& flowInfos, string trace, const vector<Json::Value>& estimatorInfos, const vector<double>& maxRates, const vector<string>& arrivalCurveFilenames, ArrivalCurveCache* pCache = NULL);
 };
 
 // Return x-intercept of a line with a given slope passing through (x,y).
@@ -127,19 +208,68 @@ inline double yIntercept(double x, double y, double slope)
 
 // Calculate the minimum rate needed to sustain a workload (i.e., average rate of work).
 double calcMinRate(ProcessedTrace* pTrace);
+// Select the instruction set of the kernels used by rbGen and rbGenSegmented: "avx512f", "avx2", or "scalar".
+// Defaults to the first of these that the CPU supports; all give the same bursts. Returns false if the CPU does not support isa.
+// Not thread-safe with calculating r-b curves; intended for testing and benchmarking.
+bool setRbGenISA(string isa);
+// Get the instruction set of the kernels used by rbGen and rbGenSegmented.
+string getRbGenISA();
+// Calculate the r-b curve for a given workload for a given set of rates.
+// bursts[i] is the burst corresponding to rates[i].
+void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, vector<double>& bursts);
 // Calculate the r-b curve for a given workload for a given set of rates.
 void rbGen(ProcessedTrace* pTrace, const vector<double>& rates, map<double, double>& bursts);
+// Number of requests in each segment of a trace summarized by rbGenSegmented.
+#define RB_SEGMENT_SIZE 65536
+
+// Summary of the virtual token buckets of a set of rates over a segment of a trace (see rbGenSegmented).
+// For rates[i], a bucket entering the segment at level x leaves it at level max(x + offsets[i], levels[i]),
+// and its max level within the segment is max(x + offsetBursts[i], bursts[i]).
+// Summaries of consecutive segments are merged with mergeRbSegmentSummary, which is associative.
+struct RbSegmentSummary {
+    vector<double> offsets;
+    vector<double> levels;
+    vector<double> offsetBursts;
+    vector<double> bursts;
+};
+// Initialize the summary of an empty segment.
+void initRbSegmentSummary(RbSegmentSummary& summary, unsigned int numRates);
+// Add count requests to the end of a summarized segment.
+// interarrivals[j] is the time in seconds since the request before request j, and works[j] is its work.
+void addRbSegmentSummary(RbSegmentSummary& summary, const vector<double>& rates, const double* interarrivals, const double* works, unsigned int count);
+// Append the segment summarized by next to the segment summarized by summary.
+void mergeRbSegmentSummary(RbSegmentSummary& summary, const RbSegmentSummary& next);
+// Calculate the r-b curve for a given workload for a given set of rates, like rbGen, with segments of segmentSize
+// requests summarized in parallel on a thread pool of numThreads threads (0 uses the number of cores).
+// The trace is still read in order, but summarizing a segment is independent of the preceding requests,
+// so the computation scales with the number of threads even for a few rates.
+// bursts[i] is the burst corresponding to rates[i], which matches rbGen up to floating point rounding.
+void rbGenSegmented(ProcessedTrace* pTrace, const vector<double>& rates, vector<double>& bursts, unsigned int numThreads = 0, unsigned int segmentSize = RB_SEGMENT_SIZE);
 // Calculate intersection of two point slopes
 // Output slope is the same as first point p1
 // Returns p1 if slopes are the same
 PointSlope calcPointSlopeIntersection(const PointSlope& p1, const PointSlope& p2);
 // Generate an arrival curve from an r-b curve.
 // Assumes rates is decreasing
+void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, const vector<double>& bursts);
+// Generate an arrival curve from an r-b curve.
+// Assumes rates is decreasing
 void rbCurveToArrivalCurve(Curve& arrivalCurve, const vector<double>& rates, map<double, double>& bursts);
 // Approximate an arrival curve by an arrival curve with n points.
 void pruneArrivalCurve(Curve& arrivalCurve, unsigned int n);
 // Calculate an arrival curve from a trace.
-void calcArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate);
+// See calcArrivalCurves for tolerance.
+void calcArrivalCurve(Curve& arrivalCurve, ProcessedTrace* pTrace, double maxRate, double tolerance = 0);
+// Calculate arrival curves for a set of traces in parallel.
+// arrivalCurves[i] is calculated from pTraces[i] with maxRates[i].
+// The rates of each trace are split across a thread pool of numThreads threads (0 uses the number of cores).
+// Traces are read in fixed-size blocks, so memory use does not grow with the trace length.
+// With a tolerance of 0, bursts are calculated for a grid of 1000 rates in a single pass over each trace.
+// With a positive tolerance, a coarse sweep of the grid is refined only where the r-b curve could bend,
+// taking a pass over the trace to get the min rate and a pass per refinement; the arrival curve is no lower than and within a factor of
+// (1 + tolerance) of the arrival curve calculated from the whole grid.
+// Arrival curves are pruned to numPoints points (0 disables pruning).
+void calcArrivalCurves(vector<Curve>& arrivalCurves, const vector<ProcessedTrace*>& pTraces, const vector<double>& maxRates, unsigned int numThreads = 0, double tolerance = 0, unsigned int numPoints = 12);
 // Read an arrival curve from a file.
 bool readArrivalCurve(Curve& arrivalCurve, string arrivalCurveFilename);
 // Write an arrival curve to a file.
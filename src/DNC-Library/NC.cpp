@@ -8,12 +8,47 @@
 #include <cassert>
 #include <string>
 #include <vector>
+#include <set>
 #include <map>
+#include <algorithm>
+#include <functional>
 #include <json/json.h>
 #include "NC.hpp"
 
 using namespace std;
 
+// Allocate an id, reusing the lowest id on the free list if reuse is true.
+static unsigned int allocateId(vector<unsigned int>& freeIds, unsigned int& nextId, bool reuse)
+{
+    if (!reuse || freeIds.empty()) {
+        return nextId++;
+    }
+    pop_heap(freeIds.begin(), freeIds.end(), greater<unsigned int>());
+    unsigned int id = freeIds.back();
+    freeIds.pop_back();
+    return id;
+}
+
+// Add a deleted id to the free list.
+static void freeId(vector<unsigned int>& freeIds, unsigned int id)
+{
+    freeIds.push_back(id);
+    push_heap(freeIds.begin(), freeIds.end(), greater<unsigned int>());
+}
+
+// Rebuild a free list from the deleted ids below nextId in a table.
+template <class T>
+static void rebuildFreeIdList(vector<unsigned int>& freeIds, const vector<T*>& table, unsigned int nextId)
+{
+    // Ids in increasing order are a min-heap
+    freeIds.clear();
+    for (unsigned int id = 1; id < nextId; id++) {
+        if ((id >= table.size()) || (table[id] == NULL)) {
+            freeIds.push_back(id);
+        }
+    }
+}
+
 bool priorityCompare(const Flow* f1, const Flow* f2)
 {
     if (f1->priority == f2->priority) {
@@ -23,25 +58,36 @@ bool priorityCompare(const Flow* f1, const Flow* f2)
     return (f1->priority < f2->priority);
 }
 
+bool operator< (const FlowIndex& fi1, const FlowIndex& fi2)
+{
+    if (fi1.flowId == fi2.flowId) {
+        return (fi1.index < fi2.index);
+    }
+    return (fi1.flowId < fi2.flowId);
+}
+
 NC::NC()
     : _nextFlowId(InvalidFlowId + 1),
       _nextClientId(InvalidClientId + 1),
-      _nextQueueId(InvalidQueueId + 1)
+      _nextQueueId(InvalidQueueId + 1),
+      _whatIf(false),
+      _whatIfFlowId(InvalidFlowId),
+      _whatIfClientId(InvalidClientId)
 {
 }
 
 NC::~NC()
 {
     // Delete flows
-    for (map<FlowId, Flow*>::const_iterator it = flowsBegin(); it != flowsEnd(); it++) {
+    for (FlowIterator it = flowsBegin(); it != flowsEnd(); it++) {
         delete it->second;
     }
     // Delete clients
-    for (map<ClientId, Client*>::const_iterator it = clientsBegin(); it != clientsEnd(); it++) {
+    for (ClientIterator it = clientsBegin(); it != clientsEnd(); it++) {
         delete it->second;
     }
     // Delete queues
-    for (map<QueueId, Queue*>::const_iterator it = queuesBegin(); it != queuesEnd(); it++) {
+    for (QueueIterator it = queuesBegin(); it != queuesEnd(); it++) {
         delete it->second;
     }
 }
@@ -51,29 +97,33 @@ FlowId NC::initFlow(Flow* f, const Json::Value& flowInfo, ClientId clientId)
     if (f == NULL) {
         f = new Flow;
     }
-    FlowId flowId = _nextFlowId++;
+    FlowId flowId = allocateId(_freeFlowIds, _nextFlowId, !_whatIf);
     f->flowId = flowId;
-    _flows[flowId] = f;
     f->name = flowInfo["name"].asString();
-    _flowIds[f->name] = flowId;
+    insertFlow(f);
     f->clientId = clientId;
     // Add flow to client flows list
-    Client* c = _clients[clientId];
+    Client* c = _clientTable[clientId];
     c->flowIds.push_back(flowId);
     const Json::Value& flowQueues = flowInfo["queues"];
     f->queueIds.resize(flowQueues.size());
+    f->queuePositions.resize(flowQueues.size());
     for (unsigned int index = 0; index < flowQueues.size(); index++) {
         QueueId queueId = getQueueIdByName(flowQueues[index].asString());
         f->queueIds[index] = queueId;
         // Init queue's list of flows
+        Queue* q = _queueTable[queueId];
         FlowIndex fi;
         fi.flowId = flowId;
         fi.index = index;
-        _queues[queueId]->flows.push_back(fi);
+        f->queuePositions[index] = q->flows.size();
+        q->flows.push_back(fi);
     }
     f->priority = flowInfo.isMember("priority") ? flowInfo["priority"].asUInt() : 1;
     f->latency = 0;
+    f->latencyDirty = false;
     f->ignoreLatency = c->ignoreLatency;
+    invalidateFlowLatency(flowId, f->priority);
     return flowId;
 }
 
@@ -82,11 +132,10 @@ ClientId NC::initClient(Client* c, const Json::Value& clientInfo)
     if (c == NULL) {
         c = new Client;
     }
-    ClientId clientId = _nextClientId++;
+    ClientId clientId = allocateId(_freeClientIds, _nextClientId, !_whatIf);
     c->clientId = clientId;
-    _clients[clientId] = c;
     c->name = clientInfo["name"].asString();
-    _clientIds[c->name] = clientId;
+    insertClient(c);
     c->SLO = clientInfo["SLO"].asDouble();
     c->SLOpercentile = clientInfo.isMember("SLOpercentile") ? clientInfo["SLOpercentile"].asDouble() : 99.9;
     c->latency = 0;
@@ -101,15 +150,48 @@ QueueId NC::initQueue(Queue* q, const Json::Value& queueInfo)
     if (q == NULL) {
         q = new Queue;
     }
-    QueueId queueId = _nextQueueId++;
+    QueueId queueId = allocateId(_freeQueueIds, _nextQueueId, true);
     q->queueId = queueId;
-    _queues[queueId] = q;
     q->name = queueInfo["name"].asString();
-    _queueIds[q->name] = queueId;
+    insertQueue(q);
     q->bandwidth = queueInfo["bandwidth"].asDouble();
     return queueId;
 }
 
+void NC::insertFlow(Flow* f)
+{
+    if (_flowTable.size() <= f->flowId) {
+        _flowTable.resize(f->flowId + 1, NULL);
+    }
+    _flowTable[f->flowId] = f;
+    _flowIds[f->name] = f->flowId;
+}
+
+void NC::insertClient(Client* c)
+{
+    if (_clientTable.size() <= c->clientId) {
+        _clientTable.resize(c->clientId + 1, NULL);
+    }
+    _clientTable[c->clientId] = c;
+    _clientIds[c->name] = c->clientId;
+}
+
+void NC::insertQueue(Queue* q)
+{
+    if (_queueTable.size() <= q->queueId) {
+        _queueTable.resize(q->queueId + 1, NULL);
+    }
+    _queueTable[q->queueId] = q;
+    _queueIds[q->name] = q->queueId;
+}
+
+void NC::rebuildFreeIds()
+{
+    rebuildFreeIdList(_freeFlowIds, _flowTable, _nextFlowId);
+    rebuildFreeIdList(_freeClientIds, _clientTable, _nextClientId);
+    rebuildFreeIdList(_freeQueueIds, _queueTable, _nextQueueId);
+}
+
 ClientId NC::addClient(const Json::Value& clientInfo)
 {
     // Initialize client
@@ -129,50 +211,210 @@ QueueId NC::addQueue(const Json::Value& queueInfo)
 
 void NC::delClient(ClientId clientId)
 {
-    Client* c = _clients[clientId];
+    Client* c = _clientTable[clientId];
+    // Mark flows depending on client's flows while they are still in the queues
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        FlowId flowId = c->flowIds[flowIndex];
+        invalidateFlowLatency(flowId, _flowTable[flowId]->priority);
+    }
+    updateDirtyFlows();
     // Delete client's flows
     for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
         FlowId flowId = c->flowIds[flowIndex];
-        Flow* f = _flows[flowId];
-        // Delete flow from queues
+        Flow* f = _flowTable[flowId];
+        setFlowLatencyDirty(f, false);
+        // Delete flow from queues by moving the last flow in each queue's list into its position
         for (unsigned int index = 0; index < f->queueIds.size(); index++) {
-            Queue* q = _queues[f->queueIds[index]];
-            for (vector<FlowIndex>::iterator it = q->flows.begin(); it != q->flows.end(); it++) {
-                if (it->flowId == flowId) {
-                    q->flows.erase(it);
-                    break;
-                }
-            }
+            Queue* q = _queueTable[f->queueIds[index]];
+            unsigned int position = f->queuePositions[index];
+            const FlowIndex& last = q->flows.back();
+            _flowTable[last.flowId]->queuePositions[last.index] = position;
+            q->flows[position] = last;
+            q->flows.pop_back();
         }
         _flowIds.erase(f->name);
-        _flows.erase(flowId);
+        _flowTable[flowId] = NULL;
+        if (!_whatIf) {
+            freeId(_freeFlowIds, flowId);
+        }
         delete f;
     }
     // Delete client
     _clientIds.erase(c->name);
-    _clients.erase(clientId);
+    _clientTable[clientId] = NULL;
+    if (!_whatIf) {
+        freeId(_freeClientIds, clientId);
+    }
     delete c;
 }
 
 void NC::delQueue(QueueId queueId)
 {
-    Queue* q = _queues[queueId];
+    Queue* q = _queueTable[queueId];
     assert(q->flows.empty());
     _queueIds.erase(q->name);
-    _queues.erase(queueId);
+    _queueTable[queueId] = NULL;
+    freeId(_freeQueueIds, queueId);
     delete q;
 }
 
 void NC::setFlowPriority(FlowId flowId, unsigned int priority)
 {
-    Flow* f = _flows[flowId];
-    f->priority = priority;
+    prepareFlowUpdate(flowId);
+    Flow* f = _flowTable[flowId];
+    if (f->priority != priority) {
+        invalidateFlowLatency(flowId, min(f->priority, priority));
+        f->priority = priority;
+    }
+}
+
+void NC::setFlowLatencyDirty(Flow* f, bool dirty)
+{
+    if (f->latencyDirty != dirty) {
+        f->latencyDirty = dirty;
+        if (dirty) {
+            _dirtyFlowIds.insert(f->flowId);
+        } else {
+            _dirtyFlowIds.erase(f->flowId);
+        }
+    }
+}
+
+void NC::invalidateFlowLatency(FlowId flowId, unsigned int priority)
+{
+    map<FlowId, unsigned int>::iterator it = _invalidatedFlows.find(flowId);
+    if (it == _invalidatedFlows.end()) {
+        _invalidatedFlows[flowId] = priority;
+    } else if (priority < it->second) {
+        it->second = priority;
+    }
+}
+
+void NC::markDirtyFlows(const FlowIndex& fi, unsigned int priority, set<FlowIndex>& visited)
+{
+    Flow* f = _flowTable[fi.flowId];
+    // If f is higher priority, it is unaffected
+    if (f->priority < priority) {
+        return;
+    }
+    // If we've already marked flow at given index, stop
+    if (!visited.insert(fi).second) {
+        return;
+    }
+    setFlowLatencyDirty(f, true);
+    // Loop through queues affected by flow starting at index
+    for (unsigned int index = fi.index; index < f->queueIds.size(); index++) {
+        const Queue* q = _queueTable[f->queueIds[index]];
+        // Try marking other flows sharing queue
+        for (vector<FlowIndex>::const_iterator itFi = q->flows.begin(); itFi != q->flows.end(); itFi++) {
+            markDirtyFlows(*itFi, f->priority, visited);
+        }
+    }
+}
+
+void NC::markDependentFlows(FlowId flowId, unsigned int priority, set<FlowIndex>& visited)
+{
+    Flow* f = _flowTable[flowId];
+    setFlowLatencyDirty(f, true);
+    // Flows of lower (or equal) priority than the changed priority that share the flow's queues, and the flows depending on them
+    for (unsigned int index = 0; index < f->queueIds.size(); index++) {
+        const Queue* q = _queueTable[f->queueIds[index]];
+        for (vector<FlowIndex>::const_iterator itFi = q->flows.begin(); itFi != q->flows.end(); itFi++) {
+            if (itFi->flowId != flowId) {
+                markDirtyFlows(*itFi, priority, visited);
+            }
+        }
+    }
+}
+
+void NC::updateDirtyFlows()
+{
+    if (!_invalidatedFlows.empty()) {
+        set<FlowIndex> visited;
+        for (map<FlowId, unsigned int>::const_iterator it = _invalidatedFlows.begin(); it != _invalidatedFlows.end(); it++) {
+            markDependentFlows(it->first, it->second, visited);
+        }
+        _invalidatedFlows.clear();
+    }
+}
+
+void NC::getDirtyClients(set<ClientId>& clientIds)
+{
+    updateDirtyFlows();
+    for (set<FlowId>::const_iterator it = _dirtyFlowIds.begin(); it != _dirtyFlowIds.end(); it++) {
+        clientIds.insert(_flowTable[*it]->clientId);
+    }
+}
+
+void NC::prepareFlowUpdate(FlowId flowId)
+{
+    if (_whatIf && (flowId < _whatIfFlowId) && (_whatIfFlows.find(flowId) == _whatIfFlows.end())) {
+        const Flow* f = getFlow(flowId);
+        FlowState& state = _whatIfFlows[flowId];
+        state.priority = f->priority;
+        state.latency = f->latency;
+        saveFlowState(flowId);
+    }
+}
+
+void NC::prepareClientUpdate(ClientId clientId)
+{
+    if (_whatIf && (clientId < _whatIfClientId) && (_whatIfClientLatencies.find(clientId) == _whatIfClientLatencies.end())) {
+        _whatIfClientLatencies[clientId] = getClient(clientId)->latency;
+    }
+}
+
+void NC::beginWhatIf()
+{
+    assert(!_whatIf);
+    _whatIf = true;
+    _whatIfFlowId = _nextFlowId;
+    _whatIfClientId = _nextClientId;
+    updateDirtyFlows();
+    _whatIfDirtyFlowIds = _dirtyFlowIds;
+}
+
+void NC::endWhatIf()
+{
+    assert(_whatIf);
+    // Restore flows
+    for (map<FlowId, FlowState>::const_iterator it = _whatIfFlows.begin(); it != _whatIfFlows.end(); it++) {
+        Flow* f = _flowTable[it->first];
+        f->priority = it->second.priority;
+        f->latency = it->second.latency;
+        restoreFlowState(it->first);
+    }
+    // Restore clients
+    for (map<ClientId, double>::const_iterator it = _whatIfClientLatencies.begin(); it != _whatIfClientLatencies.end(); it++) {
+        _clientTable[it->first]->latency = it->second;
+    }
+    // Check that added clients were deleted
+    assert(ClientIterator(_clientTable, _whatIfClientId) == clientsEnd());
+    assert(FlowIterator(_flowTable, _whatIfFlowId) == flowsEnd());
+    // Reuse the ids of the clients and flows added during the evaluation
+    _nextFlowId = _whatIfFlowId;
+    _nextClientId = _whatIfClientId;
+    _flowTable.resize(_whatIfFlowId, NULL);
+    _clientTable.resize(_whatIfClientId, NULL);
+    // The restored flows are in the same state as at the start of the evaluation, so their latencies are dirty if and only if they were then
+    _invalidatedFlows.clear();
+    for (set<FlowId>::const_iterator it = _dirtyFlowIds.begin(); it != _dirtyFlowIds.end(); it++) {
+        _flowTable[*it]->latencyDirty = false;
+    }
+    _dirtyFlowIds.swap(_whatIfDirtyFlowIds);
+    _whatIfDirtyFlowIds.clear();
+    for (set<FlowId>::const_iterator it = _dirtyFlowIds.begin(); it != _dirtyFlowIds.end(); it++) {
+        _flowTable[*it]->latencyDirty = true;
+    }
+    _whatIfFlows.clear();
+    _whatIfClientLatencies.clear();
+    _whatIf = false;
 }
 
 void NC::calcAllLatency()
 {
     // Loop through clients and calculate latency
-    for (map<ClientId, Client*>::const_iterator it = clientsBegin(); it != clientsEnd(); it++) {
+    for (ClientIterator it = clientsBegin(); it != clientsEnd(); it++) {
         calcClientLatency(it->first);
     }
 }
@@ -180,10 +422,230 @@ void NC::calcAllLatency()
 double NC::calcClientLatency(ClientId clientId)
 {
     // Loop through client's flows and calculate latency
-    Client* c = _clients[clientId];
+    prepareClientUpdate(clientId);
+    Client* c = _clientTable[clientId];
     c->latency = 0;
     for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
         c->latency += calcFlowLatency(c->flowIds[flowIndex]);
     }
     return c->latency;
 }
+
+void NC::writeFlowCheckpoint(BinaryWriter& writer, const Flow* f) const
+{
+    writer.write(static_cast<uint32_t>(f->flowId));
+    writer.write(f->name);
+    writer.write(static_cast<uint32_t>(f->queueIds.size()));
+    for (unsigned int index = 0; index < f->queueIds.size(); index++) {
+        writer.write(static_cast<uint32_t>(f->queueIds[index]));
+    }
+    writer.write(static_cast<uint32_t>(f->priority));
+    writer.write(f->latency);
+    writer.write(f->latencyDirty);
+}
+
+FlowId NC::readFlowCheckpoint(Flow* f, BinaryReader& reader, ClientId clientId)
+{
+    if (f == NULL) {
+        f = new Flow;
+    }
+    uint32_t flowId = InvalidFlowId;
+    uint32_t numQueues = 0;
+    reader.read(flowId);
+    reader.read(f->name);
+    reader.readCount(numQueues, sizeof(uint32_t));
+    f->queueIds.resize(numQueues);
+    for (unsigned int index = 0; index < numQueues; index++) {
+        uint32_t queueId = InvalidQueueId;
+        reader.read(queueId);
+        if (getQueue(queueId) == NULL) {
+            reader.fail();
+        }
+        f->queueIds[index] = queueId;
+    }
+    uint32_t priority = 0;
+    bool latencyDirty = false;
+    reader.read(priority);
+    reader.read(f->latency);
+    reader.read(latencyDirty);
+    if (!reader.ok() || (flowId == InvalidFlowId) || (flowId >= _nextFlowId) || (getFlow(flowId) != NULL) || (getFlowIdByName(f->name) != InvalidFlowId)) {
+        reader.fail();
+        delete f;
+        return InvalidFlowId;
+    }
+    f->flowId = flowId;
+    insertFlow(f);
+    // Positions are set when reading the queues' lists of flows
+    f->queuePositions.assign(numQueues, static_cast<unsigned int>(-1));
+    f->priority = priority;
+    f->latencyDirty = false;
+    setFlowLatencyDirty(f, latencyDirty);
+    Client* c = _clientTable[clientId];
+    f->clientId = clientId;
+    f->ignoreLatency = c->ignoreLatency;
+    c->flowIds.push_back(flowId);
+    return flowId;
+}
+
+void NC::writeQueueCheckpoint(BinaryWriter& writer, const Queue* q) const
+{
+    writer.write(static_cast<uint32_t>(q->queueId));
+    writer.write(q->name);
+    writer.write(q->bandwidth);
+}
+
+QueueId NC::readQueueCheckpoint(Queue* q, BinaryReader& reader)
+{
+    if (q == NULL) {
+        q = new Queue;
+    }
+    uint32_t queueId = InvalidQueueId;
+    reader.read(queueId);
+    reader.read(q->name);
+    reader.read(q->bandwidth);
+    if (!reader.ok() || (queueId == InvalidQueueId) || (queueId >= _nextQueueId) || (getQueue(queueId) != NULL) || (getQueueIdByName(q->name) != InvalidQueueId)) {
+        reader.fail();
+        delete q;
+        return InvalidQueueId;
+    }
+    q->queueId = queueId;
+    insertQueue(q);
+    return queueId;
+}
+
+void NC::writeCheckpoint(BinaryWriter& writer) const
+{
+    assert(!_whatIf);
+    writer.write(static_cast<uint32_t>(_nextFlowId));
+    writer.write(static_cast<uint32_t>(_nextClientId));
+    writer.write(static_cast<uint32_t>(_nextQueueId));
+    // Queues
+    writer.write(static_cast<uint32_t>(distance(queuesBegin(), queuesEnd())));
+    for (QueueIterator it = queuesBegin(); it != queuesEnd(); it++) {
+        writeQueueCheckpoint(writer, it->second);
+    }
+    // Clients and their flows
+    writer.write(static_cast<uint32_t>(distance(clientsBegin(), clientsEnd())));
+    for (ClientIterator it = clientsBegin(); it != clientsEnd(); it++) {
+        const Client* c = it->second;
+        writer.write(static_cast<uint32_t>(c->clientId));
+        writer.write(c->name);
+        writer.write(c->SLO);
+        writer.write(c->SLOpercentile);
+        writer.write(c->latency);
+        writer.write(c->ignoreLatency);
+        writer.write(static_cast<uint32_t>(c->flowIds.size()));
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            writeFlowCheckpoint(writer, _flowTable[c->flowIds[flowIndex]]);
+        }
+    }
+    // Queues' lists of flows, so that the restored lists are in the same order
+    for (QueueIterator it = queuesBegin(); it != queuesEnd(); it++) {
+        const Queue* q = it->second;
+        writer.write(static_cast<uint32_t>(q->flows.size()));
+        for (vector<FlowIndex>::const_iterator itFi = q->flows.begin(); itFi != q->flows.end(); itFi++) {
+            writer.write(static_cast<uint32_t>(itFi->flowId));
+            writer.write(static_cast<uint32_t>(itFi->index));
+        }
+    }
+    // Changes not yet propagated to the latencyDirty state (see updateDirtyFlows)
+    writer.write(static_cast<uint32_t>(_invalidatedFlows.size()));
+    for (map<FlowId, unsigned int>::const_iterator it = _invalidatedFlows.begin(); it != _invalidatedFlows.end(); it++) {
+        writer.write(static_cast<uint32_t>(it->first));
+        writer.write(static_cast<uint32_t>(it->second));
+    }
+}
+
+bool NC::readCheckpoint(BinaryReader& reader)
+{
+    assert(!_whatIf && (queuesBegin() == queuesEnd()) && (clientsBegin() == clientsEnd()));
+    uint32_t nextFlowId = 0;
+    uint32_t nextClientId = 0;
+    uint32_t nextQueueId = 0;
+    reader.read(nextFlowId);
+    reader.read(nextClientId);
+    reader.read(nextQueueId);
+    if (!reader.ok() || (nextFlowId <= InvalidFlowId) || (nextClientId <= InvalidClientId) || (nextQueueId <= InvalidQueueId)) {
+        return false;
+    }
+    _nextFlowId = nextFlowId;
+    _nextClientId = nextClientId;
+    _nextQueueId = nextQueueId;
+    // Queues
+    uint32_t numQueues = 0;
+    reader.readCount(numQueues, sizeof(uint32_t));
+    for (unsigned int i = 0; i < numQueues; i++) {
+        if (readQueueCheckpoint(NULL, reader) == InvalidQueueId) {
+            return false;
+        }
+    }
+    // Clients and their flows
+    uint32_t numClients = 0;
+    reader.readCount(numClients, sizeof(uint32_t));
+    size_t numFlowIndices = 0;
+    for (unsigned int i = 0; i < numClients; i++) {
+        Client* c = new Client;
+        uint32_t clientId = InvalidClientId;
+        uint32_t numFlows = 0;
+        reader.read(clientId);
+        reader.read(c->name);
+        reader.read(c->SLO);
+        reader.read(c->SLOpercentile);
+        reader.read(c->latency);
+        reader.read(c->ignoreLatency);
+        reader.readCount(numFlows, sizeof(uint32_t));
+        if (!reader.ok() || (clientId == InvalidClientId) || (clientId >= _nextClientId) || (getClient(clientId) != NULL) || (getClientIdByName(c->name) != InvalidClientId)) {
+            delete c;
+            return false;
+        }
+        c->clientId = clientId;
+        insertClient(c);
+        for (unsigned int flowIndex = 0; flowIndex < numFlows; flowIndex++) {
+            FlowId flowId = readFlowCheckpoint(NULL, reader, clientId);
+            if (flowId == InvalidFlowId) {
+                return false;
+            }
+            numFlowIndices += _flowTable[flowId]->queueIds.size();
+        }
+    }
+    // Queues' lists of flows
+    for (QueueIterator it = queuesBegin(); it != queuesEnd(); it++) {
+        Queue* q = it->second;
+        uint32_t numFlows = 0;
+        reader.readCount(numFlows, 2 * sizeof(uint32_t));
+        q->flows.resize(numFlows);
+        for (unsigned int position = 0; position < numFlows; position++) {
+            uint32_t flowId = InvalidFlowId;
+            uint32_t index = 0;
+            reader.read(flowId);
+            reader.read(index);
+            Flow* f = const_cast<Flow*>(getFlow(flowId));
+            if (!reader.ok() || (f == NULL) || (index >= f->queueIds.size()) || (f->queueIds[index] != q->queueId) || (f->queuePositions[index] != static_cast<unsigned int>(-1))) {
+                return false;
+            }
+            f->queuePositions[index] = position;
+            q->flows[position].flowId = flowId;
+            q->flows[position].index = index;
+        }
+        numFlowIndices -= numFlows;
+    }
+    // Every flow must be in the lists of each of its queues
+    if (numFlowIndices != 0) {
+        return false;
+    }
+    rebuildFreeIds();
+    // Changes not yet propagated to the latencyDirty state
+    uint32_t numInvalidatedFlows = 0;
+    reader.readCount(numInvalidatedFlows, 2 * sizeof(uint32_t));
+    for (unsigned int i = 0; i < numInvalidatedFlows; i++) {
+        uint32_t flowId = InvalidFlowId;
+        uint32_t priority = 0;
+        reader.read(flowId);
+        reader.read(priority);
+        if (!reader.ok() || (getFlow(flowId) == NULL)) {
+            return false;
+        }
+        _invalidatedFlows[flowId] = priority;
+    }
+    return reader.ok();
+}
@@ -21,6 +21,12 @@
 // "name": string - name of queue
 // "bandwidth": float - bandwidth of queue, in "work" units (see Estimator.hpp)
 //
+// Flows, clients, and queues are allocated from per-thread slab pools (see ObjectPool.hpp) and looked up by id through dense tables,
+// whose ids are reused once the entries are deleted. Names are looked up through hash tables.
+//
+// The system can be saved to a compact binary checkpoint (see writeCheckpoint) and restored without reparsing the JSON dictionaries
+// or recalculating the analysis (e.g., when restarting a server).
+//
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
 //
@@ -30,8 +36,13 @@
 
 #include <string>
 #include <vector>
+#include <set>
 #include <map>
+#include <iterator>
+#include <tr1/unordered_map>
 #include <json/json.h>
+#include "../common/ObjectPool.hpp"
+#include "../common/serializeBinary.hpp"
 
 using namespace std;
 
@@ -48,13 +59,16 @@ const QueueId InvalidQueueId = 0;
 // For example, we use a flow to represent the traffic from a VM to a server, and another flow to represent the traffic from the server back to the VM.
 struct Flow {
     virtual ~Flow() {}
+    OBJECT_POOL_OPERATORS(Flow)
 
     FlowId flowId; // Id of flow
     string name; // Name of flow
     ClientId clientId; // Id of client that flow belongs to
     vector<QueueId> queueIds; // Ordered list of queues visited by flow
+    vector<unsigned int> queuePositions; // Position of flow in each queue's list of flows; queuePositions[i] is the position in queueIds[i]'s list
     unsigned int priority; // Priority of flow (lower = higher priority)
     double latency; // Latency of flow, once calculated
+    bool latencyDirty; // Latency needs to be recalculated since the flow or a flow it competes with has changed
     bool ignoreLatency; // Ignore flow for the purposes of latency; only relevant for checking overload conditions
 };
 
@@ -64,6 +78,7 @@ struct Flow {
 // The end-to-end SLO and SLO percentile (e.g., 10ms for 99.9% of requests) are specified for clients.
 struct Client {
     virtual ~Client() {}
+    OBJECT_POOL_OPERATORS(Client)
 
     ClientId clientId; // Id of client
     string name; // Name of client
@@ -79,15 +94,19 @@ struct FlowIndex {
     unsigned int index; // Index within flow's queueIds vector
 };
 
+// FlowIndex less-than function
+bool operator< (const FlowIndex& fi1, const FlowIndex& fi2);
+
 // Base structure for representing a queue.
 // A queue is used to represent congestion points within the system.
 // For a network, this often occurs at the end-host network links, especially in full-bisection bandwidth networks.
 struct Queue {
     virtual ~Queue() {}
+    OBJECT_POOL_OPERATORS(Queue)
 
     QueueId queueId; // Id of queue
     string name; // Name of queue
-    vector<FlowIndex> flows; // Unordered list of flows that use queue
+    vector<FlowIndex> flows; // Unordered list of flows that use queue; flows are deleted by moving the last flow into their position
     double bandwidth; // Bandwidth of queue, in "work" units (see Estimator.hpp)
 };
 
@@ -95,19 +114,110 @@ struct Queue {
 // Returns true if f1 is higher priority than f2.
 bool priorityCompare(const Flow* f1, const Flow* f2);
 
+// Iterator over the entries of an id table in id order, skipping the ids of deleted entries.
+// Dereferences to an (id, entry) pair like a map<unsigned int, T*>::const_iterator. Entries may be deleted while iterating.
+template <class T>
+class IdTableIterator
+{
+private:
+    const vector<T*>* _pTable;
+    unsigned int _id;
+    pair<unsigned int, T*> _entry;
+
+    // Advance _id to the next entry that is not deleted, or to the end of the table.
+    void skipDeleted()
+    {
+        while ((_id < _pTable->size()) && ((*_pTable)[_id] == NULL)) {
+            _id++;
+        }
+        _entry.first = _id;
+        _entry.second = (_id < _pTable->size()) ? (*_pTable)[_id] : NULL;
+    }
+
+public:
+    typedef forward_iterator_tag iterator_category;
+    typedef pair<unsigned int, T*> value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef const value_type& reference;
+
+    IdTableIterator(const vector<T*>& table, unsigned int id)
+        : _pTable(&table),
+          _id(id)
+    {
+        skipDeleted();
+    }
+
+    reference operator*() const { return _entry; }
+    pointer operator->() const { return &_entry; }
+    IdTableIterator& operator++()
+    {
+        _id++;
+        skipDeleted();
+        return *this;
+    }
+    IdTableIterator operator++(int)
+    {
+        IdTableIterator it = *this;
+        ++(*this);
+        return it;
+    }
+    bool operator==(const IdTableIterator& it) const { return (_id == it._id); }
+    bool operator!=(const IdTableIterator& it) const { return (_id != it._id); }
+};
+
 // Base class for representing a network calculus analysis toolkit.
 class NC
 {
+public:
+    typedef IdTableIterator<Flow> FlowIterator;
+    typedef IdTableIterator<Client> ClientIterator;
+    typedef IdTableIterator<Queue> QueueIterator;
+
 private:
-    map<string, FlowId> _flowIds; // map flow name -> flow id
-    map<string, ClientId> _clientIds; // map client name -> client id
-    map<string, QueueId> _queueIds; // map queue name -> queue id
-    map<FlowId, Flow*> _flows; // map flow id -> flow data
-    map<ClientId, Client*> _clients; // map client id -> client data
-    map<QueueId, Queue*> _queues; // map queue id -> queue data
-    FlowId _nextFlowId; // next flow id to use for new flow
-    ClientId _nextClientId; // next client id to use for new client
-    QueueId _nextQueueId; // next queue id to use for new queue
+    tr1::unordered_map<string, FlowId> _flowIds; // hash of flow name -> flow id
+    tr1::unordered_map<string, ClientId> _clientIds; // hash of client name -> client id
+    tr1::unordered_map<string, QueueId> _queueIds; // hash of queue name -> queue id
+    // Ids are dense indices into the tables; ids of deleted entries are NULL.
+    // Outside of a what-if evaluation, the ids of deleted entries go on the free lists and the lowest is reused first, so the tables stay
+    // as large as the most entries there have been and a system restored from a checkpoint assigns the same ids. Ids allocated during
+    // a what-if evaluation are taken from the end of the tables and reused after it.
+    vector<Flow*> _flowTable; // flow id -> flow data
+    vector<Client*> _clientTable; // client id -> client data
+    vector<Queue*> _queueTable; // queue id -> queue data
+    vector<FlowId> _freeFlowIds; // min-heap of deleted flow ids below _nextFlowId
+    vector<ClientId> _freeClientIds; // min-heap of deleted client ids below _nextClientId
+    vector<QueueId> _freeQueueIds; // min-heap of deleted queue ids below _nextQueueId
+    FlowId _nextFlowId; // next flow id to use for new flow when there are no free ids
+    ClientId _nextClientId; // next client id to use for new client when there are no free ids
+    QueueId _nextQueueId; // next queue id to use for new queue when there are no free ids
+    // What-if evaluation state (see beginWhatIf)
+    struct FlowState {
+        unsigned int priority;
+        double latency;
+    };
+    bool _whatIf; // in a what-if evaluation
+    FlowId _whatIfFlowId; // flows with lower ids existed before the what-if evaluation
+    ClientId _whatIfClientId; // clients with lower ids existed before the what-if evaluation
+    map<FlowId, FlowState> _whatIfFlows; // original state of flows modified during the what-if evaluation
+    map<ClientId, double> _whatIfClientLatencies; // original latency of clients modified during the what-if evaluation
+    // Latency dependency tracking (see invalidateFlowLatency)
+    set<FlowId> _dirtyFlowIds; // flows with latencyDirty set
+    map<FlowId, unsigned int> _invalidatedFlows; // flows changed since the last updateDirtyFlows -> highest priority before/after the change
+    set<FlowId> _whatIfDirtyFlowIds; // _dirtyFlowIds at the start of a what-if evaluation
+
+    // Set the latencyDirty state of a flow.
+    void setFlowLatencyDirty(Flow* f, bool dirty);
+    // Mark the flows whose latency depends on a flow's traffic at a priority from the flow's queue at index fi.index onward.
+    void markDirtyFlows(const FlowIndex& fi, unsigned int priority, set<FlowIndex>& visited);
+    // Mark the flows whose latency depends on a changed flow.
+    void markDependentFlows(FlowId flowId, unsigned int priority, set<FlowIndex>& visited);
+    // Add a flow/client/queue to the id tables and name hash tables.
+    void insertFlow(Flow* f);
+    void insertClient(Client* c);
+    void insertQueue(Queue* q);
+    // Rebuild the free lists from the deleted ids in the tables after reading a checkpoint.
+    void rebuildFreeIds();
 
 protected:
     // Initialize a flow. Overridden by derived classes with extra flow information/initialization.
@@ -119,6 +229,34 @@ protected:
     // Initialize a queue. Overridden by derived classes with extra client information/initialization.
     // If q is NULL, q will be created. See file header for queueInfo description.
     virtual QueueId initQueue(Queue* q, const Json::Value& queueInfo);
+    // Write/read a flow's or queue's state to/from a checkpoint (see writeCheckpoint). Overridden by derived classes with extra state.
+    // When reading, if f/q is NULL, it will be created. The flow is added to its client, but not to its queues' lists of flows, which are read separately.
+    // Returns the id read, or an invalid id if the checkpoint is malformed.
+    virtual void writeFlowCheckpoint(BinaryWriter& writer, const Flow* f) const;
+    virtual FlowId readFlowCheckpoint(Flow* f, BinaryReader& reader, ClientId clientId);
+    virtual void writeQueueCheckpoint(BinaryWriter& writer, const Queue* q) const;
+    virtual QueueId readQueueCheckpoint(Queue* q, BinaryReader& reader);
+
+    // Must be called before modifying the state of a flow/client (e.g., priority, latency).
+    // During a what-if evaluation, the original state is saved the first time a pre-existing flow/client is modified.
+    void prepareFlowUpdate(FlowId flowId);
+    void prepareClientUpdate(ClientId clientId);
+    // Save/restore the original state of a pre-existing flow during a what-if evaluation.
+    // Overridden by derived classes with extra flow state.
+    virtual void saveFlowState(FlowId flowId) {}
+    virtual void restoreFlowState(FlowId flowId) {}
+
+    // Must be called after changing the state of a flow that affects latency (e.g., priority, shaper curve, queues).
+    // A flow's latency depends on the flows of higher (or equal) priority that share its queues and, transitively, on the flows those compete with,
+    // so the flow and the flows of priority value >= priority sharing its queues are marked dirty, and so on through the queue->flows lists.
+    // priority is the highest priority (i.e., min value) of the flow before and after the change.
+    // Changes are propagated lazily by updateDirtyFlows so that a batch of changes (e.g., re-optimizing a client group) is propagated once.
+    // Overridden by derived classes with state derived from the flows in a queue.
+    virtual void invalidateFlowLatency(FlowId flowId, unsigned int priority);
+    // Propagate the changes from invalidateFlowLatency to the latencyDirty state of the affected flows.
+    void updateDirtyFlows();
+    // Mark a flow's latency as up to date after calculating it.
+    void clearFlowLatencyDirty(FlowId flowId) { setFlowLatencyDirty(_flowTable[flowId], false); }
 
 public:
     NC();
@@ -139,6 +277,16 @@ public:
     // Set the priority for a flow.
     void setFlowPriority(FlowId flowId, unsigned int priority);
 
+    // Start a what-if evaluation, where clients can be tentatively added, analyzed, and deleted.
+    // Changes to the pre-existing flows and clients are recorded as they happen (i.e., copy-on-write), and endWhatIf reverts them,
+    // leaving the system as if the tentative clients were never added. Clients added during the evaluation must be deleted before endWhatIf,
+    // and pre-existing clients and queues must not be added or deleted during the evaluation.
+    // The ids of the clients and flows added during the evaluation are reused after it.
+    virtual void beginWhatIf();
+    // End a what-if evaluation, restoring the state of the pre-existing flows and clients.
+    virtual void endWhatIf();
+    bool inWhatIf() const { return _whatIf; }
+
     // Calculate the latency for all clients/flows in the system.
     // Assumes priorities are set.
     virtual void calcAllLatency();
@@ -148,39 +296,45 @@ public:
     // Calculate the latency for a flow.
     // Assumes priorities are set.
     virtual double calcFlowLatency(FlowId flowId) = 0;
+    // Get the clients with a flow whose latency has not been recalculated since a flow it depends on changed.
+    void getDirtyClients(set<ClientId>& clientIds);
+
+    // Write the queues, clients, and flows to a checkpoint, including the analysis state (e.g., priorities, latencies, and which latencies are dirty).
+    // Not supported during a what-if evaluation.
+    virtual void writeCheckpoint(BinaryWriter& writer) const;
+    // Restore the system from a checkpoint written by writeCheckpoint; ids are the same as in the checkpointed system.
+    // Must be called on an empty system. Returns false if the checkpoint is malformed, in which case the system should be discarded.
+    virtual bool readCheckpoint(BinaryReader& reader);
 
-    // Read-only accessors
-    map<FlowId, Flow*>::const_iterator flowsBegin() const { return _flows.begin(); }
-    map<FlowId, Flow*>::const_iterator flowsEnd() const { return _flows.end(); }
+    // Read-only accessors; the iterators visit entries in id order
+    FlowIterator flowsBegin() const { return FlowIterator(_flowTable, 0); }
+    FlowIterator flowsEnd() const { return FlowIterator(_flowTable, _flowTable.size()); }
     const Flow* getFlow(FlowId flowId) const {
-        map<FlowId, Flow*>::const_iterator it = _flows.find(flowId);
-        return (it != _flows.end()) ? it->second : NULL;
+        return (flowId < _flowTable.size()) ? _flowTable[flowId] : NULL;
     }
 
-    map<ClientId, Client*>::const_iterator clientsBegin() const { return _clients.begin(); }
-    map<ClientId, Client*>::const_iterator clientsEnd() const { return _clients.end(); }
+    ClientIterator clientsBegin() const { return ClientIterator(_clientTable, 0); }
+    ClientIterator clientsEnd() const { return ClientIterator(_clientTable, _clientTable.size()); }
     const Client* getClient(ClientId clientId) const {
-        map<ClientId, Client*>::const_iterator it = _clients.find(clientId);
-        return (it != _clients.end()) ? it->second : NULL;
+        return (clientId < _clientTable.size()) ? _clientTable[clientId] : NULL;
     }
 
-    map<QueueId, Queue*>::const_iterator queuesBegin() const { return _queues.begin(); }
-    map<QueueId, Queue*>::const_iterator queuesEnd() const { return _queues.end(); }
+    QueueIterator queuesBegin() const { return QueueIterator(_queueTable, 0); }
+    QueueIterator queuesEnd() const { return QueueIterator(_queueTable, _queueTable.size()); }
     const Queue* getQueue(QueueId queueId) const {
-        map<QueueId, Queue*>::const_iterator it = _queues.find(queueId);
-        return (it != _queues.end()) ? it->second : NULL;
+        return (queueId < _queueTable.size()) ? _queueTable[queueId] : NULL;
     }
 
     FlowId getFlowIdByName(string name) const {
-        map<string, FlowId>::const_iterator it = _flowIds.find(name);
+        tr1::unordered_map<string, FlowId>::const_iterator it = _flowIds.find(name);
         return (it != _flowIds.end()) ? it->second : InvalidFlowId;
     }
     ClientId getClientIdByName(string name) const {
-        map<string, ClientId>::const_iterator it = _clientIds.find(name);
+        tr1::unordered_map<string, ClientId>::const_iterator it = _clientIds.find(name);
         return (it != _clientIds.end()) ? it->second : InvalidClientId;
     }
     QueueId getQueueIdByName(string name) const {
-        map<string, QueueId>::const_iterator it = _queueIds.find(name);
+        tr1::unordered_map<string, QueueId>::const_iterator it = _queueIds.find(name);
         return (it != _queueIds.end()) ? it->second : InvalidQueueId;
     }
 };
@@ -5,20 +5,40 @@
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <sstream>
 #include <string>
 #include <set>
+#include <vector>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <json/json.h>
 #include "../DNC-Library/DNC.hpp"
 #include "../DNC-Library/WorkloadCompactor.hpp"
 #include "../common/common.hpp"
+#include "../common/time.hpp"
+#include "../common/SpanTrace.hpp"
 #include "NCConfig.hpp"
 
 const double NETWORK_BANDWIDTH = 125000000; // bytes/sec
 const double STORAGE_BANDWIDTH = 1; // work secs/sec
 const string profileFilename = "profileSSD.txt";
+const string arrivalCurveCacheFilename = "arrivalCurves/arrivalCurveCache.bin";
+const uint64_t PROFILE_CHECK_INTERVAL = NS_PER_SEC; // minimum time between checks for profile changes
+
+// Process-wide estimator registry
+// Network estimator configs are built once; the storage estimator config is loaded from the profile and reloaded when the profile changes
+static pthread_once_t g_estimatorRegistryOnce = PTHREAD_ONCE_INIT;
+static Json::Value g_networkInEstimatorInfo;
+static Json::Value g_networkOutEstimatorInfo;
+static pthread_mutex_t g_profileMutex = PTHREAD_MUTEX_INITIALIZER;
+static Json::Value g_storageEstimatorInfo; // protected by g_profileMutex
+static bool g_profileLoaded = false; // protected by g_profileMutex
+static uint64_t g_profileCheckTime = 0; // protected by g_profileMutex
+static bool g_profileReload = false; // protected by g_profileMutex
+static struct stat g_profileStat; // protected by g_profileMutex
 
 // Return a name for flow into server based on the client name
 string getFlowNetworkInName(string clientName)
@@ -70,16 +90,136 @@ string getArrivalCurveFilename(string trace, string estimatorType)
     return oss.str();
 }
 
+// Return the process-wide arrival curve cache
+ArrivalCurveCache& getArrivalCurveCache()
+{
+    static ArrivalCurveCache cache(arrivalCurveCacheFilename);
+    return cache;
+}
+
+// Build network estimator configs
+static void initEstimatorRegistry()
+{
+    g_networkInEstimatorInfo["type"] = Json::Value("networkIn");
+    g_networkInEstimatorInfo["nonDataConstant"] = Json::Value(200.0);
+    g_networkInEstimatorInfo["nonDataFactor"] = Json::Value(0.025);
+    g_networkInEstimatorInfo["dataConstant"] = Json::Value(200.0);
+    g_networkInEstimatorInfo["dataFactor"] = Json::Value(1.1);
+    g_networkOutEstimatorInfo["type"] = Json::Value("networkOut");
+    g_networkOutEstimatorInfo["nonDataConstant"] = Json::Value(200.0);
+    g_networkOutEstimatorInfo["nonDataFactor"] = Json::Value(0.025);
+    g_networkOutEstimatorInfo["dataConstant"] = Json::Value(200.0);
+    g_networkOutEstimatorInfo["dataFactor"] = Json::Value(1.1);
+}
+
+// Return the estimator config for flows from client to server
+const Json::Value& getNetworkInEstimatorInfo()
+{
+    pthread_once(&g_estimatorRegistryOnce, initEstimatorRegistry);
+    return g_networkInEstimatorInfo;
+}
+
+// Return the estimator config for flows from server to client
+const Json::Value& getNetworkOutEstimatorInfo()
+{
+    pthread_once(&g_estimatorRegistryOnce, initEstimatorRegistry);
+    return g_networkOutEstimatorInfo;
+}
+
+// Load the storage estimator config from the profile if it has changed
+// Assumes g_profileMutex held
+static void loadProfile()
+{
+    TRACE_SPAN("loadProfile");
+    struct stat st;
+    if (stat(profileFilename.c_str(), &st) != 0) {
+        if (!g_profileLoaded) {
+            cerr << "Failed to read json file " << profileFilename << endl;
+        }
+        return;
+    }
+    if (g_profileLoaded && !g_profileReload &&
+        (st.st_size == g_profileStat.st_size) &&
+        (st.st_mtim.tv_sec == g_profileStat.st_mtim.tv_sec) &&
+        (st.st_mtim.tv_nsec == g_profileStat.st_mtim.tv_nsec)) {
+        return;
+    }
+    // Keep the previous profile if the new one can not be read
+    Json::Value profileCfg;
+    if (!readJson(profileFilename, profileCfg)) {
+        return;
+    }
+    g_storageEstimatorInfo = Json::Value();
+    g_storageEstimatorInfo["type"] = profileCfg.isMember("type") ? profileCfg["type"] : Json::Value("storageSSD");
+    g_storageEstimatorInfo["bandwidthTable"] = profileCfg["bandwidthTable"];
+    // The MPLs select the profiled queue depths, as in NFSEnforcer
+    const char* mplNames[] = {"MPL", "readMPL", "writeMPL"};
+    for (unsigned int i = 0; i < sizeof(mplNames) / sizeof(mplNames[0]); i++) {
+        if (profileCfg.isMember(mplNames[i])) {
+            g_storageEstimatorInfo[mplNames[i]] = profileCfg[mplNames[i]];
+        }
+    }
+    g_profileStat = st;
+    g_profileLoaded = true;
+}
+
+// Return the estimator config for storage flows; returns false if the profile can not be read
+bool getStorageEstimatorInfo(Json::Value& estimatorInfo)
+{
+    pthread_mutex_lock(&g_profileMutex);
+    uint64_t now = GetTime();
+    if (!g_profileLoaded || g_profileReload || (now - g_profileCheckTime >= PROFILE_CHECK_INTERVAL)) {
+        g_profileCheckTime = now;
+        loadProfile();
+        g_profileReload = false;
+    }
+    bool loaded = g_profileLoaded;
+    if (loaded) {
+        estimatorInfo = g_storageEstimatorInfo;
+    }
+    pthread_mutex_unlock(&g_profileMutex);
+    return loaded;
+}
+
+// Reread the profile on the next use of the storage estimator config
+void reloadProfile()
+{
+    pthread_mutex_lock(&g_profileMutex);
+    g_profileReload = true;
+    pthread_mutex_unlock(&g_profileMutex);
+}
+
 // Set the arrivalInfo in a flow
 void setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate)
 {
     string arrivalCurveFilename = getArrivalCurveFilename(trace, estimatorInfo["type"].asString());
-    DNC::setArrivalInfo(flowInfo, trace, estimatorInfo, maxRate, arrivalCurveFilename);
+    DNC::setArrivalInfo(flowInfo, trace, estimatorInfo, maxRate, arrivalCurveFilename, &getArrivalCurveCache());
+}
+
+// Set the arrivalInfo in a set of flows that share the same trace
+void setArrivalInfos(const vector<Json::Value*>& flowInfos, string trace, const vector<Json::Value>& estimatorInfos, const vector<double>& maxRates)
+{
+    vector<string> arrivalCurveFilenames;
+    for (unsigned int i = 0; i < estimatorInfos.size(); i++) {
+        arrivalCurveFilenames.push_back(getArrivalCurveFilename(trace, estimatorInfos[i]["type"].asString()));
+    }
+    DNC::setArrivalInfos(flowInfos, trace, estimatorInfos, maxRates, arrivalCurveFilenames, &getArrivalCurveCache());
+}
+
+// Set the arrivalInfo for the flows in clientFlows at the given indices
+static void setClientArrivalInfos(Json::Value& clientFlows, string trace, const vector<unsigned int>& flowIndices, const vector<Json::Value>& estimatorInfos, const vector<double>& maxRates)
+{
+    vector<Json::Value*> flowInfos;
+    for (unsigned int i = 0; i < flowIndices.size(); i++) {
+        flowInfos.push_back(&clientFlows[flowIndices[i]]);
+    }
+    setArrivalInfos(flowInfos, trace, estimatorInfos, maxRates);
 }
 
 // Generate config for a client
 void configGenClient(Json::Value& clientInfo, string clientName, string prefix, bool enforce)
 {
+    TRACE_SPAN("configGenClient");
     clientInfo["name"] = Json::Value(clientName);
     string clientHost = clientInfo["clientHost"].asString();
     string clientVM = clientInfo["clientVM"].asString();
@@ -97,6 +237,11 @@ void configGenClient(Json::Value& clientInfo, string clientName, string prefix,
     bool storageOnly = (clientInfo.isMember("storageOnly") && clientInfo["storageOnly"].asBool());
     Json::Value& clientFlows = clientInfo["flows"];
     clientFlows = Json::arrayValue;
+    // Arrival curves for all flows are calculated together once the flows are setup
+    string trace = clientInfo["trace"].asString();
+    vector<unsigned int> flowIndices;
+    vector<Json::Value> estimatorInfos;
+    vector<double> maxRates;
     if (!storageOnly) {
         // Setup flow from client to server
         Json::Value& flowInInfo = clientFlows[clientFlows.size()];
@@ -112,13 +257,9 @@ void configGenClient(Json::Value& clientInfo, string clientName, string prefix,
         flowInQueues.resize(2);
         flowInQueues[0] = Json::Value(getQueueOutName(clientHost));
         flowInQueues[1] = Json::Value(getQueueInName(serverHost));
-        Json::Value networkInEstimatorInfo;
-        networkInEstimatorInfo["type"] = Json::Value("networkIn");
-        networkInEstimatorInfo["nonDataConstant"] = Json::Value(200.0);
-        networkInEstimatorInfo["nonDataFactor"] = Json::Value(0.025);
-        networkInEstimatorInfo["dataConstant"] = Json::Value(200.0);
-        networkInEstimatorInfo["dataFactor"] = Json::Value(1.1);
-        setArrivalInfo(flowInInfo, clientInfo["trace"].asString(), networkInEstimatorInfo, NETWORK_BANDWIDTH);
+        flowIndices.push_back(clientFlows.size() - 1);
+        estimatorInfos.push_back(getNetworkInEstimatorInfo());
+        maxRates.push_back(NETWORK_BANDWIDTH);
     }
     if (!networkOnly) {
         // Setup storage flow at server
@@ -133,14 +274,14 @@ void configGenClient(Json::Value& clientInfo, string clientName, string prefix,
         flowStorageQueues = Json::arrayValue;
         flowStorageQueues.resize(1);
         flowStorageQueues[0] = Json::Value(getServerName(serverHost, serverVM));
-        Json::Value profileCfg;
-        if (!readJson(profileFilename, profileCfg)) {
+        estimatorInfos.push_back(Json::Value());
+        if (!getStorageEstimatorInfo(estimatorInfos.back())) {
+            estimatorInfos.pop_back();
+            setClientArrivalInfos(clientFlows, trace, flowIndices, estimatorInfos, maxRates);
             return;
         }
-        Json::Value storageEstimatorInfo;
-        storageEstimatorInfo["type"] = Json::Value("storageSSD");
-        storageEstimatorInfo["bandwidthTable"] = profileCfg["bandwidthTable"];
-        setArrivalInfo(flowStorageInfo, clientInfo["trace"].asString(), storageEstimatorInfo, STORAGE_BANDWIDTH);
+        flowIndices.push_back(clientFlows.size() - 1);
+        maxRates.push_back(STORAGE_BANDWIDTH);
     }
     if (!storageOnly) {
         // Setup flow from server to client
@@ -157,14 +298,61 @@ void configGenClient(Json::Value& clientInfo, string clientName, string prefix,
         flowOutQueues.resize(2);
         flowOutQueues[0] = Json::Value(getQueueOutName(serverHost));
         flowOutQueues[1] = Json::Value(getQueueInName(clientHost));
-        Json::Value networkOutEstimatorInfo;
-        networkOutEstimatorInfo["type"] = Json::Value("networkOut");
-        networkOutEstimatorInfo["nonDataConstant"] = Json::Value(200.0);
-        networkOutEstimatorInfo["nonDataFactor"] = Json::Value(0.025);
-        networkOutEstimatorInfo["dataConstant"] = Json::Value(200.0);
-        networkOutEstimatorInfo["dataFactor"] = Json::Value(1.1);
-        setArrivalInfo(flowOutInfo, clientInfo["trace"].asString(), networkOutEstimatorInfo, NETWORK_BANDWIDTH);
+        flowIndices.push_back(clientFlows.size() - 1);
+        estimatorInfos.push_back(getNetworkOutEstimatorInfo());
+        maxRates.push_back(NETWORK_BANDWIDTH);
     }
+    setClientArrivalInfos(clientFlows, trace, flowIndices, estimatorInfos, maxRates);
+}
+
+// Get the bounds on the rate limits of a flow with the given arrival curve
+// The rate is bounded by the long-term rate of the arrival curve, and the burst is bounded by the burst of its steepest segment.
+// Flows without an arrival curve have bounds of 0.
+FlowBounds getFlowBounds(const Curve& arrivalCurve)
+{
+    FlowBounds bounds;
+    bounds.rate = 0;
+    bounds.burst = 0;
+    if (!arrivalCurve.empty()) {
+        const PointSlope& p = arrivalCurve.front();
+        bounds.rate = arrivalCurve.back().slope;
+        bounds.burst = yIntercept(p.x, p.y, p.slope);
+    }
+    return bounds;
+}
+
+// Get the bounds on the rate limits of a client's flows; configs are generated as in configGenClient
+// Bounds of flows that the client does not have (e.g., network flows of storageOnly clients) are 0.
+void getClientFlowBounds(const Json::Value& clientInfo, string prefix, FlowBounds& networkIn, FlowBounds& storage, FlowBounds& networkOut)
+{
+    TRACE_SPAN("getClientFlowBounds");
+    Json::Value clientInfoCopy = clientInfo;
+    string clientName = clientInfo["name"].asString();
+    configGenClient(clientInfoCopy, clientName, prefix, false);
+    networkIn = getFlowBounds(Curve());
+    storage = getFlowBounds(Curve());
+    networkOut = getFlowBounds(Curve());
+    const Json::Value& clientFlows = clientInfoCopy["flows"];
+    for (unsigned int i = 0; i < clientFlows.size(); i++) {
+        const Json::Value& flowInfo = clientFlows[i];
+        Curve arrivalCurve;
+        deserializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+        string flowName = flowInfo["name"].asString();
+        if (flowName == getFlowNetworkInName(clientName)) {
+            networkIn = getFlowBounds(arrivalCurve);
+        } else if (flowName == getFlowStorageName(clientName)) {
+            storage = getFlowBounds(arrivalCurve);
+        } else if (flowName == getFlowNetworkOutName(clientName)) {
+            networkOut = getFlowBounds(arrivalCurve);
+        }
+    }
+}
+
+// Estimate the load of a client with the given flow bounds for ordering placements
+// The load is the largest fraction of a queue's bandwidth used by the long-term rate of one of the client's flows.
+double getClientLoad(const FlowBounds& networkIn, const FlowBounds& storage, const FlowBounds& networkOut)
+{
+    return max(max(networkIn.rate, networkOut.rate) / NETWORK_BANDWIDTH, storage.rate / STORAGE_BANDWIDTH);
 }
 
 // Generate network in queue info
@@ -10,9 +10,11 @@
 
 #include <string>
 #include <set>
+#include <vector>
 #include <json/json.h>
 #include "NC.hpp"
 #include "../DNC-Library/DNC.hpp"
+#include "../DNC-Library/ArrivalCurveCache.hpp"
 
 using namespace std;
 
@@ -32,10 +34,34 @@ string getServerName(string host, string VM);
 string getAddr(string prefix, string host, string VM);
 // Return the arrival curve file
 string getArrivalCurveFilename(string trace, string estimatorType);
+// Return the process-wide arrival curve cache
+ArrivalCurveCache& getArrivalCurveCache();
+// Return the estimator config for flows from client to server
+const Json::Value& getNetworkInEstimatorInfo();
+// Return the estimator config for flows from server to client
+const Json::Value& getNetworkOutEstimatorInfo();
+// Return the estimator config for storage flows; returns false if the profile can not be read
+// The profile is read once and reloaded when it changes, checking for changes at most once per second.
+bool getStorageEstimatorInfo(Json::Value& estimatorInfo);
+// Reread the profile on the next use of the storage estimator config
+void reloadProfile();
 // Set the arrivalInfo in a flow
 void setArrivalInfo(Json::Value& flowInfo, string trace, const Json::Value& estimatorInfo, double maxRate);
+// Set the arrivalInfo in a set of flows that share the same trace; uncached arrival curves are calculated in parallel
+void setArrivalInfos(const vector<Json::Value*>& flowInfos, string trace, const vector<Json::Value>& estimatorInfos, const vector<double>& maxRates);
 // Generate config for a client
 void configGenClient(Json::Value& clientInfo, string clientName, string prefix, bool enforce);
+// Lower bounds on the rate limits (r, b) of a flow: r >= rate and b >= burst
+struct FlowBounds {
+    double rate;
+    double burst;
+};
+// Get the bounds on the rate limits of a flow with the given arrival curve
+FlowBounds getFlowBounds(const Curve& arrivalCurve);
+// Get the bounds on the rate limits of a client's flows; configs are generated as in configGenClient
+void getClientFlowBounds(const Json::Value& clientInfo, string prefix, FlowBounds& networkIn, FlowBounds& storage, FlowBounds& networkOut);
+// Estimate the load of a client with the given flow bounds for ordering placements
+double getClientLoad(const FlowBounds& networkIn, const FlowBounds& storage, const FlowBounds& networkOut);
 // Generate network in queue info
 void configGenNetworkInQueue(Json::Value& queueInfo, string host);
 // Generate network out queue info
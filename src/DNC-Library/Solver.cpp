@@ -0,0 +1,74 @@
+// Solver.cpp - Registry of linear program (LP) solver backends.
+// See Solver.hpp for details.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include "Solver.hpp"
+
+using namespace std;
+
+static pthread_once_t g_solverRegistryOnce = PTHREAD_ONCE_INIT;
+// Protects g_solverRegistry
+static pthread_mutex_t g_solverRegistryMutex = PTHREAD_MUTEX_INITIALIZER;
+static map<string, SolverFactory>* g_solverRegistry = NULL;
+
+static Solver* createSolverGLPK()
+{
+    return new SolverGLPK(GLPK_INTERIOR);
+}
+
+static Solver* createSolverGLPKSimplex()
+{
+    return new SolverGLPK(GLPK_SIMPLEX);
+}
+
+static Solver* createSolverGLPKExact()
+{
+    return new SolverGLPK(GLPK_EXACT);
+}
+
+// Create the registry with the built-in backends.
+static void initSolverRegistry()
+{
+    g_solverRegistry = new map<string, SolverFactory>();
+    (*g_solverRegistry)["glpk"] = createSolverGLPK;
+    (*g_solverRegistry)["glpk-simplex"] = createSolverGLPKSimplex;
+    (*g_solverRegistry)["glpk-exact"] = createSolverGLPKExact;
+}
+
+bool registerSolver(const string& name, SolverFactory factory)
+{
+    pthread_once(&g_solverRegistryOnce, initSolverRegistry);
+    pthread_mutex_lock(&g_solverRegistryMutex);
+    bool registered = g_solverRegistry->insert(make_pair(name, factory)).second;
+    pthread_mutex_unlock(&g_solverRegistryMutex);
+    return registered;
+}
+
+Solver* createSolver(const string& name)
+{
+    pthread_once(&g_solverRegistryOnce, initSolverRegistry);
+    pthread_mutex_lock(&g_solverRegistryMutex);
+    map<string, SolverFactory>::const_iterator it = g_solverRegistry->find(name);
+    SolverFactory factory = (it != g_solverRegistry->end()) ? it->second : NULL;
+    pthread_mutex_unlock(&g_solverRegistryMutex);
+    return (factory != NULL) ? factory() : NULL;
+}
+
+vector<string> getSolverNames()
+{
+    pthread_once(&g_solverRegistryOnce, initSolverRegistry);
+    vector<string> names;
+    pthread_mutex_lock(&g_solverRegistryMutex);
+    for (map<string, SolverFactory>::const_iterator it = g_solverRegistry->begin(); it != g_solverRegistry->end(); it++) {
+        names.push_back(it->first);
+    }
+    pthread_mutex_unlock(&g_solverRegistryMutex);
+    return names;
+}
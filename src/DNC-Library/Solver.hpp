@@ -1,5 +1,6 @@
 // Solver.hpp - generic interface for a linear program (LP) solver.
-// Currently, there is only one adapter to GLPK, but the design allows for other solvers to be utilized via an adapter class.
+// There is an adapter to GLPK, and other solvers can be utilized via an adapter class.
+// Solver backends are registered by name (see registerSolver), so the solver can be selected at runtime.
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -8,7 +9,10 @@
 #ifndef SOLVER_HPP
 #define SOLVER_HPP
 
+#include <algorithm>
 #include <cstring>
+#include <string>
+#include <vector>
 #include "../glpk/glpk.h"
 
 using namespace std;
@@ -80,6 +84,18 @@ public:
             delete[] vars;
         }
     }
+    ConstraintExpression& operator=(const ConstraintExpression& other) {
+        ConstraintExpression copy(other);
+        swap(copy);
+        return *this;
+    }
+    // Exchange contents with another constraint without copying (e.g., to move a constraint into a container)
+    void swap(ConstraintExpression& other) {
+        std::swap(coeffs, other.coeffs);
+        std::swap(vars, other.vars);
+        std::swap(count, other.count);
+        std::swap(capacity, other.capacity);
+    }
     // Initializes an LP constraint with a given maximum number of variables
     void init(int maxSize) {
         if (coeffs) {
@@ -101,10 +117,52 @@ public:
     }
 };
 
+// Represents a set of LP constraints in compressed sparse row format
+// Constraint i has coefficients coeffs[rowStarts[i]...(rowStarts[i+1]-1)] of variables vars[rowStarts[i]...(rowStarts[i+1]-1)]
+// clear() keeps the allocated storage, so a SparseConstraints can be reused to build constraints without allocating
+class SparseConstraints
+{
+public:
+    vector<double> coeffs;
+    vector<VariableHandle> vars;
+    vector<int> rowStarts;
+    vector<enum ConstraintType> types;
+    vector<double> rhs;
+
+    SparseConstraints()
+        : rowStarts(1, 0)
+    {}
+    // Remove all constraints
+    void clear() {
+        coeffs.clear();
+        vars.clear();
+        rowStarts.resize(1);
+        types.clear();
+        rhs.clear();
+    }
+    // Append an LP variable to the current constraint
+    void append(double coeff, VariableHandle var) {
+        coeffs.push_back(coeff);
+        vars.push_back(var);
+    }
+    // Finish the current constraint sum_i coeff[i]*vars[i] = rhs
+    void endConstraint(enum ConstraintType type, double constraintRHS) {
+        rowStarts.push_back(coeffs.size());
+        types.push_back(type);
+        rhs.push_back(constraintRHS);
+    }
+    // Returns the number of constraints
+    int size() const {
+        return types.size();
+    }
+};
+
 // Abstract base class
 class Solver
 {
 public:
+    virtual ~Solver() {}
+
     // Add an LP variable with the given lower and upper bounds; name is an optional identifier for the variable
     virtual VariableHandle addVariable(double lb, double ub, enum VarType type, const char* name) = 0;
     // Add an LP constraint sum_i=0...(count-1) coeff[i]*vars[i] = rhs; name is an optional identifier for the constraint
@@ -113,6 +171,8 @@ public:
     ConstraintHandle addConstraintExpression(const ConstraintExpression& expr, enum ConstraintType type, double rhs, const char* name) {
         return addConstraint(expr.count, expr.coeffs, expr.vars, type, rhs, name);
     }
+    // Add a set of LP constraints in bulk, appending their handles to handles
+    virtual void addConstraints(const SparseConstraints& constraints, vector<ConstraintHandle>& handles) = 0;
     // Set a min/max objective direction
     virtual void setObjectiveDirection(enum ObjectiveType type) = 0;
     // Set the coefficient and variable for the objective
@@ -125,27 +185,89 @@ public:
     virtual double getSolutionVariable(VariableHandle var) = 0;
     // Change the right-hand-size value of a constraint
     virtual void changeRHS(ConstraintHandle constraint, double rhs) = 0;
+    // Set the coefficients of a variable in the given constraints, replacing its existing coefficients
+    virtual void setVariableCoeffs(VariableHandle var, int count, const double* coeffs, const ConstraintHandle* constraints) = 0;
+    // Delete LP variables; handles of the remaining variables stay valid
+    virtual void delVariables(int count, const VariableHandle* vars) = 0;
+    // Delete LP constraints; handles of the remaining constraints stay valid
+    virtual void delConstraints(int count, const ConstraintHandle* constraints) = 0;
+    // Enable warm starts, where each solve starts from the basis of the previous solve
+    // Used when the LP is modified incrementally and re-solved; disabled by default
+    virtual void setWarmStart(bool enable) = 0;
+    // Returns true if this instance can solve concurrently with other instances (e.g., on a thread pool)
+    // Backends that share state across instances return false, so their solves are run serially
+    virtual bool canSolveConcurrently() const { return false; }
+};
+
+// Method used by SolverGLPK for cold solves
+enum GLPKMethod {
+    GLPK_INTERIOR = 0, // interior point method, falling back to the simplex method
+    GLPK_SIMPLEX, // simplex method
+    GLPK_EXACT, // simplex method refined by exact arithmetic
 };
 
 // GLPK solver
+// GLPK renumbers rows and columns on deletion, so handles are mapped to GLPK's (1-indexed) row and column numbers.
+// Handles are assigned in order starting at 1, so they match GLPK's numbers until something is deleted.
+// Cold solves use the given GLPKMethod; warm solves use the simplex method from the previous basis.
+// With warm starts, deleted variables are fixed at 0 and deleted constraints are made free so that the basis stays valid,
+// and they are removed from the GLPK problem in bulk once they outnumber the remaining ones.
+// Different SolverGLPK instances can be used from different threads; calls into GLPK are serialized unless built with GLPK_THREAD_SAFE,
+// so instances only report that they can solve concurrently if built with GLPK_THREAD_SAFE.
 class SolverGLPK : public Solver
 {
 private:
     glp_prob* prob;
+    enum GLPKMethod method;
     bool simplexMethod;
+    bool warmStart;
+    vector<int> colNums; // variable handle -> GLPK column number (0 if deleted)
+    vector<VariableHandle> colHandles; // GLPK column number -> variable handle
+    vector<int> rowNums; // constraint handle -> GLPK row number (0 if deleted)
+    vector<ConstraintHandle> rowHandles; // GLPK row number -> constraint handle
+    vector<int> nums; // scratch buffer for translating handles (1-indexed)
+    vector<VariableHandle> deadVars; // variables pending deletion
+    vector<ConstraintHandle> deadConstraints; // constraints pending deletion
+
+    // Translate handles into nums[1...count]
+    const int* translate(int count, const int* handles, const vector<int>& handleNums);
+    // Renumber the remaining handles after deleting GLPK rows or columns
+    static void renumber(int count, const int* handles, vector<int>& handleNums, vector<int>& numHandles);
+    // Delete variables and constraints pending deletion
+    void compact();
 
 public:
-    SolverGLPK();
+    SolverGLPK(enum GLPKMethod coldMethod = GLPK_INTERIOR);
     virtual ~SolverGLPK();
 
     virtual VariableHandle addVariable(double lb, double ub, enum VarType type, const char* name);
     virtual ConstraintHandle addConstraint(int count, const double* coeffs, const VariableHandle* vars, enum ConstraintType type, double rhs, const char* name);
+    virtual void addConstraints(const SparseConstraints& constraints, vector<ConstraintHandle>& handles);
     virtual void setObjectiveDirection(enum ObjectiveType type);
     virtual void setObjectiveCoeff(double coeff, VariableHandle var);
     virtual bool solve();
     virtual double getSolution();
     virtual double getSolutionVariable(VariableHandle var);
     virtual void changeRHS(ConstraintHandle constraint, double rhs);
+    virtual void setVariableCoeffs(VariableHandle var, int count, const double* coeffs, const ConstraintHandle* constraints);
+    virtual void delVariables(int count, const VariableHandle* vars);
+    virtual void delConstraints(int count, const ConstraintHandle* constraints);
+    virtual void setWarmStart(bool enable);
+    virtual bool canSolveConcurrently() const;
 };
 
+// Creates a solver of a registered backend
+typedef Solver* (*SolverFactory)();
+
+// Register a solver backend under name. Returns false if the name is already registered.
+// The GLPK backends "glpk" (GLPK_INTERIOR), "glpk-simplex" (GLPK_SIMPLEX), and "glpk-exact" (GLPK_EXACT) are always registered.
+bool registerSolver(const string& name, SolverFactory factory);
+// Create a solver of the named backend. Returns NULL if the name is not registered.
+Solver* createSolver(const string& name);
+// Get the names of the registered solver backends.
+vector<string> getSolverNames();
+
+// Name of the default solver backend
+const string defaultSolverName = "glpk";
+
 #endif // SOLVER_HPP
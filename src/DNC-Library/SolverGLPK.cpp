@@ -4,14 +4,42 @@
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
+#include <cassert>
 #include <cmath>
+#include <vector>
+#include <pthread.h>
 #include "../glpk/glpk.h"
 #include "Solver.hpp"
+#include "../common/SpanTrace.hpp"
 
 using namespace std;
 
-SolverGLPK::SolverGLPK()
+#ifndef GLPK_THREAD_SAFE
+// The bundled GLPK library keeps its environment (e.g., memory allocation state) in a global rather than thread-local storage,
+// so calls into GLPK are serialized across all solvers. Define GLPK_THREAD_SAFE when linking a GLPK built with thread-local storage.
+static pthread_mutex_t glpkMutex = PTHREAD_MUTEX_INITIALIZER;
+
+class GLPKLock
+{
+public:
+    GLPKLock() { pthread_mutex_lock(&glpkMutex); }
+    ~GLPKLock() { pthread_mutex_unlock(&glpkMutex); }
+};
+#else
+class GLPKLock {};
+#endif
+
+SolverGLPK::SolverGLPK(enum GLPKMethod coldMethod)
+    : method(coldMethod),
+      simplexMethod(false),
+      warmStart(false),
+      colNums(1, 0),
+      colHandles(1, 0),
+      rowNums(1, 0),
+      rowHandles(1, 0),
+      nums(1, 0)
 {
+    GLPKLock lock;
     // Make solver quiet
     glp_term_out(GLP_OFF);
     // Create problem
@@ -20,67 +48,177 @@ SolverGLPK::SolverGLPK()
 
 SolverGLPK::~SolverGLPK()
 {
+    GLPKLock lock;
     glp_delete_prob(prob);
 }
 
+const int* SolverGLPK::translate(int count, const int* handles, const vector<int>& handleNums)
+{
+    if (nums.size() < static_cast<unsigned int>(count + 1)) {
+        nums.resize(count + 1);
+    }
+    for (int i = 0; i < count; i++) {
+        nums[i + 1] = handleNums[handles[i]];
+    }
+    return &nums[0];
+}
+
+void SolverGLPK::renumber(int count, const int* handles, vector<int>& handleNums, vector<int>& numHandles)
+{
+    for (int i = 0; i < count; i++) {
+        numHandles[handleNums[handles[i]]] = 0;
+        handleNums[handles[i]] = 0;
+    }
+    unsigned int num = 1;
+    for (unsigned int oldNum = 1; oldNum < numHandles.size(); oldNum++) {
+        int handle = numHandles[oldNum];
+        if (handle != 0) {
+            handleNums[handle] = num;
+            numHandles[num] = handle;
+            num++;
+        }
+    }
+    numHandles.resize(num);
+}
+
 VariableHandle SolverGLPK::addVariable(double lb, double ub, enum VarType type, const char* name)
 {
+    GLPKLock lock;
     const int typeTranslation[] = {GLP_CV, GLP_BV, GLP_IV};
-    VariableHandle var = glp_add_cols(prob, 1);
+    int col = glp_add_cols(prob, 1);
+    VariableHandle var = colNums.size();
+    colNums.push_back(col);
+    colHandles.push_back(var);
+    assert(colHandles.size() == static_cast<unsigned int>(col + 1));
     if (isfinite(lb)) {
         if (isfinite(ub)) {
-            glp_set_col_bnds(prob, var, GLP_DB, lb, ub);
+            glp_set_col_bnds(prob, col, GLP_DB, lb, ub);
         } else {
-            glp_set_col_bnds(prob, var, GLP_LO, lb, ub);
+            glp_set_col_bnds(prob, col, GLP_LO, lb, ub);
         }
     } else {
         if (isfinite(ub)) {
-            glp_set_col_bnds(prob, var, GLP_UP, lb, ub);
+            glp_set_col_bnds(prob, col, GLP_UP, lb, ub);
         } else {
-            glp_set_col_bnds(prob, var, GLP_FR, lb, ub);
+            glp_set_col_bnds(prob, col, GLP_FR, lb, ub);
         }
     }
-    glp_set_col_kind(prob, var, typeTranslation[type]);
+    glp_set_col_kind(prob, col, typeTranslation[type]);
     if (name) {
-        glp_set_col_name(prob, var, name);
+        glp_set_col_name(prob, col, name);
     }
     return var;
 }
 
 ConstraintHandle SolverGLPK::addConstraint(int count, const double* coeffs, const VariableHandle* vars, enum ConstraintType type, double rhs, const char* name)
 {
+    GLPKLock lock;
     const int typeTranslation[] = {GLP_UP, GLP_FX, GLP_LO};
-    ConstraintHandle constraint = glp_add_rows(prob, 1);
-    glp_set_mat_row(prob, constraint, count, &vars[-1], &coeffs[-1]); // GLPK is 1-indexed
-    glp_set_row_bnds(prob, constraint, typeTranslation[type], rhs, rhs);
+    int row = glp_add_rows(prob, 1);
+    ConstraintHandle constraint = rowNums.size();
+    rowNums.push_back(row);
+    rowHandles.push_back(constraint);
+    assert(rowHandles.size() == static_cast<unsigned int>(row + 1));
+    glp_set_mat_row(prob, row, count, translate(count, vars, colNums), &coeffs[-1]); // GLPK is 1-indexed
+    glp_set_row_bnds(prob, row, typeTranslation[type], rhs, rhs);
     if (name) {
-        glp_set_row_name(prob, constraint, name);
+        glp_set_row_name(prob, row, name);
     }
     return constraint;
 }
 
+void SolverGLPK::addConstraints(const SparseConstraints& constraints, vector<ConstraintHandle>& handles)
+{
+    GLPKLock lock;
+    const int typeTranslation[] = {GLP_UP, GLP_FX, GLP_LO};
+    int count = constraints.size();
+    if (count == 0) {
+        return;
+    }
+    // Add all rows at once rather than growing the problem one row at a time
+    int firstRow = glp_add_rows(prob, count);
+    rowNums.reserve(rowNums.size() + count);
+    rowHandles.reserve(rowHandles.size() + count);
+    handles.reserve(handles.size() + count);
+    for (int i = 0; i < count; i++) {
+        int row = firstRow + i;
+        ConstraintHandle constraint = rowNums.size();
+        rowNums.push_back(row);
+        rowHandles.push_back(constraint);
+        assert(rowHandles.size() == static_cast<unsigned int>(row + 1));
+        int start = constraints.rowStarts[i];
+        int len = constraints.rowStarts[i + 1] - start;
+        if (len > 0) {
+            glp_set_mat_row(prob, row, len, translate(len, &constraints.vars[start], colNums), &constraints.coeffs[start] - 1); // GLPK is 1-indexed
+        }
+        glp_set_row_bnds(prob, row, typeTranslation[constraints.types[i]], constraints.rhs[i], constraints.rhs[i]);
+        handles.push_back(constraint);
+    }
+}
+
 void SolverGLPK::setObjectiveDirection(enum ObjectiveType type)
 {
+    GLPKLock lock;
     const int typeTranslation[] = {GLP_MIN, GLP_MAX};
     glp_set_obj_dir(prob, typeTranslation[type]);
 }
 
 void SolverGLPK::setObjectiveCoeff(double coeff, VariableHandle var)
 {
-    glp_set_obj_coef(prob, var, coeff);
+    GLPKLock lock;
+    glp_set_obj_coef(prob, colNums[var], coeff);
+}
+
+void SolverGLPK::compact()
+{
+    if (!deadVars.empty()) {
+        glp_del_cols(prob, deadVars.size(), translate(deadVars.size(), &deadVars[0], colNums));
+        renumber(deadVars.size(), &deadVars[0], colNums, colHandles);
+    }
+    if (!deadConstraints.empty()) {
+        glp_del_rows(prob, deadConstraints.size(), translate(deadConstraints.size(), &deadConstraints[0], rowNums));
+        renumber(deadConstraints.size(), &deadConstraints[0], rowNums, rowHandles);
+    }
+    deadVars.clear();
+    deadConstraints.clear();
+    // Deleting basic variables invalidates the basis
+    glp_adv_basis(prob, 0);
 }
 
 bool SolverGLPK::solve()
 {
-    simplexMethod = false;
+    TRACE_SPAN("SolverGLPK::solve");
+    GLPKLock lock;
+    if (warmStart) {
+        // Start from the previous basis, falling back to a fresh basis if it can not be used
+        // Deleted variables and constraints are removed once they outnumber the remaining ones, which requires a fresh basis
+        simplexMethod = true;
+        if ((2 * deadVars.size() > colHandles.size() - 1) || (2 * deadConstraints.size() > rowHandles.size() - 1)) {
+            compact();
+        }
+        glp_scale_prob(prob, GLP_SF_AUTO);
+        glp_smcp parm;
+        glp_init_smcp(&parm);
+        parm.msg_lev = GLP_MSG_OFF;
+        int status = glp_simplex(prob, &parm);
+        if ((status == GLP_EBADB) || (status == GLP_ESING) || (status == GLP_ECOND)) {
+            glp_adv_basis(prob, 0);
+            status = glp_simplex(prob, &parm);
+        }
+        return (status == 0) && (glp_get_status(prob) == GLP_OPT);
+    }
+    simplexMethod = (method != GLPK_INTERIOR);
     glp_scale_prob(prob, GLP_SF_AUTO);
-    int status = glp_interior(prob, NULL);
+    int status = 0;
+    if (method == GLPK_INTERIOR) {
+        status = glp_interior(prob, NULL);
+    }
     // Fall back to simplex method
-    if (status != 0) {
+    if (simplexMethod || (status != 0)) {
         simplexMethod = true;
         status = glp_simplex(prob, NULL);
         // Refine solution by solving exact version
-        if ((status == 0) && (glp_get_status(prob) == GLP_OPT)) {
+        if ((method != GLPK_SIMPLEX) && (status == 0) && (glp_get_status(prob) == GLP_OPT)) {
             status = glp_exact(prob, NULL);
         }
     }
@@ -97,6 +235,7 @@ bool SolverGLPK::solve()
 
 double SolverGLPK::getSolution()
 {
+    GLPKLock lock;
     if (simplexMethod) {
         return glp_get_obj_val(prob);
     } else {
@@ -106,14 +245,71 @@ double SolverGLPK::getSolution()
 
 double SolverGLPK::getSolutionVariable(VariableHandle var)
 {
+    GLPKLock lock;
     if (simplexMethod) {
-        return glp_get_col_prim(prob, var);
+        return glp_get_col_prim(prob, colNums[var]);
     } else {
-        return glp_ipt_col_prim(prob, var);
+        return glp_ipt_col_prim(prob, colNums[var]);
     }
 }
 
 void SolverGLPK::changeRHS(ConstraintHandle constraint, double rhs)
 {
-    glp_set_row_bnds(prob, constraint, glp_get_row_type(prob, constraint), rhs, rhs);
+    GLPKLock lock;
+    int row = rowNums[constraint];
+    glp_set_row_bnds(prob, row, glp_get_row_type(prob, row), rhs, rhs);
+}
+
+void SolverGLPK::setVariableCoeffs(VariableHandle var, int count, const double* coeffs, const ConstraintHandle* constraints)
+{
+    GLPKLock lock;
+    glp_set_mat_col(prob, colNums[var], count, translate(count, constraints, rowNums), &coeffs[-1]); // GLPK is 1-indexed
+}
+
+void SolverGLPK::delVariables(int count, const VariableHandle* vars)
+{
+    GLPKLock lock;
+    if (warmStart) {
+        // Fix variables at 0 instead of deleting them, which keeps the basis valid
+        for (int i = 0; i < count; i++) {
+            int col = colNums[vars[i]];
+            glp_set_col_bnds(prob, col, GLP_FX, 0, 0);
+            glp_set_obj_coef(prob, col, 0);
+            deadVars.push_back(vars[i]);
+        }
+    } else if (count > 0) {
+        glp_del_cols(prob, count, translate(count, vars, colNums));
+        renumber(count, vars, colNums, colHandles);
+    }
 }
+
+void SolverGLPK::delConstraints(int count, const ConstraintHandle* constraints)
+{
+    GLPKLock lock;
+    if (warmStart) {
+        // Make constraints free instead of deleting them, which keeps the basis valid
+        for (int i = 0; i < count; i++) {
+            glp_set_row_bnds(prob, rowNums[constraints[i]], GLP_FR, 0, 0);
+            deadConstraints.push_back(constraints[i]);
+        }
+    } else if (count > 0) {
+        glp_del_rows(prob, count, translate(count, constraints, rowNums));
+        renumber(count, constraints, rowNums, rowHandles);
+    }
+}
+
+void SolverGLPK::setWarmStart(bool enable)
+{
+    warmStart = enable;
+}
+
+bool SolverGLPK::canSolveConcurrently() const
+{
+#ifdef GLPK_THREAD_SAFE
+    return true;
+#else
+    // Solves would only wait on each other for the GLPK mutex
+    return false;
+#endif
+}
+
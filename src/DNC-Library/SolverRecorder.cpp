@@ -0,0 +1,278 @@
+// SolverRecorder.cpp - Code for capturing linear programs (LPs) to benchmark solver backends offline.
+// See SolverRecorder.hpp for details.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <pthread.h>
+#include <json/json.h>
+#include "SolverRecorder.hpp"
+
+using namespace std;
+
+// Serializes appends to capture files from solvers in different threads
+static pthread_mutex_t g_captureMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Convert a bound to JSON, using null for infinite bounds.
+static Json::Value boundToJSON(double bound)
+{
+    return isfinite(bound) ? Json::Value(bound) : Json::Value(Json::nullValue);
+}
+
+// Convert a bound from JSON, where null is an infinite bound with the given sign.
+static double boundFromJSON(const Json::Value& json, double infinity)
+{
+    return json.isNull() ? infinity : json.asDouble();
+}
+
+void CapturedLP::load(Solver& s, vector<VariableHandle>& vars) const
+{
+    s.setObjectiveDirection(direction);
+    vars.resize(lbs.size());
+    for (unsigned int i = 0; i < lbs.size(); i++) {
+        vars[i] = s.addVariable(lbs[i], ubs[i], types[i], NULL);
+        if (objCoeffs[i] != 0) {
+            s.setObjectiveCoeff(objCoeffs[i], vars[i]);
+        }
+    }
+    SparseConstraints rows(constraints);
+    for (unsigned int i = 0; i < rows.vars.size(); i++) {
+        rows.vars[i] = vars[constraints.vars[i]];
+    }
+    vector<ConstraintHandle> handles;
+    s.addConstraints(rows, handles);
+}
+
+void CapturedLP::serialize(Json::Value& json) const
+{
+    json["direction"] = Json::Value((direction == OBJECTIVE_MIN) ? "min" : "max");
+    json["variables"] = Json::arrayValue;
+    for (unsigned int i = 0; i < lbs.size(); i++) {
+        Json::Value variable;
+        variable["lb"] = boundToJSON(lbs[i]);
+        variable["ub"] = boundToJSON(ubs[i]);
+        variable["type"] = Json::Value(static_cast<int>(types[i]));
+        variable["obj"] = Json::Value(objCoeffs[i]);
+        json["variables"].append(variable);
+    }
+    json["constraints"] = Json::arrayValue;
+    for (int i = 0; i < constraints.size(); i++) {
+        Json::Value constraint;
+        constraint["type"] = Json::Value(static_cast<int>(constraints.types[i]));
+        constraint["rhs"] = Json::Value(constraints.rhs[i]);
+        constraint["vars"] = Json::arrayValue;
+        constraint["coeffs"] = Json::arrayValue;
+        for (int j = constraints.rowStarts[i]; j < constraints.rowStarts[i + 1]; j++) {
+            constraint["vars"].append(Json::Value(constraints.vars[j]));
+            constraint["coeffs"].append(Json::Value(constraints.coeffs[j]));
+        }
+        json["constraints"].append(constraint);
+    }
+}
+
+void CapturedLP::deserialize(const Json::Value& json)
+{
+    direction = (json["direction"].asString() == "max") ? OBJECTIVE_MAX : OBJECTIVE_MIN;
+    const Json::Value& variables = json["variables"];
+    lbs.resize(variables.size());
+    ubs.resize(variables.size());
+    types.resize(variables.size());
+    objCoeffs.resize(variables.size());
+    for (unsigned int i = 0; i < variables.size(); i++) {
+        lbs[i] = boundFromJSON(variables[i]["lb"], -numeric_limits<double>::infinity());
+        ubs[i] = boundFromJSON(variables[i]["ub"], numeric_limits<double>::infinity());
+        types[i] = static_cast<enum VarType>(variables[i]["type"].asInt());
+        objCoeffs[i] = variables[i]["obj"].asDouble();
+    }
+    const Json::Value& constraintsJSON = json["constraints"];
+    constraints.clear();
+    for (unsigned int i = 0; i < constraintsJSON.size(); i++) {
+        const Json::Value& constraint = constraintsJSON[i];
+        for (unsigned int j = 0; j < constraint["vars"].size(); j++) {
+            constraints.append(constraint["coeffs"][j].asDouble(), constraint["vars"][j].asInt());
+        }
+        constraints.endConstraint(static_cast<enum ConstraintType>(constraint["type"].asInt()), constraint["rhs"].asDouble());
+    }
+}
+
+bool readCapturedLPs(vector<CapturedLP>& lps, const string& filename)
+{
+    ifstream file(filename.c_str());
+    if (!file.is_open()) {
+        cerr << "Unable to open " << filename << endl;
+        return false;
+    }
+    Json::Reader reader;
+    string line;
+    while (getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        Json::Value json;
+        if (!reader.parse(line, json)) {
+            cerr << "Unable to parse " << filename << ": " << reader.getFormattedErrorMessages() << endl;
+            return false;
+        }
+        lps.resize(lps.size() + 1);
+        lps.back().deserialize(json);
+    }
+    return true;
+}
+
+SolverRecorder::SolverRecorder(Solver* pSolver, const string& filename)
+    : _pSolver(pSolver),
+      _filename(filename),
+      _direction(OBJECTIVE_MIN)
+{
+}
+
+SolverRecorder::~SolverRecorder()
+{
+    delete _pSolver;
+}
+
+void SolverRecorder::capture()
+{
+    CapturedLP lp;
+    lp.direction = _direction;
+    map<VariableHandle, int> indexes;
+    for (map<VariableHandle, VariableRecord>::const_iterator it = _variables.begin(); it != _variables.end(); it++) {
+        indexes[it->first] = lp.lbs.size();
+        lp.lbs.push_back(it->second.lb);
+        lp.ubs.push_back(it->second.ub);
+        lp.types.push_back(it->second.type);
+        lp.objCoeffs.push_back(it->second.objCoeff);
+    }
+    for (map<ConstraintHandle, ConstraintRecord>::const_iterator it = _constraints.begin(); it != _constraints.end(); it++) {
+        const ConstraintRecord& constraint = it->second;
+        for (map<VariableHandle, double>::const_iterator coeffIt = constraint.coeffs.begin(); coeffIt != constraint.coeffs.end(); coeffIt++) {
+            lp.constraints.append(coeffIt->second, indexes[coeffIt->first]);
+        }
+        lp.constraints.endConstraint(constraint.type, constraint.rhs);
+    }
+    Json::Value json;
+    lp.serialize(json);
+    Json::FastWriter writer;
+    string line = writer.write(json);
+    pthread_mutex_lock(&g_captureMutex);
+    ofstream file(_filename.c_str(), ios::app);
+    if (!file.is_open()) {
+        cerr << "Unable to open " << _filename << endl;
+    } else {
+        file << line;
+    }
+    pthread_mutex_unlock(&g_captureMutex);
+}
+
+VariableHandle SolverRecorder::addVariable(double lb, double ub, enum VarType type, const char* name)
+{
+    VariableHandle var = _pSolver->addVariable(lb, ub, type, name);
+    VariableRecord& variable = _variables[var];
+    variable.lb = lb;
+    variable.ub = ub;
+    variable.type = type;
+    variable.objCoeff = 0;
+    return var;
+}
+
+ConstraintHandle SolverRecorder::addConstraint(int count, const double* coeffs, const VariableHandle* vars, enum ConstraintType type, double rhs, const char* name)
+{
+    ConstraintHandle handle = _pSolver->addConstraint(count, coeffs, vars, type, rhs, name);
+    ConstraintRecord& constraint = _constraints[handle];
+    constraint.type = type;
+    constraint.rhs = rhs;
+    for (int i = 0; i < count; i++) {
+        constraint.coeffs[vars[i]] = coeffs[i];
+    }
+    return handle;
+}
+
+void SolverRecorder::addConstraints(const SparseConstraints& constraints, vector<ConstraintHandle>& handles)
+{
+    unsigned int start = handles.size();
+    _pSolver->addConstraints(constraints, handles);
+    assert(handles.size() == start + constraints.size());
+    for (int i = 0; i < constraints.size(); i++) {
+        ConstraintRecord& constraint = _constraints[handles[start + i]];
+        constraint.type = constraints.types[i];
+        constraint.rhs = constraints.rhs[i];
+        for (int j = constraints.rowStarts[i]; j < constraints.rowStarts[i + 1]; j++) {
+            constraint.coeffs[constraints.vars[j]] = constraints.coeffs[j];
+        }
+    }
+}
+
+void SolverRecorder::setObjectiveDirection(enum ObjectiveType type)
+{
+    _pSolver->setObjectiveDirection(type);
+    _direction = type;
+}
+
+void SolverRecorder::setObjectiveCoeff(double coeff, VariableHandle var)
+{
+    _pSolver->setObjectiveCoeff(coeff, var);
+    _variables[var].objCoeff = coeff;
+}
+
+bool SolverRecorder::solve()
+{
+    capture();
+    return _pSolver->solve();
+}
+
+double SolverRecorder::getSolution()
+{
+    return _pSolver->getSolution();
+}
+
+double SolverRecorder::getSolutionVariable(VariableHandle var)
+{
+    return _pSolver->getSolutionVariable(var);
+}
+
+void SolverRecorder::changeRHS(ConstraintHandle constraint, double rhs)
+{
+    _pSolver->changeRHS(constraint, rhs);
+    _constraints[constraint].rhs = rhs;
+}
+
+void SolverRecorder::setVariableCoeffs(VariableHandle var, int count, const double* coeffs, const ConstraintHandle* constraints)
+{
+    _pSolver->setVariableCoeffs(var, count, coeffs, constraints);
+    for (map<ConstraintHandle, ConstraintRecord>::iterator it = _constraints.begin(); it != _constraints.end(); it++) {
+        it->second.coeffs.erase(var);
+    }
+    for (int i = 0; i < count; i++) {
+        _constraints[constraints[i]].coeffs[var] = coeffs[i];
+    }
+}
+
+void SolverRecorder::delVariables(int count, const VariableHandle* vars)
+{
+    _pSolver->delVariables(count, vars);
+    for (int i = 0; i < count; i++) {
+        _variables.erase(vars[i]);
+        for (map<ConstraintHandle, ConstraintRecord>::iterator it = _constraints.begin(); it != _constraints.end(); it++) {
+            it->second.coeffs.erase(vars[i]);
+        }
+    }
+}
+
+void SolverRecorder::delConstraints(int count, const ConstraintHandle* constraints)
+{
+    _pSolver->delConstraints(count, constraints);
+    for (int i = 0; i < count; i++) {
+        _constraints.erase(constraints[i]);
+    }
+}
+
+void SolverRecorder::setWarmStart(bool enable)
+{
+    _pSolver->setWarmStart(enable);
+}
@@ -0,0 +1,100 @@
+// SolverRecorder.hpp - Class definitions for capturing linear programs (LPs) to benchmark solver backends offline.
+// SolverRecorder wraps a Solver and forwards all calls to it. Each time the LP is solved, a snapshot of the LP is appended to a capture file,
+// so LPs from real admission traffic can be replayed on each registered solver backend (see DNC-LibraryBenchmark).
+//
+// Capture files have one JSON object per line in the format:
+// {
+//     "direction" : "min" or "max",
+//     "variables" : [{"lb" : lb, "ub" : ub, "type" : VarType, "obj" : objective coefficient}, ...],
+//     "constraints" : [{"type" : ConstraintType, "rhs" : rhs, "vars" : [variable index, ...], "coeffs" : [coeff, ...]}, ...]
+// }
+// Infinite bounds are null, and variables in constraints are indices into "variables".
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef SOLVER_RECORDER_HPP
+#define SOLVER_RECORDER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "../common/serializeJSON.hpp"
+#include "Solver.hpp"
+
+using namespace std;
+
+// LP captured by SolverRecorder
+class CapturedLP : public Serializable
+{
+public:
+    enum ObjectiveType direction;
+    vector<double> lbs;
+    vector<double> ubs;
+    vector<enum VarType> types;
+    vector<double> objCoeffs;
+    SparseConstraints constraints; // variables are indices into lbs, ubs, etc.
+
+    CapturedLP()
+        : direction(OBJECTIVE_MIN)
+    {}
+
+    // Add the LP to a solver; vars is set to the handle of each variable.
+    void load(Solver& s, vector<VariableHandle>& vars) const;
+
+    virtual void serialize(Json::Value& json) const;
+    virtual void deserialize(const Json::Value& json);
+};
+
+// Read the LPs in a capture file. Returns false if the file can not be parsed.
+bool readCapturedLPs(vector<CapturedLP>& lps, const string& filename);
+
+class SolverRecorder : public Solver
+{
+private:
+    // LP variable
+    struct VariableRecord {
+        double lb;
+        double ub;
+        enum VarType type;
+        double objCoeff;
+    };
+    // LP constraint and its coefficient of each variable
+    struct ConstraintRecord {
+        enum ConstraintType type;
+        double rhs;
+        map<VariableHandle, double> coeffs;
+    };
+
+    Solver* _pSolver;
+    string _filename;
+    enum ObjectiveType _direction;
+    map<VariableHandle, VariableRecord> _variables;
+    map<ConstraintHandle, ConstraintRecord> _constraints;
+
+    // Append the current LP to the capture file.
+    void capture();
+
+public:
+    // Records the LP solved by pSolver into filename. Takes ownership of pSolver.
+    SolverRecorder(Solver* pSolver, const string& filename);
+    virtual ~SolverRecorder();
+
+    virtual VariableHandle addVariable(double lb, double ub, enum VarType type, const char* name);
+    virtual ConstraintHandle addConstraint(int count, const double* coeffs, const VariableHandle* vars, enum ConstraintType type, double rhs, const char* name);
+    virtual void addConstraints(const SparseConstraints& constraints, vector<ConstraintHandle>& handles);
+    virtual void setObjectiveDirection(enum ObjectiveType type);
+    virtual void setObjectiveCoeff(double coeff, VariableHandle var);
+    virtual bool solve();
+    virtual double getSolution();
+    virtual double getSolutionVariable(VariableHandle var);
+    virtual void changeRHS(ConstraintHandle constraint, double rhs);
+    virtual void setVariableCoeffs(VariableHandle var, int count, const double* coeffs, const ConstraintHandle* constraints);
+    virtual void delVariables(int count, const VariableHandle* vars);
+    virtual void delConstraints(int count, const ConstraintHandle* constraints);
+    virtual void setWarmStart(bool enable);
+};
+
+#endif // SOLVER_RECORDER_HPP
@@ -4,33 +4,393 @@
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
+#include <iostream>
 #include <limits>
+#include <string>
 #include <vector>
 #include <set>
 #include <map>
+#include <algorithm>
 #include <cassert>
 #include "Solver.hpp"
+#include "SolverRecorder.hpp"
 #include "NC.hpp"
 #include "DNC.hpp"
 #include "WorkloadCompactor.hpp"
+#include "../common/SpanTrace.hpp"
 
 using namespace std;
 
-// WorkloadCompactor's linear program for optimizing rate limit parameters at each queue.
-// See WorkloadCompactor paper for details.
-bool WorkloadCompactor::calcShaperParameters()
+WorkloadCompactor::~WorkloadCompactor()
 {
-    bool result = true;
-    // Partition clients into groups
-    vector<set<ClientId> > clientGroups;
+    for (set<ClientGroupLP*>::iterator it = _clientGroupLPs.begin(); it != _clientGroupLPs.end(); it++) {
+        delete *it;
+    }
+    delete _pThreadPool;
+}
+
+// Add the b constraints for an SLO and path to the LP.
+// [sum_k|SLO_k<=SLO,k in path (b_k / SLO)] + [sum_k|SLO_k<SLO,k==stage (r_k)] <= 1
+void WorkloadCompactor::addBConstraints(ClientGroupLP& lp, double SLO, const vector<QueueId>& path)
+{
+    SparseConstraints& rows = _arena.rows;
+    rows.clear();
+    for (unsigned int j = 0; j < path.size(); j++) {
+        for (map<ClientId, ClientGroupLP::ClientLP>::const_iterator it = lp.clients.begin(); it != lp.clients.end(); it++) {
+            const ClientGroupLP::ClientLP& clientLP = it->second;
+            if (clientLP.SLO > SLO) {
+                continue;
+            }
+            for (unsigned int flowIndex = 0; flowIndex < clientLP.flows.size(); flowIndex++) {
+                const ClientGroupLP::FlowLP& flowLP = clientLP.flows[flowIndex];
+                vector<QueueId>::const_iterator stageIt = find(path.begin(), path.end(), flowLP.queueId);
+                if (stageIt != path.end()) {
+                    if ((SLO > clientLP.SLO) && (static_cast<unsigned int>(stageIt - path.begin()) == j)) {
+                        rows.append(1, flowLP.rVar);
+                    }
+                    rows.append(1.0 / SLO, flowLP.bVar);
+                }
+            }
+        }
+        rows.endConstraint(CONSTRAINT_LE, 1);
+    }
+    lp.s->addConstraints(rows, lp.bConstraints[make_pair(SLO, path)]);
+}
+
+// Add a client's variables and constraints to the LP.
+void WorkloadCompactor::addClientLP(ClientGroupLP& lp, ClientId clientId)
+{
+    const Client* c = getClient(clientId);
+    ClientGroupLP::ClientLP& clientLP = lp.clients[clientId];
+    clientLP.SLO = c->SLO * 0.999; // avoid rounding errors
+    double SLO = clientLP.SLO;
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        clientLP.path.push_back(getFlow(c->flowIds[flowIndex])->queueIds.front());
+    }
+    // Add b constraints for a new SLO and/or path
+    if (lp.SLOs[SLO]++ == 0) {
+        for (map<vector<QueueId>, unsigned int>::const_iterator it = lp.paths.begin(); it != lp.paths.end(); it++) {
+            addBConstraints(lp, SLO, it->first);
+        }
+    }
+    if (lp.paths[clientLP.path]++ == 0) {
+        for (map<double, unsigned int>::const_iterator it = lp.SLOs.begin(); it != lp.SLOs.end(); it++) {
+            addBConstraints(lp, it->first, clientLP.path);
+        }
+    }
+    for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+        DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+        QueueId queueId = f->queueIds.front();
+        clientLP.flows.resize(clientLP.flows.size() + 1);
+        ClientGroupLP::FlowLP& flowLP = clientLP.flows.back();
+        flowLP.flowId = f->flowId;
+        flowLP.queueId = queueId;
+        flowLP.bw = getQueue(queueId)->bandwidth; // Bandwidth of first queue
+        // Create rVar, bVar variables
+        VariableHandle rVar = lp.s->addVariable(0, 0.999, VAR_CONTINUOUS, NULL); // avoid rounding errors
+        VariableHandle bVar = lp.s->addVariable(0, SLO, VAR_CONTINUOUS, NULL);
+        flowLP.rVar = rVar;
+        flowLP.bVar = bVar;
+        // Add to objective function (minimize sum_k r_k)
+        lp.s->setObjectiveCoeff(1, rVar);
+        // Add to r constraint for stage
+        // sum_k r_k <= 1
+        pair<ConstraintHandle, unsigned int>& rConstraint = lp.rConstraints[queueId];
+        if (rConstraint.second++ == 0) {
+            rConstraint.first = lp.s->addConstraint(0, NULL, NULL, CONSTRAINT_LE, 0.999, NULL); // avoid rounding errors
+        }
+        vector<double>& rCoeffs = _arena.rCoeffs;
+        vector<ConstraintHandle>& rConstraints = _arena.rConstraints;
+        rCoeffs.assign(1, 1);
+        rConstraints.assign(1, rConstraint.first);
+        // Add to b constraints
+        vector<double>& bCoeffs = _arena.bCoeffs;
+        vector<ConstraintHandle>& bConstraints = _arena.bConstraints;
+        bCoeffs.clear();
+        bConstraints.clear();
+        for (map<double, unsigned int>::reverse_iterator rit = lp.SLOs.rbegin(); (rit != lp.SLOs.rend()) && (rit->first >= SLO); rit++) {
+            for (map<vector<QueueId>, unsigned int>::const_iterator it = lp.paths.begin(); it != lp.paths.end(); it++) {
+                const vector<QueueId>& path = it->first;
+                for (unsigned int j = 0; j < path.size(); j++) {
+                    if (path[j] == queueId) {
+                        const vector<ConstraintHandle>& constraints = lp.bConstraints[make_pair(rit->first, path)];
+                        if (rit->first > SLO) {
+                            rCoeffs.push_back(1);
+                            rConstraints.push_back(constraints[j]);
+                        }
+                        for (unsigned int k = 0; k < path.size(); k++) {
+                            bCoeffs.push_back(1.0 / rit->first);
+                            bConstraints.push_back(constraints[k]);
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+        lp.s->setVariableCoeffs(rVar, rCoeffs.size(), &rCoeffs[0], &rConstraints[0]);
+        if (!bConstraints.empty()) {
+            lp.s->setVariableCoeffs(bVar, bCoeffs.size(), &bCoeffs[0], &bConstraints[0]);
+        }
+        // Add arrival curve constraints
+        double bw = flowLP.bw;
+        SparseConstraints& rows = _arena.rows;
+        rows.clear();
+        const Curve& arrivalCurve = f->arrivalCurve;
+        const PointSlope& p1 = arrivalCurve[1];
+        double r1 = p1.slope / bw;
+        double b1 = yIntercept(p1.x, p1.y, p1.slope) / bw;
+        // bVar >= b1
+        rows.append(0, rVar);
+        rows.append(1, bVar);
+        rows.endConstraint(CONSTRAINT_GE, b1);
+        for (unsigned int i = 2; i < arrivalCurve.size(); i++) {
+            const PointSlope& p2 = arrivalCurve[i];
+            double r2 = p2.slope / bw;
+            double b2 = yIntercept(p2.x, p2.y, p2.slope) / bw;
+            assert(b2 >= b1);
+            assert(r1 >= r2);
+            // rVar * (b2 - b1) + bVar * (r1 - r2) >= r1 * b2 - r2 * b1
+            rows.append(b2 - b1, rVar);
+            rows.append(r1 - r2, bVar);
+            rows.endConstraint(CONSTRAINT_GE, r1 * b2 - r2 * b1);
+            r1 = r2;
+            b1 = b2;
+        }
+        // rVar >= r1
+        rows.append(1, rVar);
+        rows.append(0, bVar);
+        rows.endConstraint(CONSTRAINT_GE, r1);
+        lp.s->addConstraints(rows, flowLP.arrivalConstraints);
+    }
+}
+
+// Remove a client's variables and constraints from the LP.
+void WorkloadCompactor::delClientLP(ClientGroupLP& lp, ClientId clientId)
+{
+    map<ClientId, ClientGroupLP::ClientLP>::iterator clientIt = lp.clients.find(clientId);
+    assert(clientIt != lp.clients.end());
+    const ClientGroupLP::ClientLP& clientLP = clientIt->second;
+    vector<VariableHandle> vars;
+    vector<ConstraintHandle> constraints;
+    for (unsigned int flowIndex = 0; flowIndex < clientLP.flows.size(); flowIndex++) {
+        const ClientGroupLP::FlowLP& flowLP = clientLP.flows[flowIndex];
+        vars.push_back(flowLP.rVar);
+        vars.push_back(flowLP.bVar);
+        constraints.insert(constraints.end(), flowLP.arrivalConstraints.begin(), flowLP.arrivalConstraints.end());
+        map<QueueId, pair<ConstraintHandle, unsigned int> >::iterator rIt = lp.rConstraints.find(flowLP.queueId);
+        if (--rIt->second.second == 0) {
+            constraints.push_back(rIt->second.first);
+            lp.rConstraints.erase(rIt);
+        }
+    }
+    // Remove b constraints of an SLO and/or path that is no longer used
+    map<double, unsigned int>::iterator SLOIt = lp.SLOs.find(clientLP.SLO);
+    if (--SLOIt->second == 0) {
+        for (map<vector<QueueId>, unsigned int>::const_iterator it = lp.paths.begin(); it != lp.paths.end(); it++) {
+            map<ClientGroupLP::BConstraintKey, vector<ConstraintHandle> >::iterator bIt = lp.bConstraints.find(make_pair(clientLP.SLO, it->first));
+            constraints.insert(constraints.end(), bIt->second.begin(), bIt->second.end());
+            lp.bConstraints.erase(bIt);
+        }
+        lp.SLOs.erase(SLOIt);
+    }
+    map<vector<QueueId>, unsigned int>::iterator pathIt = lp.paths.find(clientLP.path);
+    if (--pathIt->second == 0) {
+        for (map<double, unsigned int>::const_iterator it = lp.SLOs.begin(); it != lp.SLOs.end(); it++) {
+            map<ClientGroupLP::BConstraintKey, vector<ConstraintHandle> >::iterator bIt = lp.bConstraints.find(make_pair(it->first, clientLP.path));
+            constraints.insert(constraints.end(), bIt->second.begin(), bIt->second.end());
+            lp.bConstraints.erase(bIt);
+        }
+        lp.paths.erase(pathIt);
+    }
+    lp.s->delConstraints(constraints.size(), constraints.empty() ? NULL : &constraints[0]);
+    lp.s->delVariables(vars.size(), vars.empty() ? NULL : &vars[0]);
+    lp.clients.erase(clientIt);
+}
+
+// Delete an LP and remove its clients from the index.
+void WorkloadCompactor::deleteClientGroupLP(ClientGroupLP* pLP)
+{
+    for (map<ClientId, ClientGroupLP::ClientLP>::const_iterator it = pLP->clients.begin(); it != pLP->clients.end(); it++) {
+        map<ClientId, ClientGroupLP*>::iterator indexIt = _clientGroupLPIndex.find(it->first);
+        if ((indexIt != _clientGroupLPIndex.end()) && (indexIt->second == pLP)) {
+            _clientGroupLPIndex.erase(indexIt);
+        }
+    }
+    _clientGroupLPs.erase(pLP);
+    delete pLP;
+}
+
+// Solve of one client group's LP on the thread pool.
+struct ClientGroupSolve {
+    ClientGroupLP* pLP;
+    bool solved;
+};
+
+void WorkloadCompactor::solveClientGroupLP(void* arg)
+{
+    TRACE_SPAN("WorkloadCompactor::solveClientGroupLP");
+    ClientGroupSolve* solve = static_cast<ClientGroupSolve*>(arg);
+    solve->solved = solve->pLP->s->solve();
+}
+
+// Set the shaper curves and priorities of the group's flows from the LP solution.
+void WorkloadCompactor::extractClientGroupLP(ClientGroupLP& lp, bool solved)
+{
+    // Lower SLOs get higher priority
+    map<double, unsigned int> priorities;
+    for (map<double, unsigned int>::const_iterator it = lp.SLOs.begin(); it != lp.SLOs.end(); it++) {
+        unsigned int priority = priorities.size();
+        priorities[it->first] = priority;
+    }
+    for (map<ClientId, ClientGroupLP::ClientLP>::const_iterator it = lp.clients.begin(); it != lp.clients.end(); it++) {
+        const ClientGroupLP::ClientLP& clientLP = it->second;
+        for (unsigned int flowIndex = 0; flowIndex < clientLP.flows.size(); flowIndex++) {
+            const ClientGroupLP::FlowLP& flowLP = clientLP.flows[flowIndex];
+            DNCFlow* f = getDNCFlow(flowLP.flowId);
+            // Set shaper curve to be uninitialized if not solved
+            SimpleArrivalCurve shaperCurve = ZeroArrivalCurve();
+            if (solved) {
+                // Extract solution
+                shaperCurve.r = lp.s->getSolutionVariable(flowLP.rVar) * flowLP.bw;
+                shaperCurve.b = lp.s->getSolutionVariable(flowLP.bVar) * flowLP.bw;
+            }
+            setShaperCurve(f->flowId, shaperCurve);
+            // Set priority
+            setFlowPriority(f->flowId, priorities[clientLP.SLO]);
+        }
+    }
+}
+
+// Segment of a flow's r-b curve, from a point with a higher rate to a point with a lower rate and higher burst
+struct RBSegment {
+    double cost; // burst increase per unit of rate decrease
+    unsigned int flowIndex;
+    double rateDecrease;
+    double burstIncrease;
+
+    bool operator<(const RBSegment& other) const
+    {
+        return cost < other.cost;
+    }
+};
+
+// Solve a client group whose flows share a single (first) queue and whose clients share a single SLO without an LP.
+// With one queue and one SLO, the LP reduces to minimizing sum_k r_k subject to sum_k b_k <= SLO, where each flow's (r_k, b_k)
+// lies on or above the convex r-b curve of its arrival curve. Starting each flow at its minimum burst, the optimum is found by
+// taking the r-b curve segments with the smallest burst cost per unit of rate decrease first (i.e., a fractional knapsack).
+// Returns false if the group does not have this shape (or a flow's r-b curve is not convex), in which case the LP is used.
+bool WorkloadCompactor::calcTrivialShaperParameters(const set<ClientId>& clientGroup, bool& solved)
+{
+    // Check shape
+    double SLO = 0;
+    QueueId queueId = 0;
+    vector<DNCFlow*> flows;
+    for (set<ClientId>::const_iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+        const Client* c = getClient(*it);
+        if (flows.empty()) {
+            SLO = c->SLO;
+            queueId = getFlow(c->flowIds.front())->queueIds.front();
+        } else if (c->SLO != SLO) {
+            return false;
+        }
+        for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
+            DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
+            if (f->queueIds.front() != queueId) {
+                return false;
+            }
+            flows.push_back(f);
+        }
+    }
+    SLO *= 0.999; // avoid rounding errors
+    double bw = getQueue(queueId)->bandwidth;
+    // Start each flow at its minimum burst and collect the segments of its r-b curve
+    vector<double> r(flows.size());
+    vector<double> b(flows.size());
+    vector<RBSegment> segments;
+    double totalBurst = 0;
+    for (unsigned int flowIndex = 0; flowIndex < flows.size(); flowIndex++) {
+        const Curve& arrivalCurve = flows[flowIndex]->arrivalCurve;
+        const PointSlope& p1 = arrivalCurve[1];
+        double r1 = p1.slope / bw;
+        double b1 = yIntercept(p1.x, p1.y, p1.slope) / bw;
+        if (r1 > 0.999) {
+            // Rate limit is bounded
+            return false;
+        }
+        r[flowIndex] = r1;
+        b[flowIndex] = b1;
+        totalBurst += b1;
+        double prevCost = 0;
+        for (unsigned int i = 2; i < arrivalCurve.size(); i++) {
+            const PointSlope& p2 = arrivalCurve[i];
+            double r2 = p2.slope / bw;
+            double b2 = yIntercept(p2.x, p2.y, p2.slope) / bw;
+            if (r2 < r1) {
+                RBSegment segment;
+                segment.cost = (b2 - b1) / (r1 - r2);
+                segment.flowIndex = flowIndex;
+                segment.rateDecrease = r1 - r2;
+                segment.burstIncrease = b2 - b1;
+                if (segment.cost < prevCost) {
+                    return false;
+                }
+                prevCost = segment.cost;
+                segments.push_back(segment);
+                r1 = r2;
+                b1 = b2;
+            }
+        }
+    }
+    solved = (totalBurst <= SLO);
+    if (solved) {
+        // Stable sort keeps each flow's segments in order when costs are equal
+        stable_sort(segments.begin(), segments.end());
+        double budget = SLO - totalBurst;
+        for (unsigned int i = 0; (i < segments.size()) && (budget > 0); i++) {
+            const RBSegment& segment = segments[i];
+            if (segment.burstIncrease <= budget) {
+                r[segment.flowIndex] -= segment.rateDecrease;
+                b[segment.flowIndex] += segment.burstIncrease;
+                budget -= segment.burstIncrease;
+            } else {
+                r[segment.flowIndex] -= segment.rateDecrease * (budget / segment.burstIncrease);
+                b[segment.flowIndex] += budget;
+                budget = 0;
+            }
+        }
+        double totalRate = 0;
+        for (unsigned int flowIndex = 0; flowIndex < flows.size(); flowIndex++) {
+            totalRate += r[flowIndex];
+        }
+        solved = (totalRate <= 0.999); // avoid rounding errors
+    }
+    for (unsigned int flowIndex = 0; flowIndex < flows.size(); flowIndex++) {
+        DNCFlow* f = flows[flowIndex];
+        // Set shaper curve to be uninitialized if not solved
+        SimpleArrivalCurve shaperCurve = ZeroArrivalCurve();
+        if (solved) {
+            shaperCurve.r = r[flowIndex] * bw;
+            shaperCurve.b = b[flowIndex] * bw;
+        }
+        setShaperCurve(f->flowId, shaperCurve);
+        // All flows have the same SLO and priority
+        setFlowPriority(f->flowId, 0);
+    }
+    return true;
+}
+
+// Partition the clients sharing queues with the affected queues into groups of clients that share queues.
+void WorkloadCompactor::getAffectedClientGroups(vector<set<ClientId> >& clientGroups) const
+{
+    set<QueueId> affectedQueueIds = _affectedQueueIds;
     set<QueueId> remainingQueueIds;
-    for (map<QueueId, Queue*>::const_iterator it = queuesBegin(); it != queuesEnd(); it++) {
+    for (QueueIterator it = queuesBegin(); it != queuesEnd(); it++) {
         remainingQueueIds.insert(it->first);
     }
-    while (!_affectedQueueIds.empty()) {
-        QueueId firstQueueId = *(_affectedQueueIds.begin());
+    while (!affectedQueueIds.empty()) {
+        QueueId firstQueueId = *(affectedQueueIds.begin());
         remainingQueueIds.erase(firstQueueId);
-        _affectedQueueIds.erase(firstQueueId);
+        affectedQueueIds.erase(firstQueueId);
         clientGroups.resize(clientGroups.size() + 1);
         set<ClientId>& clientGroup = clientGroups[clientGroups.size() - 1];
         vector<QueueId> pendingQueueIds(1, firstQueueId);
@@ -45,7 +405,7 @@ bool WorkloadCompactor::calcShaperParameters()
                     for (unsigned int queueIndex = 0; queueIndex < f->queueIds.size(); queueIndex++) {
                         QueueId queueId = f->queueIds[queueIndex];
                         if (remainingQueueIds.erase(queueId) == 1) {
-                            _affectedQueueIds.erase(queueId);
+                            affectedQueueIds.erase(queueId);
                             pendingQueueIds.push_back(queueId);
                         }
                     }
@@ -53,208 +413,227 @@ bool WorkloadCompactor::calcShaperParameters()
             }
         }
     }
-    // Optimize shaper curves
+}
+
+// WorkloadCompactor's linear program for optimizing rate limit parameters at each queue.
+// See WorkloadCompactor paper for details.
+bool WorkloadCompactor::calcShaperParameters()
+{
+    TRACE_SPAN("WorkloadCompactor::calcShaperParameters");
+    bool result = true;
+    // Partition clients into groups
+    vector<set<ClientId> > clientGroups;
+    getAffectedClientGroups(clientGroups);
+    _affectedQueueIds.clear();
+    // Build LPs
+    set<ClientGroupLP*> staleLPs;
+    vector<ClientGroupSolve> solves;
     for (unsigned int clientGroupIndex = 0; clientGroupIndex < clientGroups.size(); clientGroupIndex++) {
         set<ClientId>& clientGroup = clientGroups[clientGroupIndex];
-        // Get SLOs in client group
-        map<double, unsigned int> SLOs;
-        for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-            double SLO = getClient(*it)->SLO * 0.999; // avoid rounding errors
-            SLOs[SLO] = 0;
-        }
-        unsigned int priority = 0;
-        for (map<double, unsigned int>::iterator it = SLOs.begin(); it != SLOs.end(); it++) {
-            it->second = priority;
-            priority++;
+        if (clientGroup.empty()) {
+            continue;
         }
-        // Get paths and queues
-        vector<vector<QueueId> > paths;
-        map<QueueId, unsigned int> queueIds;
+        // Find the LPs of the clients in the group
+        set<ClientGroupLP*> groupLPs;
         for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-            const Client* c = getClient(*it);
-            vector<QueueId> clientPath;
-            for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                const Flow* f = getFlow(c->flowIds[flowIndex]);
-                QueueId queueId = f->queueIds.front();
-                clientPath.push_back(queueId);
-                if (queueIds.find(queueId) == queueIds.end()) {
-                    unsigned int stageIndex = queueIds.size();
-                    queueIds[queueId] = stageIndex;
-                }
-            }
-            unsigned int pathIndex;
-            for (pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
-                const vector<QueueId>& path = paths[pathIndex];
-                if (path.size() == clientPath.size()) {
-                    bool found = true;
-                    for (unsigned int j = 0; j < path.size(); j++) {
-                        if (path[j] != clientPath[j]) {
-                            found = false;
-                            break;
-                        }
-                    }
-                    if (found) {
-                        break;
-                    }
-                }
+            map<ClientId, ClientGroupLP*>::iterator indexIt = _clientGroupLPIndex.find(*it);
+            if (indexIt != _clientGroupLPIndex.end()) {
+                groupLPs.insert(indexIt->second);
             }
-            if (pathIndex == paths.size()) {
-                paths.push_back(clientPath);
+        }
+        // Solve groups with a single queue and SLO directly
+        bool solved = false;
+        if (_fastPath && calcTrivialShaperParameters(clientGroup, solved)) {
+            staleLPs.insert(groupLPs.begin(), groupLPs.end());
+            if (!solved) {
+                result = false;
             }
+            continue;
         }
-        // Build LP
-        SolverGLPK s;
-        vector<VariableHandle> rVars;
-        vector<VariableHandle> bVars;
-        vector<ConstraintExpression> rConstraints(queueIds.size());
-        for (unsigned int stageIndex = 0; stageIndex < queueIds.size(); stageIndex++) {
-            rConstraints[stageIndex].init(clientGroup.size());
-        }
-        vector<vector<vector<ConstraintExpression> > > bConstraints(SLOs.size());
-        for (unsigned int i = 0; i < SLOs.size(); i++) {
-            bConstraints[i].resize(paths.size());
-            for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
-                const vector<QueueId>& path = paths[pathIndex];
-                bConstraints[i][pathIndex].resize(path.size());
-                for (unsigned int j = 0; j < path.size(); j++) {
-                    bConstraints[i][pathIndex][j].init((path.size() + 1) * clientGroup.size());
+        // Reuse an LP if the group is the LP's group plus newly added clients (i.e., groups were not merged or split)
+        ClientGroupLP* pLP = NULL;
+        if (_incrementalLP && (groupLPs.size() == 1)) {
+            pLP = *groupLPs.begin();
+            for (map<ClientId, ClientGroupLP::ClientLP>::const_iterator it = pLP->clients.begin(); it != pLP->clients.end(); it++) {
+                if (clientGroup.find(it->first) == clientGroup.end()) {
+                    pLP = NULL;
+                    break;
                 }
             }
         }
-        for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-            const Client* c = getClient(*it);
-            double SLO = c->SLO * 0.999; // avoid rounding errors
-            for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
-                QueueId queueId = f->queueIds.front();
-                // Create rVar, bVar variables
-                VariableHandle rVar = s.addVariable(0, 0.999, VAR_CONTINUOUS, NULL); // avoid rounding errors
-                VariableHandle bVar = s.addVariable(0, SLO, VAR_CONTINUOUS, NULL);
-                rVars.push_back(rVar);
-                bVars.push_back(bVar);
-                // Append to r and  b constraints
-                rConstraints[queueIds[queueId]].append(1, rVar);
-                unsigned int i = 0;
-                for (map<double, unsigned int>::reverse_iterator rit = SLOs.rbegin(); rit != SLOs.rend(); rit++) {
-                    if (rit->first >= SLO) {
-                        for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
-                            const vector<QueueId>& path = paths[pathIndex];
-                            for (unsigned int j = 0; j < path.size(); j++) {
-                                if (path[j] == queueId) {
-                                    if (rit->first > SLO) {
-                                        bConstraints[i][pathIndex][j].append(1, rVar);
-                                    }
-                                    for (unsigned int k = 0; k < path.size(); k++) {
-                                        bConstraints[i][pathIndex][k].append(1.0 / rit->first, bVar);
-                                    }
-                                    break;
-                                }
-                            }
-                        }
-                        i++;
-                    } else {
-                        break;
-                    }
-                }
-                // Add arrival curve constraints
-                double bw = getQueue(queueId)->bandwidth; // Bandwidth of first queue
-                double coeffs[] = {0, 0};
-                VariableHandle vars[] = {rVar, bVar};
-                const Curve& arrivalCurve = f->arrivalCurve;
-                const PointSlope& p1 = arrivalCurve[1];
-                double r1 = p1.slope / bw;
-                double b1 = yIntercept(p1.x, p1.y, p1.slope) / bw;
-                // bVar >= b1
-                coeffs[0] = 0; // rVar
-                coeffs[1] = 1; // bVar
-                s.addConstraint(2, coeffs, vars, CONSTRAINT_GE, b1, NULL);
-                for (unsigned int i = 2; i < arrivalCurve.size(); i++) {
-                    const PointSlope& p2 = arrivalCurve[i];
-                    double r2 = p2.slope / bw;
-                    double b2 = yIntercept(p2.x, p2.y, p2.slope) / bw;
-                    assert(b2 >= b1);
-                    assert(r1 >= r2);
-                    // rVar * (b2 - b1) + bVar * (r1 - r2) >= r1 * b2 - r2 * b1
-                    coeffs[0] = b2 - b1; // rVar
-                    coeffs[1] = r1 - r2; // bVar
-                    s.addConstraint(2, coeffs, vars, CONSTRAINT_GE, r1 * b2 - r2 * b1, NULL);
-                    r1 = r2;
-                    b1 = b2;
-                }
-                // rVar >= r1
-                coeffs[0] = 1; // rVar
-                coeffs[1] = 0; // bVar
-                s.addConstraint(2, coeffs, vars, CONSTRAINT_GE, r1, NULL);
+        if (pLP == NULL) {
+            // Build LP
+            staleLPs.insert(groupLPs.begin(), groupLPs.end());
+            Solver* pSolver = createSolver(_solverName);
+            assert(pSolver != NULL);
+            if (!_lpCaptureFilename.empty()) {
+                pSolver = new SolverRecorder(pSolver, _lpCaptureFilename);
             }
+            pLP = new ClientGroupLP(pSolver);
+            pLP->s->setWarmStart(_incrementalLP);
+            _clientGroupLPs.insert(pLP);
         }
-        // Add r constraints for each stage
-        // sum_k r_k <= 1
-        for (unsigned int stageIndex = 0; stageIndex < queueIds.size(); stageIndex++) {
-            s.addConstraintExpression(rConstraints[stageIndex], CONSTRAINT_LE, 0.999, NULL); // avoid rounding errors
-        }
-        // Add b constraints for each SLO_i, for each path, for each stage in path
-        // [sum_k|SLO_k<=SLO_i,k in path (b_k / SLO_i)] + [sum_k|SLO_k<SLO_i,k==stage (r_k)] <= 1
-        for (unsigned int i = 0; i < SLOs.size(); i++) {
-            for (unsigned int pathIndex = 0; pathIndex < paths.size(); pathIndex++) {
-                const vector<QueueId>& path = paths[pathIndex];
-                for (unsigned int j = 0; j < path.size(); j++) {
-                    s.addConstraintExpression(bConstraints[i][pathIndex][j], CONSTRAINT_LE, 1, NULL);
-                }
+        for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+            if (pLP->clients.find(*it) == pLP->clients.end()) {
+                addClientLP(*pLP, *it);
+                _clientGroupLPIndex[*it] = pLP;
             }
         }
-        // Add objective function (minimize sum_k r_k)
-        s.setObjectiveDirection(OBJECTIVE_MIN);
-        for (unsigned int i = 0; i < rVars.size(); i++) {
-            s.setObjectiveCoeff(1, rVars[i]);
-        }
-        // Solve LP
-        if (s.solve()) {
-            // Extract solution
-            unsigned int i = 0;
-            for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-                const Client* c = getClient(*it);
-                double SLO = c->SLO * 0.999; // avoid rounding errors
-                for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                    DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
-                    double bw = getQueue(f->queueIds.front())->bandwidth; // Bandwidth of first queue
-                    SimpleArrivalCurve& shaperCurve = f->shaperCurve;
-                    shaperCurve.r = s.getSolutionVariable(rVars[i]) * bw;
-                    shaperCurve.b = s.getSolutionVariable(bVars[i]) * bw;
-                    i++;
-                    // Set priority
-                    setFlowPriority(f->flowId, SLOs[SLO]);
-                }
+        ClientGroupSolve solve;
+        solve.pLP = pLP;
+        solve.solved = false;
+        solves.push_back(solve);
+    }
+    // Solve LPs, in parallel if there are multiple groups and their solvers can solve concurrently.
+    // The rest (e.g., GLPK without GLPK_THREAD_SAFE, whose calls are serialized) are solved on this thread while the pool runs.
+    bool parallel = (solves.size() > 1) && (_numThreads != 1);
+    vector<ClientGroupSolve*> serialSolves;
+    bool pending = false;
+    for (unsigned int i = 0; i < solves.size(); i++) {
+        if (parallel && solves[i].pLP->s->canSolveConcurrently()) {
+            if (_pThreadPool == NULL) {
+                _pThreadPool = new ThreadPool(_numThreads);
             }
+            _pThreadPool->addTask(solveClientGroupLP, &solves[i]);
+            pending = true;
         } else {
+            serialSolves.push_back(&solves[i]);
+        }
+    }
+    for (unsigned int i = 0; i < serialSolves.size(); i++) {
+        solveClientGroupLP(serialSolves[i]);
+    }
+    if (pending) {
+        _pThreadPool->wait();
+    }
+    // Set shaper curves and priorities in group order so that the results match a serial solve
+    for (unsigned int i = 0; i < solves.size(); i++) {
+        extractClientGroupLP(*solves[i].pLP, solves[i].solved);
+        if (!solves[i].solved) {
             result = false;
-            // Set shaper curve to be uninitialized
-            for (set<ClientId>::iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
-                const Client* c = getClient(*it);
-                double SLO = c->SLO * 0.999; // avoid rounding errors
-                for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
-                    DNCFlow* f = getDNCFlow(c->flowIds[flowIndex]);
-                    f->shaperCurve = ZeroArrivalCurve();
-                    // Set priority
-                    setFlowPriority(f->flowId, SLOs[SLO]);
-                }
-            }
         }
     }
+    for (set<ClientGroupLP*>::iterator it = staleLPs.begin(); it != staleLPs.end(); it++) {
+        deleteClientGroupLP(*it);
+    }
     return result;
 }
 
-double WorkloadCompactor::calcFlowLatency(FlowId flowId)
+// Delete all LPs, marking all queues as affected so that every group is re-optimized.
+void WorkloadCompactor::resetClientGroupLPs()
 {
-    // Re-optimize rate limit (i.e., shaper) parameters before calculating latency
+    for (QueueIterator it = queuesBegin(); it != queuesEnd(); it++) {
+        _affectedQueueIds.insert(it->first);
+    }
+    while (!_clientGroupLPs.empty()) {
+        deleteClientGroupLP(*_clientGroupLPs.begin());
+    }
+}
+
+bool WorkloadCompactor::setSolver(const string& name)
+{
+    Solver* pSolver = createSolver(name);
+    if (pSolver == NULL) {
+        cerr << "Unknown solver " << name << endl;
+        return false;
+    }
+    delete pSolver;
+    _solverName = name;
+    resetClientGroupLPs();
+    return true;
+}
+
+void WorkloadCompactor::setLPCaptureFile(const string& filename)
+{
+    _lpCaptureFilename = filename;
+    resetClientGroupLPs();
+}
+
+void WorkloadCompactor::setFastPath(bool enable)
+{
+    _fastPath = enable;
+    resetClientGroupLPs();
+}
+
+void WorkloadCompactor::updateShaperParameters()
+{
+    TRACE_SPAN("WorkloadCompactor::updateShaperParameters");
     if (!_affectedQueueIds.empty()) {
         calcShaperParameters();
         _affectedQueueIds.clear();
     }
+}
+
+void WorkloadCompactor::getAffectedFlows(set<FlowId>& flowIds) const
+{
+    vector<set<ClientId> > clientGroups;
+    getAffectedClientGroups(clientGroups);
+    for (unsigned int clientGroupIndex = 0; clientGroupIndex < clientGroups.size(); clientGroupIndex++) {
+        const set<ClientId>& clientGroup = clientGroups[clientGroupIndex];
+        for (set<ClientId>::const_iterator it = clientGroup.begin(); it != clientGroup.end(); it++) {
+            const Client* c = getClient(*it);
+            flowIds.insert(c->flowIds.begin(), c->flowIds.end());
+        }
+    }
+}
+
+void WorkloadCompactor::clearAffectedQueues()
+{
+    _affectedQueueIds.clear();
+}
+
+double WorkloadCompactor::calcFlowLatency(FlowId flowId)
+{
+    // Re-optimize rate limit (i.e., shaper) parameters before calculating latency
+    updateShaperParameters();
     return DNC::calcFlowLatency(flowId);
 }
 
+void WorkloadCompactor::writeCheckpoint(BinaryWriter& writer) const
+{
+    DNC::writeCheckpoint(writer);
+    writer.write(static_cast<uint32_t>(_affectedQueueIds.size()));
+    for (set<QueueId>::const_iterator it = _affectedQueueIds.begin(); it != _affectedQueueIds.end(); it++) {
+        writer.write(static_cast<uint32_t>(*it));
+    }
+}
+
+bool WorkloadCompactor::readCheckpoint(BinaryReader& reader)
+{
+    if (!DNC::readCheckpoint(reader)) {
+        return false;
+    }
+    _affectedQueueIds.clear();
+    uint32_t numAffectedQueues = 0;
+    reader.readCount(numAffectedQueues, sizeof(uint32_t));
+    for (unsigned int i = 0; i < numAffectedQueues; i++) {
+        uint32_t queueId = InvalidQueueId;
+        reader.read(queueId);
+        if (getQueue(queueId) == NULL) {
+            return false;
+        }
+        _affectedQueueIds.insert(queueId);
+    }
+    return reader.ok();
+}
+
+void WorkloadCompactor::beginWhatIf()
+{
+    DNC::beginWhatIf();
+    _whatIfAffectedQueueIds = _affectedQueueIds;
+}
+
+void WorkloadCompactor::endWhatIf()
+{
+    DNC::endWhatIf();
+    // The restored shaper curves are optimized for the queues that were not affected before the what-if evaluation
+    _affectedQueueIds.swap(_whatIfAffectedQueueIds);
+    _whatIfAffectedQueueIds.clear();
+}
+
 ClientId WorkloadCompactor::addClient(const Json::Value& clientInfo)
 {
+    TRACE_SPAN("WorkloadCompactor::addClient");
     // Add workload
     ClientId clientId = DNC::addClient(clientInfo);
     // Mark queues affected by workload addition
@@ -271,6 +650,17 @@ ClientId WorkloadCompactor::addClient(const Json::Value& clientInfo)
 
 void WorkloadCompactor::delClient(ClientId clientId)
 {
+    TRACE_SPAN("WorkloadCompactor::delClient");
+    // Remove workload from its group's LP
+    map<ClientId, ClientGroupLP*>::iterator indexIt = _clientGroupLPIndex.find(clientId);
+    if (indexIt != _clientGroupLPIndex.end()) {
+        ClientGroupLP* pLP = indexIt->second;
+        _clientGroupLPIndex.erase(indexIt);
+        delClientLP(*pLP, clientId);
+        if (pLP->clients.empty()) {
+            deleteClientGroupLP(pLP);
+        }
+    }
     // Mark queues affected by workload deletion
     const Client* c = getClient(clientId);
     for (unsigned int flowIndex = 0; flowIndex < c->flowIds.size(); flowIndex++) {
@@ -283,3 +673,24 @@ void WorkloadCompactor::delClient(ClientId clientId)
     // Delete workload
     DNC::delClient(clientId);
 }
+
+void WorkloadCompactor::setArrivalCurve(FlowId flowId, const Curve& arrivalCurve)
+{
+    // Remove workload from its group's LP, since the LP's arrival curve constraints have changed
+    const Flow* f = getFlow(flowId);
+    ClientId clientId = f->clientId;
+    map<ClientId, ClientGroupLP*>::iterator indexIt = _clientGroupLPIndex.find(clientId);
+    if (indexIt != _clientGroupLPIndex.end()) {
+        ClientGroupLP* pLP = indexIt->second;
+        _clientGroupLPIndex.erase(indexIt);
+        delClientLP(*pLP, clientId);
+        if (pLP->clients.empty()) {
+            deleteClientGroupLP(pLP);
+        }
+    }
+    // Mark queues affected by the new arrival curve
+    for (unsigned int queueIndex = 0; queueIndex < f->queueIds.size(); queueIndex++) {
+        _affectedQueueIds.insert(f->queueIds[queueIndex]);
+    }
+    DNC::setArrivalCurve(flowId, arrivalCurve);
+}
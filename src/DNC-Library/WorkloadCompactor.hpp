@@ -7,31 +7,144 @@
 #ifndef WORKLOAD_COMPACTOR_HPP
 #define WORKLOAD_COMPACTOR_HPP
 
+#include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include "../common/ThreadPool.hpp"
+#include "Solver.hpp"
 #include "DNC.hpp"
 
 using namespace std;
 
+// Persistent LP for a group of clients that share queues.
+// The LP is updated in place as clients join and leave the group, and re-solved from the previous basis.
+struct ClientGroupLP {
+    // LP variables and constraints of a flow
+    struct FlowLP {
+        FlowId flowId;
+        QueueId queueId; // first queue of flow
+        double bw; // bandwidth of first queue
+        VariableHandle rVar;
+        VariableHandle bVar;
+        vector<ConstraintHandle> arrivalConstraints;
+    };
+    // LP info of a client
+    struct ClientLP {
+        double SLO;
+        vector<QueueId> path; // first queue of each flow
+        vector<FlowLP> flows;
+    };
+    typedef pair<double, vector<QueueId> > BConstraintKey;
+
+    Solver* s;
+    map<ClientId, ClientLP> clients;
+    map<QueueId, pair<ConstraintHandle, unsigned int> > rConstraints; // r constraint and number of flows for each stage
+    map<double, unsigned int> SLOs; // number of clients with each SLO
+    map<vector<QueueId>, unsigned int> paths; // number of clients with each path
+    map<BConstraintKey, vector<ConstraintHandle> > bConstraints; // b constraints for each stage in path, for each SLO and path
+
+    // Takes ownership of pSolver
+    ClientGroupLP(Solver* pSolver)
+        : s(pSolver)
+    {}
+    ~ClientGroupLP()
+    {
+        delete s;
+    }
+};
+
+// Scratch storage reused while building LPs, so that adding clients does not allocate once the buffers have grown.
+struct LPBuildArena {
+    SparseConstraints rows;
+    vector<double> rCoeffs;
+    vector<ConstraintHandle> rConstraints;
+    vector<double> bCoeffs;
+    vector<ConstraintHandle> bConstraints;
+};
+
 class WorkloadCompactor : public DNC
 {
 private:
     set<QueueId> _affectedQueueIds; // track queues affected by adding/deleting workloads that need to be re-optimized
+    set<QueueId> _whatIfAffectedQueueIds; // _affectedQueueIds at the start of a what-if evaluation
+    bool _incrementalLP; // reuse and warm start LPs across re-optimizations
+    set<ClientGroupLP*> _clientGroupLPs; // LPs of client groups
+    map<ClientId, ClientGroupLP*> _clientGroupLPIndex; // map client id -> LP of its client group
+    unsigned int _numThreads; // number of threads for solving client groups in parallel (0 uses the number of cores)
+    ThreadPool* _pThreadPool; // created on first use
+    LPBuildArena _arena;
+    string _solverName; // solver backend for new LPs
+    string _lpCaptureFilename; // if set, solved LPs are appended to this file
+    bool _fastPath; // solve groups with a single queue and SLO without an LP
 
+    // Add the b constraints for an SLO and path to the LP.
+    void addBConstraints(ClientGroupLP& lp, double SLO, const vector<QueueId>& path);
+    // Add a client's variables and constraints to the LP.
+    void addClientLP(ClientGroupLP& lp, ClientId clientId);
+    // Remove a client's variables and constraints from the LP.
+    void delClientLP(ClientGroupLP& lp, ClientId clientId);
+    // Delete an LP and remove its clients from the index.
+    void deleteClientGroupLP(ClientGroupLP* pLP);
+    // Delete all LPs and re-optimize all groups on the next re-optimization.
+    void resetClientGroupLPs();
+    // Solve an LP; arg is a ClientGroupSolve. Run on the thread pool.
+    static void solveClientGroupLP(void* arg);
+    // Set the shaper curves and priorities of the group's flows from the LP solution.
+    void extractClientGroupLP(ClientGroupLP& lp, bool solved);
+
+    // Calculate the shaper curves of a group with a single queue and SLO without an LP.
+    // Returns false if the group does not have this shape; otherwise, solved is set to whether a solution was found.
+    bool calcTrivialShaperParameters(const set<ClientId>& clientGroup, bool& solved);
+
+    // Partition the clients sharing queues with the affected queues into groups of clients that share queues.
+    void getAffectedClientGroups(vector<set<ClientId> >& clientGroups) const;
     // WorkloadCompactor's linear program for optimizing rate limit parameters at each queue.
     // See WorkloadCompactor paper for details.
     bool calcShaperParameters();
 
 public:
-    WorkloadCompactor()
-    {}
-    virtual ~WorkloadCompactor()
+    // If incrementalLP is set, each client group's LP is kept and updated as clients are added and deleted
+    // rather than rebuilt and solved from scratch on every re-optimization.
+    // Independent client groups are solved in parallel on numThreads threads (0 uses the number of cores, 1 solves serially).
+    WorkloadCompactor(bool incrementalLP = true, unsigned int numThreads = 0)
+        : _incrementalLP(incrementalLP),
+          _numThreads(numThreads),
+          _pThreadPool(NULL),
+          _solverName(defaultSolverName),
+          _fastPath(true)
     {}
+    virtual ~WorkloadCompactor();
+
+    // Select the solver backend (see registerSolver) used for the LPs. Returns false if the backend is not registered.
+    bool setSolver(const string& name);
+    // Append each solved LP to filename (see SolverRecorder); an empty filename disables capturing.
+    void setLPCaptureFile(const string& filename);
+    // Enable solving client groups with a single queue and SLO directly rather than with an LP; enabled by default.
+    void setFastPath(bool enable);
+
+    // Re-optimize the shaper curves and priorities of the flows affected by adding/deleting workloads; done automatically by calcFlowLatency.
+    void updateShaperParameters();
+    // Get the flows whose shaper curves and priorities will be re-optimized by the next updateShaperParameters.
+    void getAffectedFlows(set<FlowId>& flowIds) const;
+    // Treat the current shaper curves and priorities as optimized (e.g., after setting them to the parameters
+    // optimized by another WorkloadCompactor for the same workloads), so that they are not re-optimized.
+    void clearAffectedQueues();
 
     virtual double calcFlowLatency(FlowId flowId);
 
     virtual ClientId addClient(const Json::Value& clientInfo);
     virtual void delClient(ClientId clientId);
+    // The flow's shaper curves are re-optimized by the next updateShaperParameters.
+    virtual void setArrivalCurve(FlowId flowId, const Curve& arrivalCurve);
+
+    // The queues to be re-optimized are included in checkpoints. LPs are not, so each client group's LP is rebuilt the first time the group is re-optimized.
+    virtual void writeCheckpoint(BinaryWriter& writer) const;
+    virtual bool readCheckpoint(BinaryReader& reader);
+
+    // After a what-if evaluation, only the queues that were affected before the evaluation need to be re-optimized.
+    virtual void beginWhatIf();
+    virtual void endWhatIf();
 };
 
 #endif // WORKLOAD_COMPACTOR_HPP
@@ -0,0 +1,130 @@
+// DNC-LibraryBenchmark.cpp - Benchmark code for DNC-Library hot paths.
+//
+// Command line parameters:
+// -t traceFilename (optional) - trace file to benchmark with; defaults to ../../examples/traces/trace0000.txt
+// -n numRates (optional) - number of rates to evaluate in rbGen; defaults to 1000
+// -i iterations (optional) - number of times to repeat each benchmark; defaults to 5
+// -l lpFilename (optional) - LPs captured by SolverRecorder (e.g., with AdmissionController -c) to benchmark each solver backend with
+// -j jsonFilename (optional) - run the microbenchmark suite instead and output its results in JSON to jsonFilename ("-" for stdout)
+//
+// Microbenchmark suite parameters (comma separated lists are swept):
+// -n numRates - numbers of rates to evaluate in rbGen and pruneArrivalCurve; defaults to 1000
+// -L traceLengths (optional) - lengths of generated traces, which are benchmarked along with the -t trace; defaults to 100000
+// -F flowsPerQueue (optional) - numbers of flows per queue of generated client groups; defaults to 4,16
+// -G clientGroupSizes (optional) - numbers of clients sharing queues in generated client groups; defaults to 8,32
+// -g numGroups (optional) - number of client groups to generate; defaults to 4
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include "DNC-LibraryBenchmark.hpp"
+
+using namespace std;
+
+#define USAGE "[-t traceFilename] [-n numRates] [-i iterations] [-l lpFilename] [-j jsonFilename] [-L traceLengths] [-F flowsPerQueue] [-G clientGroupSizes] [-g numGroups]"
+
+// Parse a comma separated list of positive integers. Returns false on error.
+static bool parseList(const char* s, vector<unsigned int>& values)
+{
+    values.clear();
+    stringstream ss(s);
+    string item;
+    while (getline(ss, item, ',')) {
+        int value = atoi(item.c_str());
+        if (value <= 0) {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    string traceFilename = "../../examples/traces/trace0000.txt";
+    vector<unsigned int> numRates(1, 1000);
+    int iterations = 5;
+    string lpFilename;
+    string jsonFilename;
+    vector<unsigned int> traceLengths(1, 100000);
+    vector<unsigned int> flowsPerQueue;
+    flowsPerQueue.push_back(4);
+    flowsPerQueue.push_back(16);
+    vector<unsigned int> clientGroupSizes;
+    clientGroupSizes.push_back(8);
+    clientGroupSizes.push_back(32);
+    int numGroups = 4;
+    bool validLists = true;
+    do {
+        opt = getopt(argc, argv, "t:n:i:l:j:L:F:G:g:");
+        switch (opt) {
+            case 't':
+                traceFilename.assign(optarg);
+                break;
+
+            case 'n':
+                validLists = validLists && parseList(optarg, numRates);
+                break;
+
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+
+            case 'l':
+                lpFilename.assign(optarg);
+                break;
+
+            case 'j':
+                jsonFilename.assign(optarg);
+                break;
+
+            case 'L':
+                validLists = validLists && parseList(optarg, traceLengths);
+                break;
+
+            case 'F':
+                validLists = validLists && parseList(optarg, flowsPerQueue);
+                break;
+
+            case 'G':
+                validLists = validLists && parseList(optarg, clientGroupSizes);
+                break;
+
+            case 'g':
+                numGroups = atoi(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                cerr << "Usage: " << argv[0] << " " USAGE << endl;
+                return -1;
+        }
+    } while (opt != -1);
+
+    if (!validLists || (iterations < 1) || (numGroups < 1)) {
+        cerr << "Usage: " << argv[0] << " " USAGE << endl;
+        return -1;
+    }
+
+    if (!jsonFilename.empty()) {
+        microBenchmark(jsonFilename, vector<string>(1, traceFilename), traceLengths, numRates, flowsPerQueue, clientGroupSizes, numGroups, iterations);
+        return 0;
+    }
+
+    processedTraceBenchmark(traceFilename, iterations);
+    rbGenBenchmark(traceFilename, numRates.front(), iterations);
+    if (!lpFilename.empty()) {
+        solverBenchmark(lpFilename, iterations);
+    }
+    return 0;
+}
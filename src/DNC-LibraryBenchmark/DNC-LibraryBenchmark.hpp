@@ -0,0 +1,21 @@
+// DNC-LibraryBenchmark.hpp - function definitions for benchmark code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _BENCHMARK_HPP
+#define _BENCHMARK_HPP
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+void rbGenBenchmark(string traceFilename, unsigned int numRates, unsigned int iterations);
+void processedTraceBenchmark(string traceFilename, unsigned int iterations);
+void solverBenchmark(string lpFilename, unsigned int iterations);
+void microBenchmark(string jsonFilename, const vector<string>& traceFilenames, const vector<unsigned int>& traceLengths, const vector<unsigned int>& numRatesList,
+                    const vector<unsigned int>& flowsPerQueueList, const vector<unsigned int>& clientGroupSizes, unsigned int numGroups, unsigned int iterations);
+
+#endif // _BENCHMARK_HPP
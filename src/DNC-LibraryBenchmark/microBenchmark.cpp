@@ -0,0 +1,526 @@
+// microBenchmark.cpp - Microbenchmark suite for the DNC/WorkloadCompactor hot paths.
+// Each benchmark is run on parameterized workloads (trace length, number of rates, flows per queue, and client group size),
+// using generated traces and trace files, and the throughput and latency percentiles of each are output in JSON
+// so that runs can be compared for performance regressions and optimizations.
+//
+// The private DNC and WorkloadCompactor analyses are measured through their public entry points:
+// aggregateAnalysisTwoHop by recalculating a flow's latency after changing its shaper curve,
+// and calcShaperParameters by re-optimizing a client group after changing a client's arrival curve.
+// NC's id lookups, which read the dense id tables, are compared against the id maps they previously searched.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <unistd.h>
+#include <json/json.h>
+#include "../common/common.hpp"
+#include "../common/time.hpp"
+#include "../common/serializeJSON.hpp"
+#include "../common/ThreadPool.hpp"
+#include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/ProcessedTrace.hpp"
+#include "../DNC-Library/DNC.hpp"
+#include "../DNC-Library/WorkloadCompactor.hpp"
+#include "DNC-LibraryBenchmark.hpp"
+
+using namespace std;
+
+// Max rate of arrival curves and bandwidth per flow of queues (bytes/sec); 1 Gbps as in rbGenBenchmark
+#define MICRO_BENCHMARK_MAX_RATE 125000000.0
+// Number of request sizes estimated per estimateWork iteration
+#define MICRO_BENCHMARK_ESTIMATES 1000000
+// Number of points the arrival curves are pruned to, as in calcArrivalCurves
+#define MICRO_BENCHMARK_PRUNE_POINTS 12
+
+typedef void (*MicroBenchmarkFn)(void* arg, unsigned int iteration);
+
+// Deterministic generator so that runs use the same workloads
+static uint64_t nextRandom(uint64_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// Uniform random number in (0, 1]
+static double nextUniform(uint64_t& state)
+{
+    return (double)((nextRandom(state) >> 11) + 1) / 9007199254740992.0;
+}
+
+// Write a CSV trace of length requests with bursty arrivals; returns the filename, or an empty string on error.
+// Requests arrive in bursts with exponential gaps, averaging about 5000 requests/sec and 80 MB/s.
+static string generateTrace(unsigned int length, uint64_t seed)
+{
+    char filename[] = "/tmp/microBenchmarkTraceXXXXXX";
+    int fd = mkstemp(filename);
+    if (fd < 0) {
+        perror("Failed to create trace file");
+        return "";
+    }
+    FILE* file = fdopen(fd, "w");
+    uint64_t state = seed | 1;
+    const unsigned int requestSizes[] = {4096, 8192, 16384, 65536, 131072};
+    uint64_t arrivalTime = 0;
+    for (unsigned int i = 0; i < length; i++) {
+        bool newBurst = (nextUniform(state) < 0.1);
+        double meanGap = newBurst ? 0.0019 : 0.00001;
+        arrivalTime += (uint64_t)(-log(nextUniform(state)) * meanGap * 1e9);
+        unsigned int requestSize = requestSizes[nextRandom(state) % (sizeof(requestSizes) / sizeof(requestSizes[0]))];
+        bool isRead = ((nextRandom(state) % 10) < 7);
+        fprintf(file, "%llu,0x%08x,%s\n", (unsigned long long)arrivalTime, requestSize, isRead ? "DiskRead" : "DiskWrite");
+    }
+    fclose(file);
+    return filename;
+}
+
+// Summarize sorted latencies (in seconds)
+static Json::Value latencySummary(const vector<double>& latencies)
+{
+    double total = 0;
+    for (unsigned int i = 0; i < latencies.size(); i++) {
+        total += latencies[i];
+    }
+    Json::Value summary;
+    summary["mean"] = total / latencies.size();
+    summary["p50"] = latencies[latencies.size() / 2];
+    summary["p90"] = latencies[min(static_cast<unsigned int>(latencies.size() * 0.9), static_cast<unsigned int>(latencies.size() - 1))];
+    summary["p99"] = latencies[min(static_cast<unsigned int>(latencies.size() * 0.99), static_cast<unsigned int>(latencies.size() - 1))];
+    summary["max"] = latencies.back();
+    return summary;
+}
+
+// Time iterations calls of fn after a warmup call, and append the results to results.
+static void runMicroBenchmark(Json::Value& results, const string& name, const Json::Value& params, double opsPerIteration, MicroBenchmarkFn fn, void* arg, unsigned int iterations)
+{
+    fn(arg, 0);
+    vector<double> latencies;
+    double totalTime = 0;
+    for (unsigned int iter = 1; iter <= iterations; iter++) {
+        uint64_t startTime = GetTime();
+        fn(arg, iter);
+        double latency = ConvertTimeToSeconds(GetTime() - startTime);
+        latencies.push_back(latency);
+        totalTime += latency;
+    }
+    sort(latencies.begin(), latencies.end());
+    Json::Value result;
+    result["name"] = Json::Value(name);
+    result["params"] = params;
+    result["iterations"] = Json::Value(iterations);
+    result["opsPerIteration"] = Json::Value(opsPerIteration);
+    result["throughput"] = Json::Value((totalTime > 0) ? (opsPerIteration * iterations / totalTime) : 0); // ops/sec
+    result["latency"] = latencySummary(latencies); // sec per iteration
+    results.append(result);
+    cerr << name << " " << Json::FastWriter().write(params); // progress
+}
+
+struct RbGenArgs {
+    ProcessedTrace* pTrace;
+    vector<double> rates;
+    vector<double> bursts;
+};
+
+static void rbGenFn(void* arg, unsigned int iteration)
+{
+    RbGenArgs* args = static_cast<RbGenArgs*>(arg);
+    rbGen(args->pTrace, args->rates, args->bursts);
+}
+
+static void calcArrivalCurveFn(void* arg, unsigned int iteration)
+{
+    RbGenArgs* args = static_cast<RbGenArgs*>(arg);
+    Curve arrivalCurve;
+    calcArrivalCurve(arrivalCurve, args->pTrace, MICRO_BENCHMARK_MAX_RATE);
+}
+
+struct PruneArgs {
+    Curve arrivalCurve; // unpruned
+    Curve scratch;
+};
+
+static void pruneArrivalCurveFn(void* arg, unsigned int iteration)
+{
+    PruneArgs* args = static_cast<PruneArgs*>(arg);
+    args->scratch = args->arrivalCurve;
+    pruneArrivalCurve(args->scratch, MICRO_BENCHMARK_PRUNE_POINTS);
+}
+
+struct EstimateWorkArgs {
+    Estimator* pEst;
+    vector<int> requestSizes;
+    vector<bool> isReadRequests;
+    double totalWork; // keeps the estimates from being optimized away
+};
+
+static void estimateWorkFn(void* arg, unsigned int iteration)
+{
+    EstimateWorkArgs* args = static_cast<EstimateWorkArgs*>(arg);
+    double totalWork = 0;
+    for (unsigned int i = 0; i < args->requestSizes.size(); i++) {
+        totalWork += args->pEst->estimateWork(args->requestSizes[i], args->isReadRequests[i]);
+    }
+    args->totalWork += totalWork;
+}
+
+struct NetworkArgs {
+    DNC* pDNC;
+    vector<FlowId> flowIds; // flows of first client group
+    vector<SimpleArrivalCurve> shaperCurves;
+    Curve arrivalCurves[2]; // alternated to re-optimize
+};
+
+static void aggregateAnalysisTwoHopFn(void* arg, unsigned int iteration)
+{
+    NetworkArgs* args = static_cast<NetworkArgs*>(arg);
+    // Alternate the burst of one flow so that it and the flows that depend on it are recalculated
+    unsigned int index = iteration % args->flowIds.size();
+    SimpleArrivalCurve shaperCurve = args->shaperCurves[index];
+    shaperCurve.b *= (iteration % 2 == 0) ? 1 : 1.01;
+    args->pDNC->setShaperCurve(args->flowIds[index], shaperCurve);
+    args->pDNC->calcAllLatency();
+}
+
+static void calcShaperParametersFn(void* arg, unsigned int iteration)
+{
+    NetworkArgs* args = static_cast<NetworkArgs*>(arg);
+    WorkloadCompactor* wc = static_cast<WorkloadCompactor*>(args->pDNC);
+    unsigned int index = iteration % args->flowIds.size();
+    wc->setArrivalCurve(args->flowIds[index], args->arrivalCurves[iteration % 2]);
+    wc->updateShaperParameters();
+}
+
+struct NCLookupArgs {
+    const NC* pNC;
+    vector<FlowId> flowIds; // all flows in a random order
+    map<FlowId, const Flow*> flows; // id -> flow, as NC previously looked up flows
+    map<QueueId, const Queue*> queues; // id -> queue, as NC previously looked up queues
+    vector<string> flowNames; // names of all flows in a random order
+    map<string, FlowId> flowIdsByName; // name -> flow id, as NC previously looked up names
+    double totalBandwidth; // keeps the lookups from being optimized away
+};
+
+// Look up each flow and its queues by id, as the latency analyses do
+static void ncLookupTableFn(void* arg, unsigned int iteration)
+{
+    NCLookupArgs* args = static_cast<NCLookupArgs*>(arg);
+    double totalBandwidth = 0;
+    for (unsigned int i = 0; i < args->flowIds.size(); i++) {
+        const Flow* f = args->pNC->getFlow(args->flowIds[i]);
+        for (unsigned int j = 0; j < f->queueIds.size(); j++) {
+            totalBandwidth += args->pNC->getQueue(f->queueIds[j])->bandwidth;
+        }
+    }
+    args->totalBandwidth += totalBandwidth;
+}
+
+static void ncLookupMapFn(void* arg, unsigned int iteration)
+{
+    NCLookupArgs* args = static_cast<NCLookupArgs*>(arg);
+    double totalBandwidth = 0;
+    for (unsigned int i = 0; i < args->flowIds.size(); i++) {
+        const Flow* f = args->flows.find(args->flowIds[i])->second;
+        for (unsigned int j = 0; j < f->queueIds.size(); j++) {
+            totalBandwidth += args->queues.find(f->queueIds[j])->second->bandwidth;
+        }
+    }
+    args->totalBandwidth += totalBandwidth;
+}
+
+// Look up each flow's id by name
+static void ncNameLookupHashFn(void* arg, unsigned int iteration)
+{
+    NCLookupArgs* args = static_cast<NCLookupArgs*>(arg);
+    double totalIds = 0;
+    for (unsigned int i = 0; i < args->flowNames.size(); i++) {
+        totalIds += args->pNC->getFlowIdByName(args->flowNames[i]);
+    }
+    args->totalBandwidth += totalIds;
+}
+
+static void ncNameLookupMapFn(void* arg, unsigned int iteration)
+{
+    NCLookupArgs* args = static_cast<NCLookupArgs*>(arg);
+    double totalIds = 0;
+    for (unsigned int i = 0; i < args->flowNames.size(); i++) {
+        totalIds += args->flowIdsByName.find(args->flowNames[i])->second;
+    }
+    args->totalBandwidth += totalIds;
+}
+
+// Compare NC's id lookups through its dense tables and name lookups through its hash tables against maps
+static void ncLookupMicroBenchmark(Json::Value& results, const Json::Value& params, const NC* pNC, unsigned int iterations)
+{
+    NCLookupArgs args;
+    args.pNC = pNC;
+    args.totalBandwidth = 0;
+    double numLookups = 0;
+    for (NC::FlowIterator it = pNC->flowsBegin(); it != pNC->flowsEnd(); it++) {
+        args.flowIds.push_back(it->first);
+        args.flows[it->first] = it->second;
+        args.flowNames.push_back(it->second->name);
+        args.flowIdsByName[it->second->name] = it->first;
+        numLookups += 1 + it->second->queueIds.size();
+    }
+    for (NC::QueueIterator it = pNC->queuesBegin(); it != pNC->queuesEnd(); it++) {
+        args.queues[it->first] = it->second;
+    }
+    uint64_t state = 1;
+    for (unsigned int i = args.flowIds.size(); i > 1; i--) {
+        swap(args.flowIds[i - 1], args.flowIds[nextRandom(state) % i]);
+        swap(args.flowNames[i - 1], args.flowNames[nextRandom(state) % i]);
+    }
+    runMicroBenchmark(results, "NC::getFlow/getQueue", params, numLookups, ncLookupTableFn, &args, iterations);
+    runMicroBenchmark(results, "map::find flows/queues", params, numLookups, ncLookupMapFn, &args, iterations);
+    runMicroBenchmark(results, "NC::getFlowIdByName", params, args.flowNames.size(), ncNameLookupHashFn, &args, iterations);
+    runMicroBenchmark(results, "map::find flow names", params, args.flowNames.size(), ncNameLookupMapFn, &args, iterations);
+}
+
+// Add numGroups client groups of clientGroupSize clients to pDNC, with about flowsPerQueue flows in each queue.
+// Each client has a flow through two queues of its group such that consecutive clients share a queue, so a group is connected
+// and does not share queues with other groups. Groups with flowsPerQueue >= 2 * clientGroupSize have a single queue.
+static void addClientGroups(DNC* pDNC, unsigned int numGroups, unsigned int clientGroupSize, unsigned int flowsPerQueue, const Curve& arrivalCurve, double rate, vector<FlowId>& firstGroupFlowIds)
+{
+    unsigned int numQueues = (2 * clientGroupSize + flowsPerQueue - 1) / flowsPerQueue;
+    if (numQueues == 2) {
+        numQueues = 1; // two queues with the same flows are equivalent to one queue
+    }
+    Json::Value arrivalInfo;
+    serializeJSON(arrivalInfo, "arrivalInfo", arrivalCurve);
+    for (unsigned int g = 0; g < numGroups; g++) {
+        for (unsigned int q = 0; q < numQueues; q++) {
+            Json::Value queueInfo;
+            ostringstream name;
+            name << "G" << g << "Q" << q;
+            queueInfo["name"] = Json::Value(name.str());
+            // Half utilized by the flows' average rate
+            queueInfo["bandwidth"] = Json::Value(2.0 * rate * ((numQueues == 1) ? clientGroupSize : flowsPerQueue));
+            pDNC->addQueue(queueInfo);
+        }
+        for (unsigned int c = 0; c < clientGroupSize; c++) {
+            Json::Value clientInfo;
+            ostringstream name;
+            name << "G" << g << "C" << c;
+            clientInfo["name"] = Json::Value(name.str());
+            clientInfo["SLO"] = Json::Value(0.1);
+            Json::Value& flowInfo = clientInfo["flows"][0];
+            flowInfo["name"] = Json::Value(name.str() + "F0");
+            flowInfo["priority"] = Json::Value(c % 4);
+            flowInfo["arrivalInfo"] = arrivalInfo["arrivalInfo"];
+            ostringstream q0;
+            q0 << "G" << g << "Q" << (c % numQueues);
+            flowInfo["queues"].append(Json::Value(q0.str()));
+            if (numQueues > 1) {
+                ostringstream q1;
+                q1 << "G" << g << "Q" << ((c + 1) % numQueues);
+                flowInfo["queues"].append(Json::Value(q1.str()));
+            }
+            ClientId clientId = pDNC->addClient(clientInfo);
+            if (g == 0) {
+                firstGroupFlowIds.push_back(pDNC->getClient(clientId)->flowIds.front());
+            }
+        }
+    }
+}
+
+// Count the entries of a trace
+static unsigned int traceLength(ProcessedTrace* pTrace)
+{
+    unsigned int numEntries = 0;
+    ProcessedTraceEntry traceEntry;
+    pTrace->reset();
+    while (pTrace->nextEntry(traceEntry)) {
+        numEntries++;
+    }
+    return numEntries;
+}
+
+// Benchmarks on a trace: rbGen, calcArrivalCurve, and pruneArrivalCurve
+static void traceMicroBenchmarks(Json::Value& results, const string& traceName, const string& traceFilename, const vector<unsigned int>& numRatesList, unsigned int iterations, Curve& arrivalCurve, double& rate)
+{
+    // Use a unit network estimator so that work is measured in bytes
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value("networkIn");
+    estimatorInfo["nonDataConstant"] = Json::Value(0.0);
+    estimatorInfo["nonDataFactor"] = Json::Value(1.0);
+    estimatorInfo["dataConstant"] = Json::Value(0.0);
+    estimatorInfo["dataFactor"] = Json::Value(1.0);
+    RbGenArgs args;
+    args.pTrace = ProcessedTrace::create(traceFilename, Estimator::create(estimatorInfo), TRACE_READER_LOAD);
+    unsigned int numEntries = traceLength(args.pTrace);
+    if (numEntries == 0) {
+        cerr << "Empty trace file " << traceFilename << endl;
+        delete args.pTrace;
+        return;
+    }
+    Json::Value params;
+    params["trace"] = Json::Value(traceName);
+    params["traceLength"] = Json::Value(numEntries);
+    for (unsigned int i = 0; i < numRatesList.size(); i++) {
+        unsigned int numRates = numRatesList[i];
+        args.rates.clear();
+        for (unsigned int r = 0; r < numRates; r++) {
+            args.rates.push_back(MICRO_BENCHMARK_MAX_RATE - r * (MICRO_BENCHMARK_MAX_RATE / numRates));
+        }
+        params["numRates"] = Json::Value(numRates);
+        runMicroBenchmark(results, "rbGen", params, (double)numEntries * numRates, rbGenFn, &args, iterations);
+
+        PruneArgs pruneArgs;
+        rbCurveToArrivalCurve(pruneArgs.arrivalCurve, args.rates, args.bursts);
+        runMicroBenchmark(results, "pruneArrivalCurve", params, pruneArgs.arrivalCurve.size(), pruneArrivalCurveFn, &pruneArgs, iterations);
+    }
+    params.removeMember("numRates");
+    runMicroBenchmark(results, "calcArrivalCurve", params, 1, calcArrivalCurveFn, &args, iterations);
+
+    // Arrival curve and average rate of the trace for the network benchmarks
+    calcArrivalCurve(arrivalCurve, args.pTrace, MICRO_BENCHMARK_MAX_RATE);
+    arrivalCurve.erase(arrivalCurve.begin()); // initial point is added by DNC
+    rate = calcMinRate(args.pTrace);
+    delete args.pTrace;
+}
+
+// Benchmark StorageSSDEstimator::estimateWork on a mix of aligned and unaligned request sizes
+static void estimateWorkMicroBenchmark(Json::Value& results, unsigned int iterations)
+{
+    // Storage profile with power of two request sizes from 512 B to 1 MB, as in processedTraceBenchmark
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value("storageSSD");
+    Json::Value& bwTable = estimatorInfo["bandwidthTable"];
+    for (unsigned int i = 0; i <= 11; i++) {
+        bwTable[i]["requestSize"] = Json::Value(512 << i);
+        bwTable[i]["readBandwidth"] = Json::Value(5000000.0 * (i + 1));
+        bwTable[i]["writeBandwidth"] = Json::Value(1000000.0 * (i + 1));
+    }
+    EstimateWorkArgs args;
+    args.pEst = Estimator::create(estimatorInfo);
+    args.totalWork = 0;
+    uint64_t state = 1;
+    for (unsigned int i = 0; i < MICRO_BENCHMARK_ESTIMATES; i++) {
+        int requestSize = 512 * (1 + (nextRandom(state) % 512));
+        if ((i % 4) == 0) {
+            requestSize += nextRandom(state) % 512; // unaligned
+        }
+        args.requestSizes.push_back(requestSize);
+        args.isReadRequests.push_back((i % 3) != 0);
+    }
+    Json::Value params;
+    params["type"] = estimatorInfo["type"];
+    runMicroBenchmark(results, "StorageSSDEstimator::estimateWork", params, MICRO_BENCHMARK_ESTIMATES, estimateWorkFn, &args, iterations);
+    delete args.pEst;
+}
+
+void microBenchmark(string jsonFilename, const vector<string>& traceFilenames, const vector<unsigned int>& traceLengths, const vector<unsigned int>& numRatesList,
+                    const vector<unsigned int>& flowsPerQueueList, const vector<unsigned int>& clientGroupSizes, unsigned int numGroups, unsigned int iterations)
+{
+    Json::Value root;
+    Json::Value& config = root["config"];
+    config["iterations"] = Json::Value(iterations);
+    config["numGroups"] = Json::Value(numGroups);
+    config["numCores"] = Json::Value(numCores());
+    Json::Value& results = root["benchmarks"];
+    results = Json::Value(Json::arrayValue);
+
+    // Traces: generated traces of each length, then trace files
+    vector<string> traceNames;
+    vector<string> traceFiles;
+    vector<bool> generated;
+    for (unsigned int i = 0; i < traceLengths.size(); i++) {
+        string filename = generateTrace(traceLengths[i], i + 1);
+        if (filename.empty()) {
+            continue;
+        }
+        ostringstream name;
+        name << "generated" << traceLengths[i];
+        traceNames.push_back(name.str());
+        traceFiles.push_back(filename);
+        generated.push_back(true);
+    }
+    for (unsigned int i = 0; i < traceFilenames.size(); i++) {
+        traceNames.push_back(traceFilenames[i]);
+        traceFiles.push_back(traceFilenames[i]);
+        generated.push_back(false);
+    }
+
+    Curve arrivalCurve;
+    Curve altArrivalCurve;
+    double rate = 0;
+    for (unsigned int t = 0; t < traceFiles.size(); t++) {
+        Curve traceArrivalCurve;
+        double traceRate = 0;
+        traceMicroBenchmarks(results, traceNames[t], traceFiles[t], numRatesList, iterations, traceArrivalCurve, traceRate);
+        // The first two traces' arrival curves are used for the network benchmarks
+        if (!traceArrivalCurve.empty()) {
+            if (arrivalCurve.empty()) {
+                arrivalCurve = traceArrivalCurve;
+                rate = traceRate;
+            } else if (altArrivalCurve.empty()) {
+                altArrivalCurve = traceArrivalCurve;
+            }
+        }
+        if (generated[t]) {
+            unlink(traceFiles[t].c_str());
+        }
+    }
+    estimateWorkMicroBenchmark(results, iterations);
+
+    // Network benchmarks on client groups
+    if (altArrivalCurve.empty()) {
+        altArrivalCurve = arrivalCurve;
+    }
+    for (unsigned int i = 0; !arrivalCurve.empty() && (i < flowsPerQueueList.size()); i++) {
+        for (unsigned int j = 0; j < clientGroupSizes.size(); j++) {
+            Json::Value params;
+            params["flowsPerQueue"] = Json::Value(flowsPerQueueList[i]);
+            params["clientGroupSize"] = Json::Value(clientGroupSizes[j]);
+
+            NetworkArgs args;
+            DNC dnc;
+            args.pDNC = &dnc;
+            addClientGroups(&dnc, numGroups, clientGroupSizes[j], flowsPerQueueList[i], arrivalCurve, rate, args.flowIds);
+            // Shaper curves with the flows' average rate and a burst of 10 ms at the max rate
+            for (NC::FlowIterator it = dnc.flowsBegin(); it != dnc.flowsEnd(); it++) {
+                SimpleArrivalCurve shaperCurve;
+                shaperCurve.r = rate;
+                shaperCurve.b = 0.01 * MICRO_BENCHMARK_MAX_RATE;
+                dnc.setShaperCurve(it->first, shaperCurve);
+            }
+            for (unsigned int f = 0; f < args.flowIds.size(); f++) {
+                args.shaperCurves.push_back(dnc.getShaperCurve(args.flowIds[f]));
+            }
+            dnc.calcAllLatency();
+            runMicroBenchmark(results, "aggregateAnalysisTwoHop", params, 1, aggregateAnalysisTwoHopFn, &args, iterations);
+            ncLookupMicroBenchmark(results, params, &dnc, iterations);
+
+            NetworkArgs wcArgs;
+            WorkloadCompactor wc;
+            wcArgs.pDNC = &wc;
+            wcArgs.arrivalCurves[0] = arrivalCurve;
+            wcArgs.arrivalCurves[0].insert(wcArgs.arrivalCurves[0].begin(), PointSlope(0, 0, numeric_limits<double>::infinity()));
+            wcArgs.arrivalCurves[1] = altArrivalCurve;
+            wcArgs.arrivalCurves[1].insert(wcArgs.arrivalCurves[1].begin(), PointSlope(0, 0, numeric_limits<double>::infinity()));
+            addClientGroups(&wc, numGroups, clientGroupSizes[j], flowsPerQueueList[i], arrivalCurve, rate, wcArgs.flowIds);
+            wc.updateShaperParameters();
+            runMicroBenchmark(results, "calcShaperParameters", params, 1, calcShaperParametersFn, &wcArgs, iterations);
+        }
+    }
+
+    // Output results
+    if (jsonFilename == "-") {
+        cout << root;
+    } else {
+        writeJson(jsonFilename, root);
+    }
+}
@@ -0,0 +1,88 @@
+// processedTraceBenchmark.cpp - Benchmark for converting traces into work.
+// Compares the generic ProcessedTrace, which estimates work through the Estimator's virtual interface,
+// against the ProcessedTrace specialized on the estimator type by ProcessedTrace::create.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "../common/time.hpp"
+#include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/ProcessedTrace.hpp"
+#include "DNC-LibraryBenchmark.hpp"
+
+using namespace std;
+
+// Number of entries read per nextEntries call; matches the arrival curve generation block size.
+#define PROCESSED_TRACE_BENCHMARK_BLOCK_SIZE 65536
+
+// Time a full pass over the trace, and store the total work to check the results.
+static double timeProcessedTrace(ProcessedTrace* pTrace, vector<ProcessedTraceEntry>& entries, double& totalWork)
+{
+    pTrace->reset();
+    totalWork = 0;
+    unsigned int count;
+    uint64_t startTime = GetTime();
+    while ((count = pTrace->nextEntries(&entries[0], entries.size())) > 0) {
+        for (unsigned int i = 0; i < count; i++) {
+            totalWork += entries[i].work;
+        }
+    }
+    return ConvertTimeToSeconds(GetTime() - startTime);
+}
+
+static void processedTraceBenchmark(string traceFilename, unsigned int iterations, const Json::Value& estimatorInfo)
+{
+    ProcessedTrace* pGenericTrace = new ProcessedTrace(traceFilename, Estimator::create(estimatorInfo), TRACE_READER_LOAD);
+    ProcessedTrace* pSpecializedTrace = ProcessedTrace::create(traceFilename, Estimator::create(estimatorInfo), TRACE_READER_LOAD);
+    vector<ProcessedTraceEntry> entries(PROCESSED_TRACE_BENCHMARK_BLOCK_SIZE);
+    double genericTime = 0;
+    double specializedTime = 0;
+    bool match = true;
+    for (unsigned int iter = 0; iter < iterations; iter++) {
+        double genericWork;
+        double specializedWork;
+        genericTime += timeProcessedTrace(pGenericTrace, entries, genericWork);
+        specializedTime += timeProcessedTrace(pSpecializedTrace, entries, specializedWork);
+        if (genericWork != specializedWork) {
+            match = false;
+        }
+    }
+    genericTime /= iterations;
+    specializedTime /= iterations;
+    cout << "  " << estimatorInfo["type"].asString() << ":" << endl;
+    cout << "    generic:     " << genericTime << " s" << endl;
+    cout << "    specialized: " << specializedTime << " s" << endl;
+    cout << "    speedup: " << (genericTime / specializedTime) << "x" << (match ? "" : " (MISMATCH)") << endl;
+    delete pGenericTrace;
+    delete pSpecializedTrace;
+}
+
+void processedTraceBenchmark(string traceFilename, unsigned int iterations)
+{
+    cout << "ProcessedTrace:" << endl;
+    Json::Value estimatorInfo;
+    estimatorInfo["nonDataConstant"] = Json::Value(100.0);
+    estimatorInfo["nonDataFactor"] = Json::Value(0.01);
+    estimatorInfo["dataConstant"] = Json::Value(100.0);
+    estimatorInfo["dataFactor"] = Json::Value(1.01);
+    estimatorInfo["type"] = Json::Value("networkIn");
+    processedTraceBenchmark(traceFilename, iterations, estimatorInfo);
+    estimatorInfo["type"] = Json::Value("networkOut");
+    processedTraceBenchmark(traceFilename, iterations, estimatorInfo);
+    // Storage profile with power of two request sizes from 512 B to 1 MB
+    Json::Value storageEstimatorInfo;
+    storageEstimatorInfo["type"] = Json::Value("storageSSD");
+    Json::Value& bwTable = storageEstimatorInfo["bandwidthTable"];
+    for (unsigned int i = 0; i <= 11; i++) {
+        int requestSize = 512 << i;
+        bwTable[i]["requestSize"] = Json::Value(requestSize);
+        bwTable[i]["readBandwidth"] = Json::Value(5000000.0 * (i + 1));
+        bwTable[i]["writeBandwidth"] = Json::Value(1000000.0 * (i + 1));
+    }
+    processedTraceBenchmark(traceFilename, iterations, storageEstimatorInfo);
+}
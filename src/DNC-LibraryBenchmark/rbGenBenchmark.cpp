@@ -0,0 +1,233 @@
+// rbGenBenchmark.cpp - Benchmark for r-b curve generation.
+// Compares the array-based rbGen against the original map-based implementation,
+// the scalar rbGen kernel against the vector kernels of each instruction set the CPU supports,
+// single-threaded against parallel arrival curve generation,
+// serial against segment-parallel r-b curve generation for a few rates,
+// and exhaustive against adaptive rate sampling.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <json/json.h>
+#include "../common/time.hpp"
+#include "../common/ThreadPool.hpp"
+#include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/ProcessedTrace.hpp"
+#include "../DNC-Library/DNC.hpp"
+#include "DNC-LibraryBenchmark.hpp"
+
+using namespace std;
+
+// Original map-based rbGen implementation used as the baseline.
+static void rbGenMap(ProcessedTrace* pTrace, const vector<double>& rates, map<double, double>& bursts)
+{
+    map<double, double> virtualBucket;
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        double rate = rates[i];
+        virtualBucket[rate] = 0;
+        bursts[rate] = 0;
+    }
+    pTrace->reset();
+    uint64_t prevTimestamp = 0;
+    ProcessedTraceEntry traceEntry;
+    while (pTrace->nextEntry(traceEntry)) {
+        double interarrival = ConvertTimeToSeconds(traceEntry.arrivalTime - prevTimestamp);
+        for (unsigned int i = 0; i < rates.size(); i++) {
+            double rate = rates[i];
+            virtualBucket[rate] -= rate * interarrival;
+            if (virtualBucket[rate] < 0) {
+                virtualBucket[rate] = 0;
+            }
+            virtualBucket[rate] += traceEntry.work;
+            if (virtualBucket[rate] > bursts[rate]) {
+                bursts[rate] = virtualBucket[rate];
+            }
+        }
+        prevTimestamp = traceEntry.arrivalTime;
+    }
+}
+
+// Value of an arrival curve at x > 0.
+static double evalArrivalCurve(const Curve& arrivalCurve, double x)
+{
+    unsigned int index = 1;
+    while (((index + 1) < arrivalCurve.size()) && (arrivalCurve[index + 1].x <= x)) {
+        index++;
+    }
+    const PointSlope& p = arrivalCurve[index];
+    return p.y + (x - p.x) * p.slope;
+}
+
+void rbGenBenchmark(string traceFilename, unsigned int numRates, unsigned int iterations)
+{
+    // Use a unit network estimator so that work is measured in bytes
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value("networkIn");
+    estimatorInfo["nonDataConstant"] = Json::Value(0.0);
+    estimatorInfo["nonDataFactor"] = Json::Value(1.0);
+    estimatorInfo["dataConstant"] = Json::Value(0.0);
+    estimatorInfo["dataFactor"] = Json::Value(1.0);
+    ProcessedTrace* pTrace = ProcessedTrace::create(traceFilename, Estimator::create(estimatorInfo));
+    // Count entries
+    unsigned int numEntries = 0;
+    ProcessedTraceEntry traceEntry;
+    pTrace->reset();
+    while (pTrace->nextEntry(traceEntry)) {
+        numEntries++;
+    }
+    if (numEntries == 0) {
+        cerr << "Empty trace file " << traceFilename << endl;
+        delete pTrace;
+        return;
+    }
+    // Sweep rates in the same manner as calcArrivalCurve
+    double maxRate = 125000000;
+    vector<double> rates;
+    for (unsigned int i = 0; i < numRates; i++) {
+        rates.push_back(maxRate - i * (maxRate / numRates));
+    }
+
+    double mapTime = 0;
+    double arrayTime = 0;
+    bool match = true;
+    for (unsigned int iter = 0; iter < iterations; iter++) {
+        map<double, double> mapBursts;
+        uint64_t startTime = GetTime();
+        rbGenMap(pTrace, rates, mapBursts);
+        mapTime += ConvertTimeToSeconds(GetTime() - startTime);
+
+        vector<double> arrayBursts;
+        startTime = GetTime();
+        rbGen(pTrace, rates, arrayBursts);
+        arrayTime += ConvertTimeToSeconds(GetTime() - startTime);
+
+        for (unsigned int i = 0; i < rates.size(); i++) {
+            if (mapBursts[rates[i]] != arrayBursts[i]) {
+                match = false;
+            }
+        }
+    }
+    mapTime /= iterations;
+    arrayTime /= iterations;
+
+    cout << "rbGen: " << numEntries << " entries, " << numRates << " rates" << endl;
+    cout << "  map:   " << mapTime << " s (" << (numEntries * (double)numRates / mapTime) << " updates/s)" << endl;
+    cout << "  array: " << arrayTime << " s (" << (numEntries * (double)numRates / arrayTime) << " updates/s)" << endl;
+    cout << "  speedup: " << (mapTime / arrayTime) << "x" << (match ? "" : " (MISMATCH)") << endl;
+
+    // Compare the kernels of each instruction set supported by the CPU
+    string defaultISA = getRbGenISA();
+    const char* isas[3] = {"scalar", "avx2", "avx512f"};
+    double scalarTime = 0;
+    vector<double> scalarBursts;
+    cout << "rbGen kernels:" << endl;
+    for (unsigned int i = 0; i < 3; i++) {
+        if (!setRbGenISA(isas[i])) {
+            continue;
+        }
+        double kernelTime = 0;
+        bool kernelMatch = true;
+        for (unsigned int iter = 0; iter < iterations; iter++) {
+            vector<double> bursts;
+            uint64_t startTime = GetTime();
+            rbGen(pTrace, rates, bursts);
+            kernelTime += ConvertTimeToSeconds(GetTime() - startTime);
+            if (i == 0) {
+                scalarBursts = bursts;
+            } else if (bursts != scalarBursts) {
+                kernelMatch = false;
+            }
+        }
+        kernelTime /= iterations;
+        if (i == 0) {
+            scalarTime = kernelTime;
+        }
+        cout << "  " << isas[i] << ": " << kernelTime << " s (" << (numEntries * (double)numRates / kernelTime) << " updates/s), speedup "
+             << (scalarTime / kernelTime) << "x" << (kernelMatch ? "" : " (MISMATCH)") << endl;
+    }
+    setRbGenISA(defaultISA);
+
+    // Compare single-threaded and parallel arrival curve generation
+    vector<ProcessedTrace*> pTraces(1, pTrace);
+    vector<double> maxRates(1, maxRate);
+    double serialTime = 0;
+    double parallelTime = 0;
+    for (unsigned int iter = 0; iter < iterations; iter++) {
+        vector<Curve> arrivalCurves;
+        uint64_t startTime = GetTime();
+        calcArrivalCurves(arrivalCurves, pTraces, maxRates, 1);
+        serialTime += ConvertTimeToSeconds(GetTime() - startTime);
+        startTime = GetTime();
+        calcArrivalCurves(arrivalCurves, pTraces, maxRates);
+        parallelTime += ConvertTimeToSeconds(GetTime() - startTime);
+    }
+    serialTime /= iterations;
+    parallelTime /= iterations;
+    cout << "calcArrivalCurve:" << endl;
+    cout << "  1 thread:  " << serialTime << " s" << endl;
+    cout << "  " << numCores() << " threads: " << parallelTime << " s" << endl;
+
+    // Compare serial and segment-parallel rbGen for a few rates, which are too few to split across threads
+    vector<double> fewRates;
+    for (unsigned int i = 0; i < 4; i++) {
+        fewRates.push_back(maxRate - i * (maxRate / 4));
+    }
+    double rbGenTime = 0;
+    double segmentedTime = 0;
+    double maxBurstError = 0;
+    for (unsigned int iter = 0; iter < iterations; iter++) {
+        vector<double> serialBursts;
+        uint64_t startTime = GetTime();
+        rbGen(pTrace, fewRates, serialBursts);
+        rbGenTime += ConvertTimeToSeconds(GetTime() - startTime);
+        vector<double> segmentedBursts;
+        startTime = GetTime();
+        rbGenSegmented(pTrace, fewRates, segmentedBursts);
+        segmentedTime += ConvertTimeToSeconds(GetTime() - startTime);
+        for (unsigned int i = 0; i < fewRates.size(); i++) {
+            maxBurstError = max(maxBurstError, fabs(segmentedBursts[i] - serialBursts[i]) / max(1.0, serialBursts[i]));
+        }
+    }
+    rbGenTime /= iterations;
+    segmentedTime /= iterations;
+    cout << "segmented rbGen (" << fewRates.size() << " rates):" << endl;
+    cout << "  serial:    " << rbGenTime << " s" << endl;
+    cout << "  " << numCores() << " threads: " << segmentedTime << " s" << endl;
+    cout << "  speedup: " << (rbGenTime / segmentedTime) << "x, max relative error " << maxBurstError << endl;
+
+    // Compare exhaustive and adaptive rate sampling; curves are not pruned so that the error can be measured
+    double tolerance = 0.01;
+    double exhaustiveTime = 0;
+    double adaptiveTime = 0;
+    vector<Curve> exhaustiveArrivalCurves;
+    vector<Curve> adaptiveArrivalCurves;
+    for (unsigned int iter = 0; iter < iterations; iter++) {
+        uint64_t startTime = GetTime();
+        calcArrivalCurves(exhaustiveArrivalCurves, pTraces, maxRates, 0, 0, 0);
+        exhaustiveTime += ConvertTimeToSeconds(GetTime() - startTime);
+        startTime = GetTime();
+        calcArrivalCurves(adaptiveArrivalCurves, pTraces, maxRates, 0, tolerance, 0);
+        adaptiveTime += ConvertTimeToSeconds(GetTime() - startTime);
+    }
+    exhaustiveTime /= iterations;
+    adaptiveTime /= iterations;
+    // Measure the max relative error on a log scale of latencies
+    double maxError = 0;
+    for (double x = 1e-6; x < 100; x *= 1.01) {
+        double exhaustive = evalArrivalCurve(exhaustiveArrivalCurves[0], x);
+        double adaptive = evalArrivalCurve(adaptiveArrivalCurves[0], x);
+        maxError = max(maxError, (adaptive - exhaustive) / exhaustive);
+    }
+    cout << "adaptive calcArrivalCurve (tolerance " << tolerance << "):" << endl;
+    cout << "  exhaustive: " << exhaustiveTime << " s (" << exhaustiveArrivalCurves[0].size() << " points)" << endl;
+    cout << "  adaptive:   " << adaptiveTime << " s (" << adaptiveArrivalCurves[0].size() << " points)" << endl;
+    cout << "  speedup: " << (exhaustiveTime / adaptiveTime) << "x, max error " << maxError << endl;
+
+    delete pTrace;
+}
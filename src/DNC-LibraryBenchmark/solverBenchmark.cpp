@@ -0,0 +1,92 @@
+// solverBenchmark.cpp - Benchmark for LP solver backends.
+// Replays LPs captured by SolverRecorder (e.g., from AdmissionController -c) on each registered solver backend,
+// and compares solve latency and objective values against the first backend.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../common/time.hpp"
+#include "../DNC-Library/Solver.hpp"
+#include "../DNC-Library/SolverRecorder.hpp"
+#include "DNC-LibraryBenchmark.hpp"
+
+using namespace std;
+
+void solverBenchmark(string lpFilename, unsigned int iterations)
+{
+    vector<CapturedLP> lps;
+    if (!readCapturedLPs(lps, lpFilename)) {
+        return;
+    }
+    if (lps.empty()) {
+        cerr << "No LPs in " << lpFilename << endl;
+        return;
+    }
+    unsigned int numVariables = 0;
+    unsigned int numConstraints = 0;
+    for (unsigned int i = 0; i < lps.size(); i++) {
+        numVariables += lps[i].lbs.size();
+        numConstraints += lps[i].constraints.size();
+    }
+    cout << "solve: " << lps.size() << " LPs, " << (numVariables / (double)lps.size()) << " variables and "
+         << (numConstraints / (double)lps.size()) << " constraints on average" << endl;
+
+    vector<string> solverNames = getSolverNames();
+    // Objective values of the first backend, used to check the other backends
+    vector<double> referenceSolutions;
+    vector<bool> referenceSolved;
+    for (unsigned int solverIndex = 0; solverIndex < solverNames.size(); solverIndex++) {
+        const string& solverName = solverNames[solverIndex];
+        vector<double> solveTimes;
+        double loadTime = 0;
+        unsigned int numFailed = 0;
+        bool match = true;
+        for (unsigned int iter = 0; iter < iterations; iter++) {
+            for (unsigned int i = 0; i < lps.size(); i++) {
+                Solver* s = createSolver(solverName);
+                vector<VariableHandle> vars;
+                uint64_t startTime = GetTime();
+                lps[i].load(*s, vars);
+                uint64_t loadedTime = GetTime();
+                bool solved = s->solve();
+                uint64_t endTime = GetTime();
+                loadTime += ConvertTimeToSeconds(loadedTime - startTime);
+                solveTimes.push_back(ConvertTimeToSeconds(endTime - loadedTime));
+                double solution = solved ? s->getSolution() : 0;
+                if (iter == 0) {
+                    if (!solved) {
+                        numFailed++;
+                    }
+                    if (solverIndex == 0) {
+                        referenceSolutions.push_back(solution);
+                        referenceSolved.push_back(solved);
+                    } else if ((solved != referenceSolved[i]) ||
+                               (solved && (fabs(solution - referenceSolutions[i]) > 1e-6 * max(1.0, fabs(referenceSolutions[i]))))) {
+                        match = false;
+                    }
+                }
+                delete s;
+            }
+        }
+        sort(solveTimes.begin(), solveTimes.end());
+        double totalTime = 0;
+        for (unsigned int i = 0; i < solveTimes.size(); i++) {
+            totalTime += solveTimes[i];
+        }
+        double meanTime = totalTime / solveTimes.size();
+        double p50Time = solveTimes[solveTimes.size() / 2];
+        double p99Time = solveTimes[min(static_cast<unsigned int>(solveTimes.size() * 0.99), static_cast<unsigned int>(solveTimes.size() - 1))];
+        cout << "  " << solverName << ": mean " << meanTime << " s, p50 " << p50Time << " s, p99 " << p99Time << " s, max " << solveTimes.back()
+             << " s (load " << (loadTime / solveTimes.size()) << " s)";
+        if (numFailed > 0) {
+            cout << ", " << numFailed << " unsolved";
+        }
+        cout << (match ? "" : " (MISMATCH)") << endl;
+    }
+}
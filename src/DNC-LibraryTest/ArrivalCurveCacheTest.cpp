@@ -0,0 +1,151 @@
+// ArrivalCurveCacheTest.cpp - ArrivalCurveCache test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <json/json.h>
+#include "../DNC-Library/ArrivalCurveCache.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+static const char* cacheFilename = "testArrivalCurveCache.bin";
+
+static bool curvesEqual(const Curve& c1, const Curve& c2)
+{
+    if (c1.size() != c2.size()) {
+        return false;
+    }
+    for (unsigned int i = 0; i < c1.size(); i++) {
+        if ((c1[i].x != c2[i].x) || (c1[i].y != c2[i].y) || (c1[i].slope != c2[i].slope)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void setEstimatorInfoArrivalCurveCacheTest(Json::Value& estimatorInfo, double dataFactor)
+{
+    estimatorInfo["type"] = Json::Value("networkIn");
+    estimatorInfo["nonDataConstant"] = Json::Value(1.0);
+    estimatorInfo["nonDataFactor"] = Json::Value(0.0);
+    estimatorInfo["dataConstant"] = Json::Value(1.0);
+    estimatorInfo["dataFactor"] = Json::Value(dataFactor);
+}
+
+void ArrivalCurveCacheTest()
+{
+    unlink(cacheFilename);
+    Json::Value estimatorInfo1;
+    setEstimatorInfoArrivalCurveCacheTest(estimatorInfo1, 1.0);
+    Json::Value estimatorInfo2;
+    setEstimatorInfoArrivalCurveCacheTest(estimatorInfo2, 2.0);
+    Curve c1;
+    c1.push_back(PointSlope(0, 0, numeric_limits<double>::infinity()));
+    c1.push_back(PointSlope(0, 10.5, 3.25));
+    c1.push_back(PointSlope(1.0 / 3.0, 11.583, 1.0 / 7.0));
+    Curve c2;
+    c2.push_back(PointSlope(0, 0, numeric_limits<double>::infinity()));
+    c2.push_back(PointSlope(0, 20, 1));
+    Curve c;
+
+    // Keys depend on estimator config and max rate
+    {
+        ArrivalCurveCache cache(cacheFilename);
+        assert(!cache.get(c, "testTrace.txt", estimatorInfo1, 10));
+        cache.put(c1, "testTrace.txt", estimatorInfo1, 10);
+        assert(cache.get(c, "testTrace.txt", estimatorInfo1, 10));
+        assert(curvesEqual(c, c1));
+        assert(!cache.get(c, "testTrace.txt", estimatorInfo1, 20));
+        assert(!cache.get(c, "testTrace.txt", estimatorInfo2, 10));
+    }
+    // Curves persist across caches, and caches see curves added by other caches
+    {
+        ArrivalCurveCache cache1(cacheFilename);
+        ArrivalCurveCache cache2(cacheFilename);
+        assert(cache1.get(c, "testTrace.txt", estimatorInfo1, 10));
+        assert(curvesEqual(c, c1));
+        assert(!cache1.get(c, "testTrace.txt", estimatorInfo2, 10));
+        cache2.put(c2, "testTrace.txt", estimatorInfo2, 10);
+        assert(cache1.get(c, "testTrace.txt", estimatorInfo2, 10));
+        assert(curvesEqual(c, c2));
+    }
+    // Partial records left by an interrupted writer are ignored and overwritten
+    {
+        FILE* file = fopen(cacheFilename, "ab");
+        assert(file != NULL);
+        ArrivalCurveRecordHeader header;
+        header.hash = 1;
+        header.traceHash = 1;
+        header.traceSize = 1;
+        header.maxRate = 1;
+        header.estimatorConfigSize = 0;
+        header.numPoints = 100;
+        assert(fwrite(&header, sizeof(header), 1, file) == 1);
+        fclose(file);
+        ArrivalCurveCache cache1(cacheFilename);
+        assert(cache1.get(c, "testTrace.txt", estimatorInfo1, 10));
+        assert(curvesEqual(c, c1));
+        cache1.put(c2, "testTrace.txt", estimatorInfo1, 30);
+        ArrivalCurveCache cache2(cacheFilename);
+        assert(cache2.get(c, "testTrace.txt", estimatorInfo1, 30));
+        assert(curvesEqual(c, c2));
+        assert(cache2.get(c, "testTrace.txt", estimatorInfo2, 10));
+        assert(curvesEqual(c, c2));
+    }
+    // A record whose hash matches but whose full key differs (i.e., a hash collision) is a miss
+    {
+        unlink(cacheFilename);
+        {
+            ArrivalCurveCache cache(cacheFilename);
+            cache.put(c1, "testTrace.txt", estimatorInfo1, 10);
+        }
+        int fd = open(cacheFilename, O_RDWR);
+        assert(fd >= 0);
+        char config = ' ';
+        assert(pwrite(fd, &config, 1, ARRIVAL_CURVE_CACHE_MAGIC_SIZE + sizeof(ArrivalCurveRecordHeader)) == 1);
+        close(fd);
+        ArrivalCurveCache cache1(cacheFilename);
+        assert(!cache1.get(c, "testTrace.txt", estimatorInfo1, 10));
+        cache1.put(c2, "testTrace.txt", estimatorInfo1, 10);
+        ArrivalCurveCache cache2(cacheFilename);
+        assert(cache2.get(c, "testTrace.txt", estimatorInfo1, 10));
+        assert(curvesEqual(c, c2));
+    }
+    // A store from an older version is replaced
+    {
+        FILE* file = fopen(cacheFilename, "wb");
+        assert(file != NULL);
+        assert(fwrite("WCCURVE1", ARRIVAL_CURVE_CACHE_MAGIC_SIZE, 1, file) == 1);
+        fclose(file);
+        ArrivalCurveCache cache1(cacheFilename);
+        assert(!cache1.get(c, "testTrace.txt", estimatorInfo1, 10));
+        cache1.put(c1, "testTrace.txt", estimatorInfo1, 10);
+        ArrivalCurveCache cache2(cacheFilename);
+        assert(cache2.get(c, "testTrace.txt", estimatorInfo1, 10));
+        assert(curvesEqual(c, c1));
+    }
+    // In-memory LRU evicts the least recently used curve
+    {
+        ArrivalCurveCache cache("", 2);
+        cache.put(c1, "testTrace.txt", estimatorInfo1, 1);
+        cache.put(c1, "testTrace.txt", estimatorInfo1, 2);
+        assert(cache.get(c, "testTrace.txt", estimatorInfo1, 1));
+        cache.put(c2, "testTrace.txt", estimatorInfo1, 3);
+        assert(cache.size() == 2);
+        assert(cache.get(c, "testTrace.txt", estimatorInfo1, 1));
+        assert(curvesEqual(c, c1));
+        assert(!cache.get(c, "testTrace.txt", estimatorInfo1, 2));
+        assert(cache.get(c, "testTrace.txt", estimatorInfo1, 3));
+        assert(curvesEqual(c, c2));
+    }
+    unlink(cacheFilename);
+    cout << "PASS ArrivalCurveCacheTest" << endl;
+}
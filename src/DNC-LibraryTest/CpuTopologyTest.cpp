@@ -0,0 +1,85 @@
+// CpuTopologyTest.cpp - CpuTopology test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../common/CpuTopology.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+static void CpuTopologyTestWriteFile(const string& filename, const string& contents)
+{
+    ofstream file(filename.c_str());
+    file << contents << endl;
+    assert(file.good());
+}
+
+void CpuTopologyTest()
+{
+    // Parse CPU lists
+    {
+        vector<int> cpus;
+        assert(CpuTopology::parseCpuList("0-3,8,10-11\n", cpus));
+        assert(cpus.size() == 7);
+        assert((cpus[0] == 0) && (cpus[3] == 3) && (cpus[4] == 8) && (cpus[5] == 10) && (cpus[6] == 11));
+        assert(CpuTopology::parseCpuList("5", cpus));
+        assert((cpus.size() == 1) && (cpus[0] == 5));
+        assert(CpuTopology::parseCpuList("", cpus));
+        assert(cpus.empty());
+        assert(!CpuTopology::parseCpuList("3-1", cpus));
+        assert(!CpuTopology::parseCpuList("0-", cpus));
+        assert(!CpuTopology::parseCpuList("0;1", cpus));
+    }
+    // Read nodes from sysfs, skipping nodes without CPUs
+    {
+        mkdir("testTopology", 0755);
+        mkdir("testTopology/cpu", 0755);
+        mkdir("testTopology/node", 0755);
+        mkdir("testTopology/node/node0", 0755);
+        mkdir("testTopology/node/node1", 0755);
+        mkdir("testTopology/node/node2", 0755);
+        CpuTopologyTestWriteFile("testTopology/cpu/online", "0-7");
+        CpuTopologyTestWriteFile("testTopology/node/node0/cpulist", "0-1,4-5");
+        CpuTopologyTestWriteFile("testTopology/node/node1/cpulist", "");
+        CpuTopologyTestWriteFile("testTopology/node/node2/cpulist", "2-3,6-7");
+        CpuTopology topology(true, "testTopology");
+        assert(topology.numNodes() == 2);
+        assert(topology.nodeCpus(0).size() == 4);
+        assert(topology.nodeCpus(1).size() == 4);
+        assert((topology.cpuNode(0) == 0) && (topology.cpuNode(5) == 0));
+        assert((topology.cpuNode(2) == 1) && (topology.cpuNode(7) == 1));
+        assert((topology.cpuNode(8) == -1) && (topology.cpuNode(-1) == -1));
+        // Without NUMA awareness, all online CPUs are one node
+        CpuTopology flatTopology(false, "testTopology");
+        assert(flatTopology.numNodes() == 1);
+        assert(flatTopology.nodeCpus(0).size() == 8);
+        assert(flatTopology.cpuNode(6) == 0);
+        unlink("testTopology/cpu/online");
+        unlink("testTopology/node/node0/cpulist");
+        unlink("testTopology/node/node1/cpulist");
+        unlink("testTopology/node/node2/cpulist");
+        rmdir("testTopology/node/node0");
+        rmdir("testTopology/node/node1");
+        rmdir("testTopology/node/node2");
+        rmdir("testTopology/node");
+        rmdir("testTopology/cpu");
+        rmdir("testTopology");
+    }
+    // Fall back to the online CPUs without sysfs, and pin to them
+    {
+        CpuTopology topology(true, "missingTopology");
+        assert(topology.numNodes() == 1);
+        assert(!topology.nodeCpus(0).empty());
+        assert(CpuTopology::pinThread(topology.nodeCpus(0)) == 0);
+    }
+    cout << "PASS CpuTopologyTest" << endl;
+}
@@ -6,20 +6,32 @@
 
 #include <iostream>
 #include "DNC-LibraryTest.hpp"
+#include "SolverSimplex.hpp"
 
 using namespace std;
 
 int main(int argc, char** argv)
 {
+    registerSolverSimplex();
     TraceReaderTest();
     NetworkEstimatorTest();
     StorageSSDEstimatorTest();
     ProcessedTraceTest();
+    RbEstimatorTest();
     serializeJSONTest();
+    TimerWheelTest();
+    MPSCQueueTest();
+    ObjectPoolTest();
+    LatencyHistogramTest();
+    SpanTraceTest();
+    CpuTopologyTest();
     SolverGLPKTest();
+    SolverSimplexTest();
     NCTest();
     DNCTest();
+    ArrivalCurveCacheTest();
     WorkloadCompactorTest();
+    SchedulerTest();
     cout << "PASS" << endl;
     return 0;
 }
@@ -26,10 +26,20 @@ void TraceReaderTest();
 void NetworkEstimatorTest();
 void StorageSSDEstimatorTest();
 void ProcessedTraceTest();
+void RbEstimatorTest();
 void serializeJSONTest();
+void TimerWheelTest();
+void MPSCQueueTest();
+void ObjectPoolTest();
+void LatencyHistogramTest();
+void SpanTraceTest();
+void CpuTopologyTest();
 void SolverGLPKTest();
+void SolverSimplexTest();
 void NCTest();
 void DNCTest();
+void ArrivalCurveCacheTest();
 void WorkloadCompactorTest();
+void SchedulerTest();
 
 #endif // _UNIT_TEST_HPP
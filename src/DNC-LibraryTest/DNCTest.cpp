@@ -4,11 +4,16 @@
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdlib>
 #include <limits>
 #include <iostream>
+#include <string>
 #include <vector>
+#include <set>
+#include <map>
 #include "../common/serializeJSON.hpp"
 #include "../Estimator/Estimator.hpp"
 #include "../TraceCommon/ProcessedTrace.hpp"
@@ -96,6 +101,38 @@ static bool equalCurve(const Curve& c1, const Curve& c2)
     return true;
 }
 
+// Value of an arrival curve at x > 0
+static double evalArrivalCurve(const Curve& arrivalCurve, double x)
+{
+    unsigned int index = 1;
+    while (((index + 1) < arrivalCurve.size()) && (arrivalCurve[index + 1].x <= x)) {
+        index++;
+    }
+    const PointSlope& p = arrivalCurve[index];
+    return p.y + (x - p.x) * p.slope;
+}
+
+// Reference pruneArrivalCurve that scans for the smallest y gap before each removal
+static void pruneArrivalCurveScan(Curve& arrivalCurve, unsigned int n)
+{
+    n++;
+    while ((arrivalCurve.size() > n) && (arrivalCurve.back().x >= 30)) {
+        arrivalCurve.pop_back();
+    }
+    while (arrivalCurve.size() > n) {
+        int toRemove = 1;
+        double minDiffY = numeric_limits<double>::infinity();
+        for (unsigned int i = 1; i < (arrivalCurve.size() - 1); i++) {
+            if (arrivalCurve[i + 1].y - arrivalCurve[i].y < minDiffY) {
+                minDiffY = arrivalCurve[i + 1].y - arrivalCurve[i].y;
+                toRemove = i;
+            }
+        }
+        arrivalCurve.erase(arrivalCurve.begin() + toRemove);
+        arrivalCurve[toRemove] = calcPointSlopeIntersection(arrivalCurve[toRemove], arrivalCurve[toRemove - 1]);
+    }
+}
+
 void testCalcMinRate(ProcessedTrace* pTrace0, ProcessedTrace* pTrace1)
 {
     assert(calcMinRate(pTrace0) == 0.18); // hand calculated from testTrace.csv
@@ -118,6 +155,207 @@ void testRbGen(ProcessedTrace* pTrace0, ProcessedTrace* pTrace1)
     assert(bursts1[1] == 13); // hand calculated from testTrace.csv
     assert(bursts1[0.5] == 20); // hand calculated from testTrace.csv
     assert(bursts1[0.25] == 30); // hand calculated from testTrace.csv
+    // Array form must match the map form
+    vector<double> burstArray0;
+    rbGen(pTrace0, rates, burstArray0);
+    assert(burstArray0.size() == rates.size());
+    vector<double> burstArray1;
+    rbGen(pTrace1, rates, burstArray1);
+    assert(burstArray1.size() == rates.size());
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        assert(burstArray0[i] == bursts0[rates[i]]);
+        assert(burstArray1[i] == bursts1[rates[i]]);
+    }
+    // Vector kernels give the same bursts as the scalar kernel, including for rates past the last full vector
+    vector<double> manyRates;
+    for (double rate = 2; rate > 0; rate -= 0.09) {
+        manyRates.push_back(rate);
+    }
+    string defaultISA = getRbGenISA();
+    assert(setRbGenISA("scalar"));
+    assert(getRbGenISA() == "scalar");
+    vector<double> scalarBursts0;
+    rbGen(pTrace0, manyRates, scalarBursts0);
+    vector<double> scalarBursts1;
+    rbGen(pTrace1, manyRates, scalarBursts1);
+    const char* isas[2] = {"avx2", "avx512f"};
+    for (unsigned int i = 0; i < 2; i++) {
+        if (setRbGenISA(isas[i])) {
+            vector<double> vectorBursts;
+            rbGen(pTrace0, manyRates, vectorBursts);
+            assert(vectorBursts == scalarBursts0);
+            rbGen(pTrace1, manyRates, vectorBursts);
+            assert(vectorBursts == scalarBursts1);
+        }
+    }
+    assert(!setRbGenISA("unknown"));
+    assert(setRbGenISA(defaultISA));
+}
+
+// Check if two bursts are equal up to floating point rounding.
+static bool equalBurst(double burst0, double burst1)
+{
+    return fabs(burst0 - burst1) <= 1e-9 * max(1.0, fabs(burst1));
+}
+
+void testRbGenSegmented(ProcessedTrace* pTrace0, ProcessedTrace* pTrace1)
+{
+    vector<double> rates;
+    for (double rate = 2; rate >= 0; rate -= 0.125) {
+        rates.push_back(rate);
+    }
+    // Bursts must match rbGen for any segment size and number of threads
+    ProcessedTrace* pTraces[2] = {pTrace0, pTrace1};
+    for (unsigned int t = 0; t < 2; t++) {
+        vector<double> serialBursts;
+        rbGen(pTraces[t], rates, serialBursts);
+        for (unsigned int segmentSize = 1; segmentSize <= 5; segmentSize++) {
+            for (unsigned int numThreads = 1; numThreads <= 3; numThreads++) {
+                vector<double> bursts;
+                rbGenSegmented(pTraces[t], rates, bursts, numThreads, segmentSize);
+                assert(bursts.size() == rates.size());
+                for (unsigned int i = 0; i < rates.size(); i++) {
+                    assert(equalBurst(bursts[i], serialBursts[i]));
+                }
+            }
+        }
+        vector<double> bursts;
+        rbGenSegmented(pTraces[t], rates, bursts);
+        for (unsigned int i = 0; i < rates.size(); i++) {
+            assert(equalBurst(bursts[i], serialBursts[i]));
+        }
+    }
+    // Merging summaries is associative and agrees with summarizing the whole segment, for any entry level
+    double interarrivals[6] = {0.5, 3, 0.25, 0, 4, 1};
+    double works[6] = {2, 1, 3, 1, 0.5, 2};
+    RbSegmentSummary whole;
+    initRbSegmentSummary(whole, rates.size());
+    addRbSegmentSummary(whole, rates, interarrivals, works, 6);
+    RbSegmentSummary parts[3];
+    for (unsigned int i = 0; i < 3; i++) {
+        initRbSegmentSummary(parts[i], rates.size());
+        addRbSegmentSummary(parts[i], rates, interarrivals + 2 * i, works + 2 * i, 2);
+    }
+    RbSegmentSummary left = parts[0];
+    mergeRbSegmentSummary(left, parts[1]);
+    mergeRbSegmentSummary(left, parts[2]);
+    RbSegmentSummary right = parts[1];
+    mergeRbSegmentSummary(right, parts[2]);
+    RbSegmentSummary merged = parts[0];
+    mergeRbSegmentSummary(merged, right);
+    RbSegmentSummary empty;
+    initRbSegmentSummary(empty, rates.size());
+    mergeRbSegmentSummary(merged, empty);
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        assert(equalBurst(left.offsets[i], merged.offsets[i]));
+        assert(equalBurst(left.levels[i], merged.levels[i]));
+        for (double x = 0; x <= 8; x += 2) {
+            double exitLevel = max(x + whole.offsets[i], whole.levels[i]);
+            double burst = max(x + whole.offsetBursts[i], whole.bursts[i]);
+            assert(equalBurst(max(x + left.offsets[i], left.levels[i]), exitLevel));
+            assert(equalBurst(max(x + left.offsetBursts[i], left.bursts[i]), burst));
+            assert(equalBurst(max(x + merged.offsets[i], merged.levels[i]), exitLevel));
+            assert(equalBurst(max(x + merged.offsetBursts[i], merged.bursts[i]), burst));
+        }
+    }
+    // Vector kernels give the same summaries as the scalar kernel
+    string defaultISA = getRbGenISA();
+    assert(setRbGenISA("scalar"));
+    RbSegmentSummary scalarSummary;
+    initRbSegmentSummary(scalarSummary, rates.size());
+    addRbSegmentSummary(scalarSummary, rates, interarrivals, works, 6);
+    const char* isas[2] = {"avx2", "avx512f"};
+    for (unsigned int i = 0; i < 2; i++) {
+        if (setRbGenISA(isas[i])) {
+            RbSegmentSummary vectorSummary;
+            initRbSegmentSummary(vectorSummary, rates.size());
+            addRbSegmentSummary(vectorSummary, rates, interarrivals, works, 6);
+            assert(vectorSummary.offsets == scalarSummary.offsets);
+            assert(vectorSummary.levels == scalarSummary.levels);
+            assert(vectorSummary.offsetBursts == scalarSummary.offsetBursts);
+            assert(vectorSummary.bursts == scalarSummary.bursts);
+        }
+    }
+    assert(setRbGenISA(defaultISA));
+    // Without rates, there are no bursts
+    vector<double> bursts;
+    rbGenSegmented(pTrace0, vector<double>(), bursts, 2, 1);
+    assert(bursts.empty());
+}
+
+void testCalcArrivalCurves(ProcessedTrace* pTrace0, ProcessedTrace* pTrace1)
+{
+    // Serial reference using calcMinRate and rbGen directly
+    ProcessedTrace* pTraces[2] = {pTrace0, pTrace1};
+    Curve serialArrivalCurves[2];
+    double maxRate = 2;
+    for (unsigned int i = 0; i < 2; i++) {
+        double minRate = calcMinRate(pTraces[i]);
+        vector<double> rates;
+        for (double rate = maxRate; rate >= minRate; rate -= 0.001 * maxRate) {
+            rates.push_back(rate);
+        }
+        vector<double> bursts;
+        rbGen(pTraces[i], rates, bursts);
+        rbCurveToArrivalCurve(serialArrivalCurves[i], rates, bursts);
+        pruneArrivalCurve(serialArrivalCurves[i], 12);
+    }
+    // Parallel results must not depend on the number of threads
+    for (unsigned int numThreads = 1; numThreads <= 4; numThreads++) {
+        vector<Curve> arrivalCurves;
+        calcArrivalCurves(arrivalCurves, vector<ProcessedTrace*>(pTraces, pTraces + 2), vector<double>(2, maxRate), numThreads);
+        assert(arrivalCurves.size() == 2);
+        assert(equalCurve(arrivalCurves[0], serialArrivalCurves[0]));
+        assert(equalCurve(arrivalCurves[1], serialArrivalCurves[1]));
+    }
+    Curve arrivalCurve;
+    calcArrivalCurve(arrivalCurve, pTrace1, maxRate);
+    assert(equalCurve(arrivalCurve, serialArrivalCurves[1]));
+}
+
+void testCalcArrivalCurvesAdaptive(ProcessedTrace* pTrace0, ProcessedTrace* pTrace1)
+{
+    vector<ProcessedTrace*> pTraces;
+    pTraces.push_back(pTrace0);
+    pTraces.push_back(pTrace1);
+    vector<double> maxRates(2, 2);
+    vector<Curve> arrivalCurves;
+    calcArrivalCurves(arrivalCurves, pTraces, maxRates, 0, 0, 0);
+    for (unsigned int i = 0; i < 2; i++) {
+        // The priority queue pruning must remove the same points as scanning for the smallest gap
+        for (unsigned int n = 1; n <= 12; n++) {
+            Curve arrivalCurve = arrivalCurves[i];
+            Curve expectedArrivalCurve = arrivalCurves[i];
+            pruneArrivalCurve(arrivalCurve, n);
+            pruneArrivalCurveScan(expectedArrivalCurve, n);
+            assert(equalCurve(arrivalCurve, expectedArrivalCurve));
+        }
+    }
+    // Adaptive arrival curves must be within the tolerance of the exhaustive arrival curves
+    double tolerances[] = {0.001, 0.01, 0.1};
+    for (unsigned int t = 0; t < sizeof(tolerances) / sizeof(tolerances[0]); t++) {
+        double tolerance = tolerances[t];
+        for (unsigned int numThreads = 1; numThreads <= 2; numThreads++) {
+            vector<Curve> adaptiveArrivalCurves;
+            calcArrivalCurves(adaptiveArrivalCurves, pTraces, maxRates, numThreads, tolerance, 0);
+            assert(adaptiveArrivalCurves.size() == 2);
+            for (unsigned int i = 0; i < 2; i++) {
+                assert(adaptiveArrivalCurves[i].size() <= arrivalCurves[i].size());
+                // The sweep stops at the lowest grid rate at or above the min rate
+                assert(adaptiveArrivalCurves[i].back().slope == arrivalCurves[i].back().slope);
+                assert(adaptiveArrivalCurves[i].back().slope >= calcMinRate(pTraces[i]));
+                for (double x = 0.0001; x < 100; x *= 1.1) {
+                    double exhaustive = evalArrivalCurve(arrivalCurves[i], x);
+                    double adaptive = evalArrivalCurve(adaptiveArrivalCurves[i], x);
+                    assert(adaptive >= exhaustive * (1 - 1e-9));
+                    assert(adaptive <= exhaustive * (1 + tolerance + 1e-9));
+                }
+            }
+        }
+    }
+    Curve arrivalCurve;
+    calcArrivalCurve(arrivalCurve, pTrace1, 2, 0.01);
+    assert(arrivalCurve.size() > 1);
 }
 
 void testRbCurveToArrivalCurve()
@@ -239,6 +477,30 @@ void testRbCurveToArrivalCurve()
     assert(equalCurve(calcArrivalCurve1, arrivalCurve1));
 }
 
+void testScaleArrivalInfo()
+{
+    double xArr[] = {0, 4, 10};
+    double slopeArr[] = {1, 0.25, 0.125};
+    double scaledSlopeArr[] = {2, 0.5, 0.25};
+    unsigned int count = sizeof(xArr) / sizeof(xArr[0]);
+    Curve arrivalCurve;
+    buildArrivalCurve(arrivalCurve, count, 1, xArr, slopeArr);
+    Curve scaledArrivalCurve;
+    buildArrivalCurve(scaledArrivalCurve, count, 2, xArr, scaledSlopeArr);
+    // arrivalInfo omits the initial point (see updateArrivalInfo)
+    arrivalCurve.erase(arrivalCurve.begin());
+    scaledArrivalCurve.erase(scaledArrivalCurve.begin());
+    Json::Value flowInfo;
+    serializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+    DNC::scaleArrivalInfo(flowInfo, 2);
+    Curve calcArrivalCurve;
+    deserializeJSON(flowInfo, "arrivalInfo", calcArrivalCurve);
+    assert(equalCurve(calcArrivalCurve, scaledArrivalCurve));
+    DNC::scaleArrivalInfo(flowInfo, 0.5);
+    deserializeJSON(flowInfo, "arrivalInfo", calcArrivalCurve);
+    assert(equalCurve(calcArrivalCurve, arrivalCurve));
+}
+
 void testCalcPointSlopeIntersection()
 {
     // Test positive slope
@@ -745,6 +1007,84 @@ void DNCTestTwoHops()
     assert(nc->calcClientLatency(c8) == 52);
     assert(nc->calcClientLatency(c9) == 52);
 
+    // Test that only the latencies depending on a changed flow are recalculated
+    DNC* dnc = static_cast<DNC*>(nc);
+    set<ClientId> dirtyClientIds;
+    nc->getDirtyClients(dirtyClientIds);
+    assert(dirtyClientIds.empty());
+    FlowId f6 = nc->getFlowIdByName("F6");
+    SimpleArrivalCurve shaperCurve = dnc->getShaperCurve(f6);
+    dnc->setShaperCurve(f6, shaperCurve);
+    nc->getDirtyClients(dirtyClientIds);
+    assert(dirtyClientIds.empty());
+    shaperCurve.b = 0.75;
+    dnc->setShaperCurve(f6, shaperCurve);
+    nc->getDirtyClients(dirtyClientIds);
+    // Only F6 and the lower (or equal) priority flows sharing its queues are affected; F2-F5 have higher priority
+    assert(dirtyClientIds.size() == 4);
+    assert(dirtyClientIds.count(c6) && dirtyClientIds.count(c7) && dirtyClientIds.count(c8) && dirtyClientIds.count(c9));
+    assert(nc->calcClientLatency(c6) > 16);
+    assert(nc->calcClientLatency(c7) == nc->getClient(c6)->latency);
+    assert(nc->calcClientLatency(c8) == 56);
+    shaperCurve.b = 0.25;
+    dnc->setShaperCurve(f6, shaperCurve);
+    nc->setFlowPriority(nc->getFlowIdByName("F7"), 3);
+    dirtyClientIds.clear();
+    nc->getDirtyClients(dirtyClientIds);
+    // F7 moves ahead of F6 and now competes with F4 and F5 in Q1
+    assert(dirtyClientIds.size() == 6);
+    assert(dirtyClientIds.count(c4) && dirtyClientIds.count(c5));
+    nc->setFlowPriority(nc->getFlowIdByName("F7"), 4);
+    for (ClientId clientId = c0; clientId <= c9; clientId++) {
+        nc->calcClientLatency(clientId);
+    }
+    assert(nc->getClient(c4)->latency == 4);
+    assert(nc->getClient(c6)->latency == 16);
+    assert(nc->getClient(c8)->latency == 52);
+    dirtyClientIds.clear();
+    nc->getDirtyClients(dirtyClientIds);
+    assert(dirtyClientIds.empty());
+
+    // Test that deleting flows from the middle of the queues' lists keeps the lists consistent and the analysis unchanged
+    const Json::Value* queueLists[] = {&queueListA, &queueListB, &queueListC, &queueListD};
+    vector<ClientId> extraClientIds;
+    for (unsigned int i = 0; i < 8; i++) {
+        flowInfo["name"] = Json::Value(string("X") + static_cast<char>('0' + i));
+        flowInfo["queues"] = *queueLists[i % 4];
+        flowInfo["priority"] = Json::Value(i % 5 + 1);
+        flowInfo["r"] = Json::Value(0.0625);
+        flowInfo["b"] = Json::Value(0.5);
+        clientInfo["name"] = Json::Value(string("CX") + static_cast<char>('0' + i));
+        extraClientIds.push_back(nc->addClient(clientInfo));
+    }
+    nc->calcAllLatency();
+    assert(nc->getClient(c0)->latency > 1.5);
+    const unsigned int deleteOrder[] = {3, 0, 6, 1, 7, 2, 5, 4};
+    for (unsigned int i = 0; i < 8; i++) {
+        nc->delClient(extraClientIds[deleteOrder[i]]);
+        for (NC::QueueIterator it = nc->queuesBegin(); it != nc->queuesEnd(); it++) {
+            const Queue* q = it->second;
+            for (unsigned int position = 0; position < q->flows.size(); position++) {
+                const Flow* f = nc->getFlow(q->flows[position].flowId);
+                assert(f != NULL);
+                assert(f->queueIds[q->flows[position].index] == q->queueId);
+                assert(f->queuePositions[q->flows[position].index] == position);
+            }
+        }
+    }
+    assert(nc->getQueue(nc->getQueueIdByName("Q0"))->flows.size() == 4);
+    assert(nc->getQueue(nc->getQueueIdByName("Q3"))->flows.size() == 6);
+    assert(nc->calcClientLatency(c0) == 1.5);
+    assert(nc->calcClientLatency(c1) == 1.5);
+    assert(nc->calcClientLatency(c2) == 6.4);
+    assert(nc->calcClientLatency(c3) == 6.4);
+    assert(nc->calcClientLatency(c4) == 4);
+    assert(nc->calcClientLatency(c5) == 4);
+    assert(nc->calcClientLatency(c6) == 16);
+    assert(nc->calcClientLatency(c7) == 16);
+    assert(nc->calcClientLatency(c8) == 52);
+    assert(nc->calcClientLatency(c9) == 52);
+
     delete nc;
 }
 
@@ -794,7 +1134,11 @@ void DNCTest()
     // Test input functions
     testCalcMinRate(pTrace0, pTrace1);
     testRbGen(pTrace0, pTrace1);
+    testRbGenSegmented(pTrace0, pTrace1);
+    testCalcArrivalCurves(pTrace0, pTrace1);
+    testCalcArrivalCurvesAdaptive(pTrace0, pTrace1);
     testRbCurveToArrivalCurve();
+    testScaleArrivalInfo();
 
     delete pTrace0;
     delete pTrace1;
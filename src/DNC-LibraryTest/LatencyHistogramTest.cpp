@@ -0,0 +1,96 @@
+// LatencyHistogramTest.cpp - LatencyHistogram test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include "../common/LatencyHistogram.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+#define LATENCY_HISTOGRAM_TEST_THREADS 4
+#define LATENCY_HISTOGRAM_TEST_VALUES 100000
+
+static void* LatencyHistogramTestRecordThread(void* ptr)
+{
+    LatencyHistogram* pHistogram = static_cast<LatencyHistogram*>(ptr);
+    for (uint64_t i = 1; i <= LATENCY_HISTOGRAM_TEST_VALUES; i++) {
+        pHistogram->record(i);
+    }
+    return NULL;
+}
+
+void LatencyHistogramTest()
+{
+    // Buckets are contiguous, contain their values, and are at most 1 / LATENCY_HISTOGRAM_SUB_BUCKETS of their values wide
+    {
+        assert(LatencyHistogram::bucketLowerBound(0) == 0);
+        for (unsigned int b = 0; b < LATENCY_HISTOGRAM_BUCKETS; b++) {
+            uint64_t lower = LatencyHistogram::bucketLowerBound(b);
+            uint64_t upper = LatencyHistogram::bucketUpperBound(b);
+            assert(lower <= upper);
+            assert(LatencyHistogram::bucket(lower) == b);
+            assert(LatencyHistogram::bucket(upper) == b);
+            if (b + 1 < LATENCY_HISTOGRAM_BUCKETS) {
+                assert(LatencyHistogram::bucketLowerBound(b + 1) == upper + 1);
+            }
+            assert((upper - lower) <= (lower / LATENCY_HISTOGRAM_SUB_BUCKETS));
+        }
+        assert(LatencyHistogram::bucketUpperBound(LATENCY_HISTOGRAM_BUCKETS - 1) == ~(uint64_t)0);
+    }
+    // Snapshots omit empty buckets at either end, and quantiles are within a bucket of the exact value
+    {
+        LatencyHistogram histogram;
+        unsigned int firstBucket;
+        vector<uint64_t> counts;
+        histogram.snapshot(firstBucket, counts);
+        assert(counts.empty());
+        assert(LatencyHistogram::quantile(firstBucket, counts, 0.99) == 0);
+        for (uint64_t i = 1000; i <= 100000; i++) {
+            histogram.record(i);
+        }
+        histogram.snapshot(firstBucket, counts);
+        assert(firstBucket == LatencyHistogram::bucket(1000));
+        assert(firstBucket + counts.size() - 1 == LatencyHistogram::bucket(100000));
+        assert((counts.front() > 0) && (counts.back() > 0));
+        assert(LatencyHistogram::quantile(firstBucket, counts, 0) == LatencyHistogram::bucketUpperBound(LatencyHistogram::bucket(1000)));
+        assert(LatencyHistogram::quantile(firstBucket, counts, 1) == LatencyHistogram::bucketUpperBound(LatencyHistogram::bucket(100000)));
+        uint64_t exact = 1000 + (uint64_t)(0.99 * (100000 - 1000 + 1)) - 1;
+        uint64_t p99 = LatencyHistogram::quantile(firstBucket, counts, 0.99);
+        assert(LatencyHistogram::bucket(p99) == LatencyHistogram::bucket(exact));
+    }
+    // Concurrent recording loses no values
+    {
+        LatencyHistogram histogram;
+        pthread_t threads[LATENCY_HISTOGRAM_TEST_THREADS];
+        for (unsigned int t = 0; t < LATENCY_HISTOGRAM_TEST_THREADS; t++) {
+            int rc = pthread_create(&threads[t], NULL, LatencyHistogramTestRecordThread, &histogram);
+            assert(rc == 0);
+        }
+        for (unsigned int t = 0; t < LATENCY_HISTOGRAM_TEST_THREADS; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        unsigned int firstBucket;
+        vector<uint64_t> counts;
+        histogram.snapshot(firstBucket, counts);
+        uint64_t total = 0;
+        for (unsigned int i = 0; i < counts.size(); i++) {
+            uint64_t lower = LatencyHistogram::bucketLowerBound(firstBucket + i);
+            uint64_t upper = LatencyHistogram::bucketUpperBound(firstBucket + i);
+            if (upper > LATENCY_HISTOGRAM_TEST_VALUES) {
+                upper = LATENCY_HISTOGRAM_TEST_VALUES;
+            }
+            uint64_t expected = (lower == 0) ? 0 : (upper - lower + 1) * LATENCY_HISTOGRAM_TEST_THREADS;
+            assert(counts[i] == expected);
+            total += counts[i];
+        }
+        assert(total == LATENCY_HISTOGRAM_TEST_THREADS * LATENCY_HISTOGRAM_TEST_VALUES);
+    }
+    cout << "PASS LatencyHistogramTest" << endl;
+}
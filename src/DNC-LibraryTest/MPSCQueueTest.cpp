@@ -0,0 +1,96 @@
+// MPSCQueueTest.cpp - MPSCQueue test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include "../common/MPSCQueue.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+#define MPSC_QUEUE_TEST_PRODUCERS 4
+#define MPSC_QUEUE_TEST_ITEMS 100000
+
+struct MPSCQueueTestItem {
+    unsigned int producer;
+    unsigned int index;
+    MPSCQueueTestItem* next;
+};
+
+typedef MPSCQueue<MPSCQueueTestItem, &MPSCQueueTestItem::next> MPSCQueueTestQueue;
+
+struct MPSCQueueTestProducer {
+    MPSCQueueTestQueue* pQueue;
+    vector<MPSCQueueTestItem> items;
+};
+
+static void* MPSCQueueTestProducerThread(void* ptr)
+{
+    MPSCQueueTestProducer* pProducer = static_cast<MPSCQueueTestProducer*>(ptr);
+    for (unsigned int i = 0; i < pProducer->items.size(); i++) {
+        pProducer->pQueue->push(&pProducer->items[i]);
+    }
+    return NULL;
+}
+
+void MPSCQueueTest()
+{
+    // Items are popped in push order
+    {
+        MPSCQueueTestQueue queue;
+        vector<MPSCQueueTestItem> items(3);
+        assert(queue.empty());
+        assert(queue.popAll() == NULL);
+        assert(queue.push(&items[0]));
+        assert(!queue.push(&items[1]));
+        assert(!queue.push(&items[2]));
+        assert(!queue.empty());
+        MPSCQueueTestItem* pItem = queue.popAll();
+        assert(queue.empty());
+        assert(pItem == &items[0]);
+        assert(pItem->next == &items[1]);
+        assert(pItem->next->next == &items[2]);
+        assert(pItem->next->next->next == NULL);
+        assert(queue.push(&items[1]));
+        pItem = queue.popAll();
+        assert((pItem == &items[1]) && (pItem->next == NULL));
+    }
+    // Concurrent producers; each producer's items are popped exactly once and in the order it pushed them
+    {
+        MPSCQueueTestQueue queue;
+        MPSCQueueTestProducer producers[MPSC_QUEUE_TEST_PRODUCERS];
+        pthread_t threads[MPSC_QUEUE_TEST_PRODUCERS];
+        for (unsigned int p = 0; p < MPSC_QUEUE_TEST_PRODUCERS; p++) {
+            producers[p].pQueue = &queue;
+            producers[p].items.resize(MPSC_QUEUE_TEST_ITEMS);
+            for (unsigned int i = 0; i < MPSC_QUEUE_TEST_ITEMS; i++) {
+                producers[p].items[i].producer = p;
+                producers[p].items[i].index = i;
+            }
+        }
+        for (unsigned int p = 0; p < MPSC_QUEUE_TEST_PRODUCERS; p++) {
+            int rc = pthread_create(&threads[p], NULL, MPSCQueueTestProducerThread, &producers[p]);
+            assert(rc == 0);
+        }
+        vector<unsigned int> nextIndex(MPSC_QUEUE_TEST_PRODUCERS, 0);
+        unsigned int numPopped = 0;
+        while (numPopped < MPSC_QUEUE_TEST_PRODUCERS * MPSC_QUEUE_TEST_ITEMS) {
+            for (MPSCQueueTestItem* pItem = queue.popAll(); pItem != NULL; pItem = pItem->next) {
+                assert(pItem->index == nextIndex[pItem->producer]);
+                nextIndex[pItem->producer]++;
+                numPopped++;
+            }
+        }
+        for (unsigned int p = 0; p < MPSC_QUEUE_TEST_PRODUCERS; p++) {
+            pthread_join(threads[p], NULL);
+            assert(nextIndex[p] == MPSC_QUEUE_TEST_ITEMS);
+        }
+        assert(queue.empty());
+    }
+    cout << "PASS MPSCQueueTest" << endl;
+}
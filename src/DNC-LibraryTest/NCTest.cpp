@@ -28,7 +28,7 @@ private:
         assert(q->name == "Q0");
         assert(q->flows.empty());
         assert(q->bandwidth == 1);
-        map<QueueId, Queue*>::const_iterator it = queuesBegin();
+        NC::QueueIterator it = queuesBegin();
         assert(it->first == queueId);
         assert(it->second == q);
         it++;
@@ -65,7 +65,7 @@ private:
         assert(q->name == "Q1");
         assert(q->flows.empty());
         assert(q->bandwidth == 1);
-        map<QueueId, Queue*>::const_iterator it = queuesBegin();
+        NC::QueueIterator it = queuesBegin();
         assert(it->first == queueId);
         assert(it->second == q);
         it++;
@@ -112,12 +112,12 @@ private:
         assert(f->queueIds[0] == queueId0);
         assert(f->queueIds[1] == queueId1);
         assert(f->priority == 5);
-        map<ClientId, Client*>::const_iterator itC = clientsBegin();
+        NC::ClientIterator itC = clientsBegin();
         assert(itC->first == clientId);
         assert(itC->second == c);
         itC++;
         assert(itC == clientsEnd());
-        map<FlowId, Flow*>::const_iterator itF = flowsBegin();
+        NC::FlowIterator itF = flowsBegin();
         assert(itF->first == flowId);
         assert(itF->second == f);
         itF++;
@@ -197,12 +197,12 @@ private:
         assert(f->queueIds[0] == queueId0);
         assert(f->queueIds[1] == queueId1);
         assert(f->priority == 6);
-        map<ClientId, Client*>::const_iterator itC = clientsBegin();
+        NC::ClientIterator itC = clientsBegin();
         assert(itC->first == clientId);
         assert(itC->second == c);
         itC++;
         assert(itC == clientsEnd());
-        map<FlowId, Flow*>::const_iterator itF = flowsBegin();
+        NC::FlowIterator itF = flowsBegin();
         assert(itF->first == flowId);
         assert(itF->second == f);
         itF++;
@@ -277,6 +277,43 @@ public:
         assert(c1->latency == 1);
         assert(f0->latency == 1);
         assert(f1->latency == 1);
+        // Test id lookups of deleted clients/flows and id reuse after a what-if evaluation
+        const Client* c = getClient(clientId1);
+        Json::Value clientInfo;
+        clientInfo["name"] = Json::Value("C2");
+        clientInfo["SLO"] = Json::Value(1);
+        clientInfo["flows"] = Json::arrayValue;
+        clientInfo["flows"].resize(1);
+        clientInfo["flows"][0]["name"] = Json::Value("F2");
+        clientInfo["flows"][0]["queues"] = Json::arrayValue;
+        clientInfo["flows"][0]["queues"].append(Json::Value("Q0"));
+        beginWhatIf();
+        ClientId clientId2 = addClient(clientInfo);
+        FlowId flowId2 = getFlowIdByName("F2");
+        assert(getClient(clientId2)->name == "C2");
+        assert(getFlow(flowId2)->clientId == clientId2);
+        delClient(clientId2);
+        assert(getClient(clientId2) == NULL);
+        assert(getFlow(flowId2) == NULL);
+        endWhatIf();
+        assert(getClient(clientId1) == c);
+        assert(addClient(clientInfo) == clientId2);
+        assert(getFlowIdByName("F2") == flowId2);
+        delClient(clientId2);
+        assert(getClient(clientId2) == NULL);
+        assert(getClient(clientId2 + 1) == NULL);
+        assert(getFlow(flowId2) == NULL);
+        // Test reuse of the lowest deleted ids outside of a what-if evaluation
+        delClient(clientId0);
+        assert(clientId0 < clientId2);
+        assert(addClient(clientInfo) == clientId0);
+        assert(getFlowIdByName("F2") == flowId0);
+        NC::ClientIterator itC = clientsBegin();
+        assert((itC->first == clientId0) && (itC->second->name == "C2"));
+        itC++;
+        assert((itC->first == clientId1) && (itC->second == c));
+        itC++;
+        assert(itC == clientsEnd());
     }
 };
 
@@ -12,6 +12,18 @@
 
 using namespace std;
 
+// Batch estimates must match per request estimates
+static void testEstimateWorkBatch(Estimator* pEst)
+{
+    int requestSizes[6] = {100, 200, 300, 100, 200, 300};
+    bool isReadRequests[6] = {true, true, true, false, false, false};
+    double works[6];
+    pEst->estimateWorkBatch(6, requestSizes, isReadRequests, works);
+    for (unsigned int i = 0; i < 6; i++) {
+        assert(works[i] == pEst->estimateWork(requestSizes[i], isReadRequests[i]));
+    }
+}
+
 void NetworkInEstimatorTest()
 {
     Json::Value estimatorInfo;
@@ -28,6 +40,7 @@ void NetworkInEstimatorTest()
     assert(pEst->estimateWork(100, false) == 2010);
     assert(pEst->estimateWork(200, false) == 2020);
     assert(pEst->estimateWork(300, false) == 2030);
+    testEstimateWorkBatch(pEst);
     delete pEst;
     cout << "PASS NetworkInEstimatorTest" << endl;
 }
@@ -48,6 +61,7 @@ void NetworkOutEstimatorTest()
     assert(pEst->estimateWork(100, false) == 1020);
     assert(pEst->estimateWork(200, false) == 1040);
     assert(pEst->estimateWork(300, false) == 1060);
+    testEstimateWorkBatch(pEst);
     delete pEst;
     cout << "PASS NetworkOutEstimatorTest" << endl;
 }
@@ -0,0 +1,103 @@
+// ObjectPoolTest.cpp - ObjectPool test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include "../common/ObjectPool.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Whole slabs, so that each thread uses every slot of its pool
+#define OBJECT_POOL_TEST_OBJECTS (40 * OBJECT_POOL_SLAB_OBJECTS)
+
+class ObjectPoolTestObject
+{
+public:
+    char data[200];
+    unsigned int id;
+
+    static void* operator new(size_t size) { return ObjectPool<ObjectPoolTestObject>::allocate(); }
+    static void operator delete(void* ptr) { ObjectPool<ObjectPoolTestObject>::deallocate(ptr); }
+};
+
+static void* ObjectPoolTestAllocateThread(void* ptr)
+{
+    vector<ObjectPoolTestObject*>* pObjects = static_cast<vector<ObjectPoolTestObject*>*>(ptr);
+    for (unsigned int i = 0; i < OBJECT_POOL_TEST_OBJECTS; i++) {
+        ObjectPoolTestObject* pObject = new ObjectPoolTestObject;
+        pObject->id = i;
+        pObjects->push_back(pObject);
+    }
+    return NULL;
+}
+
+static void* ObjectPoolTestDeleteThread(void* ptr)
+{
+    vector<ObjectPoolTestObject*>* pObjects = static_cast<vector<ObjectPoolTestObject*>*>(ptr);
+    for (unsigned int i = 0; i < pObjects->size(); i++) {
+        assert((*pObjects)[i]->id == i);
+        delete (*pObjects)[i];
+    }
+    return NULL;
+}
+
+void ObjectPoolTest()
+{
+    // Objects are distinct, aligned, and reused by the same thread
+    {
+        vector<ObjectPoolTestObject*> objects;
+        set<ObjectPoolTestObject*> addresses;
+        for (unsigned int i = 0; i < OBJECT_POOL_TEST_OBJECTS; i++) {
+            ObjectPoolTestObject* pObject = new ObjectPoolTestObject;
+            assert((reinterpret_cast<uintptr_t>(pObject) % OBJECT_POOL_CACHE_LINE_SIZE) == 0);
+            pObject->id = i;
+            objects.push_back(pObject);
+            addresses.insert(pObject);
+        }
+        assert(addresses.size() == objects.size());
+        for (unsigned int i = 0; i < objects.size(); i++) {
+            assert(objects[i]->id == i);
+            delete objects[i];
+        }
+        delete static_cast<ObjectPoolTestObject*>(NULL);
+        // Freed objects are allocated again before new slabs
+        for (unsigned int i = 0; i < objects.size(); i++) {
+            objects[i] = new ObjectPoolTestObject;
+            assert(addresses.count(objects[i]) == 1);
+        }
+        for (unsigned int i = 0; i < objects.size(); i++) {
+            delete objects[i];
+        }
+    }
+    // Objects allocated by one thread and freed by another return to the allocating thread's pool,
+    // whose objects are reused by later threads after it exits
+    {
+        vector<ObjectPoolTestObject*> objects;
+        pthread_t thread;
+        int rc = pthread_create(&thread, NULL, ObjectPoolTestAllocateThread, &objects);
+        assert(rc == 0);
+        pthread_join(thread, NULL);
+        set<ObjectPoolTestObject*> addresses(objects.begin(), objects.end());
+        assert(addresses.size() == objects.size());
+        rc = pthread_create(&thread, NULL, ObjectPoolTestDeleteThread, &objects);
+        assert(rc == 0);
+        pthread_join(thread, NULL);
+        vector<ObjectPoolTestObject*> reusedObjects;
+        rc = pthread_create(&thread, NULL, ObjectPoolTestAllocateThread, &reusedObjects);
+        assert(rc == 0);
+        pthread_join(thread, NULL);
+        for (unsigned int i = 0; i < reusedObjects.size(); i++) {
+            assert(addresses.count(reusedObjects[i]) == 1);
+        }
+        ObjectPoolTestDeleteThread(&reusedObjects);
+    }
+    cout << "PASS ObjectPoolTest" << endl;
+}
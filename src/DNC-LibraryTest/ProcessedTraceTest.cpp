@@ -48,6 +48,55 @@ void ProcessedTraceTest(ProcessedTrace* pTrace)
     }
 }
 
+// Batch reads must match nextEntry
+void ProcessedTraceBatchTest(ProcessedTrace* pTrace)
+{
+    ProcessedTraceEntry expected[4];
+    pTrace->reset();
+    for (int i = 0; i < 4; i++) {
+        assert(pTrace->nextEntry(expected[i]) == true);
+    }
+    for (unsigned int batchSize = 1; batchSize <= 5; batchSize++) {
+        pTrace->reset();
+        ProcessedTraceEntry entries[5];
+        unsigned int index = 0;
+        unsigned int count;
+        while ((count = pTrace->nextEntries(entries, batchSize)) > 0) {
+            assert(count <= batchSize);
+            for (unsigned int i = 0; i < count; i++, index++) {
+                assert(index < 4);
+                assert(entries[i].arrivalTime == expected[index].arrivalTime);
+                assert(entries[i].work == expected[index].work);
+                assert(entries[i].isRead == expected[index].isRead);
+            }
+        }
+        assert(index == 4);
+    }
+    pTrace->reset();
+}
+
+// ProcessedTrace specialized on the estimator type must match the generic ProcessedTrace
+void ProcessedTraceSpecializedTest(const Json::Value& estimatorInfo)
+{
+    ProcessedTrace processedTrace("testTrace.txt", Estimator::create(estimatorInfo));
+    ProcessedTrace* pTrace = ProcessedTrace::create("testTrace.txt", Estimator::create(estimatorInfo));
+    ProcessedTraceEntry expected[4];
+    ProcessedTraceEntry entry;
+    for (int i = 0; i < 4; i++) {
+        assert(processedTrace.nextEntry(expected[i]) == true);
+    }
+    assert(processedTrace.nextEntry(entry) == false);
+    for (int i = 0; i < 4; i++) {
+        assert(pTrace->nextEntry(entry) == true);
+        assert(entry.arrivalTime == expected[i].arrivalTime);
+        assert(entry.work == expected[i].work);
+        assert(entry.isRead == expected[i].isRead);
+    }
+    assert(pTrace->nextEntry(entry) == false);
+    ProcessedTraceBatchTest(pTrace);
+    delete pTrace;
+}
+
 void ProcessedTraceTest()
 {
     Json::Value estimatorInfo;
@@ -55,5 +104,23 @@ void ProcessedTraceTest()
     Estimator* pEst = Estimator::create(estimatorInfo);
     ProcessedTrace processedTrace("testTrace.txt", pEst);
     ProcessedTraceTest(&processedTrace);
+    ProcessedTraceBatchTest(&processedTrace);
+    // Specialized ProcessedTrace for each estimator type
+    ProcessedTrace* pTrace = ProcessedTrace::create("testTrace.txt", Estimator::create(estimatorInfo));
+    ProcessedTraceTest(pTrace);
+    delete pTrace;
+    ProcessedTraceSpecializedTest(estimatorInfo);
+    estimatorInfo["type"] = Json::Value("networkOut");
+    ProcessedTraceSpecializedTest(estimatorInfo);
+    Json::Value storageEstimatorInfo;
+    storageEstimatorInfo["type"] = Json::Value("storageSSD");
+    Json::Value& bwTable = storageEstimatorInfo["bandwidthTable"];
+    bwTable[0]["requestSize"] = Json::Value(512);
+    bwTable[0]["readBandwidth"] = Json::Value(1000000.0);
+    bwTable[0]["writeBandwidth"] = Json::Value(500000.0);
+    bwTable[1]["requestSize"] = Json::Value(4096);
+    bwTable[1]["readBandwidth"] = Json::Value(4000000.0);
+    bwTable[1]["writeBandwidth"] = Json::Value(2000000.0);
+    ProcessedTraceSpecializedTest(storageEstimatorInfo);
     cout << "PASS ProcessedTraceTest" << endl;
 }
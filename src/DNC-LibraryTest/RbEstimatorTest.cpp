@@ -0,0 +1,70 @@
+// RbEstimatorTest.cpp - RbEstimator test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include <json/json.h>
+#include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/ProcessedTrace.hpp"
+#include "../TraceCommon/RbEstimator.hpp"
+#include "../DNC-Library/DNC.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+void RbEstimatorTest()
+{
+    Json::Value estimatorInfo;
+    estimatorInfo["type"] = Json::Value("networkOut");
+    estimatorInfo["nonDataConstant"] = Json::Value(0.0);
+    estimatorInfo["nonDataFactor"] = Json::Value(1.0);
+    estimatorInfo["dataConstant"] = Json::Value(0.0);
+    estimatorInfo["dataFactor"] = Json::Value(1.0);
+    Estimator* pEst = Estimator::create(estimatorInfo);
+    ProcessedTrace processedTrace("testTrace.csv", pEst);
+    double maxRate = 2;
+    RbEstimator estimator(maxRate, 100);
+    vector<double> rates;
+    vector<double> bursts;
+
+    // Unknown average rate
+    assert(!estimator.getRbCurve(rates, bursts));
+    assert(rates.empty() && bursts.empty());
+    ProcessedTraceEntry entry;
+    assert(processedTrace.nextEntry(entry));
+    estimator.addRequest(entry.arrivalTime, entry.work);
+    assert(estimator.numRequests() == 1);
+    assert(!estimator.getRbCurve(rates, bursts));
+
+    // Streaming requests must give the same r-b curve as rbGen on the trace
+    unsigned int numRequests = 1;
+    while (processedTrace.nextEntry(entry)) {
+        estimator.addRequest(entry.arrivalTime, entry.work);
+        numRequests++;
+    }
+    assert(estimator.numRequests() == numRequests);
+    assert(estimator.getRbCurve(rates, bursts));
+    assert(!rates.empty());
+    assert(rates.size() == bursts.size());
+    assert(rates[0] == maxRate);
+    double minRate = calcMinRate(&processedTrace);
+    assert(rates.back() >= minRate);
+    assert((rates.size() == 100) || ((rates.back() - maxRate / 100) < minRate));
+    vector<double> expectedBursts;
+    rbGen(&processedTrace, rates, expectedBursts);
+    for (unsigned int i = 0; i < rates.size(); i++) {
+        assert(bursts[i] == expectedBursts[i]);
+        assert((i == 0) || ((rates[i] < rates[i - 1]) && (bursts[i] >= bursts[i - 1])));
+    }
+
+    // Reset forgets all requests
+    estimator.reset();
+    assert(estimator.numRequests() == 0);
+    assert(!estimator.getRbCurve(rates, bursts));
+
+    cout << "PASS RbEstimatorTest" << endl;
+}
@@ -0,0 +1,630 @@
+// SchedulerTest.cpp - Scheduler test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <deque>
+#include <list>
+#include <map>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <json/json.h>
+#include "../common/time.hpp"
+#include "../Estimator/Estimator.hpp"
+#include "../NFSEnforcer/scheduler.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Fake clock of the schedulers under test, so that both see the same times
+static uint64_t g_schedulerTestTime;
+
+static uint64_t SchedulerTestTime()
+{
+    return g_schedulerTestTime;
+}
+
+// Job as tracked by BaselineScheduler
+struct BaselineJob {
+    u_long xid;
+    unsigned long s_addr;
+    bool immediate;
+    bool isRead;
+    bool isWrite;
+    int requestSize;
+    uint64_t arrivalTime;
+    double jobSize;
+    bool rateLimitObeyed;
+    unsigned int priority;
+    uint64_t seqNumRead;
+    uint64_t seqNumWrite;
+    uint64_t seqNumReadBytes;
+    uint64_t seqNumWriteBytes;
+};
+
+struct BaselineClient {
+    list<BaselineJob*> pendingJobs;
+    unsigned int priority;
+    vector<double> rateLimitRates;
+    vector<double> rateLimitBursts;
+    vector<double> rateLimitTokens;
+    uint64_t rateLimitUpdateTime;
+    bool rateLimitObeyed;
+    uint64_t lastOccupancyTime;
+};
+
+// Reference for the scheduling policy of the Scheduler, as originally implemented before its ready queues and outstanding priority queues:
+// each schedule updates the token buckets of all clients and scans them in address order for the best client (see CompareClient),
+// and outstanding jobs that obey rate limits are kept in a single list from oldest to newest.
+class BaselineScheduler
+{
+private:
+    map<unsigned long, BaselineClient> _clients;
+    list<BaselineJob*> _outstandingPriorityList;
+    uint64_t _seqNumRead;
+    uint64_t _seqNumWrite;
+    uint64_t _seqNumReadBytes;
+    uint64_t _seqNumWriteBytes;
+    int _outstandingReadBytes;
+    int _maxOutstandingReadBytes;
+    int _outstandingWriteBytes;
+    int _maxOutstandingWriteBytes;
+    int _outstandingJobs;
+    int _maxOutstandingJobs;
+    int _outstandingReadJobs;
+    int _maxOutstandingReadJobs;
+    int _outstandingWriteJobs;
+    int _maxOutstandingWriteJobs;
+    int _pendingJobCount;
+
+    void UpdateTokens(BaselineClient& c, uint64_t now);
+    // Returns > 0 if c1 is preferred, < 0 if c2 is preferred, and 0 if neither is
+    int CompareClient(const BaselineClient& c1, const BaselineClient& c2);
+
+public:
+    BaselineScheduler(int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs)
+        : _seqNumRead(0),
+          _seqNumWrite(0),
+          _seqNumReadBytes(0),
+          _seqNumWriteBytes(0),
+          _outstandingReadBytes(0),
+          _maxOutstandingReadBytes(maxOutstandingReadBytes),
+          _outstandingWriteBytes(0),
+          _maxOutstandingWriteBytes(maxOutstandingWriteBytes),
+          _outstandingJobs(0),
+          _maxOutstandingJobs(maxReadJobs + maxWriteJobs),
+          _outstandingReadJobs(0),
+          _maxOutstandingReadJobs(maxReadJobs),
+          _outstandingWriteJobs(0),
+          _maxOutstandingWriteJobs(maxWriteJobs),
+          _pendingJobCount(0)
+    {}
+    void UpdateClient(unsigned long s_addr, unsigned int priority, int rateLimitLength, const double* rateLimitRates, const double* rateLimitBursts);
+    void SubmitJob(BaselineJob* pJob);
+    BaselineJob* ScheduleJob();
+    void CompleteJob(BaselineJob* pJob);
+};
+
+// Clients are created with no rate limits, like Scheduler::GetClient.
+void BaselineScheduler::UpdateClient(unsigned long s_addr, unsigned int priority, int rateLimitLength, const double* rateLimitRates, const double* rateLimitBursts)
+{
+    map<unsigned long, BaselineClient>::iterator it = _clients.find(s_addr);
+    if (it == _clients.end()) {
+        BaselineClient& c = _clients[s_addr];
+        c.rateLimitUpdateTime = 0;
+        c.lastOccupancyTime = g_schedulerTestTime;
+        it = _clients.find(s_addr);
+    }
+    BaselineClient& c = it->second;
+    c.priority = priority;
+    c.rateLimitRates.assign(rateLimitRates, rateLimitRates + rateLimitLength);
+    c.rateLimitBursts.assign(rateLimitBursts, rateLimitBursts + rateLimitLength);
+    c.rateLimitTokens.assign(rateLimitBursts, rateLimitBursts + rateLimitLength);
+    c.rateLimitObeyed = false;
+}
+
+void BaselineScheduler::UpdateTokens(BaselineClient& c, uint64_t now)
+{
+    if (c.pendingJobs.empty() || c.rateLimitObeyed) {
+        return;
+    }
+    BaselineJob* pJob = c.pendingJobs.front();
+    c.rateLimitObeyed = true;
+    // Tokens accrue with burst limits while the queue was empty
+    if (c.rateLimitUpdateTime < c.lastOccupancyTime) {
+        double elapsedTime = ConvertTimeToSeconds(c.lastOccupancyTime - c.rateLimitUpdateTime);
+        for (unsigned int i = 0; i < c.rateLimitRates.size(); i++) {
+            c.rateLimitTokens[i] += elapsedTime * c.rateLimitRates[i];
+            if (c.rateLimitTokens[i] > c.rateLimitBursts[i]) {
+                c.rateLimitTokens[i] = c.rateLimitBursts[i];
+            }
+        }
+        c.rateLimitUpdateTime = c.lastOccupancyTime;
+    }
+    // and without burst limits while it is not
+    double elapsedTime = ConvertTimeToSeconds(now - c.rateLimitUpdateTime);
+    c.rateLimitUpdateTime = now;
+    for (unsigned int i = 0; i < c.rateLimitRates.size(); i++) {
+        c.rateLimitTokens[i] += elapsedTime * c.rateLimitRates[i];
+        if (pJob->jobSize > c.rateLimitTokens[i]) {
+            c.rateLimitObeyed = false;
+        }
+    }
+}
+
+int BaselineScheduler::CompareClient(const BaselineClient& c1, const BaselineClient& c2)
+{
+    // Clients with pending jobs first
+    if (c1.pendingJobs.empty() || c2.pendingJobs.empty()) {
+        return (int)c2.pendingJobs.empty() - (int)c1.pendingJobs.empty();
+    }
+    // then immediate head jobs
+    BaselineJob* pJob1 = c1.pendingJobs.front();
+    BaselineJob* pJob2 = c2.pendingJobs.front();
+    if (pJob1->immediate != pJob2->immediate) {
+        return pJob1->immediate ? 1 : -1;
+    }
+    // then clients within their rate limits, by priority if both are
+    if (c1.rateLimitObeyed != c2.rateLimitObeyed) {
+        return c1.rateLimitObeyed ? 1 : -1;
+    }
+    if (c1.rateLimitObeyed && (c1.priority != c2.priority)) {
+        return (c1.priority < c2.priority) ? 1 : -1;
+    }
+    // then FCFS
+    if (pJob1->arrivalTime != pJob2->arrivalTime) {
+        return (pJob1->arrivalTime < pJob2->arrivalTime) ? 1 : -1;
+    }
+    return 0;
+}
+
+// The job's arrival time and size are set by the caller.
+void BaselineScheduler::SubmitJob(BaselineJob* pJob)
+{
+    BaselineClient& c = _clients[pJob->s_addr];
+    if (c.pendingJobs.empty()) {
+        c.lastOccupancyTime = pJob->arrivalTime;
+    }
+    c.pendingJobs.push_back(pJob);
+    _pendingJobCount++;
+}
+
+BaselineJob* BaselineScheduler::ScheduleJob()
+{
+    if (_pendingJobCount == 0) {
+        return NULL;
+    }
+    // Find the best client
+    uint64_t now = g_schedulerTestTime;
+    map<unsigned long, BaselineClient>::iterator bestClientIt = _clients.begin();
+    for (map<unsigned long, BaselineClient>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
+        UpdateTokens(it->second, now);
+        if (CompareClient(it->second, bestClientIt->second) > 0) {
+            bestClientIt = it;
+        }
+    }
+    BaselineClient& c = bestClientIt->second;
+    BaselineJob* pJob = c.pendingJobs.front();
+    // Check the outstanding limits
+    if (pJob->immediate) {
+        _maxOutstandingJobs++;
+    } else {
+        if (_outstandingJobs >= _maxOutstandingJobs) {
+            return NULL;
+        }
+        if (pJob->isRead || pJob->isWrite) {
+            int outstandingJobs = pJob->isRead ? _outstandingReadJobs : _outstandingWriteJobs;
+            int maxOutstandingJobs = pJob->isRead ? _maxOutstandingReadJobs : _maxOutstandingWriteJobs;
+            int outstandingBytes = pJob->isRead ? _outstandingReadBytes : _outstandingWriteBytes;
+            int maxOutstandingBytes = pJob->isRead ? _maxOutstandingReadBytes : _maxOutstandingWriteBytes;
+            uint64_t seqNum = pJob->isRead ? _seqNumRead : _seqNumWrite;
+            uint64_t seqNumBytes = pJob->isRead ? _seqNumReadBytes : _seqNumWriteBytes;
+            if (outstandingJobs >= maxOutstandingJobs) {
+                return NULL;
+            } else if ((outstandingBytes + pJob->requestSize) >= maxOutstandingBytes) {
+                return NULL;
+            }
+            // Starvation check against the oldest outstanding higher priority job
+            uint64_t oldestSeqNum = seqNum;
+            uint64_t oldestSeqNumBytes = seqNumBytes;
+            for (list<BaselineJob*>::iterator it = _outstandingPriorityList.begin(); it != _outstandingPriorityList.end(); it++) {
+                if ((*it)->priority < c.priority) {
+                    oldestSeqNum = pJob->isRead ? (*it)->seqNumRead : (*it)->seqNumWrite;
+                    oldestSeqNumBytes = pJob->isRead ? (*it)->seqNumReadBytes : (*it)->seqNumWriteBytes;
+                    break;
+                }
+            }
+            if (seqNum > (oldestSeqNum + maxOutstandingJobs)) {
+                return NULL;
+            } else if ((seqNumBytes + pJob->requestSize) >= (oldestSeqNumBytes + maxOutstandingBytes)) {
+                return NULL;
+            }
+        }
+    }
+    // Remove the job and charge its client's token buckets
+    c.pendingJobs.pop_front();
+    _pendingJobCount--;
+    pJob->rateLimitObeyed = c.rateLimitObeyed;
+    for (unsigned int i = 0; i < c.rateLimitTokens.size(); i++) {
+        c.rateLimitTokens[i] -= pJob->jobSize;
+        if (c.rateLimitTokens[i] < 0) {
+            c.rateLimitTokens[i] = 0;
+        }
+    }
+    c.rateLimitObeyed = false;
+    // Track the outstanding job
+    pJob->priority = c.priority;
+    pJob->seqNumRead = _seqNumRead;
+    pJob->seqNumWrite = _seqNumWrite;
+    pJob->seqNumReadBytes = _seqNumReadBytes;
+    pJob->seqNumWriteBytes = _seqNumWriteBytes;
+    if (pJob->rateLimitObeyed) {
+        _outstandingPriorityList.push_back(pJob);
+    }
+    _outstandingJobs++;
+    if (pJob->isRead) {
+        _seqNumRead++;
+        _seqNumReadBytes += pJob->requestSize;
+        _outstandingReadJobs++;
+        _outstandingReadBytes += pJob->requestSize;
+    } else if (pJob->isWrite) {
+        _seqNumWrite++;
+        _seqNumWriteBytes += pJob->requestSize;
+        _outstandingWriteJobs++;
+        _outstandingWriteBytes += pJob->requestSize;
+    }
+    return pJob;
+}
+
+void BaselineScheduler::CompleteJob(BaselineJob* pJob)
+{
+    if (pJob->immediate) {
+        _maxOutstandingJobs--;
+    }
+    _outstandingJobs--;
+    if (pJob->isRead) {
+        _outstandingReadJobs--;
+        _outstandingReadBytes -= pJob->requestSize;
+    } else if (pJob->isWrite) {
+        _outstandingWriteJobs--;
+        _outstandingWriteBytes -= pJob->requestSize;
+    }
+    if (pJob->rateLimitObeyed) {
+        for (list<BaselineJob*>::iterator it = _outstandingPriorityList.begin(); it != _outstandingPriorityList.end(); it++) {
+            if (*it == pJob) {
+                _outstandingPriorityList.erase(it);
+                break;
+            }
+        }
+    }
+}
+
+// Parameters of a random scheduler test
+struct SchedulerTestConfig {
+    unsigned long numClients;
+    int maxOutstandingReadBytes;
+    int maxOutstandingWriteBytes;
+    int maxReadJobs;
+    int maxWriteJobs;
+    unsigned int numPriorities;
+    bool rateLimits; // whether clients have rate limits
+    double rateScale; // rate limits are multiples of rateScale up to 50 * rateScale
+    bool zeroRates; // whether some rate limits have no rate, so that they are covered only by their bursts
+    uint64_t maxTimeStep; // max time in nanoseconds between operations
+    bool batches; // whether jobs are submitted on random connections and submitted/completed in batches between dispatches
+    unsigned int numSteps;
+};
+
+// Pending and outstanding jobs of both schedulers
+struct SchedulerTestJobs {
+    deque<BaselineJob> baselineJobs; // by xid
+    vector<Job*> outstandingJobs;
+    vector<BaselineJob*> baselineOutstandingJobs;
+    unsigned int numDispatched;
+};
+
+// Submit the same random job to both schedulers.
+static void SchedulerTestSubmit(Scheduler& s, BaselineScheduler& b, SchedulerTestJobs& jobs, const SchedulerTestConfig& config)
+{
+    Job* pJob = new Job();
+    int op = rand() % 20;
+    pJob->rq_proc = (op == 0) ? NFSPROC3_GETATTR : ((op % 2) ? NFSPROC3_READ : NFSPROC3_WRITE);
+    pJob->s_addr = rand() % config.numClients;
+    pJob->fd = config.batches ? rand() : pJob->s_addr;
+    pJob->immediate = ((rand() % 25) == 0);
+    pJob->requestSize = 4096 * (1 + rand() % 16);
+    pJob->xid = jobs.baselineJobs.size();
+    s.SubmitJob(pJob);
+    // The job is not added to the Scheduler's queues until the next TryGetNextJob, so its arrival time and size can still be read
+    BaselineJob baselineJob;
+    baselineJob.xid = pJob->xid;
+    baselineJob.s_addr = pJob->s_addr;
+    baselineJob.immediate = pJob->immediate;
+    baselineJob.isRead = pJob->IsReadRequest();
+    baselineJob.isWrite = pJob->IsWriteRequest();
+    baselineJob.requestSize = pJob->requestSize;
+    baselineJob.arrivalTime = pJob->arrivalTime;
+    baselineJob.jobSize = pJob->jobSize;
+    jobs.baselineJobs.push_back(baselineJob);
+    b.SubmitJob(&jobs.baselineJobs.back());
+}
+
+// Schedule a job in both schedulers, checking that they pick the same one. Returns whether a job was scheduled.
+static bool SchedulerTestDispatch(Scheduler& s, BaselineScheduler& b, SchedulerTestJobs& jobs)
+{
+    Job* pJob = s.TryGetNextJob();
+    BaselineJob* pBaselineJob = b.ScheduleJob();
+    assert((pJob == NULL) == (pBaselineJob == NULL));
+    if (pJob == NULL) {
+        return false;
+    }
+    assert(pJob->xid == pBaselineJob->xid);
+    assert(pJob->rateLimitObeyed == pBaselineJob->rateLimitObeyed);
+    jobs.outstandingJobs.push_back(pJob);
+    jobs.baselineOutstandingJobs.push_back(pBaselineJob);
+    jobs.numDispatched++;
+    return true;
+}
+
+// Complete the same outstanding job in both schedulers.
+static void SchedulerTestComplete(Scheduler& s, BaselineScheduler& b, SchedulerTestJobs& jobs, unsigned int index)
+{
+    s.CompleteJob(jobs.outstandingJobs[index], false);
+    b.CompleteJob(jobs.baselineOutstandingJobs[index]);
+    jobs.outstandingJobs.erase(jobs.outstandingJobs.begin() + index);
+    jobs.baselineOutstandingJobs.erase(jobs.baselineOutstandingJobs.begin() + index);
+}
+
+// Feed the same random sequence of submissions, dispatches, and completions to the Scheduler and to BaselineScheduler,
+// checking that they dispatch the same jobs in the same order.
+static void SchedulerRandomTest(unsigned int seed, const SchedulerTestConfig& config)
+{
+    srand(seed);
+    g_schedulerTestTime = ConvertSecondsToTime(1);
+    Json::Value estimatorInfo;
+    estimatorInfo["name"] = Json::Value("testEstimator");
+    estimatorInfo["type"] = Json::Value("networkIn");
+    estimatorInfo["nonDataConstant"] = Json::Value(100);
+    estimatorInfo["nonDataFactor"] = Json::Value(0.01);
+    estimatorInfo["dataConstant"] = Json::Value(100);
+    estimatorInfo["dataFactor"] = Json::Value(1.0);
+    Estimator* pEst = Estimator::create(estimatorInfo);
+    {
+        Scheduler s(vector<CLIENT*>(), config.maxOutstandingReadBytes, config.maxOutstandingWriteBytes, config.maxReadJobs, config.maxWriteJobs, pEst,
+                    SchedulerTestTime);
+        BaselineScheduler b(config.maxOutstandingReadBytes, config.maxOutstandingWriteBytes, config.maxReadJobs, config.maxWriteJobs);
+        // Configure clients before they have jobs; the Scheduler restarts the token buckets of backlogged clients, which the baseline did not
+        for (unsigned long s_addr = 0; s_addr < config.numClients; s_addr++) {
+            unsigned int priority = rand() % config.numPriorities;
+            int rateLimitLength = config.rateLimits ? (1 + rand() % 2) : 0;
+            double rates[2];
+            double bursts[2];
+            for (int i = 0; i < rateLimitLength; i++) {
+                rates[i] = config.rateScale * (1 + rand() % 50);
+                if (config.zeroRates && ((rand() % 10) == 0)) {
+                    rates[i] = 0;
+                }
+                bursts[i] = 1e4 * (1 + rand() % 20);
+            }
+            s.UpdateClient(s_addr, priority, rateLimitLength, rates, bursts, "");
+            b.UpdateClient(s_addr, priority, rateLimitLength, rates, bursts);
+        }
+        SchedulerTestJobs jobs;
+        jobs.numDispatched = 0;
+        for (unsigned int step = 0; step < config.numSteps; step++) {
+            g_schedulerTestTime += rand() % config.maxTimeStep;
+            int op = rand() % 10;
+            if (!config.batches) {
+                if (op < 4) {
+                    SchedulerTestSubmit(s, b, jobs, config);
+                } else if (op < 7) {
+                    SchedulerTestDispatch(s, b, jobs);
+                } else if (!jobs.outstandingJobs.empty()) {
+                    SchedulerTestComplete(s, b, jobs, rand() % jobs.outstandingJobs.size());
+                }
+            } else if (op < 4) {
+                // Jobs of a client may be on different submission queues, which are merged by arrival time, so arrival times are kept distinct
+                int batchSize = 1 + rand() % 8;
+                for (int i = 0; i < batchSize; i++) {
+                    g_schedulerTestTime += 1 + rand() % 1000;
+                    SchedulerTestSubmit(s, b, jobs, config);
+                }
+            } else if (op < 7) {
+                SchedulerTestDispatch(s, b, jobs);
+            } else {
+                int batchSize = 1 + rand() % 4;
+                for (int i = 0; (i < batchSize) && !jobs.outstandingJobs.empty(); i++) {
+                    SchedulerTestComplete(s, b, jobs, rand() % jobs.outstandingJobs.size());
+                }
+            }
+        }
+        // Drain the remaining jobs
+        while (true) {
+            g_schedulerTestTime += rand() % config.maxTimeStep;
+            if (!SchedulerTestDispatch(s, b, jobs)) {
+                if (jobs.outstandingJobs.empty()) {
+                    break;
+                }
+                SchedulerTestComplete(s, b, jobs, 0);
+            }
+        }
+        assert(jobs.numDispatched == jobs.baselineJobs.size());
+        for (unsigned long s_addr = 0; s_addr < config.numClients; s_addr++) {
+            assert(s.GetNumPendingJobs(s_addr) == 0);
+        }
+    }
+    delete pEst;
+}
+
+#define SCHEDULER_TEST_SUBMITTERS 4
+#define SCHEDULER_TEST_WORKERS 4
+#define SCHEDULER_TEST_JOBS 20000
+#define SCHEDULER_TEST_CLIENTS 16
+
+struct SchedulerTestThreads {
+    Scheduler* pScheduler;
+    volatile int dispatchCounts[SCHEDULER_TEST_SUBMITTERS * SCHEDULER_TEST_JOBS]; // by xid
+    volatile int numDispatched;
+};
+
+struct SchedulerTestSubmitter {
+    SchedulerTestThreads* pThreads;
+    unsigned int index;
+};
+
+static void* SchedulerTestSubmitterThread(void* ptr)
+{
+    SchedulerTestSubmitter* pSubmitter = static_cast<SchedulerTestSubmitter*>(ptr);
+    for (unsigned int i = 0; i < SCHEDULER_TEST_JOBS; i++) {
+        Job* pJob = new Job();
+        pJob->rq_proc = (i % 2) ? NFSPROC3_READ : NFSPROC3_WRITE;
+        pJob->xid = pSubmitter->index * SCHEDULER_TEST_JOBS + i;
+        pJob->s_addr = pJob->xid % SCHEDULER_TEST_CLIENTS;
+        pJob->fd = pSubmitter->index;
+        pJob->immediate = ((i % 100) == 0);
+        pJob->requestSize = 4096;
+        pSubmitter->pThreads->pScheduler->SubmitJob(pJob);
+    }
+    return NULL;
+}
+
+// Dispatch and complete jobs until a job with no client (i.e., s_addr SCHEDULER_TEST_CLIENTS) is dispatched.
+static void* SchedulerTestWorkerThread(void* ptr)
+{
+    SchedulerTestThreads* pThreads = static_cast<SchedulerTestThreads*>(ptr);
+    while (true) {
+        Job* pJob = pThreads->pScheduler->GetNextJob();
+        bool done = (pJob->s_addr == SCHEDULER_TEST_CLIENTS);
+        if (!done) {
+            __sync_fetch_and_add(&pThreads->dispatchCounts[pJob->xid], 1);
+            __sync_fetch_and_add(&pThreads->numDispatched, 1);
+        }
+        pThreads->pScheduler->CompleteJob(pJob, false);
+        if (done) {
+            return NULL;
+        }
+    }
+}
+
+// Submit and complete jobs from multiple threads, checking that every job is dispatched exactly once.
+static void SchedulerConcurrentTest()
+{
+    Json::Value estimatorInfo;
+    estimatorInfo["name"] = Json::Value("testEstimator");
+    estimatorInfo["type"] = Json::Value("networkIn");
+    estimatorInfo["nonDataConstant"] = Json::Value(100);
+    estimatorInfo["nonDataFactor"] = Json::Value(0.01);
+    estimatorInfo["dataConstant"] = Json::Value(100);
+    estimatorInfo["dataFactor"] = Json::Value(1.0);
+    Estimator* pEst = Estimator::create(estimatorInfo);
+    {
+        Scheduler s(vector<CLIENT*>(), 1 << 20, 1 << 20, 4, 4, pEst);
+        SchedulerTestThreads* pThreads = new SchedulerTestThreads();
+        pThreads->pScheduler = &s;
+        SchedulerTestSubmitter submitters[SCHEDULER_TEST_SUBMITTERS];
+        pthread_t submitterThreads[SCHEDULER_TEST_SUBMITTERS];
+        pthread_t workerThreads[SCHEDULER_TEST_WORKERS];
+        for (unsigned int w = 0; w < SCHEDULER_TEST_WORKERS; w++) {
+            int rc = pthread_create(&workerThreads[w], NULL, SchedulerTestWorkerThread, pThreads);
+            assert(rc == 0);
+        }
+        for (unsigned int p = 0; p < SCHEDULER_TEST_SUBMITTERS; p++) {
+            submitters[p].pThreads = pThreads;
+            submitters[p].index = p;
+            int rc = pthread_create(&submitterThreads[p], NULL, SchedulerTestSubmitterThread, &submitters[p]);
+            assert(rc == 0);
+        }
+        for (unsigned int p = 0; p < SCHEDULER_TEST_SUBMITTERS; p++) {
+            pthread_join(submitterThreads[p], NULL);
+        }
+        // Stop the workers once every job has been dispatched, so that each of them gets one of the stop jobs
+        while (pThreads->numDispatched < SCHEDULER_TEST_SUBMITTERS * SCHEDULER_TEST_JOBS) {
+            sched_yield();
+        }
+        for (unsigned int w = 0; w < SCHEDULER_TEST_WORKERS; w++) {
+            Job* pJob = new Job();
+            pJob->rq_proc = NFSPROC3_NULL;
+            pJob->xid = 0;
+            pJob->s_addr = SCHEDULER_TEST_CLIENTS;
+            pJob->fd = w;
+            pJob->immediate = false;
+            pJob->requestSize = 0;
+            s.SubmitJob(pJob);
+        }
+        for (unsigned int w = 0; w < SCHEDULER_TEST_WORKERS; w++) {
+            pthread_join(workerThreads[w], NULL);
+        }
+        for (unsigned int i = 0; i < SCHEDULER_TEST_SUBMITTERS * SCHEDULER_TEST_JOBS; i++) {
+            assert(pThreads->dispatchCounts[i] == 1);
+        }
+        for (unsigned long s_addr = 0; s_addr <= SCHEDULER_TEST_CLIENTS; s_addr++) {
+            assert(s.GetNumPendingJobs(s_addr) == 0);
+        }
+        delete pThreads;
+    }
+    delete pEst;
+}
+
+void SchedulerTest()
+{
+    SchedulerTestConfig config;
+    config.numClients = 12;
+    config.maxOutstandingReadBytes = 1 << 30;
+    config.maxOutstandingWriteBytes = 1 << 30;
+    config.maxReadJobs = 1 << 20;
+    config.maxWriteJobs = 1 << 20;
+    config.numPriorities = 3;
+    config.maxTimeStep = 200000;
+    config.numSteps = 20000;
+    // Ordering by immediate flag, priority, and FCFS without rate limits
+    config.batches = false;
+    config.rateLimits = false;
+    config.rateScale = 0;
+    config.zeroRates = false;
+    for (unsigned int seed = 1; seed <= 5; seed++) {
+        SchedulerRandomTest(seed, config);
+    }
+    // Ordering with clients within and over their rate limits
+    config.rateLimits = true;
+    config.rateScale = 1e5;
+    config.zeroRates = false;
+    for (unsigned int seed = 1; seed <= 5; seed++) {
+        SchedulerRandomTest(seed, config);
+    }
+    // Rate limit timers spanning the timer wheel's levels (up to ~65 s at the lowest rate), and token buckets with no rate
+    config.rateScale = 1e3;
+    config.zeroRates = true;
+    config.maxTimeStep = ConvertSecondsToTime(2);
+    for (unsigned int seed = 1; seed <= 5; seed++) {
+        SchedulerRandomTest(seed, config);
+    }
+    // Tight outstanding job and byte limits, so that jobs are held back by the limits and by the starvation check against the oldest
+    // outstanding higher priority job while jobs complete out of order
+    config.maxOutstandingReadBytes = 1 << 17;
+    config.maxOutstandingWriteBytes = 1 << 17;
+    config.maxReadJobs = 4;
+    config.maxWriteJobs = 4;
+    config.numPriorities = 4;
+    config.rateScale = 1e5;
+    config.zeroRates = false;
+    config.maxTimeStep = 200000;
+    for (unsigned int seed = 1; seed <= 5; seed++) {
+        config.rateLimits = false;
+        SchedulerRandomTest(seed, config);
+        config.rateLimits = true;
+        SchedulerRandomTest(seed, config);
+    }
+    // Submissions spread over the submission queues and completions applied in batches when the queues are drained
+    config.batches = true;
+    for (unsigned int seed = 1; seed <= 5; seed++) {
+        SchedulerRandomTest(seed, config);
+    }
+    SchedulerConcurrentTest();
+    cout << "PASS SchedulerTest" << endl;
+}
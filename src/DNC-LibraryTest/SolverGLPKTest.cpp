@@ -4,10 +4,16 @@
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+#include <unistd.h>
 #include <json/json.h>
 #include "../DNC-Library/Solver.hpp"
+#include "../DNC-Library/SolverRecorder.hpp"
 #include "DNC-LibraryTest.hpp"
 
 using namespace std;
@@ -73,5 +79,155 @@ void SolverGLPKTest()
     assert(approxEqual(s.getSolutionVariable(x), 8.0, epsilon));
     assert(approxEqual(s.getSolutionVariable(y), 0.0, epsilon));
     assert(approxEqual(s.getSolutionVariable(z), 8.0, epsilon));
+
+    // Constraints added in bulk
+    SolverGLPK b;
+    b.setObjectiveDirection(OBJECTIVE_MAX);
+    VariableHandle bx = b.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+    VariableHandle by = b.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+    b.setObjectiveCoeff(1, bx);
+    b.setObjectiveCoeff(1, by);
+    SparseConstraints rows;
+    rows.append(1, bx);
+    rows.append(2, by);
+    rows.endConstraint(CONSTRAINT_LE, 8); // x + 2*y <= 8
+    rows.append(3, bx);
+    rows.append(1, by);
+    rows.endConstraint(CONSTRAINT_LE, 9); // 3*x + y <= 9
+    vector<ConstraintHandle> handles;
+    b.addConstraints(rows, handles);
+    assert(handles.size() == 2);
+    assert(b.solve());
+    assert(approxEqual(b.getSolution(), 5.0, epsilon));
+    assert(approxEqual(b.getSolutionVariable(bx), 2.0, epsilon));
+    assert(approxEqual(b.getSolutionVariable(by), 3.0, epsilon));
+    b.changeRHS(handles[1], 4); // 3*x + y <= 4
+    assert(b.solve());
+    assert(approxEqual(b.getSolution(), 4.0, epsilon));
+    assert(approxEqual(b.getSolutionVariable(bx), 0.0, epsilon));
+    assert(approxEqual(b.getSolutionVariable(by), 4.0, epsilon));
+
+    // ConstraintExpression copies and swaps
+    {
+        ConstraintExpression e1(2);
+        e1.append(1, x);
+        e1.append(2, y);
+        ConstraintExpression e2;
+        e2 = e1;
+        assert((e2.count == 2) && (e2.coeffs != e1.coeffs) && (e2.coeffs[1] == 2) && (e2.vars[1] == y));
+        ConstraintExpression e3;
+        e3.swap(e1);
+        assert((e1.count == 0) && (e1.coeffs == NULL) && (e3.count == 2) && (e3.vars[0] == x));
+    }
+
+    // Warm started solves after adding and deleting variables and constraints
+    SolverGLPK w;
+    w.setWarmStart(true);
+    w.setObjectiveDirection(OBJECTIVE_MAX);
+    VariableHandle wx = w.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+    VariableHandle wy = w.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+    ConstraintHandle wc;
+    {
+        double coeffs[] = {1, 2};
+        VariableHandle vars[] = {wx, wy};
+        wc = w.addConstraint(2, coeffs, vars, CONSTRAINT_LE, 8, NULL); // x + 2*y <= 8
+    }
+    w.setObjectiveCoeff(1, wx);
+    w.setObjectiveCoeff(1, wy);
+    assert(w.solve());
+    assert(approxEqual(w.getSolution(), 8.0, epsilon));
+
+    VariableHandle wz = w.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+    {
+        double coeffs[] = {1};
+        ConstraintHandle constraints[] = {wc};
+        w.setVariableCoeffs(wz, 1, coeffs, constraints); // x + 2*y + z <= 8
+    }
+    w.setObjectiveCoeff(3, wz);
+    assert(w.solve());
+    assert(approxEqual(w.getSolution(), 24.0, epsilon));
+    assert(approxEqual(w.getSolutionVariable(wz), 8.0, epsilon));
+
+    w.delVariables(1, &wz);
+    ConstraintHandle wc2;
+    {
+        double coeffs[] = {1};
+        VariableHandle vars[] = {wx};
+        wc2 = w.addConstraint(1, coeffs, vars, CONSTRAINT_LE, 2, NULL); // x <= 2
+    }
+    assert(w.solve());
+    assert(approxEqual(w.getSolution(), 5.0, epsilon));
+    assert(approxEqual(w.getSolutionVariable(wx), 2.0, epsilon));
+    assert(approxEqual(w.getSolutionVariable(wy), 3.0, epsilon));
+
+    w.delConstraints(1, &wc2);
+    w.delVariables(1, &wy);
+    assert(w.solve());
+    assert(approxEqual(w.getSolution(), 8.0, epsilon));
+    assert(approxEqual(w.getSolutionVariable(wx), 8.0, epsilon));
+
+    // Solver backends are created by name
+    {
+        vector<string> names = getSolverNames();
+        assert(find(names.begin(), names.end(), defaultSolverName) != names.end());
+        assert(find(names.begin(), names.end(), "glpk-simplex") != names.end());
+        assert(createSolver("unknownSolver") == NULL);
+        assert(!registerSolver(defaultSolverName, NULL));
+        for (unsigned int i = 0; i < names.size(); i++) {
+            Solver* pSolver = createSolver(names[i]);
+            assert(pSolver != NULL);
+            CapturedLP lp;
+            lp.direction = OBJECTIVE_MAX;
+            lp.lbs.assign(2, 0);
+            lp.ubs.assign(2, 10);
+            lp.types.assign(2, VAR_CONTINUOUS);
+            lp.objCoeffs.assign(2, 1);
+            lp.constraints = rows; // x + 2*y <= 8, 3*x + y <= 9
+            lp.constraints.vars[0] = lp.constraints.vars[2] = 0;
+            lp.constraints.vars[1] = lp.constraints.vars[3] = 1;
+            vector<VariableHandle> vars;
+            lp.load(*pSolver, vars);
+            assert(pSolver->solve());
+            assert(approxEqual(pSolver->getSolution(), 5.0, epsilon));
+            delete pSolver;
+        }
+    }
+
+    // Solved LPs are captured and can be replayed
+    {
+        const char* captureFilename = "testLPCapture.txt";
+        unlink(captureFilename);
+        SolverRecorder r(new SolverGLPK(), captureFilename);
+        r.setObjectiveDirection(OBJECTIVE_MAX);
+        VariableHandle rx = r.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+        VariableHandle ry = r.addVariable(0, numeric_limits<double>::infinity(), VAR_CONTINUOUS, NULL);
+        r.setObjectiveCoeff(1, rx);
+        r.setObjectiveCoeff(1, ry);
+        SparseConstraints rRows;
+        rRows.append(1, rx);
+        rRows.append(2, ry);
+        rRows.endConstraint(CONSTRAINT_LE, 8); // x + 2*y <= 8
+        vector<ConstraintHandle> rHandles;
+        r.addConstraints(rRows, rHandles);
+        assert(r.solve());
+        assert(approxEqual(r.getSolution(), 8.0, epsilon));
+        double coeffs[] = {1};
+        r.addConstraint(1, coeffs, &rx, CONSTRAINT_LE, 4, NULL); // x <= 4
+        assert(r.solve());
+        assert(approxEqual(r.getSolution(), 6.0, epsilon));
+        vector<CapturedLP> lps;
+        assert(readCapturedLPs(lps, captureFilename));
+        assert(lps.size() == 2);
+        assert(lps[0].constraints.size() == 1);
+        assert(lps[1].constraints.size() == 2);
+        assert(lps[1].ubs[1] == numeric_limits<double>::infinity());
+        SolverGLPK replay;
+        vector<VariableHandle> vars;
+        lps[1].load(replay, vars);
+        assert(replay.solve());
+        assert(approxEqual(replay.getSolution(), 6.0, epsilon));
+        assert(approxEqual(replay.getSolutionVariable(vars[0]), 4.0, epsilon));
+        unlink(captureFilename);
+    }
     cout << "PASS SolverGLPKTest" << endl;
 }
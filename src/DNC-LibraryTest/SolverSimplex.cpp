@@ -0,0 +1,428 @@
+// SolverSimplex.cpp - Self-contained dense simplex solver for linear programs (LPs).
+// See SolverSimplex.hpp for details.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "SolverSimplex.hpp"
+#include "../common/SpanTrace.hpp"
+
+using namespace std;
+
+// Tolerances for pivot elements, reduced costs, and the phase 1 infeasibility
+const double simplexPivotTolerance = 1e-9;
+const double simplexOptimalityTolerance = 1e-9;
+const double simplexFeasibilityTolerance = 1e-7;
+// Number of consecutive degenerate pivots after which Bland's rule is used to avoid cycling
+const unsigned int simplexDegenerateLimit = 50;
+
+// Dense tableau of the bounded-variable simplex method for min sum_j cost[j]*x[j] s.t. A*x = b, lb <= x <= ub.
+// Row i of the tableau is row i of B^-1 * A for the current basis B, and nonbasic variables are at a bound (or 0 if free).
+class SimplexTableau
+{
+public:
+    int numRows;
+    int numCols;
+    vector<double> t; // row-major numRows x numCols tableau
+    vector<double> lb;
+    vector<double> ub;
+    vector<double> x; // current values of all variables
+    vector<double> cost;
+    vector<double> d; // reduced costs
+    vector<int> head; // row -> basic variable
+    vector<bool> basic; // variable -> whether it is basic
+
+    SimplexTableau(int rows, int cols)
+        : numRows(rows),
+          numCols(cols),
+          t(static_cast<size_t>(rows) * cols, 0),
+          lb(cols, 0),
+          ub(cols, 0),
+          x(cols, 0),
+          cost(cols, 0),
+          d(cols, 0),
+          head(rows, 0),
+          basic(cols, false)
+    {}
+    double& at(int row, int col) {
+        return t[static_cast<size_t>(row) * numCols + col];
+    }
+    // Compute the reduced costs of the current costs and basis
+    void price();
+    // Pivot column col into the basis at row
+    void pivot(int row, int col);
+    // Run the simplex method from the current basis. Returns false if the LP is unbounded or the iteration limit is reached.
+    bool run();
+};
+
+void SimplexTableau::price()
+{
+    for (int col = 0; col < numCols; col++) {
+        d[col] = cost[col];
+    }
+    for (int row = 0; row < numRows; row++) {
+        double c = cost[head[row]];
+        if (c != 0) {
+            const double* r = &t[static_cast<size_t>(row) * numCols];
+            for (int col = 0; col < numCols; col++) {
+                d[col] -= c * r[col];
+            }
+        }
+    }
+    for (int row = 0; row < numRows; row++) {
+        d[head[row]] = 0;
+    }
+}
+
+void SimplexTableau::pivot(int row, int col)
+{
+    double* pivotRow = &t[static_cast<size_t>(row) * numCols];
+    double pivotElement = pivotRow[col];
+    for (int j = 0; j < numCols; j++) {
+        pivotRow[j] /= pivotElement;
+    }
+    pivotRow[col] = 1;
+    for (int i = 0; i < numRows; i++) {
+        if (i == row) {
+            continue;
+        }
+        double* r = &t[static_cast<size_t>(i) * numCols];
+        double factor = r[col];
+        if (factor != 0) {
+            for (int j = 0; j < numCols; j++) {
+                r[j] -= factor * pivotRow[j];
+            }
+            r[col] = 0;
+        }
+    }
+    double factor = d[col];
+    if (factor != 0) {
+        for (int j = 0; j < numCols; j++) {
+            d[j] -= factor * pivotRow[j];
+        }
+    }
+    d[col] = 0;
+    basic[head[row]] = false;
+    basic[col] = true;
+    head[row] = col;
+}
+
+bool SimplexTableau::run()
+{
+    const double inf = numeric_limits<double>::infinity();
+    price();
+    unsigned int degenerateCount = 0;
+    unsigned long maxIterations = 100 * static_cast<unsigned long>(numRows + numCols) + 1000;
+    for (unsigned long iteration = 0; iteration < maxIterations; iteration++) {
+        // Choose the entering variable: the largest reduced cost (Dantzig's rule), or the first one under Bland's rule
+        bool bland = (degenerateCount >= simplexDegenerateLimit);
+        int enter = -1;
+        double enterDir = 0;
+        double best = 0;
+        for (int col = 0; col < numCols; col++) {
+            if (basic[col]) {
+                continue;
+            }
+            double dir = 0;
+            if ((d[col] < -simplexOptimalityTolerance) && (x[col] < ub[col])) {
+                dir = 1;
+            } else if ((d[col] > simplexOptimalityTolerance) && (x[col] > lb[col])) {
+                dir = -1;
+            }
+            if ((dir != 0) && (fabs(d[col]) > best)) {
+                enter = col;
+                enterDir = dir;
+                best = fabs(d[col]);
+                if (bland) {
+                    break;
+                }
+            }
+        }
+        if (enter < 0) {
+            return true;
+        }
+        // Ratio test: the entering variable moves until it reaches its other bound or a basic variable reaches a bound
+        double step = ub[enter] - lb[enter];
+        int leave = -1;
+        double leaveAlpha = 0;
+        for (int row = 0; row < numRows; row++) {
+            double alpha = at(row, enter) * enterDir;
+            int var = head[row];
+            double limit = inf;
+            if ((alpha > simplexPivotTolerance) && (lb[var] > -inf)) {
+                limit = max((x[var] - lb[var]) / alpha, 0.0);
+            } else if ((alpha < -simplexPivotTolerance) && (ub[var] < inf)) {
+                limit = max((ub[var] - x[var]) / -alpha, 0.0);
+            }
+            if (limit == inf) {
+                continue;
+            }
+            // Break ties by the larger pivot element for stability, or by the lower variable under Bland's rule
+            bool better = (limit < step);
+            if ((limit == step) && (leave >= 0)) {
+                better = bland ? (var < head[leave]) : (fabs(alpha) > leaveAlpha);
+            }
+            if (better) {
+                step = limit;
+                leave = row;
+                leaveAlpha = fabs(alpha);
+            }
+        }
+        if (step == inf) {
+            return false; // unbounded
+        }
+        degenerateCount = (step == 0) ? (degenerateCount + 1) : 0;
+        // Update values
+        x[enter] += enterDir * step;
+        for (int row = 0; row < numRows; row++) {
+            x[head[row]] -= at(row, enter) * enterDir * step;
+        }
+        if (leave < 0) {
+            // Entering variable moved to its other bound
+            x[enter] = (enterDir > 0) ? ub[enter] : lb[enter];
+            continue;
+        }
+        int var = head[leave];
+        x[var] = ((at(leave, enter) * enterDir) > 0) ? lb[var] : ub[var];
+        pivot(leave, enter);
+    }
+    return false;
+}
+
+SolverSimplex::SolverSimplex()
+    : direction(OBJECTIVE_MIN),
+      objective(0)
+{
+}
+
+SolverSimplex::~SolverSimplex()
+{
+}
+
+VariableHandle SolverSimplex::addVariable(double lb, double ub, enum VarType type, const char* name)
+{
+    Column column;
+    column.lb = lb;
+    column.ub = ub;
+    column.type = type;
+    column.objCoeff = 0;
+    column.deleted = false;
+    columns.push_back(column);
+    return columns.size() - 1;
+}
+
+ConstraintHandle SolverSimplex::addConstraint(int count, const double* coeffs, const VariableHandle* vars, enum ConstraintType type, double rhs, const char* name)
+{
+    ConstraintHandle constraint = rows.size();
+    Row row;
+    row.type = type;
+    row.rhs = rhs;
+    row.deleted = false;
+    rows.push_back(row);
+    for (int i = 0; i < count; i++) {
+        columns[vars[i]].coeffs.push_back(make_pair(constraint, coeffs[i]));
+    }
+    return constraint;
+}
+
+void SolverSimplex::addConstraints(const SparseConstraints& constraints, vector<ConstraintHandle>& handles)
+{
+    handles.reserve(handles.size() + constraints.size());
+    for (int i = 0; i < constraints.size(); i++) {
+        int start = constraints.rowStarts[i];
+        int len = constraints.rowStarts[i + 1] - start;
+        handles.push_back(addConstraint(len, (len > 0) ? &constraints.coeffs[start] : NULL, (len > 0) ? &constraints.vars[start] : NULL, constraints.types[i], constraints.rhs[i], NULL));
+    }
+}
+
+void SolverSimplex::setObjectiveDirection(enum ObjectiveType type)
+{
+    direction = type;
+}
+
+void SolverSimplex::setObjectiveCoeff(double coeff, VariableHandle var)
+{
+    columns[var].objCoeff = coeff;
+}
+
+// Each row i becomes sum_j a_ij*x_j + s_i + a_i = rhs_i with a slack s_i bounded by the constraint type
+// and an artificial a_i that is initially basic and covers the residual of the nonbasic variables at their bounds.
+// Phase 1 minimizes the sum of the (signed) artificials to find a feasible basis, and phase 2 fixes them at 0 and minimizes the objective.
+bool SolverSimplex::solve()
+{
+    TRACE_SPAN("SolverSimplex::solve");
+    const double inf = numeric_limits<double>::infinity();
+    // Number the remaining constraints and variables
+    vector<int> rowNums(rows.size(), -1);
+    int numRows = 0;
+    for (unsigned int i = 0; i < rows.size(); i++) {
+        if (!rows[i].deleted) {
+            rowNums[i] = numRows++;
+        }
+    }
+    vector<VariableHandle> vars;
+    for (unsigned int j = 0; j < columns.size(); j++) {
+        if (!columns[j].deleted) {
+            if (columns[j].type != VAR_CONTINUOUS) {
+                return false;
+            }
+            vars.push_back(j);
+        }
+    }
+    int numVars = vars.size();
+    int slackStart = numVars;
+    int artificialStart = numVars + numRows;
+    SimplexTableau tableau(numRows, numVars + 2 * numRows);
+    // Variables start at a finite bound
+    for (int k = 0; k < numVars; k++) {
+        Column& column = columns[vars[k]];
+        tableau.lb[k] = column.lb;
+        tableau.ub[k] = column.ub;
+        tableau.x[k] = (column.lb > -inf) ? column.lb : ((column.ub < inf) ? column.ub : 0);
+        // Drop coefficients of deleted constraints
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < column.coeffs.size(); i++) {
+            int row = rowNums[column.coeffs[i].first];
+            if (row >= 0) {
+                tableau.at(row, k) += column.coeffs[i].second;
+                column.coeffs[count++] = column.coeffs[i];
+            }
+        }
+        column.coeffs.resize(count);
+    }
+    vector<double> rhs(numRows);
+    for (unsigned int i = 0; i < rows.size(); i++) {
+        int row = rowNums[i];
+        if (row < 0) {
+            continue;
+        }
+        int slack = slackStart + row;
+        tableau.lb[slack] = (rows[i].type == CONSTRAINT_GE) ? -inf : 0;
+        tableau.ub[slack] = (rows[i].type == CONSTRAINT_LE) ? inf : 0;
+        tableau.at(row, slack) = 1;
+        rhs[row] = rows[i].rhs;
+    }
+    for (int row = 0; row < numRows; row++) {
+        double residual = rhs[row];
+        for (int k = 0; k < numVars; k++) {
+            residual -= tableau.at(row, k) * tableau.x[k];
+        }
+        // Negate rows with a negative residual so that the artificial is nonnegative in the initial basis
+        if (residual < 0) {
+            for (int col = 0; col < artificialStart; col++) {
+                tableau.at(row, col) = -tableau.at(row, col);
+            }
+        }
+        int artificial = artificialStart + row;
+        tableau.at(row, artificial) = 1;
+        tableau.lb[artificial] = 0;
+        tableau.ub[artificial] = inf;
+        tableau.x[artificial] = fabs(residual);
+        tableau.cost[artificial] = 1;
+        tableau.head[row] = artificial;
+        tableau.basic[artificial] = true;
+    }
+    // Phase 1
+    if (!tableau.run()) {
+        return false;
+    }
+    double scale = 1;
+    double infeasibility = 0;
+    for (int row = 0; row < numRows; row++) {
+        scale = max(scale, fabs(rhs[row]));
+        infeasibility += tableau.x[artificialStart + row];
+    }
+    if (infeasibility > simplexFeasibilityTolerance * scale) {
+        return false;
+    }
+    // Phase 2
+    for (int row = 0; row < numRows; row++) {
+        int artificial = artificialStart + row;
+        tableau.ub[artificial] = 0;
+        tableau.cost[artificial] = 0;
+        if (!tableau.basic[artificial]) {
+            tableau.x[artificial] = 0;
+        }
+    }
+    for (int k = 0; k < numVars; k++) {
+        double objCoeff = columns[vars[k]].objCoeff;
+        tableau.cost[k] = (direction == OBJECTIVE_MAX) ? -objCoeff : objCoeff;
+    }
+    if (!tableau.run()) {
+        return false;
+    }
+    values.assign(columns.size(), 0);
+    objective = 0;
+    for (int k = 0; k < numVars; k++) {
+        // Clamp rounding errors into the variable's bounds
+        double value = max(min(tableau.x[k], tableau.ub[k]), tableau.lb[k]);
+        values[vars[k]] = value;
+        objective += columns[vars[k]].objCoeff * value;
+    }
+    return true;
+}
+
+double SolverSimplex::getSolution()
+{
+    return objective;
+}
+
+double SolverSimplex::getSolutionVariable(VariableHandle var)
+{
+    return (static_cast<unsigned int>(var) < values.size()) ? values[var] : 0;
+}
+
+void SolverSimplex::changeRHS(ConstraintHandle constraint, double rhs)
+{
+    rows[constraint].rhs = rhs;
+}
+
+void SolverSimplex::setVariableCoeffs(VariableHandle var, int count, const double* coeffs, const ConstraintHandle* constraints)
+{
+    Column& column = columns[var];
+    column.coeffs.clear();
+    for (int i = 0; i < count; i++) {
+        column.coeffs.push_back(make_pair(constraints[i], coeffs[i]));
+    }
+}
+
+void SolverSimplex::delVariables(int count, const VariableHandle* vars)
+{
+    for (int i = 0; i < count; i++) {
+        Column& column = columns[vars[i]];
+        column.deleted = true;
+        column.objCoeff = 0;
+        vector<pair<ConstraintHandle, double> >().swap(column.coeffs);
+    }
+}
+
+void SolverSimplex::delConstraints(int count, const ConstraintHandle* constraints)
+{
+    for (int i = 0; i < count; i++) {
+        rows[constraints[i]].deleted = true;
+    }
+}
+
+void SolverSimplex::setWarmStart(bool enable)
+{
+}
+
+bool SolverSimplex::canSolveConcurrently() const
+{
+    return true;
+}
+
+static Solver* createSolverSimplex()
+{
+    return new SolverSimplex();
+}
+
+void registerSolverSimplex()
+{
+    registerSolver("simplex", createSolverSimplex);
+}
@@ -0,0 +1,64 @@
+// SolverSimplex.hpp - Self-contained dense simplex solver for cross-checking the GLPK solver in tests.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef SOLVER_SIMPLEX_HPP
+#define SOLVER_SIMPLEX_HPP
+
+#include <vector>
+#include "../DNC-Library/Solver.hpp"
+
+using namespace std;
+
+// Dense bounded-variable primal simplex solver that does not depend on GLPK
+// Each solve builds a dense tableau from scratch and runs the two-phase simplex method, so it is only meant for
+// cross-checking GLPK's results on the small LPs of the tests, and is not registered as a production backend. Different instances share no state and can be used from different threads.
+// Warm starts are not supported (setWarmStart has no effect), and solve returns false if there are integer or binary variables.
+class SolverSimplex : public Solver
+{
+private:
+    struct Column {
+        double lb;
+        double ub;
+        enum VarType type;
+        double objCoeff;
+        bool deleted;
+        vector<pair<ConstraintHandle, double> > coeffs; // coefficients of the variable in each constraint
+    };
+    struct Row {
+        enum ConstraintType type;
+        double rhs;
+        bool deleted;
+    };
+    enum ObjectiveType direction;
+    vector<Column> columns; // variable handle -> variable
+    vector<Row> rows; // constraint handle -> constraint
+    vector<double> values; // variable handle -> solved value
+    double objective; // solved objective value
+
+public:
+    SolverSimplex();
+    virtual ~SolverSimplex();
+
+    virtual VariableHandle addVariable(double lb, double ub, enum VarType type, const char* name);
+    virtual ConstraintHandle addConstraint(int count, const double* coeffs, const VariableHandle* vars, enum ConstraintType type, double rhs, const char* name);
+    virtual void addConstraints(const SparseConstraints& constraints, vector<ConstraintHandle>& handles);
+    virtual void setObjectiveDirection(enum ObjectiveType type);
+    virtual void setObjectiveCoeff(double coeff, VariableHandle var);
+    virtual bool solve();
+    virtual double getSolution();
+    virtual double getSolutionVariable(VariableHandle var);
+    virtual void changeRHS(ConstraintHandle constraint, double rhs);
+    virtual void setVariableCoeffs(VariableHandle var, int count, const double* coeffs, const ConstraintHandle* constraints);
+    virtual void delVariables(int count, const VariableHandle* vars);
+    virtual void delConstraints(int count, const ConstraintHandle* constraints);
+    virtual void setWarmStart(bool enable);
+    virtual bool canSolveConcurrently() const;
+};
+
+// Register SolverSimplex as the "simplex" backend for tests that select the solver by name.
+void registerSolverSimplex();
+
+#endif // SOLVER_SIMPLEX_HPP
@@ -0,0 +1,212 @@
+// SolverSimplexTest.cpp - SolverSimplex test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include <json/json.h>
+#include "../DNC-Library/Solver.hpp"
+#include "SolverSimplex.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Random value in [lower, upper]
+static double randomValue(double lower, double upper)
+{
+    return lower + (upper - lower) * (rand() / static_cast<double>(RAND_MAX));
+}
+
+// Build the same random feasible LP in both solvers, then modify it, checking after each step that both find the same optimum.
+static void SolverSimplexRandomTest(unsigned int seed)
+{
+    const double epsilon = 1e-6;
+    srand(seed);
+    SolverSimplex s;
+    SolverGLPK g(GLPK_SIMPLEX);
+    g.setWarmStart(true); // re-solves from the previous basis, which stays valid after deletions
+    enum ObjectiveType direction = ((rand() % 2) == 0) ? OBJECTIVE_MIN : OBJECTIVE_MAX;
+    s.setObjectiveDirection(direction);
+    g.setObjectiveDirection(direction);
+    unsigned int numVars = 2 + rand() % 8;
+    unsigned int numConstraints = 1 + rand() % 10;
+    vector<VariableHandle> sVars;
+    vector<VariableHandle> gVars;
+    vector<double> point; // feasible point
+    for (unsigned int j = 0; j < numVars; j++) {
+        double lb = randomValue(-5, 5);
+        double ub = lb + randomValue(0, 10);
+        sVars.push_back(s.addVariable(lb, ub, VAR_CONTINUOUS, NULL));
+        gVars.push_back(g.addVariable(lb, ub, VAR_CONTINUOUS, NULL));
+        point.push_back(randomValue(lb, ub));
+        double objCoeff = randomValue(-3, 3);
+        s.setObjectiveCoeff(objCoeff, sVars.back());
+        g.setObjectiveCoeff(objCoeff, gVars.back());
+    }
+    SparseConstraints sRows;
+    SparseConstraints gRows;
+    for (unsigned int i = 0; i < numConstraints; i++) {
+        double activity = 0;
+        for (unsigned int j = 0; j < numVars; j++) {
+            if ((rand() % 3) != 0) {
+                double coeff = randomValue(-4, 4);
+                sRows.append(coeff, sVars[j]);
+                gRows.append(coeff, gVars[j]);
+                activity += coeff * point[j];
+            }
+        }
+        enum ConstraintType type = static_cast<enum ConstraintType>(rand() % 3);
+        double rhs = activity;
+        if (type == CONSTRAINT_LE) {
+            rhs += randomValue(0, 2);
+        } else if (type == CONSTRAINT_GE) {
+            rhs -= randomValue(0, 2);
+        }
+        sRows.endConstraint(type, rhs);
+        gRows.endConstraint(type, rhs);
+    }
+    vector<ConstraintHandle> sConstraints;
+    vector<ConstraintHandle> gConstraints;
+    s.addConstraints(sRows, sConstraints);
+    g.addConstraints(gRows, gConstraints);
+    assert(s.solve() && g.solve());
+    assert(approxEqual(s.getSolution(), g.getSolution(), epsilon));
+
+    // Loosen an inequality constraint
+    unsigned int index = rand() % numConstraints;
+    double rhs = sRows.rhs[index];
+    if (sRows.types[index] == CONSTRAINT_LE) {
+        rhs += 1;
+    } else if (sRows.types[index] == CONSTRAINT_GE) {
+        rhs -= 1;
+    }
+    s.changeRHS(sConstraints[index], rhs);
+    g.changeRHS(gConstraints[index], rhs);
+    assert(s.solve() && g.solve());
+    assert(approxEqual(s.getSolution(), g.getSolution(), epsilon));
+
+    // Add a variable to existing constraints
+    VariableHandle sz = s.addVariable(0, 3, VAR_CONTINUOUS, NULL);
+    VariableHandle gz = g.addVariable(0, 3, VAR_CONTINUOUS, NULL);
+    s.setObjectiveCoeff(1, sz);
+    g.setObjectiveCoeff(1, gz);
+    vector<double> coeffs;
+    vector<ConstraintHandle> sZConstraints;
+    vector<ConstraintHandle> gZConstraints;
+    for (unsigned int i = 0; i < numConstraints; i++) {
+        if ((rand() % 2) == 0) {
+            coeffs.push_back(randomValue(-1, 1));
+            sZConstraints.push_back(sConstraints[i]);
+            gZConstraints.push_back(gConstraints[i]);
+        }
+    }
+    if (!coeffs.empty()) {
+        s.setVariableCoeffs(sz, coeffs.size(), &coeffs[0], &sZConstraints[0]);
+        g.setVariableCoeffs(gz, coeffs.size(), &coeffs[0], &gZConstraints[0]);
+    }
+    assert(s.solve() && g.solve());
+    assert(approxEqual(s.getSolution(), g.getSolution(), epsilon));
+
+    // Delete a variable and a constraint
+    index = rand() % numVars;
+    s.delVariables(1, &sVars[index]);
+    g.delVariables(1, &gVars[index]);
+    index = rand() % numConstraints;
+    s.delConstraints(1, &sConstraints[index]);
+    g.delConstraints(1, &gConstraints[index]);
+    bool sSolved = s.solve();
+    assert(sSolved == g.solve());
+    if (sSolved) {
+        assert(approxEqual(s.getSolution(), g.getSolution(), epsilon));
+    }
+}
+
+void SolverSimplexTest()
+{
+    const double inf = numeric_limits<double>::infinity();
+    const double epsilon = 1e-6;
+    SolverSimplex s;
+    VariableHandle x = s.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+    VariableHandle y = s.addVariable(0, 10, VAR_CONTINUOUS, NULL);
+    VariableHandle z = s.addVariable(0, 100, VAR_CONTINUOUS, NULL);
+    VariableHandle obj = s.addVariable(0, 100, VAR_CONTINUOUS, NULL);
+    ConstraintHandle c;
+    {
+        double coeffs[] = {1, 1};
+        VariableHandle vars[] = {x, y};
+        c = s.addConstraint(2, coeffs, vars, CONSTRAINT_LE, 16, NULL); // x + y <= 16
+    }
+    {
+        double coeffs[] = {1, -1, -1};
+        VariableHandle vars[] = {x, y, z};
+        s.addConstraint(3, coeffs, vars, CONSTRAINT_EQ, 0, NULL); // x - y - z = 0
+    }
+    {
+        double coeffs[] = {1, 1};
+        VariableHandle vars[] = {x, y};
+        s.addConstraint(2, coeffs, vars, CONSTRAINT_GE, 4, NULL); // x + y >= 4
+    }
+    {
+        double coeffs[] = {1, 1, 5, -1};
+        VariableHandle vars[] = {x, y, z, obj};
+        s.addConstraint(4, coeffs, vars, CONSTRAINT_EQ, 0, NULL); // x + y + 5*z - obj = 0
+    }
+    s.setObjectiveCoeff(1, obj);
+
+    s.setObjectiveDirection(OBJECTIVE_MIN);
+    assert(s.solve());
+    assert(approxEqual(s.getSolution(), 4.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(x), 2.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(y), 2.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(z), 0.0, epsilon));
+
+    s.setObjectiveDirection(OBJECTIVE_MAX);
+    assert(s.solve());
+    assert(approxEqual(s.getSolution(), 60.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(x), 10.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(y), 0.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(z), 10.0, epsilon));
+
+    s.changeRHS(c, 8);
+    assert(s.solve());
+    assert(approxEqual(s.getSolution(), 48.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(x), 8.0, epsilon));
+    assert(approxEqual(s.getSolutionVariable(z), 8.0, epsilon));
+
+    // Infeasible and unbounded LPs
+    {
+        SolverSimplex infeasible;
+        VariableHandle v = infeasible.addVariable(0, 1, VAR_CONTINUOUS, NULL);
+        double coeffs[] = {1};
+        infeasible.addConstraint(1, coeffs, &v, CONSTRAINT_GE, 2, NULL); // v >= 2
+        assert(!infeasible.solve());
+    }
+    {
+        SolverSimplex unbounded;
+        unbounded.setObjectiveDirection(OBJECTIVE_MAX);
+        VariableHandle u = unbounded.addVariable(-inf, inf, VAR_CONTINUOUS, NULL);
+        VariableHandle v = unbounded.addVariable(0, inf, VAR_CONTINUOUS, NULL);
+        unbounded.setObjectiveCoeff(1, v);
+        double coeffs[] = {1, -1};
+        VariableHandle vars[] = {u, v};
+        unbounded.addConstraint(2, coeffs, vars, CONSTRAINT_GE, 0, NULL); // u >= v
+        assert(!unbounded.solve());
+    }
+    // Integer variables are not supported
+    {
+        SolverSimplex integer;
+        integer.addVariable(0, 1, VAR_BINARY, NULL);
+        assert(!integer.solve());
+    }
+
+    // Random LPs match GLPK
+    for (unsigned int seed = 1; seed <= 200; seed++) {
+        SolverSimplexRandomTest(seed);
+    }
+    cout << "PASS SolverSimplexTest" << endl;
+}
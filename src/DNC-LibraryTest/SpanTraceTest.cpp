@@ -0,0 +1,100 @@
+// SpanTraceTest.cpp - SpanTracer test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include <pthread.h>
+#include <json/json.h>
+#include "../common/SpanTrace.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+#define SPAN_TRACE_TEST_SPANS (SPAN_TRACE_BUFFER_SIZE + 1000)
+
+static void* SpanTraceTestRecordThread(void* ptr)
+{
+    // Record more spans than fit in the buffer, so that the oldest are overwritten
+    for (uint64_t i = 0; i < SPAN_TRACE_TEST_SPANS; i++) {
+        SpanTracer::record("SpanTraceTestWrap", i * 1000, i * 1000 + 500);
+    }
+    return NULL;
+}
+
+void SpanTraceTest()
+{
+    // Spans are collected per thread, and only the most recent spans of a full buffer are kept
+    {
+        SpanTracer::record("SpanTraceTestMain", 1000, 3500);
+        {
+            SpanScope scope("SpanTraceTestScope");
+        }
+        pthread_t thread;
+        int rc = pthread_create(&thread, NULL, SpanTraceTestRecordThread, NULL);
+        assert(rc == 0);
+        pthread_join(thread, NULL);
+        vector<SpanEvent> events;
+        SpanTracer::collect(events);
+        map<string, unsigned int> counts;
+        long mainTid = -1;
+        long wrapTid = -1;
+        uint64_t minWrapStart = ~(uint64_t)0;
+        for (unsigned int i = 0; i < events.size(); i++) {
+            const SpanEvent& event = events[i];
+            counts[event.name]++;
+            assert(event.startTime <= event.endTime);
+            if (string(event.name) == "SpanTraceTestMain") {
+                assert((event.startTime == 1000) && (event.endTime == 3500));
+                mainTid = event.tid;
+            } else if (string(event.name) == "SpanTraceTestWrap") {
+                assert(event.endTime == event.startTime + 500);
+                minWrapStart = min(minWrapStart, event.startTime);
+                wrapTid = event.tid;
+            }
+        }
+        assert(counts["SpanTraceTestMain"] == 1);
+        assert(counts["SpanTraceTestScope"] == 1);
+        assert(counts["SpanTraceTestWrap"] == SPAN_TRACE_BUFFER_SIZE - 1);
+        assert(minWrapStart == (uint64_t)(SPAN_TRACE_TEST_SPANS - SPAN_TRACE_BUFFER_SIZE + 1) * 1000);
+        assert((mainTid >= 0) && (wrapTid >= 0) && (mainTid != wrapTid));
+    }
+    // Chrome traces contain a complete event per span, in microseconds
+    {
+        const char* filename = "SpanTraceTest.json";
+        assert(SpanTracer::writeChromeTrace(filename));
+        ifstream file(filename);
+        Json::Value trace;
+        Json::Reader reader;
+        assert(reader.parse(file, trace));
+        file.close();
+        remove(filename);
+        const Json::Value& traceEvents = trace["traceEvents"];
+        assert(traceEvents.isArray());
+        unsigned int numWrap = 0;
+        bool foundMain = false;
+        for (unsigned int i = 0; i < traceEvents.size(); i++) {
+            const Json::Value& event = traceEvents[i];
+            assert(event["ph"].asString() == "X");
+            if (event["name"].asString() == "SpanTraceTestWrap") {
+                assert(event["dur"].asDouble() == 0.5);
+                numWrap++;
+            } else if (event["name"].asString() == "SpanTraceTestMain") {
+                assert(event["ts"].asDouble() == 1.0);
+                assert(event["dur"].asDouble() == 2.5);
+                foundMain = true;
+            }
+        }
+        assert(numWrap == SPAN_TRACE_BUFFER_SIZE - 1);
+        assert(foundMain);
+    }
+    cout << "PASS SpanTraceTest" << endl;
+}
@@ -5,6 +5,7 @@
 //
 
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <json/json.h>
 #include "../Estimator/Estimator.hpp"
@@ -12,6 +13,127 @@
 
 using namespace std;
 
+// Reference estimate that scans the bandwidth table.
+static double referenceWork(const vector<StorageBandwidth>& bandwidthTable, int requestSize)
+{
+    double bandwidth = bandwidthTable.back().bandwidth;
+    for (unsigned int i = 1; i < bandwidthTable.size(); i++) {
+        if (requestSize < bandwidthTable[i].requestSize) {
+            bandwidth = linearInterpolate(static_cast<double>(requestSize),
+                                          static_cast<double>(bandwidthTable[i-1].requestSize), static_cast<double>(bandwidthTable[i].requestSize),
+                                          bandwidthTable[i-1].bandwidth, bandwidthTable[i].bandwidth);
+            break;
+        }
+    }
+    return static_cast<double>(requestSize) / bandwidth;
+}
+
+// Lookup tables must match scanning the bandwidth table for aligned and unaligned sizes.
+static void testLookup()
+{
+    int requestSizes[6] = {512, 1536, 4096, 6000, 65536, 1048576};
+    double readBandwidths[6] = {4.9e6, 13.1e6, 21.7e6, 25.3e6, 110.9e6, 250.3e6};
+    double writeBandwidths[6] = {0.6e6, 1.6e6, 7.3e6, 8.1e6, 60.7e6, 180.1e6};
+    vector<StorageBandwidth> readBandwidthTable(6);
+    vector<StorageBandwidth> writeBandwidthTable(6);
+    for (unsigned int i = 0; i < 6; i++) {
+        readBandwidthTable[i].requestSize = requestSizes[i];
+        readBandwidthTable[i].bandwidth = readBandwidths[i];
+        writeBandwidthTable[i].requestSize = requestSizes[i];
+        writeBandwidthTable[i].bandwidth = writeBandwidths[i];
+    }
+    StorageSSDEstimator est(readBandwidthTable, writeBandwidthTable);
+    for (int requestSize = 1; requestSize <= 70000; requestSize++) {
+        assert(est.estimateWork(requestSize, true) == referenceWork(readBandwidthTable, requestSize));
+        assert(est.estimateWork(requestSize, false) == referenceWork(writeBandwidthTable, requestSize));
+    }
+    for (int requestSize = 512; requestSize <= 2 * 1048576; requestSize += 512) {
+        assert(est.estimateWork(requestSize, true) == referenceWork(readBandwidthTable, requestSize));
+        assert(est.estimateWork(requestSize, false) == referenceWork(writeBandwidthTable, requestSize));
+        assert(est.estimateWork(requestSize + 1, true) == referenceWork(readBandwidthTable, requestSize + 1));
+        assert(est.estimateWork(requestSize - 1, false) == referenceWork(writeBandwidthTable, requestSize - 1));
+    }
+}
+
+// Bandwidths profiled at several queue depths are interpolated at the enforcer's MPL.
+static void testQueueDepths()
+{
+    Json::Value estimatorInfo;
+    estimatorInfo["name"] = Json::Value("testEstimator");
+    estimatorInfo["type"] = Json::Value("storageSSD");
+    estimatorInfo["readMPL"] = Json::Value(3);
+    estimatorInfo["MPL"] = Json::Value(8);
+    Json::Value& bwTableEntry = estimatorInfo["bandwidthTable"][0];
+    bwTableEntry["requestSize"] = Json::Value(4);
+    bwTableEntry["readBandwidth"] = Json::Value(8.0);
+    bwTableEntry["writeBandwidth"] = Json::Value(4.0);
+    Json::Value& qdTable = bwTableEntry["queueDepths"];
+    qdTable[0]["queueDepth"] = Json::Value(1);
+    qdTable[0]["readBandwidth"] = Json::Value(1.0);
+    qdTable[0]["writeBandwidth"] = Json::Value(0.5);
+    qdTable[1]["queueDepth"] = Json::Value(4);
+    qdTable[1]["readBandwidth"] = Json::Value(4.0);
+    qdTable[1]["writeBandwidth"] = Json::Value(4.0);
+    qdTable[2]["queueDepth"] = Json::Value(8);
+    qdTable[2]["readBandwidth"] = Json::Value(8.0);
+
+    // Reads interpolate at queue depth 3, writes use the largest profiled write queue depth 4 for MPL 8
+    Estimator* pEst = Estimator::create(estimatorInfo);
+    assert(pEst->estimateWork(4, true) == 4.0 / 3.0);
+    assert(pEst->estimateWork(4, false) == 1);
+    delete pEst;
+
+    // Without an MPL, the entry's bandwidth is used
+    estimatorInfo["readMPL"] = Json::Value(0);
+    estimatorInfo["writeMPL"] = Json::Value(1);
+    pEst = Estimator::create(estimatorInfo);
+    assert(pEst->estimateWork(4, true) == 0.5);
+    assert(pEst->estimateWork(4, false) == 8);
+    delete pEst;
+}
+
+// Mixes that get less throughput than their read and write costs predict derate the read and write bandwidths.
+static void testMixes()
+{
+    Json::Value estimatorInfo;
+    estimatorInfo["name"] = Json::Value("testEstimator");
+    estimatorInfo["type"] = Json::Value("storageSSDMix");
+    Json::Value& bwTableEntry = estimatorInfo["bandwidthTable"][0];
+    bwTableEntry["requestSize"] = Json::Value(4);
+    bwTableEntry["readBandwidth"] = Json::Value(4.0);
+    bwTableEntry["writeBandwidth"] = Json::Value(2.0);
+    // 75% reads at 2 bytes/sec requires 3 * readFactor + 2 * writeFactor >= 8, which is cheapest with readFactor 2
+    Json::Value& mixes = bwTableEntry["mixes"];
+    mixes[0]["queueDepth"] = Json::Value(1);
+    mixes[0]["readPercent"] = Json::Value(75);
+    mixes[0]["readBandwidth"] = Json::Value(1.5);
+    mixes[0]["writeBandwidth"] = Json::Value(0.5);
+    // No interference
+    mixes[1]["queueDepth"] = Json::Value(1);
+    mixes[1]["readPercent"] = Json::Value(67);
+    mixes[1]["readBandwidth"] = Json::Value(2.0);
+    mixes[1]["writeBandwidth"] = Json::Value(1.0);
+
+    Estimator* pEst = Estimator::create(estimatorInfo);
+    assert(fabs(pEst->estimateWork(4, true) - 2) < 1e-9);
+    assert(fabs(pEst->estimateWork(4, false) - 2) < 1e-9);
+    delete pEst;
+
+    // Without interference, the work is the same as storageSSD
+    mixes.resize(1);
+    mixes[0]["readBandwidth"] = Json::Value(3.0);
+    mixes[0]["writeBandwidth"] = Json::Value(1.0);
+    pEst = Estimator::create(estimatorInfo);
+    assert(pEst->estimateWork(4, true) == 1);
+    assert(pEst->estimateWork(4, false) == 2);
+    delete pEst;
+    estimatorInfo["type"] = Json::Value("storageSSD");
+    mixes[0]["readBandwidth"] = Json::Value(0.1);
+    pEst = Estimator::create(estimatorInfo);
+    assert(pEst->estimateWork(4, true) == 1);
+    delete pEst;
+}
+
 void StorageSSDEstimatorTest()
 {
     Json::Value estimatorInfo;
@@ -47,6 +169,17 @@ void StorageSSDEstimatorTest()
     assert(pEst->estimateWork(4, false) == 4);
     assert(pEst->estimateWork(5, false) == 4);
     assert(pEst->estimateWork(6, false) == 4);
+    // Batch estimates must match per request estimates
+    int requestSizes[12] = {1, 2, 3, 4, 5, 6, 1, 2, 3, 4, 5, 6};
+    bool isReadRequests[12] = {true, true, true, true, true, true, false, false, false, false, false, false};
+    double works[12];
+    pEst->estimateWorkBatch(12, requestSizes, isReadRequests, works);
+    for (unsigned int i = 0; i < 12; i++) {
+        assert(works[i] == pEst->estimateWork(requestSizes[i], isReadRequests[i]));
+    }
     delete pEst;
+    testLookup();
+    testQueueDepths();
+    testMixes();
     cout << "PASS StorageSSDEstimatorTest" << endl;
 }
@@ -0,0 +1,120 @@
+// TimerWheelTest.cpp - TimerWheel test code.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <cassert>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <stdint.h>
+#include "../common/TimerWheel.hpp"
+#include "DNC-LibraryTest.hpp"
+
+using namespace std;
+
+// Expire timers up to now and check that exactly the scheduled timers with times up to now expire.
+// scheduledTimes[i] is the time entry i is scheduled for, or 0 if it is not scheduled.
+static void expireTimerWheelTest(TimerWheel& wheel, vector<TimerWheelEntry>& entries, vector<uint64_t>& scheduledTimes, uint64_t now)
+{
+    vector<TimerWheelEntry*> expired;
+    wheel.expire(now, expired);
+    vector<unsigned int> expiredIndices;
+    for (unsigned int i = 0; i < expired.size(); i++) {
+        unsigned int index = expired[i] - &entries[0];
+        assert(!expired[i]->scheduled());
+        assert(expired[i]->time == scheduledTimes[index]);
+        assert(expired[i]->data == &scheduledTimes[index]);
+        expiredIndices.push_back(index);
+    }
+    sort(expiredIndices.begin(), expiredIndices.end());
+    vector<unsigned int> expectedIndices;
+    size_t numScheduled = 0;
+    for (unsigned int i = 0; i < entries.size(); i++) {
+        if (scheduledTimes[i] != 0) {
+            if (scheduledTimes[i] <= now) {
+                expectedIndices.push_back(i);
+                scheduledTimes[i] = 0;
+            } else {
+                assert(entries[i].scheduled());
+                numScheduled++;
+            }
+        }
+    }
+    assert(expiredIndices == expectedIndices);
+    assert(wheel.size() == numScheduled);
+}
+
+void TimerWheelTest()
+{
+    // Basic expiration within and across ticks
+    {
+        TimerWheel wheel(4);
+        vector<TimerWheelEntry> entries(3);
+        vector<uint64_t> scheduledTimes(3, 0);
+        for (unsigned int i = 0; i < entries.size(); i++) {
+            initTimerWheelEntry(entries[i], &scheduledTimes[i]);
+        }
+        assert(wheel.empty());
+        scheduledTimes[0] = 5;
+        wheel.schedule(entries[0], 5);
+        scheduledTimes[1] = 7;
+        wheel.schedule(entries[1], 7);
+        scheduledTimes[2] = 100000;
+        wheel.schedule(entries[2], 100000);
+        assert(wheel.size() == 3);
+        // Timers expire at their exact time, not at the end of their tick
+        expireTimerWheelTest(wheel, entries, scheduledTimes, 4);
+        expireTimerWheelTest(wheel, entries, scheduledTimes, 5);
+        expireTimerWheelTest(wheel, entries, scheduledTimes, 6);
+        // Rescheduling and cancelling
+        scheduledTimes[1] = 50000;
+        wheel.schedule(entries[1], 50000);
+        wheel.cancel(entries[2]);
+        scheduledTimes[2] = 0;
+        wheel.cancel(entries[2]);
+        expireTimerWheelTest(wheel, entries, scheduledTimes, 49999);
+        expireTimerWheelTest(wheel, entries, scheduledTimes, 200000);
+        assert(wheel.empty());
+        // Times in the past expire on the next call
+        scheduledTimes[0] = 1;
+        wheel.schedule(entries[0], 1);
+        expireTimerWheelTest(wheel, entries, scheduledTimes, 200000);
+        assert(wheel.empty());
+    }
+    // Randomized against a reference, with times spanning every level and the overflow list
+    srand(1);
+    for (unsigned int tickShift = 0; tickShift <= 8; tickShift += 4) {
+        TimerWheel wheel(tickShift);
+        vector<TimerWheelEntry> entries(200);
+        vector<uint64_t> scheduledTimes(entries.size(), 0);
+        for (unsigned int i = 0; i < entries.size(); i++) {
+            initTimerWheelEntry(entries[i], &scheduledTimes[i]);
+        }
+        uint64_t now = 1;
+        for (unsigned int step = 0; step < 20000; step++) {
+            unsigned int index = rand() % entries.size();
+            int op = rand() % 8;
+            if (op < 4) {
+                // Delays up to ~2^40 ticks, weighted towards short delays
+                uint64_t delay = (static_cast<uint64_t>(rand()) << (rand() % 10)) >> (rand() % 31);
+                uint64_t time = now + (delay << tickShift) + (rand() % 3);
+                wheel.schedule(entries[index], time);
+                scheduledTimes[index] = time;
+            } else if (op < 5) {
+                wheel.cancel(entries[index]);
+                scheduledTimes[index] = 0;
+            } else {
+                uint64_t advance = (static_cast<uint64_t>(rand()) << (rand() % 10)) >> (rand() % 31);
+                now += (advance << tickShift) + (rand() % 3);
+                expireTimerWheelTest(wheel, entries, scheduledTimes, now);
+            }
+        }
+        expireTimerWheelTest(wheel, entries, scheduledTimes, numeric_limits<uint64_t>::max());
+        assert(wheel.empty());
+    }
+    cout << "PASS TimerWheelTest" << endl;
+}
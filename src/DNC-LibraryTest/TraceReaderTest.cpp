@@ -5,15 +5,17 @@
 //
 
 #include <cassert>
+#include <cstdio>
 #include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "../TraceCommon/TraceReader.hpp"
 #include "DNC-LibraryTest.hpp"
 
 using namespace std;
 
-void TraceReaderTest()
+static void testTraceReader(TraceReader& traceReader)
 {
-    TraceReader traceReader("testTrace.txt");
     TraceEntry entry;
     for (int i = 0; i < 3; i++) {
         assert(traceReader.nextEntry(entry) == true);
@@ -35,5 +37,61 @@ void TraceReaderTest()
         assert(traceReader.nextEntry(entry) == false);
         traceReader.reset();
     }
+    // Batch reads must return the same entries
+    TraceEntry entries[3];
+    assert(traceReader.nextEntries(entries, 3) == 3);
+    assert(entries[0].arrivalTime == 0);
+    assert(entries[1].arrivalTime == 1000);
+    assert(entries[2].arrivalTime == 10000);
+    assert(traceReader.nextEntries(entries, 3) == 1);
+    assert(entries[0].arrivalTime == 20000);
+    assert(entries[0].requestSize == 512);
+    assert(entries[0].isRead == false);
+    assert(traceReader.nextEntries(entries, 3) == 0);
+    traceReader.reset();
+}
+
+void TraceReaderTest()
+{
+    // CSV format
+    TraceReader traceReader("testTrace.txt");
+    testTraceReader(traceReader);
+    // Binary format
+    assert(writeBinaryTrace(traceReader, "testTrace.bin"));
+    {
+        TraceReader binaryTraceReader("testTrace.bin");
+        testTraceReader(binaryTraceReader);
+    }
+    // Binary traces whose header does not match the file's size are read as empty, rather than parsed as CSV
+    {
+        struct stat st;
+        assert(stat("testTrace.bin", &st) == 0);
+        TraceEntry entry;
+        assert(truncate("testTrace.bin", st.st_size - 1) == 0);
+        TraceReader truncatedTraceReader("testTrace.bin");
+        assert(!truncatedTraceReader.nextEntry(entry));
+        assert(truncate("testTrace.bin", st.st_size + 1) == 0);
+        TraceReader paddedTraceReader("testTrace.bin");
+        assert(!paddedTraceReader.nextEntry(entry));
+        assert(truncate("testTrace.bin", st.st_size) == 0);
+        // Entry count that overflows the expected size
+        FILE* file = fopen("testTrace.bin", "r+b");
+        assert(file != NULL);
+        BinaryTraceHeader header;
+        assert(fread(&header, sizeof(header), 1, file) == 1);
+        header.numEntries += (1ull << 62);
+        assert(fseek(file, 0, SEEK_SET) == 0);
+        assert(fwrite(&header, sizeof(header), 1, file) == 1);
+        fclose(file);
+        TraceReader overflowTraceReader("testTrace.bin");
+        assert(!overflowTraceReader.nextEntry(entry));
+    }
+    unlink("testTrace.bin");
+    // Streamed CSV format, including chunks that split lines
+    size_t chunkSizes[3] = {1, 7, TRACE_READER_CHUNK_SIZE};
+    for (unsigned int i = 0; i < 3; i++) {
+        TraceReader streamTraceReader("testTrace.txt", TRACE_READER_STREAM, chunkSizes[i]);
+        testTraceReader(streamTraceReader);
+    }
     cout << "PASS TraceReaderTest" << endl;
 }
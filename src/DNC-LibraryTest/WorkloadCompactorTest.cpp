@@ -8,7 +8,10 @@
 #include <cstdlib>
 #include <limits>
 #include <iostream>
+#include <sstream>
+#include <string>
 #include <vector>
+#include <set>
 #include <json/json.h>
 #include "../common/serializeJSON.hpp"
 #include "../DNC-Library/DNC.hpp"
@@ -17,10 +20,11 @@
 
 using namespace std;
 
-void WorkloadCompactorTest()
+static void WorkloadCompactorTest(bool incrementalLP, const string& solverName)
 {
     const double epsilon = 1e-6;
-    WorkloadCompactor* wc = new WorkloadCompactor();
+    WorkloadCompactor* wc = new WorkloadCompactor(incrementalLP);
+    assert(wc->setSolver(solverName));
     // Setup queues
     Json::Value queueInfo;
     queueInfo["bandwidth"] = Json::Value(1);
@@ -260,5 +264,565 @@ void WorkloadCompactorTest()
     }
 
     delete wc;
+}
+
+// Sum of shaper rates, normalized by the flows' first queue bandwidth (i.e., the LP objective summed over client groups).
+static double sumShaperRates(WorkloadCompactor* wc)
+{
+    double sum = 0;
+    for (NC::FlowIterator it = wc->flowsBegin(); it != wc->flowsEnd(); it++) {
+        sum += wc->getShaperCurve(it->first).r / wc->getQueue(it->second->queueIds.front())->bandwidth;
+    }
+    return sum;
+}
+
+// Check that the shaper rate kept for each queue matches the sum of the shaper rates of the queue's flows.
+static void checkQueueShaperRates(WorkloadCompactor* wc)
+{
+    for (NC::QueueIterator it = wc->queuesBegin(); it != wc->queuesEnd(); it++) {
+        double sum = 0;
+        bool initialized = true;
+        for (vector<FlowIndex>::const_iterator flowIt = it->second->flows.begin(); flowIt != it->second->flows.end(); flowIt++) {
+            const SimpleArrivalCurve& shaperCurve = wc->getShaperCurve(flowIt->flowId);
+            if ((shaperCurve.r == 0) && (shaperCurve.b == 0)) {
+                initialized = false;
+            }
+            sum += shaperCurve.r;
+        }
+        double shaperRate;
+        assert(wc->getQueueShaperRate(it->first, shaperRate) == initialized);
+        if (initialized) {
+            assert(approxEqual(shaperRate, sum, 1e-9));
+        }
+    }
+}
+
+// Randomly add and delete clients, checking that the incrementally updated LPs find the same optimum as LPs rebuilt from scratch,
+// and that the simplex backend finds the same optimum and admission decisions as GLPK.
+// The optimum only fixes the sum of the shaper rates, so the rates and bursts of individual flows may differ between backends.
+// and that solving independent client groups in parallel matches solving them serially.
+static void WorkloadCompactorIncrementalTest()
+{
+    const unsigned int numQueues = 6;
+    const unsigned int numSteps = 60;
+    WorkloadCompactor* wcIncremental = new WorkloadCompactor(true);
+    WorkloadCompactor* wcRebuild = new WorkloadCompactor(false);
+    WorkloadCompactor* wcSimplex = new WorkloadCompactor(false);
+    assert(wcSimplex->setSolver("simplex"));
+    wcSimplex->setFastPath(false);
+    Json::Value queueInfo;
+    queueInfo["bandwidth"] = Json::Value(1);
+    for (unsigned int q = 0; q < numQueues; q++) {
+        ostringstream oss;
+        oss << "Q" << q;
+        queueInfo["name"] = Json::Value(oss.str());
+        wcIncremental->addQueue(queueInfo);
+        wcRebuild->addQueue(queueInfo);
+        wcSimplex->addQueue(queueInfo);
+    }
+    srand(1);
+    vector<pair<ClientId, ClientId> > clientIds;
+    vector<ClientId> simplexClientIds;
+    vector<Json::Value> clientInfos;
+    for (unsigned int step = 0; step < numSteps; step++) {
+        if (!clientIds.empty() && ((rand() % 3) == 0)) {
+            unsigned int index = rand() % clientIds.size();
+            wcIncremental->delClient(clientIds[index].first);
+            wcRebuild->delClient(clientIds[index].second);
+            wcSimplex->delClient(simplexClientIds[index]);
+            clientIds.erase(clientIds.begin() + index);
+            simplexClientIds.erase(simplexClientIds.begin() + index);
+            clientInfos.erase(clientInfos.begin() + index);
+        } else {
+            Json::Value clientInfo;
+            ostringstream oss;
+            oss << "C" << step;
+            clientInfo["name"] = Json::Value(oss.str());
+            clientInfo["SLO"] = Json::Value(static_cast<double>(10 * (1 + rand() % 4)));
+            clientInfo["flows"] = Json::arrayValue;
+            unsigned int numFlows = 1 + rand() % 2;
+            clientInfo["flows"].resize(numFlows);
+            for (unsigned int flowIndex = 0; flowIndex < numFlows; flowIndex++) {
+                Json::Value& flowInfo = clientInfo["flows"][flowIndex];
+                ostringstream flowName;
+                flowName << "F" << step << "_" << flowIndex;
+                flowInfo["name"] = Json::Value(flowName.str());
+                ostringstream queueName;
+                queueName << "Q" << (rand() % numQueues);
+                flowInfo["queues"] = Json::arrayValue;
+                flowInfo["queues"].append(Json::Value(queueName.str()));
+                double rate = 0.02 + 0.01 * (rand() % 10);
+                vector<double> rates;
+                map<double, double> bursts;
+                rates.push_back(1);
+                bursts[1] = 0.5;
+                rates.push_back(2 * rate);
+                bursts[2 * rate] = 1 + rand() % 3;
+                rates.push_back(rate);
+                bursts[rate] = 4 + rand() % 4;
+                Curve arrivalCurve;
+                rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
+                arrivalCurve.erase(arrivalCurve.begin());
+                serializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+            }
+            clientIds.push_back(make_pair(wcIncremental->addClient(clientInfo), wcRebuild->addClient(clientInfo)));
+            simplexClientIds.push_back(wcSimplex->addClient(clientInfo));
+            clientInfos.push_back(clientInfo);
+        }
+        wcIncremental->calcAllLatency();
+        wcRebuild->calcAllLatency();
+        wcSimplex->calcAllLatency();
+        assert(approxEqual(sumShaperRates(wcIncremental), sumShaperRates(wcRebuild), 1e-6));
+        assert(approxEqual(sumShaperRates(wcSimplex), sumShaperRates(wcRebuild), 1e-6));
+        checkQueueShaperRates(wcIncremental);
+        for (unsigned int i = 0; i < clientIds.size(); i++) {
+            const Client* c1 = wcIncremental->getClient(clientIds[i].first);
+            const Client* c2 = wcRebuild->getClient(clientIds[i].second);
+            assert((c1->latency <= c1->SLO) == (c2->latency <= c2->SLO));
+            const Client* c3 = wcSimplex->getClient(simplexClientIds[i]);
+            assert((c3->latency <= c3->SLO) == (c2->latency <= c2->SLO));
+        }
+    }
+    delete wcIncremental;
+    delete wcRebuild;
+    delete wcSimplex;
+
+    // Adding the remaining clients at once results in many independent groups; solving them in parallel matches a serial solve
+    // GLPK is serialized unless built with GLPK_THREAD_SAFE, so the simplex backend is also used to solve groups concurrently
+    const char* solverNames[] = {"glpk", "simplex"};
+    for (unsigned int n = 0; n < sizeof(solverNames) / sizeof(solverNames[0]); n++) {
+        WorkloadCompactor* wcParallel = new WorkloadCompactor(false, 4);
+        WorkloadCompactor* wcSerial = new WorkloadCompactor(false, 1);
+        assert(wcParallel->setSolver(solverNames[n]) && wcSerial->setSolver(solverNames[n]));
+        for (unsigned int q = 0; q < numQueues; q++) {
+            ostringstream oss;
+            oss << "Q" << q;
+            queueInfo["name"] = Json::Value(oss.str());
+            wcParallel->addQueue(queueInfo);
+            wcSerial->addQueue(queueInfo);
+        }
+        for (unsigned int i = 0; i < clientInfos.size(); i++) {
+            wcParallel->addClient(clientInfos[i]);
+            wcSerial->addClient(clientInfos[i]);
+        }
+        wcParallel->calcAllLatency();
+        wcSerial->calcAllLatency();
+        NC::FlowIterator it1 = wcParallel->flowsBegin();
+        NC::FlowIterator it2 = wcSerial->flowsBegin();
+        for (; it1 != wcParallel->flowsEnd(); it1++, it2++) {
+            assert(it2 != wcSerial->flowsEnd());
+            assert(wcParallel->getShaperCurve(it1->first).r == wcSerial->getShaperCurve(it2->first).r);
+            assert(wcParallel->getShaperCurve(it1->first).b == wcSerial->getShaperCurve(it2->first).b);
+            assert(it1->second->priority == it2->second->priority);
+        }
+        assert(it2 == wcSerial->flowsEnd());
+        delete wcParallel;
+        delete wcSerial;
+    }
+}
+
+// Check that groups with a single queue and SLO solved without an LP find the same optimum as the LP.
+static void WorkloadCompactorFastPathTest()
+{
+    const unsigned int numQueues = 3;
+    const double SLOs[numQueues] = {10, 20, 40};
+    srand(2);
+    for (unsigned int trial = 0; trial < 20; trial++) {
+        WorkloadCompactor* wcFast = new WorkloadCompactor();
+        WorkloadCompactor* wcLP = new WorkloadCompactor();
+        wcLP->setFastPath(false);
+        for (unsigned int q = 0; q < numQueues; q++) {
+            Json::Value queueInfo;
+            ostringstream oss;
+            oss << "Q" << q;
+            queueInfo["name"] = Json::Value(oss.str());
+            queueInfo["bandwidth"] = Json::Value(static_cast<double>(q + 1));
+            wcFast->addQueue(queueInfo);
+            wcLP->addQueue(queueInfo);
+        }
+        unsigned int numClients = 1 + rand() % 12;
+        for (unsigned int clientIndex = 0; clientIndex < numClients; clientIndex++) {
+            unsigned int q = rand() % numQueues;
+            Json::Value clientInfo;
+            ostringstream oss;
+            oss << "C" << clientIndex;
+            clientInfo["name"] = Json::Value(oss.str());
+            clientInfo["SLO"] = Json::Value(SLOs[q]);
+            clientInfo["flows"] = Json::arrayValue;
+            unsigned int numFlows = 1 + rand() % 2;
+            clientInfo["flows"].resize(numFlows);
+            for (unsigned int flowIndex = 0; flowIndex < numFlows; flowIndex++) {
+                Json::Value& flowInfo = clientInfo["flows"][flowIndex];
+                ostringstream flowName;
+                flowName << "F" << clientIndex << "_" << flowIndex;
+                flowInfo["name"] = Json::Value(flowName.str());
+                ostringstream queueName;
+                queueName << "Q" << q;
+                flowInfo["queues"] = Json::arrayValue;
+                flowInfo["queues"].append(Json::Value(queueName.str()));
+                double rate = (q + 1) * (0.01 + 0.01 * (rand() % 10));
+                vector<double> rates;
+                map<double, double> bursts;
+                rates.push_back(q + 1);
+                bursts[q + 1] = 0.5 + rand() % 2;
+                rates.push_back(3 * rate);
+                bursts[3 * rate] = 2 + rand() % 3;
+                rates.push_back(rate);
+                bursts[rate] = 5 + rand() % 5;
+                Curve arrivalCurve;
+                rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
+                arrivalCurve.erase(arrivalCurve.begin());
+                serializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+            }
+            wcFast->addClient(clientInfo);
+            wcLP->addClient(clientInfo);
+        }
+        wcFast->calcAllLatency();
+        wcLP->calcAllLatency();
+        assert(approxEqual(sumShaperRates(wcFast), sumShaperRates(wcLP), 1e-6));
+        NC::FlowIterator it1 = wcFast->flowsBegin();
+        NC::FlowIterator it2 = wcLP->flowsBegin();
+        for (; it1 != wcFast->flowsEnd(); it1++, it2++) {
+            // Either both or neither find a solution
+            const SimpleArrivalCurve& c1 = wcFast->getShaperCurve(it1->first);
+            const SimpleArrivalCurve& c2 = wcLP->getShaperCurve(it2->first);
+            assert(((c1.r == 0) && (c1.b == 0)) == ((c2.r == 0) && (c2.b == 0)));
+            assert(it1->second->priority == it2->second->priority);
+        }
+        delete wcFast;
+        delete wcLP;
+    }
+}
+
+// Random client with flows on random queues
+static Json::Value randomWhatIfClient(const string& name, unsigned int numQueues)
+{
+    Json::Value clientInfo;
+    clientInfo["name"] = Json::Value(name);
+    clientInfo["SLO"] = Json::Value(static_cast<double>(10 * (1 + rand() % 3)));
+    clientInfo["flows"] = Json::arrayValue;
+    unsigned int numFlows = 1 + rand() % 2;
+    clientInfo["flows"].resize(numFlows);
+    for (unsigned int flowIndex = 0; flowIndex < numFlows; flowIndex++) {
+        Json::Value& flowInfo = clientInfo["flows"][flowIndex];
+        ostringstream flowName;
+        flowName << name << "_F" << flowIndex;
+        flowInfo["name"] = Json::Value(flowName.str());
+        ostringstream queueName;
+        queueName << "Q" << (rand() % numQueues);
+        flowInfo["queues"] = Json::arrayValue;
+        flowInfo["queues"].append(Json::Value(queueName.str()));
+        double rate = 0.02 + 0.01 * (rand() % 10);
+        vector<double> rates;
+        map<double, double> bursts;
+        rates.push_back(1);
+        bursts[1] = 0.5;
+        rates.push_back(2 * rate);
+        bursts[2 * rate] = 1 + rand() % 3;
+        rates.push_back(rate);
+        bursts[rate] = 4 + rand() % 4;
+        Curve arrivalCurve;
+        rbCurveToArrivalCurve(arrivalCurve, rates, bursts);
+        arrivalCurve.erase(arrivalCurve.begin());
+        serializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+    }
+    return clientInfo;
+}
+
+// Check that what-if evaluations leave the flows and clients unchanged, and do not affect later admissions.
+static void WorkloadCompactorWhatIfTest()
+{
+    const unsigned int numQueues = 3;
+    WorkloadCompactor* wc = new WorkloadCompactor();
+    WorkloadCompactor* wcNoWhatIf = new WorkloadCompactor();
+    Json::Value queueInfo;
+    queueInfo["bandwidth"] = Json::Value(1);
+    for (unsigned int q = 0; q < numQueues; q++) {
+        ostringstream oss;
+        oss << "Q" << q;
+        queueInfo["name"] = Json::Value(oss.str());
+        wc->addQueue(queueInfo);
+        wcNoWhatIf->addQueue(queueInfo);
+    }
+    srand(3);
+    for (unsigned int step = 0; step < 20; step++) {
+        ostringstream oss;
+        oss << "C" << step;
+        Json::Value clientInfo = randomWhatIfClient(oss.str(), numQueues);
+        wc->addClient(clientInfo);
+        wcNoWhatIf->addClient(clientInfo);
+        wc->calcAllLatency();
+        wcNoWhatIf->calcAllLatency();
+        assert(approxEqual(sumShaperRates(wc), sumShaperRates(wcNoWhatIf), 1e-6));
+        // Save state
+        vector<SimpleArrivalCurve> shaperCurves;
+        vector<unsigned int> priorities;
+        vector<double> latencies;
+        for (NC::FlowIterator it = wc->flowsBegin(); it != wc->flowsEnd(); it++) {
+            shaperCurves.push_back(wc->getShaperCurve(it->first));
+            priorities.push_back(it->second->priority);
+            latencies.push_back(it->second->latency);
+        }
+        for (NC::ClientIterator it = wc->clientsBegin(); it != wc->clientsEnd(); it++) {
+            latencies.push_back(it->second->latency);
+        }
+        checkQueueShaperRates(wc);
+        vector<double> queueShaperRates;
+        vector<bool> queueShapersInitialized;
+        for (NC::QueueIterator it = wc->queuesBegin(); it != wc->queuesEnd(); it++) {
+            double shaperRate = 0;
+            queueShapersInitialized.push_back(wc->getQueueShaperRate(it->first, shaperRate));
+            queueShaperRates.push_back(shaperRate);
+        }
+        // Probe clients
+        wc->beginWhatIf();
+        assert(wc->inWhatIf());
+        ostringstream probeName;
+        probeName << "P" << step;
+        ClientId probeId = wc->addClient(randomWhatIfClient(probeName.str(), numQueues));
+        wc->calcAllLatency();
+        wc->delClient(probeId);
+        wc->endWhatIf();
+        assert(!wc->inWhatIf());
+        // Check state is unchanged
+        unsigned int flowIndex = 0;
+        for (NC::FlowIterator it = wc->flowsBegin(); it != wc->flowsEnd(); it++, flowIndex++) {
+            assert(wc->getShaperCurve(it->first).r == shaperCurves[flowIndex].r);
+            assert(wc->getShaperCurve(it->first).b == shaperCurves[flowIndex].b);
+            assert(it->second->priority == priorities[flowIndex]);
+            assert(it->second->latency == latencies[flowIndex]);
+        }
+        assert(flowIndex == shaperCurves.size());
+        for (NC::ClientIterator it = wc->clientsBegin(); it != wc->clientsEnd(); it++, flowIndex++) {
+            assert(it->second->latency == latencies[flowIndex]);
+        }
+        unsigned int queueIndex = 0;
+        for (NC::QueueIterator it = wc->queuesBegin(); it != wc->queuesEnd(); it++, queueIndex++) {
+            double shaperRate = 0;
+            assert(wc->getQueueShaperRate(it->first, shaperRate) == queueShapersInitialized[queueIndex]);
+            assert(shaperRate == queueShaperRates[queueIndex]);
+        }
+    }
+    delete wc;
+    delete wcNoWhatIf;
+}
+
+// Replace the arrival curves of some flows, checking that the re-optimized parameters match a WorkloadCompactor
+// that was given the new arrival curves from the start.
+static void WorkloadCompactorSetArrivalCurveTest()
+{
+    const unsigned int numQueues = 3;
+    const unsigned int numClients = 12;
+    for (unsigned int fastPath = 0; fastPath < 2; fastPath++) {
+        WorkloadCompactor* wc = new WorkloadCompactor(true);
+        WorkloadCompactor* wcFresh = new WorkloadCompactor(true);
+        wc->setFastPath(fastPath != 0);
+        wcFresh->setFastPath(fastPath != 0);
+        Json::Value queueInfo;
+        queueInfo["bandwidth"] = Json::Value(1);
+        for (unsigned int q = 0; q < numQueues; q++) {
+            ostringstream oss;
+            oss << "Q" << q;
+            queueInfo["name"] = Json::Value(oss.str());
+            wc->addQueue(queueInfo);
+            wcFresh->addQueue(queueInfo);
+        }
+        srand(2);
+        vector<Json::Value> clientInfos;
+        for (unsigned int i = 0; i < numClients; i++) {
+            Json::Value clientInfo;
+            ostringstream oss;
+            oss << "C" << i;
+            clientInfo["name"] = Json::Value(oss.str());
+            clientInfo["SLO"] = Json::Value((fastPath != 0) ? 20.0 : static_cast<double>(10 * (1 + rand() % 4)));
+            clientInfo["flows"] = Json::arrayValue;
+            clientInfo["flows"].resize(1);
+            Json::Value& flowInfo = clientInfo["flows"][0u];
+            flowInfo["name"] = Json::Value(oss.str() + "F");
+            ostringstream queueName;
+            queueName << "Q" << (rand() % numQueues);
+            flowInfo["queues"] = Json::arrayValue;
+            flowInfo["queues"].append(Json::Value(queueName.str()));
+            Curve arrivalCurves[2];
+            for (unsigned int j = 0; j < 2; j++) {
+                double rate = 0.01 + 0.01 * (rand() % 5);
+                vector<double> rates;
+                vector<double> bursts;
+                rates.push_back(1);
+                bursts.push_back(0.5);
+                rates.push_back(2 * rate);
+                bursts.push_back(1 + rand() % 3);
+                rates.push_back(rate);
+                bursts.push_back(4 + rand() % 4);
+                rbCurveToArrivalCurve(arrivalCurves[j], rates, bursts);
+                arrivalCurves[j].erase(arrivalCurves[j].begin());
+            }
+            serializeJSON(flowInfo, "arrivalInfo", arrivalCurves[0]);
+            wc->addClient(clientInfo);
+            serializeJSON(flowInfo, "arrivalInfo", arrivalCurves[1]);
+            wcFresh->addClient(clientInfo);
+            clientInfos.push_back(clientInfo);
+        }
+        wc->calcAllLatency();
+        // Set the new arrival curves as initialized by wcFresh
+        for (unsigned int i = 0; i < numClients; i++) {
+            string flowName = clientInfos[i]["flows"][0u]["name"].asString();
+            FlowId flowId = wc->getFlowIdByName(flowName);
+            const Curve& newArrivalCurve = wcFresh->getArrivalCurve(wcFresh->getFlowIdByName(flowName));
+            wc->setArrivalCurve(flowId, newArrivalCurve);
+            assert(wc->getArrivalCurve(flowId).size() == newArrivalCurve.size());
+        }
+        set<FlowId> affectedFlowIds;
+        wc->getAffectedFlows(affectedFlowIds);
+        assert(affectedFlowIds.size() == numClients);
+        wc->calcAllLatency();
+        wcFresh->calcAllLatency();
+        assert(approxEqual(sumShaperRates(wc), sumShaperRates(wcFresh), 1e-6));
+        for (unsigned int i = 0; i < numClients; i++) {
+            const Client* c1 = wc->getClient(wc->getClientIdByName(clientInfos[i]["name"].asString()));
+            const Client* c2 = wcFresh->getClient(wcFresh->getClientIdByName(clientInfos[i]["name"].asString()));
+            assert((c1->latency <= c1->SLO) == (c2->latency <= c2->SLO));
+        }
+        delete wc;
+        delete wcFresh;
+    }
+}
+
+// Checkpoint a WorkloadCompactor with deleted clients, dirty latencies, and queues to be re-optimized,
+// checking that the restored WorkloadCompactor has the same state and re-optimizes in the same manner.
+static void WorkloadCompactorCheckpointTest()
+{
+    const unsigned int numQueues = 3;
+    WorkloadCompactor* wc = new WorkloadCompactor();
+    Json::Value queueInfo;
+    queueInfo["bandwidth"] = Json::Value(1);
+    for (unsigned int q = 0; q < numQueues + 1; q++) {
+        ostringstream oss;
+        oss << "Q" << q;
+        queueInfo["name"] = Json::Value(oss.str());
+        wc->addQueue(queueInfo);
+    }
+    wc->delQueue(wc->getQueueIdByName("Q3"));
+    srand(5);
+    vector<ClientId> clientIds;
+    for (unsigned int step = 0; step < 12; step++) {
+        ostringstream oss;
+        oss << "C" << step;
+        clientIds.push_back(wc->addClient(randomWhatIfClient(oss.str(), numQueues)));
+    }
+    wc->calcAllLatency();
+    wc->delClient(clientIds[3]);
+    wc->delClient(clientIds[7]);
+    wc->calcClientLatency(clientIds[0]);
+    wc->addClient(randomWhatIfClient("C12", numQueues));
+
+    BinaryWriter writer;
+    wc->writeCheckpoint(writer);
+    WorkloadCompactor* wcRestored = new WorkloadCompactor();
+    BinaryReader reader(writer.data(), writer.size());
+    assert(wcRestored->readCheckpoint(reader));
+    assert(reader.atEnd());
+
+    // Check state is the same
+    NC::QueueIterator itQueue = wcRestored->queuesBegin();
+    for (NC::QueueIterator it = wc->queuesBegin(); it != wc->queuesEnd(); it++, itQueue++) {
+        assert(itQueue != wcRestored->queuesEnd());
+        assert(it->first == itQueue->first);
+        assert(it->second->name == itQueue->second->name);
+        assert(it->second->bandwidth == itQueue->second->bandwidth);
+        assert(it->second->flows.size() == itQueue->second->flows.size());
+        for (unsigned int position = 0; position < it->second->flows.size(); position++) {
+            assert(it->second->flows[position].flowId == itQueue->second->flows[position].flowId);
+            assert(it->second->flows[position].index == itQueue->second->flows[position].index);
+        }
+        double shaperRate = 0;
+        double restoredShaperRate = 0;
+        assert(wc->getQueueShaperRate(it->first, shaperRate) == wcRestored->getQueueShaperRate(it->first, restoredShaperRate));
+        assert(shaperRate == restoredShaperRate);
+    }
+    assert(itQueue == wcRestored->queuesEnd());
+    NC::ClientIterator itClient = wcRestored->clientsBegin();
+    for (NC::ClientIterator it = wc->clientsBegin(); it != wc->clientsEnd(); it++, itClient++) {
+        assert(itClient != wcRestored->clientsEnd());
+        assert(it->first == itClient->first);
+        assert(it->second->name == itClient->second->name);
+        assert(it->second->flowIds == itClient->second->flowIds);
+        assert(it->second->SLO == itClient->second->SLO);
+        assert(it->second->SLOpercentile == itClient->second->SLOpercentile);
+        assert(it->second->latency == itClient->second->latency);
+        assert(it->second->ignoreLatency == itClient->second->ignoreLatency);
+    }
+    assert(itClient == wcRestored->clientsEnd());
+    NC::FlowIterator itFlow = wcRestored->flowsBegin();
+    for (NC::FlowIterator it = wc->flowsBegin(); it != wc->flowsEnd(); it++, itFlow++) {
+        assert(itFlow != wcRestored->flowsEnd());
+        assert(it->first == itFlow->first);
+        assert(it->second->name == itFlow->second->name);
+        assert(it->second->clientId == itFlow->second->clientId);
+        assert(it->second->queueIds == itFlow->second->queueIds);
+        assert(it->second->queuePositions == itFlow->second->queuePositions);
+        assert(it->second->priority == itFlow->second->priority);
+        assert(it->second->latency == itFlow->second->latency);
+        assert(it->second->latencyDirty == itFlow->second->latencyDirty);
+        const Curve& arrivalCurve = wc->getArrivalCurve(it->first);
+        const Curve& restoredArrivalCurve = wcRestored->getArrivalCurve(it->first);
+        assert(arrivalCurve.size() == restoredArrivalCurve.size());
+        for (unsigned int i = 0; i < arrivalCurve.size(); i++) {
+            assert(arrivalCurve[i].x == restoredArrivalCurve[i].x);
+            assert(arrivalCurve[i].y == restoredArrivalCurve[i].y);
+            assert(arrivalCurve[i].slope == restoredArrivalCurve[i].slope);
+        }
+        assert(wc->getShaperCurve(it->first).r == wcRestored->getShaperCurve(it->first).r);
+        assert(wc->getShaperCurve(it->first).b == wcRestored->getShaperCurve(it->first).b);
+    }
+    assert(itFlow == wcRestored->flowsEnd());
+    set<FlowId> affectedFlowIds;
+    set<FlowId> restoredAffectedFlowIds;
+    wc->getAffectedFlows(affectedFlowIds);
+    wcRestored->getAffectedFlows(restoredAffectedFlowIds);
+    assert(!affectedFlowIds.empty());
+    assert(affectedFlowIds == restoredAffectedFlowIds);
+    set<ClientId> dirtyClientIds;
+    set<ClientId> restoredDirtyClientIds;
+    wc->getDirtyClients(dirtyClientIds);
+    wcRestored->getDirtyClients(restoredDirtyClientIds);
+    assert(dirtyClientIds == restoredDirtyClientIds);
+
+    // Check re-optimization and new clients
+    Json::Value clientInfo = randomWhatIfClient("C13", numQueues);
+    // C12 reused the id of C3, so C13 reuses the id of C7
+    ClientId clientId = wc->addClient(clientInfo);
+    assert(clientId == clientIds[7]);
+    assert(wcRestored->addClient(clientInfo) == clientId);
+    wc->calcAllLatency();
+    wcRestored->calcAllLatency();
+    assert(approxEqual(sumShaperRates(wc), sumShaperRates(wcRestored), 1e-6));
+    itClient = wcRestored->clientsBegin();
+    for (NC::ClientIterator it = wc->clientsBegin(); it != wc->clientsEnd(); it++, itClient++) {
+        assert((it->second->latency <= it->second->SLO) == (itClient->second->latency <= itClient->second->SLO));
+    }
+
+    // Check truncated checkpoints are rejected
+    for (size_t size = 0; size < writer.size(); size += 1 + size / 16) {
+        WorkloadCompactor* wcTruncated = new WorkloadCompactor();
+        BinaryReader truncatedReader(writer.data(), size);
+        assert(!wcTruncated->readCheckpoint(truncatedReader));
+        delete wcTruncated;
+    }
+    delete wc;
+    delete wcRestored;
+}
+
+void WorkloadCompactorTest()
+{
+    WorkloadCompactorTest(false, "glpk");
+    WorkloadCompactorTest(true, "glpk");
+    WorkloadCompactorTest(false, "simplex");
+    WorkloadCompactorTest(true, "simplex");
+    WorkloadCompactorIncrementalTest();
+    WorkloadCompactorFastPathTest();
+    WorkloadCompactorWhatIfTest();
+    WorkloadCompactorSetArrivalCurveTest();
+    WorkloadCompactorCheckpointTest();
     cout << "PASS WorkloadCompactorTest" << endl;
 }
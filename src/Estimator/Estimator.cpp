@@ -20,7 +20,16 @@ Estimator* Estimator::create(const Json::Value& estimatorInfo)
         return new NetworkOutEstimator(estimatorInfo);
     } else if (type == "storageSSD") {
         return new StorageSSDEstimator(estimatorInfo);
+    } else if (type == "storageSSDMix") {
+        return new StorageSSDMixEstimator(estimatorInfo);
     } else {
         throw invalid_argument("Invalid estimator type " + type);
     }
 }
+
+void Estimator::estimateWorkBatch(unsigned int count, const int* requestSizes, const bool* isReadRequests, double* works)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        works[i] = estimateWork(requestSizes[i], isReadRequests[i]);
+    }
+}
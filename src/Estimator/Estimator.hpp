@@ -24,6 +24,15 @@
 // "requestSize": int - request size (bytes)
 // "readBandwidth": double - read bandwidth when accessing a given request size (bytes per second)
 // "writeBandwidth": double - write bandwidth when accessing a given request size (bytes per second)
+// "queueDepths": list of bandwidths (optional) - read/write bandwidths at various queue depths, sorted by queue depth, as profiled by BandwidthTableGen
+// where each entry has "queueDepth", "readBandwidth", "writeBandwidth", and "readLatency" and "writeLatency" percentiles (seconds).
+// If present, the bandwidths are interpolated at the storage enforcer's "readMPL" and "writeMPL" queue depths (or "MPL"),
+// since the enforcer keeps at most that many requests outstanding at the storage device.
+//
+// SSD storage estimators that account for read/write interference have type "storageSSDMix" and the same fields, where bandwidth
+// table entries also have the mixed read/write workloads profiled by BandwidthTableGen:
+// "mixes": list of mixes (optional) - bandwidths of a mixed workload, where each mix has "queueDepth", "readPercent", "readBandwidth",
+// and "writeBandwidth" (bytes per second of the reads and writes in the mix), and latency percentiles
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -33,6 +42,7 @@
 #define _ESTIMATOR_HPP
 
 #include <vector>
+#include <cassert>
 #include <json/json.h>
 
 using namespace std;
@@ -56,6 +66,9 @@ public:
     // Estimate work based on request size and type.
     // This is the main function that converts request size into "work" units.
     virtual double estimateWork(int requestSize, bool isReadRequest) = 0;
+    // Estimate work for a batch of count requests; works[i] is the work of request i.
+    // Equivalent to calling estimateWork on each request, but avoids a virtual call per request.
+    virtual void estimateWorkBatch(unsigned int count, const int* requestSizes, const bool* isReadRequests, double* works);
     // Returns type of estimator.
     virtual EstimatorType estimatorType() = 0;
     // Reset any estimator state, if any.
@@ -84,7 +97,17 @@ public:
     {}
     virtual ~NetworkInEstimator() {}
 
+    // Non-virtual estimateWork that can be inlined by code specialized on the estimator type (see ProcessedTrace::create).
+    // Both affine functions are evaluated so that loops over requests are branch-free and can be vectorized.
+    double work(int requestSize, bool isReadRequest) const
+    {
+        double nonDataWork = _nonDataConstant + _nonDataFactor * (double)requestSize;
+        double dataWork = _dataConstant + _dataFactor * (double)requestSize;
+        return isReadRequest ? nonDataWork : dataWork;
+    }
+
     virtual double estimateWork(int requestSize, bool isReadRequest);
+    virtual void estimateWorkBatch(unsigned int count, const int* requestSizes, const bool* isReadRequests, double* works);
     virtual EstimatorType estimatorType() { return ESTIMATOR_NETWORK_IN; }
 };
 
@@ -110,7 +133,17 @@ public:
     {}
     virtual ~NetworkOutEstimator() {}
 
+    // Non-virtual estimateWork that can be inlined by code specialized on the estimator type (see ProcessedTrace::create).
+    // Both affine functions are evaluated so that loops over requests are branch-free and can be vectorized.
+    double work(int requestSize, bool isReadRequest) const
+    {
+        double nonDataWork = _nonDataConstant + _nonDataFactor * (double)requestSize;
+        double dataWork = _dataConstant + _dataFactor * (double)requestSize;
+        return isReadRequest ? dataWork : nonDataWork;
+    }
+
     virtual double estimateWork(int requestSize, bool isReadRequest);
+    virtual void estimateWorkBatch(unsigned int count, const int* requestSizes, const bool* isReadRequests, double* works);
     virtual EstimatorType estimatorType() { return ESTIMATOR_NETWORK_OUT; }
 };
 
@@ -119,27 +152,103 @@ typedef struct {
     double bandwidth; // B/s
 } StorageBandwidth;
 
+// Granularity (bytes) of the precomputed work table; covers sector, 4K, and power of two sizes >= 512
+#define STORAGE_SSD_ALIGNED_SIZE 512
+// Maximum number of precomputed aligned sizes per table; larger aligned sizes use the log bucket index
+#define STORAGE_SSD_MAX_ALIGNED_ENTRIES 65536
+// Number of log2 request size buckets (one per bit of a positive int)
+#define STORAGE_SSD_LOG_BUCKETS 32
+
+// Precomputed lookup for a bandwidth table so that estimating work does not scan the table.
+typedef struct {
+    // alignedWork[k] is the work of a request of size k * STORAGE_SSD_ALIGNED_SIZE, or negative if the slow path must be used
+    vector<double> alignedWork;
+    // logBucketStart[b] is the first bandwidth table index i >= 1 with requestSize > 2^b
+    // Requests with floor(log2(requestSize)) == b can start their scan there
+    unsigned int logBucketStart[STORAGE_SSD_LOG_BUCKETS];
+} StorageWorkLookup;
+
 // Estimator for SSD storage traffic at server.
 // Read and write characteristics are different, so they are each profiled separately.
 // Storage profiles look at bandwidth over a range of request sizes and interpolate to calculate the bandwidth of a request.
+// Since the estimator runs on the storage enforcer's critical path, the interpolation is precomputed for aligned request sizes,
+// and other sizes use a log2 bucket index into the bandwidth table. Both give the same results as scanning the table.
 class StorageSSDEstimator : public Estimator
 {
 protected:
     vector<StorageBandwidth> _readBandwidthTable;
     vector<StorageBandwidth> _writeBandwidthTable;
+    StorageWorkLookup _readLookup;
+    StorageWorkLookup _writeLookup;
+
+    // Build lookup for bandwidthTable.
+    static void buildLookup(const vector<StorageBandwidth>& bandwidthTable, StorageWorkLookup& lookup);
+    // Interpolate the bandwidth of requestSize, scanning bandwidthTable starting at index start.
+    static double interpolateBandwidth(const vector<StorageBandwidth>& bandwidthTable, unsigned int start, int requestSize);
+    // Interpolate the bandwidth (readBandwidth or writeBandwidth) of a bandwidth table entry at queueDepth.
+    static double queueDepthBandwidth(const Json::Value& bwTableEntry, const char* bandwidthName, int queueDepth);
+    // Estimate work using the precomputed lookup.
+    static inline double lookupWork(const vector<StorageBandwidth>& bandwidthTable, const StorageWorkLookup& lookup, int requestSize);
 
 public:
     StorageSSDEstimator(const vector<StorageBandwidth>& readBandwidthTable, const vector<StorageBandwidth>& writeBandwidthTable)
         : _readBandwidthTable(readBandwidthTable),
           _writeBandwidthTable(writeBandwidthTable)
-    {}
+    {
+        buildLookup(_readBandwidthTable, _readLookup);
+        buildLookup(_writeBandwidthTable, _writeLookup);
+    }
     StorageSSDEstimator(const Json::Value& estimatorInfo);
     virtual ~StorageSSDEstimator() {}
 
+    // Non-virtual estimateWork that can be inlined by code specialized on the estimator type (see ProcessedTrace::create).
+    double work(int requestSize, bool isReadRequest) const
+    {
+        if (isReadRequest) {
+            return lookupWork(_readBandwidthTable, _readLookup, requestSize);
+        } else {
+            return lookupWork(_writeBandwidthTable, _writeLookup, requestSize);
+        }
+    }
+
     virtual double estimateWork(int requestSize, bool isReadRequest);
+    virtual void estimateWorkBatch(unsigned int count, const int* requestSizes, const bool* isReadRequests, double* works);
     virtual EstimatorType estimatorType() { return ESTIMATOR_STORAGE; }
 };
 
+// Estimator for SSD storage traffic at server that accounts for read/write interference.
+// Mixed workloads can get less throughput than their read and write costs predict due to garbage collection and reads waiting on writes.
+// For each request size, the read and write bandwidths are derated by factors >= 1 such that the work of every profiled mix is at
+// least its measured time. Of such factors, we use those with the least work averaged over read fractions from 0 to 1, so that
+// admission is tight without assuming the mix of the workloads sharing the storage server.
+class StorageSSDMixEstimator : public StorageSSDEstimator
+{
+protected:
+    // Calculate the derating factors of a bandwidth table entry from its mixes; both are 1 if there are no mixes.
+    static void interferenceFactors(const Json::Value& bwTableEntry, double& readFactor, double& writeFactor);
+
+public:
+    StorageSSDMixEstimator(const Json::Value& estimatorInfo);
+    virtual ~StorageSSDMixEstimator() {}
+};
+
+inline double StorageSSDEstimator::lookupWork(const vector<StorageBandwidth>& bandwidthTable, const StorageWorkLookup& lookup, int requestSize)
+{
+    unsigned int start = 1;
+    if (requestSize > 0) {
+        if ((requestSize % STORAGE_SSD_ALIGNED_SIZE) == 0) {
+            unsigned int k = static_cast<unsigned int>(requestSize) / STORAGE_SSD_ALIGNED_SIZE;
+            if ((k < lookup.alignedWork.size()) && (lookup.alignedWork[k] >= 0)) {
+                return lookup.alignedWork[k];
+            }
+        }
+        start = lookup.logBucketStart[31 - __builtin_clz(static_cast<unsigned int>(requestSize))];
+    }
+    double bandwidth = interpolateBandwidth(bandwidthTable, start, requestSize);
+    assert(bandwidth > 0);
+    return static_cast<double>(requestSize) / bandwidth;
+}
+
 inline double linearInterpolate(double x, double x0, double x1, double y0, double y1)
 {
     return y0 + (y1 - y0) * (x - x0) / (x1 - x0);
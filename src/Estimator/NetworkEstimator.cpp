@@ -9,18 +9,24 @@
 
 double NetworkInEstimator::estimateWork(int requestSize, bool isReadRequest)
 {
-    if (isReadRequest) {
-        return _nonDataConstant + _nonDataFactor * (double)requestSize;
-    } else {
-        return _dataConstant + _dataFactor * (double)requestSize;
-    }
+    return work(requestSize, isReadRequest);
 }
 
 double NetworkOutEstimator::estimateWork(int requestSize, bool isReadRequest)
 {
-    if (!isReadRequest) {
-        return _nonDataConstant + _nonDataFactor * (double)requestSize;
-    } else {
-        return _dataConstant + _dataFactor * (double)requestSize;
+    return work(requestSize, isReadRequest);
+}
+
+void NetworkInEstimator::estimateWorkBatch(unsigned int count, const int* requestSizes, const bool* isReadRequests, double* works)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        works[i] = work(requestSizes[i], isReadRequests[i]);
+    }
+}
+
+void NetworkOutEstimator::estimateWorkBatch(unsigned int count, const int* requestSizes, const bool* isReadRequests, double* works)
+{
+    for (unsigned int i = 0; i < count; i++) {
+        works[i] = work(requestSizes[i], isReadRequests[i]);
     }
 }
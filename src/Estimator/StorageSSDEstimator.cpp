@@ -8,27 +8,58 @@
 #include "Estimator.hpp"
 
 #include <assert.h>
+#include <algorithm>
 #include <json/json.h>
 
 StorageSSDEstimator::StorageSSDEstimator(const Json::Value& estimatorInfo)
 {
+    int readMPL = estimatorInfo.isMember("readMPL") ? estimatorInfo["readMPL"].asInt() : estimatorInfo["MPL"].asInt();
+    int writeMPL = estimatorInfo.isMember("writeMPL") ? estimatorInfo["writeMPL"].asInt() : estimatorInfo["MPL"].asInt();
     const Json::Value& bwTable = estimatorInfo["bandwidthTable"];
     _readBandwidthTable.resize(bwTable.size());
     _writeBandwidthTable.resize(bwTable.size());
     for (unsigned int entry = 0; entry < bwTable.size(); entry++) {
         const Json::Value& bwTableEntry = bwTable[entry];
         _readBandwidthTable[entry].requestSize = bwTableEntry["requestSize"].asInt();
-        _readBandwidthTable[entry].bandwidth = bwTableEntry["readBandwidth"].asDouble();
+        _readBandwidthTable[entry].bandwidth = queueDepthBandwidth(bwTableEntry, "readBandwidth", readMPL);
         _writeBandwidthTable[entry].requestSize = bwTableEntry["requestSize"].asInt();
-        _writeBandwidthTable[entry].bandwidth = bwTableEntry["writeBandwidth"].asDouble();
+        _writeBandwidthTable[entry].bandwidth = queueDepthBandwidth(bwTableEntry, "writeBandwidth", writeMPL);
     }
+    buildLookup(_readBandwidthTable, _readLookup);
+    buildLookup(_writeBandwidthTable, _writeLookup);
 }
 
-double StorageSSDEstimator::estimateWork(int requestSize, bool isReadRequest)
+double StorageSSDEstimator::queueDepthBandwidth(const Json::Value& bwTableEntry, const char* bandwidthName, int queueDepth)
+{
+    const Json::Value& qdTable = bwTableEntry["queueDepths"];
+    if ((queueDepth <= 0) || !qdTable.isArray()) {
+        return bwTableEntry[bandwidthName].asDouble();
+    }
+    // Interpolate between the profiled queue depths around queueDepth; outside of the profiled range, use the nearest queue depth
+    const Json::Value* pPrev = NULL;
+    for (unsigned int i = 0; i < qdTable.size(); i++) {
+        const Json::Value& qdEntry = qdTable[i];
+        if (!qdEntry.isMember(bandwidthName)) {
+            continue;
+        }
+        int entryQueueDepth = qdEntry["queueDepth"].asInt();
+        if (entryQueueDepth >= queueDepth) {
+            if ((pPrev == NULL) || (entryQueueDepth == queueDepth)) {
+                return qdEntry[bandwidthName].asDouble();
+            }
+            return linearInterpolate(static_cast<double>(queueDepth),
+                                     (*pPrev)["queueDepth"].asDouble(), static_cast<double>(entryQueueDepth),
+                                     (*pPrev)[bandwidthName].asDouble(), qdEntry[bandwidthName].asDouble());
+        }
+        pPrev = &qdEntry;
+    }
+    return (pPrev != NULL) ? (*pPrev)[bandwidthName].asDouble() : bwTableEntry[bandwidthName].asDouble();
+}
+
+double StorageSSDEstimator::interpolateBandwidth(const vector<StorageBandwidth>& bandwidthTable, unsigned int start, int requestSize)
 {
-    const vector<StorageBandwidth>& bandwidthTable = isReadRequest ? _readBandwidthTable : _writeBandwidthTable;
     double bandwidth = bandwidthTable.back().bandwidth; // max bw
-    for (unsigned int i = 1; i < bandwidthTable.size(); i++) {
+    for (unsigned int i = start; i < bandwidthTable.size(); i++) {
         if (requestSize < bandwidthTable[i].requestSize) {
             bandwidth = linearInterpolate(static_cast<double>(requestSize),
                                           static_cast<double>(bandwidthTable[i-1].requestSize), static_cast<double>(bandwidthTable[i].requestSize),
@@ -37,6 +68,127 @@ double StorageSSDEstimator::estimateWork(int requestSize, bool isReadRequest)
             break;
         }
     }
-    assert(bandwidth > 0);
-    return static_cast<double>(requestSize) / bandwidth;
+    return bandwidth;
+}
+
+void StorageSSDEstimator::buildLookup(const vector<StorageBandwidth>& bandwidthTable, StorageWorkLookup& lookup)
+{
+    lookup.alignedWork.clear();
+    if (bandwidthTable.empty()) {
+        for (unsigned int b = 0; b < STORAGE_SSD_LOG_BUCKETS; b++) {
+            lookup.logBucketStart[b] = 1;
+        }
+        return;
+    }
+    // Log buckets: a request of size s >= 2^b cannot be below any table entry with requestSize <= 2^b
+    unsigned int start = 1;
+    for (unsigned int b = 0; b < STORAGE_SSD_LOG_BUCKETS; b++) {
+        long long bucketSize = 1LL << b;
+        while ((start < bandwidthTable.size()) && (bandwidthTable[start].requestSize <= bucketSize)) {
+            start++;
+        }
+        lookup.logBucketStart[b] = start;
+    }
+    // Aligned sizes up to the largest profiled request size; larger requests use the max bandwidth
+    int maxRequestSize = bandwidthTable.back().requestSize;
+    unsigned int numAligned = (maxRequestSize > 0) ? (static_cast<unsigned int>(maxRequestSize) / STORAGE_SSD_ALIGNED_SIZE + 1) : 1;
+    if (numAligned > STORAGE_SSD_MAX_ALIGNED_ENTRIES) {
+        numAligned = STORAGE_SSD_MAX_ALIGNED_ENTRIES;
+    }
+    lookup.alignedWork.resize(numAligned, -1);
+    for (unsigned int k = 1; k < numAligned; k++) {
+        int requestSize = k * STORAGE_SSD_ALIGNED_SIZE;
+        double bandwidth = interpolateBandwidth(bandwidthTable, 1, requestSize);
+        // Leave invalid bandwidths to the slow path so they are caught when requested
+        if (bandwidth > 0) {
+            lookup.alignedWork[k] = static_cast<double>(requestSize) / bandwidth;
+        }
+    }
+}
+
+double StorageSSDEstimator::estimateWork(int requestSize, bool isReadRequest)
+{
+    return work(requestSize, isReadRequest);
+}
+
+void StorageSSDEstimator::estimateWorkBatch(unsigned int count, const int* requestSizes, const bool* isReadRequests, double* works)
+{
+    // Inline lookups avoid a virtual call and table scan per request
+    for (unsigned int i = 0; i < count; i++) {
+        works[i] = work(requestSizes[i], isReadRequests[i]);
+    }
+}
+
+StorageSSDMixEstimator::StorageSSDMixEstimator(const Json::Value& estimatorInfo)
+    : StorageSSDEstimator(estimatorInfo)
+{
+    const Json::Value& bwTable = estimatorInfo["bandwidthTable"];
+    for (unsigned int entry = 0; entry < bwTable.size(); entry++) {
+        double readFactor;
+        double writeFactor;
+        interferenceFactors(bwTable[entry], readFactor, writeFactor);
+        _readBandwidthTable[entry].bandwidth /= readFactor;
+        _writeBandwidthTable[entry].bandwidth /= writeFactor;
+    }
+    buildLookup(_readBandwidthTable, _readLookup);
+    buildLookup(_writeBandwidthTable, _writeLookup);
+}
+
+void StorageSSDMixEstimator::interferenceFactors(const Json::Value& bwTableEntry, double& readFactor, double& writeFactor)
+{
+    // Each mix with read fraction f of its bytes and total bandwidth T, measured at a queue depth with read and write bandwidths R and W,
+    // takes 1/T seconds per byte, and the derated costs must cover it: readFactor * f/R + writeFactor * (1-f)/W >= 1/T.
+    // This is a linear program in two variables, so the optimum is at an intersection of two constraint boundaries.
+    vector<double> a; // coefficient of readFactor
+    vector<double> b; // coefficient of writeFactor
+    vector<double> c; // lower bound
+    a.push_back(1);
+    b.push_back(0);
+    c.push_back(1); // readFactor >= 1
+    a.push_back(0);
+    b.push_back(1);
+    c.push_back(1); // writeFactor >= 1
+    const Json::Value& mixes = bwTableEntry["mixes"];
+    for (unsigned int i = 0; i < mixes.size(); i++) {
+        const Json::Value& mix = mixes[i];
+        double readBandwidth = mix["readBandwidth"].asDouble();
+        double writeBandwidth = mix["writeBandwidth"].asDouble();
+        double totalBandwidth = readBandwidth + writeBandwidth;
+        int queueDepth = mix["queueDepth"].asInt();
+        double pureReadBandwidth = queueDepthBandwidth(bwTableEntry, "readBandwidth", queueDepth);
+        double pureWriteBandwidth = queueDepthBandwidth(bwTableEntry, "writeBandwidth", queueDepth);
+        if ((totalBandwidth <= 0) || (pureReadBandwidth <= 0) || (pureWriteBandwidth <= 0)) {
+            continue;
+        }
+        double readFraction = readBandwidth / totalBandwidth;
+        a.push_back(readFraction / pureReadBandwidth);
+        b.push_back((1 - readFraction) / pureWriteBandwidth);
+        c.push_back(1 / totalBandwidth);
+    }
+    // Minimize the work averaged over read fractions, i.e., readFactor / readBandwidth + writeFactor / writeBandwidth
+    double readWeight = 1 / bwTableEntry["readBandwidth"].asDouble();
+    double writeWeight = 1 / bwTableEntry["writeBandwidth"].asDouble();
+    readFactor = 1;
+    writeFactor = 1;
+    double bestCost = -1;
+    for (unsigned int i = 0; i < c.size(); i++) {
+        for (unsigned int j = i + 1; j < c.size(); j++) {
+            double det = a[i] * b[j] - a[j] * b[i];
+            if (det == 0) {
+                continue;
+            }
+            double x = (c[i] * b[j] - c[j] * b[i]) / det;
+            double y = (a[i] * c[j] - a[j] * c[i]) / det;
+            bool feasible = true;
+            for (unsigned int k = 0; feasible && (k < c.size()); k++) {
+                feasible = (a[k] * x + b[k] * y >= c[k] * (1 - 1e-9));
+            }
+            double cost = readWeight * x + writeWeight * y;
+            if (feasible && ((bestCost < 0) || (cost < bestCost))) {
+                bestCost = cost;
+                readFactor = max(x, 1.0);
+                writeFactor = max(y, 1.0);
+            }
+        }
+    }
 }
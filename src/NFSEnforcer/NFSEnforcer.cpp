@@ -3,9 +3,13 @@
 // It then performs schedules the RPCs while taking into account workload priorities and rate limits.
 // Workloads are configured via the storage enforcer RPC interface (see prot/storage_prot.x).
 // NFSEnforcer is run in the same VM that is running the NFS server.
+// If AdmissionController addresses are given, NFSEnforcer observes the r-b curve of each workload's requests and periodically publishes
+// the curves to the AdmissionControllers, which re-characterize the workloads and re-optimize their rate limits accordingly.
 //
 // Command line parameters:
 // -c configFile (required) - config file that specifies some global NFSEnforcer parameters such as the storage profile; see profile file description in README
+// -a admissionControllerAddr (optional) - address of an AdmissionController to publish observed r-b curves to; can be used multiple times
+// -p publishPeriod (optional) - seconds between publishing observed r-b curves; defaults to 60
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -31,14 +35,15 @@
 #include <json/json.h>
 #include "../prot/nfs3_prot.h"
 #include "../prot/storage_prot.h"
+#include "../prot/AdmissionController_clnt.hpp"
 #include "../common/time.hpp"
 #include "../common/common.hpp"
 #include "scheduler.hpp"
+#include "forwarder.hpp"
 #include "NFSEnforcer.hpp"
 
 using namespace std;
 
-pid_t pid;
 // Scheduler
 Scheduler* sched;
 uint64_t startTime;
@@ -47,9 +52,20 @@ int maxPendingJobsPerClient = 8;
 pthread_mutex_t xprt_mutex = PTHREAD_MUTEX_INITIALIZER; // used in addition to xprt_cache->mutex to protect ignore flag; must not lock xprt_cache->mutex while holding xprt_mutex
 xprt_cache_t* xprt_cache;
 
+// r-b curve publishing
+#define RB_NUM_RATES 1000
+const double STORAGE_BANDWIDTH = 1; // work secs/sec; matches DNC-Library/NCConfig.cpp
+vector<AdmissionController_clnt*> admissionControllers;
+double publishPeriod = 60;
+
 // Default timeout can be changed using clnt_control()
 static struct timeval TIMEOUT = { 25, 0 };
 
+// NUMA nodes that worker threads are pinned to
+CpuTopology* topology;
+// Workers check their RPC client before using it after this long, since the NFS server closes idle connections (see Scheduler::KeepAlive)
+#define WORKER_IDLE_SECONDS 60
+
 /*
  * kept in xprt->xp_p1
  */
@@ -120,6 +136,8 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
     bool success = true;
     xdrproc_t _xdr_argument;
     xdrproc_t _xdr_result;
+    size_t _argument_size;
+    size_t _result_size;
     switch (rq_proc) {
         case NULLPROC:
             svc_sendreply(transp, (xdrproc_t)xdr_void, (caddr_t)NULL);
@@ -129,106 +147,148 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
         case NFSPROC3_GETATTR:
             _xdr_argument = (xdrproc_t)xdr_nfs_fh3;
             _xdr_result = (xdrproc_t)xdr_getattr3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_getattr_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_getattr_3_res);
             break;
 
         case NFSPROC3_SETATTR:
             _xdr_argument = (xdrproc_t)xdr_setattr3args;
             _xdr_result = (xdrproc_t)xdr_wccstat3;
+            _argument_size = sizeof(pJob->argument.nfsproc3_setattr_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_setattr_3_res);
             break;
 
         case NFSPROC3_LOOKUP:
             _xdr_argument = (xdrproc_t)xdr_diropargs3;
             _xdr_result = (xdrproc_t)xdr_lookup3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_lookup_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_lookup_3_res);
             break;
 
         case NFSPROC3_ACCESS:
             _xdr_argument = (xdrproc_t)xdr_access3args;
             _xdr_result = (xdrproc_t)xdr_access3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_access_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_access_3_res);
             break;
 
         case NFSPROC3_READLINK:
             _xdr_argument = (xdrproc_t)xdr_nfs_fh3;
             _xdr_result = (xdrproc_t)xdr_readlink3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_readlink_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_readlink_3_res);
             break;
 
         case NFSPROC3_READ:
             _xdr_argument = (xdrproc_t)xdr_read3args;
             _xdr_result = (xdrproc_t)xdr_read3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_read_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_read_3_res);
             break;
 
         case NFSPROC3_WRITE:
             _xdr_argument = (xdrproc_t)xdr_write3args;
             _xdr_result = (xdrproc_t)xdr_write3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_write_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_write_3_res);
             break;
 
         case NFSPROC3_CREATE:
             _xdr_argument = (xdrproc_t)xdr_create3args;
             _xdr_result = (xdrproc_t)xdr_diropres3;
+            _argument_size = sizeof(pJob->argument.nfsproc3_create_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_create_3_res);
             break;
 
         case NFSPROC3_MKDIR:
             _xdr_argument = (xdrproc_t)xdr_mkdir3args;
             _xdr_result = (xdrproc_t)xdr_diropres3;
+            _argument_size = sizeof(pJob->argument.nfsproc3_mkdir_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_mkdir_3_res);
             break;
 
         case NFSPROC3_SYMLINK:
             _xdr_argument = (xdrproc_t)xdr_symlink3args;
             _xdr_result = (xdrproc_t)xdr_diropres3;
+            _argument_size = sizeof(pJob->argument.nfsproc3_symlink_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_symlink_3_res);
             break;
 
         case NFSPROC3_MKNOD:
             _xdr_argument = (xdrproc_t)xdr_mknod3args;
             _xdr_result = (xdrproc_t)xdr_diropres3;
+            _argument_size = sizeof(pJob->argument.nfsproc3_mknod_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_mknod_3_res);
             break;
 
         case NFSPROC3_REMOVE:
             _xdr_argument = (xdrproc_t)xdr_diropargs3;
             _xdr_result = (xdrproc_t)xdr_wccstat3;
+            _argument_size = sizeof(pJob->argument.nfsproc3_remove_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_remove_3_res);
             break;
 
         case NFSPROC3_RMDIR:
             _xdr_argument = (xdrproc_t)xdr_diropargs3;
             _xdr_result = (xdrproc_t)xdr_wccstat3;
+            _argument_size = sizeof(pJob->argument.nfsproc3_rmdir_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_rmdir_3_res);
             break;
 
         case NFSPROC3_RENAME:
             _xdr_argument = (xdrproc_t)xdr_rename3args;
             _xdr_result = (xdrproc_t)xdr_rename3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_rename_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_rename_3_res);
             break;
 
         case NFSPROC3_LINK:
             _xdr_argument = (xdrproc_t)xdr_link3args;
             _xdr_result = (xdrproc_t)xdr_link3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_link_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_link_3_res);
             break;
 
         case NFSPROC3_READDIR:
             _xdr_argument = (xdrproc_t)xdr_readdir3args;
             _xdr_result = (xdrproc_t)xdr_readdir3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_readdir_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_readdir_3_res);
             break;
 
         case NFSPROC3_READDIRPLUS:
             _xdr_argument = (xdrproc_t)xdr_readdirplus3args;
             _xdr_result = (xdrproc_t)xdr_readdirplus3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_readdirplus_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_readdirplus_3_res);
             break;
 
         case NFSPROC3_FSSTAT:
             _xdr_argument = (xdrproc_t)xdr_nfs_fh3;
             _xdr_result = (xdrproc_t)xdr_fsstat3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_fsstat_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_fsstat_3_res);
             break;
 
         case NFSPROC3_FSINFO:
             _xdr_argument = (xdrproc_t)xdr_nfs_fh3;
             _xdr_result = (xdrproc_t)xdr_fsinfo3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_fsinfo_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_fsinfo_3_res);
             break;
 
         case NFSPROC3_PATHCONF:
             _xdr_argument = (xdrproc_t)xdr_nfs_fh3;
             _xdr_result = (xdrproc_t)xdr_pathconf3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_pathconf_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_pathconf_3_res);
             break;
 
         case NFSPROC3_COMMIT:
             _xdr_argument = (xdrproc_t)xdr_commit3args;
             _xdr_result = (xdrproc_t)xdr_commit3res;
+            _argument_size = sizeof(pJob->argument.nfsproc3_commit_3_arg);
+            _result_size = sizeof(pJob->result.nfsproc3_commit_3_res);
             break;
 
         default:
@@ -237,9 +297,9 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
             break;
     }
     if (success) {
-        // Fill job parameters
-        memset((char*)pJob->Argument(), 0, sizeof(pJob->argument));
-        memset((char*)pJob->Result(), 0, sizeof(pJob->result));
+        // Fill job parameters; only the procedure's argument and result need to be cleared for XDR
+        memset((char*)pJob->Argument(), 0, _argument_size);
+        memset((char*)pJob->Result(), 0, _result_size);
         pJob->xdr_argument = _xdr_argument;
         pJob->xdr_result = _xdr_result;
         pJob->rq_proc = rq_proc;
@@ -247,6 +307,9 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
         pJob->fd = transp->xp_sock;
         pJob->xid = custom_xp_get_xid(transp);
         pJob->s_addr = svc_getcaller(transp)->sin_addr.s_addr;
+        pJob->rawResultBuffer = NULL;
+        pJob->rawResult = NULL;
+        pJob->rawResultSize = 0;
         // Get arguments
         if (svc_getargs(transp, pJob->XdrArgument(), pJob->Argument())) {
             if (pJob->IsReadRequest()) {
@@ -263,6 +326,7 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
                 pJob->file = args->file;
                 pJob->immediate = false;
             } else {
+                pJob->requestSize = 0;
                 pJob->immediate = true;
             }
         } else {
@@ -273,34 +337,40 @@ bool InitJob(Job* pJob, rpcproc_t rq_proc, register SVCXPRT* transp)
     return success;
 }
 
-void RunJob(Job* pJob)
+// Reply to a job's client once NFS has completed it
+void ReplyJob(Job* pJob, enum clnt_stat rpcStatus)
 {
-    // Forward to NFS
-    enum clnt_stat rpcStatus = clnt_call(pJob->RPCClient(), pJob->Proc(),
-                                         pJob->XdrArgument(), pJob->Argument(),
-                                         pJob->XdrResult(), pJob->Result(),
-                                         TIMEOUT);
     xprt_cache_t& xprt_cache_data = xprt_cache[pJob->Fd()];
     pthread_mutex_lock(&xprt_cache_data.mutex);
-    // Wake up thread reading requests
+    // Resume receiving requests if the connection was throttled
     if (sched->GetNumPendingJobs(pJob->Addr()) < maxPendingJobsPerClient) {
-        pthread_cond_signal(&xprt_cache_data.recvJobCV);
+        custom_svc_resume(pJob->Fd());
     }
     // Only reply if xprt is matching
     register SVCXPRT* transp = pJob->Xprt();
     if (xprt_cache_data.xprt == transp) {
         custom_xp_set_xid(transp, pJob->Xid());
         if (rpcStatus == RPC_SUCCESS) {
-            // Reply to client
-            if (!svc_sendreply(transp, pJob->XdrResult(), pJob->Result())) {
+            // Reply to client, passing through results that were not decoded
+            bool_t replied;
+            if (pJob->rawResult != NULL) {
+                replied = svc_sendreply(transp, (xdrproc_t)xdr_raw_result, (caddr_t)pJob);
+            } else {
+                replied = svc_sendreply(transp, pJob->XdrResult(), pJob->Result());
+            }
+            if (!replied) {
                 svcerr_systemerr(transp);
             }
         } else {
-            clnt_perror(pJob->RPCClient(), "Failed RPC");
+            if (pJob->RPCClient() != NULL) {
+                clnt_perror(pJob->RPCClient(), "Failed RPC");
+            } else {
+                cerr << "Failed RPC: " << clnt_sperrno(rpcStatus) << endl;
+            }
             svcerr_systemerr(transp);
             pthread_mutex_unlock(&xprt_cache_data.mutex);
-            // Indicate that job has finished forwarding to NFS
-            sched->CompleteJob(pJob);
+            // Indicate that job has finished forwarding to NFS without reusing its RPC client
+            sched->CompleteJob(pJob, false);
             return;
         }
         // Free arguments
@@ -310,16 +380,48 @@ void RunJob(Job* pJob)
     }
     pthread_mutex_unlock(&xprt_cache_data.mutex);
 
-    // Indicate that job has finished forwarding to NFS
-    sched->CompleteJob(pJob);
-
     // Free results
-    if (!clnt_freeres(pJob->RPCClient(), pJob->XdrResult(), pJob->Result())) {
-        cerr << "Unable to free results" << endl;
-    }
+    xdr_free(pJob->XdrResult(), pJob->Result());
+    free(pJob->rawResultBuffer);
+
+    // Indicate that job has finished forwarding to NFS and return its RPC client to scheduler
+    sched->CompleteJob(pJob, true);
+}
+
+// Forward a job to NFS over its RPC client and reply to its client. Returns the RPC status.
+enum clnt_stat RunJob(Job* pJob)
+{
+    // Forward to NFS
+    enum clnt_stat rpcStatus = clnt_call(pJob->RPCClient(), pJob->Proc(),
+                                         pJob->XdrArgument(), pJob->Argument(),
+                                         pJob->XdrResult(), pJob->Result(),
+                                         TIMEOUT);
+    ReplyJob(pJob, rpcStatus);
+    return rpcStatus;
+}
+
+// Connect a NFS RPC client to the NFS server. Returns NULL on error.
+CLIENT* CreateNFSClient()
+{
+    CLIENT* cl; // NFS RPC handle
+    if ((cl = clnt_create("127.0.0.1", NFS_PROGRAM, NFS_V3, "tcp")) == NULL) {
+        clnt_pcreateerror("127.0.0.1");
+        return NULL;
+    }
+    // Use NFS enforcer's user as authentication
+    cl->cl_auth = authunix_create_default();
+    return cl;
+}
 
-    // Return RPC client to scheduler
-    sched->ReturnClient(pJob);
+// Replace a NFS RPC client whose connection failed, retrying every second until the NFS server accepts the connection.
+CLIENT* ReconnectNFSClient(CLIENT* cl)
+{
+    auth_destroy(cl->cl_auth);
+    clnt_destroy(cl);
+    while ((cl = CreateNFSClient()) == NULL) {
+        sleep(1);
+    }
+    return cl;
 }
 
 bool_t custom_xp_recv (SVCXPRT* xprt, struct rpc_msg* msg)
@@ -389,17 +491,12 @@ void custom_xp_destroy(SVCXPRT* xprt)
     pthread_mutex_lock(&xprt_mutex);
     if (xprt_cache_data.xprt == xprt) {
         assert(xprt_cache_data.xp_ops != NULL);
-        if (xprt_cache_data.threadDestroy != NULL) {
-            // Signal RPC thread to terminate
-            *xprt_cache_data.threadDestroy = true;
-            pthread_cond_signal(&xprt_cache_data.CV);
-        }
+        // Stop receiving from the connection
+        custom_svc_unregister(xprt->xp_sock);
         // Destroy xprt
         xprt->xp_ops = xprt_cache_data.xp_ops;
         xprt_cache_data.xprt = NULL;
         xprt_cache_data.xp_ops = NULL;
-        xprt_cache_data.threadDestroy = NULL;
-        xprt_cache_data.ignore = false;
         pthread_mutex_unlock(&xprt_mutex);
         SVC_DESTROY(xprt);
     } else {
@@ -411,9 +508,11 @@ void custom_xp_destroy(SVCXPRT* xprt)
 // Assumes xprt mutex is held
 void proxy_dispatch(struct svc_req* rqstp, register SVCXPRT* transp)
 {
-    Job* pJob = new Job();
+    Job* pJob = new Job;
     if (InitJob(pJob, rqstp->rq_proc, transp)) {
         sched->SubmitJob(pJob);
+    } else {
+        delete pJob;
     }
 }
 
@@ -442,17 +541,57 @@ void* worker_thread(void* ptr)
 {
     while (true) {
         Job* pJob = sched->GetNextJob();
-        // Run job
+        // Run job; the scheduler deletes it once it is completed
         RunJob(pJob);
-        // Delete job
-        delete pJob;
     }
     return NULL;
 }
 
-// Dummy signal handler to wake up poll
-void dummy_signal(int signum)
+// Worker thread pinned to the cores of a NUMA node that forwards jobs to NFS over its own RPC client.
+// The client is created by the worker after it is pinned, so that its buffers are allocated on the worker's node.
+void* node_worker_thread(void* ptr)
+{
+    int rc = CpuTopology::pinThread(topology->nodeCpus((long)ptr));
+    if (rc) {
+        cerr << "Warning: unable to pin worker thread: " << rc << endl;
+    }
+    CLIENT* cl = CreateNFSClient();
+    if (cl == NULL) {
+        exit(2);
+    }
+    uint64_t lastRunTime = GetTime();
+    while (true) {
+        Job* pJob = sched->GetNextJob();
+        // Reconnect if the NFS server closed the connection while the worker was idle
+        if ((GetTime() - lastRunTime) > ConvertSecondsToTime(WORKER_IDLE_SECONDS)) {
+            char clnt_res = 0;
+            if (clnt_call(cl, NFSPROC3_NULL,
+                          (xdrproc_t)xdr_void, (caddr_t)NULL,
+                          (xdrproc_t)xdr_void, (caddr_t)&clnt_res,
+                          TIMEOUT) != RPC_SUCCESS) {
+                cl = ReconnectNFSClient(cl);
+            }
+        }
+        // Run job; the scheduler deletes it once it is completed without taking the client
+        pJob->cl = cl;
+        enum clnt_stat rpcStatus = RunJob(pJob);
+        if ((rpcStatus == RPC_CANTSEND) || (rpcStatus == RPC_CANTRECV)) {
+            cl = ReconnectNFSClient(cl);
+        }
+        lastRunTime = GetTime();
+    }
+    return NULL;
+}
+
+void* forward_thread(void* ptr)
 {
+    Forwarder* pForwarder = (Forwarder*)ptr;
+    while (true) {
+        Job* pJob = sched->GetNextJob();
+        // Send job without waiting for its reply; ReplyJob is called once it completes
+        pForwarder->Forward(pJob);
+    }
+    return NULL;
 }
 
 // SIGTERM/SIGINT signal for cleanup
@@ -475,7 +614,8 @@ void* storage_enforcer_update_svc(StorageUpdateArgs* argp, struct svc_req* rqstp
                             client->priority,
                             client->rateLimitRates.rateLimitRates_len,
                             client->rateLimitRates.rateLimitRates_val,
-                            client->rateLimitBursts.rateLimitBursts_val);
+                            client->rateLimitBursts.rateLimitBursts_val,
+                            string(client->flowName));
     }
     return (void*)&result;
 }
@@ -487,11 +627,69 @@ StorageGetOccupancyRes* storage_enforcer_get_occupancy_svc(StorageGetOccupancyAr
     return &result;
 }
 
+// Copy a histogram snapshot into an RPC histogram, which points into the snapshot's counts.
+static void fillStorageHistogram(StorageHistogram& histogram, unsigned int firstBucket, vector<uint64_t>& counts)
+{
+    histogram.firstBucket = firstBucket;
+    histogram.counts.counts_len = counts.size();
+    histogram.counts.counts_val = counts.empty() ? NULL : (u_quad_t*)&counts[0];
+}
+
+// GetStats RPC - get telemetry of clients
+StorageGetStatsRes* storage_enforcer_get_stats_svc(StorageGetStatsArgs* argp, struct svc_req* rqstp)
+{
+    // Results are kept per thread until the thread's next call, since receive threads handle requests concurrently
+    static __thread StorageGetStatsRes result;
+    static __thread vector<ClientStatsSnapshot>* pStats = NULL;
+    static __thread vector<StorageClientStats>* pResults = NULL;
+    if (pStats == NULL) {
+        pStats = new vector<ClientStatsSnapshot>();
+        pResults = new vector<StorageClientStats>();
+    }
+    vector<unsigned long> s_addrs(argp->s_addrs.s_addrs_val, argp->s_addrs.s_addrs_val + argp->s_addrs.s_addrs_len);
+    sched->GetStats(s_addrs, *pStats);
+    pResults->resize(pStats->size());
+    for (unsigned int i = 0; i < pStats->size(); i++) {
+        ClientStatsSnapshot& stats = (*pStats)[i];
+        StorageClientStats& clientStats = (*pResults)[i];
+        clientStats.s_addr = stats.s_addr;
+        fillStorageHistogram(clientStats.queueTime, stats.queueTimeFirstBucket, stats.queueTimeCounts);
+        fillStorageHistogram(clientStats.serviceTime, stats.serviceTimeFirstBucket, stats.serviceTimeCounts);
+        clientStats.conformingJobs = stats.conformingJobs;
+        clientStats.nonconformingJobs = stats.nonconformingJobs;
+        clientStats.outstandingJobs = stats.outstandingJobs;
+        clientStats.pendingJobs = stats.pendingJobs;
+        clientStats.maxPendingJobs = stats.maxPendingJobs;
+    }
+    result.StorageGetStatsRes_len = pResults->size();
+    result.StorageGetStatsRes_val = pResults->empty() ? NULL : &(*pResults)[0];
+    return &result;
+}
+
+// Periodically publish observed r-b curves to the AdmissionControllers.
+void* publish_thread(void* arg)
+{
+    uint64_t t = GetTime();
+    while (true) {
+        t += ConvertSecondsToTime(publishPeriod);
+        AbsoluteSleepUninterruptible(t);
+        Json::Value rbCurves;
+        sched->GetRbCurves(rbCurves);
+        if (rbCurves.size() > 0) {
+            for (vector<AdmissionController_clnt*>::const_iterator it = admissionControllers.begin(); it != admissionControllers.end(); it++) {
+                (*it)->updateArrivalCurves(rbCurves);
+            }
+        }
+    }
+    return NULL;
+}
+
 void storage_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
 {
     union {
         StorageUpdateArgs storage_enforcer_update_arg;
         StorageGetOccupancyArgs storage_get_occupancy_arg;
+        StorageGetStatsArgs storage_get_stats_arg;
     } argument;
     char* result;
     xdrproc_t _xdr_argument, _xdr_result;
@@ -514,6 +712,12 @@ void storage_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
             local = (char* (*)(char*, struct svc_req*))storage_enforcer_get_occupancy_svc;
             break;
 
+        case STORAGE_ENFORCER_GET_STATS:
+            _xdr_argument = (xdrproc_t)xdr_StorageGetStatsArgs;
+            _xdr_result = (xdrproc_t)xdr_StorageGetStatsRes;
+            local = (char* (*)(char*, struct svc_req*))storage_enforcer_get_stats_svc;
+            break;
+
         default:
             svcerr_noproc(transp);
             return;
@@ -536,13 +740,22 @@ int main(int argc, char** argv)
 {
     int opt = 0;
     char* configFile = NULL;
+    vector<string> admissionControllerAddrs;
     do {
-        opt = getopt(argc, argv, "c:");
+        opt = getopt(argc, argv, "c:a:p:");
         switch (opt) {
             case 'c':
                 configFile = optarg;
                 break;
 
+            case 'a':
+                admissionControllerAddrs.push_back(string(optarg));
+                break;
+
+            case 'p':
+                publishPeriod = atof(optarg);
+                break;
+
             case -1:
                 break;
 
@@ -552,7 +765,7 @@ int main(int argc, char** argv)
     } while (opt != -1);
 
     if (configFile == NULL) {
-        cerr << "Usage: " << argv[0] << " -c configFile" << endl;
+        cerr << "Usage: " << argv[0] << " -c configFile [-a admissionControllerAddr ...] [-p publishPeriod]" << endl;
         // Unregister NFS RPC handlers before quitting
         pmap_unset(NFS_PROGRAM, NFS_V3);
         // Unregister storage RPC handlers
@@ -560,8 +773,6 @@ int main(int argc, char** argv)
         exit(1);
     }
 
-    // Get pid
-    pid = getpid();
     // Read config file
     Json::Value root;
     if (!readJson(configFile, root)) {
@@ -583,14 +794,16 @@ int main(int argc, char** argv)
     } else {
         maxOutstandingWriteBytes = 1024 * 1024 * 1024; // large number - unconstrained
     }
+    int numReceiveThreads = root.isMember("receiveThreads") ? root["receiveThreads"].asInt() : 4;
+    int numForwardingConnections = root.isMember("forwardingConnections") ? root["forwardingConnections"].asInt() : 0;
+    bool numaAware = root.isMember("numaAware") ? root["numaAware"].asBool() : false;
+    topology = new CpuTopology(numaAware);
 
     // Setup signal handler
     struct sigaction action;
-    action.sa_handler = dummy_signal;
+    action.sa_handler = term_signal;
     sigemptyset(&action.sa_mask);
     action.sa_flags = 0;
-    sigaction(SIGUSR1, &action, NULL);
-    action.sa_handler = term_signal;
     sigaction(SIGTERM, &action, NULL);
     sigaction(SIGINT, &action, NULL);
     // Ignore SIGPIPE
@@ -610,26 +823,32 @@ int main(int argc, char** argv)
         pthread_mutexattr_init(&attr);
         pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
         pthread_mutex_init(&xprt_cache[i].mutex, &attr);
-        pthread_cond_init(&xprt_cache[i].CV, NULL);
-        pthread_cond_init(&xprt_cache[i].recvJobCV, NULL);
         xprt_cache[i].xprt = NULL;
         xprt_cache[i].xp_ops = NULL;
         xprt_cache[i].ignore = false;
-        xprt_cache[i].threadDestroy = NULL;
+        xprt_cache[i].throttled = false;
+        xprt_cache[i].receivePool = 0;
     }
 
-    // Create NFS RPC clients
+    // Create NFS RPC clients, or connections for asynchronous forwarding
+    // With NUMA awareness, each worker creates its own RPC client instead
     vector<CLIENT*> RPCClients;
-    int numClients = NFS_read_MPL + NFS_write_MPL + 7; // 7 for backup and non-read/write requests
-    for (int i = 0; i < numClients; i++) {
+    int numClients = 0;
+    Forwarder* forwarder = NULL;
+    if (numForwardingConnections > 0) {
+        forwarder = new Forwarder("127.0.0.1", numForwardingConnections, ReplyJob);
+        if (!forwarder->Start()) {
+            exit(2);
+        }
+    } else {
+        numClients = NFS_read_MPL + NFS_write_MPL + 7; // 7 for backup and non-read/write requests
+    }
+    for (int i = 0; !numaAware && (i < numClients); i++) {
         // Connect to NFS server
-        CLIENT* cl; // NFS RPC handle
-        if ((cl = clnt_create("127.0.0.1", NFS_PROGRAM, NFS_V3, "tcp")) == NULL) {
-            clnt_pcreateerror("127.0.0.1");
+        CLIENT* cl = CreateNFSClient();
+        if (cl == NULL) {
             exit(2);
         }
-        // Use NFS enforcer's user as authentication
-        cl->cl_auth = authunix_create_default();
         RPCClients.push_back(cl);
     }
 
@@ -643,15 +862,19 @@ int main(int argc, char** argv)
         exit(1);
     }
 
-    // Create worker threads
-    for (int i = 0; i < numClients; i++) {
+    // Publish observed r-b curves to AdmissionControllers
+    if (!admissionControllerAddrs.empty()) {
+        for (vector<string>::const_iterator it = admissionControllerAddrs.begin(); it != admissionControllerAddrs.end(); it++) {
+            admissionControllers.push_back(new AdmissionController_clnt(*it));
+        }
+        sched->EnableRbEstimation(STORAGE_BANDWIDTH, RB_NUM_RATES);
         pthread_t thread;
         pthread_attr_t attr;
         pthread_attr_init(&attr);
         pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
         int rc = pthread_create(&thread,
                                 &attr,
-                                worker_thread,
+                                publish_thread,
                                 (void*)NULL);
         if (rc) {
             cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
@@ -659,6 +882,38 @@ int main(int argc, char** argv)
         }
     }
 
+    // Create worker threads, spread over the NUMA nodes with NUMA awareness
+    for (int i = 0; i < numClients; i++) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&thread,
+                                &attr,
+                                numaAware ? node_worker_thread : worker_thread,
+                                (void*)(long)(i % topology->numNodes()));
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+
+    // Create forwarding threads
+    for (int i = 0; i < numForwardingConnections; i++) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&thread,
+                                &attr,
+                                forward_thread,
+                                (void*)forwarder);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+
     // Unregister NFS RPC handlers
     pmap_unset(NFS_PROGRAM, NFS_V3);
 
@@ -700,11 +955,12 @@ int main(int argc, char** argv)
     }
 
     // Run proxy
-    custom_svc_run();
+    custom_svc_run(numReceiveThreads, *topology);
     cerr << "custom_svc_run returned" << endl;
 
     delete sched;
     delete pEst;
+    delete topology;
     delete[] xprt_cache;
 
     return 1;
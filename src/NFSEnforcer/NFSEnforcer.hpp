@@ -11,11 +11,11 @@
 #include <unistd.h>
 #include <rpc/rpc.h>
 #include <rpc/pmap_clnt.h>
+#include "../common/CpuTopology.hpp"
 #include "scheduler.hpp"
 
 using namespace std;
 
-extern pid_t pid;
 // Scheduler
 extern Scheduler* sched;
 extern uint64_t startTime;
@@ -24,18 +24,23 @@ extern int maxPendingJobsPerClient;
 struct xprt_cache_t {
     SVCXPRT* xprt; // xprt handle
     pthread_mutex_t mutex;
-    pthread_cond_t CV;
-    pthread_cond_t recvJobCV;
     const struct SVCXPRT::xp_ops* xp_ops; // original xp_ops
     struct SVCXPRT::xp_ops xp_ops_modified; // modified xp_ops with our interposition
-    bool ignore; // ignore fd in poll
-    volatile bool* threadDestroy; // destroy signal to RPC thread
+    bool ignore; // ignore fd in poll since it is handled by the receive threads
+    bool throttled; // not being received until the client's pending jobs drop below maxPendingJobsPerClient
+    int receivePool; // receive pool (NUMA node) handling the connection while ignore is set
 };
 extern pthread_mutex_t xprt_mutex; // used in addition to xprt_cache->mutex to protect ignore flag; must not lock xprt_cache->mutex while holding xprt_mutex
 extern xprt_cache_t* xprt_cache;
 
-// Custom svc_run function.
-void custom_svc_run();
+// Custom svc_run function with numReceiveThreads threads receiving NFS requests, spread over the nodes of the topology.
+void custom_svc_run(int numReceiveThreads, const CpuTopology& topology);
+// Resume receiving from a connection that was throttled.
+// Assumes xprt_cache[fd].mutex is held
+void custom_svc_resume(int fd);
+// Remove a connection from the receive threads before its xprt is destroyed.
+// Assumes xprt_cache[fd].mutex and xprt_mutex are held
+void custom_svc_unregister(int fd);
 
 // RPC dispatch functions.
 void proxy_dispatch(struct svc_req* rqstp, register SVCXPRT* transp);
@@ -1,25 +1,122 @@
 // custom_svc_run.cpp - custom svc_run function to add threading support.
 // Based on glibc-2.19 with minor modifications to add threading and integrate with NFSEnforcer.cpp.
+// The main thread polls the fds managed by the RPC library (e.g., listening sockets) as in svc_run. Once NFSEnforcer caches a NFS connection's
+// xprt, the connection is handed to a fixed pool of receive threads that wait on an edge-triggered, one-shot epoll set, so each connection
+// is received by at most one thread at a time without a thread per connection. Connections are also queued to the pool through an eventfd
+// when they have requests buffered in their xprt or are resumed after being throttled by maxPendingJobsPerClient.
+// Each NUMA node has its own receive pool with threads pinned to its cores, and a connection is handed to the pool of the node whose CPU
+// receives its packets from the NIC, so that it is received and its jobs are allocated on that node.
 //
 
 #include <iostream>
 #include <cassert>
+#include <deque>
+#include <vector>
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
-#include <signal.h>
+#include <stdint.h>
 #include <rpc/rpc.h>
 #include <rpc/pmap_clnt.h>
 #include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <errno.h>
+#include "../common/CpuTopology.hpp"
 #include "NFSEnforcer.hpp"
 
-// From glibc-2.19 with minor modifications to compile and run in a thread
+#define CUSTOM_SVC_MAX_EVENTS 64
+
+// Receive thread pool of a NUMA node
+struct receive_pool_t {
+    int epollFd;
+    // Connections queued to the receive threads, each counted in readyEventFd
+    int readyEventFd;
+    pthread_mutex_t readyMutex;
+    deque<int> readyFds;
+    const vector<int>* cpus; // cores of the pool's node
+};
+static vector<receive_pool_t*> receivePools;
+static const CpuTopology* receiveTopology = NULL;
+
+// Rearm fd in its pool's epoll set to be received once it has data.
+static void custom_svc_rearm(int fd)
+{
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(receivePools[xprt_cache[fd].receivePool]->epollFd, EPOLL_CTL_MOD, fd, &event) < 0) {
+        perror("svc_run: - epoll_ctl failed");
+    }
+}
+
+// Queue fd to a receive thread of its pool to receive the requests buffered in its xprt.
+static void custom_svc_queue(int fd)
+{
+    receive_pool_t* pPool = receivePools[xprt_cache[fd].receivePool];
+    pthread_mutex_lock(&pPool->readyMutex);
+    pPool->readyFds.push_back(fd);
+    pthread_mutex_unlock(&pPool->readyMutex);
+    uint64_t count = 1;
+    if (write(pPool->readyEventFd, &count, sizeof(count)) != sizeof(count)) {
+        perror("svc_run: - eventfd write failed");
+    }
+}
+
+// Hand a connection with a cached xprt to the receive threads, so that the main poll loop ignores it.
+// Assumes xprt_cache[fd].mutex is held
+static void custom_svc_register(int fd)
+{
+    xprt_cache_t& xprt_cache_data = xprt_cache[fd];
+    if (xprt_cache_data.ignore) {
+        return;
+    }
+    pthread_mutex_lock(&xprt_mutex);
+    xprt_cache_data.ignore = true;
+    pthread_mutex_unlock(&xprt_mutex);
+    // Use the pool of the node receiving the connection's packets, spreading connections over the pools if it is unknown
+    int node = receiveTopology->socketNode(fd);
+    xprt_cache_data.receivePool = (node >= 0) ? node : (fd % receivePools.size());
+    // Add it disarmed and queue it, since the xprt may have buffered requests that epoll does not report
+    struct epoll_event event;
+    event.events = EPOLLET | EPOLLONESHOT;
+    event.data.fd = fd;
+    if (epoll_ctl(receivePools[xprt_cache_data.receivePool]->epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        perror("svc_run: - epoll_ctl failed");
+    }
+    custom_svc_queue(fd);
+}
+
+// Resume receiving from a connection that was throttled.
+// Assumes xprt_cache[fd].mutex is held
+void custom_svc_resume(int fd)
+{
+    xprt_cache_t& xprt_cache_data = xprt_cache[fd];
+    if (xprt_cache_data.throttled) {
+        xprt_cache_data.throttled = false;
+        custom_svc_queue(fd);
+    }
+}
+
+// Remove a connection from the receive threads before its xprt is destroyed.
+// Assumes xprt_cache[fd].mutex and xprt_mutex are held
+void custom_svc_unregister(int fd)
+{
+    xprt_cache_t& xprt_cache_data = xprt_cache[fd];
+    if (xprt_cache_data.ignore) {
+        epoll_ctl(receivePools[xprt_cache_data.receivePool]->epollFd, EPOLL_CTL_DEL, fd, NULL);
+        xprt_cache_data.ignore = false;
+    }
+    xprt_cache_data.throttled = false;
+}
+
+// From glibc-2.19 with minor modifications to compile and run in a receive thread
+// Receives the requests buffered in the xprt, and then from the socket if readable is set, until the connection has no more requests,
+// is throttled, or dies. The connection is then rearmed in the epoll set unless it is throttled or destroyed.
 #define RQCRED_SIZE 400/* this size is excessive */
-void* custom_svc_getreq_common_thread(void* ptr)
+static void custom_svc_getreq_fd(int fd, bool readable)
 {
-    volatile bool destroy = false;
     struct rpc_msg msg;
-    int fd = (long)ptr;
     char cred_area[2 * MAX_AUTH_BYTES + RQCRED_SIZE];
     msg.rm_call.cb_cred.oa_base = cred_area;
     msg.rm_call.cb_verf.oa_base = &(cred_area[MAX_AUTH_BYTES]);
@@ -28,64 +125,155 @@ void* custom_svc_getreq_common_thread(void* ptr)
     xprt_cache_t& xprt_cache_data = xprt_cache[fd];
     pthread_mutex_lock(&xprt_cache_data.mutex);
     register SVCXPRT* xprt = xprt_cache_data.xprt;
-    if ((xprt != NULL) && (xprt_cache_data.threadDestroy == NULL)) {
-        xprt_cache_data.threadDestroy = &destroy;
-        while (!destroy) {
-            do
-            {
-                if (SVC_RECV (xprt, &msg))
-                {
-                    /* now find the exported program and call it */
-                    struct svc_req r;
-                    enum auth_stat why;
-
-                    r.rq_clntcred = &(cred_area[2 * MAX_AUTH_BYTES]);
-                    r.rq_xprt = xprt;
-                    r.rq_prog = msg.rm_call.cb_prog;
-                    r.rq_vers = msg.rm_call.cb_vers;
-                    r.rq_proc = msg.rm_call.cb_proc;
-                    r.rq_cred = msg.rm_call.cb_cred;
-
-                    /* first authenticate the message */
-                    /* Check for null flavor and bypass these calls if possible */
-
-                    if (msg.rm_call.cb_cred.oa_flavor == AUTH_NULL)
-                    {
-                        r.rq_xprt->xp_verf.oa_flavor = _null_auth.oa_flavor;
-                        r.rq_xprt->xp_verf.oa_length = 0;
-                    }
-                    else if ((why = _authenticate (&r, &msg)) != AUTH_OK)
-                    {
-                        svcerr_auth (xprt, why);
-                        continue;
-                    }
-
-                    if (r.rq_prog == NFS_PROGRAM) {
-                        assert(r.rq_vers == NFS_V3);
-                        proxy_dispatch(&r, xprt);
-                    } else {
-                        svcerr_noprog(xprt);
-                    }
-                }
-                if (sched->GetNumPendingJobs(svc_getcaller(xprt)->sin_addr.s_addr) >= maxPendingJobsPerClient) {
-                    pthread_cond_wait(&xprt_cache_data.recvJobCV, &xprt_cache_data.mutex);
-                }
-            } while (SVC_STAT(xprt) == XPRT_MOREREQS);
+    if ((xprt == NULL) || xprt_cache_data.throttled) {
+        pthread_mutex_unlock(&xprt_cache_data.mutex);
+        return;
+    }
+    bool receive = readable || (SVC_STAT(xprt) == XPRT_MOREREQS);
+    while (receive)
+    {
+        if (SVC_RECV (xprt, &msg))
+        {
+            /* now find the exported program and call it */
+            struct svc_req r;
+            enum auth_stat why;
+
+            r.rq_clntcred = &(cred_area[2 * MAX_AUTH_BYTES]);
+            r.rq_xprt = xprt;
+            r.rq_prog = msg.rm_call.cb_prog;
+            r.rq_vers = msg.rm_call.cb_vers;
+            r.rq_proc = msg.rm_call.cb_proc;
+            r.rq_cred = msg.rm_call.cb_cred;
 
-            // Wake main poll so it'll take this socket into account
-            pthread_mutex_lock(&xprt_mutex);
-            xprt_cache_data.ignore = false;
-            pthread_mutex_unlock(&xprt_mutex);
-            kill(pid, SIGUSR1);
+            /* first authenticate the message */
+            /* Check for null flavor and bypass these calls if possible */
 
-            // Wait on cond var
-            pthread_cond_wait(&xprt_cache_data.CV, &xprt_cache_data.mutex);
+            if (msg.rm_call.cb_cred.oa_flavor == AUTH_NULL)
+            {
+                r.rq_xprt->xp_verf.oa_flavor = _null_auth.oa_flavor;
+                r.rq_xprt->xp_verf.oa_length = 0;
+            }
+            else if ((why = _authenticate (&r, &msg)) != AUTH_OK)
+            {
+                svcerr_auth (xprt, why);
+                receive = (SVC_STAT(xprt) == XPRT_MOREREQS);
+                continue;
+            }
+
+            if (r.rq_prog == NFS_PROGRAM) {
+                assert(r.rq_vers == NFS_V3);
+                proxy_dispatch(&r, xprt);
+            } else {
+                svcerr_noprog(xprt);
+            }
+        }
+        // Stop receiving until RunJob resumes the connection
+        if (sched->GetNumPendingJobs(svc_getcaller(xprt)->sin_addr.s_addr) >= maxPendingJobsPerClient) {
+            xprt_cache_data.throttled = true;
+            pthread_mutex_unlock(&xprt_cache_data.mutex);
+            return;
         }
+        receive = (SVC_STAT(xprt) == XPRT_MOREREQS);
+    }
+    if (SVC_STAT(xprt) == XPRT_DIED) {
+        SVC_DESTROY(xprt);
+    } else {
+        // Rearming reports the fd again if data arrived while it was being received
+        custom_svc_rearm(fd);
     }
     pthread_mutex_unlock(&xprt_cache_data.mutex);
+}
+
+// Receive thread that handles connections reported by its pool's epoll set.
+// Thread i belongs to pool i % receivePools.size() and is pinned to the next core of the pool's node.
+static void* custom_svc_receive_thread(void* ptr)
+{
+    long i = (long)ptr;
+    receive_pool_t* pPool = receivePools[i % receivePools.size()];
+    // Pin to a core
+    vector<int> core(1, (*pPool->cpus)[(i / receivePools.size()) % pPool->cpus->size()]);
+    int rc = CpuTopology::pinThread(core);
+    if (rc) {
+        cerr << "Warning: unable to pin receive thread: " << rc << endl;
+    }
+    struct epoll_event events[CUSTOM_SVC_MAX_EVENTS];
+    while (true) {
+        int numEvents = epoll_wait(pPool->epollFd, events, CUSTOM_SVC_MAX_EVENTS, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("svc_run: - epoll_wait failed");
+            exit(-1);
+        }
+        for (int i = 0; i < numEvents; i++) {
+            int fd = events[i].data.fd;
+            if (fd == pPool->readyEventFd) {
+                // Take one queued connection per count, leaving the rest to other receive threads
+                uint64_t count;
+                if (read(pPool->readyEventFd, &count, sizeof(count)) != sizeof(count)) {
+                    continue;
+                }
+                pthread_mutex_lock(&pPool->readyMutex);
+                assert(!pPool->readyFds.empty());
+                fd = pPool->readyFds.front();
+                pPool->readyFds.pop_front();
+                pthread_mutex_unlock(&pPool->readyMutex);
+                custom_svc_getreq_fd(fd, false);
+            } else {
+                custom_svc_getreq_fd(fd, true);
+            }
+        }
+    }
     return NULL;
 }
 
+// Create the epoll set of each node's receive pool and the receive threads, with at least one thread per pool.
+static void custom_svc_start(int numReceiveThreads, const CpuTopology& topology)
+{
+    receiveTopology = &topology;
+    for (unsigned int node = 0; node < topology.numNodes(); node++) {
+        receive_pool_t* pPool = new receive_pool_t;
+        pPool->epollFd = epoll_create1(0);
+        if (pPool->epollFd < 0) {
+            perror("svc_run: - epoll_create failed");
+            exit(-1);
+        }
+        pPool->readyEventFd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE);
+        if (pPool->readyEventFd < 0) {
+            perror("svc_run: - eventfd failed");
+            exit(-1);
+        }
+        // Level-triggered so that each count wakes a receive thread
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = pPool->readyEventFd;
+        if (epoll_ctl(pPool->epollFd, EPOLL_CTL_ADD, pPool->readyEventFd, &event) < 0) {
+            perror("svc_run: - epoll_ctl failed");
+            exit(-1);
+        }
+        pthread_mutex_init(&pPool->readyMutex, NULL);
+        pPool->cpus = &topology.nodeCpus(node);
+        receivePools.push_back(pPool);
+    }
+    if (numReceiveThreads < (int)receivePools.size()) {
+        numReceiveThreads = receivePools.size();
+    }
+    for (long i = 0; i < numReceiveThreads; i++) {
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&thread,
+                                &attr,
+                                custom_svc_receive_thread,
+                                (void*)i);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+}
+
 // From glibc-2.19 with minor modifications to compile and add threading
 void custom_svc_getreq_poll (struct pollfd *pfdp, int pollretval, int max_pollfd)
 {
@@ -100,7 +288,7 @@ void custom_svc_getreq_poll (struct pollfd *pfdp, int pollretval, int max_pollfd
         if (p->fd != -1 && p->revents)
         {
             /* fd has input waiting */
-            // Check if we've cached the xprt so that we can run our custom svc_getreq_common in a thread
+            // Check if we've cached the xprt so that its requests can be received by the receive threads
             xprt_cache_t& xprt_cache_data = xprt_cache[p->fd];
             pthread_mutex_lock(&xprt_cache_data.mutex);
             SVCXPRT* xprt = xprt_cache_data.xprt;
@@ -112,32 +300,15 @@ void custom_svc_getreq_poll (struct pollfd *pfdp, int pollretval, int max_pollfd
                     SVC_DESTROY(xprt);
                     pthread_mutex_unlock(&xprt_cache_data.mutex);
                 } else {
-                    pthread_mutex_lock(&xprt_mutex);
-                    assert(p->fd == xprt->xp_sock);
-                    // Ignore this fd in poll until thread completes
-                    assert(xprt_cache[p->fd].ignore == false);
-                    xprt_cache[p->fd].ignore = true;
-                    pthread_mutex_unlock(&xprt_mutex);
-                    if (xprt_cache_data.threadDestroy != NULL) {
-                        pthread_cond_signal(&xprt_cache_data.CV);
-                    } else {
-                        pthread_t thread;
-                        pthread_attr_t attr;
-                        pthread_attr_init(&attr);
-                        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-                        int rc = pthread_create(&thread,
-                                                &attr,
-                                                custom_svc_getreq_common_thread,
-                                                (void*)(long)(p->fd));
-                        if (rc) {
-                            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
-                            exit(-1);
-                        }
-                    }
+                    custom_svc_register(p->fd);
                     pthread_mutex_unlock(&xprt_cache_data.mutex);
                 }
             } else {
                 svc_getreq_common(p->fd);
+                // Hand the connection to the receive threads once NFSEnforcer caches its xprt
+                if (xprt_cache_data.xprt != NULL) {
+                    custom_svc_register(p->fd);
+                }
                 pthread_mutex_unlock(&xprt_cache_data.mutex);
             }
 
@@ -148,12 +319,14 @@ void custom_svc_getreq_poll (struct pollfd *pfdp, int pollretval, int max_pollfd
 }
 
 // From glibc-2.19 with minor modifications to compile and add threading
-void custom_svc_run (void)
+void custom_svc_run (int numReceiveThreads, const CpuTopology& topology)
 {
     int i;
     struct pollfd *my_pollfd = NULL;
     int last_max_pollfd = 0;
 
+    custom_svc_start(numReceiveThreads, topology);
+
     for (;;)
     {
         int max_pollfd = svc_max_pollfd;
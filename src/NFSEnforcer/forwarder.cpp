@@ -0,0 +1,388 @@
+// forwarder.cpp - Code for asynchronous forwarding of NFS requests.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <rpc/rpc.h>
+#include <rpc/pmap_clnt.h>
+#include "forwarder.hpp"
+#include "../common/time.hpp"
+#include "../prot/nfs3_prot.h"
+
+using namespace std;
+
+// Last fragment bit of a TCP record mark (RFC 5531)
+#define RECORD_LAST_FRAGMENT 0x80000000u
+// Upper bound on the size of a call header: xid, direction, rpcvers, prog, vers, proc, and the credential and verifier
+#define CALL_HEADER_MAX_SIZE (6 * BYTES_PER_XDR_UNIT + 2 * (2 * BYTES_PER_XDR_UNIT + MAX_AUTH_BYTES))
+
+// Write all of the buffers in iov to fd; iov is modified. Returns false on error.
+static bool WriteAll(int fd, struct iovec* iov, int iovcnt)
+{
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    while (msg.msg_iovlen > 0) {
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // Skip the buffers written
+        while ((msg.msg_iovlen > 0) && ((size_t)n >= msg.msg_iov->iov_len)) {
+            n -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (n > 0) {
+            msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+// Read size bytes from fd into buf. Returns false on error or end of stream.
+static bool ReadAll(int fd, char* buf, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = recv(fd, buf, size, 0);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        } else if (n == 0) {
+            return false;
+        }
+        buf += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Read one record from fd into a malloc'ed buffer, which is grown as needed. Returns false on error or end of stream.
+static bool ReadRecord(int fd, char*& buffer, size_t& capacity, size_t& size)
+{
+    size = 0;
+    bool lastFragment = false;
+    while (!lastFragment) {
+        uint32_t mark;
+        if (!ReadAll(fd, (char*)&mark, sizeof(mark))) {
+            return false;
+        }
+        mark = ntohl(mark);
+        lastFragment = (mark & RECORD_LAST_FRAGMENT) != 0;
+        size_t fragmentSize = mark & ~RECORD_LAST_FRAGMENT;
+        if (size + fragmentSize > capacity) {
+            char* newBuffer = (char*)realloc(buffer, size + fragmentSize);
+            if (newBuffer == NULL) {
+                return false;
+            }
+            buffer = newBuffer;
+            capacity = size + fragmentSize;
+        }
+        if (!ReadAll(fd, buffer + size, fragmentSize)) {
+            return false;
+        }
+        size += fragmentSize;
+    }
+    return true;
+}
+
+// Encode write arguments up to and including the length of the data.
+static bool_t xdr_write3args_header(XDR* xdrs, write3args* objp)
+{
+    return xdr_nfs_fh3(xdrs, &objp->file) &&
+           xdr_uint64(xdrs, &objp->offset) &&
+           xdr_uint32(xdrs, &objp->count) &&
+           xdr_stable_how(xdrs, &objp->stable) &&
+           xdr_u_int(xdrs, &objp->data.data_len);
+}
+
+bool_t xdr_raw_result(XDR* xdrs, Job* pJob)
+{
+    return XDR_PUTBYTES(xdrs, pJob->rawResult, pJob->rawResultSize);
+}
+
+void* ForwarderReceiveThread(void* ptr)
+{
+    pair<Forwarder*, ForwarderConnection*>* pArgs = (pair<Forwarder*, ForwarderConnection*>*)ptr;
+    Forwarder* pForwarder = pArgs->first;
+    ForwarderConnection* pConnection = pArgs->second;
+    delete pArgs;
+    while (true) {
+        pForwarder->ReceiveReplies(pConnection);
+        pForwarder->Disconnect(pConnection);
+        // Reconnect after a delay
+        uint64_t t = GetTime() + ConvertSecondsToTime(1);
+        AbsoluteSleepUninterruptible(t);
+        while (!pForwarder->Connect(pConnection)) {
+            t += ConvertSecondsToTime(1);
+            AbsoluteSleepUninterruptible(t);
+        }
+    }
+    return NULL;
+}
+
+// Connect a connection to the NFS server.
+bool Forwarder::Connect(ForwarderConnection* pConnection)
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, _host.c_str(), &addr.sin_addr) != 1) {
+        cerr << "Invalid NFS server address " << _host << endl;
+        return false;
+    }
+    // Look up the NFS port with the portmapper
+    u_short port = pmap_getport(&addr, NFS_PROGRAM, NFS_V3, IPPROTO_TCP);
+    if (port == 0) {
+        clnt_pcreateerror(_host.c_str());
+        return false;
+    }
+    addr.sin_port = htons(port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Failed to create socket");
+        return false;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("Failed to connect to NFS server");
+        close(fd);
+        return false;
+    }
+    // Requests are written as whole records, so do not delay them
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+    pthread_mutex_lock(&pConnection->mutex);
+    pConnection->fd = fd;
+    pthread_mutex_unlock(&pConnection->mutex);
+    return true;
+}
+
+// Fail the jobs outstanding on a connection and close it.
+void Forwarder::Disconnect(ForwarderConnection* pConnection)
+{
+    map<uint32_t, Job*> failedJobs;
+    // Wait for any send in progress, so that the fd is not reused while being written to
+    pthread_mutex_lock(&pConnection->sendMutex);
+    pthread_mutex_lock(&pConnection->mutex);
+    if (pConnection->fd >= 0) {
+        close(pConnection->fd);
+        pConnection->fd = -1;
+    }
+    failedJobs.swap(pConnection->outstandingJobs);
+    pthread_mutex_unlock(&pConnection->mutex);
+    pthread_mutex_unlock(&pConnection->sendMutex);
+    if (!failedJobs.empty()) {
+        cerr << "Lost connection to NFS server with " << failedJobs.size() << " outstanding requests" << endl;
+    }
+    for (map<uint32_t, Job*>::iterator it = failedJobs.begin(); it != failedJobs.end(); it++) {
+        _callback(it->second, RPC_CANTRECV);
+    }
+}
+
+// Receive replies on a connection until it fails.
+void Forwarder::ReceiveReplies(ForwarderConnection* pConnection)
+{
+    // Only this thread changes the fd while connected
+    pthread_mutex_lock(&pConnection->mutex);
+    int fd = pConnection->fd;
+    pthread_mutex_unlock(&pConnection->mutex);
+    char* buffer = NULL;
+    size_t capacity = 0;
+    size_t size;
+    while (ReadRecord(fd, buffer, capacity, size)) {
+        if (size < sizeof(uint32_t)) {
+            continue;
+        }
+        // Match the reply to its job
+        uint32_t xid;
+        memcpy(&xid, buffer, sizeof(xid));
+        xid = ntohl(xid);
+        Job* pJob = NULL;
+        pthread_mutex_lock(&pConnection->mutex);
+        map<uint32_t, Job*>::iterator it = pConnection->outstandingJobs.find(xid);
+        if (it != pConnection->outstandingJobs.end()) {
+            pJob = it->second;
+            pConnection->outstandingJobs.erase(it);
+        }
+        pthread_mutex_unlock(&pConnection->mutex);
+        if (pJob == NULL) {
+            cerr << "Unexpected reply from NFS server" << endl;
+            continue;
+        }
+        // Decode the reply directly into the job's result, except for reads, whose result is left encoded in the buffer
+        bool decodeResult = !pJob->IsReadRequest();
+        XDR xdrs;
+        xdrmem_create(&xdrs, buffer, size, XDR_DECODE);
+        struct rpc_msg reply;
+        reply.acpted_rply.ar_verf = _null_auth;
+        reply.acpted_rply.ar_results.where = decodeResult ? pJob->Result() : NULL;
+        reply.acpted_rply.ar_results.proc = decodeResult ? pJob->XdrResult() : (xdrproc_t)xdr_void;
+        enum clnt_stat rpcStatus = RPC_CANTDECODERES;
+        if (xdr_replymsg(&xdrs, &reply)) {
+            struct rpc_err err;
+            _seterr_reply(&reply, &err);
+            rpcStatus = err.re_status;
+            if ((rpcStatus == RPC_SUCCESS) && !decodeResult) {
+                // Give the buffer to the job
+                pJob->rawResultBuffer = buffer;
+                pJob->rawResult = buffer + XDR_GETPOS(&xdrs);
+                pJob->rawResultSize = size - XDR_GETPOS(&xdrs);
+                buffer = NULL;
+                capacity = 0;
+            }
+            if (reply.acpted_rply.ar_verf.oa_base != NULL) {
+                xdrs.x_op = XDR_FREE;
+                xdr_opaque_auth(&xdrs, &reply.acpted_rply.ar_verf);
+            }
+        }
+        XDR_DESTROY(&xdrs);
+        _callback(pJob, rpcStatus);
+    }
+    free(buffer);
+}
+
+// Encode a call for a job into the connection's send buffer, preceded by its record mark.
+// Assumes sendMutex held
+bool Forwarder::EncodeCall(ForwarderConnection* pConnection, Job* pJob, uint32_t xid)
+{
+    xdrproc_t xdrArgument = pJob->IsWriteRequest() ? (xdrproc_t)xdr_write3args_header : pJob->XdrArgument();
+    size_t maxSize = sizeof(uint32_t) + CALL_HEADER_MAX_SIZE + xdr_sizeof(xdrArgument, pJob->Argument());
+    if (pConnection->sendBuffer.size() < maxSize) {
+        pConnection->sendBuffer.resize(maxSize);
+    }
+    XDR xdrs;
+    xdrmem_create(&xdrs, &pConnection->sendBuffer[sizeof(uint32_t)], maxSize - sizeof(uint32_t), XDR_ENCODE);
+    struct rpc_msg call;
+    call.rm_xid = xid;
+    call.rm_direction = CALL;
+    call.rm_call.cb_rpcvers = RPC_MSG_VERSION;
+    call.rm_call.cb_prog = NFS_PROGRAM;
+    call.rm_call.cb_vers = NFS_V3;
+    u_int32_t proc = pJob->Proc();
+    bool success = xdr_callhdr(&xdrs, &call) &&
+                   xdr_u_int32_t(&xdrs, &proc) &&
+                   AUTH_MARSHALL(pConnection->auth, &xdrs) &&
+                   xdrArgument(&xdrs, pJob->Argument());
+    if (success) {
+        size_t recordSize = XDR_GETPOS(&xdrs);
+        if (pJob->IsWriteRequest()) {
+            recordSize += RNDUP(((write3args*)pJob->Argument())->data.data_len);
+        }
+        uint32_t mark = htonl(RECORD_LAST_FRAGMENT | recordSize);
+        memcpy(&pConnection->sendBuffer[0], &mark, sizeof(mark));
+    }
+    XDR_DESTROY(&xdrs);
+    return success;
+}
+
+// Send a job's request to the NFS server.
+void Forwarder::Forward(Job* pJob)
+{
+    uint32_t xid = __sync_fetch_and_add(&_nextXid, 1);
+    ForwarderConnection* pConnection = _connections[__sync_fetch_and_add(&_nextConnection, 1) % _connections.size()];
+    enum clnt_stat rpcStatus = RPC_SUCCESS;
+    pthread_mutex_lock(&pConnection->sendMutex);
+    if (!EncodeCall(pConnection, pJob, xid)) {
+        rpcStatus = RPC_CANTENCODEARGS;
+    } else {
+        pthread_mutex_lock(&pConnection->mutex);
+        int fd = pConnection->fd;
+        if (fd < 0) {
+            rpcStatus = RPC_CANTSEND;
+        } else {
+            // Track the job before sending, since its reply may arrive before the send returns
+            pConnection->outstandingJobs[xid] = pJob;
+        }
+        pthread_mutex_unlock(&pConnection->mutex);
+        if (fd >= 0) {
+            uint32_t mark;
+            memcpy(&mark, &pConnection->sendBuffer[0], sizeof(mark));
+            size_t size = sizeof(mark) + (ntohl(mark) & ~RECORD_LAST_FRAGMENT);
+            // Send write data and its padding from their own buffers
+            static const char padding[BYTES_PER_XDR_UNIT] = {0};
+            struct iovec iov[3];
+            int iovcnt = 1;
+            iov[0].iov_base = &pConnection->sendBuffer[0];
+            if (pJob->IsWriteRequest()) {
+                write3args* args = (write3args*)pJob->Argument();
+                size_t dataSize = RNDUP(args->data.data_len);
+                iov[0].iov_len = size - dataSize;
+                iov[1].iov_base = args->data.data_val;
+                iov[1].iov_len = args->data.data_len;
+                iov[2].iov_base = (void*)padding;
+                iov[2].iov_len = dataSize - args->data.data_len;
+                iovcnt = 3;
+            } else {
+                iov[0].iov_len = size;
+            }
+            if (!WriteAll(fd, iov, iovcnt)) {
+                // The receive thread fails the job unless it already has
+                shutdown(fd, SHUT_RDWR);
+            }
+        }
+    }
+    pthread_mutex_unlock(&pConnection->sendMutex);
+    if (rpcStatus != RPC_SUCCESS) {
+        _callback(pJob, rpcStatus);
+    }
+}
+
+// Connect to the NFS server and start receiving replies.
+bool Forwarder::Start()
+{
+    for (vector<ForwarderConnection*>::iterator it = _connections.begin(); it != _connections.end(); it++) {
+        ForwarderConnection* pConnection = *it;
+        if (!Connect(pConnection)) {
+            return false;
+        }
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&pConnection->receiveThread,
+                                &attr,
+                                ForwarderReceiveThread,
+                                (void*)new pair<Forwarder*, ForwarderConnection*>(this, pConnection));
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+Forwarder::Forwarder(string host, int numConnections, ForwardCallback callback)
+    : _host(host),
+      _callback(callback),
+      _nextXid((uint32_t)GetTime()),
+      _nextConnection(0)
+{
+    for (int i = 0; i < numConnections; i++) {
+        ForwarderConnection* pConnection = new ForwarderConnection;
+        pthread_mutex_init(&pConnection->mutex, NULL);
+        pthread_mutex_init(&pConnection->sendMutex, NULL);
+        pConnection->fd = -1;
+        // Use NFS enforcer's user as authentication
+        pConnection->auth = authunix_create_default();
+        _connections.push_back(pConnection);
+    }
+}
@@ -0,0 +1,76 @@
+// forwarder.hpp - Class definitions for asynchronous forwarding of NFS requests.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _FORWARDER_HPP
+#define _FORWARDER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include <rpc/rpc.h>
+#include "scheduler.hpp"
+
+using namespace std;
+
+// Called with the RPC status of a forwarded job once its reply is received or its connection fails.
+// If the status is RPC_SUCCESS, the job's result has been decoded.
+// Results of reads are not decoded; see xdr_raw_result.
+typedef void (*ForwardCallback)(Job* pJob, enum clnt_stat rpcStatus);
+
+// Encode the undecoded result of a job forwarded by Forwarder, e.g., to reply with svc_sendreply.
+bool_t xdr_raw_result(XDR* xdrs, Job* pJob);
+
+// Connection to the NFS server over which many jobs are outstanding at once.
+typedef struct {
+    // Protects fd and outstandingJobs
+    pthread_mutex_t mutex;
+    // Serializes sending requests so that their records are not interleaved
+    pthread_mutex_t sendMutex;
+    int fd; // -1 while disconnected
+    map<uint32_t, Job*> outstandingJobs; // jobs awaiting a reply by XID
+    AUTH* auth;
+    vector<char> sendBuffer; // protected by sendMutex; holds encoded calls except write data
+    pthread_t receiveThread;
+} ForwarderConnection;
+
+// Forwards NFS requests to the NFS server without waiting for their replies.
+// Jobs are spread over a few TCP connections, each with a thread that receives replies, matches them to their jobs by XID,
+// and completes the jobs through the callback.
+// Data is not copied through XDR: write data is sent directly from the job's arguments, and the result of a read is left encoded
+// in the buffer it was received into, which is given to the job.
+class Forwarder
+{
+private:
+    string _host;
+    ForwardCallback _callback;
+    vector<ForwarderConnection*> _connections;
+    // Next XID and connection to use
+    uint32_t _nextXid;
+    unsigned int _nextConnection;
+
+    // Connect a connection to the NFS server. Returns false on error.
+    bool Connect(ForwarderConnection* pConnection);
+    // Fail the jobs outstanding on a connection and close it.
+    void Disconnect(ForwarderConnection* pConnection);
+    // Receive replies on a connection until it fails.
+    void ReceiveReplies(ForwarderConnection* pConnection);
+    // Encode a call for a job into the connection's send buffer. Returns false on error.
+    // Write data is not encoded; its size including padding is added to the record mark.
+    bool EncodeCall(ForwarderConnection* pConnection, Job* pJob, uint32_t xid);
+    friend void* ForwarderReceiveThread(void* ptr);
+
+public:
+    // Connections are never freed, since their receive threads run until exit.
+    Forwarder(string host, int numConnections, ForwardCallback callback);
+    // Connect to the NFS server and start receiving replies. Returns false on error.
+    bool Start();
+    // Send a job's request to the NFS server; the callback is called once it completes, possibly before Forward returns.
+    void Forward(Job* pJob);
+};
+
+#endif // _FORWARDER_HPP
@@ -5,6 +5,7 @@
 //
 
 #include <iostream>
+#include <algorithm>
 #include <limits>
 #include <cassert>
 #include <cstring>
@@ -37,19 +38,40 @@ Client& Scheduler::GetClient(unsigned long s_addr)
     c.rateLimitUpdateTime = 0;
     c.rateLimitObeyed = false;
     c.occupancy = 0;
-    uint64_t now = GetTime();
+    uint64_t now = _getTime();
     c.lastOccupancyTime = now;
     c.getOccupancyTime = now;
+    c.lastArrivalTime = 0;
+    c.pPendingJobs = GetPendingJobCounter(s_addr, true);
+    c.pRbEstimator = (_rbNumRates > 0) ? new RbEstimator(_rbMaxRate, _rbNumRates) : NULL;
+    c.rbPublishedRequests = 0;
+    c.s_addr = s_addr;
+    initTimerWheelEntry(c.rateLimitTimer, &c);
+    c.pStats = new ClientStats();
     return c;
 }
 
 // Update client parameters.
-void Scheduler::UpdateClient(unsigned long s_addr, unsigned int priority, int rateLimitLength, double* rateLimitRates, double* rateLimitBursts)
+void Scheduler::UpdateClient(unsigned long s_addr, unsigned int priority, int rateLimitLength, double* rateLimitRates, double* rateLimitBursts, string flowName)
 {
     // Request ownership of the mutex
     pthread_mutex_lock(&_schedulerMutex);
+    DrainQueues();
     Client& c = GetClient(s_addr);
+    // Reclassify a backlogged client with its new priority and rate limits
+    bool backlogged = !c.pendingJobs.empty();
+    if (backlogged) {
+        RemoveReadyClient(c);
+    }
     c.priority = priority;
+    // Restart r-b estimation for a new workload
+    if (c.flowName != flowName) {
+        c.flowName = flowName;
+        if (c.pRbEstimator != NULL) {
+            c.pRbEstimator->reset();
+        }
+        c.rbPublishedRequests = 0;
+    }
     delete[] c.rateLimitRates;
     delete[] c.rateLimitBursts;
     delete[] c.rateLimitTokens;
@@ -63,6 +85,61 @@ void Scheduler::UpdateClient(unsigned long s_addr, unsigned int priority, int ra
         c.rateLimitTokens[i] = rateLimitBursts[i];
     }
     c.rateLimitObeyed = false;
+    if (backlogged) {
+        // Token buckets of a backlogged client are only brought up to date when it is checked, so restart them from now
+        uint64_t now = _getTime();
+        c.rateLimitUpdateTime = now;
+        InsertReadyClient(c, now);
+    }
+    // Release ownership of the mutex
+    pthread_mutex_unlock(&_schedulerMutex);
+}
+
+// Observe the r-b curve of each client's read/write requests.
+void Scheduler::EnableRbEstimation(double maxRate, unsigned int numRates)
+{
+    // Request ownership of the mutex
+    pthread_mutex_lock(&_schedulerMutex);
+    _rbMaxRate = maxRate;
+    _rbNumRates = numRates;
+    for (map<unsigned long, Client>::iterator it = _clients.begin(); it != _clients.end(); it++) {
+        Client& c = it->second;
+        delete c.pRbEstimator;
+        c.pRbEstimator = new RbEstimator(_rbMaxRate, _rbNumRates);
+        c.rbPublishedRequests = 0;
+    }
+    // Release ownership of the mutex
+    pthread_mutex_unlock(&_schedulerMutex);
+}
+
+// Get the observed r-b curves of clients that have had new requests since their curve was last returned.
+void Scheduler::GetRbCurves(Json::Value& rbCurves)
+{
+    rbCurves = Json::arrayValue;
+    // Request ownership of the mutex
+    pthread_mutex_lock(&_schedulerMutex);
+    DrainQueues();
+    for (map<unsigned long, Client>::iterator it = _clients.begin(); it != _clients.end(); it++) {
+        Client& c = it->second;
+        if ((c.pRbEstimator == NULL) || c.flowName.empty() || (c.pRbEstimator->numRequests() == c.rbPublishedRequests)) {
+            continue;
+        }
+        vector<double> rates;
+        vector<double> bursts;
+        if (!c.pRbEstimator->getRbCurve(rates, bursts)) {
+            continue;
+        }
+        Json::Value rbCurve;
+        rbCurve["name"] = Json::Value(c.flowName);
+        rbCurve["rates"] = Json::arrayValue;
+        rbCurve["bursts"] = Json::arrayValue;
+        for (unsigned int i = 0; i < rates.size(); i++) {
+            rbCurve["rates"].append(Json::Value(rates[i]));
+            rbCurve["bursts"].append(Json::Value(bursts[i]));
+        }
+        rbCurves.append(rbCurve);
+        c.rbPublishedRequests = c.pRbEstimator->numRequests();
+    }
     // Release ownership of the mutex
     pthread_mutex_unlock(&_schedulerMutex);
 }
@@ -72,8 +149,9 @@ double Scheduler::GetOccupancy(unsigned long s_addr)
 {
     // Request ownership of the mutex
     pthread_mutex_lock(&_schedulerMutex);
+    DrainQueues();
     Client& c = GetClient(s_addr);
-    uint64_t now = GetTime();
+    uint64_t now = _getTime();
     uint64_t occupancyTime = c.occupancy;
     // Update occupancy for partial period
     if (!c.pendingJobs.empty()) {
@@ -88,27 +166,61 @@ double Scheduler::GetOccupancy(unsigned long s_addr)
     return occupancy;
 }
 
-// Return number of pending jobs for a client.
-int Scheduler::GetNumPendingJobs(unsigned long s_addr)
+// Get the telemetry of clients.
+void Scheduler::GetStats(const vector<unsigned long>& s_addrs, vector<ClientStatsSnapshot>& stats)
 {
     // Request ownership of the mutex
     pthread_mutex_lock(&_schedulerMutex);
-    Client& c = GetClient(s_addr);
-    int numPending = c.pendingJobs.size();
+    DrainQueues();
+    vector<Client*> clients;
+    if (s_addrs.empty()) {
+        for (map<unsigned long, Client>::iterator it = _clients.begin(); it != _clients.end(); it++) {
+            clients.push_back(&it->second);
+        }
+    } else {
+        for (vector<unsigned long>::const_iterator it = s_addrs.begin(); it != s_addrs.end(); it++) {
+            clients.push_back(&GetClient(*it));
+        }
+    }
+    stats.resize(clients.size());
+    for (unsigned int i = 0; i < clients.size(); i++) {
+        Client& c = *clients[i];
+        ClientStatsSnapshot& s = stats[i];
+        s.s_addr = c.s_addr;
+        c.pStats->queueTime.snapshot(s.queueTimeFirstBucket, s.queueTimeCounts);
+        c.pStats->serviceTime.snapshot(s.serviceTimeFirstBucket, s.serviceTimeCounts);
+        s.conformingJobs = c.pStats->conformingJobs;
+        s.nonconformingJobs = c.pStats->nonconformingJobs;
+        s.outstandingJobs = c.pStats->outstandingJobs;
+        s.pendingJobs = c.pendingJobs.size();
+        s.maxPendingJobs = c.pStats->maxPendingJobs;
+        // Restart max for the next call
+        c.pStats->maxPendingJobs = s.pendingJobs;
+    }
     // Release ownership of the mutex
     pthread_mutex_unlock(&_schedulerMutex);
-    return numPending;
+}
+
+// Return number of pending jobs for a client.
+int Scheduler::GetNumPendingJobs(unsigned long s_addr)
+{
+    PendingJobCounter* pCounter = GetPendingJobCounter(s_addr, false);
+    return (pCounter != NULL) ? pCounter->count : 0;
 }
 
 // Submit job to scheduler queue.
+// The job is added to the client's queue by the next thread to drain the submission queues (see DrainQueues).
 void Scheduler::SubmitJob(Job* pJob)
 {
-    // Request ownership of the mutex
-    pthread_mutex_lock(&_schedulerMutex);
-    // Add job
-    AddJob(pJob);
-    // Release ownership of the mutex
-    pthread_mutex_unlock(&_schedulerMutex);
+    // Set arrival time
+    pJob->arrivalTime = _getTime();
+    // Initialize job size
+    pJob->jobSize = EstimateJobSize(pJob);
+    // Initialize RPC client
+    pJob->cl = NULL;
+    __sync_fetch_and_add(&GetPendingJobCounter(pJob->Addr(), true)->count, 1);
+    _submittedJobs[pJob->Fd() % SCHEDULER_SUBMIT_QUEUES].push(pJob);
+    WakeWorker();
 }
 
 // Get the next job to send to storage.
@@ -116,21 +228,124 @@ Job* Scheduler::GetNextJob()
 {
     // Request ownership of the mutex
     pthread_mutex_lock(&_schedulerMutex);
+    DrainQueues();
     Job* pJob = ScheduleJob();
     while (pJob == NULL) {
-      pthread_cond_wait(&_availableJobsCV, &_schedulerMutex);
-      pJob = ScheduleJob();
+        // Count this worker as waiting before checking the queues again, so that a concurrent push is either seen here or signals
+        _wakeupPending = 0;
+        __sync_fetch_and_add(&_numWaitingWorkers, 1);
+        if (QueuesEmpty()) {
+            pthread_cond_wait(&_availableJobsCV, &_schedulerMutex);
+        }
+        __sync_fetch_and_sub(&_numWaitingWorkers, 1);
+        DrainQueues();
+        pJob = ScheduleJob();
+    }
+    // Pushes only signal one worker per batch, so pass the signal on if more jobs may be able to run
+    if ((_pendingJobCount > 0) && (_numWaitingWorkers > 0)) {
+        pthread_cond_signal(&_availableJobsCV);
     }
     // Release ownership of the mutex
     pthread_mutex_unlock(&_schedulerMutex);
     return pJob;
 }
 
-// Indicate job is completed.
-void Scheduler::CompleteJob(Job* pJob)
+// Get the next job to send to storage without waiting.
+Job* Scheduler::TryGetNextJob()
 {
     // Request ownership of the mutex
     pthread_mutex_lock(&_schedulerMutex);
+    DrainQueues();
+    Job* pJob = ScheduleJob();
+    // Pass the signal on if more jobs may be able to run, as in GetNextJob
+    if ((_pendingJobCount > 0) && (_numWaitingWorkers > 0)) {
+        pthread_cond_signal(&_availableJobsCV);
+    }
+    // Release ownership of the mutex
+    pthread_mutex_unlock(&_schedulerMutex);
+    return pJob;
+}
+
+// Indicate job is completed.
+// The job's outstanding counts are released by the next thread to drain the completion queue (see DrainQueues).
+void Scheduler::CompleteJob(Job* pJob, bool returnClient)
+{
+    pJob->pStats->serviceTime.record(_getTime() - pJob->scheduleTime);
+    __sync_fetch_and_sub(&pJob->pStats->outstandingJobs, 1);
+    if (!returnClient) {
+        pJob->cl = NULL;
+    }
+    _completedJobs.push(pJob);
+    WakeWorker();
+}
+
+// Wake a waiting worker after pushing to the submission or completion queues.
+// Only the first push since a worker last checked the queues signals; later pushes are drained by the signaled worker.
+void Scheduler::WakeWorker()
+{
+    // The push is a full barrier, so either a waiting worker is counted here or it sees the pushed job before waiting
+    if ((_numWaitingWorkers > 0) && __sync_bool_compare_and_swap(&_wakeupPending, 0, 1)) {
+        // Signal under the mutex so that the signal is not lost by a worker that is about to wait
+        pthread_mutex_lock(&_schedulerMutex);
+        pthread_cond_signal(&_availableJobsCV);
+        pthread_mutex_unlock(&_schedulerMutex);
+    }
+}
+
+// Returns whether the submission and completion queues are empty.
+bool Scheduler::QueuesEmpty()
+{
+    if (!_completedJobs.empty()) {
+        return false;
+    }
+    for (unsigned int i = 0; i < SCHEDULER_SUBMIT_QUEUES; i++) {
+        if (!_submittedJobs[i].empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool CompareArrivalTime(Job* pJob1, Job* pJob2)
+{
+    return pJob1->ArrivalTime() < pJob2->ArrivalTime();
+}
+
+// Apply completed jobs and add submitted jobs.
+// Assumes mutex held
+void Scheduler::DrainQueues()
+{
+    // Pushes after this point signal a waiting worker again
+    _wakeupPending = 0;
+    __sync_synchronize();
+    // Apply completions first so that the added jobs are scheduled against the current outstanding jobs
+    Job* pJob = _completedJobs.popAll();
+    while (pJob != NULL) {
+        Job* pNextJob = pJob->schedulerNext;
+        FinishJob(pJob);
+        pJob = pNextJob;
+    }
+    // Merge the submission queues by arrival time
+    _submittedBatch.clear();
+    for (unsigned int i = 0; i < SCHEDULER_SUBMIT_QUEUES; i++) {
+        for (pJob = _submittedJobs[i].popAll(); pJob != NULL; pJob = pJob->schedulerNext) {
+            _submittedBatch.push_back(pJob);
+        }
+    }
+    if (_submittedBatch.empty()) {
+        return;
+    }
+    stable_sort(_submittedBatch.begin(), _submittedBatch.end(), CompareArrivalTime);
+    uint64_t now = _getTime();
+    for (unsigned int i = 0; i < _submittedBatch.size(); i++) {
+        AddJob(_submittedBatch[i], now);
+    }
+}
+
+// Release the resources of a completed job.
+// Assumes mutex held
+void Scheduler::FinishJob(Job* pJob)
+{
     // Readjust maximum number of outstanding jobs for immediate jobs
     if (pJob->Immediate()) {
         _maxOutstandingJobs--;
@@ -148,26 +363,43 @@ void Scheduler::CompleteJob(Job* pJob)
     if (pJob->rateLimitObeyed) {
         RemoveOutstandingPriority(pJob);
     }
-    // Broadcast new jobs may be able to run
-    if (_pendingJobCount > 0) {
-        pthread_cond_broadcast(&_availableJobsCV);
+    // Return NFS RPC client
+    if (_useRPCClients && (pJob->RPCClient() != NULL)) {
+        _RPCAvailableClients.push_back(pJob->RPCClient());
     }
-    // Release ownership of the mutex
-    pthread_mutex_unlock(&_schedulerMutex);
+    delete pJob;
 }
 
-// Return NFS RPC client resources once a job completes.
-void Scheduler::ReturnClient(Job* pJob)
+// Get the pending job counter of a client, assigning one if create is set.
+// Counters are found by linear probing from a hash of the address; clients that do not fit share an overflow counter.
+PendingJobCounter* Scheduler::GetPendingJobCounter(unsigned long s_addr, bool create)
 {
-    // Request ownership of the mutex
-    pthread_mutex_lock(&_schedulerMutex);
-    _RPCAvailableClients.push_back(pJob->RPCClient());
-    // Release ownership of the mutex
-    pthread_mutex_unlock(&_schedulerMutex);
+    unsigned long key = s_addr + 1;
+    unsigned long hash = s_addr;
+    hash = ((hash >> 16) ^ hash) * 0x45d9f3b;
+    hash = ((hash >> 16) ^ hash) * 0x45d9f3b;
+    hash = (hash >> 16) ^ hash;
+    for (unsigned int i = 0; i < SCHEDULER_PENDING_COUNTERS; i++) {
+        PendingJobCounter& counter = _pendingJobCounters[(hash + i) & (SCHEDULER_PENDING_COUNTERS - 1)];
+        unsigned long counterKey = counter.key;
+        if (counterKey == 0) {
+            if (!create) {
+                return NULL;
+            }
+            counterKey = __sync_val_compare_and_swap(&counter.key, 0, key);
+            if (counterKey == 0) {
+                return &counter;
+            }
+        }
+        if (counterKey == key) {
+            return &counter;
+        }
+    }
+    return &_overflowPendingJobCounter;
 }
 
 // Returns job size estimate.
-double Scheduler::EstimateJobSize(Client& c, Job* pJob)
+double Scheduler::EstimateJobSize(Job* pJob)
 {
     // Non-read/write requests are treated as free for now
     if (!pJob->IsReadRequest() && !pJob->IsWriteRequest()) {
@@ -176,63 +408,6 @@ double Scheduler::EstimateJobSize(Client& c, Job* pJob)
     return _pEst->estimateWork(pJob->RequestSize(), pJob->IsReadRequest());
 }
 
-// Compares two clients to see which should be scheduled.
-// Assumes mutex held
-// Assumes UpdateTokens has been called to update rateLimitObeyed flags
-#define PREFER_1 1
-#define PREFER_EQUAL 0
-#define PREFER_2 -1
-int Scheduler::CompareClient(const Client& c1, const Client& c2)
-{
-    // Check for pending job
-    if (c1.pendingJobs.empty()) {
-        if (c2.pendingJobs.empty()) {
-            return PREFER_EQUAL;
-        } else {
-            return PREFER_2;
-        }
-    } else if (c2.pendingJobs.empty()) {
-        return PREFER_1;
-    }
-
-    // Check immediate flag
-    Job* pJob1 = c1.pendingJobs.front();
-    Job* pJob2 = c2.pendingJobs.front();
-    if (pJob1->Immediate()) {
-        if (!pJob2->Immediate()) {
-            return PREFER_1;
-        }
-    } else if (pJob2->Immediate()) {
-        return PREFER_2;
-    }
-
-    // Check if within rate limit
-    if (c1.rateLimitObeyed) {
-        if (c2.rateLimitObeyed) {
-            // Check priority
-            // Priority only applies when both clients are within rate limits
-            if (c1.priority < c2.priority) {
-                return PREFER_1;
-            } else if (c1.priority > c2.priority) {
-                return PREFER_2;
-            }
-        } else {
-            return PREFER_1;
-        }
-    } else if (c2.rateLimitObeyed) {
-        return PREFER_2;
-    }
-
-    // When rate limits/priority have not determined which client is better,
-    // then switch to using FCFS
-    if (pJob1->ArrivalTime() < pJob2->ArrivalTime()) {
-        return PREFER_1;
-    } else if (pJob1->ArrivalTime() > pJob2->ArrivalTime()) {
-        return PREFER_2;
-    }
-    return PREFER_EQUAL;
-}
-
 // Update token buckets in order to check rate limits
 // Assumes mutex held
 void Scheduler::UpdateTokens(Client& c, uint64_t now)
@@ -271,25 +446,31 @@ void Scheduler::UpdateTokens(Client& c, uint64_t now)
 
 // Add a job to the scheduler queue.
 // Assumes mutex held
-void Scheduler::AddJob(Job* pJob)
+void Scheduler::AddJob(Job* pJob, uint64_t now)
 {
-    uint64_t now = GetTime();
     Client& c = GetClient(pJob->Addr());
-    // Set arrival time
-    pJob->arrivalTime = now;
-    // Initialize job size
-    pJob->jobSize = EstimateJobSize(c, pJob);
-    // Initialize RPC client
-    pJob->cl = NULL;
+    // Jobs submitted concurrently may be added out of order
+    if (pJob->arrivalTime < c.lastArrivalTime) {
+        pJob->arrivalTime = c.lastArrivalTime;
+    }
+    c.lastArrivalTime = pJob->arrivalTime;
+    // Observe read/write requests for the client's r-b curve
+    if ((c.pRbEstimator != NULL) && (pJob->IsReadRequest() || pJob->IsWriteRequest())) {
+        c.pRbEstimator->addRequest(pJob->ArrivalTime(), pJob->JobSize());
+    }
     // Update occupancy time
     if (c.pendingJobs.empty()) {
-        c.lastOccupancyTime = now;
-        // Signal new job might be available
-        pthread_cond_signal(&_availableJobsCV);
+        c.lastOccupancyTime = pJob->ArrivalTime();
     }
     // Add job to queue
     c.pendingJobs.push_back(pJob);
     _pendingJobCount++;
+    if ((int)c.pendingJobs.size() > c.pStats->maxPendingJobs) {
+        c.pStats->maxPendingJobs = c.pendingJobs.size();
+    }
+    if (c.pendingJobs.size() == 1) {
+        InsertReadyClient(c, now);
+    }
 }
 
 // Remove a job from the scheduler queue to submit it to storage.
@@ -298,10 +479,12 @@ Job* Scheduler::RemoveJob(Client& c)
 {
     // Remove job from queue
     assert(!c.pendingJobs.empty());
+    RemoveReadyClient(c);
     Job* pJob = c.pendingJobs.front();
     c.pendingJobs.pop_front();
     _pendingJobCount--;
-    uint64_t now = GetTime();
+    __sync_fetch_and_sub(&c.pPendingJobs->count, 1);
+    uint64_t now = _getTime();
     // Update occupancy
     if (c.pendingJobs.empty()) {
         c.occupancy += now - c.lastOccupancyTime;
@@ -309,6 +492,18 @@ Job* Scheduler::RemoveJob(Client& c)
     // Update estimator history
     assert(pJob->jobSize >= 0);
     pJob->rateLimitObeyed = c.rateLimitObeyed;
+    // Update telemetry
+    pJob->pStats = c.pStats;
+    pJob->scheduleTime = now;
+    c.pStats->queueTime.record(now - pJob->ArrivalTime());
+    if (pJob->IsReadRequest() || pJob->IsWriteRequest()) {
+        if (pJob->rateLimitObeyed) {
+            c.pStats->conformingJobs++;
+        } else {
+            c.pStats->nonconformingJobs++;
+        }
+    }
+    __sync_fetch_and_add(&c.pStats->outstandingJobs, 1);
     // Decrement token buckets by usage
     for (int i = 0; i < c.rateLimitLength; i++) {
         c.rateLimitTokens[i] -= pJob->JobSize();
@@ -317,27 +512,128 @@ Job* Scheduler::RemoveJob(Client& c)
             c.rateLimitTokens[i] = 0;
         }
     }
-    // Clear rate limit flag (will be rechecked next UpdateTokens)
+    // Clear rate limit flag and recheck it for the next job
     c.rateLimitObeyed = false;
+    if (!c.pendingJobs.empty()) {
+        InsertReadyClient(c, now);
+    }
     return pJob;
 }
 
+// Add a backlogged client to the ready queues based on its head job.
+// A client within its rate limits stays so until its head job is removed, since its tokens only grow until then.
+// Assumes mutex held
+void Scheduler::InsertReadyClient(Client& c, uint64_t now)
+{
+    assert(!c.pendingJobs.empty());
+    UpdateTokens(c, now);
+    Job* pJob = c.pendingJobs.front();
+    ReadyQueues& readyQueues = _readyQueues[pJob->Immediate() ? 0 : 1];
+    pair<uint64_t, unsigned long> key(pJob->ArrivalTime(), c.s_addr);
+    if (c.rateLimitObeyed) {
+        readyQueues.withinLimit[c.priority][key] = &c;
+    } else {
+        readyQueues.overLimit[key] = &c;
+        uint64_t eligibleTime = RateLimitEligibleTime(c);
+        if (eligibleTime != numeric_limits<uint64_t>::max()) {
+            _rateLimitTimers.schedule(c.rateLimitTimer, eligibleTime);
+        }
+    }
+}
+
+// Remove a backlogged client from the ready queues.
+// Assumes mutex held
+// Assumes the client's head job, priority, and rateLimitObeyed flag are unchanged since it was added
+void Scheduler::RemoveReadyClient(Client& c)
+{
+    assert(!c.pendingJobs.empty());
+    Job* pJob = c.pendingJobs.front();
+    ReadyQueues& readyQueues = _readyQueues[pJob->Immediate() ? 0 : 1];
+    pair<uint64_t, unsigned long> key(pJob->ArrivalTime(), c.s_addr);
+    if (c.rateLimitObeyed) {
+        map<unsigned int, ReadyClients>::iterator it = readyQueues.withinLimit.find(c.priority);
+        assert(it != readyQueues.withinLimit.end());
+        it->second.erase(key);
+        if (it->second.empty()) {
+            readyQueues.withinLimit.erase(it);
+        }
+    } else {
+        readyQueues.overLimit.erase(key);
+        _rateLimitTimers.cancel(c.rateLimitTimer);
+    }
+}
+
+// Move clients whose rate limit timers have expired by now into the within rate limit ready queues.
+// Assumes mutex held
+void Scheduler::PromoteReadyClients(uint64_t now)
+{
+    _expiredRateLimitTimers.clear();
+    _rateLimitTimers.expire(now, _expiredRateLimitTimers);
+    for (unsigned int i = 0; i < _expiredRateLimitTimers.size(); i++) {
+        Client& c = *static_cast<Client*>(_expiredRateLimitTimers[i]->data);
+        RemoveReadyClient(c);
+        InsertReadyClient(c, now);
+        // Rounding may leave the token buckets just short of the head job; check again later
+        if (!c.rateLimitObeyed && c.rateLimitTimer.scheduled() && (c.rateLimitTimer.time <= now)) {
+            _rateLimitTimers.schedule(c.rateLimitTimer, now + 1);
+        }
+    }
+}
+
+// Time at which an over rate limit client's token buckets can cover its head job.
+// Returns the maximum time if a token bucket with no rate can not cover it.
+// Assumes mutex held
+// Assumes UpdateTokens has been called, so that tokens accrue from rateLimitUpdateTime without burst limits
+uint64_t Scheduler::RateLimitEligibleTime(const Client& c)
+{
+    double jobSize = c.pendingJobs.front()->JobSize();
+    double waitTime = 0;
+    for (int i = 0; i < c.rateLimitLength; i++) {
+        double neededTokens = jobSize - c.rateLimitTokens[i];
+        if (neededTokens > 0) {
+            if (c.rateLimitRates[i] <= 0) {
+                return numeric_limits<uint64_t>::max();
+            }
+            waitTime = max(waitTime, neededTokens / c.rateLimitRates[i]);
+        }
+    }
+    // Avoid overflowing for practically unreachable times
+    if (waitTime >= ConvertTimeToSeconds(numeric_limits<uint64_t>::max() - c.rateLimitUpdateTime)) {
+        return numeric_limits<uint64_t>::max();
+    }
+    // Round up to the first nanosecond with enough tokens
+    uint64_t waitNs = ConvertSecondsToTime(waitTime);
+    if (ConvertTimeToSeconds(waitNs) < waitTime) {
+        waitNs++;
+    }
+    return c.rateLimitUpdateTime + waitNs;
+}
+
 // Find the best client to schedule next.
+// Clients with an immediate head job are preferred, then clients within their rate limits by priority, then clients over their rate limits,
+// with ties broken by the arrival time of their head job (FCFS) and then by address.
 // Assumes mutex held
+// Assumes there is a pending job
 Client& Scheduler::FindBestClient()
 {
-    uint64_t now = GetTime();
-    // Loop through clients and find the best client
-    map<unsigned long, Client>::iterator bestClientIt = _clients.begin();
-    for (map<unsigned long, Client>::iterator it = _clients.begin(); it != _clients.end(); ++it) {
-        // Update token buckets
-        UpdateTokens(it->second, now);
-        // Compare against best client
-        if (CompareClient(it->second, bestClientIt->second) > 0) {
-            bestClientIt = it;
+    uint64_t now = _getTime();
+    PromoteReadyClients(now);
+    for (int i = 0; i < 2; i++) {
+        ReadyQueues& readyQueues = _readyQueues[i];
+        if (!readyQueues.withinLimit.empty()) {
+            return *readyQueues.withinLimit.begin()->second.begin()->second;
+        }
+        if (!readyQueues.overLimit.empty()) {
+            Client& c = *readyQueues.overLimit.begin()->second;
+            // Bring the token buckets up to date before they are charged for the client's head job
+            // If they now cover the head job, the client is the only one within its rate limits in this ready queue
+            RemoveReadyClient(c);
+            InsertReadyClient(c, now);
+            return c;
         }
     }
-    return bestClientIt->second;
+    assert(false);
+    return *_readyQueues[1].overLimit.begin()->second;
 }
 
 // Try to schedule next job.
@@ -347,7 +643,7 @@ Job* Scheduler::ScheduleJob()
     // Check if there are pending jobs
     if (_pendingJobCount > 0) {
         // Check if we are out of clients
-        if (_RPCAvailableClients.empty()) {
+        if (_useRPCClients && _RPCAvailableClients.empty()) {
             return NULL;
         }
         Client& c = FindBestClient();
@@ -371,13 +667,10 @@ Job* Scheduler::ScheduleJob()
                 // Ensure that higher priority jobs are not being starved by low priority jobs
                 uint64_t oldestHigherPrioritySeqNumRead = _seqNumRead;
                 uint64_t oldestHigherPrioritySeqNumReadBytes = _seqNumReadBytes;
-                // Assumes list is sorted by oldest request
-                for (list<Job*>::iterator it = _outstandingPriorityList.begin(); it != _outstandingPriorityList.end(); it++) {
-                    if ((*it)->priority < c.priority) {
-                        oldestHigherPrioritySeqNumRead = (*it)->seqNumRead;
-                        oldestHigherPrioritySeqNumReadBytes = (*it)->seqNumReadBytes;
-                        break;
-                    }
+                Job* pOldestHigherPriorityJob = OldestHigherPriorityJob(c.priority);
+                if (pOldestHigherPriorityJob != NULL) {
+                    oldestHigherPrioritySeqNumRead = pOldestHigherPriorityJob->seqNumRead;
+                    oldestHigherPrioritySeqNumReadBytes = pOldestHigherPriorityJob->seqNumReadBytes;
                 }
                 if (_seqNumRead > (oldestHigherPrioritySeqNumRead + _maxOutstandingReadJobs)) {
                     return NULL;
@@ -394,13 +687,10 @@ Job* Scheduler::ScheduleJob()
                 // Ensure that higher priority jobs are not being starved by low priority jobs
                 uint64_t oldestHigherPrioritySeqNumWrite = _seqNumWrite;
                 uint64_t oldestHigherPrioritySeqNumWriteBytes = _seqNumWriteBytes;
-                // Assumes list is sorted by oldest request
-                for (list<Job*>::iterator it = _outstandingPriorityList.begin(); it != _outstandingPriorityList.end(); it++) {
-                    if ((*it)->priority < c.priority) {
-                        oldestHigherPrioritySeqNumWrite = (*it)->seqNumWrite;
-                        oldestHigherPrioritySeqNumWriteBytes = (*it)->seqNumWriteBytes;
-                        break;
-                    }
+                Job* pOldestHigherPriorityJob = OldestHigherPriorityJob(c.priority);
+                if (pOldestHigherPriorityJob != NULL) {
+                    oldestHigherPrioritySeqNumWrite = pOldestHigherPriorityJob->seqNumWrite;
+                    oldestHigherPrioritySeqNumWriteBytes = pOldestHigherPriorityJob->seqNumWriteBytes;
                 }
                 if (_seqNumWrite > (oldestHigherPrioritySeqNumWrite + _maxOutstandingWriteJobs)) {
                     return NULL;
@@ -424,11 +714,13 @@ Job* Scheduler::ScheduleJob()
             _seqNumWriteBytes += pJob->RequestSize();
         }
         if (pJob->rateLimitObeyed) {
-            _outstandingPriorityList.push_back(pJob);
+            AddOutstandingPriority(pJob);
         }
         // Release job for execution
-        pJob->cl = _RPCAvailableClients.back();
-        _RPCAvailableClients.pop_back();
+        if (_useRPCClients) {
+            pJob->cl = _RPCAvailableClients.back();
+            _RPCAvailableClients.pop_back();
+        }
         _outstandingJobs++;
         if (pJob->IsReadRequest()) {
             _outstandingReadJobs++;
@@ -437,20 +729,64 @@ Job* Scheduler::ScheduleJob()
             _outstandingWriteJobs++;
             _outstandingWriteBytes += pJob->RequestSize();
         }
-	return pJob;
+        return pJob;
     }
     return NULL;
 }
 
-// Remove job from outstanding priority list.
+// Add job to the outstanding priority queue for its priority.
+// Assumes mutex held
+void Scheduler::AddOutstandingPriority(Job* pJob)
+{
+    // New queues are value-initialized to empty
+    OutstandingPriorityQueue& queue = _outstandingPriorityQueues[pJob->priority];
+    pJob->outstandingSeqNum = _outstandingSeqNum++;
+    pJob->outstandingPrev = queue.tail;
+    pJob->outstandingNext = NULL;
+    if (queue.tail != NULL) {
+        queue.tail->outstandingNext = pJob;
+    } else {
+        queue.head = pJob;
+    }
+    queue.tail = pJob;
+}
+
+// Remove job from outstanding priority queue.
+// Assumes mutex held
 void Scheduler::RemoveOutstandingPriority(Job* pJob)
 {
-    for (list<Job*>::iterator it = _outstandingPriorityList.begin(); it != _outstandingPriorityList.end(); it++) {
-        if (*it == pJob) {
-            _outstandingPriorityList.erase(it);
-            break;
+    map<unsigned int, OutstandingPriorityQueue>::iterator it = _outstandingPriorityQueues.find(pJob->priority);
+    assert(it != _outstandingPriorityQueues.end());
+    OutstandingPriorityQueue& queue = it->second;
+    if (pJob->outstandingPrev != NULL) {
+        pJob->outstandingPrev->outstandingNext = pJob->outstandingNext;
+    } else {
+        queue.head = pJob->outstandingNext;
+    }
+    if (pJob->outstandingNext != NULL) {
+        pJob->outstandingNext->outstandingPrev = pJob->outstandingPrev;
+    } else {
+        queue.tail = pJob->outstandingPrev;
+    }
+    if (queue.head == NULL) {
+        _outstandingPriorityQueues.erase(it);
+    }
+}
+
+// Returns the oldest outstanding job with a higher priority than priority, or NULL if none.
+// Only the head of each higher priority's queue is considered, so this is linear in the number of priorities rather than outstanding jobs.
+// Assumes mutex held
+Job* Scheduler::OldestHigherPriorityJob(unsigned int priority)
+{
+    Job* pOldestJob = NULL;
+    for (map<unsigned int, OutstandingPriorityQueue>::iterator it = _outstandingPriorityQueues.begin();
+         (it != _outstandingPriorityQueues.end()) && (it->first < priority); it++) {
+        Job* pJob = it->second.head;
+        if ((pOldestJob == NULL) || (pJob->outstandingSeqNum < pOldestJob->outstandingSeqNum)) {
+            pOldestJob = pJob;
         }
     }
+    return pOldestJob;
 }
 
 // Keep NFS RPC clients alive via periodic NULL requests.
@@ -486,8 +822,12 @@ void* KeepAliveThread(void* ptr)
     return NULL;
 }
 
-Scheduler::Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs, Estimator* pEst)
-    : _RPCAvailableClients(RPCClients),
+Scheduler::Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs, Estimator* pEst, uint64_t (*getTime)())
+    : _numWaitingWorkers(0),
+      _wakeupPending(0),
+      _useRPCClients(!RPCClients.empty()),
+      _RPCAvailableClients(RPCClients),
+      _outstandingSeqNum(0),
       _seqNumRead(0),
       _seqNumWrite(0),
       _seqNumReadBytes(0),
@@ -504,11 +844,23 @@ Scheduler::Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, in
       _maxOutstandingWriteJobs(maxWriteJobs),
       _pendingJobCount(0),
       _pEst(pEst),
-      _keepAlive(true)
+      _keepAlive(true),
+      _rbMaxRate(0),
+      _rbNumRates(0),
+      _getTime(getTime)
 {
+    for (unsigned int i = 0; i < SCHEDULER_PENDING_COUNTERS; i++) {
+        _pendingJobCounters[i].key = 0;
+        _pendingJobCounters[i].count = 0;
+    }
+    _overflowPendingJobCounter.key = 0;
+    _overflowPendingJobCounter.count = 0;
     pthread_mutex_init(&_schedulerMutex, NULL);
     pthread_cond_init(&_availableJobsCV, NULL);
-    // Create keepalive thread
+    // Create keepalive thread, unless there are no RPC clients to keep alive
+    if (!_useRPCClients) {
+        return;
+    }
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
@@ -524,11 +876,21 @@ Scheduler::Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, in
 
 Scheduler::~Scheduler()
 {
-    _keepAlive = false;
-    int rc = pthread_join(_keepAliveThread, NULL);
-    if (rc) {
-        cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
-        exit(-1);
+    if (_useRPCClients) {
+        _keepAlive = false;
+        int rc = pthread_join(_keepAliveThread, NULL);
+        if (rc) {
+            cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+    for (map<unsigned long, Client>::iterator it = _clients.begin(); it != _clients.end(); it++) {
+        Client& c = it->second;
+        delete[] c.rateLimitRates;
+        delete[] c.rateLimitBursts;
+        delete[] c.rateLimitTokens;
+        delete c.pRbEstimator;
+        delete c.pStats;
     }
     pthread_cond_destroy(&_availableJobsCV);
     pthread_mutex_destroy(&_schedulerMutex);
@@ -9,17 +9,76 @@
 
 #include <list>
 #include <map>
+#include <string>
 #include <vector>
 #include <stdint.h>
 #include <rpc/rpc.h>
 #include <json/json.h>
+#include "../common/MPSCQueue.hpp"
+#include "../common/ObjectPool.hpp"
+#include "../common/LatencyHistogram.hpp"
+#include "../common/TimerWheel.hpp"
+#include "../common/time.hpp"
 #include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/RbEstimator.hpp"
 #include "../prot/nfs3_prot.h"
 
 using namespace std;
 
+class Job;
+
+// Telemetry of a workload (a.k.a. client), which is freed with the Scheduler rather than the client's jobs so that jobs can update it after being scheduled.
+typedef struct {
+    LatencyHistogram queueTime; // time in nanoseconds from a job's arrival to being scheduled
+    LatencyHistogram serviceTime; // time in nanoseconds from a job being scheduled to being completed; recorded without the mutex
+    uint64_t conformingJobs; // read/write jobs scheduled within the client's rate limits
+    uint64_t nonconformingJobs; // read/write jobs scheduled over the client's rate limits (i.e., with spare capacity)
+    volatile int outstandingJobs; // jobs scheduled but not completed; updated atomically
+    int maxPendingJobs; // max number of pending jobs since the last Scheduler::GetStats
+} ClientStats;
+
+// Copy of a client's telemetry returned by Scheduler::GetStats; histograms are as copied by LatencyHistogram::snapshot.
+typedef struct {
+    unsigned long s_addr;
+    unsigned int queueTimeFirstBucket;
+    vector<uint64_t> queueTimeCounts;
+    unsigned int serviceTimeFirstBucket;
+    vector<uint64_t> serviceTimeCounts;
+    uint64_t conformingJobs;
+    uint64_t nonconformingJobs;
+    int outstandingJobs;
+    int pendingJobs;
+    int maxPendingJobs;
+} ClientStatsSnapshot;
+
+// Fields of a NFS request used for scheduling, kept together at the start of the job so that scheduling touches few cache lines.
+class JobHeader
+{
+public:
+    rpcproc_t rq_proc;
+    int fd;
+    unsigned long s_addr;
+    bool immediate;
+    bool rateLimitObeyed;
+    int requestSize;
+    unsigned int priority;
+    // Scheduler parameters
+    uint64_t arrivalTime;
+    double jobSize;
+    uint64_t seqNumRead;
+    uint64_t seqNumWrite;
+    uint64_t seqNumReadBytes;
+    uint64_t seqNumWriteBytes;
+    // Links in the scheduler's outstanding priority queue for the job's priority
+    uint64_t outstandingSeqNum;
+    Job* outstandingPrev;
+    Job* outstandingNext;
+    CLIENT* cl;
+} __attribute__((aligned(OBJECT_POOL_CACHE_LINE_SIZE)));
+
 // Represents a NFS request.
-class Job
+// Jobs are allocated from per-thread pools; fields are not initialized.
+class Job : public JobHeader
 {
 public:
     // NFS parameters
@@ -71,26 +130,23 @@ public:
     } result;
     xdrproc_t xdr_argument;
     xdrproc_t xdr_result;
-    rpcproc_t rq_proc;
     SVCXPRT* xprt;
-    int fd;
     u_long xid;
-    unsigned long s_addr;
-    bool immediate;
     // Read/write specific info
-    int requestSize;
     uint64_t offset;
     nfs_fh3 file;
-    // Scheduler parameters
-    uint64_t arrivalTime;
-    double jobSize;
-    bool rateLimitObeyed;
-    unsigned int priority;
-    uint64_t seqNumRead;
-    uint64_t seqNumWrite;
-    uint64_t seqNumReadBytes;
-    uint64_t seqNumWriteBytes;
-    CLIENT* cl;
+    // Encoded result of a read forwarded by Forwarder, which is replied without decoding it; rawResultBuffer is malloc'ed
+    char* rawResultBuffer;
+    char* rawResult;
+    size_t rawResultSize;
+    // Link in the scheduler's submission or completion queue
+    Job* schedulerNext;
+    // Telemetry of the job's client and when the job was scheduled, for recording its service time on completion
+    ClientStats* pStats;
+    uint64_t scheduleTime;
+
+    static void* operator new(size_t size) { return ObjectPool<Job>::allocate(); }
+    static void operator delete(void* ptr) { ObjectPool<Job>::deallocate(ptr); }
 
     inline rpcproc_t Proc() { return rq_proc; }
     inline caddr_t Argument() { return (caddr_t)&argument; }
@@ -112,6 +168,27 @@ public:
     inline CLIENT* RPCClient() { return cl; }
 };
 
+// Outstanding jobs of one priority that obey rate limits, from oldest to newest.
+// Jobs are linked through their outstandingPrev/outstandingNext fields.
+typedef struct {
+    Job* head;
+    Job* tail;
+} OutstandingPriorityQueue;
+
+// Number of submission queues, which are selected by connection so that receive threads rarely contend
+#define SCHEDULER_SUBMIT_QUEUES 16
+// Number of per-client pending job counters; a power of two
+#define SCHEDULER_PENDING_COUNTERS 4096
+
+typedef MPSCQueue<Job, &Job::schedulerNext> JobQueue;
+
+// Number of pending jobs of a client, updated atomically so that it can be read without the scheduler mutex.
+// Counters are assigned to clients once with a compare-and-swap on the key and are never freed.
+typedef struct {
+    volatile unsigned long key; // client address + 1, or 0 if unassigned
+    volatile int count; // jobs submitted by the client that have not been scheduled
+} PendingJobCounter;
+
 // A workload's (a.k.a. client) parameters.
 typedef struct {
     list<Job*> pendingJobs;
@@ -125,8 +202,25 @@ typedef struct {
     uint64_t occupancy;
     uint64_t lastOccupancyTime;
     uint64_t getOccupancyTime;
+    uint64_t lastArrivalTime; // arrival time of the last job added, so arrival times of the client's jobs never decrease
+    PendingJobCounter* pPendingJobs;
+    string flowName; // name of the workload's flow in AdmissionController; empty if unknown
+    RbEstimator* pRbEstimator; // observed r-b curve of the workload's read/write requests; NULL if r-b estimation is disabled
+    uint64_t rbPublishedRequests; // number of requests observed when the r-b curve was last returned by GetRbCurves
+    unsigned long s_addr; // key of the client in Scheduler::_clients
+    TimerWheelEntry rateLimitTimer; // while over its rate limits with pending jobs, expires when its token buckets can cover its head job
+    ClientStats* pStats;
 } Client;
 
+// Backlogged clients ordered by the arrival time of their head job, then by address (i.e., the order in which Scheduler::_clients is scanned).
+typedef map<pair<uint64_t, unsigned long>, Client*> ReadyClients;
+
+// Backlogged clients grouped by how they are prioritized (see Scheduler::FindBestClient).
+typedef struct {
+    map<unsigned int, ReadyClients> withinLimit; // clients within their rate limits by priority
+    ReadyClients overLimit; // clients not within their rate limits, for which priority does not apply
+} ReadyQueues;
+
 // Scheduler for NFS requests that queues each workload separately and prioritizes and rate limits workloads.
 class Scheduler
 {
@@ -135,10 +229,23 @@ private:
     pthread_mutex_t _schedulerMutex;
     // Available jobs condition variable
     pthread_cond_t _availableJobsCV;
-    // RPC client pool
+    // Jobs submitted and completed without the mutex, which are added/applied in batches when the mutex is next held
+    JobQueue _submittedJobs[SCHEDULER_SUBMIT_QUEUES];
+    JobQueue _completedJobs;
+    vector<Job*> _submittedBatch;
+    // Number of workers waiting on _availableJobsCV, and whether a push since the queues were last checked has signaled one
+    volatile int _numWaitingWorkers;
+    volatile int _wakeupPending;
+    // Pending job counters by client address
+    PendingJobCounter _pendingJobCounters[SCHEDULER_PENDING_COUNTERS];
+    // Shared by clients that do not fit in _pendingJobCounters
+    PendingJobCounter _overflowPendingJobCounter;
+    // RPC client pool; jobs are not assigned RPC clients if the pool is created empty
+    bool _useRPCClients;
     vector<CLIENT*> _RPCAvailableClients;
     // Track outstanding jobs
-    list<Job*> _outstandingPriorityList;
+    map<unsigned int, OutstandingPriorityQueue> _outstandingPriorityQueues;
+    uint64_t _outstandingSeqNum;
     uint64_t _seqNumRead;
     uint64_t _seqNumWrite;
     uint64_t _seqNumReadBytes;
@@ -157,49 +264,96 @@ private:
     int _pendingJobCount;
     // Array of clients
     map<unsigned long, Client> _clients;
+    // Backlogged clients whose head job is immediate ([0]) or not ([1]), so the best client is found without scanning all clients
+    ReadyQueues _readyQueues[2];
+    // Timers of backlogged clients over their rate limits
+    TimerWheel _rateLimitTimers;
+    vector<TimerWheelEntry*> _expiredRateLimitTimers;
     // Storage estimator
     Estimator* _pEst;
     // Keep Alive
     pthread_t _keepAliveThread;
     bool _keepAlive;
+    // r-b estimation parameters (see EnableRbEstimation)
+    double _rbMaxRate;
+    unsigned int _rbNumRates;
+    // Clock in nanoseconds (see Scheduler)
+    uint64_t (*_getTime)();
 
     // Returns job size estimate.
-    double EstimateJobSize(Client& c, Job* job);
-    // Compares two clients to see which should be scheduled.
-    // Assumes UpdateTokens has been called to update rateLimitObeyed flags.
-    int CompareClient(const Client& c1, const Client& c2);
+    double EstimateJobSize(Job* job);
+    // Get the pending job counter of a client, assigning one if create is set. Returns NULL if the client has none and create is not set.
+    PendingJobCounter* GetPendingJobCounter(unsigned long s_addr, bool create);
     // Get a client, possibly creating a new client.
     Client& GetClient(unsigned long s_addr);
     // Update token buckets in order to check rate limits.
     void UpdateTokens(Client& c, uint64_t now);
     // Add a job to the scheduler queue.
-    void AddJob(Job* pJob);
+    void AddJob(Job* pJob, uint64_t now);
     // Remove a job from the scheduler queue to submit it to storage.
     Job* RemoveJob(Client& c);
+    // Add a backlogged client to the ready queues based on its head job, updating its token buckets to check its rate limits.
+    void InsertReadyClient(Client& c, uint64_t now);
+    // Remove a backlogged client from the ready queues.
+    void RemoveReadyClient(Client& c);
+    // Move clients whose rate limit timers have expired by now into the within rate limit ready queues.
+    void PromoteReadyClients(uint64_t now);
+    // Time at which an over rate limit client's token buckets can cover its head job.
+    uint64_t RateLimitEligibleTime(const Client& c);
     // Find the best client to schedule next.
     Client& FindBestClient();
     // Try to schedule next job.
     Job* ScheduleJob();
-    // Remove job from outstanding priority list.
+    // Wake a waiting worker after pushing to the submission or completion queues.
+    void WakeWorker();
+    // Returns whether the submission and completion queues are empty.
+    bool QueuesEmpty();
+    // Apply completed jobs and add submitted jobs.
+    void DrainQueues();
+    // Release the resources of a completed job.
+    void FinishJob(Job* pJob);
+    // Add job to the outstanding priority queue for its priority.
+    void AddOutstandingPriority(Job* pJob);
+    // Remove job from outstanding priority queue.
     void RemoveOutstandingPriority(Job* pJob);
+    // Returns the oldest outstanding job with a higher priority than priority, or NULL if none.
+    Job* OldestHigherPriorityJob(unsigned int priority);
 
 public:
-    Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs, Estimator* pEst);
+    // If RPCClients is empty, jobs are not assigned RPC clients (e.g., for asynchronous forwarding; see Forwarder, or workers with their
+    // own RPC clients), so the number of outstanding jobs is only limited by maxReadJobs/maxWriteJobs and the outstanding immediate jobs.
+    // Clients that workers set on jobs are then not returned to a pool.
+    // getTime is the clock used for arrival times, rate limits, and telemetry; it can be replaced to replay a schedule deterministically (e.g., in tests).
+    Scheduler(vector<CLIENT*> RPCClients, int maxOutstandingReadBytes, int maxOutstandingWriteBytes, int maxReadJobs, int maxWriteJobs, Estimator* pEst,
+              uint64_t (*getTime)() = GetTime);
     ~Scheduler();
     // Update client parameters.
-    void UpdateClient(unsigned long s_addr, unsigned int priority, int rateLimitLength, double* rateLimitRates, double* rateLimitBursts);
+    // The client's observed r-b curve is restarted if its flowName changes.
+    void UpdateClient(unsigned long s_addr, unsigned int priority, int rateLimitLength, double* rateLimitRates, double* rateLimitBursts, string flowName);
+    // Observe the r-b curve of each client's read/write requests with numRates rates up to maxRate (in work per second).
+    // Requests observed before r-b estimation is enabled are not included.
+    void EnableRbEstimation(double maxRate, unsigned int numRates);
+    // Get the observed r-b curves of clients with a flowName that have had new requests since their curve was last returned.
+    // Returns a list of {"name": flowName, "rates": list of decreasing rates, "bursts": list of bursts} (see AdmissionController's UpdateArrivalCurves RPC).
+    void GetRbCurves(Json::Value& rbCurves);
     // Return queue occupancy for a client since last call for the client.
     double GetOccupancy(unsigned long s_addr);
-    // Return number of pending jobs for a client.
+    // Get the telemetry of the clients with the given addresses, or of all clients if s_addrs is empty.
+    // Histograms and job counts are cumulative; maxPendingJobs is since the last call.
+    void GetStats(const vector<unsigned long>& s_addrs, vector<ClientStatsSnapshot>& stats);
+    // Return number of pending jobs for a client, including submitted jobs that have not been added yet.
+    // Does not take the scheduler mutex.
     int GetNumPendingJobs(unsigned long s_addr);
     // Submit job to scheduler queue.
+    // Does not take the scheduler mutex unless a worker is waiting for jobs.
     void SubmitJob(Job* pJob);
     // Get the next job to send to storage.
     Job* GetNextJob();
-    // Indicate job is completed.
-    void CompleteJob(Job* pJob);
-    // Return NFS RPC client resources once a job completes.
-    void ReturnClient(Job* pJob);
+    // Get the next job to send to storage, or NULL if no job can be scheduled now.
+    Job* TryGetNextJob();
+    // Indicate job is completed, returning its NFS RPC client to the pool if returnClient is set.
+    // The scheduler takes ownership of the job. Does not take the scheduler mutex unless a worker is waiting for jobs.
+    void CompleteJob(Job* pJob, bool returnClient);
     // Keep NFS RPC clients alive via periodic NULL requests.
     bool KeepAlive();
 };
@@ -35,6 +35,9 @@
 //
 // Lastly, as clients are added, src/dst filters are setup to send packets to the corresponding queue for its priority level.
 //
+// TC is configured with rtnetlink requests (see netlink.hpp), which are batched so that each RPC's changes are sent together.
+// If netlink cannot be used, or with the -t option, NetEnforcer runs a tc command for each change instead.
+//
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
 //
@@ -43,7 +46,9 @@
 #include <cstdlib>
 #include <cassert>
 #include <string>
+#include <sstream>
 #include <map>
+#include <vector>
 #include <unistd.h>
 #include <stdio.h>
 #include <signal.h>
@@ -52,6 +57,7 @@
 #include <rpc/pmap_clnt.h>
 #include "../prot/net_prot.h"
 #include "../common/time.hpp"
+#include "netlink.hpp"
 
 #define MAX_CMD_SIZE 256
 
@@ -75,6 +81,12 @@ string g_dev = "eth0";
 unsigned int g_maxRate = 125000000; // bytes per second
 unsigned int g_numPriorities = 7;
 unsigned int g_numLevels = 5;
+TCNetlink* g_netlink = NULL; // TC is configured with tc commands if NULL
+// TC class stats by handle, read at most once per RPC and reused by later RPCs for up to g_statsInterval seconds
+map<uint32_t, ClassStats> g_classStats;
+uint64_t g_classStatsTime = 0;
+bool g_classStatsCurrent = false; // read during the current RPC
+double g_statsInterval = 0;
 
 // Handle for root HTB qdisc
 unsigned int rootHTBHandle()
@@ -126,6 +138,30 @@ unsigned int HTBMinor(unsigned int id, unsigned int level)
     return (level == 0) ? (id + 2) : 1;
 }
 
+// TC handle [major:minor] as written in tc commands.
+// tc parses the numbers of handles as hex, while they are written in decimal (e.g., 10 is handle 0x10), so a number's value in the handle
+// is its binary-coded decimal.
+uint32_t tcHandle(unsigned int major, unsigned int minor)
+{
+    uint32_t majorValue = 0;
+    uint32_t minorValue = 0;
+    for (unsigned int shift = 0; major > 0; major /= 10, shift += 4) {
+        majorValue |= (major % 10) << shift;
+    }
+    for (unsigned int shift = 0; minor > 0; minor /= 10, shift += 4) {
+        minorValue |= (minor % 10) << shift;
+    }
+    return TC_H_MAKE(majorValue << 16, minorValue);
+}
+
+// Send the batched TC changes; changes made with tc commands have already been applied
+void commitTC()
+{
+    if (g_netlink != NULL) {
+        g_netlink->Commit();
+    }
+}
+
 // Execute a command and return the output as a string
 string runCmd(char* cmd)
 {
@@ -148,6 +184,10 @@ string runCmd(char* cmd)
 // Remove the root qdisc in TC
 void removeRoot()
 {
+    if (g_netlink != NULL) {
+        g_netlink->DeleteQdisc(TC_H_ROOT, 0);
+        return;
+    }
     char cmd[MAX_CMD_SIZE];
     snprintf(cmd, MAX_CMD_SIZE,
              "tc qdisc del dev %s root",
@@ -158,6 +198,10 @@ void removeRoot()
 // Remove a qdisc in TC
 void removeQdisc(unsigned int parentHandle, unsigned int parentMinor, unsigned int childHandle)
 {
+    if (g_netlink != NULL) {
+        g_netlink->DeleteQdisc(tcHandle(parentHandle, parentMinor), tcHandle(childHandle, 0));
+        return;
+    }
     char cmd[MAX_CMD_SIZE];
     snprintf(cmd, MAX_CMD_SIZE,
              "tc qdisc del dev %s parent %d:%d handle %d:",
@@ -171,6 +215,10 @@ void removeQdisc(unsigned int parentHandle, unsigned int parentMinor, unsigned i
 // Remove a class in TC
 void removeClass(unsigned int parentHandle, unsigned int minor)
 {
+    if (g_netlink != NULL) {
+        g_netlink->DeleteClass(tcHandle(parentHandle, minor));
+        return;
+    }
     char cmd[MAX_CMD_SIZE];
     snprintf(cmd, MAX_CMD_SIZE,
              "tc class del dev %s classid %d:%d",
@@ -185,6 +233,10 @@ void removeFilter(unsigned int parentHandle, unsigned int id)
 {
     // We overload prio to be the client id + 1 to make the filter easy to identify when removing it.
     // Since only one filter should target a client, setting prio should not have any effect.
+    if (g_netlink != NULL) {
+        g_netlink->DeleteU32Filter(tcHandle(parentHandle, 0), id + 1);
+        return;
+    }
     char cmd[MAX_CMD_SIZE];
     snprintf(cmd, MAX_CMD_SIZE,
              "tc filter del dev %s parent %d: prio %d u32",
@@ -197,6 +249,10 @@ void removeFilter(unsigned int parentHandle, unsigned int id)
 // Add a HTB qdisc in TC
 void addHTBQdisc(unsigned int parentHandle, unsigned int parentMinor, unsigned int childHandle)
 {
+    if (g_netlink != NULL) {
+        g_netlink->AddHTBQdisc(tcHandle(parentHandle, parentMinor), tcHandle(childHandle, 0), tcHandle(0, 1));
+        return;
+    }
     char cmd[MAX_CMD_SIZE];
     snprintf(cmd, MAX_CMD_SIZE,
              "tc qdisc add dev %s parent %d:%d handle %d: htb default 1",
@@ -210,6 +266,10 @@ void addHTBQdisc(unsigned int parentHandle, unsigned int parentMinor, unsigned i
 // Add a HTB class in TC
 void addHTBClass(unsigned int parentHandle, unsigned int minor, unsigned int rate, unsigned int ceil, unsigned int burst, unsigned int cburst)
 {
+    if (g_netlink != NULL) {
+        g_netlink->AddHTBClass(tcHandle(parentHandle, 0), tcHandle(parentHandle, minor), rate, ceil, burst, cburst, 0, true);
+        return;
+    }
     char burstStr[MAX_CMD_SIZE] = "";
     if (burst > 0) {
         snprintf(burstStr, MAX_CMD_SIZE,
@@ -240,6 +300,13 @@ void addHTBClass(unsigned int parentHandle, unsigned int minor, unsigned int rat
 // Causes packets with given src/dst to use class [parentHandle:minor]
 void addFilter(unsigned int parentHandle, unsigned int id, unsigned long s_dstAddr, unsigned long s_srcAddr, unsigned int minor)
 {
+    // We overload prio to be the client id + 1 to make the filter easy to identify when removing it.
+    // Since only one filter should target a client, setting prio should not have any effect.
+    if (g_netlink != NULL) {
+        g_netlink->AddU32Filter(tcHandle(parentHandle, 0), id + 1, s_dstAddr, s_srcAddr, tcHandle(parentHandle, minor));
+        return;
+    }
+
     // Convert address to string
     char dstAddrStr[INET_ADDRSTRLEN];
     char srcAddrStr[INET_ADDRSTRLEN];
@@ -250,8 +317,6 @@ void addFilter(unsigned int parentHandle, unsigned int id, unsigned long s_dstAd
     srcAddr.s_addr = s_srcAddr;
     inet_ntop(AF_INET, &srcAddr, srcAddrStr, INET_ADDRSTRLEN);
 
-    // We overload prio to be the client id + 1 to make the filter easy to identify when removing it.
-    // Since only one filter should target a client, setting prio should not have any effect.
     char cmd[MAX_CMD_SIZE];
     snprintf(cmd, MAX_CMD_SIZE,
              "tc filter add dev %s parent %d: protocol ip prio %d u32 match ip dst %s match ip src %s flowid %d:%d",
@@ -265,6 +330,67 @@ void addFilter(unsigned int parentHandle, unsigned int id, unsigned long s_dstAd
     runCmd(cmd);
 }
 
+// Add the root HTB qdisc [rootHTBHandle():] in TC
+void addRootHTBQdisc()
+{
+    if (g_netlink != NULL) {
+        g_netlink->AddHTBQdisc(TC_H_ROOT, tcHandle(rootHTBHandle(), 0), tcHandle(0, rootHTBMinorDefault()));
+        return;
+    }
+    char cmd[MAX_CMD_SIZE];
+    snprintf(cmd, MAX_CMD_SIZE,
+             "tc qdisc add dev %s root handle %d: htb default %d",
+             g_dev.c_str(),
+             rootHTBHandle(),
+             rootHTBMinorDefault());
+    runCmd(cmd);
+}
+
+// Add a class for a priority level in the root HTB qdisc in TC
+void addRootHTBClass(unsigned int parentMinor, unsigned int minor, unsigned int rate, unsigned int ceil, unsigned int priority)
+{
+    if (g_netlink != NULL) {
+        g_netlink->AddHTBClass(tcHandle(rootHTBHandle(), parentMinor), tcHandle(rootHTBHandle(), minor), rate, ceil, 0, 0, priority, false);
+        return;
+    }
+    char cmd[MAX_CMD_SIZE];
+    snprintf(cmd, MAX_CMD_SIZE,
+             "tc class add dev %s parent %d:%d classid %d:%d htb rate %dbps ceil %dbps prio %d",
+             g_dev.c_str(),
+             rootHTBHandle(),
+             parentMinor,
+             rootHTBHandle(),
+             minor,
+             rate,
+             ceil,
+             priority);
+    runCmd(cmd);
+}
+
+// Add a DSMARK qdisc in TC that marks packets with the DSCP flags of its class [childHandle:1]
+void addDSMARKQdisc(unsigned int parentHandle, unsigned int parentMinor, unsigned int childHandle, unsigned char value)
+{
+    if (g_netlink != NULL) {
+        g_netlink->AddDSMARKQdisc(tcHandle(parentHandle, parentMinor), tcHandle(childHandle, 0), 2, 1);
+        g_netlink->ChangeDSMARKClass(tcHandle(childHandle, 1), 0x3, value);
+        return;
+    }
+    char cmd[MAX_CMD_SIZE];
+    snprintf(cmd, MAX_CMD_SIZE,
+             "tc qdisc add dev %s parent %d:%d handle %d: dsmark indices 2 default_index 1",
+             g_dev.c_str(),
+             parentHandle,
+             parentMinor,
+             childHandle);
+    runCmd(cmd);
+    snprintf(cmd, MAX_CMD_SIZE,
+             "tc class change dev %s classid %d:1 dsmark mask 0x3 value 0x%x", // must be change, not add
+             g_dev.c_str(),
+             childHandle,
+             value);
+    runCmd(cmd);
+}
+
 // Initialize TC with our basic qdisc/class structure (see file header)
 void initTC()
 {
@@ -274,102 +400,119 @@ void initTC()
     const unsigned int minRate = g_maxRate / 100; // bps
     unsigned int rate = minRate * (g_numPriorities + 1);
     unsigned int ceil = g_maxRate;
-    char cmd[MAX_CMD_SIZE];
     // Create root HTB qdisc [1:]
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc qdisc add dev %s root handle 1: htb default %d",
-             g_dev.c_str(),
-             rootHTBMinorDefault());
-    runCmd(cmd);
+    addRootHTBQdisc();
     // Create root HTB class [1:rootHTBMinorHelper(0)]
-    snprintf(cmd, MAX_CMD_SIZE,
-             "tc class add dev %s parent 1: classid 1:%d htb rate %dbps prio %d",
-             g_dev.c_str(),
-             rootHTBMinorHelper(0),
-             g_maxRate,
-             0);
-    runCmd(cmd);
+    addRootHTBClass(0, rootHTBMinorHelper(0), g_maxRate, g_maxRate, 0);
     for (unsigned int priority = 0; priority < g_numPriorities; priority++) {
         // Create root HTB class [1:rootHTBMinor(priority)]
-        snprintf(cmd, MAX_CMD_SIZE,
-                 "tc class add dev %s parent 1:%d classid 1:%d htb rate %dbps ceil %dbps prio %d",
-                 g_dev.c_str(),
-                 rootHTBMinorHelper(priority),
-                 rootHTBMinor(priority),
-                 minRate,
-                 ceil,
-                 priority);
-        runCmd(cmd);
-        // Add DSMARK qdisc [DSMARKHandle(priority):]
-        snprintf(cmd, MAX_CMD_SIZE,
-                 "tc qdisc add dev %s parent 1:%d handle %d: dsmark indices 2 default_index 1",
-                 g_dev.c_str(),
-                 rootHTBMinor(priority),
-                 DSMARKHandle(priority));
-        runCmd(cmd);
-        // Set DSCP flag for DSMARK class [DSMARKHandle(priority):1]
+        addRootHTBClass(rootHTBMinorHelper(priority), rootHTBMinor(priority), minRate, ceil, priority);
+        // Add DSMARK qdisc [DSMARKHandle(priority):] and set DSCP flag for DSMARK class [DSMARKHandle(priority):1]
         // Highest priority (0) is cs7 (0b11100000)
         unsigned char value = (7 - priority) << 5;
-        snprintf(cmd, MAX_CMD_SIZE,
-                 "tc class change dev %s classid %d:1 dsmark mask 0x3 value 0x%x", // must be change, not add
-                 g_dev.c_str(),
-                 DSMARKHandle(priority),
-                 value);
-        runCmd(cmd);
+        addDSMARKQdisc(rootHTBHandle(), rootHTBMinor(priority), DSMARKHandle(priority), value);
         // Create base HTB qdisc [HTBBaseHandle(priority):] for handling rate limits
         addHTBQdisc(DSMARKHandle(priority), 1, HTBBaseHandle(priority));
         // Create root HTB class [1:rootHTBMinorHelper(priority + 1)]
         rate -= minRate;
         ceil -= minRate;
-        snprintf(cmd, MAX_CMD_SIZE,
-                 "tc class add dev %s parent 1:%d classid 1:%d htb rate %dbps ceil %dbps prio %d",
-                 g_dev.c_str(),
-                 rootHTBMinorHelper(priority),
-                 rootHTBMinorHelper(priority + 1),
-                 rate,
-                 ceil,
-                 priority + 1);
-        runCmd(cmd);
+        addRootHTBClass(rootHTBMinorHelper(priority), rootHTBMinorHelper(priority + 1), rate, ceil, priority + 1);
+    }
+    commitTC();
+}
+
+// Parse a TC size (e.g., "1514b" or "12Kb") in bytes
+uint64_t parseSize(const char* str)
+{
+    double size = 0;
+    char unit = 'b';
+    sscanf(str, "%lf%c", &size, &unit);
+    if (unit == 'K') {
+        size *= 1024;
+    } else if (unit == 'M') {
+        size *= 1024 * 1024;
+    } else if (unit == 'G') {
+        size *= 1024 * 1024 * 1024;
     }
+    return (uint64_t)size;
 }
 
-// Get TC stats on the sent bytes
-uint64_t getSentBytes(unsigned int parentHandle, unsigned int minor)
+// Get TC stats of all classes with one tc command, keyed by handle
+void getClassStats(map<uint32_t, ClassStats>& classStats)
 {
     char cmd[MAX_CMD_SIZE];
     snprintf(cmd, MAX_CMD_SIZE,
-             "tc -s class show dev %s parent %d:",
-             g_dev.c_str(),
-             parentHandle);
-    string stats = runCmd(cmd);
-    char find[64];
-    snprintf(find, 64,
-             "class htb %d:%d",
-             parentHandle,
-             minor);
-    size_t location = stats.find(find);
-    if (location == string::npos) {
-        return 0;
+             "tc -s class show dev %s",
+             g_dev.c_str());
+    istringstream stats(runCmd(cmd));
+    ClassStats* pStats = NULL;
+    string line;
+    while (getline(stats, line)) {
+        unsigned int major, minor;
+        unsigned long long sentBytes, sentPackets, droppedPackets, overlimits, backlogPackets;
+        char backlogBytes[64];
+        // tc shows handles in hex
+        if (sscanf(line.c_str(), "class %*s %x:%x", &major, &minor) == 2) {
+            pStats = &classStats[TC_H_MAKE(major << 16, minor)];
+            memset(pStats, 0, sizeof(ClassStats));
+        } else if (pStats == NULL) {
+            continue;
+        } else if (sscanf(line.c_str(), " Sent %llu bytes %llu pkt (dropped %llu, overlimits %llu", &sentBytes, &sentPackets, &droppedPackets, &overlimits) == 4) {
+            pStats->sentBytes = sentBytes;
+            pStats->sentPackets = sentPackets;
+            pStats->droppedPackets = droppedPackets;
+            pStats->overlimits = overlimits;
+        } else if (sscanf(line.c_str(), " backlog %63s %llup", backlogBytes, &backlogPackets) == 2) {
+            pStats->backlogBytes = parseSize(backlogBytes);
+            pStats->backlogPackets = backlogPackets;
+        }
+    }
+}
+
+// Get the table of TC stats of all classes, reading the stats if they have not been read during the current RPC and are older than
+// g_statsInterval, or if refresh is set
+const map<uint32_t, ClassStats>& classStats(bool refresh = false)
+{
+    uint64_t now = GetTime();
+    if (refresh || (!g_classStatsCurrent && ((now - g_classStatsTime) >= ConvertSecondsToTime(g_statsInterval)))) {
+        g_classStats.clear();
+        if (g_netlink != NULL) {
+            g_netlink->GetClassStats(g_classStats);
+        } else {
+            getClassStats(g_classStats);
+        }
+        g_classStatsTime = now;
+        g_classStatsCurrent = true;
+    }
+    return g_classStats;
+}
+
+// Get the stats of a class from the table of class stats; all zero if the class was not found
+ClassStats getClassStats(const map<uint32_t, ClassStats>& stats, unsigned int parentHandle, unsigned int minor)
+{
+    map<uint32_t, ClassStats>::const_iterator it = stats.find(tcHandle(parentHandle, minor));
+    if (it != stats.end()) {
+        return it->second;
     }
-    size_t begin = stats.find("Sent", location + 1);
-    assert(location != string::npos);
-    size_t end = stats.find('\n', begin);
-    string statsLine = stats.substr(begin, end - begin);
-    unsigned long long sentBytes;
-    sscanf(statsLine.c_str(), "Sent %lld", &sentBytes);
-    return sentBytes;
+    ClassStats zeroStats;
+    memset(&zeroStats, 0, sizeof(zeroStats));
+    return zeroStats;
 }
 
 // Update sent bytes stats
 void updateSentBytes(Client& c)
 {
     if (c.rateLimitLength > 0) {
-        uint64_t currSentBytes = getSentBytes(HTBBaseHandle(c.priority), HTBMinor(c.id, 0));
-        c.sentBytes += currSentBytes - c.prevSentBytes;
+        const map<uint32_t, ClassStats>& stats = classStats();
+        uint64_t currSentBytes = getClassStats(stats, HTBBaseHandle(c.priority), HTBMinor(c.id, 0)).sentBytes;
+        // The counters restart if the class was removed and added again
+        c.sentBytes += (currSentBytes >= c.prevSentBytes) ? (currSentBytes - c.prevSentBytes) : currSentBytes;
         c.prevSentBytes = currSentBytes;
-        uint64_t now = GetTime();
-        c.maxSentBytes += c.rate * ConvertTimeToSeconds(now - c.lastSentBytesTime);
-        c.lastSentBytesTime = now;
+        // Count the time up to when the stats were read
+        if (g_classStatsTime > c.lastSentBytesTime) {
+            c.maxSentBytes += c.rate * ConvertTimeToSeconds(g_classStatsTime - c.lastSentBytesTime);
+            c.lastSentBytesTime = g_classStatsTime;
+        }
     }
 }
 
@@ -475,12 +618,15 @@ double getOccupancy(unsigned long s_dstAddr, unsigned long s_srcAddr)
 {
     double occupancy = 0;
     pair<unsigned long, unsigned long> addr(s_dstAddr, s_srcAddr);
-    Client& c = g_clients[addr];
+    map<pair<unsigned long, unsigned long>, Client>::iterator it = g_clients.find(addr);
     // Ignore clients we don't know anything about
-    if (c.priority != 0) {
+    if (it != g_clients.end()) {
+        Client& c = it->second;
         updateSentBytes(c);
         // Approximate occupancy by its utilization of its assigned rate
-        occupancy = (double)c.sentBytes / c.maxSentBytes;
+        if (c.maxSentBytes > 0) {
+            occupancy = (double)c.sentBytes / c.maxSentBytes;
+        }
         // Cap occupancy at 1
         if (occupancy > 1) {
             cout << "Capped occupancy " << occupancy << " to 1" << endl; // Shouldn't happen often, if at all
@@ -493,6 +639,30 @@ double getOccupancy(unsigned long s_dstAddr, unsigned long s_srcAddr)
     return occupancy;
 }
 
+// Fill the stats of a client from the stats of its rate limiting class
+void fillClientStats(NetClientStats& clientStats, const map<uint32_t, ClassStats>& classStats)
+{
+    ClassStats stats;
+    memset(&stats, 0, sizeof(stats));
+    clientStats.rateLimited = false;
+    pair<unsigned long, unsigned long> addr(clientStats.client.s_dstAddr, clientStats.client.s_srcAddr);
+    map<pair<unsigned long, unsigned long>, Client>::const_iterator it = g_clients.find(addr);
+    if ((it != g_clients.end()) && (it->second.rateLimitLength > 0)) {
+        const Client& c = it->second;
+        map<uint32_t, ClassStats>::const_iterator statsIt = classStats.find(tcHandle(HTBBaseHandle(c.priority), HTBMinor(c.id, 0)));
+        if (statsIt != classStats.end()) {
+            stats = statsIt->second;
+            clientStats.rateLimited = true;
+        }
+    }
+    clientStats.sentBytes = stats.sentBytes;
+    clientStats.sentPackets = stats.sentPackets;
+    clientStats.droppedPackets = stats.droppedPackets;
+    clientStats.overlimits = stats.overlimits;
+    clientStats.backlogBytes = stats.backlogBytes;
+    clientStats.backlogPackets = stats.backlogPackets;
+}
+
 // UpdateClients RPC - update/add client configurations
 void* net_enforcer_update_clients_svc(NetUpdateClientsArgs* argp, struct svc_req* rqstp)
 {
@@ -516,6 +686,7 @@ void* net_enforcer_update_clients_svc(NetUpdateClientsArgs* argp, struct svc_req
                      clientUpdate.rateLimitRates.rateLimitRates_val,
                      clientUpdate.rateLimitBursts.rateLimitBursts_val);
     }
+    commitTC();
     return (void*)&result;
 }
 
@@ -528,6 +699,7 @@ void* net_enforcer_remove_clients_svc(NetRemoveClientsArgs* argp, struct svc_req
         // Special call to updateClient to cleanup client settings
         updateClient(client.s_dstAddr, client.s_srcAddr, g_numPriorities, 0, NULL, NULL);
     }
+    commitTC();
     return (void*)&result;
 }
 
@@ -539,6 +711,50 @@ NetGetOccupancyRes* net_enforcer_get_occupancy_svc(NetGetOccupancyArgs* argp, st
     return &result;
 }
 
+// GetOccupancies RPC - get occupancy statistics of a set of clients
+NetGetOccupanciesRes* net_enforcer_get_occupancies_svc(NetGetOccupanciesArgs* argp, struct svc_req* rqstp)
+{
+    static NetGetOccupanciesRes result;
+    static vector<double> occupancies;
+    // Read the stats of all clients at once
+    classStats(argp->refresh);
+    occupancies.resize(argp->clients.clients_len);
+    for (unsigned int i = 0; i < argp->clients.clients_len; i++) {
+        occupancies[i] = getOccupancy(argp->clients.clients_val[i].s_dstAddr, argp->clients.clients_val[i].s_srcAddr);
+    }
+    result.NetGetOccupanciesRes_len = occupancies.size();
+    result.NetGetOccupanciesRes_val = occupancies.empty() ? NULL : &occupancies[0];
+    return &result;
+}
+
+// GetStats RPC - get statistics of clients
+NetGetStatsRes* net_enforcer_get_stats_svc(NetGetStatsArgs* argp, struct svc_req* rqstp)
+{
+    static NetGetStatsRes result;
+    static vector<NetClientStats> stats;
+    stats.clear();
+    if (argp->NetGetStatsArgs_len == 0) {
+        for (map<pair<unsigned long, unsigned long>, Client>::const_iterator it = g_clients.begin(); it != g_clients.end(); it++) {
+            NetClientStats clientStats;
+            clientStats.client.s_dstAddr = it->first.first;
+            clientStats.client.s_srcAddr = it->first.second;
+            stats.push_back(clientStats);
+        }
+    } else {
+        for (unsigned int i = 0; i < argp->NetGetStatsArgs_len; i++) {
+            NetClientStats clientStats;
+            clientStats.client = argp->NetGetStatsArgs_val[i];
+            stats.push_back(clientStats);
+        }
+    }
+    for (unsigned int i = 0; i < stats.size(); i++) {
+        fillClientStats(stats[i], classStats());
+    }
+    result.NetGetStatsRes_len = stats.size();
+    result.NetGetStatsRes_val = stats.empty() ? NULL : &stats[0];
+    return &result;
+}
+
 // Main RPC handler
 void net_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
 {
@@ -546,6 +762,8 @@ void net_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
         NetUpdateClientsArgs net_enforcer_update_clients_arg;
         NetRemoveClientsArgs net_enforcer_remove_clients_arg;
         NetGetOccupancyArgs net_get_occupancy_arg;
+        NetGetStatsArgs net_get_stats_arg;
+        NetGetOccupanciesArgs net_get_occupancies_arg;
     } argument;
     char* result;
     xdrproc_t _xdr_argument, _xdr_result;
@@ -574,6 +792,18 @@ void net_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
             local = (char* (*)(char*, struct svc_req*))net_enforcer_get_occupancy_svc;
             break;
 
+        case NET_ENFORCER_GET_STATS:
+            _xdr_argument = (xdrproc_t)xdr_NetGetStatsArgs;
+            _xdr_result = (xdrproc_t)xdr_NetGetStatsRes;
+            local = (char* (*)(char*, struct svc_req*))net_enforcer_get_stats_svc;
+            break;
+
+        case NET_ENFORCER_GET_OCCUPANCIES:
+            _xdr_argument = (xdrproc_t)xdr_NetGetOccupanciesArgs;
+            _xdr_result = (xdrproc_t)xdr_NetGetOccupanciesRes;
+            local = (char* (*)(char*, struct svc_req*))net_enforcer_get_occupancies_svc;
+            break;
+
         default:
             svcerr_noproc(transp);
             return;
@@ -583,6 +813,8 @@ void net_enforcer_program(struct svc_req* rqstp, register SVCXPRT* transp)
         svcerr_decode(transp);
         return;
     }
+    // Class stats are read again by the RPC if needed
+    g_classStatsCurrent = false;
     result = (*local)((char*)&argument, rqstp);
     if (result != NULL && !svc_sendreply(transp, (xdrproc_t)_xdr_result, result)) {
         svcerr_systemerr(transp);
@@ -599,16 +831,18 @@ void term_signal(int signum)
     pmap_unset(NET_ENFORCER_PROGRAM, NET_ENFORCER_V1);
     // Remove TC root
     removeRoot();
+    commitTC();
     exit(0);
 }
 
-// Usage: ./NetEnforcer [-d dev] [-b maxBandwidth (in bytes per sec)] [-n numPriorities]
+// Usage: ./NetEnforcer [-d dev] [-b maxBandwidth (in bytes per sec)] [-n numPriorities] [-s statsInterval (in sec)] [-t]
 int main(int argc, char** argv)
 {
     // Initialize globals
+    bool useTCCommands = false;
     int opt = 0;
     do {
-        opt = getopt(argc, argv, "d:b:n:");
+        opt = getopt(argc, argv, "d:b:n:s:t");
         switch (opt) {
             case 'd':
                 g_dev.assign(optarg);
@@ -622,6 +856,14 @@ int main(int argc, char** argv)
                 g_numPriorities = atoi(optarg);
                 break;
 
+            case 's':
+                g_statsInterval = atof(optarg);
+                break;
+
+            case 't':
+                useTCCommands = true;
+                break;
+
             case -1:
                 break;
 
@@ -638,6 +880,16 @@ int main(int argc, char** argv)
     sigaction(SIGTERM, &action, NULL);
     sigaction(SIGINT, &action, NULL);
 
+    // Configure TC over netlink, falling back to tc commands
+    if (!useTCCommands) {
+        g_netlink = new TCNetlink();
+        if (!g_netlink->Open(g_dev)) {
+            cerr << "Warning: unable to configure TC over netlink; using tc commands" << endl;
+            delete g_netlink;
+            g_netlink = NULL;
+        }
+    }
+
     // Initialize TC
     initTC();
 
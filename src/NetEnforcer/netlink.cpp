@@ -0,0 +1,465 @@
+// netlink.cpp - Code for configuring TC over rtnetlink.
+// Requests match those built by tc (iproute2) for the equivalent commands, including the rate tables and burst times that tc calculates
+// from the kernel's clock parameters in /proc/net/psched.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <linux/if_ether.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/gen_stats.h>
+#include "netlink.hpp"
+
+using namespace std;
+
+// From tc (iproute2)
+#define TC_TIME_UNITS_PER_SEC 1000000
+#define TC_DEFAULT_MTU 1600
+#define TC_DEFAULT_HZ 100
+#define TC_HTB_RATE2QUANTUM 10
+#define TC_RATE_TABLE_SIZE 256
+
+// Size of buffer for replies; the kernel sends at most 32KB of a dump at a time
+#define TC_NETLINK_RECV_SIZE 65536
+
+TCNetlink::TCNetlink()
+    : _fd(-1),
+      _ifindex(0),
+      _seq(0),
+      _recvBuffer(TC_NETLINK_RECV_SIZE),
+      _tickInUsec(1),
+      _hz(TC_DEFAULT_HZ)
+{
+}
+
+TCNetlink::~TCNetlink()
+{
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool TCNetlink::Open(const string& dev)
+{
+    _ifindex = if_nametoindex(dev.c_str());
+    if (_ifindex == 0) {
+        perror("Unable to find network device");
+        return false;
+    }
+    // Read clock parameters as in tc_core_init and get_hz of tc
+    FILE* file = fopen("/proc/net/psched", "r");
+    if (file == NULL) {
+        perror("Unable to open /proc/net/psched");
+        return false;
+    }
+    unsigned int t2us, us2t, clockRes, hz;
+    int numFields = fscanf(file, "%08x%08x%08x%08x", &t2us, &us2t, &clockRes, &hz);
+    fclose(file);
+    if (numFields < 3) {
+        cerr << "Unable to read /proc/net/psched" << endl;
+        return false;
+    }
+    if (clockRes == 1000000000) {
+        t2us = us2t;
+    }
+    _tickInUsec = ((double)t2us / us2t) * ((double)clockRes / TC_TIME_UNITS_PER_SEC);
+    if ((numFields == 4) && (clockRes == 1000000)) {
+        _hz = hz;
+    }
+    // Open netlink socket
+    _fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (_fd < 0) {
+        perror("Unable to open netlink socket");
+        return false;
+    }
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("Unable to bind netlink socket");
+        close(_fd);
+        _fd = -1;
+        return false;
+    }
+#ifdef NETLINK_CAP_ACK
+    // Acknowledgements of failed requests do not need to include the request
+    int one = 1;
+    setsockopt(_fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+#endif
+    return true;
+}
+
+size_t TCNetlink::BeginRequest(uint16_t type, uint16_t flags, uint32_t parent, uint32_t handle, uint32_t info, const string& description)
+{
+    if (_batch.size() >= TC_NETLINK_BATCH_SIZE) {
+        Flush();
+    }
+    size_t offset = _batch.size();
+    _batch.resize(offset + NLMSG_SPACE(sizeof(struct tcmsg)), 0);
+    struct nlmsghdr* pHeader = (struct nlmsghdr*)&_batch[offset];
+    pHeader->nlmsg_type = type;
+    pHeader->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+    pHeader->nlmsg_seq = _seq++;
+    struct tcmsg* pTC = (struct tcmsg*)NLMSG_DATA(pHeader);
+    pTC->tcm_family = AF_UNSPEC;
+    pTC->tcm_ifindex = _ifindex;
+    pTC->tcm_parent = parent;
+    pTC->tcm_handle = handle;
+    pTC->tcm_info = info;
+    _batchDescriptions.push_back(description);
+    return offset;
+}
+
+void TCNetlink::EndRequest(size_t offset)
+{
+    ((struct nlmsghdr*)&_batch[offset])->nlmsg_len = _batch.size() - offset;
+}
+
+void TCNetlink::AddAttr(uint16_t type, const void* data, size_t size)
+{
+    size_t offset = _batch.size();
+    _batch.resize(offset + RTA_SPACE(size), 0);
+    struct rtattr* pAttr = (struct rtattr*)&_batch[offset];
+    pAttr->rta_type = type;
+    pAttr->rta_len = RTA_LENGTH(size);
+    if (size > 0) {
+        memcpy(RTA_DATA(pAttr), data, size);
+    }
+}
+
+size_t TCNetlink::BeginNest(uint16_t type)
+{
+    size_t offset = _batch.size();
+    AddAttr(type, NULL, 0);
+    return offset;
+}
+
+void TCNetlink::EndNest(size_t offset)
+{
+    ((struct rtattr*)&_batch[offset])->rta_len = _batch.size() - offset;
+}
+
+bool TCNetlink::Flush()
+{
+    if (_batch.empty()) {
+        return true;
+    }
+    bool success = true;
+    uint32_t firstSeq = _seq - _batchDescriptions.size();
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (sendto(_fd, &_batch[0], _batch.size(), 0, (struct sockaddr*)&addr, sizeof(addr)) != (ssize_t)_batch.size()) {
+        perror("Unable to send netlink requests");
+        success = false;
+    } else {
+        // Each request is acknowledged in order with its error code
+        unsigned int numAcks = 0;
+        while (numAcks < _batchDescriptions.size()) {
+            ssize_t len = recv(_fd, &_recvBuffer[0], _recvBuffer.size(), 0);
+            if (len < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Unable to receive netlink acknowledgements");
+                success = false;
+                break;
+            }
+            int remaining = len;
+            for (struct nlmsghdr* pHeader = (struct nlmsghdr*)&_recvBuffer[0]; NLMSG_OK(pHeader, remaining); pHeader = NLMSG_NEXT(pHeader, remaining)) {
+                uint32_t index = pHeader->nlmsg_seq - firstSeq;
+                if ((pHeader->nlmsg_type != NLMSG_ERROR) || (index >= _batchDescriptions.size())) {
+                    continue;
+                }
+                numAcks++;
+                int error = ((struct nlmsgerr*)NLMSG_DATA(pHeader))->error;
+                if (error != 0) {
+                    cerr << "Error configuring TC (" << _batchDescriptions[index] << "): " << strerror(-error) << endl;
+                    success = false;
+                }
+            }
+        }
+    }
+    _batch.clear();
+    _batchDescriptions.clear();
+    return success;
+}
+
+bool TCNetlink::Commit()
+{
+    return Flush();
+}
+
+// From tc_calc_xmittime of tc, including its rounding
+uint32_t TCNetlink::XmitTime(uint32_t rate, uint32_t size)
+{
+    if (rate == 0) {
+        return 0;
+    }
+    unsigned int time = TC_TIME_UNITS_PER_SEC * ((double)size / rate);
+    return time * _tickInUsec;
+}
+
+// From tc_calc_rtable of tc for the default cell size and Ethernet link layer
+void TCNetlink::CalcRateTable(struct tc_ratespec& rateSpec, uint32_t rate, uint32_t* rateTable)
+{
+    int cellLog = 0;
+    while ((TC_DEFAULT_MTU >> cellLog) > (TC_RATE_TABLE_SIZE - 1)) {
+        cellLog++;
+    }
+    for (int i = 0; i < TC_RATE_TABLE_SIZE; i++) {
+        rateTable[i] = XmitTime(rate, (i + 1) << cellLog);
+    }
+    memset(&rateSpec, 0, sizeof(rateSpec));
+    rateSpec.rate = rate;
+    rateSpec.cell_align = -1;
+    rateSpec.cell_log = cellLog;
+    rateSpec.linklayer = TC_LINKLAYER_ETHERNET;
+}
+
+void TCNetlink::AddHTBQdisc(uint32_t parent, uint32_t handle, uint32_t defaultMinor)
+{
+    char description[128];
+    snprintf(description, sizeof(description), "qdisc add parent %x:%x handle %x: htb", TC_H_MAJ(parent) >> 16, TC_H_MIN(parent), TC_H_MAJ(handle) >> 16);
+    size_t offset = BeginRequest(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, parent, handle, 0, description);
+    AddAttr(TCA_KIND, "htb", sizeof("htb"));
+    struct tc_htb_glob opt;
+    memset(&opt, 0, sizeof(opt));
+    opt.version = 3;
+    opt.rate2quantum = TC_HTB_RATE2QUANTUM;
+    opt.defcls = defaultMinor;
+    size_t nest = BeginNest(TCA_OPTIONS);
+    AddAttr(TCA_HTB_INIT, &opt, sizeof(opt));
+    EndNest(nest);
+    EndRequest(offset);
+}
+
+void TCNetlink::AddHTBClass(uint32_t parent, uint32_t classid, uint32_t rate, uint32_t ceil, uint32_t burst, uint32_t cburst, uint32_t prio, bool replace)
+{
+    char description[128];
+    snprintf(description, sizeof(description), "class %s classid %x:%x htb", replace ? "replace" : "add", TC_H_MAJ(classid) >> 16, TC_H_MIN(classid));
+    size_t offset = BeginRequest(RTM_NEWTCLASS, NLM_F_CREATE | (replace ? NLM_F_REPLACE : NLM_F_EXCL), parent, classid, 0, description);
+    AddAttr(TCA_KIND, "htb", sizeof("htb"));
+    // Default bursts are the bytes sent in a timer tick plus a MTU
+    if (burst == 0) {
+        burst = (rate / _hz) + TC_DEFAULT_MTU;
+    }
+    if (cburst == 0) {
+        cburst = (ceil / _hz) + TC_DEFAULT_MTU;
+    }
+    struct tc_htb_opt opt;
+    uint32_t rateTable[TC_RATE_TABLE_SIZE];
+    uint32_t ceilTable[TC_RATE_TABLE_SIZE];
+    memset(&opt, 0, sizeof(opt));
+    CalcRateTable(opt.rate, rate, rateTable);
+    CalcRateTable(opt.ceil, ceil, ceilTable);
+    opt.buffer = XmitTime(rate, burst);
+    opt.cbuffer = XmitTime(ceil, cburst);
+    opt.prio = prio;
+    size_t nest = BeginNest(TCA_OPTIONS);
+    AddAttr(TCA_HTB_PARMS, &opt, sizeof(opt));
+    AddAttr(TCA_HTB_RTAB, rateTable, sizeof(rateTable));
+    AddAttr(TCA_HTB_CTAB, ceilTable, sizeof(ceilTable));
+    EndNest(nest);
+    EndRequest(offset);
+}
+
+void TCNetlink::AddDSMARKQdisc(uint32_t parent, uint32_t handle, uint16_t indices, uint16_t defaultIndex)
+{
+    char description[128];
+    snprintf(description, sizeof(description), "qdisc add parent %x:%x handle %x: dsmark", TC_H_MAJ(parent) >> 16, TC_H_MIN(parent), TC_H_MAJ(handle) >> 16);
+    size_t offset = BeginRequest(RTM_NEWQDISC, NLM_F_CREATE | NLM_F_EXCL, parent, handle, 0, description);
+    AddAttr(TCA_KIND, "dsmark", sizeof("dsmark"));
+    size_t nest = BeginNest(TCA_OPTIONS);
+    AddAttr(TCA_DSMARK_INDICES, &indices, sizeof(indices));
+    AddAttr(TCA_DSMARK_DEFAULT_INDEX, &defaultIndex, sizeof(defaultIndex));
+    EndNest(nest);
+    EndRequest(offset);
+}
+
+void TCNetlink::ChangeDSMARKClass(uint32_t classid, uint8_t mask, uint8_t value)
+{
+    char description[128];
+    snprintf(description, sizeof(description), "class change classid %x:%x dsmark", TC_H_MAJ(classid) >> 16, TC_H_MIN(classid));
+    size_t offset = BeginRequest(RTM_NEWTCLASS, 0, TC_H_UNSPEC, classid, 0, description);
+    AddAttr(TCA_KIND, "dsmark", sizeof("dsmark"));
+    size_t nest = BeginNest(TCA_OPTIONS);
+    AddAttr(TCA_DSMARK_MASK, &mask, sizeof(mask));
+    AddAttr(TCA_DSMARK_VALUE, &value, sizeof(value));
+    EndNest(nest);
+    EndRequest(offset);
+}
+
+void TCNetlink::AddU32Filter(uint32_t parent, uint32_t prio, unsigned long s_dstAddr, unsigned long s_srcAddr, uint32_t flowid)
+{
+    char description[128];
+    snprintf(description, sizeof(description), "filter add parent %x: prio %u u32", TC_H_MAJ(parent) >> 16, prio);
+    size_t offset = BeginRequest(RTM_NEWTFILTER, NLM_F_CREATE | NLM_F_EXCL, parent, 0, TC_H_MAKE(prio << 16, htons(ETH_P_IP)), description);
+    AddAttr(TCA_KIND, "u32", sizeof("u32"));
+    // Match the dst and src addresses in the IP header
+    const size_t selSize = sizeof(struct tc_u32_sel) + (2 * sizeof(struct tc_u32_key));
+    uint32_t selBuffer[selSize / sizeof(uint32_t)];
+    memset(selBuffer, 0, selSize);
+    struct tc_u32_sel* pSel = (struct tc_u32_sel*)selBuffer;
+    pSel->flags = TC_U32_TERMINAL;
+    pSel->nkeys = 2;
+    pSel->keys[0].mask = 0xffffffff;
+    pSel->keys[0].val = s_dstAddr;
+    pSel->keys[0].off = 16;
+    pSel->keys[1].mask = 0xffffffff;
+    pSel->keys[1].val = s_srcAddr;
+    pSel->keys[1].off = 12;
+    size_t nest = BeginNest(TCA_OPTIONS);
+    AddAttr(TCA_U32_CLASSID, &flowid, sizeof(flowid));
+    AddAttr(TCA_U32_SEL, selBuffer, selSize);
+    EndNest(nest);
+    EndRequest(offset);
+}
+
+void TCNetlink::DeleteQdisc(uint32_t parent, uint32_t handle)
+{
+    char description[128];
+    if (parent == TC_H_ROOT) {
+        snprintf(description, sizeof(description), "qdisc del root");
+    } else {
+        snprintf(description, sizeof(description), "qdisc del parent %x:%x handle %x:", TC_H_MAJ(parent) >> 16, TC_H_MIN(parent), TC_H_MAJ(handle) >> 16);
+    }
+    EndRequest(BeginRequest(RTM_DELQDISC, 0, parent, handle, 0, description));
+}
+
+void TCNetlink::DeleteClass(uint32_t classid)
+{
+    char description[128];
+    snprintf(description, sizeof(description), "class del classid %x:%x", TC_H_MAJ(classid) >> 16, TC_H_MIN(classid));
+    EndRequest(BeginRequest(RTM_DELTCLASS, 0, TC_H_UNSPEC, classid, 0, description));
+}
+
+void TCNetlink::DeleteU32Filter(uint32_t parent, uint32_t prio)
+{
+    char description[128];
+    snprintf(description, sizeof(description), "filter del parent %x: prio %u u32", TC_H_MAJ(parent) >> 16, prio);
+    size_t offset = BeginRequest(RTM_DELTFILTER, 0, parent, 0, TC_H_MAKE(prio << 16, 0), description);
+    AddAttr(TCA_KIND, "u32", sizeof("u32"));
+    EndRequest(offset);
+}
+
+// Fill the stats of a class from the attributes of its dump message, as shown by tc -s
+static void ParseClassStats(struct tcmsg* pTC, int len, ClassStats& stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    struct rtattr* pStats = NULL;
+    struct rtattr* pOldStats = NULL;
+    for (struct rtattr* pAttr = TCA_RTA(pTC); RTA_OK(pAttr, len); pAttr = RTA_NEXT(pAttr, len)) {
+        if (pAttr->rta_type == TCA_STATS2) {
+            pStats = pAttr;
+        } else if (pAttr->rta_type == TCA_STATS) {
+            pOldStats = pAttr;
+        }
+    }
+    if (pStats != NULL) {
+        int statsLen = RTA_PAYLOAD(pStats);
+        for (struct rtattr* pAttr = (struct rtattr*)RTA_DATA(pStats); RTA_OK(pAttr, statsLen); pAttr = RTA_NEXT(pAttr, statsLen)) {
+            if (pAttr->rta_type == TCA_STATS_BASIC) {
+                struct gnet_stats_basic basic;
+                memset(&basic, 0, sizeof(basic));
+                memcpy(&basic, RTA_DATA(pAttr), min((size_t)RTA_PAYLOAD(pAttr), sizeof(basic)));
+                stats.sentBytes = basic.bytes;
+                if (stats.sentPackets == 0) {
+                    stats.sentPackets = basic.packets;
+                }
+            } else if ((pAttr->rta_type == TCA_STATS_PKT64) && (RTA_PAYLOAD(pAttr) >= sizeof(uint64_t))) {
+                // Packets beyond 32 bits
+                memcpy(&stats.sentPackets, RTA_DATA(pAttr), sizeof(uint64_t));
+            } else if (pAttr->rta_type == TCA_STATS_QUEUE) {
+                struct gnet_stats_queue queue;
+                memset(&queue, 0, sizeof(queue));
+                memcpy(&queue, RTA_DATA(pAttr), min((size_t)RTA_PAYLOAD(pAttr), sizeof(queue)));
+                stats.droppedPackets = queue.drops;
+                stats.overlimits = queue.overlimits;
+                stats.backlogBytes = queue.backlog;
+                stats.backlogPackets = queue.qlen;
+            }
+        }
+    } else if (pOldStats != NULL) {
+        // Kernels without TCA_STATS2
+        struct tc_stats oldStats;
+        memset(&oldStats, 0, sizeof(oldStats));
+        memcpy(&oldStats, RTA_DATA(pOldStats), min((size_t)RTA_PAYLOAD(pOldStats), sizeof(oldStats)));
+        stats.sentBytes = oldStats.bytes;
+        stats.sentPackets = oldStats.packets;
+        stats.droppedPackets = oldStats.drops;
+        stats.overlimits = oldStats.overlimits;
+        stats.backlogBytes = oldStats.backlog;
+        stats.backlogPackets = oldStats.qlen;
+    }
+}
+
+bool TCNetlink::GetClassStats(map<uint32_t, ClassStats>& classStats)
+{
+    bool success = Flush();
+    // Dump the classes of all qdiscs on the device
+    struct {
+        struct nlmsghdr header;
+        struct tcmsg tc;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+    request.header.nlmsg_type = RTM_GETTCLASS;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = _seq++;
+    request.tc.tcm_family = AF_UNSPEC;
+    request.tc.tcm_ifindex = _ifindex;
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (sendto(_fd, &request, request.header.nlmsg_len, 0, (struct sockaddr*)&addr, sizeof(addr)) != (ssize_t)request.header.nlmsg_len) {
+        perror("Unable to send netlink dump request");
+        return false;
+    }
+    // Receive the classes until the end of the dump
+    bool done = false;
+    while (!done) {
+        ssize_t len = recv(_fd, &_recvBuffer[0], _recvBuffer.size(), 0);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Unable to receive netlink dump");
+            return false;
+        }
+        int remaining = len;
+        for (struct nlmsghdr* pHeader = (struct nlmsghdr*)&_recvBuffer[0]; NLMSG_OK(pHeader, remaining); pHeader = NLMSG_NEXT(pHeader, remaining)) {
+            if (pHeader->nlmsg_seq != request.header.nlmsg_seq) {
+                continue;
+            }
+            if (pHeader->nlmsg_type == NLMSG_DONE) {
+                done = true;
+            } else if (pHeader->nlmsg_type == NLMSG_ERROR) {
+                int error = ((struct nlmsgerr*)NLMSG_DATA(pHeader))->error;
+                cerr << "Error getting TC class stats: " << strerror(-error) << endl;
+                success = false;
+                done = true;
+            } else if ((pHeader->nlmsg_type == RTM_NEWTCLASS) && (pHeader->nlmsg_len >= NLMSG_LENGTH(sizeof(struct tcmsg)))) {
+                struct tcmsg* pTC = (struct tcmsg*)NLMSG_DATA(pHeader);
+                ParseClassStats(pTC, pHeader->nlmsg_len - NLMSG_LENGTH(sizeof(struct tcmsg)), classStats[pTC->tcm_handle]);
+            }
+        }
+    }
+    return success;
+}
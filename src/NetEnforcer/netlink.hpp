@@ -0,0 +1,96 @@
+// netlink.hpp - Class definitions for configuring TC over rtnetlink.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _NETLINK_HPP
+#define _NETLINK_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <linux/pkt_sched.h>
+
+using namespace std;
+
+// Max size in bytes of the requests sent to the kernel at once
+#define TC_NETLINK_BATCH_SIZE 65536
+
+// TC stats of a class
+struct ClassStats {
+    uint64_t sentBytes;
+    uint64_t sentPackets;
+    uint64_t droppedPackets;
+    uint64_t overlimits;
+    uint64_t backlogBytes;
+    uint64_t backlogPackets;
+};
+
+// Configures TC qdiscs, classes, and filters on a device by sending rtnetlink requests directly instead of running tc commands.
+// Requests are built as tc would build them for the equivalent command and batched until Commit, which sends them over one netlink
+// socket with few system calls. The kernel applies the requests of a batch in order, and a failed request does not stop the rest,
+// as with running each tc command in turn.
+// Handles are full TC handles (i.e., TC_H_MAKE(major << 16, minor)).
+class TCNetlink
+{
+private:
+    int _fd;
+    int _ifindex;
+    uint32_t _seq; // sequence number of the next request
+    vector<char> _batch; // requests that have not been sent
+    vector<string> _batchDescriptions; // equivalent tc command of each request in the batch for error messages
+    vector<char> _recvBuffer; // buffer for replies
+    double _tickInUsec; // TC clock ticks per microsecond
+    unsigned int _hz; // kernel timer frequency used for default bursts
+
+    // Start a request in the batch. Returns the offset of the request.
+    size_t BeginRequest(uint16_t type, uint16_t flags, uint32_t parent, uint32_t handle, uint32_t info, const string& description);
+    // Finish a request started at offset.
+    void EndRequest(size_t offset);
+    // Add an attribute to the current request.
+    void AddAttr(uint16_t type, const void* data, size_t size);
+    // Start a nested attribute in the current request. Returns the offset of the attribute.
+    size_t BeginNest(uint16_t type);
+    // Finish a nested attribute started at offset.
+    void EndNest(size_t offset);
+    // Send the requests in the batch and wait for their acknowledgements. Returns false if any request failed.
+    bool Flush();
+    // Time in TC clock ticks to send size bytes at a rate (bytes/sec).
+    uint32_t XmitTime(uint32_t rate, uint32_t size);
+    // Fill a rate and its table of transmit times by packet size.
+    void CalcRateTable(struct tc_ratespec& rateSpec, uint32_t rate, uint32_t* rateTable);
+
+public:
+    TCNetlink();
+    ~TCNetlink();
+    // Open a netlink socket for configuring TC on a device. Returns false on error.
+    bool Open(const string& dev);
+
+    // Batch a request to add a HTB qdisc with default class [handle:defaultMinor].
+    void AddHTBQdisc(uint32_t parent, uint32_t handle, uint32_t defaultMinor);
+    // Batch a request to add or replace a HTB class; bursts of 0 use the defaults of tc.
+    void AddHTBClass(uint32_t parent, uint32_t classid, uint32_t rate, uint32_t ceil, uint32_t burst, uint32_t cburst, uint32_t prio, bool replace);
+    // Batch a request to add a DSMARK qdisc.
+    void AddDSMARKQdisc(uint32_t parent, uint32_t handle, uint16_t indices, uint16_t defaultIndex);
+    // Batch a request to change the marking of a DSMARK class.
+    void ChangeDSMARKClass(uint32_t classid, uint8_t mask, uint8_t value);
+    // Batch a request to add a u32 filter with priority prio that sends IP packets with the given dst/src addresses to class flowid.
+    void AddU32Filter(uint32_t parent, uint32_t prio, unsigned long s_dstAddr, unsigned long s_srcAddr, uint32_t flowid);
+    // Batch a request to remove a qdisc; removes the root qdisc if parent is TC_H_ROOT.
+    void DeleteQdisc(uint32_t parent, uint32_t handle);
+    // Batch a request to remove a class.
+    void DeleteClass(uint32_t classid);
+    // Batch a request to remove the u32 filters with priority prio.
+    void DeleteU32Filter(uint32_t parent, uint32_t prio);
+
+    // Send the batched requests. Returns false if any request failed; failures are reported to cerr.
+    bool Commit();
+
+    // Get the stats of all classes on the device with one dump, keyed by handle. Batched requests are sent first.
+    // Returns false on error.
+    bool GetClassStats(map<uint32_t, ClassStats>& classStats);
+};
+
+#endif // _NETLINK_HPP
@@ -6,20 +6,37 @@
 // -o outputFilename (required) - output file to store the results of the workload placement
 // -s serverAddr (required) - the address of the PlacementController server
 // -e eventFilename (optional) - a file for experimentation purposes to add and remove instances of a workload from the system; see below for format; if not specified, by default each workload in the topology file will be added to the system.
+// -b (optional) - without an events file, place all workloads in the topology file as a single batch, in which each workload is admitted or rejected independently
+// -d (optional) - with -b, place the batch in decreasing order of load, which can pack workloads onto fewer servers
+// -w windowSize (optional) - sends the events asynchronously with up to windowSize requests in flight, each on its own connection,
+//                            and streams the result of each event to the output file as it completes (see below)
+// -m maxBatchSize (optional) - with -w, the maximum number of consecutive events of the same type sent in one request; defaults to 16
 //
 // Events file format: CSV file with 2 columns. 
 // The first column corresponds to the index of the workload in the topology file.
 // The second column is either addClient or delClient to indicate whether to add or remove the workload from the system.
 //
+// In the asynchronous mode (-w), consecutive addClient events are sent as one PlaceClients request, in which each workload is
+// admitted or rejected independently in the order given, like a series of addClient events. Consecutive delClient events are
+// sent as one DelClients request. Requests are sent in event order, and a request waits until the earlier requests with any of its
+// workloads have completed, so each workload's events are applied in order, while requests of other workloads overlap.
+// Instead of the topology file with the placements, the output file has a line per event with a JSON object of the event's
+// index, type ("addClient" or "delClient"), and workload name, and, for addClient events, whether the workload was admitted and its placement.
+// Lines are written in event order as soon as the event's request and the earlier requests have completed.
+//
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
 #include <iostream>
 #include <fstream>
+#include <vector>
+#include <list>
+#include <set>
 #include <string>
 #include <cstdlib>
 #include <unistd.h>
+#include <pthread.h>
 #include "../prot/PlacementController_clnt.hpp"
 #include <json/json.h>
 #include "../common/time.hpp"
@@ -32,24 +49,204 @@ struct EventInfo {
     bool addClient;
 };
 
+// Request of the asynchronous mode for a run of consecutive events of the same type
+struct EventRequest {
+    bool addClients;
+    vector<unsigned int> eventIndices;
+    set<string> names; // names of the request's workloads
+    Json::Value clientInfos; // for addClients, the workloads to place, updated with the placements
+    vector<bool> admitted;
+    bool complete;
+};
+
 Json::Value rootConfig;
 char* outputFilename = NULL;
+ofstream streamFile; // output file of the asynchronous mode
+
+// Asynchronous mode requests, protected by g_mutex
+pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t g_requestAvailable = PTHREAD_COND_INITIALIZER; // indicates a request has been queued
+pthread_cond_t g_requestComplete = PTHREAD_COND_INITIALIZER; // indicates a request has completed
+list<EventRequest*> g_requestQueue; // requests waiting to be sent
+string g_addrPrefix;
+bool g_enforce = false;
 
 // SIGTERM/SIGINT signal for cleanup
 void term_signal(int signum)
 {
+    if (streamFile.is_open()) {
+        // Results of completed events have already been written
+        exit(0);
+    }
     writeJson(outputFilename, rootConfig);
     exit(0);
 }
 
+// Sends asynchronous mode requests on a connection, one at a time.
+void* requestThread(void* ptr)
+{
+    PlacementController_clnt* clnt = static_cast<PlacementController_clnt*>(ptr);
+    pthread_mutex_lock(&g_mutex);
+    while (true) {
+        while (g_requestQueue.empty()) {
+            pthread_cond_wait(&g_requestAvailable, &g_mutex);
+        }
+        EventRequest* request = g_requestQueue.front();
+        g_requestQueue.pop_front();
+        pthread_mutex_unlock(&g_mutex);
+
+        if (request->addClients) {
+            clnt->placeClients(request->clientInfos, g_addrPrefix, g_enforce, PLACEMENT_ORDER_GIVEN, request->admitted);
+        } else {
+            clnt->delClients(vector<string>(request->names.begin(), request->names.end()));
+        }
+
+        pthread_mutex_lock(&g_mutex);
+        request->complete = true;
+        pthread_cond_broadcast(&g_requestComplete);
+    }
+    pthread_mutex_unlock(&g_mutex);
+    return NULL;
+}
+
+// Group events into requests of up to maxBatchSize consecutive events of the same type, without repeating a workload in a request.
+void buildRequests(const vector<EventInfo>& events, const Json::Value& clientInfos, unsigned int maxBatchSize, vector<EventRequest>& requests)
+{
+    requests.clear();
+    for (unsigned int eventIndex = 0; eventIndex < events.size(); eventIndex++) {
+        const EventInfo& event = events[eventIndex];
+        string name = clientInfos[event.clientInfoIndex]["name"].asString();
+        if (requests.empty() ||
+            (requests.back().addClients != event.addClient) ||
+            (requests.back().eventIndices.size() >= maxBatchSize) ||
+            (requests.back().names.find(name) != requests.back().names.end())) {
+            EventRequest request;
+            request.addClients = event.addClient;
+            request.complete = false;
+            requests.push_back(request);
+        }
+        requests.back().eventIndices.push_back(eventIndex);
+        requests.back().names.insert(name);
+    }
+}
+
+// Check if a request shares a workload with a request that has been sent and not yet retired.
+bool requestConflicts(const EventRequest& request, const multiset<string>& pendingNames)
+{
+    for (set<string>::const_iterator it = request.names.begin(); it != request.names.end(); it++) {
+        if (pendingNames.find(*it) != pendingNames.end()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Write the results of a completed request's events to the output file and update the topology's workloads with their placements.
+void retireRequest(EventRequest& request, const vector<EventInfo>& events, Json::Value& clientInfos)
+{
+    Json::FastWriter writer;
+    for (unsigned int i = 0; i < request.eventIndices.size(); i++) {
+        unsigned int eventIndex = request.eventIndices[i];
+        Json::Value& clientInfo = clientInfos[events[eventIndex].clientInfoIndex];
+        Json::Value result;
+        result["event"] = Json::Value(eventIndex);
+        result["type"] = Json::Value(request.addClients ? "addClient" : "delClient");
+        result["name"] = clientInfo["name"];
+        if (request.addClients) {
+            bool admitted = (i < request.admitted.size()) && request.admitted[i];
+            result["admitted"] = Json::Value(admitted);
+            if (admitted) {
+                clientInfo = request.clientInfos[i];
+                result["clientHost"] = clientInfo["clientHost"];
+                result["clientVM"] = clientInfo["clientVM"];
+                result["serverHost"] = clientInfo["serverHost"];
+                result["serverVM"] = clientInfo["serverVM"];
+                cout << "Placed " << clientInfo["name"].asString() << " (" << clientInfo["clientHost"].asString() << ", " << clientInfo["clientVM"].asString() << ") -> (" << clientInfo["serverHost"].asString() << ", " << clientInfo["serverVM"].asString() << ")" << endl;
+            } else {
+                cout << "Rejected " << clientInfo["name"].asString() << endl;
+            }
+        }
+        streamFile << writer.write(result);
+    }
+    streamFile.flush();
+}
+
+// Send the events with up to windowSize requests in flight, streaming the results to outputFilename in event order.
+bool runAsync(const vector<EventInfo>& events, Json::Value& clientInfos, string serverAddr, unsigned int windowSize, unsigned int maxBatchSize)
+{
+    streamFile.open(outputFilename);
+    if (!streamFile.is_open()) {
+        cerr << "Failed to open output file " << outputFilename << endl;
+        return false;
+    }
+    vector<EventRequest> requests;
+    buildRequests(events, clientInfos, maxBatchSize, requests);
+    // Create a connection and thread per request in flight
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (unsigned int i = 0; i < windowSize; i++) {
+        pthread_t thread;
+        int rc = pthread_create(&thread, &attr, requestThread, new PlacementController_clnt(serverAddr));
+        if (rc) {
+            cerr << "Error creating thread: " << rc << endl;
+            return false;
+        }
+    }
+    // Send requests in order, and retire them in order as they complete
+    multiset<string> pendingNames; // workloads of sent requests that have not been retired
+    unsigned int nextSend = 0;
+    unsigned int nextRetire = 0;
+    pthread_mutex_lock(&g_mutex);
+    while (nextRetire < requests.size()) {
+        bool progress = false;
+        while ((nextSend < requests.size()) && (nextSend - nextRetire < windowSize) && !requestConflicts(requests[nextSend], pendingNames)) {
+            EventRequest& request = requests[nextSend];
+            if (request.addClients) {
+                // Copy the workloads now, so that they include the placements of earlier events
+                request.clientInfos = Json::Value(Json::arrayValue);
+                for (unsigned int i = 0; i < request.eventIndices.size(); i++) {
+                    request.clientInfos.append(clientInfos[events[request.eventIndices[i]].clientInfoIndex]);
+                }
+            }
+            pendingNames.insert(request.names.begin(), request.names.end());
+            g_requestQueue.push_back(&request);
+            pthread_cond_signal(&g_requestAvailable);
+            nextSend++;
+            progress = true;
+        }
+        while ((nextRetire < nextSend) && requests[nextRetire].complete) {
+            EventRequest& request = requests[nextRetire];
+            pthread_mutex_unlock(&g_mutex);
+            retireRequest(request, events, clientInfos);
+            for (set<string>::const_iterator it = request.names.begin(); it != request.names.end(); it++) {
+                pendingNames.erase(pendingNames.find(*it));
+            }
+            pthread_mutex_lock(&g_mutex);
+            nextRetire++;
+            progress = true;
+        }
+        if (!progress) {
+            pthread_cond_wait(&g_requestComplete, &g_mutex);
+        }
+    }
+    pthread_mutex_unlock(&g_mutex);
+    streamFile.close();
+    return true;
+}
+
 int main(int argc, char** argv)
 {
     int opt = 0;
     char* topoFilename = NULL;
     char* eventFilename = NULL;
     string serverAddr = "";
+    bool batch = false;
+    PlacementOrder order = PLACEMENT_ORDER_GIVEN;
+    unsigned int windowSize = 0;
+    unsigned int maxBatchSize = 16;
     do {
-        opt = getopt(argc, argv, "t:o:s:e:");
+        opt = getopt(argc, argv, "t:o:s:e:bdw:m:");
         switch (opt) {
             case 't':
                 topoFilename = optarg;
@@ -67,6 +264,22 @@ int main(int argc, char** argv)
                 eventFilename = optarg;
                 break;
 
+            case 'b':
+                batch = true;
+                break;
+
+            case 'd':
+                order = PLACEMENT_ORDER_DECREASING_LOAD;
+                break;
+
+            case 'w':
+                windowSize = atoi(optarg);
+                break;
+
+            case 'm':
+                maxBatchSize = atoi(optarg);
+                break;
+
             case -1:
                 break;
 
@@ -75,8 +288,8 @@ int main(int argc, char** argv)
         }
     } while (opt != -1);
 
-    if ((topoFilename == NULL) || (outputFilename == NULL) || (serverAddr == "")) {
-        cout << "Usage: " << argv[0] << " -t topoFilename -o outputFilename -s serverAddr [-e eventFilename]" << endl;
+    if ((topoFilename == NULL) || (outputFilename == NULL) || (serverAddr == "") || (maxBatchSize == 0) || (batch && (windowSize > 0))) {
+        cout << "Usage: " << argv[0] << " -t topoFilename -o outputFilename -s serverAddr [-e eventFilename] [-b [-d] | -w windowSize [-m maxBatchSize]]" << endl;
         return -1;
     }
 
@@ -132,6 +345,23 @@ int main(int argc, char** argv)
     // Add/remove clients according to events
     string addrPrefix = rootConfig["addrPrefix"].asString();
     bool enforce = rootConfig.isMember("enforce") && rootConfig["enforce"].asBool();
+    if (batch && !eventFilename) {
+        clnt.placeClients(clientInfos, addrPrefix, enforce, order);
+        for (unsigned int clientInfoIndex = 0; clientInfoIndex < clientInfos.size(); clientInfoIndex++) {
+            const Json::Value& clientInfo = clientInfos[clientInfoIndex];
+            if (clientInfo.isMember("serverHost")) {
+                cout << "Placed " << clientInfo["name"].asString() << " (" << clientInfo["clientHost"].asString() << ", " << clientInfo["clientVM"].asString() << ") -> (" << clientInfo["serverHost"].asString() << ", " << clientInfo["serverVM"].asString() << ")" << endl;
+            } else {
+                cout << "Rejected " << clientInfo["name"].asString() << endl;
+            }
+        }
+        events.clear();
+    }
+    if (windowSize > 0) {
+        g_addrPrefix = addrPrefix;
+        g_enforce = enforce;
+        return runAsync(events, clientInfos, serverAddr, windowSize, maxBatchSize) ? 0 : -1;
+    }
     for (unsigned int eventIndex = 0; eventIndex < events.size(); eventIndex++) {
         const EventInfo& event = events[eventIndex];
         Json::Value& clientInfo = clientInfos[event.clientInfoIndex];
@@ -3,16 +3,40 @@
 // Workloads are placed one by one onto servers in a first-fit fashion.
 // To improve the placement performance, multiple admission control servers can be used to run the computation in parallel.
 // Each admission control server is used to speculatively test the ability to place a workload onto a server.
+// Tests use the ProbeClients RPC, which checks admission without adding the workload, so they leave no state to undo on the admission control server.
 // This is done until a fit is found, at which point, the work to test the rest of the servers is canceled.
+// Probe results are memoized: each queue has a state version that changes whenever a workload sharing its client group is added or removed,
+// so a workload with the same configuration is not probed again on a server whose queues' state versions have not changed.
+// Workloads given in a single RPC form a batch: while the current workload is being tested, idle worker threads speculatively test
+// the next few workloads of the batch in first-fit order, and the results are memoized like any other test. Results for servers
+// whose queues are unaffected by the current workload's placement remain valid, so the tests of the next workload overlap the
+// tests of the current one. The PlaceClients RPC admits each workload of a batch independently, optionally in decreasing order of load.
+// Servers that can not fit a workload are pruned before testing. For each queue, the PlacementController tracks the sums of
+// lower bounds on the rate limits (r, b) of the flows using the queue (see getFlowBounds). A server is skipped if, after adding
+// the workload, the rates would exceed a queue's bandwidth, or the bursts could not be served within the largest SLO of the
+// queue's flows, since the lowest priority flow waits for all bursts. Candidate servers are found using an index of the servers'
+// remaining storage rates.
+// Placements are committed on the first AdmissionController server (the primary), which computes the admitted workload's flow parameters.
+// The other servers (replicas) are updated asynchronously in parallel by per-replica threads, which apply the primary's flow parameters
+// using the ApplyClients RPC rather than re-running the admission computation. Updates are applied to each replica in order,
+// and tests on a replica wait until the replica has applied all prior updates.
+// Instead of first-fit, workloads can be placed with a best-fit or balanced policy, which tests all candidate servers using the
+// HeadroomClientsTyped RPC to find how much each server could scale the workload's load and still admit it. Best-fit picks the admitting
+// server with the least headroom to pack servers tightly, and balanced picks the server with the most headroom to spread load.
+// For large clusters, several PlacementControllers can each manage a partition of the servers behind a PlacementRouter (see PlacementRouter.cpp).
+// The grouping of workloads onto client machines, capacity pruning, and memoization are shared with PlacementReplay (see PlacementState.hpp).
 //
 // Command line parameters:
 // -a AdmissionControllerAddr (required) - the address of the AdmissionController server that determines if a workload can fit on a server; this command line option can be used multiple times to use multiple AdmissionController servers for performing the placement computation in parallel
 // -f (optional) - enables the fast-first-fit computation optimization, which tells the AdmissionController server to return early if a placement is unlikely to fit
+// -n numConnections (optional) - number of connections to each AdmissionController server used for testing placements in parallel; a multi-threaded AdmissionController server (see AdmissionController -t) tests placements on each connection concurrently; defaults to 1
+// -p policy (optional) - placement policy: first (first-fit), best (best-fit), or balanced; best and balanced require AdmissionController servers that support version 2 RPCs; defaults to first
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <fstream>
@@ -24,6 +48,7 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <cerrno>
+#include <stdint.h>
 #include <pthread.h>
 #include <rpc/rpc.h>
 #include <rpc/pmap_clnt.h>
@@ -32,32 +57,71 @@
 #include <json/json.h>
 #include "../common/time.hpp"
 #include "../common/common.hpp"
+#include "../common/SpanTrace.hpp"
 #include "../DNC-Library/NCConfig.hpp"
+#include "PlacementState.hpp"
 
 using namespace std;
 
-struct WorkloadInfo {
-    string name;
-    string clientHost;
-    string clientVM;
-    string serverHost;
-    string serverVM;
+// Number of upcoming workloads in a batch that are tested speculatively
+#define BATCH_LOOKAHEAD 2
+// Largest scale factor of a workload's load tested for its headroom on a server (see PlacementPolicy)
+#define HEADROOM_MAX_SCALE 8
+// Relative precision of headroom tests
+#define HEADROOM_TOLERANCE 0.05
+
+// Policy for choosing among the servers that can admit a workload
+enum PlacementPolicy {
+    PLACEMENT_FIRST_FIT, // lowest index in first-fit order
+    PLACEMENT_BEST_FIT, // least headroom, i.e., the server left with the least room for the workload
+    PLACEMENT_BALANCED // most headroom, i.e., the server left with the most room for the workload
+};
+
+// Update committed on the primary AdmissionController to be applied to a replica
+enum ReplicaUpdateType {
+    REPLICA_APPLY_CLIENT,
+    REPLICA_DEL_CLIENT,
+    REPLICA_ADD_QUEUE,
+    REPLICA_DEL_QUEUE
+};
+struct ReplicaUpdate {
+    ReplicaUpdateType type;
+    Json::Value info; // clientInfo for REPLICA_APPLY_CLIENT or queueInfo for REPLICA_ADD_QUEUE
+    Json::Value flowParameters; // flow parameters computed by the primary for REPLICA_APPLY_CLIENT
+    string name; // client or queue name for REPLICA_DEL_CLIENT or REPLICA_DEL_QUEUE
+};
+
+// Updates not yet applied to a replica
+struct ReplicaState {
+    list<ReplicaUpdate> updates; // updates waiting to be applied in order
+    bool busy; // an update is being applied
+};
+
+// Speculative test of an upcoming workload in a batch on a serverHost/serverVM pair
+struct SpeculativeWork {
+    unsigned int batchIndex;
+    pair<string, string> server;
+};
+
+// Connection used by a worker thread for testing placements
+struct ProbeConnection {
+    AdmissionController_clnt* clnt;
+    unsigned int replicaIndex; // index of the AdmissionController server in g_clnts
 };
 
 //
 // Globals fixed at init
 //
-vector<AdmissionController_clnt*> g_clnts; // connections to AdmissionController servers that perform most of the computation; many are used for computation parallelism
+vector<AdmissionController_clnt*> g_clnts; // connections for committing placements to AdmissionController servers; g_clnts[0] is the primary and the rest are replicas
+vector<ProbeConnection> g_probeConnections; // connections used by worker threads for testing placements; many are used for computation parallelism
 bool g_fastFirstFit = false; // enable fast-first-fit computation optimization
+PlacementPolicy g_placementPolicy = PLACEMENT_FIRST_FIT; // policy for choosing among servers that can admit a workload
 
 //
 // Globals protected by g_mutex
 //
 pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
-map<string, set<string> > g_servers; // map serverHost -> serverVMs
-map<string, set<string> > g_clients; // map clientHost -> clientVMs
-map<string, string> g_serverClientGrouping; // map serverHost -> clientHost to group workloads that share the same server onto the same client
-list<WorkloadInfo> g_workloads; // list of workloads in system
+PlacementState g_placement; // client/server VMs, workloads, queue capacities, and memoized probe results
 // manage placement work queue
 pthread_cond_t g_workAvailable = PTHREAD_COND_INITIALIZER; // indicates there is work to do
 pthread_cond_t g_workComplete = PTHREAD_COND_INITIALIZER; // indicates current placement is complete
@@ -67,73 +131,295 @@ vector<pair<string, string> > g_workQueue; // work queue consists of a list of s
 unsigned int g_outstandingWork = 0; // number of placements being tested concurrently
 unsigned int g_nextWorkQueueIndex = 0; // next index in work queue to test
 unsigned int g_bestWorkQueueIndex; // index of best server (i.e., lowest index for first-fit)
+double g_bestHeadroom; // headroom of best server (only used if not first-fit)
+string g_currentFingerprint = ""; // configuration of current workload, excluding its name and placement
+// manage batch placement
+vector<Json::Value*> g_batch; // workloads of the current RPC in placement order
+vector<string> g_batchFingerprints; // configurations of workloads in g_batch
+vector<WorkloadDemand> g_batchDemands; // rate and burst bounds and SLOs of workloads in g_batch, for pruning their placements
+unsigned int g_batchIndex = 0; // index in g_batch of current workload
+uint64_t g_batchNumber = 0; // changed whenever g_speculativeQueue is rebuilt
+vector<SpeculativeWork> g_speculativeQueue; // tests of upcoming workloads in g_batch, in first-fit order for each workload
+unsigned int g_nextSpeculativeIndex = 0; // next index in speculative queue to test
+set<unsigned int> g_speculativeAdmitted; // batch indices of upcoming workloads admitted by a speculative test
+// manage replica updates
+vector<ReplicaState> g_replicas; // state of each AdmissionController server indexed as in g_clnts; the primary has no pending updates
+pthread_cond_t g_replicaUpdateAvailable = PTHREAD_COND_INITIALIZER; // indicates a replica has updates to apply
+pthread_cond_t g_replicaUpToDate = PTHREAD_COND_INITIALIZER; // indicates a replica has applied all of its updates
 
-// Decides which client VM to place a workload on.
-// The current algorithm groups workloads that share a server onto the same client machine.
-// This is because their performance is already correlated by sharing a server, so it's better
-// to continue sharing so as not to introduce additional correlations with other workloads.
+// Decides which client VM to place a workload on a server with (see PlacementState::clientServerPlacement).
 // Assumes g_mutex is held
 pair<string, string> clientServerPlacement(string serverHost)
 {
-    string clientHost;
-    map<string, string>::const_iterator it = g_serverClientGrouping.find(serverHost);
-    if (it != g_serverClientGrouping.end()) {
-        clientHost = it->second;
-        const set<string>& clientVMs = g_clients[clientHost];
-        if (!clientVMs.empty()) {
-            return pair<string, string>(clientHost, *(clientVMs.begin()));
-        }
+    pair<string, string> client;
+    if (!g_placement.clientServerPlacement(serverHost, client)) {
+        cerr << "Out of client machines" << endl;
+        exit(-1);
     }
-    // Check for other workloads using server
-    for (list<WorkloadInfo>::iterator it2 = g_workloads.begin(); it2 != g_workloads.end(); it2++) {
-        if (it2->serverHost == serverHost) {
-            clientHost = it2->clientHost;
-            const set<string>& clientVMs = g_clients[clientHost];
-            if (!clientVMs.empty()) {
-                return pair<string, string>(clientHost, *(clientVMs.begin()));
-            }
+    return client;
+}
+
+// Get the servers that could fit a workload in first-fit order.
+// Assumes g_mutex is held
+void getCandidateServers(vector<pair<string, string> >& servers, const WorkloadDemand& demand)
+{
+    if (!g_placement.getCandidateServers(servers, demand)) {
+        cerr << "Out of client machines" << endl;
+        exit(-1);
+    }
+}
+
+//
+// Manage replica updates
+//
+// Queue an update for all replicas.
+// Assumes g_mutex is held
+void addReplicaUpdate(const ReplicaUpdate& update)
+{
+    for (unsigned int index = 1; index < g_replicas.size(); index++) {
+        g_replicas[index].updates.push_back(update);
+    }
+    if (g_replicas.size() > 1) {
+        pthread_cond_broadcast(&g_replicaUpdateAvailable);
+    }
+}
+
+// Check if a replica has applied all of its updates.
+// Assumes g_mutex is held
+bool replicaUpToDate(unsigned int index)
+{
+    const ReplicaState& replica = g_replicas[index];
+    return replica.updates.empty() && !replica.busy;
+}
+
+// Add a workload to the primary and, if admitted, apply the primary's flow parameters to the replicas.
+// clientInfo is the workload to add to the primary, and replicaClientInfo is the workload to add to the replicas.
+// Assumes g_mutex is held
+bool commitAddClient(const Json::Value& clientInfo, const Json::Value& replicaClientInfo)
+{
+    TRACE_SPAN("commitAddClient");
+    ReplicaUpdate update;
+    update.type = REPLICA_APPLY_CLIENT;
+    Json::Value clientInfos(Json::arrayValue);
+    clientInfos.append(clientInfo);
+    if (!g_clnts[0]->addClients(clientInfos, g_fastFirstFit, update.flowParameters)) {
+        cerr << "Primary AdmissionController did not admit " << clientInfo["name"].asString() << endl;
+        return false;
+    }
+    update.info = replicaClientInfo;
+    addReplicaUpdate(update);
+    return true;
+}
+
+// Delete a workload from the primary and replicas.
+// Assumes g_mutex is held
+void commitDelClient(string name)
+{
+    g_clnts[0]->delClient(name);
+    ReplicaUpdate update;
+    update.type = REPLICA_DEL_CLIENT;
+    update.name = name;
+    addReplicaUpdate(update);
+}
+
+// Add a queue to the primary and replicas.
+// Assumes g_mutex is held
+void commitAddQueue(const Json::Value& queueInfo)
+{
+    g_clnts[0]->addQueue(queueInfo);
+    g_placement.addQueueCapacity(queueInfo);
+    ReplicaUpdate update;
+    update.type = REPLICA_ADD_QUEUE;
+    update.info = queueInfo;
+    addReplicaUpdate(update);
+}
+
+// Delete a queue from the primary and replicas.
+// Assumes g_mutex is held
+void commitDelQueue(string name)
+{
+    g_clnts[0]->delQueue(name);
+    g_placement.delQueueCapacity(name);
+    ReplicaUpdate update;
+    update.type = REPLICA_DEL_QUEUE;
+    update.name = name;
+    addReplicaUpdate(update);
+}
+
+// Applies updates to a replica in order.
+void* replicaThread(void* ptr)
+{
+    unsigned int index = static_cast<unsigned int>(reinterpret_cast<uintptr_t>(ptr));
+    AdmissionController_clnt* clnt = g_clnts[index];
+    pthread_mutex_lock(&g_mutex);
+    ReplicaState& replica = g_replicas[index];
+    while (true) {
+        while (replica.updates.empty()) {
+            pthread_cond_wait(&g_replicaUpdateAvailable, &g_mutex);
+        }
+        ReplicaUpdate update = replica.updates.front();
+        replica.updates.pop_front();
+        replica.busy = true;
+        pthread_mutex_unlock(&g_mutex);
+
+        switch (update.type) {
+            case REPLICA_APPLY_CLIENT:
+                {
+                    Json::Value clientInfos(Json::arrayValue);
+                    clientInfos.append(update.info);
+                    clnt->applyClients(clientInfos, update.flowParameters);
+                }
+                break;
+            case REPLICA_DEL_CLIENT:
+                clnt->delClient(update.name);
+                break;
+            case REPLICA_ADD_QUEUE:
+                clnt->addQueue(update.info);
+                break;
+            case REPLICA_DEL_QUEUE:
+                clnt->delQueue(update.name);
+                break;
+        }
+
+        pthread_mutex_lock(&g_mutex);
+        replica.busy = false;
+        if (replica.updates.empty()) {
+            pthread_cond_broadcast(&g_replicaUpToDate);
         }
     }
-    // Look for a client to use
-    unsigned int maxAvailableClients = 0;
-    for (map<string, set<string> >::const_iterator it3 = g_clients.begin(); it3 != g_clients.end(); it3++) {
-        if (it3->second.size() > maxAvailableClients) {
-            maxAvailableClients = it3->second.size();
-            clientHost = it3->first;
+    pthread_mutex_unlock(&g_mutex);
+    return NULL;
+}
+
+//
+// Manage batch placement
+//
+// Start placing a batch of workloads with the given long-term rates; the workloads must remain valid until endBatch.
+// Assumes g_mutex is held
+void beginBatch(const vector<Json::Value*>& batch, const vector<WorkloadDemand>& demands)
+{
+    assert(g_batch.empty());
+    assert(batch.size() == demands.size());
+    g_batch = batch;
+    g_batchDemands = demands;
+    for (unsigned int i = 0; i < batch.size(); i++) {
+        g_batchFingerprints.push_back(getWorkloadFingerprint(*batch[i]));
+    }
+    g_batchIndex = 0;
+}
+
+// Finish placing a batch of workloads and cancel its speculative tests.
+// Assumes g_mutex is held
+void endBatch()
+{
+    g_batch.clear();
+    g_batchFingerprints.clear();
+    g_batchDemands.clear();
+    g_batchIndex = 0;
+    g_batchNumber++;
+    g_speculativeQueue.clear();
+    g_nextSpeculativeIndex = 0;
+    g_speculativeAdmitted.clear();
+}
+
+// Queue speculative tests of the workloads following the current workload in the batch.
+// Tests that were already done on unchanged queues are skipped by the workers using the memoized results.
+// Assumes g_mutex is held
+void addSpeculativeWork()
+{
+    g_batchNumber++;
+    g_speculativeQueue.clear();
+    g_nextSpeculativeIndex = 0;
+    g_speculativeAdmitted.clear();
+    for (unsigned int batchIndex = g_batchIndex + 1; (batchIndex < g_batch.size()) && (batchIndex <= g_batchIndex + BATCH_LOOKAHEAD); batchIndex++) {
+        const Json::Value& clientInfo = *g_batch[batchIndex];
+        if (clientInfo.isMember("admitted") && clientInfo["admitted"].asBool()) {
+            continue;
+        }
+        SpeculativeWork work;
+        work.batchIndex = batchIndex;
+        vector<pair<string, string> > servers;
+        getCandidateServers(servers, g_batchDemands[batchIndex]);
+        for (unsigned int i = 0; i < servers.size(); i++) {
+            work.server = servers[i];
+            g_speculativeQueue.push_back(work);
         }
     }
-    if (maxAvailableClients <= 0) {
-        cerr << "Out of client machines" << endl;
-        exit(-1);
+}
+
+// Check if a speculative test is still needed.
+// Assumes g_mutex is held
+bool speculativeWorkNeeded(uint64_t batchNumber, unsigned int batchIndex)
+{
+    return (batchNumber == g_batchNumber) && (g_speculativeAdmitted.find(batchIndex) == g_speculativeAdmitted.end());
+}
+
+// Assumes g_mutex is held
+void speculativeWorkComplete(uint64_t batchNumber, unsigned int batchIndex, bool admitted)
+{
+    // Cancel remaining speculative work for the workload since the first fit is likely found
+    // Other policies need the headroom of every candidate server, so their work is not canceled
+    if ((g_placementPolicy == PLACEMENT_FIRST_FIT) && admitted && (batchNumber == g_batchNumber)) {
+        g_speculativeAdmitted.insert(batchIndex);
     }
-    return pair<string, string>(clientHost, *(g_clients[clientHost].begin()));
 }
 
 //
 // Manage placement work queue
 //
+// Get the next index in the work queue to test, or if there is none, the next index in the speculative queue.
+// Returns true for work queue indices and false for speculative queue indices.
 // Assumes g_mutex is held
-unsigned int nextWork()
+bool nextWork(unsigned int& index)
 {
-    while (g_nextWorkQueueIndex >= g_workQueue.size()) {
+    while (true) {
+        if (g_nextWorkQueueIndex < g_workQueue.size()) {
+            index = g_nextWorkQueueIndex;
+            g_nextWorkQueueIndex++;
+            g_outstandingWork++;
+            return true;
+        }
+        while (g_nextSpeculativeIndex < g_speculativeQueue.size()) {
+            index = g_nextSpeculativeIndex;
+            g_nextSpeculativeIndex++;
+            if (speculativeWorkNeeded(g_batchNumber, g_speculativeQueue[index].batchIndex)) {
+                return false;
+            }
+        }
         pthread_cond_wait(&g_workAvailable, &g_mutex);
     }
-    unsigned int workQueueIndex = g_nextWorkQueueIndex;
-    g_nextWorkQueueIndex++;
-    g_outstandingWork++;
-    return workQueueIndex;
+}
+
+// Check if an admitting server is better than the best server so far according to the placement policy.
+// Ties are broken by the lower index in first-fit order, so placements do not depend on the order tests complete.
+// Assumes g_mutex is held
+bool betterPlacement(unsigned int workQueueIndex, double headroom)
+{
+    if (g_bestWorkQueueIndex >= g_workQueue.size()) {
+        return true;
+    }
+    if ((g_placementPolicy == PLACEMENT_FIRST_FIT) || (headroom == g_bestHeadroom)) {
+        return workQueueIndex < g_bestWorkQueueIndex;
+    }
+    if (g_placementPolicy == PLACEMENT_BEST_FIT) {
+        return headroom < g_bestHeadroom;
+    }
+    return headroom > g_bestHeadroom;
 }
 
 // Assumes g_mutex is held
-void workComplete(unsigned int workQueueIndex, bool admitted)
+void workComplete(unsigned int workQueueIndex, bool admitted, double headroom)
 {
     g_outstandingWork--;
     if (admitted) {
         // Cancel remaining global work (optimization)
-        g_nextWorkQueueIndex = g_workQueue.size();
+        if (g_placementPolicy == PLACEMENT_FIRST_FIT) {
+            g_nextWorkQueueIndex = g_workQueue.size();
+        }
         // Track best placement
-        if (workQueueIndex < g_bestWorkQueueIndex) {
+        if (betterPlacement(workQueueIndex, headroom)) {
             g_bestWorkQueueIndex = workQueueIndex;
+            g_bestHeadroom = headroom;
         }
     }
     // Check if done with client
@@ -144,14 +430,51 @@ void workComplete(unsigned int workQueueIndex, bool admitted)
 
 void* workerThread(void* ptr)
 {
-    AdmissionController_clnt* clnt = static_cast<AdmissionController_clnt*>(ptr);
+    const ProbeConnection* connection = static_cast<const ProbeConnection*>(ptr);
+    AdmissionController_clnt* clnt = connection->clnt;
     pthread_mutex_lock(&g_mutex);
     while (true) {
-        unsigned int workQueueIndex = nextWork();
-        pair<string, string> server = g_workQueue[workQueueIndex];
+        unsigned int index;
+        bool speculative = !nextWork(index);
+        unsigned int workQueueIndex = index;
+        uint64_t batchNumber = g_batchNumber;
+        unsigned int batchIndex = 0;
+        pair<string, string> server;
+        const Json::Value* pClientInfo;
+        string fingerprint;
+        if (speculative) {
+            batchIndex = g_speculativeQueue[index].batchIndex;
+            server = g_speculativeQueue[index].server;
+            pClientInfo = g_batch[batchIndex];
+            fingerprint = g_batchFingerprints[batchIndex];
+        } else {
+            server = g_workQueue[workQueueIndex];
+            pClientInfo = g_currentClientInfo;
+            fingerprint = g_currentFingerprint;
+        }
         pair<string, string> client = clientServerPlacement(server.first);
+        // Reuse the result of testing the same workload on the same unchanged queues
+        vector<uint64_t> versions;
+        string probeKey = g_placement.getProbeKey(versions, fingerprint, client.first, server.first, server.second);
+        const ProbeResult* pProbeResult = g_placement.getProbeResult(probeKey, versions);
+        if (pProbeResult != NULL) {
+            if (speculative) {
+                speculativeWorkComplete(batchNumber, batchIndex, pProbeResult->admitted);
+            } else {
+                workComplete(workQueueIndex, pProbeResult->admitted, pProbeResult->headroom);
+            }
+            continue;
+        }
         // Make a copy of clientInfo
-        Json::Value clientInfo = *g_currentClientInfo;
+        Json::Value clientInfo = *pClientInfo;
+        string addrPrefix = g_currentAddrPrefix;
+        // Wait for replica to apply prior placements
+        while (!replicaUpToDate(connection->replicaIndex)) {
+            pthread_cond_wait(&g_replicaUpToDate, &g_mutex);
+        }
+        if (speculative && !speculativeWorkNeeded(batchNumber, batchIndex)) {
+            continue;
+        }
         pthread_mutex_unlock(&g_mutex);
 
         // Update client/server
@@ -160,45 +483,53 @@ void* workerThread(void* ptr)
         clientInfo["serverHost"] = Json::Value(server.first);
         clientInfo["serverVM"] = Json::Value(server.second);
         // Convert clientInfo using NC-ConfigGen
-        configGenClient(clientInfo, clientInfo["name"].asString(), g_currentAddrPrefix, false);
-        bool admitted = clnt->addClient(clientInfo, g_fastFirstFit);
-        if (admitted) {
-            clnt->delClient(clientInfo["name"].asString());
+        configGenClient(clientInfo, clientInfo["name"].asString(), addrPrefix, false);
+        bool admitted;
+        double headroom = 0;
+        if (g_placementPolicy == PLACEMENT_FIRST_FIT) {
+            admitted = clnt->probeClient(clientInfo, g_fastFirstFit);
+        } else {
+            headroom = clnt->headroomClient(clientInfo, g_fastFirstFit, 1, HEADROOM_MAX_SCALE, HEADROOM_TOLERANCE);
+            admitted = (headroom >= 1);
         }
 
         pthread_mutex_lock(&g_mutex);
-        workComplete(workQueueIndex, admitted);
+        g_placement.addProbeResult(probeKey, versions, admitted, headroom);
+        if (speculative) {
+            speculativeWorkComplete(batchNumber, batchIndex, admitted);
+        } else {
+            workComplete(workQueueIndex, admitted, headroom);
+        }
     }
     pthread_mutex_unlock(&g_mutex);
     return NULL;
 }
 
 // Decides which server VM to place a workload on.
+// clientInfo is the workload at g_batchIndex in the current batch, and the following workloads are tested speculatively.
 // Assumes called from single thread
 // Assumes g_mutex is held
 bool placeClient(Json::Value& clientInfo, string addrPrefix, bool enforce)
 {
+    TRACE_SPAN("placeClient");
+    assert((g_batchIndex < g_batch.size()) && (g_batch[g_batchIndex] == &clientInfo));
     assert(g_currentClientInfo == NULL);
     assert(g_currentAddrPrefix == "");
     assert(g_workQueue.empty());
     assert(g_nextWorkQueueIndex == 0);
     g_currentClientInfo = &clientInfo;
     g_currentAddrPrefix = addrPrefix;
+    g_currentFingerprint = getWorkloadFingerprint(clientInfo);
     // Check if admitted already
     if (clientInfo.isMember("admitted") && clientInfo["admitted"].asBool()) {
         g_workQueue.push_back(pair<string, string>(clientInfo["serverHost"].asString(), clientInfo["serverVM"].asString()));
         g_bestWorkQueueIndex = 0;
     } else {
-        // Add work in first fit order
-        for (map<string, set<string> >::const_iterator it = g_servers.begin(); it != g_servers.end(); it++) {
-            string serverHost = it->first;
-            const set<string>& serverVMs = it->second;
-            for (set<string>::const_iterator it2 = serverVMs.begin(); it2 != serverVMs.end(); it2++) {
-                string serverVM = *it2;
-                g_workQueue.push_back(pair<string, string>(serverHost, serverVM));
-            }
-        }
+        // Add work in first fit order (also used to break ties for other policies), skipping servers without the capacity for the workload
+        getCandidateServers(g_workQueue, g_batchDemands[g_batchIndex]);
         g_bestWorkQueueIndex = g_workQueue.size();
+        g_bestHeadroom = 0;
+        addSpeculativeWork();
         pthread_cond_broadcast(&g_workAvailable);
         // Wait for work to complete
         while ((g_outstandingWork > 0) || (g_nextWorkQueueIndex < g_workQueue.size())) {
@@ -222,18 +553,11 @@ bool placeClient(Json::Value& clientInfo, string addrPrefix, bool enforce)
             Json::Value clientInfoCopy = clientInfo;
             configGenClient(clientInfoCopy, clientName, addrPrefix, true);
             configGenClient(clientInfo, clientName, addrPrefix, false);
-            g_clnts[0]->addClient(clientInfoCopy, g_fastFirstFit);
+            commitAddClient(clientInfoCopy, clientInfo);
         } else {
             configGenClient(clientInfo, clientName, addrPrefix, false);
-            g_clnts[0]->addClient(clientInfo, g_fastFirstFit);
-        }
-        // Update all remaining clnts
-        for (unsigned int index = 1; index < g_clnts.size(); index++) {
-            g_clnts[index]->addClient(clientInfo, g_fastFirstFit);
+            commitAddClient(clientInfo, clientInfo);
         }
-        // Mark client as used
-        g_serverClientGrouping[server.first] = client.first;
-        g_clients[client.first].erase(client.second);
         // Add workload info
         WorkloadInfo workloadInfo;
         workloadInfo.name = clientName;
@@ -241,10 +565,11 @@ bool placeClient(Json::Value& clientInfo, string addrPrefix, bool enforce)
         workloadInfo.clientVM = client.second;
         workloadInfo.serverHost = server.first;
         workloadInfo.serverVM = server.second;
-        g_workloads.push_back(workloadInfo);
+        g_placement.addWorkload(workloadInfo, clientInfo);
     }
     g_currentClientInfo = NULL;
     g_currentAddrPrefix = "";
+    g_currentFingerprint = "";
     g_workQueue.clear();
     g_nextWorkQueueIndex = 0;
     return admitted;
@@ -254,19 +579,11 @@ bool placeClient(Json::Value& clientInfo, string addrPrefix, bool enforce)
 // Assumes g_mutex is held
 void removeClient(string clientName)
 {
-    for (list<WorkloadInfo>::iterator it = g_workloads.begin(); it != g_workloads.end(); it++) {
-        if (it->name == clientName) {
-            // Update clnts
-            for (unsigned int index = 0; index < g_clnts.size(); index++) {
-                g_clnts[index]->delClient(clientName);
-            }
-            // Mark client as unused
-            g_serverClientGrouping.erase(it->serverHost);
-            g_clients[it->clientHost].insert(it->clientVM);
-            // Remove workload info
-            g_workloads.erase(it);
-            break;
-        }
+    TRACE_SPAN("removeClient");
+    if (g_placement.getWorkload(clientName) != NULL) {
+        // Update AdmissionController servers
+        commitDelClient(clientName);
+        g_placement.removeWorkload(clientName);
     }
 }
 
@@ -274,6 +591,7 @@ void removeClient(string clientName)
 // Assumes RPCs are not multi-threaded
 PlacementAddClientsRes* placement_controller_add_clients_svc(PlacementAddClientsArgs* argp, struct svc_req* rqstp)
 {
+    TRACE_SPAN("AddClients RPC");
     static PlacementAddClientsRes result = {PLACEMENT_SUCCESS, false, {0, NULL}, {0, NULL}, {0, NULL}, {0, NULL}};
     // Parse input
     Json::Value clientInfos;
@@ -312,11 +630,19 @@ PlacementAddClientsRes* placement_controller_add_clients_svc(PlacementAddClients
     result.serverVMs.serverVMs_len = clientInfos.size();
     // Make placements
     result.admitted = true;
+    vector<Json::Value*> batch;
+    vector<WorkloadDemand> demands;
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        batch.push_back(&clientInfos[i]);
+        demands.push_back(getWorkloadDemand(clientInfos[i], addrPrefix));
+    }
     pthread_mutex_lock(&g_mutex);
+    beginBatch(batch, demands);
     for (unsigned int i = 0; i < clientInfos.size(); i++) {
         Json::Value& clientInfo = clientInfos[i];
+        g_batchIndex = i;
         if (placeClient(clientInfo, addrPrefix, enforce)) {
-            WorkloadInfo& workloadInfo = g_workloads.back();
+            const WorkloadInfo& workloadInfo = *g_placement.getWorkload(clientInfo["name"].asString());
             result.clientHosts.clientHosts_val[i] = new char[workloadInfo.clientHost.length() + 1];
             strcpy(result.clientHosts.clientHosts_val[i], workloadInfo.clientHost.c_str());
             result.clientVMs.clientVMs_val[i] = new char[workloadInfo.clientVM.length() + 1];
@@ -350,6 +676,102 @@ PlacementAddClientsRes* placement_controller_add_clients_svc(PlacementAddClients
             break;
         }
     }
+    endBatch();
+    pthread_mutex_unlock(&g_mutex);
+    result.status = PLACEMENT_SUCCESS;
+    return &result;
+}
+
+// Compare workloads by decreasing load
+struct DecreasingLoad {
+    const vector<double>& loads;
+    DecreasingLoad(const vector<double>& l) : loads(l) {}
+    bool operator()(unsigned int a, unsigned int b) const { return loads[a] > loads[b]; }
+};
+
+// PlaceClients RPC - performs placement on each workload in a set of workloads independently and adds admitted workloads to system.
+// Assumes RPCs are not multi-threaded
+PlacementPlaceClientsRes* placement_controller_place_clients_svc(PlacementPlaceClientsArgs* argp, struct svc_req* rqstp)
+{
+    TRACE_SPAN("PlaceClients RPC");
+    static PlacementPlaceClientsRes result = {PLACEMENT_SUCCESS, {0, NULL}, {0, NULL}, {0, NULL}, {0, NULL}, {0, NULL}};
+    // Delete old arrays
+    for (unsigned int i = 0; i < result.clientHosts.clientHosts_len; i++) {
+        delete[] result.clientHosts.clientHosts_val[i];
+        delete[] result.clientVMs.clientVMs_val[i];
+        delete[] result.serverHosts.serverHosts_val[i];
+        delete[] result.serverVMs.serverVMs_val[i];
+    }
+    delete[] result.admitted.admitted_val;
+    delete[] result.clientHosts.clientHosts_val;
+    delete[] result.clientVMs.clientVMs_val;
+    delete[] result.serverHosts.serverHosts_val;
+    delete[] result.serverVMs.serverVMs_val;
+    memset(&result, 0, sizeof(result));
+    // Parse input
+    Json::Value clientInfos;
+    if (!stringToJson(argp->clientInfos, clientInfos) || !clientInfos.isArray()) {
+        result.status = PLACEMENT_ERR_INVALID_ARGUMENT;
+        return &result;
+    }
+    string addrPrefix(argp->addrPrefix);
+    bool enforce = argp->enforce;
+    // Order workloads
+    vector<unsigned int> order;
+    vector<WorkloadDemand> demands;
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        order.push_back(i);
+        demands.push_back(getWorkloadDemand(clientInfos[i], addrPrefix));
+    }
+    if (argp->order == PLACEMENT_ORDER_DECREASING_LOAD) {
+        vector<double> loads;
+        for (unsigned int i = 0; i < clientInfos.size(); i++) {
+            loads.push_back(getClientLoad(demands[i].networkIn, demands[i].storage, demands[i].networkOut));
+        }
+        stable_sort(order.begin(), order.end(), DecreasingLoad(loads));
+    } else if (argp->order != PLACEMENT_ORDER_GIVEN) {
+        result.status = PLACEMENT_ERR_INVALID_ARGUMENT;
+        return &result;
+    }
+    // Create new result arrays
+    unsigned int numClients = clientInfos.size();
+    result.admitted.admitted_val = new bool_t[numClients];
+    result.admitted.admitted_len = numClients;
+    result.clientHosts.clientHosts_val = new char*[numClients];
+    result.clientHosts.clientHosts_len = numClients;
+    result.clientVMs.clientVMs_val = new char*[numClients];
+    result.clientVMs.clientVMs_len = numClients;
+    result.serverHosts.serverHosts_val = new char*[numClients];
+    result.serverHosts.serverHosts_len = numClients;
+    result.serverVMs.serverVMs_val = new char*[numClients];
+    result.serverVMs.serverVMs_len = numClients;
+    // Make placements
+    vector<Json::Value*> batch;
+    vector<WorkloadDemand> batchDemands;
+    for (unsigned int i = 0; i < numClients; i++) {
+        batch.push_back(&clientInfos[order[i]]);
+        batchDemands.push_back(demands[order[i]]);
+    }
+    pthread_mutex_lock(&g_mutex);
+    beginBatch(batch, batchDemands);
+    for (unsigned int i = 0; i < numClients; i++) {
+        unsigned int clientIndex = order[i];
+        g_batchIndex = i;
+        WorkloadInfo workloadInfo;
+        result.admitted.admitted_val[clientIndex] = placeClient(clientInfos[clientIndex], addrPrefix, enforce);
+        if (result.admitted.admitted_val[clientIndex]) {
+            workloadInfo = *g_placement.getWorkload(clientInfos[clientIndex]["name"].asString());
+        }
+        result.clientHosts.clientHosts_val[clientIndex] = new char[workloadInfo.clientHost.length() + 1];
+        strcpy(result.clientHosts.clientHosts_val[clientIndex], workloadInfo.clientHost.c_str());
+        result.clientVMs.clientVMs_val[clientIndex] = new char[workloadInfo.clientVM.length() + 1];
+        strcpy(result.clientVMs.clientVMs_val[clientIndex], workloadInfo.clientVM.c_str());
+        result.serverHosts.serverHosts_val[clientIndex] = new char[workloadInfo.serverHost.length() + 1];
+        strcpy(result.serverHosts.serverHosts_val[clientIndex], workloadInfo.serverHost.c_str());
+        result.serverVMs.serverVMs_val[clientIndex] = new char[workloadInfo.serverVM.length() + 1];
+        strcpy(result.serverVMs.serverVMs_val[clientIndex], workloadInfo.serverVM.c_str());
+    }
+    endBatch();
     pthread_mutex_unlock(&g_mutex);
     result.status = PLACEMENT_SUCCESS;
     return &result;
@@ -359,6 +781,7 @@ PlacementAddClientsRes* placement_controller_add_clients_svc(PlacementAddClients
 // Assumes RPCs are not multi-threaded
 PlacementDelClientsRes* placement_controller_del_clients_svc(PlacementDelClientsArgs* argp, struct svc_req* rqstp)
 {
+    TRACE_SPAN("DelClients RPC");
     static PlacementDelClientsRes result;
     pthread_mutex_lock(&g_mutex);
     for (unsigned int i = 0; i < argp->names.names_len; i++) {
@@ -381,36 +804,19 @@ PlacementAddClientVMRes* placement_controller_add_client_vm_svc(PlacementAddClie
 
     pthread_mutex_lock(&g_mutex);
     // Check if clientHost does not exist
-    map<string, set<string> >::iterator it = g_clients.find(clientHost);
-    if (it == g_clients.end()) {
+    if (!g_placement.hasClientHost(clientHost)) {
         // Add network queues to AdmissionController
-        for (unsigned int index = 0; index < g_clnts.size(); index++) {
-            Json::Value queueInInfo;
-            configGenNetworkInQueue(queueInInfo, clientHost);
-            g_clnts[index]->addQueue(queueInInfo);
-            Json::Value queueOutInfo;
-            configGenNetworkOutQueue(queueOutInfo, clientHost);
-            g_clnts[index]->addQueue(queueOutInfo);
-        }
+        Json::Value queueInInfo;
+        configGenNetworkInQueue(queueInInfo, clientHost);
+        commitAddQueue(queueInInfo);
+        Json::Value queueOutInfo;
+        configGenNetworkOutQueue(queueOutInfo, clientHost);
+        commitAddQueue(queueOutInfo);
+        g_placement.updateHostQueueVersions(clientHost);
     }
-    // Check if clientVM does not exist (unused)
-    set<string>& clientVMs = g_clients[clientHost];
-    set<string>::const_iterator it2 = clientVMs.find(clientVM);
-    if (it2 == clientVMs.end()) {
-        // Check if clientVM does not exist (in use)
-        list<WorkloadInfo>::const_iterator it3 = g_workloads.begin();
-        while (it3 != g_workloads.end()) {
-            if ((it3->clientHost == clientHost) && (it3->clientVM == clientVM)) {
-                break;
-            }
-            it3++;
-        }
-        if (it3 == g_workloads.end()) {
-            clientVMs.insert(clientVM);
-            result.status = PLACEMENT_SUCCESS;
-        } else {
-            result.status = PLACEMENT_ERR_CLIENT_VM_ALREADY_EXISTS;
-        }
+    // Check if clientVM does not exist (unused or in use)
+    if (g_placement.addClientVM(clientHost, clientVM)) {
+        result.status = PLACEMENT_SUCCESS;
     } else {
         result.status = PLACEMENT_ERR_CLIENT_VM_ALREADY_EXISTS;
     }
@@ -427,36 +833,17 @@ PlacementDelClientVMRes* placement_controller_del_client_vm_svc(PlacementDelClie
     string clientVM(argp->clientVM);
 
     pthread_mutex_lock(&g_mutex);
-    // Check if clientHost exists
-    map<string, set<string> >::iterator it = g_clients.find(clientHost);
-    if (it != g_clients.end()) {
-        // Check if clientVM exists
-        set<string>& clientVMs = it->second;
-        set<string>::const_iterator it2 = clientVMs.find(clientVM);
-        if (it2 != clientVMs.end()) {
-            clientVMs.erase(it2);
-            // Check if clientHost has no VMs and is not in use
-            if (clientVMs.empty()) {
-                list<WorkloadInfo>::const_iterator it3 = g_workloads.begin();
-                while (it3 != g_workloads.end()) {
-                    if (it3->clientHost == clientHost) {
-                        break;
-                    }
-                    it3++;
-                }
-                if (it3 == g_workloads.end()) {
-                    // Remove network queues from AdmissionController
-                    for (unsigned int index = 0; index < g_clnts.size(); index++) {
-                        g_clnts[index]->delQueue(getQueueInName(clientHost));
-                        g_clnts[index]->delQueue(getQueueOutName(clientHost));
-                    }
-                    g_clients.erase(it);
-                }
-            }
-            result.status = PLACEMENT_SUCCESS;
-        } else {
-            result.status = PLACEMENT_ERR_CLIENT_VM_NONEXISTENT;
+    // Check if clientVM exists
+    if (g_placement.delClientVM(clientHost, clientVM)) {
+        // Check if clientHost has no VMs and is not in use
+        if (g_placement.clientHostUnused(clientHost)) {
+            // Remove network queues from AdmissionController
+            commitDelQueue(getQueueInName(clientHost));
+            commitDelQueue(getQueueOutName(clientHost));
+            g_placement.updateHostQueueVersions(clientHost);
+            g_placement.delClientHost(clientHost);
         }
+        result.status = PLACEMENT_SUCCESS;
     } else {
         result.status = PLACEMENT_ERR_CLIENT_VM_NONEXISTENT;
     }
@@ -474,29 +861,23 @@ PlacementAddServerVMRes* placement_controller_add_server_vm_svc(PlacementAddServ
 
     pthread_mutex_lock(&g_mutex);
     // Check if serverHost does not exist
-    map<string, set<string> >::iterator it = g_servers.find(serverHost);
-    if (it == g_servers.end()) {
+    if (!g_placement.hasServerHost(serverHost)) {
         // Add network queues to AdmissionController
-        for (unsigned int index = 0; index < g_clnts.size(); index++) {
-            Json::Value queueInInfo;
-            configGenNetworkInQueue(queueInInfo, serverHost);
-            g_clnts[index]->addQueue(queueInInfo);
-            Json::Value queueOutInfo;
-            configGenNetworkOutQueue(queueOutInfo, serverHost);
-            g_clnts[index]->addQueue(queueOutInfo);
-        }
+        Json::Value queueInInfo;
+        configGenNetworkInQueue(queueInInfo, serverHost);
+        commitAddQueue(queueInInfo);
+        Json::Value queueOutInfo;
+        configGenNetworkOutQueue(queueOutInfo, serverHost);
+        commitAddQueue(queueOutInfo);
+        g_placement.updateHostQueueVersions(serverHost);
     }
     // Check if serverVM does not exist
-    set<string>& serverVMs = g_servers[serverHost];
-    set<string>::const_iterator it2 = serverVMs.find(serverVM);
-    if (it2 == serverVMs.end()) {
+    if (!g_placement.hasServerVM(serverHost, serverVM)) {
         // Add storage queue to AdmissionController
-        for (unsigned int index = 0; index < g_clnts.size(); index++) {
-            Json::Value queueStorageInfo;
-            configGenStorageQueue(queueStorageInfo, getServerName(serverHost, serverVM));
-            g_clnts[index]->addQueue(queueStorageInfo);
-        }
-        serverVMs.insert(serverVM);
+        Json::Value queueStorageInfo;
+        configGenStorageQueue(queueStorageInfo, getServerName(serverHost, serverVM));
+        commitAddQueue(queueStorageInfo);
+        g_placement.addServerVM(serverHost, serverVM);
         result.status = PLACEMENT_SUCCESS;
     } else {
         result.status = PLACEMENT_ERR_SERVER_VM_ALREADY_EXISTS;
@@ -514,41 +895,22 @@ PlacementDelServerVMRes* placement_controller_del_server_vm_svc(PlacementDelServ
     string serverVM(argp->serverVM);
 
     pthread_mutex_lock(&g_mutex);
-    // Check if serverHost exists
-    map<string, set<string> >::iterator it = g_servers.find(serverHost);
-    if (it != g_servers.end()) {
-        // Check if serverVM exists
-        set<string>& serverVMs = it->second;
-        set<string>::const_iterator it2 = serverVMs.find(serverVM);
-        if (it2 != serverVMs.end()) {
-            // Check if server is not in use
-            list<WorkloadInfo>::const_iterator it3 = g_workloads.begin();
-            while (it3 != g_workloads.end()) {
-                if ((it3->serverHost == serverHost) && (it3->serverVM == serverVM)) {
-                    break;
-                }
-                it3++;
-            }
-            if (it3 == g_workloads.end()) {
-                // Remove storage queue from AdmissionController
-                for (unsigned int index = 0; index < g_clnts.size(); index++) {
-                    g_clnts[index]->delQueue(getServerName(serverHost, serverVM));
-                }
-                serverVMs.erase(it2);
-                if (serverVMs.empty()) {
-                    // Remove network queues from AdmissionController
-                    for (unsigned int index = 0; index < g_clnts.size(); index++) {
-                        g_clnts[index]->delQueue(getQueueInName(serverHost));
-                        g_clnts[index]->delQueue(getQueueOutName(serverHost));
-                    }
-                    g_servers.erase(it);
-                }
-                result.status = PLACEMENT_SUCCESS;
-            } else {
-                result.status = PLACEMENT_ERR_SERVER_VM_IN_USE;
+    // Check if serverVM exists
+    if (g_placement.hasServerVM(serverHost, serverVM)) {
+        // Check if server is not in use
+        if (!g_placement.serverVMInUse(serverHost, serverVM)) {
+            // Remove storage queue from AdmissionController
+            bool serverHostEmpty = g_placement.delServerVM(serverHost, serverVM);
+            commitDelQueue(getServerName(serverHost, serverVM));
+            if (serverHostEmpty) {
+                // Remove network queues from AdmissionController
+                commitDelQueue(getQueueInName(serverHost));
+                commitDelQueue(getQueueOutName(serverHost));
+                g_placement.updateHostQueueVersions(serverHost);
             }
+            result.status = PLACEMENT_SUCCESS;
         } else {
-            result.status = PLACEMENT_ERR_SERVER_VM_NONEXISTENT;
+            result.status = PLACEMENT_ERR_SERVER_VM_IN_USE;
         }
     } else {
         result.status = PLACEMENT_ERR_SERVER_VM_NONEXISTENT;
@@ -567,6 +929,7 @@ void placement_controller_program(struct svc_req* rqstp, register SVCXPRT* trans
         PlacementDelClientVMArgs placement_controller_del_client_vm_arg;
         PlacementAddServerVMArgs placement_controller_add_server_vm_arg;
         PlacementDelServerVMArgs placement_controller_del_server_vm_arg;
+        PlacementPlaceClientsArgs placement_controller_place_clients_arg;
     } argument;
     char* result;
     xdrproc_t _xdr_argument, _xdr_result;
@@ -613,6 +976,12 @@ void placement_controller_program(struct svc_req* rqstp, register SVCXPRT* trans
             local = (char* (*)(char*, struct svc_req*))placement_controller_del_server_vm_svc;
             break;
 
+        case PLACEMENT_CONTROLLER_PLACE_CLIENTS:
+            _xdr_argument = (xdrproc_t)xdr_PlacementPlaceClientsArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementPlaceClientsRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_place_clients_svc;
+            break;
+
         default:
             svcerr_noproc(transp);
             return;
@@ -634,17 +1003,36 @@ void placement_controller_program(struct svc_req* rqstp, register SVCXPRT* trans
 int main(int argc, char** argv)
 {
     int opt = 0;
+    vector<string> admissionControllerAddrs;
+    unsigned int numConnections = 1;
+    bool validPolicy = true;
     do {
-        opt = getopt(argc, argv, "a:f");
+        opt = getopt(argc, argv, "a:fn:p:");
         switch (opt) {
             case 'a':
-                g_clnts.push_back(new AdmissionController_clnt(optarg));
+                admissionControllerAddrs.push_back(optarg);
                 break;
 
             case 'f':
                 g_fastFirstFit = true;
                 break;
 
+            case 'n':
+                numConnections = atoi(optarg);
+                break;
+
+            case 'p':
+                if (string(optarg) == "first") {
+                    g_placementPolicy = PLACEMENT_FIRST_FIT;
+                } else if (string(optarg) == "best") {
+                    g_placementPolicy = PLACEMENT_BEST_FIT;
+                } else if (string(optarg) == "balanced") {
+                    g_placementPolicy = PLACEMENT_BALANCED;
+                } else {
+                    validPolicy = false;
+                }
+                break;
+
             case -1:
                 break;
 
@@ -653,10 +1041,22 @@ int main(int argc, char** argv)
         }
     } while (opt != -1);
 
-    if (g_clnts.empty()) {
-        cout << "Usage: " << argv[0] << " -a AdmissionControllerAddr [-a AdmissionControllerAddr ...] [-f]" << endl;
+    if (admissionControllerAddrs.empty() || (numConnections == 0) || !validPolicy) {
+        cout << "Usage: " << argv[0] << " -a AdmissionControllerAddr [-a AdmissionControllerAddr ...] [-f] [-n numConnections] [-p first|best|balanced]" << endl;
         return -1;
     }
+    for (unsigned int i = 0; i < admissionControllerAddrs.size(); i++) {
+        g_clnts.push_back(new AdmissionController_clnt(admissionControllerAddrs[i]));
+        for (unsigned int j = 0; j < numConnections; j++) {
+            ProbeConnection connection;
+            connection.clnt = new AdmissionController_clnt(admissionControllerAddrs[i]);
+            connection.replicaIndex = i;
+            g_probeConnections.push_back(connection);
+        }
+    }
+    ReplicaState replicaState;
+    replicaState.busy = false;
+    g_replicas.resize(g_clnts.size(), replicaState);
 
     // Unregister PlacementController RPC handlers
     pmap_unset(PLACEMENT_CONTROLLER_PROGRAM, PLACEMENT_CONTROLLER_V1);
@@ -677,22 +1077,41 @@ int main(int argc, char** argv)
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-    pthread_t* threadArray = new pthread_t[g_clnts.size()];
-    for (unsigned int i = 0; i < g_clnts.size(); i++) {
+    pthread_t* threadArray = new pthread_t[g_probeConnections.size()];
+    for (unsigned int i = 0; i < g_probeConnections.size(); i++) {
         int rc = pthread_create(&threadArray[i],
                                 &attr,
                                 workerThread,
-                                reinterpret_cast<void*>(g_clnts[i]));
+                                reinterpret_cast<void*>(&g_probeConnections[i]));
+        if (rc) {
+            cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+            exit(-1);
+        }
+    }
+    // Create replica threads
+    pthread_t* replicaThreadArray = new pthread_t[g_clnts.size()];
+    for (unsigned int i = 1; i < g_clnts.size(); i++) {
+        int rc = pthread_create(&replicaThreadArray[i],
+                                &attr,
+                                replicaThread,
+                                reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
         if (rc) {
             cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
             exit(-1);
         }
     }
 
+    // Dump tracing spans on SIGUSR2 (see common/SpanTrace.hpp)
+    TRACE_DUMP_ON_SIGNAL(SIGUSR2, "PlacementController");
+
     // Run proxy
     svc_run();
     cerr << "svc_run returned" << endl;
     delete[] threadArray;
+    delete[] replicaThreadArray;
+    for (unsigned int i = 0; i < g_probeConnections.size(); i++) {
+        delete g_probeConnections[i].clnt;
+    }
     for (unsigned int i = 0; i < g_clnts.size(); i++) {
         delete g_clnts[i];
     }
@@ -0,0 +1,477 @@
+// PlacementState.cpp - Code for the placement decisions shared by the PlacementController and PlacementReplay.
+// See PlacementState.hpp for details.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <algorithm>
+#include <vector>
+#include <list>
+#include <set>
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <json/json.h>
+#include "../common/serializeJSON.hpp"
+#include "../common/SpanTrace.hpp"
+#include "../DNC-Library/NCConfig.hpp"
+#include "PlacementState.hpp"
+
+using namespace std;
+
+// Maximum number of memoized probe results
+#define PROBE_CACHE_SIZE 100000
+
+// Get the bounds on the rate limits of a workload's flows.
+WorkloadDemand getWorkloadDemand(const Json::Value& clientInfo, string addrPrefix)
+{
+    WorkloadDemand demand;
+    getClientFlowBounds(clientInfo, addrPrefix, demand.networkIn, demand.storage, demand.networkOut);
+    demand.SLO = clientInfo["SLO"].asDouble();
+    return demand;
+}
+
+// Get a workload's configuration, excluding its name and placement, which do not affect admission.
+string getWorkloadFingerprint(const Json::Value& clientInfo)
+{
+    Json::Value fingerprint = clientInfo;
+    fingerprint.removeMember("name");
+    fingerprint.removeMember("admitted");
+    fingerprint.removeMember("clientHost");
+    fingerprint.removeMember("clientVM");
+    fingerprint.removeMember("serverHost");
+    fingerprint.removeMember("serverVM");
+    Json::FastWriter writer;
+    return writer.write(fingerprint);
+}
+
+// Get the queues used by a workload placed on the given client/server.
+vector<string> getWorkloadQueues(string clientHost, string serverHost, string serverVM)
+{
+    vector<string> queues;
+    queues.push_back(getServerName(serverHost, serverVM));
+    queues.push_back(getQueueInName(serverHost));
+    queues.push_back(getQueueOutName(serverHost));
+    queues.push_back(getQueueInName(clientHost));
+    queues.push_back(getQueueOutName(clientHost));
+    return queues;
+}
+
+// Get the largest rate bound that fits in a queue.
+// Sums of rate limits are able to use up to the full bandwidth, so only rates exceeding the bandwidth are pruned.
+static double remainingRate(const QueueCapacity& capacity)
+{
+    return 1.000001 * capacity.bandwidth - capacity.rate; // allow for rounding errors
+}
+
+PlacementState::PlacementState()
+    : _lastVersion(0)
+{
+}
+
+//
+// Manage workload and client VM indexes
+//
+void PlacementState::removeHostWorkload(map<string, WorkloadList>& hostWorkloads, string host, list<WorkloadInfo>::iterator workload)
+{
+    map<string, WorkloadList>::iterator it = hostWorkloads.find(host);
+    if (it != hostWorkloads.end()) {
+        it->second.remove(workload);
+        if (it->second.empty()) {
+            hostWorkloads.erase(it);
+        }
+    }
+}
+
+bool PlacementState::hostInUse(const map<string, WorkloadList>& hostWorkloads, string host, string VM, bool isServer)
+{
+    map<string, WorkloadList>::const_iterator it = hostWorkloads.find(host);
+    if (it == hostWorkloads.end()) {
+        return false;
+    }
+    if (VM.empty()) {
+        return true;
+    }
+    for (WorkloadList::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
+        if ((isServer ? (*it2)->serverVM : (*it2)->clientVM) == VM) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PlacementState::addFreeClientVM(string clientHost, string clientVM)
+{
+    set<string>& clientVMs = _clients[clientHost];
+    _clientHostsByFreeVMs.erase(make_pair(-static_cast<int>(clientVMs.size()), clientHost));
+    clientVMs.insert(clientVM);
+    _clientHostsByFreeVMs.insert(make_pair(-static_cast<int>(clientVMs.size()), clientHost));
+}
+
+void PlacementState::removeFreeClientVM(string clientHost, string clientVM)
+{
+    set<string>& clientVMs = _clients[clientHost];
+    _clientHostsByFreeVMs.erase(make_pair(-static_cast<int>(clientVMs.size()), clientHost));
+    clientVMs.erase(clientVM);
+    _clientHostsByFreeVMs.insert(make_pair(-static_cast<int>(clientVMs.size()), clientHost));
+}
+
+bool PlacementState::addClientVM(string clientHost, string clientVM)
+{
+    const set<string>& clientVMs = _clients[clientHost];
+    if ((clientVMs.find(clientVM) != clientVMs.end()) || hostInUse(_clientHostWorkloads, clientHost, clientVM, false)) {
+        return false;
+    }
+    addFreeClientVM(clientHost, clientVM);
+    return true;
+}
+
+bool PlacementState::delClientVM(string clientHost, string clientVM)
+{
+    map<string, set<string> >::const_iterator it = _clients.find(clientHost);
+    if ((it == _clients.end()) || (it->second.find(clientVM) == it->second.end())) {
+        return false;
+    }
+    removeFreeClientVM(clientHost, clientVM);
+    return true;
+}
+
+bool PlacementState::clientHostUnused(string clientHost) const
+{
+    map<string, set<string> >::const_iterator it = _clients.find(clientHost);
+    return (it != _clients.end()) && it->second.empty() && !hostInUse(_clientHostWorkloads, clientHost, "", false);
+}
+
+void PlacementState::delClientHost(string clientHost)
+{
+    map<string, set<string> >::iterator it = _clients.find(clientHost);
+    if (it != _clients.end()) {
+        _clientHostsByFreeVMs.erase(make_pair(-static_cast<int>(it->second.size()), it->first));
+        _clients.erase(it);
+    }
+}
+
+//
+// Manage server VMs
+//
+bool PlacementState::hasServerVM(string serverHost, string serverVM) const
+{
+    map<string, set<string> >::const_iterator it = _servers.find(serverHost);
+    return (it != _servers.end()) && (it->second.find(serverVM) != it->second.end());
+}
+
+void PlacementState::addServerVM(string serverHost, string serverVM)
+{
+    // Add the server VM's storage queue to the capacity index
+    string queueName = getServerName(serverHost, serverVM);
+    const QueueCapacity& capacity = _queueCapacities[queueName];
+    _storageCapacityIndexEntries[queueName] = _storageCapacityIndex.insert(make_pair(remainingRate(capacity), make_pair(serverHost, serverVM)));
+    updateQueueVersions(vector<string>(), serverHost, serverVM);
+    _servers[serverHost].insert(serverVM);
+}
+
+bool PlacementState::delServerVM(string serverHost, string serverVM)
+{
+    // Remove the server VM's storage queue from the capacity index
+    map<string, CapacityIndex::iterator>::iterator it = _storageCapacityIndexEntries.find(getServerName(serverHost, serverVM));
+    if (it != _storageCapacityIndexEntries.end()) {
+        _storageCapacityIndex.erase(it->second);
+        _storageCapacityIndexEntries.erase(it);
+    }
+    updateQueueVersions(vector<string>(), serverHost, serverVM);
+    map<string, set<string> >::iterator it2 = _servers.find(serverHost);
+    if (it2 == _servers.end()) {
+        return false;
+    }
+    it2->second.erase(serverVM);
+    if (!it2->second.empty()) {
+        return false;
+    }
+    _servers.erase(it2);
+    return true;
+}
+
+//
+// Manage capacity pruning
+//
+void PlacementState::addQueueCapacity(const Json::Value& queueInfo)
+{
+    QueueCapacity& capacity = _queueCapacities[queueInfo["name"].asString()];
+    capacity.bandwidth = queueInfo["bandwidth"].asDouble();
+    capacity.rate = 0;
+    capacity.burst = 0;
+    capacity.SLOs.clear();
+}
+
+void PlacementState::delQueueCapacity(string name)
+{
+    _queueCapacities.erase(name);
+}
+
+const QueueCapacity* PlacementState::getQueueCapacity(string name) const
+{
+    map<string, QueueCapacity>::const_iterator it = _queueCapacities.find(name);
+    return (it != _queueCapacities.end()) ? &it->second : NULL;
+}
+
+void PlacementState::updateQueueLoad(string queueName, const FlowBounds& bounds, double SLO, bool add)
+{
+    map<string, QueueCapacity>::iterator it = _queueCapacities.find(queueName);
+    if (it == _queueCapacities.end()) {
+        return;
+    }
+    QueueCapacity& capacity = it->second;
+    if (add) {
+        capacity.rate += bounds.rate;
+        capacity.burst += bounds.burst;
+        capacity.SLOs.insert(SLO);
+    } else {
+        capacity.rate -= bounds.rate;
+        capacity.burst -= bounds.burst;
+        multiset<double>::iterator it2 = capacity.SLOs.find(SLO);
+        if (it2 != capacity.SLOs.end()) {
+            capacity.SLOs.erase(it2);
+        }
+    }
+    map<string, CapacityIndex::iterator>::iterator it3 = _storageCapacityIndexEntries.find(queueName);
+    if (it3 != _storageCapacityIndexEntries.end()) {
+        pair<string, string> server = it3->second->second;
+        _storageCapacityIndex.erase(it3->second);
+        it3->second = _storageCapacityIndex.insert(make_pair(remainingRate(capacity), server));
+    }
+}
+
+bool PlacementState::queueFits(string queueName, const FlowBounds& bounds, double SLO) const
+{
+    if ((bounds.rate <= 0) && (bounds.burst <= 0)) {
+        return true;
+    }
+    map<string, QueueCapacity>::const_iterator it = _queueCapacities.find(queueName);
+    if (it == _queueCapacities.end()) {
+        return true;
+    }
+    const QueueCapacity& capacity = it->second;
+    if (bounds.rate > remainingRate(capacity)) {
+        return false;
+    }
+    // The lowest priority flow waits for the bursts of all flows
+    double maxSLO = capacity.SLOs.empty() ? SLO : max(SLO, *capacity.SLOs.rbegin());
+    return (capacity.burst + bounds.burst <= 1.000001 * capacity.bandwidth * maxSLO);
+}
+
+//
+// Placement decisions
+//
+bool PlacementState::clientServerPlacement(string serverHost, pair<string, string>& client) const
+{
+    map<string, string>::const_iterator it = _serverClientGrouping.find(serverHost);
+    if (it != _serverClientGrouping.end()) {
+        map<string, set<string> >::const_iterator clientIt = _clients.find(it->second);
+        if ((clientIt != _clients.end()) && !clientIt->second.empty()) {
+            client = make_pair(clientIt->first, *(clientIt->second.begin()));
+            return true;
+        }
+    }
+    // Check for other workloads using server
+    map<string, WorkloadList>::const_iterator it2 = _serverHostWorkloads.find(serverHost);
+    if (it2 != _serverHostWorkloads.end()) {
+        for (WorkloadList::const_iterator it3 = it2->second.begin(); it3 != it2->second.end(); it3++) {
+            map<string, set<string> >::const_iterator clientIt = _clients.find((*it3)->clientHost);
+            if ((clientIt != _clients.end()) && !clientIt->second.empty()) {
+                client = make_pair(clientIt->first, *(clientIt->second.begin()));
+                return true;
+            }
+        }
+    }
+    // Look for the client with the most available VMs
+    if (_clientHostsByFreeVMs.empty() || (_clientHostsByFreeVMs.begin()->first >= 0)) {
+        return false;
+    }
+    string clientHost = _clientHostsByFreeVMs.begin()->second;
+    client = make_pair(clientHost, *(_clients.find(clientHost)->second.begin()));
+    return true;
+}
+
+bool PlacementState::getCandidateServers(vector<pair<string, string> >& servers, const WorkloadDemand& demand) const
+{
+    TRACE_SPAN("getCandidateServers");
+    servers.clear();
+    CapacityIndex::const_iterator begin = (demand.storage.rate > 0) ? _storageCapacityIndex.lower_bound(demand.storage.rate) : _storageCapacityIndex.begin();
+    for (CapacityIndex::const_iterator it = begin; it != _storageCapacityIndex.end(); it++) {
+        const pair<string, string>& server = it->second;
+        if (!queueFits(getServerName(server.first, server.second), demand.storage, demand.SLO) ||
+            !queueFits(getQueueInName(server.first), demand.networkIn, demand.SLO) ||
+            !queueFits(getQueueOutName(server.first), demand.networkOut, demand.SLO)) {
+            continue;
+        }
+        pair<string, string> client;
+        if (!clientServerPlacement(server.first, client)) {
+            return false;
+        }
+        if (!queueFits(getQueueOutName(client.first), demand.networkIn, demand.SLO) ||
+            !queueFits(getQueueInName(client.first), demand.networkOut, demand.SLO)) {
+            continue;
+        }
+        servers.push_back(server);
+    }
+    sort(servers.begin(), servers.end());
+    return true;
+}
+
+//
+// Manage workloads
+//
+void PlacementState::addWorkload(WorkloadInfo& workloadInfo, const Json::Value& clientInfo)
+{
+    // Add the bounds of the workload's flows to the load of its queues
+    workloadInfo.SLO = clientInfo["SLO"].asDouble();
+    workloadInfo.queueLoads.clear();
+    const Json::Value& clientFlows = clientInfo["flows"];
+    for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+        const Json::Value& flowInfo = clientFlows[flowIndex];
+        Curve arrivalCurve;
+        deserializeJSON(flowInfo, "arrivalInfo", arrivalCurve);
+        FlowBounds bounds = getFlowBounds(arrivalCurve);
+        const Json::Value& flowQueues = flowInfo["queues"];
+        for (unsigned int index = 0; index < flowQueues.size(); index++) {
+            string queueName = flowQueues[index].asString();
+            updateQueueLoad(queueName, bounds, workloadInfo.SLO, true);
+            workloadInfo.queueLoads.push_back(make_pair(queueName, bounds));
+        }
+    }
+    // Mark client as used
+    _serverClientGrouping[workloadInfo.serverHost] = workloadInfo.clientHost;
+    removeFreeClientVM(workloadInfo.clientHost, workloadInfo.clientVM);
+    // Add workload info and indexes
+    list<WorkloadInfo>::iterator it = _workloads.insert(_workloads.end(), workloadInfo);
+    _workloadsByName[it->name] = it;
+    _serverHostWorkloads[it->serverHost].push_back(it);
+    _clientHostWorkloads[it->clientHost].push_back(it);
+    updateWorkloadQueueVersions(it->clientHost, it->serverHost, it->serverVM);
+}
+
+bool PlacementState::removeWorkload(string name)
+{
+    map<string, list<WorkloadInfo>::iterator>::iterator indexIt = _workloadsByName.find(name);
+    if (indexIt == _workloadsByName.end()) {
+        return false;
+    }
+    list<WorkloadInfo>::iterator it = indexIt->second;
+    updateWorkloadQueueVersions(it->clientHost, it->serverHost, it->serverVM);
+    // Remove the bounds of the workload's flows from the load of its queues
+    for (unsigned int i = 0; i < it->queueLoads.size(); i++) {
+        updateQueueLoad(it->queueLoads[i].first, it->queueLoads[i].second, it->SLO, false);
+    }
+    // Mark client as unused
+    _serverClientGrouping.erase(it->serverHost);
+    addFreeClientVM(it->clientHost, it->clientVM);
+    // Remove workload info and indexes
+    _workloadsByName.erase(indexIt);
+    removeHostWorkload(_serverHostWorkloads, it->serverHost, it);
+    removeHostWorkload(_clientHostWorkloads, it->clientHost, it);
+    _workloads.erase(it);
+    return true;
+}
+
+const WorkloadInfo* PlacementState::getWorkload(string name) const
+{
+    map<string, list<WorkloadInfo>::iterator>::const_iterator it = _workloadsByName.find(name);
+    return (it != _workloadsByName.end()) ? &*(it->second) : NULL;
+}
+
+//
+// Manage probe memoization
+//
+// Called when a workload using the queues is added or removed, since that can change the admission result of any workload in the group.
+// Workloads sharing a queue share a host, so the group is found by a breadth-first search over the hosts of connected workloads.
+void PlacementState::updateQueueVersions(const vector<string>& hosts, string serverHost, string serverVM)
+{
+    set<string> groupQueues;
+    set<string> visitedHosts;
+    vector<string> pendingHosts(hosts);
+    if (!serverHost.empty()) {
+        groupQueues.insert(getServerName(serverHost, serverVM));
+        // Workloads using the server queue connect it to their hosts
+        map<string, WorkloadList>::const_iterator it = _serverHostWorkloads.find(serverHost);
+        if (it != _serverHostWorkloads.end()) {
+            for (WorkloadList::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
+                if ((*it2)->serverVM == serverVM) {
+                    pendingHosts.push_back((*it2)->serverHost);
+                    pendingHosts.push_back((*it2)->clientHost);
+                }
+            }
+        }
+    }
+    for (unsigned int i = 0; i < pendingHosts.size(); i++) {
+        string host = pendingHosts[i];
+        if (!visitedHosts.insert(host).second) {
+            continue;
+        }
+        groupQueues.insert(getQueueInName(host));
+        groupQueues.insert(getQueueOutName(host));
+        // Workloads using the host's network queues connect them to the workloads' other queues
+        const map<string, WorkloadList>* hostWorkloads[] = {&_serverHostWorkloads, &_clientHostWorkloads};
+        for (unsigned int j = 0; j < 2; j++) {
+            map<string, WorkloadList>::const_iterator it = hostWorkloads[j]->find(host);
+            if (it == hostWorkloads[j]->end()) {
+                continue;
+            }
+            for (WorkloadList::const_iterator it2 = it->second.begin(); it2 != it->second.end(); it2++) {
+                const WorkloadInfo& workload = **it2;
+                groupQueues.insert(getServerName(workload.serverHost, workload.serverVM));
+                if (visitedHosts.find(workload.serverHost) == visitedHosts.end()) {
+                    pendingHosts.push_back(workload.serverHost);
+                }
+                if (visitedHosts.find(workload.clientHost) == visitedHosts.end()) {
+                    pendingHosts.push_back(workload.clientHost);
+                }
+            }
+        }
+    }
+    _lastVersion++;
+    for (set<string>::const_iterator it = groupQueues.begin(); it != groupQueues.end(); it++) {
+        _queueVersions[*it] = _lastVersion;
+    }
+}
+
+void PlacementState::updateWorkloadQueueVersions(string clientHost, string serverHost, string serverVM)
+{
+    vector<string> hosts;
+    hosts.push_back(clientHost);
+    hosts.push_back(serverHost);
+    updateQueueVersions(hosts, serverHost, serverVM);
+}
+
+void PlacementState::updateHostQueueVersions(string host)
+{
+    updateQueueVersions(vector<string>(1, host), "", "");
+}
+
+string PlacementState::getProbeKey(vector<uint64_t>& versions, string fingerprint, string clientHost, string serverHost, string serverVM) const
+{
+    vector<string> queues = getWorkloadQueues(clientHost, serverHost, serverVM);
+    versions.clear();
+    for (unsigned int i = 0; i < queues.size(); i++) {
+        map<string, uint64_t>::const_iterator it = _queueVersions.find(queues[i]);
+        versions.push_back((it != _queueVersions.end()) ? it->second : 0);
+    }
+    return fingerprint + "\n" + clientHost + "\n" + serverHost + "\n" + serverVM;
+}
+
+const ProbeResult* PlacementState::getProbeResult(string probeKey, const vector<uint64_t>& versions) const
+{
+    map<string, ProbeResult>::const_iterator it = _probeCache.find(probeKey);
+    return ((it != _probeCache.end()) && (it->second.versions == versions)) ? &it->second : NULL;
+}
+
+void PlacementState::addProbeResult(string probeKey, const vector<uint64_t>& versions, bool admitted, double headroom)
+{
+    if (_probeCache.size() >= PROBE_CACHE_SIZE) {
+        _probeCache.clear();
+    }
+    ProbeResult& probeResult = _probeCache[probeKey];
+    probeResult.versions = versions;
+    probeResult.admitted = admitted;
+    probeResult.headroom = headroom;
+}
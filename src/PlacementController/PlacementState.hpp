@@ -0,0 +1,174 @@
+// PlacementState.hpp - Placement decisions shared by the PlacementController and PlacementReplay.
+// PlacementState tracks the client/server VMs and placed workloads of a system, and makes the decisions that do not depend on
+// how workloads are tested for admission:
+// - Group selection: workloads that share a server are grouped onto the same client machine (see clientServerPlacement).
+// - Capacity pruning: for each queue, the sums of lower bounds on the rate limits (r, b) of the flows using the queue (see getFlowBounds)
+//   are tracked, and servers where adding a workload would exceed a queue's bandwidth, or where the bursts could not be served within
+//   the largest SLO of the queue's flows, are skipped (see getCandidateServers).
+// - Probe memoization: each queue has a state version that changes whenever a workload sharing its client group is added or removed,
+//   so the result of testing a workload with the same configuration on a server whose queues' state versions have not changed
+//   is reused (see getProbeKey).
+// The caller adds the queues to its admission control model (e.g., AdmissionController RPCs or a WorkloadCompactor) along with
+// their capacities, and tests workloads on the candidate servers.
+// PlacementState is not thread-safe; the PlacementController protects it with g_mutex.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _PLACEMENT_STATE_HPP
+#define _PLACEMENT_STATE_HPP
+
+#include <vector>
+#include <list>
+#include <set>
+#include <map>
+#include <string>
+#include <stdint.h>
+#include <json/json.h>
+#include "../DNC-Library/NCConfig.hpp"
+
+using namespace std;
+
+struct WorkloadInfo {
+    string name;
+    string clientHost;
+    string clientVM;
+    string serverHost;
+    string serverVM;
+    vector<pair<string, FlowBounds> > queueLoads; // flow bounds added to the load of each of the workload's queues
+    double SLO;
+};
+
+// Bounds on the rate limits of a workload's flows (see getClientFlowBounds)
+struct WorkloadDemand {
+    FlowBounds networkIn;
+    FlowBounds storage;
+    FlowBounds networkOut;
+    double SLO;
+};
+
+// Capacity of a queue used for pruning placements
+struct QueueCapacity {
+    double bandwidth;
+    double rate; // sum of rate bounds of flows using the queue
+    double burst; // sum of burst bounds of flows using the queue
+    multiset<double> SLOs; // SLOs of flows using the queue
+};
+
+// Index of serverHost/serverVM pairs by remaining storage capacity (see remainingRate)
+typedef multimap<double, pair<string, string> > CapacityIndex;
+
+// Result of testing a workload on a server, valid as long as the state versions of the queues are unchanged
+struct ProbeResult {
+    vector<uint64_t> versions;
+    bool admitted;
+    double headroom; // largest scale factor of the workload's load that would be admitted (only tested if not first-fit)
+};
+
+// Get the bounds on the rate limits of a workload's flows.
+WorkloadDemand getWorkloadDemand(const Json::Value& clientInfo, string addrPrefix);
+// Get a workload's configuration, excluding its name and placement, which do not affect admission.
+string getWorkloadFingerprint(const Json::Value& clientInfo);
+// Get the queues used by a workload placed on the given client/server.
+vector<string> getWorkloadQueues(string clientHost, string serverHost, string serverVM);
+
+class PlacementState
+{
+private:
+    typedef list<list<WorkloadInfo>::iterator> WorkloadList;
+
+    map<string, set<string> > _servers; // map serverHost -> serverVMs
+    map<string, set<string> > _clients; // map clientHost -> free clientVMs
+    map<string, string> _serverClientGrouping; // map serverHost -> clientHost to group workloads that share the same server onto the same client
+    list<WorkloadInfo> _workloads; // list of workloads in system
+    // indexes of workloads and free client VMs, updated along with _workloads and _clients
+    map<string, list<WorkloadInfo>::iterator> _workloadsByName; // map name -> workload in _workloads
+    map<string, WorkloadList> _serverHostWorkloads; // map serverHost -> workloads using serverHost in _workloads order
+    map<string, WorkloadList> _clientHostWorkloads; // map clientHost -> workloads using clientHost in _workloads order
+    set<pair<int, string> > _clientHostsByFreeVMs; // set of (-number of free clientVMs, clientHost) for clientHosts in _clients, so the first has the most free VMs
+    // prune placements by capacity
+    map<string, QueueCapacity> _queueCapacities; // map queue name -> capacity
+    CapacityIndex _storageCapacityIndex; // map remaining storage capacity -> serverHost/serverVM
+    map<string, CapacityIndex::iterator> _storageCapacityIndexEntries; // map storage queue name -> entry in _storageCapacityIndex
+    // memoize probe results
+    map<string, uint64_t> _queueVersions; // map queue name -> state version of queue's client group (0 if never used)
+    uint64_t _lastVersion; // last state version assigned
+    map<string, ProbeResult> _probeCache; // map fingerprint/placement -> probe result
+
+    // Remove a workload in _workloads from a host's index.
+    static void removeHostWorkload(map<string, WorkloadList>& hostWorkloads, string host, list<WorkloadInfo>::iterator workload);
+    // Check if a workload uses a serverHost/serverVM or clientHost/clientVM. An empty VM matches any VM on the host.
+    static bool hostInUse(const map<string, WorkloadList>& hostWorkloads, string host, string VM, bool isServer);
+    // Mark a clientVM as free/not free.
+    void addFreeClientVM(string clientHost, string clientVM);
+    void removeFreeClientVM(string clientHost, string clientVM);
+    // Add (or remove if add is false) a flow's bounds to the load of a queue and update its entry in the capacity index.
+    void updateQueueLoad(string queueName, const FlowBounds& bounds, double SLO, bool add);
+    // Check if a queue could fit an additional flow with the given bounds and SLO.
+    bool queueFits(string queueName, const FlowBounds& bounds, double SLO) const;
+    // Change the state version of all queues that share a client group with the given hosts' network queues
+    // and the given server queue (if serverHost is not empty).
+    void updateQueueVersions(const vector<string>& hosts, string serverHost, string serverVM);
+    // Change the state version of the queues that share a client group with a workload placed on the given client/server.
+    void updateWorkloadQueueVersions(string clientHost, string serverHost, string serverVM);
+
+public:
+    PlacementState();
+
+    // Start/stop tracking the capacity of a queue that was added to/deleted from the admission control model.
+    void addQueueCapacity(const Json::Value& queueInfo);
+    void delQueueCapacity(string name);
+    // Get the capacity of a queue, or NULL if it is not tracked.
+    const QueueCapacity* getQueueCapacity(string name) const;
+
+    // Client VMs. The network queues of a new clientHost are added by the caller before its first clientVM.
+    bool hasClientHost(string clientHost) const { return (_clients.find(clientHost) != _clients.end()); }
+    // Add a free clientVM. Returns false if the clientVM already exists.
+    bool addClientVM(string clientHost, string clientVM);
+    // Delete a free clientVM. Returns false if the clientVM is in use or does not exist.
+    bool delClientVM(string clientHost, string clientVM);
+    // Check if a clientHost has no clientVMs left, so that it and its network queues can be deleted.
+    bool clientHostUnused(string clientHost) const;
+    void delClientHost(string clientHost);
+
+    // Server VMs. The network queues of a new serverHost and the storage queue of a serverVM are added by the caller before the serverVM.
+    bool hasServerHost(string serverHost) const { return (_servers.find(serverHost) != _servers.end()); }
+    bool hasServerVM(string serverHost, string serverVM) const;
+    bool serverVMInUse(string serverHost, string serverVM) const { return hostInUse(_serverHostWorkloads, serverHost, serverVM, true); }
+    void addServerVM(string serverHost, string serverVM);
+    // Delete a serverVM that is not in use. Returns true if the serverHost has no serverVMs left,
+    // in which case it is deleted and the caller deletes its network queues.
+    bool delServerVM(string serverHost, string serverVM);
+    unsigned int numServerVMs() const { return _storageCapacityIndex.size(); }
+
+    // Decides which client VM to place a workload on a server with.
+    // The current algorithm groups workloads that share a server onto the same client machine.
+    // This is because their performance is already correlated by sharing a server, so it's better
+    // to continue sharing so as not to introduce additional correlations with other workloads.
+    // Returns false if there are no free client VMs.
+    bool clientServerPlacement(string serverHost, pair<string, string>& client) const;
+    // Get the servers that could fit a workload in first-fit order.
+    // Returns false if there are no free client VMs.
+    bool getCandidateServers(vector<pair<string, string> >& servers, const WorkloadDemand& demand) const;
+
+    // Workloads
+    // Add a workload that was admitted on its client/server. clientInfo is the workload's generated config (see configGenClient).
+    void addWorkload(WorkloadInfo& workloadInfo, const Json::Value& clientInfo);
+    // Remove a workload. Returns false if there is no workload with the name.
+    bool removeWorkload(string name);
+    // Get a workload, or NULL if there is no workload with the name.
+    const WorkloadInfo* getWorkload(string name) const;
+    unsigned int numWorkloads() const { return _workloads.size(); }
+
+    // Change the state version of a host's network queues when they are added or removed.
+    void updateHostQueueVersions(string host);
+    // Get the key and current queue state versions for testing a workload on a client/server.
+    string getProbeKey(vector<uint64_t>& versions, string fingerprint, string clientHost, string serverHost, string serverVM) const;
+    // Get the memoized result of a test with the given key and queue state versions, or NULL if there is none.
+    const ProbeResult* getProbeResult(string probeKey, const vector<uint64_t>& versions) const;
+    // Memoize the result of a test.
+    void addProbeResult(string probeKey, const vector<uint64_t>& versions, bool admitted, double headroom);
+};
+
+#endif // _PLACEMENT_STATE_HPP
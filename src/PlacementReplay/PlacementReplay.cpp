@@ -0,0 +1,478 @@
+// PlacementReplay.cpp - replays the placement of workloads in-process for measuring admission and placement throughput.
+// The topology and events are read as in PlacementClient, but rather than sending RPCs to the PlacementController and
+// AdmissionController servers, a single WorkloadCompactor model is used directly, so the measurements exclude RPC overheads.
+// Workloads are placed with the same PlacementState as the PlacementController (see PlacementController/PlacementState.hpp):
+// servers that can not fit a workload's rate bounds are pruned, and the remaining servers are tested in first-fit order,
+// grouping workloads that share a server onto the same client machine. Each test tentatively adds the workload within a what-if
+// evaluation, as in the ProbeClients RPC, and the first server that meets the workload's SLO is committed. The results of tests
+// are memoized until a workload sharing a client group with the tested queues is added or removed.
+// The time of each stage is recorded: curve load (generating the workload's config and arrival curves), LP (optimizing the
+// rate limit parameters), and latency check (calculating the latency of the affected workloads). The report also includes
+// the number of add events per second and the packing density of the admitted workloads.
+//
+// Command line parameters:
+// -t topoFilename (required) - topology file that specifies the workloads and system configuration; see README for file format
+// -o outputFilename (optional) - output file to store the JSON report; defaults to stdout
+// -e eventFilename (optional) - a file of events to add and remove workloads from the system in the format of the PlacementClient events file; if not specified, by default each workload in the topology file will be added to the system
+// -r numCopies (optional) - replicates the client VMs, server VMs, and workloads of the topology file numCopies times to replay at scale (e.g., 10k+ workloads); host and workload names of each copy are suffixed with the copy index, each copy's workloads are placed on the copy's VMs, and the events are replayed for each copy in turn; defaults to 1
+// -s solverName (optional) - the LP solver backend (see registerSolver in DNC-Library/Solver.hpp); defaults to glpk
+// -n numThreads (optional) - the number of threads for solving independent client groups (0, the default, uses the number of cores); groups are only solved in parallel with solver backends that can solve concurrently (e.g., GLPK built with GLPK_THREAD_SAFE)
+// -m (optional) - disables memoizing the results of tests, so that every candidate server is tested
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <stdint.h>
+#include <json/json.h>
+#include "../common/time.hpp"
+#include "../common/common.hpp"
+#include "../common/serializeJSON.hpp"
+#include "../common/LatencyHistogram.hpp"
+#include "../DNC-Library/NCConfig.hpp"
+#include "../DNC-Library/WorkloadCompactor.hpp"
+#include "../PlacementController/PlacementState.hpp"
+
+using namespace std;
+
+struct EventInfo {
+    unsigned int clientInfoIndex;
+    bool addClient;
+};
+
+// Workload placed in a copy of the topology
+struct ReplayWorkload {
+    ClientId clientId;
+    unsigned int cell; // index of the copy of the topology in g_cells
+};
+
+// Time spent in a stage of admission
+struct StageStats {
+    uint64_t totalTime;
+    LatencyHistogram histogram;
+
+    StageStats() : totalTime(0) {}
+    void record(uint64_t time)
+    {
+        totalTime += time;
+        histogram.record(time);
+    }
+};
+
+WorkloadCompactor* g_pWC = NULL;
+vector<PlacementState> g_cells; // client/server VMs, workloads, queue capacities, and memoized probe results of each copy of the topology
+map<string, ReplayWorkload> g_workloads; // map name -> workload in system
+bool g_memoize = true; // memoize probe results
+// stats
+StageStats g_curveLoadStats;
+StageStats g_lpStats;
+StageStats g_latencyCheckStats;
+StageStats g_addClientStats;
+StageStats g_delClientStats;
+uint64_t g_numProbes = 0;
+uint64_t g_numPruned = 0;
+uint64_t g_numMemoized = 0;
+
+// Summarize the times in a stage (in seconds)
+Json::Value stageToJson(const StageStats& stats)
+{
+    unsigned int firstBucket;
+    vector<uint64_t> counts;
+    stats.histogram.snapshot(firstBucket, counts);
+    uint64_t count = 0;
+    for (unsigned int i = 0; i < counts.size(); i++) {
+        count += counts[i];
+    }
+    Json::Value summary;
+    summary["count"] = (Json::UInt64)count;
+    summary["total"] = ConvertTimeToSeconds(stats.totalTime);
+    summary["mean"] = (count > 0) ? (ConvertTimeToSeconds(stats.totalTime) / count) : 0;
+    summary["p50"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.5));
+    summary["p90"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.9));
+    summary["p99"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.99));
+    summary["max"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 1));
+    return summary;
+}
+
+//
+// Manage system configuration
+//
+// Add a queue to the model and start tracking its capacity in a cell.
+void addQueue(PlacementState& cell, const Json::Value& queueInfo)
+{
+    g_pWC->addQueue(queueInfo);
+    cell.addQueueCapacity(queueInfo);
+}
+
+// Add the network queues of a host to a cell if it is new.
+void addHost(PlacementState& cell, string host)
+{
+    if (cell.getQueueCapacity(getQueueInName(host)) == NULL) {
+        Json::Value queueInInfo;
+        configGenNetworkInQueue(queueInInfo, host);
+        addQueue(cell, queueInInfo);
+        Json::Value queueOutInfo;
+        configGenNetworkOutQueue(queueOutInfo, host);
+        addQueue(cell, queueOutInfo);
+    }
+}
+
+//
+// Admission and placement
+//
+// Check latency of an added client and the other clients affected by it
+bool checkLatency(ClientId clientId)
+{
+    g_pWC->calcClientLatency(clientId);
+    const Client* c = g_pWC->getClient(clientId);
+    if (c->latency > c->SLO) {
+        return false;
+    }
+    set<ClientId> affectedClientIds;
+    g_pWC->getDirtyClients(affectedClientIds);
+    for (set<ClientId>::const_iterator it = affectedClientIds.begin(); it != affectedClientIds.end(); it++) {
+        g_pWC->calcClientLatency(*it);
+        c = g_pWC->getClient(*it);
+        if (c->latency > c->SLO) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Calculate the latency of the workloads affected by a committed change.
+// Committed workloads are not rechecked against their SLOs, as in the AdmissionController, but their latencies are brought up to
+// date so that later tests only check the workloads affected by the tested workload.
+void updateLatencies()
+{
+    uint64_t startTime = GetTime();
+    set<ClientId> affectedClientIds;
+    g_pWC->getDirtyClients(affectedClientIds);
+    for (set<ClientId>::const_iterator it = affectedClientIds.begin(); it != affectedClientIds.end(); it++) {
+        g_pWC->calcClientLatency(*it);
+    }
+    g_latencyCheckStats.record(GetTime() - startTime);
+}
+
+// Test if a workload meets its SLO without changing the model, as in the ProbeClients RPC.
+bool probeClient(const Json::Value& clientInfo)
+{
+    g_numProbes++;
+    g_pWC->beginWhatIf();
+    ClientId clientId = g_pWC->addClient(clientInfo);
+    uint64_t startTime = GetTime();
+    g_pWC->updateShaperParameters();
+    uint64_t lpTime = GetTime();
+    bool admitted = checkLatency(clientId);
+    g_latencyCheckStats.record(GetTime() - lpTime);
+    g_lpStats.record(lpTime - startTime);
+    g_pWC->delClient(clientId);
+    g_pWC->endWhatIf();
+    return admitted;
+}
+
+// Place a workload onto the first server of a cell that meets its SLO and add it to the model.
+// Returns false if the workload is rejected.
+bool placeClient(const Json::Value& clientInfo, unsigned int cellIndex, string addrPrefix, bool enforce)
+{
+    string clientName = clientInfo["name"].asString();
+    if (g_workloads.find(clientName) != g_workloads.end()) {
+        cerr << "Workload " << clientName << " already placed" << endl;
+        return false;
+    }
+    PlacementState& cell = g_cells[cellIndex];
+    uint64_t startTime = GetTime();
+    WorkloadDemand demand = getWorkloadDemand(clientInfo, addrPrefix);
+    g_curveLoadStats.record(GetTime() - startTime);
+    vector<pair<string, string> > servers;
+    if (!cell.getCandidateServers(servers, demand)) {
+        cerr << "Out of client machines" << endl;
+        return false;
+    }
+    g_numPruned += cell.numServerVMs() - servers.size();
+    string fingerprint = getWorkloadFingerprint(clientInfo);
+    for (unsigned int serverIndex = 0; serverIndex < servers.size(); serverIndex++) {
+        const pair<string, string>& server = servers[serverIndex];
+        pair<string, string> client;
+        if (!cell.clientServerPlacement(server.first, client)) {
+            cerr << "Out of client machines" << endl;
+            return false;
+        }
+        // Reuse the result of testing the same workload on the same unchanged queues
+        vector<uint64_t> versions;
+        string probeKey = cell.getProbeKey(versions, fingerprint, client.first, server.first, server.second);
+        const ProbeResult* probeResult = g_memoize ? cell.getProbeResult(probeKey, versions) : NULL;
+        if ((probeResult != NULL) && !probeResult->admitted) {
+            g_numMemoized++;
+            continue;
+        }
+        Json::Value candidateInfo = clientInfo;
+        candidateInfo["clientHost"] = Json::Value(client.first);
+        candidateInfo["clientVM"] = Json::Value(client.second);
+        candidateInfo["serverHost"] = Json::Value(server.first);
+        candidateInfo["serverVM"] = Json::Value(server.second);
+        startTime = GetTime();
+        configGenClient(candidateInfo, clientName, addrPrefix, enforce);
+        g_curveLoadStats.record(GetTime() - startTime);
+        if (probeResult != NULL) {
+            g_numMemoized++;
+        } else {
+            bool admitted = probeClient(candidateInfo);
+            if (g_memoize) {
+                cell.addProbeResult(probeKey, versions, admitted, 0);
+            }
+            if (!admitted) {
+                continue;
+            }
+        }
+        // Commit placement
+        ReplayWorkload& workload = g_workloads[clientName];
+        workload.clientId = g_pWC->addClient(candidateInfo);
+        workload.cell = cellIndex;
+        startTime = GetTime();
+        g_pWC->updateShaperParameters();
+        g_lpStats.record(GetTime() - startTime);
+        updateLatencies();
+        WorkloadInfo workloadInfo;
+        workloadInfo.name = clientName;
+        workloadInfo.clientHost = client.first;
+        workloadInfo.clientVM = client.second;
+        workloadInfo.serverHost = server.first;
+        workloadInfo.serverVM = server.second;
+        cell.addWorkload(workloadInfo, candidateInfo);
+        return true;
+    }
+    return false;
+}
+
+// Remove a workload from the system.
+void removeClient(string clientName)
+{
+    map<string, ReplayWorkload>::iterator it = g_workloads.find(clientName);
+    if (it != g_workloads.end()) {
+        g_pWC->delClient(it->second.clientId);
+        updateLatencies();
+        g_cells[it->second.cell].removeWorkload(clientName);
+        g_workloads.erase(it);
+    }
+}
+
+// Append a copy index to a name
+string copyName(string name, unsigned int copy, unsigned int numCopies)
+{
+    if (numCopies <= 1) {
+        return name;
+    }
+    ostringstream oss;
+    oss << name << "-" << copy;
+    return oss.str();
+}
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    char* topoFilename = NULL;
+    char* outputFilename = NULL;
+    char* eventFilename = NULL;
+    unsigned int numCopies = 1;
+    string solverName = "";
+    unsigned int numThreads = 0;
+    do {
+        opt = getopt(argc, argv, "t:o:e:r:s:n:m");
+        switch (opt) {
+            case 't':
+                topoFilename = optarg;
+                break;
+
+            case 'o':
+                outputFilename = optarg;
+                break;
+
+            case 'e':
+                eventFilename = optarg;
+                break;
+
+            case 'r':
+                numCopies = atoi(optarg);
+                break;
+
+            case 's':
+                solverName.assign(optarg);
+                break;
+
+            case 'n':
+                numThreads = atoi(optarg);
+                break;
+
+            case 'm':
+                g_memoize = false;
+                break;
+
+            case -1:
+                break;
+
+            default:
+                break;
+        }
+    } while (opt != -1);
+
+    if ((topoFilename == NULL) || (numCopies == 0)) {
+        cout << "Usage: " << argv[0] << " -t topoFilename [-o outputFilename] [-e eventFilename] [-r numCopies] [-s solverName] [-n numThreads] [-m]" << endl;
+        return -1;
+    }
+
+    // Read config
+    Json::Value rootConfig;
+    if (!readJson(topoFilename, rootConfig)) {
+        return -1;
+    }
+    g_pWC = new WorkloadCompactor(true, numThreads);
+    if (!solverName.empty() && !g_pWC->setSolver(solverName)) {
+        cerr << "Unknown solver " << solverName << endl;
+        return -1;
+    }
+    const Json::Value& clientVMs = rootConfig["clientVMs"];
+    const Json::Value& serverVMs = rootConfig["serverVMs"];
+    const Json::Value& topoClientInfos = rootConfig["clients"];
+    Json::Value clientInfos = Json::arrayValue;
+    g_cells.resize(numCopies);
+    unsigned int numServerVMs = 0;
+    for (unsigned int copy = 0; copy < numCopies; copy++) {
+        PlacementState& cell = g_cells[copy];
+        // Add clientVMs
+        for (unsigned int clientVMIndex = 0; clientVMIndex < clientVMs.size(); clientVMIndex++) {
+            string clientHost = copyName(clientVMs[clientVMIndex]["clientHost"].asString(), copy, numCopies);
+            addHost(cell, clientHost);
+            cell.addClientVM(clientHost, clientVMs[clientVMIndex]["clientVM"].asString());
+        }
+        // Add serverVMs
+        for (unsigned int serverVMIndex = 0; serverVMIndex < serverVMs.size(); serverVMIndex++) {
+            string serverHost = copyName(serverVMs[serverVMIndex]["serverHost"].asString(), copy, numCopies);
+            string serverVM = serverVMs[serverVMIndex]["serverVM"].asString();
+            if (cell.hasServerVM(serverHost, serverVM)) {
+                continue;
+            }
+            addHost(cell, serverHost);
+            Json::Value queueStorageInfo;
+            configGenStorageQueue(queueStorageInfo, getServerName(serverHost, serverVM));
+            addQueue(cell, queueStorageInfo);
+            cell.addServerVM(serverHost, serverVM);
+            numServerVMs++;
+        }
+        // Add workloads
+        for (unsigned int clientInfoIndex = 0; clientInfoIndex < topoClientInfos.size(); clientInfoIndex++) {
+            Json::Value clientInfo = topoClientInfos[clientInfoIndex];
+            clientInfo["name"] = Json::Value(copyName(clientInfo["name"].asString(), copy, numCopies));
+            clientInfos.append(clientInfo);
+        }
+    }
+    // Process events file, or by default add one of every client in order in topology file
+    vector<EventInfo> topoEvents;
+    if (eventFilename) {
+        ifstream file(eventFilename);
+        if (!file.is_open()) {
+            cerr << "Failed to open event file " << eventFilename << endl;
+            return -1;
+        }
+        string line;
+        EventInfo event;
+        char isAdd[32];
+        while (getline(file, line)) {
+            // Parse line
+            if ((sscanf(line.c_str(), "%u,%31[^,]", &event.clientInfoIndex, isAdd) == 2) && (event.clientInfoIndex < topoClientInfos.size())) {
+                event.addClient = (strcmp(isAdd, "addClient") == 0);
+                topoEvents.push_back(event);
+            }
+        }
+    } else {
+        EventInfo event;
+        event.addClient = true;
+        for (event.clientInfoIndex = 0; event.clientInfoIndex < topoClientInfos.size(); event.clientInfoIndex++) {
+            topoEvents.push_back(event);
+        }
+    }
+    // Replay events
+    string addrPrefix = rootConfig["addrPrefix"].asString();
+    bool enforce = rootConfig.isMember("enforce") && rootConfig["enforce"].asBool();
+    unsigned int numAdmitted = 0;
+    unsigned int numRejected = 0;
+    unsigned int numRemoved = 0;
+    uint64_t replayStartTime = GetTime();
+    for (unsigned int copy = 0; copy < numCopies; copy++) {
+        for (unsigned int eventIndex = 0; eventIndex < topoEvents.size(); eventIndex++) {
+            const EventInfo& event = topoEvents[eventIndex];
+            const Json::Value& clientInfo = clientInfos[copy * topoClientInfos.size() + event.clientInfoIndex];
+            uint64_t startTime = GetTime();
+            if (event.addClient) {
+                if (placeClient(clientInfo, copy, addrPrefix, enforce)) {
+                    numAdmitted++;
+                } else {
+                    numRejected++;
+                }
+                g_addClientStats.record(GetTime() - startTime);
+            } else {
+                removeClient(clientInfo["name"].asString());
+                numRemoved++;
+                g_delClientStats.record(GetTime() - startTime);
+            }
+        }
+    }
+    double elapsed = ConvertTimeToSeconds(GetTime() - replayStartTime);
+    // Compute packing density of admitted workloads
+    set<pair<unsigned int, string> > usedServerVMs; // set of (cell, server name) of server VMs used by workloads
+    for (map<string, ReplayWorkload>::const_iterator it = g_workloads.begin(); it != g_workloads.end(); it++) {
+        const WorkloadInfo* workloadInfo = g_cells[it->second.cell].getWorkload(it->first);
+        usedServerVMs.insert(make_pair(it->second.cell, getServerName(workloadInfo->serverHost, workloadInfo->serverVM)));
+    }
+    unsigned int numUsedServerVMs = usedServerVMs.size();
+    double storageUtilization = 0;
+    for (set<pair<unsigned int, string> >::const_iterator it = usedServerVMs.begin(); it != usedServerVMs.end(); it++) {
+        const QueueCapacity* capacity = g_cells[it->first].getQueueCapacity(it->second);
+        storageUtilization += capacity->rate / capacity->bandwidth;
+    }
+    // Write report
+    Json::Value report;
+    report["numWorkloads"] = Json::Value(clientInfos.size());
+    report["numEvents"] = Json::Value(static_cast<unsigned int>(numCopies * topoEvents.size()));
+    report["admitted"] = Json::Value(numAdmitted);
+    report["rejected"] = Json::Value(numRejected);
+    report["removed"] = Json::Value(numRemoved);
+    report["elapsed"] = Json::Value(elapsed);
+    report["admissionsPerSec"] = Json::Value((elapsed > 0) ? ((numAdmitted + numRejected) / elapsed) : 0);
+    report["probes"] = Json::Value((Json::UInt64)g_numProbes);
+    report["prunedServers"] = Json::Value((Json::UInt64)g_numPruned);
+    report["memoizedProbes"] = Json::Value((Json::UInt64)g_numMemoized);
+    Json::Value& stages = report["stages"];
+    stages["curveLoad"] = stageToJson(g_curveLoadStats);
+    stages["lp"] = stageToJson(g_lpStats);
+    stages["latencyCheck"] = stageToJson(g_latencyCheckStats);
+    Json::Value& events = report["events"];
+    events["addClient"] = stageToJson(g_addClientStats);
+    events["delClient"] = stageToJson(g_delClientStats);
+    Json::Value& packing = report["packing"];
+    packing["serverVMs"] = Json::Value(numServerVMs);
+    packing["usedServerVMs"] = Json::Value(numUsedServerVMs);
+    packing["workloadsPerUsedServerVM"] = Json::Value((numUsedServerVMs > 0) ? (static_cast<double>(g_workloads.size()) / numUsedServerVMs) : 0);
+    packing["storageUtilization"] = Json::Value((numUsedServerVMs > 0) ? (storageUtilization / numUsedServerVMs) : 0); // mean rate bound / bandwidth of used server VMs
+    if (outputFilename) {
+        if (!writeJson(outputFilename, report)) {
+            return -1;
+        }
+    } else {
+        cout << report.toStyledString();
+    }
+    delete g_pWC;
+    return 0;
+}
@@ -0,0 +1,553 @@
+// PlacementRouter.cpp - routes placement RPCs to a set of PlacementController shards.
+// Serves the PlacementController RPC interface, so PlacementClient can use the router in place of a single PlacementController.
+// The servers and clients are partitioned between the shards by host: each host is assigned to a shard when its first VM is added,
+// which is the shard with the fewest hosts of that type (server or client), and all of its VMs are sent to that shard's PlacementController.
+// Each shard is an ordinary PlacementController with its own AdmissionController servers, which hold only the queues of the shard's hosts,
+// so a shard's placement computation and state only grow with the size of its partition.
+// Workloads are placed on a single shard, since the hosts of a workload's client and server VMs must be on the same shard.
+// The PlaceClients RPC deals the workloads of the batch round-robin to the shards and places each shard's workloads in parallel.
+// Workloads that a shard rejects are retried on the next shard in the following round, until they are admitted or rejected by all shards.
+// The AddClients RPC places the whole set of workloads on one shard, trying the shards one at a time starting from a rotating shard.
+// Workloads that are already admitted (see PlacementController's placeClient) are sent to the shard of their serverHost.
+// Each shard must have at least one client host for its servers to be usable (see PlacementController's clientServerPlacement).
+//
+// Since the router and the shards each register the PlacementController RPC program, they must run on different machines.
+//
+// Command line parameters:
+// -s shardAddr (required) - the address of a PlacementController shard; this command line option is used once per shard
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <rpc/rpc.h>
+#include <rpc/pmap_clnt.h>
+#include "../prot/PlacementController_prot.h"
+#include "../prot/PlacementController_clnt.hpp"
+#include <json/json.h>
+#include "../common/common.hpp"
+#include "../common/ThreadPool.hpp"
+#include "../common/SpanTrace.hpp"
+
+using namespace std;
+
+// A PlacementController shard
+struct Shard {
+    string addr;
+    PlacementController_clnt* clnt;
+    unsigned int numServerHosts; // number of server hosts assigned to the shard
+    unsigned int numClientHosts; // number of client hosts assigned to the shard
+};
+
+// Placement of a subset of a batch of workloads on a shard, run by a pool thread
+struct ShardPlacement {
+    unsigned int shardIndex;
+    vector<unsigned int> indices; // indices of the workloads in the batch
+    Json::Value clientInfos; // workloads to place on the shard, updated with the placements
+    vector<bool> admitted;
+    string addrPrefix;
+    bool enforce;
+    PlacementOrder order;
+};
+
+// Deletion of a set of workloads from a shard, run by a pool thread
+struct ShardDeletion {
+    unsigned int shardIndex;
+    vector<string> names;
+};
+
+//
+// Globals fixed at init
+//
+ThreadPool* g_pool = NULL; // threads for sending RPCs to the shards in parallel; one per shard
+
+//
+// Globals accessed only by the RPC thread, or by pool threads while the RPC thread waits for them
+//
+vector<Shard> g_shards; // each shard's connection is used by one thread at a time
+map<string, unsigned int> g_hostShards; // map host -> shard index of hosts that have had VMs; hosts stay on their shard
+map<string, unsigned int> g_workloadShards; // map name -> shard index of admitted workloads
+unsigned int g_nextAddClientsShard = 0; // shard that the next AddClients RPC tries first
+
+// Get the shard of a host, assigning a new host to the shard with the fewest hosts of its type.
+// Returns true if the host is new.
+bool getHostShard(string host, bool isServer, unsigned int& shardIndex)
+{
+    map<string, unsigned int>::const_iterator it = g_hostShards.find(host);
+    if (it != g_hostShards.end()) {
+        shardIndex = it->second;
+        return false;
+    }
+    shardIndex = 0;
+    for (unsigned int i = 1; i < g_shards.size(); i++) {
+        unsigned int numHosts = isServer ? g_shards[i].numServerHosts : g_shards[i].numClientHosts;
+        unsigned int minHosts = isServer ? g_shards[shardIndex].numServerHosts : g_shards[shardIndex].numClientHosts;
+        if (numHosts < minHosts) {
+            shardIndex = i;
+        }
+    }
+    return true;
+}
+
+// Record the assignment of a new host to a shard.
+void addHostShard(string host, bool isServer, unsigned int shardIndex)
+{
+    g_hostShards[host] = shardIndex;
+    if (isServer) {
+        g_shards[shardIndex].numServerHosts++;
+    } else {
+        g_shards[shardIndex].numClientHosts++;
+    }
+}
+
+// Get the shard that a workload must be placed on if it is already admitted.
+// Returns false if the workload can be placed on any shard.
+bool getAdmittedShard(const Json::Value& clientInfo, unsigned int& shardIndex)
+{
+    if (!clientInfo.isMember("admitted") || !clientInfo["admitted"].asBool()) {
+        return false;
+    }
+    map<string, unsigned int>::const_iterator it = g_hostShards.find(clientInfo["serverHost"].asString());
+    if (it == g_hostShards.end()) {
+        return false;
+    }
+    shardIndex = it->second;
+    return true;
+}
+
+// Copy a string into a new char array for an RPC result.
+char* newString(string str)
+{
+    char* c_str = new char[str.length() + 1];
+    strcpy(c_str, str.c_str());
+    return c_str;
+}
+
+// Place a subset of a batch of workloads on a shard.
+void placeOnShard(void* ptr)
+{
+    ShardPlacement* placement = static_cast<ShardPlacement*>(ptr);
+    TRACE_SPAN("placeOnShard");
+    Shard& shard = g_shards[placement->shardIndex];
+    shard.clnt->placeClients(placement->clientInfos, placement->addrPrefix, placement->enforce, placement->order, placement->admitted);
+}
+
+// Delete a set of workloads from a shard.
+void deleteFromShard(void* ptr)
+{
+    ShardDeletion* deletion = static_cast<ShardDeletion*>(ptr);
+    g_shards[deletion->shardIndex].clnt->delClients(deletion->names);
+}
+
+// AddClients RPC - places a set of workloads on the first shard that admits all of them.
+// Assumes RPCs are not multi-threaded
+PlacementAddClientsRes* placement_controller_add_clients_svc(PlacementAddClientsArgs* argp, struct svc_req* rqstp)
+{
+    TRACE_SPAN("AddClients RPC");
+    static PlacementAddClientsRes result = {PLACEMENT_SUCCESS, false, {0, NULL}, {0, NULL}, {0, NULL}, {0, NULL}};
+    // Delete old arrays
+    for (unsigned int i = 0; i < result.clientHosts.clientHosts_len; i++) {
+        delete[] result.clientHosts.clientHosts_val[i];
+        delete[] result.clientVMs.clientVMs_val[i];
+        delete[] result.serverHosts.serverHosts_val[i];
+        delete[] result.serverVMs.serverVMs_val[i];
+    }
+    delete[] result.clientHosts.clientHosts_val;
+    delete[] result.clientVMs.clientVMs_val;
+    delete[] result.serverHosts.serverHosts_val;
+    delete[] result.serverVMs.serverVMs_val;
+    memset(&result, 0, sizeof(result));
+    // Parse input
+    Json::Value clientInfos;
+    if (!stringToJson(argp->clientInfos, clientInfos) || !clientInfos.isArray()) {
+        result.status = PLACEMENT_ERR_INVALID_ARGUMENT;
+        return &result;
+    }
+    string addrPrefix(argp->addrPrefix);
+    bool enforce = argp->enforce;
+    // Restrict to the shard of any already admitted workload
+    unsigned int firstShard = g_nextAddClientsShard;
+    unsigned int numTries = g_shards.size();
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        if (getAdmittedShard(clientInfos[i], firstShard)) {
+            numTries = 1;
+            break;
+        }
+    }
+    if (numTries > 1) {
+        g_nextAddClientsShard = (g_nextAddClientsShard + 1) % g_shards.size();
+    }
+    // Try shards until one admits the workloads
+    for (unsigned int i = 0; (i < numTries) && !result.admitted; i++) {
+        unsigned int shardIndex = (firstShard + i) % g_shards.size();
+        Json::Value shardClientInfos = clientInfos;
+        if (g_shards[shardIndex].clnt->addClients(shardClientInfos, addrPrefix, enforce)) {
+            result.admitted = true;
+            clientInfos = shardClientInfos;
+            for (unsigned int j = 0; j < clientInfos.size(); j++) {
+                g_workloadShards[clientInfos[j]["name"].asString()] = shardIndex;
+            }
+        }
+    }
+    // Create result arrays
+    if (result.admitted) {
+        unsigned int numClients = clientInfos.size();
+        result.clientHosts.clientHosts_val = new char*[numClients];
+        result.clientHosts.clientHosts_len = numClients;
+        result.clientVMs.clientVMs_val = new char*[numClients];
+        result.clientVMs.clientVMs_len = numClients;
+        result.serverHosts.serverHosts_val = new char*[numClients];
+        result.serverHosts.serverHosts_len = numClients;
+        result.serverVMs.serverVMs_val = new char*[numClients];
+        result.serverVMs.serverVMs_len = numClients;
+        for (unsigned int i = 0; i < numClients; i++) {
+            const Json::Value& clientInfo = clientInfos[i];
+            result.clientHosts.clientHosts_val[i] = newString(clientInfo["clientHost"].asString());
+            result.clientVMs.clientVMs_val[i] = newString(clientInfo["clientVM"].asString());
+            result.serverHosts.serverHosts_val[i] = newString(clientInfo["serverHost"].asString());
+            result.serverVMs.serverVMs_val[i] = newString(clientInfo["serverVM"].asString());
+        }
+    }
+    result.status = PLACEMENT_SUCCESS;
+    return &result;
+}
+
+// PlaceClients RPC - places each workload in a set of workloads independently on the shards in parallel, retrying rejected workloads on other shards.
+// Assumes RPCs are not multi-threaded
+PlacementPlaceClientsRes* placement_controller_place_clients_svc(PlacementPlaceClientsArgs* argp, struct svc_req* rqstp)
+{
+    TRACE_SPAN("PlaceClients RPC");
+    static PlacementPlaceClientsRes result = {PLACEMENT_SUCCESS, {0, NULL}, {0, NULL}, {0, NULL}, {0, NULL}, {0, NULL}};
+    // Delete old arrays
+    for (unsigned int i = 0; i < result.clientHosts.clientHosts_len; i++) {
+        delete[] result.clientHosts.clientHosts_val[i];
+        delete[] result.clientVMs.clientVMs_val[i];
+        delete[] result.serverHosts.serverHosts_val[i];
+        delete[] result.serverVMs.serverVMs_val[i];
+    }
+    delete[] result.admitted.admitted_val;
+    delete[] result.clientHosts.clientHosts_val;
+    delete[] result.clientVMs.clientVMs_val;
+    delete[] result.serverHosts.serverHosts_val;
+    delete[] result.serverVMs.serverVMs_val;
+    memset(&result, 0, sizeof(result));
+    // Parse input
+    Json::Value clientInfos;
+    if (!stringToJson(argp->clientInfos, clientInfos) || !clientInfos.isArray()) {
+        result.status = PLACEMENT_ERR_INVALID_ARGUMENT;
+        return &result;
+    }
+    if ((argp->order != PLACEMENT_ORDER_GIVEN) && (argp->order != PLACEMENT_ORDER_DECREASING_LOAD)) {
+        result.status = PLACEMENT_ERR_INVALID_ARGUMENT;
+        return &result;
+    }
+    unsigned int numClients = clientInfos.size();
+    unsigned int numShards = g_shards.size();
+    // Deal workloads round-robin to shards; already admitted workloads only go to the shard of their serverHost
+    vector<unsigned int> firstShards(numClients);
+    vector<unsigned int> numTries(numClients, numShards);
+    for (unsigned int i = 0; i < numClients; i++) {
+        firstShards[i] = i % numShards;
+        if (getAdmittedShard(clientInfos[i], firstShards[i])) {
+            numTries[i] = 1;
+        }
+    }
+    // Place workloads in rounds, where each shard places its workloads in parallel with the other shards
+    vector<bool> admitted(numClients, false);
+    vector<unsigned int> pending;
+    for (unsigned int i = 0; i < numClients; i++) {
+        pending.push_back(i);
+    }
+    for (unsigned int round = 0; (round < numShards) && !pending.empty(); round++) {
+        vector<ShardPlacement> placements(numShards);
+        for (unsigned int shardIndex = 0; shardIndex < numShards; shardIndex++) {
+            ShardPlacement& placement = placements[shardIndex];
+            placement.shardIndex = shardIndex;
+            placement.clientInfos = Json::Value(Json::arrayValue);
+            placement.addrPrefix = argp->addrPrefix;
+            placement.enforce = argp->enforce;
+            placement.order = argp->order;
+        }
+        for (unsigned int i = 0; i < pending.size(); i++) {
+            unsigned int clientIndex = pending[i];
+            ShardPlacement& placement = placements[(firstShards[clientIndex] + round) % numShards];
+            placement.indices.push_back(clientIndex);
+            placement.clientInfos.append(clientInfos[clientIndex]);
+        }
+        for (unsigned int shardIndex = 0; shardIndex < numShards; shardIndex++) {
+            if (!placements[shardIndex].indices.empty()) {
+                g_pool->addTask(placeOnShard, &placements[shardIndex]);
+            }
+        }
+        g_pool->wait();
+        // Collect placements and retry rejected workloads on the next shard
+        pending.clear();
+        for (unsigned int shardIndex = 0; shardIndex < numShards; shardIndex++) {
+            const ShardPlacement& placement = placements[shardIndex];
+            for (unsigned int i = 0; i < placement.indices.size(); i++) {
+                unsigned int clientIndex = placement.indices[i];
+                if ((i < placement.admitted.size()) && placement.admitted[i]) {
+                    admitted[clientIndex] = true;
+                    clientInfos[clientIndex] = placement.clientInfos[i];
+                    g_workloadShards[clientInfos[clientIndex]["name"].asString()] = shardIndex;
+                } else if (round + 1 < numTries[clientIndex]) {
+                    pending.push_back(clientIndex);
+                }
+            }
+        }
+    }
+    // Create result arrays; placements of workloads that are not admitted are empty strings
+    result.admitted.admitted_val = new bool_t[numClients];
+    result.admitted.admitted_len = numClients;
+    result.clientHosts.clientHosts_val = new char*[numClients];
+    result.clientHosts.clientHosts_len = numClients;
+    result.clientVMs.clientVMs_val = new char*[numClients];
+    result.clientVMs.clientVMs_len = numClients;
+    result.serverHosts.serverHosts_val = new char*[numClients];
+    result.serverHosts.serverHosts_len = numClients;
+    result.serverVMs.serverVMs_val = new char*[numClients];
+    result.serverVMs.serverVMs_len = numClients;
+    for (unsigned int i = 0; i < numClients; i++) {
+        const Json::Value& clientInfo = clientInfos[i];
+        result.admitted.admitted_val[i] = admitted[i];
+        result.clientHosts.clientHosts_val[i] = newString(admitted[i] ? clientInfo["clientHost"].asString() : "");
+        result.clientVMs.clientVMs_val[i] = newString(admitted[i] ? clientInfo["clientVM"].asString() : "");
+        result.serverHosts.serverHosts_val[i] = newString(admitted[i] ? clientInfo["serverHost"].asString() : "");
+        result.serverVMs.serverVMs_val[i] = newString(admitted[i] ? clientInfo["serverVM"].asString() : "");
+    }
+    result.status = PLACEMENT_SUCCESS;
+    return &result;
+}
+
+// DelClients RPC - deletes a set of workloads from their shards in parallel.
+// Assumes RPCs are not multi-threaded
+PlacementDelClientsRes* placement_controller_del_clients_svc(PlacementDelClientsArgs* argp, struct svc_req* rqstp)
+{
+    TRACE_SPAN("DelClients RPC");
+    static PlacementDelClientsRes result;
+    vector<ShardDeletion> deletions(g_shards.size());
+    for (unsigned int i = 0; i < argp->names.names_len; i++) {
+        string name(argp->names.names_val[i]);
+        map<string, unsigned int>::iterator it = g_workloadShards.find(name);
+        if (it != g_workloadShards.end()) {
+            deletions[it->second].names.push_back(name);
+            g_workloadShards.erase(it);
+        }
+    }
+    for (unsigned int shardIndex = 0; shardIndex < deletions.size(); shardIndex++) {
+        deletions[shardIndex].shardIndex = shardIndex;
+        if (!deletions[shardIndex].names.empty()) {
+            g_pool->addTask(deleteFromShard, &deletions[shardIndex]);
+        }
+    }
+    g_pool->wait();
+    result.status = PLACEMENT_SUCCESS;
+    return &result;
+}
+
+// AddClientVM RPC - add a client VM to the shard of its host.
+// Assumes RPCs are not multi-threaded
+PlacementAddClientVMRes* placement_controller_add_client_vm_svc(PlacementAddClientVMArgs* argp, struct svc_req* rqstp)
+{
+    static PlacementAddClientVMRes result;
+    string clientHost(argp->clientHost);
+    unsigned int shardIndex;
+    bool newHost = getHostShard(clientHost, false, shardIndex);
+    result.status = g_shards[shardIndex].clnt->addClientVM(clientHost, argp->clientVM);
+    if (newHost && (result.status == PLACEMENT_SUCCESS)) {
+        addHostShard(clientHost, false, shardIndex);
+    }
+    return &result;
+}
+
+// DelClientVM RPC - delete a client VM from the shard of its host.
+// Assumes RPCs are not multi-threaded
+PlacementDelClientVMRes* placement_controller_del_client_vm_svc(PlacementDelClientVMArgs* argp, struct svc_req* rqstp)
+{
+    static PlacementDelClientVMRes result;
+    map<string, unsigned int>::const_iterator it = g_hostShards.find(argp->clientHost);
+    if (it != g_hostShards.end()) {
+        result.status = g_shards[it->second].clnt->delClientVM(argp->clientHost, argp->clientVM);
+    } else {
+        result.status = PLACEMENT_ERR_CLIENT_VM_NONEXISTENT;
+    }
+    return &result;
+}
+
+// AddServerVM RPC - add a server VM to the shard of its host.
+// Assumes RPCs are not multi-threaded
+PlacementAddServerVMRes* placement_controller_add_server_vm_svc(PlacementAddServerVMArgs* argp, struct svc_req* rqstp)
+{
+    static PlacementAddServerVMRes result;
+    string serverHost(argp->serverHost);
+    unsigned int shardIndex;
+    bool newHost = getHostShard(serverHost, true, shardIndex);
+    result.status = g_shards[shardIndex].clnt->addServerVM(serverHost, argp->serverVM);
+    if (newHost && (result.status == PLACEMENT_SUCCESS)) {
+        addHostShard(serverHost, true, shardIndex);
+    }
+    return &result;
+}
+
+// DelServerVM RPC - delete a server VM from the shard of its host.
+// Assumes RPCs are not multi-threaded
+PlacementDelServerVMRes* placement_controller_del_server_vm_svc(PlacementDelServerVMArgs* argp, struct svc_req* rqstp)
+{
+    static PlacementDelServerVMRes result;
+    map<string, unsigned int>::const_iterator it = g_hostShards.find(argp->serverHost);
+    if (it != g_hostShards.end()) {
+        result.status = g_shards[it->second].clnt->delServerVM(argp->serverHost, argp->serverVM);
+    } else {
+        result.status = PLACEMENT_ERR_SERVER_VM_NONEXISTENT;
+    }
+    return &result;
+}
+
+// Main RPC handler
+void placement_controller_program(struct svc_req* rqstp, register SVCXPRT* transp)
+{
+    union {
+        PlacementAddClientsArgs placement_controller_add_clients_arg;
+        PlacementDelClientsArgs placement_controller_del_clients_arg;
+        PlacementAddClientVMArgs placement_controller_add_client_vm_arg;
+        PlacementDelClientVMArgs placement_controller_del_client_vm_arg;
+        PlacementAddServerVMArgs placement_controller_add_server_vm_arg;
+        PlacementDelServerVMArgs placement_controller_del_server_vm_arg;
+        PlacementPlaceClientsArgs placement_controller_place_clients_arg;
+    } argument;
+    char* result;
+    xdrproc_t _xdr_argument, _xdr_result;
+    char* (*local)(char*, struct svc_req*);
+
+    switch (rqstp->rq_proc) {
+        case PLACEMENT_CONTROLLER_NULL:
+            svc_sendreply(transp, (xdrproc_t)xdr_void, (caddr_t)NULL);
+            return;
+
+        case PLACEMENT_CONTROLLER_ADD_CLIENTS:
+            _xdr_argument = (xdrproc_t)xdr_PlacementAddClientsArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementAddClientsRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_add_clients_svc;
+            break;
+
+        case PLACEMENT_CONTROLLER_DEL_CLIENTS:
+            _xdr_argument = (xdrproc_t)xdr_PlacementDelClientsArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementDelClientsRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_del_clients_svc;
+            break;
+
+        case PLACEMENT_CONTROLLER_ADD_CLIENT_VM:
+            _xdr_argument = (xdrproc_t)xdr_PlacementAddClientVMArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementAddClientVMRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_add_client_vm_svc;
+            break;
+
+        case PLACEMENT_CONTROLLER_DEL_CLIENT_VM:
+            _xdr_argument = (xdrproc_t)xdr_PlacementDelClientVMArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementDelClientVMRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_del_client_vm_svc;
+            break;
+
+        case PLACEMENT_CONTROLLER_ADD_SERVER_VM:
+            _xdr_argument = (xdrproc_t)xdr_PlacementAddServerVMArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementAddServerVMRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_add_server_vm_svc;
+            break;
+
+        case PLACEMENT_CONTROLLER_DEL_SERVER_VM:
+            _xdr_argument = (xdrproc_t)xdr_PlacementDelServerVMArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementDelServerVMRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_del_server_vm_svc;
+            break;
+
+        case PLACEMENT_CONTROLLER_PLACE_CLIENTS:
+            _xdr_argument = (xdrproc_t)xdr_PlacementPlaceClientsArgs;
+            _xdr_result = (xdrproc_t)xdr_PlacementPlaceClientsRes;
+            local = (char* (*)(char*, struct svc_req*))placement_controller_place_clients_svc;
+            break;
+
+        default:
+            svcerr_noproc(transp);
+            return;
+    }
+    memset((char*)&argument, 0, sizeof(argument));
+    if (!svc_getargs(transp, (xdrproc_t)_xdr_argument, (caddr_t)&argument)) {
+        svcerr_decode(transp);
+        return;
+    }
+    result = (*local)((char*)&argument, rqstp);
+    if (result != NULL && !svc_sendreply(transp, (xdrproc_t)_xdr_result, result)) {
+        svcerr_systemerr(transp);
+    }
+    if (!svc_freeargs(transp, (xdrproc_t)_xdr_argument, (caddr_t)&argument)) {
+        cerr << "Unable to free arguments" << endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    vector<string> shardAddrs;
+    do {
+        opt = getopt(argc, argv, "s:");
+        switch (opt) {
+            case 's':
+                shardAddrs.push_back(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                break;
+        }
+    } while (opt != -1);
+
+    if (shardAddrs.empty()) {
+        cout << "Usage: " << argv[0] << " -s shardAddr [-s shardAddr ...]" << endl;
+        return -1;
+    }
+    for (unsigned int i = 0; i < shardAddrs.size(); i++) {
+        Shard shard;
+        shard.addr = shardAddrs[i];
+        shard.clnt = new PlacementController_clnt(shardAddrs[i]);
+        shard.numServerHosts = 0;
+        shard.numClientHosts = 0;
+        g_shards.push_back(shard);
+    }
+    g_pool = new ThreadPool(g_shards.size());
+
+    // Unregister PlacementController RPC handlers
+    pmap_unset(PLACEMENT_CONTROLLER_PROGRAM, PLACEMENT_CONTROLLER_V1);
+
+    // Replace tcp RPC handlers
+    register SVCXPRT *transp;
+    transp = svctcp_create(RPC_ANYSOCK, 0, 0);
+    if (transp == NULL) {
+        cerr << "Failed to create tcp service" << endl;
+        return 1;
+    }
+    if (!svc_register(transp, PLACEMENT_CONTROLLER_PROGRAM, PLACEMENT_CONTROLLER_V1, placement_controller_program, IPPROTO_TCP)) {
+        cerr << "Failed to register tcp PlacementRouter" << endl;
+        return 1;
+    }
+
+    // Dump tracing spans on SIGUSR2 (see common/SpanTrace.hpp)
+    TRACE_DUMP_ON_SIGNAL(SIGUSR2, "PlacementRouter");
+
+    // Run proxy
+    svc_run();
+    cerr << "svc_run returned" << endl;
+    delete g_pool;
+    for (unsigned int i = 0; i < g_shards.size(); i++) {
+        delete g_shards[i].clnt;
+    }
+    return 1;
+}
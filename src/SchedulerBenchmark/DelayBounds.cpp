@@ -0,0 +1,50 @@
+// DelayBounds.cpp - Code for calculating the DNC delay bounds of the tenants of SchedulerBenchmark.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <json/json.h>
+#include "../DNC-Library/DNC.hpp"
+#include "DelayBounds.hpp"
+
+using namespace std;
+
+// Calculate the DNC delay bound of each flow sharing a queue with the given bandwidth.
+void calcDelayBounds(double bandwidth, const vector<DelayBoundFlow>& flows, vector<double>& bounds)
+{
+    DNC dnc;
+    Json::Value queueInfo;
+    queueInfo["name"] = Json::Value("storage");
+    queueInfo["bandwidth"] = Json::Value(bandwidth);
+    dnc.addQueue(queueInfo);
+    vector<ClientId> clientIds(flows.size(), InvalidClientId);
+    for (unsigned int i = 0; i < flows.size(); i++) {
+        const DelayBoundFlow& flow = flows[i];
+        if (flow.rates.empty()) {
+            continue;
+        }
+        Json::Value flowInfo;
+        flowInfo["name"] = Json::Value(flow.name);
+        flowInfo["queues"] = Json::arrayValue;
+        flowInfo["queues"].append(Json::Value("storage"));
+        flowInfo["priority"] = Json::Value(flow.priority + 1); // DNC priorities are positive
+        DNC::setArrivalInfo(flowInfo, flow.rates, flow.bursts);
+        Json::Value clientInfo;
+        clientInfo["name"] = Json::Value(flow.name);
+        clientInfo["flows"] = Json::arrayValue;
+        clientInfo["flows"].append(flowInfo);
+        clientInfo["SLO"] = Json::Value(1);
+        clientIds[i] = dnc.addClient(clientInfo);
+        SimpleArrivalCurve shaperCurve;
+        shaperCurve.r = flow.rate;
+        shaperCurve.b = flow.burst;
+        dnc.setShaperCurve(dnc.getFlowIdByName(flow.name), shaperCurve);
+    }
+    bounds.assign(flows.size(), 0);
+    for (unsigned int i = 0; i < flows.size(); i++) {
+        if (clientIds[i] != InvalidClientId) {
+            bounds[i] = dnc.calcClientLatency(clientIds[i]);
+        }
+    }
+}
@@ -0,0 +1,30 @@
+// DelayBounds.hpp - Definitions for calculating the DNC delay bounds of the tenants of SchedulerBenchmark.
+// Kept apart from SchedulerBenchmark.cpp since the DNC library and the NFSEnforcer scheduler both define a Client type.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _DELAY_BOUNDS_HPP
+#define _DELAY_BOUNDS_HPP
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// A tenant's flow through the scheduler.
+struct DelayBoundFlow {
+    string name;
+    unsigned int priority; // scheduler priority (lower = higher priority)
+    double rate; // rate limit (work per second)
+    double burst; // rate limit (work)
+    vector<double> rates; // observed r-b curve (see RbEstimator::getRbCurve); empty if the tenant had no requests
+    vector<double> bursts;
+};
+
+// Calculate the DNC delay bound (in seconds) of each flow sharing a queue with the given bandwidth (in work per second).
+// Flows without an observed r-b curve get a bound of 0.
+void calcDelayBounds(double bandwidth, const vector<DelayBoundFlow>& flows, vector<double>& bounds);
+
+#endif // _DELAY_BOUNDS_HPP
@@ -0,0 +1,567 @@
+// SchedulerBenchmark.cpp - drives the NFSEnforcer scheduler with synthetic multi-tenant job streams, without an NFS server or RPC stack.
+// Submitter threads generate the jobs of each tenant (a.k.a. workload) and submit them to a Scheduler as NFSEnforcer's receive threads do.
+// A tenant's jobs either replay a trace file or are generated greedily from an (r,b) profile (i.e., each job arrives as soon as a token bucket
+// with rate r and burst b covers it), and the tenant is rate limited by the scheduler with its own (r,b) parameters.
+// Worker threads forward the scheduled jobs to stubbed RPC clients, which emulate a storage device serving work (see Estimator.hpp) at a given
+// bandwidth in arrival order, or complete each job after a fixed service time for measuring the dispatch overhead in isolation.
+// The report includes the time spent in the Scheduler's SubmitJob, GetNextJob, and CompleteJob calls, the contention on the mutexes they take
+// (measured by wrapping pthread_mutex_lock at link time; see Makefile), and the delay of each tenant's jobs from being submitted to being
+// completed compared with the delay bound calculated by DNC for the tenant's observed r-b curve, priority, and rate limit.
+//
+// Command line parameters:
+// -c configFile (required) - NFSEnforcer config file that specifies the storage profile and MPLs; see profile file description in README
+// -w tenantsFile (required) - JSON list of tenants; see README for format
+// -o outputFilename (optional) - output file to store the JSON report; defaults to stdout
+// -d duration (optional) - seconds to submit jobs for; defaults to 10
+// -t numSubmitThreads (optional) - number of threads submitting jobs, each generating the jobs of every numSubmitThreads-th tenant; defaults to 4
+// -k numWorkers (optional) - number of worker threads, each with its own stubbed RPC client; defaults to readMPL + writeMPL
+// -b bandwidth (optional) - work per second served by the emulated storage device; defaults to 1 (i.e., storage seconds per second)
+// -f fixedServiceTime (optional) - if given, the stubbed RPC clients complete each job after this many seconds (e.g., 0) instead of emulating
+//                                  the storage device, and delay bounds are not calculated
+// -r numRates (optional) - number of rates of the r-b curves observed for the delay bounds; defaults to 100
+// -q maxPendingJobs (optional) - a tenant's jobs are held back while it has this many jobs pending in the scheduler, so that an overloaded
+//                                run does not queue without bound; 0 for no limit; defaults to 1024
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <queue>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <rpc/rpc.h>
+#include <json/json.h>
+#include "../common/time.hpp"
+#include "../common/common.hpp"
+#include "../Estimator/Estimator.hpp"
+#include "../TraceCommon/TraceReader.hpp"
+#include "../TraceCommon/RbEstimator.hpp"
+#include "../NFSEnforcer/scheduler.hpp"
+#include "DelayBounds.hpp"
+
+using namespace std;
+
+// Waits shorter than this are spun rather than slept, since sleeps overshoot by tens of microseconds
+#define SPIN_THRESHOLD_NS 100000
+// Time until a throttled tenant's job is retried
+#define THROTTLE_RETRY_NS 10000
+
+// A tenant's configuration and measurements.
+struct Tenant {
+    string name;
+    unsigned long s_addr;
+    unsigned int priority;
+    double rate; // rate limit (work per second)
+    double burst; // rate limit (work)
+    // Job generation; from the trace if pTrace is set, otherwise greedily from (arrivalRate, arrivalBurst)
+    double arrivalRate;
+    double arrivalBurst;
+    int requestSize;
+    unsigned int readPercent;
+    TraceReader* pTrace;
+    uint64_t traceStartTime;
+    // Next job
+    uint64_t nextTime;
+    int nextRequestSize;
+    bool nextIsRead;
+    double nextWork;
+    double tokens;
+    uint64_t tokensTime;
+    unsigned int seed;
+    // Measurements
+    RbEstimator* pRbEstimator; // only used by the tenant's submitter thread
+    uint64_t submittedJobs;
+    LatencyHistogram delay; // time in nanoseconds from a job being submitted to being completed
+    volatile uint64_t maxDelay; // exact maximum of delay, since histogram buckets only bound it
+};
+
+// State of a stubbed RPC client.
+struct StubClient {
+    CLIENT cl;
+    Job* pJob; // job being forwarded
+};
+
+Scheduler* g_sched;
+Estimator* g_pEst;
+vector<Tenant*> g_tenants;
+double g_bandwidth = 1;
+bool g_fixedServiceTime = false;
+uint64_t g_serviceTime = 0;
+int g_maxPendingJobs = 1024;
+// Time at which the emulated storage device finishes the jobs forwarded to it so far
+volatile uint64_t g_deviceFreeTime = 0;
+volatile uint64_t g_completedJobs = 0;
+// Scheduler call times in nanoseconds
+LatencyHistogram g_submitJobTime;
+LatencyHistogram g_getNextJobTime;
+LatencyHistogram g_completeJobTime;
+// Mutex contention
+volatile uint64_t g_lockAcquisitions = 0;
+volatile uint64_t g_lockContentions = 0;
+LatencyHistogram g_lockWaitTime;
+
+// pthread_mutex_lock is wrapped at link time (-Wl,--wrap=pthread_mutex_lock) to measure how often and how long threads wait for mutexes.
+extern "C" int __real_pthread_mutex_lock(pthread_mutex_t* mutex);
+extern "C" int __wrap_pthread_mutex_lock(pthread_mutex_t* mutex)
+{
+    if (pthread_mutex_trylock(mutex) == 0) {
+        __sync_fetch_and_add(&g_lockAcquisitions, 1);
+        return 0;
+    }
+    uint64_t startTime = GetTime();
+    int rc = __real_pthread_mutex_lock(mutex);
+    g_lockWaitTime.record(GetTime() - startTime);
+    __sync_fetch_and_add(&g_lockAcquisitions, 1);
+    __sync_fetch_and_add(&g_lockContentions, 1);
+    return rc;
+}
+
+// Wait until time t, spinning for the last SPIN_THRESHOLD_NS.
+void waitUntil(uint64_t t)
+{
+    uint64_t now = GetTime();
+    if (t > now + SPIN_THRESHOLD_NS) {
+        AbsoluteSleepUninterruptible(t - SPIN_THRESHOLD_NS);
+    }
+    while (GetTime() < t) {
+    }
+}
+
+// Stubbed clnt_call, which is templated on the procedure and argument types since they differ between RPC implementations (e.g., glibc and libtirpc).
+// Completes the forwarded job once the emulated storage device has served it, or after the fixed service time.
+template <typename Proc, typename Arg>
+static enum clnt_stat stubCall(CLIENT* cl, Proc proc, xdrproc_t xargs, Arg argsp, xdrproc_t xres, Arg resp, struct timeval timeout)
+{
+    StubClient* pStub = (StubClient*)cl->cl_private;
+    uint64_t now = GetTime();
+    uint64_t finishTime;
+    if (g_fixedServiceTime) {
+        finishTime = now + g_serviceTime;
+    } else {
+        // Serve the job after the jobs forwarded before it
+        uint64_t serviceTime = ConvertSecondsToTime(pStub->pJob->JobSize() / g_bandwidth);
+        uint64_t deviceFreeTime;
+        do {
+            deviceFreeTime = g_deviceFreeTime;
+            finishTime = max(now, deviceFreeTime) + serviceTime;
+        } while (!__sync_bool_compare_and_swap(&g_deviceFreeTime, deviceFreeTime, finishTime));
+    }
+    waitUntil(finishTime);
+    return RPC_SUCCESS;
+}
+
+// Operations of the stubbed RPC clients; only clnt_call is used
+CLIENT::clnt_ops g_stubOps;
+
+// Create a stubbed RPC client.
+CLIENT* createStubClient()
+{
+    StubClient* pStub = new StubClient;
+    memset(pStub, 0, sizeof(*pStub));
+    pStub->cl.cl_ops = &g_stubOps;
+    pStub->cl.cl_private = (caddr_t)pStub;
+    return &pStub->cl;
+}
+
+// Forwards scheduled jobs to the worker's stubbed RPC client, as NFSEnforcer's workers with their own RPC clients do.
+void* workerThread(void* ptr)
+{
+    static struct timeval TIMEOUT = { 25, 0 };
+    CLIENT* cl = createStubClient();
+    StubClient* pStub = (StubClient*)cl->cl_private;
+    while (true) {
+        uint64_t startTime = GetTime();
+        Job* pJob = g_sched->GetNextJob();
+        g_getNextJobTime.record(GetTime() - startTime);
+        pJob->cl = cl;
+        pStub->pJob = pJob;
+        clnt_call(cl, pJob->Proc(),
+                  (xdrproc_t)xdr_void, (caddr_t)NULL,
+                  (xdrproc_t)xdr_void, (caddr_t)NULL,
+                  TIMEOUT);
+        Tenant* pTenant = g_tenants[pJob->Addr() - 1];
+        uint64_t completeTime = GetTime();
+        uint64_t delay = completeTime - pJob->ArrivalTime();
+        pTenant->delay.record(delay);
+        uint64_t maxDelay;
+        while ((delay > (maxDelay = pTenant->maxDelay)) && !__sync_bool_compare_and_swap(&pTenant->maxDelay, maxDelay, delay)) {
+        }
+        g_sched->CompleteJob(pJob, false);
+        g_completeJobTime.record(GetTime() - completeTime);
+        __sync_fetch_and_add(&g_completedJobs, 1);
+    }
+    return NULL;
+}
+
+// Determine a tenant's next job. Returns false if the tenant's trace has ended.
+bool nextTenantJob(Tenant* pTenant, uint64_t now)
+{
+    if (pTenant->pTrace != NULL) {
+        TraceEntry entry;
+        if (!pTenant->pTrace->nextEntry(entry)) {
+            return false;
+        }
+        if (pTenant->traceStartTime == 0) {
+            pTenant->traceStartTime = now - entry.arrivalTime;
+        }
+        pTenant->nextTime = pTenant->traceStartTime + entry.arrivalTime;
+        pTenant->nextRequestSize = entry.requestSize;
+        pTenant->nextIsRead = entry.isRead;
+        pTenant->nextWork = g_pEst->estimateWork(pTenant->nextRequestSize, pTenant->nextIsRead);
+        return true;
+    }
+    pTenant->nextRequestSize = pTenant->requestSize;
+    pTenant->nextIsRead = ((unsigned int)(rand_r(&pTenant->seed) % 100) < pTenant->readPercent);
+    pTenant->nextWork = g_pEst->estimateWork(pTenant->nextRequestSize, pTenant->nextIsRead);
+    // Arrive as soon as the token bucket covers the job
+    double tokens = min(pTenant->arrivalBurst, pTenant->tokens + pTenant->arrivalRate * ConvertTimeToSeconds(now - pTenant->tokensTime));
+    uint64_t waitTime = 0;
+    if (tokens < pTenant->nextWork) {
+        waitTime = ConvertSecondsToTime((pTenant->nextWork - tokens) / pTenant->arrivalRate);
+        tokens = pTenant->nextWork;
+    }
+    pTenant->nextTime = now + waitTime;
+    pTenant->tokens = tokens - pTenant->nextWork;
+    pTenant->tokensTime = pTenant->nextTime;
+    return true;
+}
+
+struct SubmitterArgs {
+    vector<Tenant*> tenants;
+    uint64_t endTime;
+};
+
+// Submits the jobs of a set of tenants until the end time, in arrival order.
+void* submitterThread(void* ptr)
+{
+    SubmitterArgs* pArgs = (SubmitterArgs*)ptr;
+    uint64_t now = GetTime();
+    priority_queue<pair<uint64_t, unsigned int>, vector<pair<uint64_t, unsigned int> >, greater<pair<uint64_t, unsigned int> > > arrivals;
+    for (unsigned int i = 0; i < pArgs->tenants.size(); i++) {
+        Tenant* pTenant = pArgs->tenants[i];
+        pTenant->tokens = pTenant->arrivalBurst;
+        pTenant->tokensTime = now;
+        if (nextTenantJob(pTenant, now)) {
+            arrivals.push(make_pair(pTenant->nextTime, i));
+        }
+    }
+    while (!arrivals.empty() && (arrivals.top().first < pArgs->endTime)) {
+        unsigned int index = arrivals.top().second;
+        Tenant* pTenant = pArgs->tenants[index];
+        arrivals.pop();
+        waitUntil(pTenant->nextTime);
+        // Hold back the job while the tenant has too many pending jobs, as NFSEnforcer stops receiving from a throttled connection
+        if ((g_maxPendingJobs > 0) && (g_sched->GetNumPendingJobs(pTenant->s_addr) >= g_maxPendingJobs)) {
+            pTenant->nextTime = GetTime() + THROTTLE_RETRY_NS;
+            arrivals.push(make_pair(pTenant->nextTime, index));
+            continue;
+        }
+        Job* pJob = new Job;
+        pJob->rq_proc = pTenant->nextIsRead ? NFSPROC3_READ : NFSPROC3_WRITE;
+        pJob->fd = (int)pTenant->s_addr; // selects the submission queue as the tenant's connection would
+        pJob->s_addr = pTenant->s_addr;
+        pJob->immediate = false;
+        pJob->requestSize = pTenant->nextRequestSize;
+        uint64_t startTime = GetTime();
+        if (pTenant->pRbEstimator != NULL) {
+            pTenant->pRbEstimator->addRequest(startTime, pTenant->nextWork);
+        }
+        g_sched->SubmitJob(pJob);
+        g_submitJobTime.record(GetTime() - startTime);
+        pTenant->submittedJobs++;
+        if (nextTenantJob(pTenant, pTenant->nextTime)) {
+            arrivals.push(make_pair(pTenant->nextTime, index));
+        }
+    }
+    return NULL;
+}
+
+// Summarize a snapshot of a histogram of nanoseconds in seconds.
+Json::Value latencyToJson(unsigned int firstBucket, const vector<uint64_t>& counts)
+{
+    uint64_t count = 0;
+    for (unsigned int i = 0; i < counts.size(); i++) {
+        count += counts[i];
+    }
+    Json::Value summary;
+    summary["count"] = (Json::UInt64)count;
+    summary["p50"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.5));
+    summary["p90"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.9));
+    summary["p99"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.99));
+    summary["p999"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 0.999));
+    summary["max"] = ConvertTimeToSeconds(LatencyHistogram::quantile(firstBucket, counts, 1));
+    return summary;
+}
+
+// Summarize a histogram of nanoseconds in seconds.
+Json::Value latencyToJson(const LatencyHistogram& histogram)
+{
+    unsigned int firstBucket;
+    vector<uint64_t> counts;
+    histogram.snapshot(firstBucket, counts);
+    return latencyToJson(firstBucket, counts);
+}
+
+// Append the copy index to a name if there are multiple copies.
+string copyName(const string& name, unsigned int copy, unsigned int numCopies)
+{
+    if (numCopies <= 1) {
+        return name;
+    }
+    ostringstream oss;
+    oss << name << "-" << copy;
+    return oss.str();
+}
+
+int main(int argc, char** argv)
+{
+    char* configFilename = NULL;
+    char* tenantsFilename = NULL;
+    char* outputFilename = NULL;
+    double duration = 10;
+    int numSubmitThreads = 4;
+    int numWorkers = 0;
+    unsigned int numRates = 100;
+
+    // Get arguments
+    int opt = 0;
+    do {
+        opt = getopt(argc, argv, "c:w:o:d:t:k:b:f:r:q:");
+        switch (opt) {
+            case 'c':
+                configFilename = optarg;
+                break;
+
+            case 'w':
+                tenantsFilename = optarg;
+                break;
+
+            case 'o':
+                outputFilename = optarg;
+                break;
+
+            case 'd':
+                duration = atof(optarg);
+                break;
+
+            case 't':
+                numSubmitThreads = atoi(optarg);
+                break;
+
+            case 'k':
+                numWorkers = atoi(optarg);
+                break;
+
+            case 'b':
+                g_bandwidth = atof(optarg);
+                break;
+
+            case 'f':
+                g_fixedServiceTime = true;
+                g_serviceTime = ConvertSecondsToTime(atof(optarg));
+                break;
+
+            case 'r':
+                numRates = atoi(optarg);
+                break;
+
+            case 'q':
+                g_maxPendingJobs = atoi(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                break;
+        }
+    } while (opt != -1);
+
+    if ((configFilename == NULL) || (tenantsFilename == NULL) || (numSubmitThreads <= 0) || (g_bandwidth <= 0) || (numRates == 0)) {
+        cout << "Usage: " << argv[0] << " -c configFile -w tenantsFile [-o outputFilename] [-d duration] [-t numSubmitThreads] [-k numWorkers] [-b bandwidth] [-f fixedServiceTime] [-r numRates] [-q maxPendingJobs]" << endl;
+        return -1;
+    }
+
+    // Read config
+    Json::Value config;
+    if (!readJson(configFilename, config)) {
+        return -1;
+    }
+    if (!config.isMember("type")) {
+        config["type"] = Json::Value("storageSSD");
+    }
+    int readMPL = config.isMember("readMPL") ? config["readMPL"].asInt() : config["MPL"].asInt();
+    int writeMPL = config.isMember("writeMPL") ? config["writeMPL"].asInt() : config["MPL"].asInt();
+    int maxOutstandingReadBytes = config.isMember("maxOutstandingReadBytes") ? config["maxOutstandingReadBytes"].asInt() : 1024 * 1024 * 1024;
+    int maxOutstandingWriteBytes = config.isMember("maxOutstandingWriteBytes") ? config["maxOutstandingWriteBytes"].asInt() : 1024 * 1024 * 1024;
+    if (numWorkers <= 0) {
+        numWorkers = readMPL + writeMPL;
+    }
+    g_pEst = Estimator::create(config);
+    Json::Value tenantInfos;
+    if (!readJson(tenantsFilename, tenantInfos)) {
+        return -1;
+    }
+    for (unsigned int i = 0; i < tenantInfos.size(); i++) {
+        const Json::Value& tenantInfo = tenantInfos[i];
+        unsigned int numCopies = tenantInfo.isMember("copies") ? tenantInfo["copies"].asUInt() : 1;
+        for (unsigned int copy = 0; copy < numCopies; copy++) {
+            Tenant* pTenant = new Tenant;
+            pTenant->name = copyName(tenantInfo["name"].asString(), copy, numCopies);
+            pTenant->s_addr = g_tenants.size() + 1;
+            pTenant->priority = tenantInfo.isMember("priority") ? tenantInfo["priority"].asUInt() : 0;
+            pTenant->rate = tenantInfo["rate"].asDouble();
+            pTenant->burst = tenantInfo["burst"].asDouble();
+            pTenant->arrivalRate = tenantInfo.isMember("arrivalRate") ? tenantInfo["arrivalRate"].asDouble() : pTenant->rate;
+            pTenant->arrivalBurst = tenantInfo.isMember("arrivalBurst") ? tenantInfo["arrivalBurst"].asDouble() : pTenant->burst;
+            pTenant->requestSize = tenantInfo.isMember("requestSize") ? tenantInfo["requestSize"].asInt() : 4096;
+            pTenant->readPercent = tenantInfo.isMember("readPercent") ? tenantInfo["readPercent"].asUInt() : 100;
+            pTenant->pTrace = tenantInfo.isMember("trace") ? new TraceReader(tenantInfo["trace"].asString()) : NULL;
+            pTenant->traceStartTime = 0;
+            pTenant->seed = g_tenants.size();
+            pTenant->pRbEstimator = g_fixedServiceTime ? NULL : new RbEstimator(g_bandwidth, numRates);
+            pTenant->submittedJobs = 0;
+            pTenant->maxDelay = 0;
+            if ((pTenant->pTrace == NULL) && (pTenant->arrivalRate <= 0)) {
+                cerr << "Tenant " << pTenant->name << " needs a trace or a positive arrival rate" << endl;
+                return -1;
+            }
+            g_tenants.push_back(pTenant);
+        }
+    }
+
+    // Create scheduler; workers set their own stubbed RPC clients on jobs, so the scheduler is not given an RPC client pool
+    g_sched = new Scheduler(vector<CLIENT*>(), maxOutstandingReadBytes, maxOutstandingWriteBytes, readMPL, writeMPL, g_pEst);
+    for (unsigned int i = 0; i < g_tenants.size(); i++) {
+        Tenant* pTenant = g_tenants[i];
+        g_sched->UpdateClient(pTenant->s_addr, pTenant->priority, 1, &pTenant->rate, &pTenant->burst, pTenant->name);
+    }
+    memset(&g_stubOps, 0, sizeof(g_stubOps));
+    g_stubOps.cl_call = stubCall;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < numWorkers; i++) {
+        pthread_t thread;
+        int rc = pthread_create(&thread, &attr, workerThread, NULL);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << endl;
+            return -1;
+        }
+    }
+
+    // Submit jobs
+    struct rusage startUsage;
+    getrusage(RUSAGE_SELF, &startUsage);
+    uint64_t lockAcquisitions = g_lockAcquisitions;
+    uint64_t lockContentions = g_lockContentions;
+    uint64_t runStartTime = GetTime();
+    vector<SubmitterArgs> submitterArgs(numSubmitThreads);
+    vector<pthread_t> submitters(numSubmitThreads);
+    for (int i = 0; i < numSubmitThreads; i++) {
+        submitterArgs[i].endTime = runStartTime + ConvertSecondsToTime(duration);
+        for (unsigned int j = i; j < g_tenants.size(); j += numSubmitThreads) {
+            submitterArgs[i].tenants.push_back(g_tenants[j]);
+        }
+        int rc = pthread_create(&submitters[i], NULL, submitterThread, (void*)&submitterArgs[i]);
+        if (rc) {
+            cerr << "Error creating thread: " << rc << endl;
+            return -1;
+        }
+    }
+    for (int i = 0; i < numSubmitThreads; i++) {
+        pthread_join(submitters[i], NULL);
+    }
+    uint64_t submitEndTime = GetTime();
+    // Wait for the submitted jobs to complete
+    uint64_t submittedJobs = 0;
+    for (unsigned int i = 0; i < g_tenants.size(); i++) {
+        submittedJobs += g_tenants[i]->submittedJobs;
+    }
+    while (g_completedJobs < submittedJobs) {
+        RelativeSleepUninterruptible(ConvertSecondsToTime(0.001));
+    }
+    uint64_t runEndTime = GetTime();
+    struct rusage endUsage;
+    getrusage(RUSAGE_SELF, &endUsage);
+    double submitElapsed = ConvertTimeToSeconds(submitEndTime - runStartTime);
+    double elapsed = ConvertTimeToSeconds(runEndTime - runStartTime);
+
+    // Write report
+    Json::Value report;
+    report["numTenants"] = Json::Value((unsigned int)g_tenants.size());
+    report["numSubmitThreads"] = Json::Value(numSubmitThreads);
+    report["numWorkers"] = Json::Value(numWorkers);
+    report["submittedJobs"] = Json::Value((Json::UInt64)submittedJobs);
+    report["submitElapsed"] = Json::Value(submitElapsed);
+    report["elapsed"] = Json::Value(elapsed);
+    report["jobsPerSec"] = Json::Value((elapsed > 0) ? (submittedJobs / elapsed) : 0);
+    report["submitJob"] = latencyToJson(g_submitJobTime);
+    report["getNextJob"] = latencyToJson(g_getNextJobTime); // includes waiting for jobs to be schedulable
+    report["completeJob"] = latencyToJson(g_completeJobTime);
+    Json::Value& locks = report["locks"];
+    locks["acquisitions"] = Json::Value((Json::UInt64)(g_lockAcquisitions - lockAcquisitions));
+    locks["contended"] = Json::Value((Json::UInt64)(g_lockContentions - lockContentions));
+    locks["wait"] = latencyToJson(g_lockWaitTime);
+    locks["voluntaryContextSwitches"] = Json::Value((Json::Int64)(endUsage.ru_nvcsw - startUsage.ru_nvcsw));
+    locks["involuntaryContextSwitches"] = Json::Value((Json::Int64)(endUsage.ru_nivcsw - startUsage.ru_nivcsw));
+    vector<double> bounds;
+    if (!g_fixedServiceTime) {
+        vector<DelayBoundFlow> flows(g_tenants.size());
+        for (unsigned int i = 0; i < g_tenants.size(); i++) {
+            const Tenant* pTenant = g_tenants[i];
+            flows[i].name = pTenant->name;
+            flows[i].priority = pTenant->priority;
+            flows[i].rate = pTenant->rate;
+            flows[i].burst = pTenant->burst;
+            pTenant->pRbEstimator->getRbCurve(flows[i].rates, flows[i].bursts);
+        }
+        calcDelayBounds(g_bandwidth, flows, bounds);
+    }
+    vector<ClientStatsSnapshot> stats;
+    g_sched->GetStats(vector<unsigned long>(), stats);
+    unsigned int numBoundViolations = 0;
+    report["tenants"] = Json::arrayValue;
+    for (unsigned int i = 0; i < stats.size(); i++) {
+        const ClientStatsSnapshot& s = stats[i];
+        const Tenant* pTenant = g_tenants[s.s_addr - 1];
+        Json::Value tenantReport;
+        tenantReport["name"] = Json::Value(pTenant->name);
+        tenantReport["priority"] = Json::Value(pTenant->priority);
+        tenantReport["jobs"] = Json::Value((Json::UInt64)pTenant->submittedJobs);
+        tenantReport["conformingJobs"] = Json::Value((Json::UInt64)s.conformingJobs);
+        tenantReport["nonconformingJobs"] = Json::Value((Json::UInt64)s.nonconformingJobs);
+        tenantReport["queueTime"] = latencyToJson(s.queueTimeFirstBucket, s.queueTimeCounts);
+        tenantReport["delay"] = latencyToJson(pTenant->delay);
+        tenantReport["maxDelay"] = Json::Value(ConvertTimeToSeconds(pTenant->maxDelay));
+        if (!bounds.empty()) {
+            tenantReport["delayBound"] = Json::Value(bounds[s.s_addr - 1]);
+            if (ConvertTimeToSeconds(pTenant->maxDelay) > bounds[s.s_addr - 1]) {
+                numBoundViolations++;
+            }
+        }
+        report["tenants"].append(tenantReport);
+    }
+    if (!bounds.empty()) {
+        report["boundViolations"] = Json::Value(numBoundViolations);
+    }
+    if (outputFilename) {
+        ofstream file(outputFilename);
+        file << report;
+    } else {
+        cout << report;
+    }
+    // Exit without deleting the scheduler, whose destructor waits for its keepalive thread, while the workers wait for jobs
+    return 0;
+}
@@ -4,6 +4,7 @@
 // Licensed under the MIT License. See LICENSE file for details.
 //
 
+#include <algorithm>
 #include <string>
 #include "../Estimator/Estimator.hpp"
 #include "TraceReader.hpp"
@@ -11,15 +12,37 @@
 
 using namespace std;
 
-ProcessedTrace::ProcessedTrace(string filename, Estimator* pEst)
-    : _traceReader(filename),
+ProcessedTrace::ProcessedTrace(string filename, Estimator* pEst, TraceReaderMode mode)
+    : _traceReader(filename, mode),
       _pEst(pEst)
 {
+    _batchEntries = new TraceEntry[PROCESSED_TRACE_BATCH_SIZE];
+    _batchRequestSizes = new int[PROCESSED_TRACE_BATCH_SIZE];
+    _batchIsReadRequests = new bool[PROCESSED_TRACE_BATCH_SIZE];
+    _batchWorks = new double[PROCESSED_TRACE_BATCH_SIZE];
 }
 
 ProcessedTrace::~ProcessedTrace()
 {
     delete _pEst;
+    delete[] _batchEntries;
+    delete[] _batchRequestSizes;
+    delete[] _batchIsReadRequests;
+    delete[] _batchWorks;
+}
+
+// Dispatch on the estimator type once so that each request is converted without a virtual call.
+ProcessedTrace* ProcessedTrace::create(string filename, Estimator* pEst, TraceReaderMode mode)
+{
+    switch (pEst->estimatorType()) {
+        case ESTIMATOR_NETWORK_IN:
+            return new EstimatorProcessedTrace<NetworkInEstimator>(filename, static_cast<NetworkInEstimator*>(pEst), mode);
+        case ESTIMATOR_NETWORK_OUT:
+            return new EstimatorProcessedTrace<NetworkOutEstimator>(filename, static_cast<NetworkOutEstimator*>(pEst), mode);
+        case ESTIMATOR_STORAGE:
+            return new EstimatorProcessedTrace<StorageSSDEstimator>(filename, static_cast<StorageSSDEstimator*>(pEst), mode);
+    }
+    return new ProcessedTrace(filename, pEst, mode);
 }
 
 bool ProcessedTrace::nextEntry(ProcessedTraceEntry& entry)
@@ -34,6 +57,34 @@ bool ProcessedTrace::nextEntry(ProcessedTraceEntry& entry)
     return false;
 }
 
+unsigned int ProcessedTrace::nextEntries(ProcessedTraceEntry* entries, unsigned int maxEntries)
+{
+    unsigned int total = 0;
+    while (total < maxEntries) {
+        unsigned int batchSize = min(maxEntries - total, static_cast<unsigned int>(PROCESSED_TRACE_BATCH_SIZE));
+        unsigned int count = _traceReader.nextEntries(_batchEntries, batchSize);
+        if (count == 0) {
+            break;
+        }
+        for (unsigned int i = 0; i < count; i++) {
+            _batchRequestSizes[i] = _batchEntries[i].requestSize;
+            _batchIsReadRequests[i] = _batchEntries[i].isRead;
+        }
+        _pEst->estimateWorkBatch(count, _batchRequestSizes, _batchIsReadRequests, _batchWorks);
+        for (unsigned int i = 0; i < count; i++) {
+            ProcessedTraceEntry& entry = entries[total + i];
+            entry.arrivalTime = _batchEntries[i].arrivalTime;
+            entry.work = _batchWorks[i];
+            entry.isRead = _batchEntries[i].isRead;
+        }
+        total += count;
+        if (count < batchSize) {
+            break;
+        }
+    }
+    return total;
+}
+
 void ProcessedTrace::reset()
 {
     _traceReader.reset();
@@ -1,5 +1,7 @@
 // ProcessedTrace.hpp - Class definitions representing a trace that has been processed with an estimator.
 // Uses the given estimator to convert request sizes in a trace into generic "work" units (see Estimator.hpp for details).
+// ProcessedTrace::create returns a ProcessedTrace specialized on the estimator's type, so that converting requests to work
+// does not go through the Estimator's virtual functions and the estimator's work function can be inlined into the conversion loop.
 //
 // Copyright (c) 2017 Timothy Zhu.
 // Licensed under the MIT License. See LICENSE file for details.
@@ -8,6 +10,7 @@
 #ifndef _PROCESSED_TRACE_HPP
 #define _PROCESSED_TRACE_HPP
 
+#include <algorithm>
 #include <string>
 #include <stdint.h>
 #include "../Estimator/Estimator.hpp"
@@ -21,22 +24,91 @@ struct ProcessedTraceEntry {
     bool isRead; // true if read request, false if write request
 };
 
+// Maximum number of requests converted to work in one estimator call by nextEntries.
+#define PROCESSED_TRACE_BATCH_SIZE 4096
+
 // Reads requests from trace file with TraceReader and converts each request's request size into work using the given estimator.
 // ProcessedTrace is not thread-safe.
 class ProcessedTrace
 {
-private:
+protected:
     TraceReader _traceReader;
     Estimator* _pEst;
+    // Buffers for nextEntries
+    TraceEntry* _batchEntries;
+    int* _batchRequestSizes;
+    bool* _batchIsReadRequests;
+    double* _batchWorks;
 
 public:
-    ProcessedTrace(string filename, Estimator* pEst);
+    ProcessedTrace(string filename, Estimator* pEst, TraceReaderMode mode = TRACE_READER_AUTO);
     virtual ~ProcessedTrace();
 
+    // Create a ProcessedTrace specialized on the type of pEst; see EstimatorProcessedTrace.
+    // The result behaves the same as a ProcessedTrace constructed with the same arguments, and likewise owns pEst.
+    // Assumes pEst's work function agrees with its estimateWork, as is the case for the estimators returned by Estimator::create.
+    static ProcessedTrace* create(string filename, Estimator* pEst, TraceReaderMode mode = TRACE_READER_AUTO);
+
     // Fills entry with the next request from the trace. Returns false if end of trace.
     virtual bool nextEntry(ProcessedTraceEntry& entry);
+    // Fills entries with up to maxEntries of the next requests from the trace. Returns the number of entries filled; 0 if end of trace.
+    // The work of each batch of requests is estimated with a single estimator call.
+    virtual unsigned int nextEntries(ProcessedTraceEntry* entries, unsigned int maxEntries);
     // Resets trace reader back to beginning of trace.
     virtual void reset();
 };
 
+// ProcessedTrace whose estimator is known to be of type Est.
+// Work is estimated with the non-virtual Est::work, which is inlined into the loops converting trace entries,
+// rather than with a virtual estimateWork call per request or an estimateWorkBatch call per batch that requires copying the requests into separate arrays.
+template <class Est>
+class EstimatorProcessedTrace : public ProcessedTrace
+{
+private:
+    const Est* _pTypedEst;
+
+public:
+    EstimatorProcessedTrace(string filename, Est* pEst, TraceReaderMode mode = TRACE_READER_AUTO)
+        : ProcessedTrace(filename, pEst, mode),
+          _pTypedEst(pEst)
+    {}
+    virtual ~EstimatorProcessedTrace() {}
+
+    virtual bool nextEntry(ProcessedTraceEntry& entry)
+    {
+        TraceEntry traceEntry;
+        if (_traceReader.nextEntry(traceEntry)) {
+            entry.arrivalTime = traceEntry.arrivalTime;
+            entry.work = _pTypedEst->work(traceEntry.requestSize, traceEntry.isRead);
+            entry.isRead = traceEntry.isRead;
+            return true;
+        }
+        return false;
+    }
+
+    virtual unsigned int nextEntries(ProcessedTraceEntry* entries, unsigned int maxEntries)
+    {
+        const Est& est = *_pTypedEst;
+        unsigned int total = 0;
+        while (total < maxEntries) {
+            unsigned int batchSize = min(maxEntries - total, static_cast<unsigned int>(PROCESSED_TRACE_BATCH_SIZE));
+            unsigned int count = _traceReader.nextEntries(_batchEntries, batchSize);
+            if (count == 0) {
+                break;
+            }
+            ProcessedTraceEntry* batch = entries + total;
+            for (unsigned int i = 0; i < count; i++) {
+                batch[i].arrivalTime = _batchEntries[i].arrivalTime;
+                batch[i].work = est.work(_batchEntries[i].requestSize, _batchEntries[i].isRead);
+                batch[i].isRead = _batchEntries[i].isRead;
+            }
+            total += count;
+            if (count < batchSize) {
+                break;
+            }
+        }
+        return total;
+    }
+};
+
 #endif // _PROCESSED_TRACE_HPP
@@ -0,0 +1,70 @@
+// RbEstimator.cpp - Code for estimating a workload's r-b curve online.
+// See RbEstimator.hpp for details.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <vector>
+#include <stdint.h>
+#include "../common/time.hpp"
+#include "RbEstimator.hpp"
+
+using namespace std;
+
+RbEstimator::RbEstimator(double maxRate, unsigned int numRates)
+{
+    for (unsigned int i = 0; i < numRates; i++) {
+        _rates.push_back(maxRate - i * (maxRate / numRates));
+    }
+    reset();
+}
+
+// Add a request that arrived at arrivalTime with the given work.
+void RbEstimator::addRequest(uint64_t arrivalTime, double work)
+{
+    if (_numRequests == 0) {
+        _firstArrivalTime = arrivalTime;
+    }
+    double interarrival = ConvertTimeToSeconds(arrivalTime - _prevArrivalTime);
+    for (unsigned int i = 0; i < _rates.size(); i++) {
+        // Drain token bucket for time since last request
+        double bucket = _virtualBucket[i] - _rates[i] * interarrival;
+        bucket = (bucket < 0) ? 0 : bucket;
+        // Add tokens for current request
+        bucket += work;
+        _virtualBucket[i] = bucket;
+        // Record max burst
+        _bursts[i] = (bucket > _bursts[i]) ? bucket : _bursts[i];
+    }
+    _prevArrivalTime = arrivalTime;
+    _totalWork += work;
+    _numRequests++;
+}
+
+// Get the r-b curve of the requests added since the last reset.
+bool RbEstimator::getRbCurve(vector<double>& rates, vector<double>& bursts) const
+{
+    rates.clear();
+    bursts.clear();
+    if ((_numRequests < 2) || (_prevArrivalTime == _firstArrivalTime)) {
+        return false;
+    }
+    double minRate = _totalWork / ConvertTimeToSeconds(_prevArrivalTime - _firstArrivalTime);
+    for (unsigned int i = 0; (i < _rates.size()) && (_rates[i] >= minRate); i++) {
+        rates.push_back(_rates[i]);
+        bursts.push_back(_bursts[i]);
+    }
+    return true;
+}
+
+// Forget all requests.
+void RbEstimator::reset()
+{
+    _virtualBucket.assign(_rates.size(), 0);
+    _bursts.assign(_rates.size(), 0);
+    _numRequests = 0;
+    _firstArrivalTime = 0;
+    _prevArrivalTime = 0;
+    _totalWork = 0;
+}
@@ -0,0 +1,47 @@
+// RbEstimator.hpp - Class definitions for estimating a workload's r-b curve online.
+// Rather than processing a trace file, RbEstimator is given each request as it arrives (e.g., by an enforcer that sees the live traffic),
+// and keeps a virtual token bucket for each of a fixed set of rates, so its memory use does not grow with the number of requests.
+// The resulting r-b curve is the same as the one calculated by rbGen (see DNC-Library/DNC.hpp) on a trace of the same requests.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _RB_ESTIMATOR_HPP
+#define _RB_ESTIMATOR_HPP
+
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+// Streaming r-b curve estimator for a workload.
+// Candidate rates are numRates evenly spaced rates from maxRate down towards 0.
+// RbEstimator is not thread-safe.
+class RbEstimator
+{
+private:
+    vector<double> _rates;
+    vector<double> _virtualBucket;
+    vector<double> _bursts;
+    uint64_t _numRequests;
+    uint64_t _firstArrivalTime;
+    uint64_t _prevArrivalTime;
+    double _totalWork;
+
+public:
+    RbEstimator(double maxRate, unsigned int numRates = 1000);
+
+    // Add a request that arrived at arrivalTime (in nanoseconds, no earlier than the previous request) with the given work.
+    void addRequest(uint64_t arrivalTime, double work);
+    // Number of requests added since the last reset.
+    uint64_t numRequests() const { return _numRequests; }
+    // Get the r-b curve of the requests added since the last reset, with decreasing rates.
+    // Rates below the average rate of the requests are omitted, since the workload cannot be sustained at those rates.
+    // Returns false if fewer than two requests have been added, in which case the average rate is unknown.
+    bool getRbCurve(vector<double>& rates, vector<double>& bursts) const;
+    // Forget all requests.
+    void reset();
+};
+
+#endif // _RB_ESTIMATOR_HPP
@@ -9,27 +9,186 @@
 #include <string>
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "TraceReader.hpp"
 
 using namespace std;
 
-TraceReader::TraceReader(string filename)
-    : _curIndex(0)
+// Zigzag encode a signed delta so that small negative deltas stay small.
+static inline uint64_t zigzagEncode(int64_t x)
+{
+    return (static_cast<uint64_t>(x) << 1) ^ static_cast<uint64_t>(x >> 63);
+}
+
+// Zigzag decode a delta.
+static inline int64_t zigzagDecode(uint64_t x)
+{
+    return static_cast<int64_t>(x >> 1) ^ -static_cast<int64_t>(x & 1);
+}
+
+// Append a varint to buf.
+static inline void varintEncode(vector<uint8_t>& buf, uint64_t x)
+{
+    while (x >= 0x80) {
+        buf.push_back(static_cast<uint8_t>(x | 0x80));
+        x >>= 7;
+    }
+    buf.push_back(static_cast<uint8_t>(x));
+}
+
+// Decode a varint from p, advancing p. Returns false if the varint runs past end.
+static inline bool varintDecode(const uint8_t*& p, const uint8_t* end, uint64_t& x)
+{
+    x = 0;
+    for (unsigned int shift = 0; (p < end) && (shift < 64); shift += 7) {
+        uint8_t byte = *p++;
+        x |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Offset of the request size column from the start of the file.
+static inline uint64_t sizeColumnOffset(uint64_t timeColumnBytes)
+{
+    return (sizeof(BinaryTraceHeader) + timeColumnBytes + 3) & ~static_cast<uint64_t>(3);
+}
+
+// Parse a line of a CSV trace. Returns false if the line is not a request.
+static inline bool parseLine(const char* line, TraceEntry& entry)
 {
     unsigned long long timestamp; // in nanoseconds
     unsigned long requestSize; // in bytes
     char isRead[32];
+    if (sscanf(line, "%llu,%lx,%31s", &timestamp, &requestSize, isRead) == 3) {
+        entry.arrivalTime = timestamp;
+        entry.requestSize = requestSize;
+        entry.isRead = (strcmp(isRead, "DiskRead") == 0);
+        return true;
+    }
+    return false;
+}
+
+TraceReader::TraceReader(string filename, TraceReaderMode mode, size_t chunkSize)
+    : _curIndex(0),
+      _binary(false),
+      _map(NULL),
+      _mapSize(0),
+      _numEntries(0),
+      _timeColumn(NULL),
+      _timeColumnEnd(NULL),
+      _sizeColumn(NULL),
+      _readBitmap(NULL),
+      _timeCursor(NULL),
+      _prevArrivalTime(0),
+      _streaming(false),
+      _fd(-1),
+      _chunkSize(chunkSize),
+      _fillIndex(0),
+      _readIndex(0),
+      _readOffset(0),
+      _readHeld(false),
+      _streamEnd(false),
+      _stopPrefetch(false)
+{
+    _chunks[0].data = NULL;
+    _chunks[1].data = NULL;
+    if (!openBinary(filename)) {
+        if (mode == TRACE_READER_AUTO) {
+            struct stat st;
+            if ((stat(filename.c_str(), &st) == 0) && (st.st_size > TRACE_READER_STREAM_THRESHOLD)) {
+                mode = TRACE_READER_STREAM;
+            }
+        }
+        if (mode == TRACE_READER_STREAM) {
+            openStream(filename);
+        } else {
+            openCSV(filename);
+        }
+    }
+}
+
+TraceReader::~TraceReader()
+{
+    if (_map != NULL) {
+        munmap(_map, _mapSize);
+    }
+    if (_streaming) {
+        stopStream();
+        close(_fd);
+        pthread_cond_destroy(&_streamCV);
+        pthread_mutex_destroy(&_streamMutex);
+    }
+    delete[] _chunks[0].data;
+    delete[] _chunks[1].data;
+}
+
+// Memory map a binary trace. Returns false if filename is not a binary trace.
+// A binary trace whose header does not match the file's size is rejected and read as an empty trace.
+bool TraceReader::openBinary(string filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    // Check magic
+    BinaryTraceHeader header;
+    struct stat st;
+    if ((fstat(fd, &st) != 0) ||
+        (st.st_size < static_cast<off_t>(sizeof(header))) ||
+        (pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) ||
+        (memcmp(header.magic, BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_SIZE) != 0)) {
+        close(fd);
+        return false;
+    }
+    // Check size; each request takes at least a byte of the time column and 4 bytes of the size column, which bounds the
+    // header's counts before they are used to compute the expected size
+    uint64_t fileSize = st.st_size;
+    _binary = true;
+    if ((header.timeColumnBytes > fileSize) || (header.numEntries > header.timeColumnBytes) ||
+        (fileSize != sizeColumnOffset(header.timeColumnBytes) + header.numEntries * sizeof(uint32_t) + (header.numEntries + 7) / 8)) {
+        cerr << "Binary trace " << filename << " does not match its header" << endl;
+        close(fd);
+        return true;
+    }
+    // Map file
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        cerr << "Unable to mmap " << filename << endl;
+        return true;
+    }
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    const uint8_t* base = static_cast<const uint8_t*>(map);
+    _map = map;
+    _mapSize = st.st_size;
+    _numEntries = header.numEntries;
+    _timeColumn = base + sizeof(header);
+    _timeColumnEnd = _timeColumn + header.timeColumnBytes;
+    _sizeColumn = reinterpret_cast<const uint32_t*>(base + sizeColumnOffset(header.timeColumnBytes));
+    _readBitmap = reinterpret_cast<const uint8_t*>(_sizeColumn + _numEntries);
+    _timeCursor = _timeColumn;
+    return true;
+}
+
+// Parse a CSV trace.
+void TraceReader::openCSV(string filename)
+{
     ifstream file(filename.c_str());
     if (file.is_open()) {
         string line;
+        TraceEntry entry;
         while (getline(file, line)) {
-            // Parse line
-            if (sscanf(line.c_str(), "%llu,%lx,%s", &timestamp, &requestSize, isRead) == 3) {
-                // Store results
-                TraceEntry entry;
-                entry.arrivalTime = timestamp;
-                entry.requestSize = requestSize;
-                entry.isRead = (strcmp(isRead, "DiskRead") == 0);
+            // Parse line and store results
+            if (parseLine(line.c_str(), entry)) {
                 _trace.push_back(entry);
             }
         }
@@ -39,12 +198,167 @@ TraceReader::TraceReader(string filename)
     }
 }
 
-TraceReader::~TraceReader()
+// Setup streaming of a CSV trace.
+void TraceReader::openStream(string filename)
+{
+    _fd = open(filename.c_str(), O_RDONLY);
+    if (_fd < 0) {
+        cerr << "Unable to open " << filename << endl;
+        return;
+    }
+    if (_chunkSize == 0) {
+        _chunkSize = TRACE_READER_CHUNK_SIZE;
+    }
+    _streaming = true;
+    _chunks[0].data = new char[_chunkSize];
+    _chunks[1].data = new char[_chunkSize];
+    pthread_mutex_init(&_streamMutex, NULL);
+    pthread_cond_init(&_streamCV, NULL);
+    startStream();
+}
+
+// Start the prefetch thread from the beginning of the file.
+void TraceReader::startStream()
+{
+    if (lseek(_fd, 0, SEEK_SET) < 0) {
+        cerr << "Failed lseek errno: " << errno << endl;
+    }
+    for (unsigned int i = 0; i < 2; i++) {
+        _chunks[i].size = 0;
+        _chunks[i].filled = false;
+    }
+    _fillIndex = 0;
+    _readIndex = 0;
+    _readOffset = 0;
+    _readHeld = false;
+    _streamEnd = false;
+    _stopPrefetch = false;
+    int rc = pthread_create(&_prefetchThread, NULL, prefetchThread, (void*)this);
+    if (rc) {
+        cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+        exit(-1);
+    }
+}
+
+// Stop the prefetch thread.
+void TraceReader::stopStream()
+{
+    pthread_mutex_lock(&_streamMutex);
+    _stopPrefetch = true;
+    pthread_cond_broadcast(&_streamCV);
+    pthread_mutex_unlock(&_streamMutex);
+    int rc = pthread_join(_prefetchThread, NULL);
+    if (rc) {
+        cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
+        exit(-1);
+    }
+}
+
+// Fill chunks in the background until end of file or stopped.
+void TraceReader::prefetch()
+{
+    pthread_mutex_lock(&_streamMutex);
+    while (!_stopPrefetch) {
+        StreamChunk& chunk = _chunks[_fillIndex];
+        // Wait for the parser to release the chunk
+        if (chunk.filled) {
+            pthread_cond_wait(&_streamCV, &_streamMutex);
+            continue;
+        }
+        pthread_mutex_unlock(&_streamMutex);
+        ssize_t numb;
+        do {
+            numb = read(_fd, chunk.data, _chunkSize);
+        } while ((numb < 0) && (errno == EINTR));
+        if (numb < 0) {
+            cerr << "Failed to read trace errno: " << errno << endl;
+        }
+        pthread_mutex_lock(&_streamMutex);
+        chunk.size = (numb > 0) ? numb : 0;
+        chunk.filled = true;
+        pthread_cond_broadcast(&_streamCV);
+        _fillIndex ^= 1;
+        if (chunk.size == 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_streamMutex);
+}
+
+void* TraceReader::prefetchThread(void* ptr)
 {
+    ((TraceReader*)ptr)->prefetch();
+    return NULL;
+}
+
+// Get the next line of a streamed trace. Returns false if end of trace.
+bool TraceReader::nextStreamLine(string& line)
+{
+    line.clear();
+    while (!_streamEnd) {
+        // Acquire the next chunk
+        if (!_readHeld) {
+            pthread_mutex_lock(&_streamMutex);
+            while (!_chunks[_readIndex].filled) {
+                pthread_cond_wait(&_streamCV, &_streamMutex);
+            }
+            pthread_mutex_unlock(&_streamMutex);
+            _readHeld = true;
+            _readOffset = 0;
+            if (_chunks[_readIndex].size == 0) {
+                // End of file; return the last line even if it has no newline
+                _streamEnd = true;
+                return !line.empty();
+            }
+        }
+        StreamChunk& chunk = _chunks[_readIndex];
+        const char* start = chunk.data + _readOffset;
+        size_t remaining = chunk.size - _readOffset;
+        const char* newline = static_cast<const char*>(memchr(start, '\n', remaining));
+        if (newline != NULL) {
+            line.append(start, newline - start);
+            _readOffset += (newline - start) + 1;
+            return true;
+        }
+        // Line continues into the next chunk; release this chunk for prefetching
+        line.append(start, remaining);
+        pthread_mutex_lock(&_streamMutex);
+        chunk.filled = false;
+        pthread_cond_broadcast(&_streamCV);
+        pthread_mutex_unlock(&_streamMutex);
+        _readHeld = false;
+        _readIndex ^= 1;
+    }
+    return false;
 }
 
 bool TraceReader::nextEntry(TraceEntry& entry)
 {
+    if (_binary) {
+        if (_curIndex < _numEntries) {
+            uint64_t delta;
+            if (!varintDecode(_timeCursor, _timeColumnEnd, delta)) {
+                cerr << "Corrupt binary trace" << endl;
+                _curIndex = _numEntries;
+                return false;
+            }
+            _prevArrivalTime += zigzagDecode(delta);
+            entry.arrivalTime = _prevArrivalTime;
+            entry.requestSize = _sizeColumn[_curIndex];
+            entry.isRead = ((_readBitmap[_curIndex / 8] >> (_curIndex % 8)) & 1) != 0;
+            _curIndex++;
+            return true;
+        }
+        return false;
+    }
+    if (_streaming) {
+        while (nextStreamLine(_line)) {
+            if (parseLine(_line.c_str(), entry)) {
+                return true;
+            }
+        }
+        return false;
+    }
     if (_curIndex < _trace.size()) {
         entry = _trace[_curIndex++];
         return true;
@@ -52,7 +366,82 @@ bool TraceReader::nextEntry(TraceEntry& entry)
     return false;
 }
 
+unsigned int TraceReader::nextEntries(TraceEntry* entries, unsigned int maxEntries)
+{
+    if (!_binary && !_streaming) {
+        // Copy directly from the loaded trace
+        uint64_t remaining = _trace.size() - _curIndex;
+        unsigned int count = (remaining < maxEntries) ? static_cast<unsigned int>(remaining) : maxEntries;
+        if (count > 0) {
+            memcpy(entries, &_trace[_curIndex], count * sizeof(TraceEntry));
+            _curIndex += count;
+        }
+        return count;
+    }
+    unsigned int count = 0;
+    while ((count < maxEntries) && nextEntry(entries[count])) {
+        count++;
+    }
+    return count;
+}
+
 void TraceReader::reset()
 {
+    if (_streaming) {
+        stopStream();
+        startStream();
+    }
     _curIndex = 0;
+    _timeCursor = _timeColumn;
+    _prevArrivalTime = 0;
+}
+
+// Convert the requests read from traceReader into a binary trace file. Returns false on error.
+bool writeBinaryTrace(TraceReader& traceReader, string filename)
+{
+    // Build columns
+    vector<uint8_t> timeColumn;
+    vector<uint32_t> sizeColumn;
+    vector<uint8_t> readBitmap;
+    uint64_t prevArrivalTime = 0;
+    TraceEntry entry;
+    traceReader.reset();
+    while (traceReader.nextEntry(entry)) {
+        varintEncode(timeColumn, zigzagEncode(static_cast<int64_t>(entry.arrivalTime - prevArrivalTime)));
+        prevArrivalTime = entry.arrivalTime;
+        if ((sizeColumn.size() % 8) == 0) {
+            readBitmap.push_back(0);
+        }
+        if (entry.isRead) {
+            readBitmap.back() |= static_cast<uint8_t>(1 << (sizeColumn.size() % 8));
+        }
+        sizeColumn.push_back(entry.requestSize);
+    }
+    traceReader.reset();
+    // Write file
+    BinaryTraceHeader header;
+    memcpy(header.magic, BINARY_TRACE_MAGIC, BINARY_TRACE_MAGIC_SIZE);
+    header.numEntries = sizeColumn.size();
+    header.timeColumnBytes = timeColumn.size();
+    ofstream file(filename.c_str(), ofstream::out | ofstream::trunc | ofstream::binary);
+    if (!file.good()) {
+        cerr << "Unable to open " << filename << endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!timeColumn.empty()) {
+        file.write(reinterpret_cast<const char*>(&timeColumn[0]), timeColumn.size());
+    }
+    const char padding[4] = {0, 0, 0, 0};
+    file.write(padding, sizeColumnOffset(header.timeColumnBytes) - sizeof(header) - timeColumn.size());
+    if (!sizeColumn.empty()) {
+        file.write(reinterpret_cast<const char*>(&sizeColumn[0]), sizeColumn.size() * sizeof(uint32_t));
+        file.write(reinterpret_cast<const char*>(&readBitmap[0]), readBitmap.size());
+    }
+    file.close();
+    if (!file.good()) {
+        cerr << "Failed to write " << filename << endl;
+        return false;
+    }
+    return true;
 }
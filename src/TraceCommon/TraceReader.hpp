@@ -8,6 +8,7 @@
 #define _TRACE_READER_HPP
 
 #include <stdint.h>
+#include <pthread.h>
 #include <string>
 #include <vector>
 
@@ -19,26 +20,114 @@ struct TraceEntry {
     bool isRead; // true if read request, false if write request
 };
 
-// Reads and stores requests from trace file on construction.
-// Trace file must be in CSV format with one request per line. Each line contains 3 columns:
+// Binary trace files start with this magic string.
+#define BINARY_TRACE_MAGIC "WCTRACE1"
+#define BINARY_TRACE_MAGIC_SIZE 8
+
+// Header of a binary trace file.
+// Binary trace files are in a columnar format (in host byte order) consisting of:
+// 1) the header
+// 2) arrival time column - zigzag varint encoded arrival time deltas from the previous request (the first is relative to 0), timeColumnBytes in total
+// 3) padding to a 4 byte boundary
+// 4) request size column - uint32_t number of bytes in each request
+// 5) read bitmap column - bit (i % 8) of byte (i / 8) is set if request i is a read
+struct BinaryTraceHeader {
+    char magic[BINARY_TRACE_MAGIC_SIZE];
+    uint64_t numEntries;
+    uint64_t timeColumnBytes;
+};
+
+// Default size of each chunk read by a streaming TraceReader.
+#define TRACE_READER_CHUNK_SIZE (4 * 1024 * 1024)
+// CSV traces larger than this are streamed in TRACE_READER_AUTO mode.
+#define TRACE_READER_STREAM_THRESHOLD (256 * 1024 * 1024)
+
+// How a TraceReader handles CSV traces.
+enum TraceReaderMode {
+    TRACE_READER_AUTO, // stream CSV traces larger than TRACE_READER_STREAM_THRESHOLD, otherwise load them
+    TRACE_READER_LOAD, // parse and store the entire CSV trace on construction
+    TRACE_READER_STREAM // parse the CSV trace in chunks as it is read, prefetching the next chunk on a background thread
+};
+
+// Reads requests from a trace file.
+// Trace file can either be in CSV format or the binary format described above; the format is detected automatically.
+// CSV trace files have one request per line. Each line contains 3 columns:
 // 1) (decimal) arrival time of request in nanoseconds
 // 2) (hex) number of bytes in request
 // 3) (string) "DiskRead" or "DiskWrite"
+// CSV traces are either parsed and stored on construction, or streamed with constant memory (see TraceReaderMode).
+// Binary traces are memory mapped and decoded as they are read.
 // TraceReader is not thread-safe.
 class TraceReader
 {
 private:
+    // CSV trace
     vector<TraceEntry> _trace;
-    unsigned int _curIndex;
+    uint64_t _curIndex;
+    // Binary trace
+    bool _binary;
+    void* _map;
+    size_t _mapSize;
+    uint64_t _numEntries;
+    const uint8_t* _timeColumn;
+    const uint8_t* _timeColumnEnd;
+    const uint32_t* _sizeColumn;
+    const uint8_t* _readBitmap;
+    const uint8_t* _timeCursor;
+    uint64_t _prevArrivalTime;
+    // Streamed CSV trace
+    struct StreamChunk {
+        char* data;
+        size_t size; // 0 indicates end of file
+        bool filled; // true if filled by the prefetch thread and not yet consumed
+    };
+    bool _streaming;
+    int _fd;
+    size_t _chunkSize;
+    StreamChunk _chunks[2];
+    unsigned int _fillIndex; // next chunk to be filled by the prefetch thread
+    unsigned int _readIndex; // chunk being parsed
+    size_t _readOffset;
+    bool _readHeld; // true if chunk _readIndex has been acquired for parsing
+    bool _streamEnd;
+    bool _stopPrefetch;
+    string _line;
+    pthread_t _prefetchThread;
+    pthread_mutex_t _streamMutex;
+    pthread_cond_t _streamCV;
+
+    // Memory map a binary trace. Returns false if filename is not a binary trace; an invalid binary trace is read as empty.
+    bool openBinary(string filename);
+    // Parse a CSV trace.
+    void openCSV(string filename);
+    // Setup streaming of a CSV trace.
+    void openStream(string filename);
+    // Start/stop the prefetch thread from the beginning of the file.
+    void startStream();
+    void stopStream();
+    // Fill chunks in the background until end of file or stopped.
+    void prefetch();
+    static void* prefetchThread(void* ptr);
+    // Get the next line of a streamed trace. Returns false if end of trace.
+    bool nextStreamLine(string& line);
+
+    // Not copyable, since it owns a memory mapping, a file descriptor, and a prefetch thread
+    TraceReader(const TraceReader&);
+    TraceReader& operator=(const TraceReader&);
 
 public:
-    TraceReader(string filename);
+    TraceReader(string filename, TraceReaderMode mode = TRACE_READER_AUTO, size_t chunkSize = TRACE_READER_CHUNK_SIZE);
     virtual ~TraceReader();
 
     // Fills entry with the next request from the trace. Returns false if end of trace.
     virtual bool nextEntry(TraceEntry& entry);
+    // Fills entries with up to maxEntries of the next requests from the trace. Returns the number of entries filled; 0 if end of trace.
+    virtual unsigned int nextEntries(TraceEntry* entries, unsigned int maxEntries);
     // Resets trace reader back to beginning of trace.
     virtual void reset();
 };
 
+// Convert the requests read from traceReader into a binary trace file. Returns false on error.
+bool writeBinaryTrace(TraceReader& traceReader, string filename);
+
 #endif // _TRACE_READER_HPP
@@ -0,0 +1,54 @@
+// TraceConverter.cpp - tool for converting CSV trace files into the binary trace format.
+// Binary traces are memory mapped by TraceReader instead of being parsed, which reduces startup time and memory for large traces.
+// See TraceCommon/TraceReader.hpp for a description of the binary format.
+//
+// Command line parameters:
+// -i inputFilename (required) - input trace file in CSV format (or binary format)
+// -o outputFilename (required) - output trace file in binary format
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include "../TraceCommon/TraceReader.hpp"
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+    int opt = 0;
+    string inputFilename = "";
+    string outputFilename = "";
+    do {
+        opt = getopt(argc, argv, "i:o:");
+        switch (opt) {
+            case 'i':
+                inputFilename.assign(optarg);
+                break;
+
+            case 'o':
+                outputFilename.assign(optarg);
+                break;
+
+            case -1:
+                break;
+
+            default:
+                break;
+        }
+    } while (opt != -1);
+
+    if ((inputFilename == "") || (outputFilename == "")) {
+        cerr << "Usage: " << argv[0] << " -i inputFilename -o outputFilename" << endl;
+        return -1;
+    }
+
+    TraceReader traceReader(inputFilename);
+    if (!writeBinaryTrace(traceReader, outputFilename)) {
+        return -1;
+    }
+    return 0;
+}
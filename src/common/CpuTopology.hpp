@@ -0,0 +1,151 @@
+// CpuTopology.hpp - CPUs of each NUMA node, for placing threads near the memory and devices they use.
+// The topology is read from sysfs (node*/cpulist under the system devices directory), so it does not depend on libnuma. If the system has
+// no NUMA information, or NUMA awareness is disabled, all online CPUs are treated as one node.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _CPU_TOPOLOGY_HPP
+#define _CPU_TOPOLOGY_HPP
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+#define CPU_TOPOLOGY_SYSFS_ROOT "/sys/devices/system"
+// Nodes are numbered densely in practice; stop looking after this many missing nodes
+#define CPU_TOPOLOGY_MAX_NODE_GAP 64
+
+class CpuTopology
+{
+private:
+    vector<vector<int> > _nodeCpus; // CPUs of each node
+    vector<int> _cpuNodes; // node of each CPU, or -1
+
+    // Read the first line of a file. Returns false if it cannot be read.
+    static bool readLine(const string& filename, string& line)
+    {
+        ifstream file(filename.c_str());
+        return getline(file, line) && !line.empty();
+    }
+
+    void addNode(const vector<int>& cpus)
+    {
+        int node = _nodeCpus.size();
+        _nodeCpus.push_back(cpus);
+        for (unsigned int i = 0; i < cpus.size(); i++) {
+            if (cpus[i] >= (int)_cpuNodes.size()) {
+                _cpuNodes.resize(cpus[i] + 1, -1);
+            }
+            _cpuNodes[cpus[i]] = node;
+        }
+    }
+
+public:
+    // Read the topology under sysfsRoot, or treat all online CPUs as one node if numaAware is false.
+    CpuTopology(bool numaAware, const string& sysfsRoot = CPU_TOPOLOGY_SYSFS_ROOT)
+    {
+        if (numaAware) {
+            int gap = 0;
+            for (int node = 0; gap < CPU_TOPOLOGY_MAX_NODE_GAP; node++) {
+                ostringstream filename;
+                filename << sysfsRoot << "/node/node" << node << "/cpulist";
+                string line;
+                vector<int> cpus;
+                // Skip missing nodes and nodes without CPUs (e.g., memory-only nodes)
+                if (readLine(filename.str(), line) && parseCpuList(line, cpus) && !cpus.empty()) {
+                    addNode(cpus);
+                    gap = 0;
+                } else {
+                    gap++;
+                }
+            }
+        }
+        if (_nodeCpus.empty()) {
+            string line;
+            vector<int> cpus;
+            if (!readLine(sysfsRoot + "/cpu/online", line) || !parseCpuList(line, cpus) || cpus.empty()) {
+                long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+                cpus.clear();
+                for (long cpu = 0; cpu < ((numCpus > 0) ? numCpus : 1); cpu++) {
+                    cpus.push_back(cpu);
+                }
+            }
+            addNode(cpus);
+        }
+    }
+
+    // Parse a sysfs CPU list such as "0-3,8-11". Returns false on error.
+    static bool parseCpuList(const string& str, vector<int>& cpus)
+    {
+        cpus.clear();
+        const char* p = str.c_str();
+        while ((*p != '\0') && (*p != '\n')) {
+            char* end;
+            long first = strtol(p, &end, 10);
+            if ((end == p) || (first < 0)) {
+                return false;
+            }
+            long last = first;
+            p = end;
+            if (*p == '-') {
+                last = strtol(p + 1, &end, 10);
+                if ((end == p + 1) || (last < first)) {
+                    return false;
+                }
+                p = end;
+            }
+            for (long cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+            if (*p == ',') {
+                p++;
+            } else if ((*p != '\0') && (*p != '\n')) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    unsigned int numNodes() const { return _nodeCpus.size(); }
+    const vector<int>& nodeCpus(unsigned int node) const { return _nodeCpus[node]; }
+
+    // Node of a CPU, or -1 if it is unknown.
+    int cpuNode(int cpu) const { return ((cpu >= 0) && (cpu < (int)_cpuNodes.size())) ? _cpuNodes[cpu] : -1; }
+
+    // Node of the CPU that last received packets for a connected socket, i.e., the CPU serving the NIC queue that the connection is
+    // steered to; -1 if it is unknown.
+    int socketNode(int fd) const
+    {
+#ifdef SO_INCOMING_CPU
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0) {
+            return cpuNode(cpu);
+        }
+#endif
+        return -1;
+    }
+
+    // Restrict the calling thread to a set of CPUs. Returns the pthread_setaffinity_np error, or 0 on success.
+    static int pinThread(const vector<int>& cpus)
+    {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (unsigned int i = 0; i < cpus.size(); i++) {
+            CPU_SET(cpus[i], &cpuSet);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+    }
+};
+
+#endif // _CPU_TOPOLOGY_HPP
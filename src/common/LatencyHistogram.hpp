@@ -0,0 +1,103 @@
+// LatencyHistogram.hpp - Lock-free log-linear histogram of latencies.
+// Values are counted in buckets in the style of HDR histograms: values below 2 * LATENCY_HISTOGRAM_SUB_BUCKETS each have
+// their own bucket, and each larger power of two range is split into LATENCY_HISTOGRAM_SUB_BUCKETS equal buckets, so a bucket's
+// width is at most 1 / LATENCY_HISTOGRAM_SUB_BUCKETS of its values. Any thread can record values with an atomic add to a bucket.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _LATENCY_HISTOGRAM_HPP
+#define _LATENCY_HISTOGRAM_HPP
+
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+#define LATENCY_HISTOGRAM_SUB_BUCKET_BITS 4
+#define LATENCY_HISTOGRAM_SUB_BUCKETS (1 << LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+// Number of buckets covering all 64-bit values
+#define LATENCY_HISTOGRAM_BUCKETS ((64 - LATENCY_HISTOGRAM_SUB_BUCKET_BITS + 1) * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+class LatencyHistogram
+{
+private:
+    volatile uint64_t _counts[LATENCY_HISTOGRAM_BUCKETS];
+
+public:
+    LatencyHistogram() { memset((void*)_counts, 0, sizeof(_counts)); }
+
+    // Bucket containing a value.
+    static unsigned int bucket(uint64_t value)
+    {
+        if (value < (2 * LATENCY_HISTOGRAM_SUB_BUCKETS)) {
+            return value;
+        }
+        unsigned int shift = (63 - __builtin_clzll(value)) - LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+        return (shift * LATENCY_HISTOGRAM_SUB_BUCKETS) + (value >> shift);
+    }
+
+    // Smallest value in a bucket.
+    static uint64_t bucketLowerBound(unsigned int bucket)
+    {
+        if (bucket < (2 * LATENCY_HISTOGRAM_SUB_BUCKETS)) {
+            return bucket;
+        }
+        unsigned int shift = (bucket / LATENCY_HISTOGRAM_SUB_BUCKETS) - 1;
+        return (uint64_t)(bucket - (shift * LATENCY_HISTOGRAM_SUB_BUCKETS)) << shift;
+    }
+
+    // Largest value in a bucket.
+    static uint64_t bucketUpperBound(unsigned int bucket)
+    {
+        return (bucket + 1 < LATENCY_HISTOGRAM_BUCKETS) ? (bucketLowerBound(bucket + 1) - 1) : ~(uint64_t)0;
+    }
+
+    // Record a value. Thread-safe.
+    void record(uint64_t value) { __sync_fetch_and_add(&_counts[bucket(value)], 1); }
+
+    // Copy the counts of buckets firstBucket and up, omitting leading and trailing empty buckets.
+    // Values recorded concurrently may or may not be included.
+    void snapshot(unsigned int& firstBucket, vector<uint64_t>& counts) const
+    {
+        unsigned int begin = 0;
+        while ((begin < LATENCY_HISTOGRAM_BUCKETS) && (_counts[begin] == 0)) {
+            begin++;
+        }
+        unsigned int end = LATENCY_HISTOGRAM_BUCKETS;
+        while ((end > begin) && (_counts[end - 1] == 0)) {
+            end--;
+        }
+        firstBucket = begin;
+        counts.assign(_counts + begin, _counts + end);
+    }
+
+    // Upper bound of the bucket containing quantile q (in [0, 1]) of counts from snapshot; 0 if there are no samples.
+    static uint64_t quantile(unsigned int firstBucket, const vector<uint64_t>& counts, double q)
+    {
+        uint64_t total = 0;
+        for (unsigned int i = 0; i < counts.size(); i++) {
+            total += counts[i];
+        }
+        if (total == 0) {
+            return 0;
+        }
+        // Rank of the sample at the quantile, starting at 1
+        uint64_t rank = (uint64_t)(q * total);
+        if (rank < 1) {
+            rank = 1;
+        } else if (rank > total) {
+            rank = total;
+        }
+        uint64_t seen = 0;
+        unsigned int i = 0;
+        while ((seen += counts[i]) < rank) {
+            i++;
+        }
+        return bucketUpperBound(firstBucket + i);
+    }
+};
+
+#endif // _LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,66 @@
+// MPSCQueue.hpp - Intrusive lock-free multi-producer single-consumer queue.
+// Items are linked through a pointer member, so pushing does not allocate. Producers push onto a LIFO list with a compare-and-swap,
+// and the consumer takes the whole list with a single exchange and reverses it, so each push and each batch popped costs one atomic operation.
+// Since the consumer never pops individual items, pushes are not subject to the ABA problem.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _MPSC_QUEUE_HPP
+#define _MPSC_QUEUE_HPP
+
+#include <cstddef>
+
+using namespace std;
+
+// Queues are padded to a cache line so that arrays of queues do not share lines between producers
+#define MPSC_QUEUE_CACHE_LINE_SIZE 64
+
+// Queue of T linked through T::*Next.
+// push may be called concurrently by any number of threads; popAll must only be called by one thread at a time.
+template <class T, T* T::*Next>
+class MPSCQueue
+{
+private:
+    T* volatile _head; // most recently pushed item
+    char _padding[MPSC_QUEUE_CACHE_LINE_SIZE - sizeof(T*)];
+
+    // Not copyable
+    MPSCQueue(const MPSCQueue&);
+    MPSCQueue& operator=(const MPSCQueue&);
+
+public:
+    MPSCQueue()
+        : _head(NULL)
+    {}
+
+    // Push item. Acts as a full memory barrier. Returns true if the queue was empty.
+    bool push(T* item)
+    {
+        T* head;
+        do {
+            head = _head;
+            item->*Next = head;
+        } while (!__sync_bool_compare_and_swap(&_head, head, item));
+        return head == NULL;
+    }
+
+    // Remove all items. Returns the first pushed item, with the rest linked in push order and the last linked to NULL.
+    T* popAll()
+    {
+        T* item = __sync_lock_test_and_set(&_head, static_cast<T*>(NULL));
+        T* prev = NULL;
+        while (item != NULL) {
+            T* next = item->*Next;
+            item->*Next = prev;
+            prev = item;
+            item = next;
+        }
+        return prev;
+    }
+
+    bool empty() const { return _head == NULL; }
+};
+
+#endif // _MPSC_QUEUE_HPP
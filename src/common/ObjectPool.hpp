@@ -0,0 +1,167 @@
+// ObjectPool.hpp - Per-thread slab pools of objects of one type.
+// Each thread allocates from its own pool, which carves slabs into cache line aligned slots. The allocating thread is the first to touch
+// a slab, so under the default first-touch policy its pages are on that thread's NUMA node. Objects freed by the pool's thread go back on
+// its free list without atomic operations; objects freed by other threads are pushed onto the pool's lock-free remote queue, which the pool's
+// thread takes back in one batch when its free list runs out. Slabs are never returned to the system, and the pools of exited threads are
+// reused by new threads since their objects may still be in use.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _OBJECT_POOL_HPP
+#define _OBJECT_POOL_HPP
+
+#include <cstdlib>
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <pthread.h>
+#include "MPSCQueue.hpp"
+
+using namespace std;
+
+#define OBJECT_POOL_CACHE_LINE_SIZE 64
+// Number of objects allocated at a time
+#define OBJECT_POOL_SLAB_OBJECTS 256
+
+// Pools of memory for objects of type T; allocate and deallocate are thread-safe.
+// Typically used through T's class-specific operator new and operator delete.
+template <class T>
+class ObjectPool
+{
+private:
+    // Header in the cache line before each object
+    struct Slot {
+        ObjectPool* pPool; // pool the slot belongs to
+        Slot* next; // link in the free list or remote queue
+    };
+
+    Slot* _freeList; // only used by the pool's thread
+    MPSCQueue<Slot, &Slot::next> _remoteFreed;
+    vector<void*> _slabs;
+    ObjectPool* _nextIdle; // link in the list of pools of exited threads
+
+    static __thread ObjectPool* _threadPool;
+    static pthread_once_t _keyOnce;
+    static pthread_key_t _key;
+    static pthread_mutex_t _idleMutex;
+    static ObjectPool* _idlePools;
+
+    ObjectPool()
+        : _freeList(NULL),
+          _nextIdle(NULL)
+    {}
+
+    // Not copyable
+    ObjectPool(const ObjectPool&);
+    ObjectPool& operator=(const ObjectPool&);
+
+    static size_t slotSize()
+    {
+        size_t objectSize = (sizeof(T) + OBJECT_POOL_CACHE_LINE_SIZE - 1) / OBJECT_POOL_CACHE_LINE_SIZE * OBJECT_POOL_CACHE_LINE_SIZE;
+        return OBJECT_POOL_CACHE_LINE_SIZE + objectSize;
+    }
+
+    static void createKey() { pthread_key_create(&_key, releasePool); }
+
+    // Called when a thread with a pool exits.
+    static void releasePool(void* ptr)
+    {
+        ObjectPool* pPool = static_cast<ObjectPool*>(ptr);
+        pthread_mutex_lock(&_idleMutex);
+        pPool->_nextIdle = _idlePools;
+        _idlePools = pPool;
+        pthread_mutex_unlock(&_idleMutex);
+    }
+
+    // Get the calling thread's pool, reusing the pool of an exited thread if possible.
+    static ObjectPool* threadPool()
+    {
+        if (_threadPool == NULL) {
+            pthread_once(&_keyOnce, createKey);
+            pthread_mutex_lock(&_idleMutex);
+            ObjectPool* pPool = _idlePools;
+            if (pPool != NULL) {
+                _idlePools = pPool->_nextIdle;
+                pPool->_nextIdle = NULL;
+            }
+            pthread_mutex_unlock(&_idleMutex);
+            if (pPool == NULL) {
+                pPool = new ObjectPool();
+            }
+            pthread_setspecific(_key, pPool);
+            _threadPool = pPool;
+        }
+        return _threadPool;
+    }
+
+    // Add a slab of slots to the free list.
+    void addSlab()
+    {
+        size_t size = slotSize();
+        void* slab = NULL;
+        if (posix_memalign(&slab, OBJECT_POOL_CACHE_LINE_SIZE, size * OBJECT_POOL_SLAB_OBJECTS) != 0) {
+            throw bad_alloc();
+        }
+        _slabs.push_back(slab);
+        for (unsigned int i = 0; i < OBJECT_POOL_SLAB_OBJECTS; i++) {
+            Slot* pSlot = reinterpret_cast<Slot*>(static_cast<char*>(slab) + i * size);
+            pSlot->pPool = this;
+            pSlot->next = _freeList;
+            _freeList = pSlot;
+        }
+    }
+
+public:
+    // Allocate memory for a T aligned to a cache line. Throws bad_alloc if out of memory.
+    static void* allocate()
+    {
+        ObjectPool* pPool = threadPool();
+        if (pPool->_freeList == NULL) {
+            pPool->_freeList = pPool->_remoteFreed.popAll();
+            if (pPool->_freeList == NULL) {
+                pPool->addSlab();
+            }
+        }
+        Slot* pSlot = pPool->_freeList;
+        pPool->_freeList = pSlot->next;
+        return reinterpret_cast<char*>(pSlot) + OBJECT_POOL_CACHE_LINE_SIZE;
+    }
+
+    // Free memory returned by allocate. May be called from any thread.
+    static void deallocate(void* ptr)
+    {
+        if (ptr == NULL) {
+            return;
+        }
+        Slot* pSlot = reinterpret_cast<Slot*>(static_cast<char*>(ptr) - OBJECT_POOL_CACHE_LINE_SIZE);
+        ObjectPool* pPool = pSlot->pPool;
+        if (pPool == _threadPool) {
+            pSlot->next = pPool->_freeList;
+            pPool->_freeList = pSlot;
+        } else {
+            pPool->_remoteFreed.push(pSlot);
+        }
+    }
+};
+
+template <class T>
+__thread ObjectPool<T>* ObjectPool<T>::_threadPool = NULL;
+template <class T>
+pthread_once_t ObjectPool<T>::_keyOnce = PTHREAD_ONCE_INIT;
+template <class T>
+pthread_key_t ObjectPool<T>::_key;
+template <class T>
+pthread_mutex_t ObjectPool<T>::_idleMutex = PTHREAD_MUTEX_INITIALIZER;
+template <class T>
+ObjectPool<T>* ObjectPool<T>::_idlePools = NULL;
+
+// Class-specific operator new and operator delete for T that allocate from ObjectPool<T>, for use in T's class definition.
+// Classes derived from T that do not declare their own are larger than the pool's slots, so they fall back to the global operators;
+// operator delete gets the size of the object's dynamic type when T has a virtual destructor.
+#define OBJECT_POOL_OPERATORS(T) \
+    static void* operator new(size_t size) { return (size == sizeof(T)) ? ObjectPool<T>::allocate() : ::operator new(size); } \
+    static void operator delete(void* ptr, size_t size) { if (size == sizeof(T)) { ObjectPool<T>::deallocate(ptr); } else { ::operator delete(ptr); } }
+
+#endif // _OBJECT_POOL_HPP
@@ -0,0 +1,253 @@
+// SpanTrace.hpp - Low-overhead tracing of timed spans (e.g., the stages of handling an admission RPC) for finding where time is spent.
+// Code is instrumented with TRACE_SPAN(name), which records the time from the statement to the end of the enclosing scope.
+// The macros are only compiled in if SPAN_TRACE is defined (see common/Makefile.template), and otherwise expand to nothing.
+// Each thread records its spans into its own ring buffer of the last SPAN_TRACE_BUFFER_SIZE spans, without locks or allocation.
+// Buffers are created on a thread's first span and are never freed, so spans of exited threads are kept until overwritten.
+// The buffered spans of all threads are written in the Chrome trace event format (viewable in chrome://tracing or Perfetto) by
+// SpanTracer::writeChromeTrace, or each time the process receives a signal set up with TRACE_DUMP_ON_SIGNAL(signum, prefix),
+// which writes the spans to prefix-<pid>-<n>.json in the working directory.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _SPAN_TRACE_HPP
+#define _SPAN_TRACE_HPP
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include "time.hpp"
+
+using namespace std;
+
+// Number of spans kept per thread; a power of two
+#define SPAN_TRACE_BUFFER_SIZE 65536
+
+// A completed span. Names are string literals, so that recording a span does not copy its name.
+struct SpanEvent {
+    const char* name;
+    uint64_t startTime; // in nanoseconds (see GetTime)
+    uint64_t endTime;
+    long tid; // kernel thread id of the thread that recorded the span
+};
+
+class SpanTracer
+{
+private:
+    // Ring buffer of a thread's spans, written only by the thread.
+    struct Buffer {
+        SpanEvent events[SPAN_TRACE_BUFFER_SIZE];
+        volatile uint64_t count; // number of spans ever recorded; span i is in events[i % SPAN_TRACE_BUFFER_SIZE]
+        long tid;
+        Buffer* next;
+    };
+
+    // Buffers of all threads, linked through Buffer::next; buffers are only added
+    static Buffer* volatile& buffers()
+    {
+        static Buffer* volatile s_buffers = NULL;
+        return s_buffers;
+    }
+
+    static Buffer*& threadBuffer()
+    {
+        static __thread Buffer* t_buffer = NULL;
+        return t_buffer;
+    }
+
+    static Buffer* createThreadBuffer()
+    {
+        Buffer* pBuffer = new Buffer;
+        pBuffer->count = 0;
+        pBuffer->tid = syscall(SYS_gettid);
+        do {
+            pBuffer->next = buffers();
+        } while (!__sync_bool_compare_and_swap(&buffers(), pBuffer->next, pBuffer));
+        threadBuffer() = pBuffer;
+        return pBuffer;
+    }
+
+    // Pipe from the signal handler of dumpOnSignal to the thread writing the trace, since writing it is not async-signal-safe
+    static int* dumpPipe()
+    {
+        static int s_dumpPipe[2] = {-1, -1};
+        return s_dumpPipe;
+    }
+
+    static void dumpSignalHandler(int signum)
+    {
+        int savedErrno = errno;
+        char c = 0;
+        if (write(dumpPipe()[1], &c, 1) < 0) {
+            // The pipe is non-blocking, so the signal is dropped if many dumps are already pending
+        }
+        errno = savedErrno;
+    }
+
+    static void* dumpThread(void* ptr)
+    {
+        string* pPrefix = (string*)ptr;
+        unsigned int numDumps = 0;
+        char c;
+        while (true) {
+            ssize_t rc = read(dumpPipe()[0], &c, 1);
+            if (rc < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("Failed to read span trace dump pipe");
+                break;
+            }
+            ostringstream filename;
+            filename << *pPrefix << "-" << getpid() << "-" << numDumps++ << ".json";
+            if (writeChromeTrace(filename.str())) {
+                cerr << "Wrote span trace to " << filename.str() << endl;
+            }
+        }
+        return NULL;
+    }
+
+public:
+    // Record a span of the calling thread.
+    static void record(const char* name, uint64_t startTime, uint64_t endTime)
+    {
+        Buffer* pBuffer = threadBuffer();
+        if (pBuffer == NULL) {
+            pBuffer = createThreadBuffer();
+        }
+        uint64_t count = pBuffer->count;
+        SpanEvent& event = pBuffer->events[count & (SPAN_TRACE_BUFFER_SIZE - 1)];
+        event.name = name;
+        event.startTime = startTime;
+        event.endTime = endTime;
+        event.tid = pBuffer->tid;
+        // Publish the span after writing it
+        __sync_synchronize();
+        pBuffer->count = count + 1;
+    }
+
+    // Get the buffered spans of all threads, without stopping the threads from recording.
+    // Spans that are overwritten while being copied are left out.
+    static void collect(vector<SpanEvent>& events)
+    {
+        events.clear();
+        for (Buffer* pBuffer = buffers(); pBuffer != NULL; pBuffer = pBuffer->next) {
+            uint64_t end = pBuffer->count;
+            __sync_synchronize();
+            // The oldest span's slot is skipped in a full buffer, since it is the slot of a span that may be being written
+            uint64_t begin = (end >= SPAN_TRACE_BUFFER_SIZE) ? (end - SPAN_TRACE_BUFFER_SIZE + 1) : 0;
+            size_t offset = events.size();
+            for (uint64_t i = begin; i < end; i++) {
+                events.push_back(pBuffer->events[i & (SPAN_TRACE_BUFFER_SIZE - 1)]);
+            }
+            // Drop the spans that the thread may have overwritten since the count was read
+            __sync_synchronize();
+            uint64_t newEnd = pBuffer->count;
+            uint64_t newBegin = (newEnd >= SPAN_TRACE_BUFFER_SIZE) ? (newEnd - SPAN_TRACE_BUFFER_SIZE + 1) : 0;
+            if (newBegin > begin) {
+                uint64_t numOverwritten = min(newBegin - begin, end - begin);
+                events.erase(events.begin() + offset, events.begin() + offset + numOverwritten);
+            }
+        }
+    }
+
+    // Write the buffered spans of all threads to a file in the Chrome trace event format. Returns false on error.
+    static bool writeChromeTrace(const string& filename)
+    {
+        vector<SpanEvent> events;
+        collect(events);
+        ofstream file(filename.c_str());
+        if (!file.is_open()) {
+            cerr << "Failed to open span trace file " << filename << endl;
+            return false;
+        }
+        // Complete ("X") events with timestamps and durations in microseconds
+        pid_t pid = getpid();
+        file << "{\"traceEvents\":[";
+        char line[256];
+        for (unsigned int i = 0; i < events.size(); i++) {
+            const SpanEvent& event = events[i];
+            snprintf(line, sizeof(line), "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f}",
+                     (i > 0) ? "," : "", event.name, (int)pid, event.tid, event.startTime / 1000.0, (event.endTime - event.startTime) / 1000.0);
+            file << line;
+        }
+        file << "\n],\"displayTimeUnit\":\"ns\"}" << endl;
+        return file.good();
+    }
+
+    // Write the buffered spans to prefix-<pid>-<n>.json each time the process receives signum. Returns false on error.
+    // Should be called once, before the process starts handling requests.
+    static bool dumpOnSignal(int signum, const string& prefix)
+    {
+        if (pipe(dumpPipe()) < 0) {
+            perror("Failed to create span trace dump pipe");
+            return false;
+        }
+        fcntl(dumpPipe()[1], F_SETFL, O_NONBLOCK);
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        int rc = pthread_create(&thread, &attr, dumpThread, (void*)new string(prefix));
+        if (rc) {
+            cerr << "Error creating thread: " << rc << endl;
+            return false;
+        }
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = dumpSignalHandler;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(signum, &action, NULL) < 0) {
+            perror("Failed to set span trace signal handler");
+            return false;
+        }
+        return true;
+    }
+};
+
+// Records a span from its construction to its destruction.
+class SpanScope
+{
+private:
+    const char* _name;
+    uint64_t _startTime;
+
+public:
+    SpanScope(const char* name)
+        : _name(name),
+          _startTime(GetTime())
+    {}
+    ~SpanScope()
+    {
+        SpanTracer::record(_name, _startTime, GetTime());
+    }
+};
+
+#define SPAN_TRACE_CONCAT_(a, b) a##b
+#define SPAN_TRACE_CONCAT(a, b) SPAN_TRACE_CONCAT_(a, b)
+
+#ifdef SPAN_TRACE
+// Record a span named name (a string literal) from here to the end of the enclosing scope.
+#define TRACE_SPAN(name) SpanScope SPAN_TRACE_CONCAT(_spanScope, __LINE__)(name)
+// Write the buffered spans to prefix-<pid>-<n>.json each time the process receives signum (see SpanTracer::dumpOnSignal).
+#define TRACE_DUMP_ON_SIGNAL(signum, prefix) SpanTracer::dumpOnSignal(signum, prefix)
+#else
+#define TRACE_SPAN(name)
+#define TRACE_DUMP_ON_SIGNAL(signum, prefix)
+#endif
+
+#endif // _SPAN_TRACE_HPP
@@ -0,0 +1,143 @@
+// ThreadPool.hpp - Simple fixed-size pthread pool.
+// Tasks are a function pointer and an argument. Callers add a batch of tasks and then wait for all of them to complete.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _THREAD_POOL_HPP
+#define _THREAD_POOL_HPP
+
+#include <iostream>
+#include <cstdlib>
+#include <list>
+#include <vector>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Returns the number of online cores, or 1 if unknown.
+inline unsigned int numCores()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? static_cast<unsigned int>(n) : 1;
+}
+
+class ThreadPool
+{
+private:
+    struct Task {
+        void (*fn)(void*);
+        void* arg;
+    };
+
+    vector<pthread_t> _threads;
+    // Protects task queue
+    pthread_mutex_t _mutex;
+    // Signaled when a task is added or the pool is being destroyed
+    pthread_cond_t _taskAvailableCV;
+    // Signaled when all tasks are complete
+    pthread_cond_t _tasksCompleteCV;
+    list<Task> _tasks;
+    // Number of tasks queued or running
+    unsigned int _outstandingTasks;
+    bool _destroy;
+
+    static void* workerThread(void* ptr)
+    {
+        ThreadPool* pool = (ThreadPool*)ptr;
+        pthread_mutex_lock(&pool->_mutex);
+        while (true) {
+            while (pool->_tasks.empty() && !pool->_destroy) {
+                pthread_cond_wait(&pool->_taskAvailableCV, &pool->_mutex);
+            }
+            if (pool->_tasks.empty()) {
+                break;
+            }
+            Task task = pool->_tasks.front();
+            pool->_tasks.pop_front();
+            pthread_mutex_unlock(&pool->_mutex);
+            task.fn(task.arg);
+            pthread_mutex_lock(&pool->_mutex);
+            pool->_outstandingTasks--;
+            if (pool->_outstandingTasks == 0) {
+                pthread_cond_broadcast(&pool->_tasksCompleteCV);
+            }
+        }
+        pthread_mutex_unlock(&pool->_mutex);
+        return NULL;
+    }
+
+public:
+    // Creates a pool with numThreads threads; 0 uses the number of cores.
+    ThreadPool(unsigned int numThreads = 0)
+        : _outstandingTasks(0),
+          _destroy(false)
+    {
+        if (numThreads == 0) {
+            numThreads = numCores();
+        }
+        pthread_mutex_init(&_mutex, NULL);
+        pthread_cond_init(&_taskAvailableCV, NULL);
+        pthread_cond_init(&_tasksCompleteCV, NULL);
+        _threads.resize(numThreads);
+        for (unsigned int i = 0; i < numThreads; i++) {
+            int rc = pthread_create(&_threads[i], NULL, workerThread, (void*)this);
+            if (rc) {
+                cerr << "Error creating thread: " << rc << " errno: " << errno << endl;
+                exit(-1);
+            }
+        }
+    }
+
+    ~ThreadPool()
+    {
+        pthread_mutex_lock(&_mutex);
+        _destroy = true;
+        pthread_cond_broadcast(&_taskAvailableCV);
+        pthread_mutex_unlock(&_mutex);
+        for (unsigned int i = 0; i < _threads.size(); i++) {
+            int rc = pthread_join(_threads[i], NULL);
+            if (rc) {
+                cerr << "Error joining thread: " << rc << " errno: " << errno << endl;
+                exit(-1);
+            }
+        }
+        pthread_cond_destroy(&_tasksCompleteCV);
+        pthread_cond_destroy(&_taskAvailableCV);
+        pthread_mutex_destroy(&_mutex);
+    }
+
+    // Returns the number of threads in the pool.
+    unsigned int numThreads() const
+    {
+        return _threads.size();
+    }
+
+    // Queue fn(arg) to be run by a pool thread.
+    void addTask(void (*fn)(void*), void* arg)
+    {
+        Task task;
+        task.fn = fn;
+        task.arg = arg;
+        pthread_mutex_lock(&_mutex);
+        _tasks.push_back(task);
+        _outstandingTasks++;
+        pthread_cond_signal(&_taskAvailableCV);
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    // Block until all queued tasks have completed.
+    void wait()
+    {
+        pthread_mutex_lock(&_mutex);
+        while (_outstandingTasks > 0) {
+            pthread_cond_wait(&_tasksCompleteCV, &_mutex);
+        }
+        pthread_mutex_unlock(&_mutex);
+    }
+};
+
+#endif // _THREAD_POOL_HPP
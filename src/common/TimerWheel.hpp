@@ -0,0 +1,210 @@
+// TimerWheel.hpp - Hierarchical timer wheel.
+// Timers are TimerWheelEntry structs embedded in the objects being timed, so scheduling and cancelling a timer is O(1) and does not allocate.
+// Time is divided into ticks of 2^tickShift nanoseconds. The wheel has TIMER_WHEEL_LEVELS levels of TIMER_WHEEL_SLOTS slots each,
+// where a level-L slot spans TIMER_WHEEL_SLOTS^L ticks. Timers are placed in the slot at the lowest level that distinguishes their tick from
+// the current tick, and move down a level each time the current tick reaches their slot, so each timer is moved at most TIMER_WHEEL_LEVELS times.
+// Timers beyond the top level are kept in an overflow list. Expired timers are reported at their exact time rather than rounded to a tick.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _TIMER_WHEEL_HPP
+#define _TIMER_WHEEL_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+using namespace std;
+
+#define TIMER_WHEEL_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4
+// Default tick of 2^16 ns (~66 us); the levels then span ~17 ms, ~4 s, ~18 min, and ~3 days
+#define TIMER_WHEEL_DEFAULT_TICK_SHIFT 16
+
+// Timer that can be scheduled in a TimerWheel.
+// Must be initialized with initTimerWheelEntry, and must not be moved or destroyed while scheduled.
+struct TimerWheelEntry {
+    uint64_t time; // expiration time in nanoseconds
+    void* data; // owner of the timer
+    // Links within a slot; pprev points to the previous entry's next or to the slot, or is NULL if not scheduled
+    TimerWheelEntry* next;
+    TimerWheelEntry** pprev;
+    int level; // level of the slot, or TIMER_WHEEL_LEVELS for the overflow list
+
+    bool scheduled() const { return pprev != NULL; }
+};
+
+inline void initTimerWheelEntry(TimerWheelEntry& entry, void* data)
+{
+    entry.time = 0;
+    entry.data = data;
+    entry.next = NULL;
+    entry.pprev = NULL;
+    entry.level = 0;
+}
+
+// TimerWheel is not thread-safe.
+class TimerWheel
+{
+private:
+    unsigned int _tickShift;
+    // Timers earlier than the current tick have all expired
+    uint64_t _curTick;
+    TimerWheelEntry* _slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    TimerWheelEntry* _overflow;
+    // Number of timers at each level, with the overflow list last
+    size_t _levelCounts[TIMER_WHEEL_LEVELS + 1];
+    size_t _size;
+
+    // Not copyable
+    TimerWheel(const TimerWheel&);
+    TimerWheel& operator=(const TimerWheel&);
+
+    static unsigned int slotIndex(uint64_t tick, int level) { return (tick >> (level * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1); }
+
+    void link(TimerWheelEntry** head, TimerWheelEntry* entry, int level)
+    {
+        entry->next = *head;
+        if (*head != NULL) {
+            (*head)->pprev = &entry->next;
+        }
+        entry->pprev = head;
+        *head = entry;
+        entry->level = level;
+        _levelCounts[level]++;
+    }
+
+    void unlink(TimerWheelEntry* entry)
+    {
+        assert(entry->scheduled());
+        *entry->pprev = entry->next;
+        if (entry->next != NULL) {
+            entry->next->pprev = entry->pprev;
+        }
+        entry->next = NULL;
+        entry->pprev = NULL;
+        _levelCounts[entry->level]--;
+    }
+
+    // Link entry into the slot for its time relative to the current tick.
+    void place(TimerWheelEntry* entry)
+    {
+        uint64_t tick = entry->time >> _tickShift;
+        if (tick < _curTick) {
+            tick = _curTick;
+        }
+        // Use the lowest level whose slots above it agree with the current tick
+        for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            unsigned int shift = (level + 1) * TIMER_WHEEL_BITS;
+            if ((tick >> shift) == (_curTick >> shift)) {
+                link(&_slots[level][slotIndex(tick, level)], entry, level);
+                return;
+            }
+        }
+        link(&_overflow, entry, TIMER_WHEEL_LEVELS);
+    }
+
+    // Move the entries in head down to lower levels.
+    void cascade(TimerWheelEntry** head)
+    {
+        TimerWheelEntry* entry = *head;
+        while (entry != NULL) {
+            TimerWheelEntry* next = entry->next;
+            unlink(entry);
+            place(entry);
+            entry = next;
+        }
+    }
+
+public:
+    TimerWheel(unsigned int tickShift = TIMER_WHEEL_DEFAULT_TICK_SHIFT)
+        : _tickShift(tickShift),
+          _curTick(0),
+          _overflow(NULL),
+          _size(0)
+    {
+        for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+            for (unsigned int i = 0; i < TIMER_WHEEL_SLOTS; i++) {
+                _slots[level][i] = NULL;
+            }
+        }
+        for (int level = 0; level <= TIMER_WHEEL_LEVELS; level++) {
+            _levelCounts[level] = 0;
+        }
+    }
+
+    // Schedule entry to expire at time, rescheduling it if it is already scheduled.
+    // Times that have already passed expire on the next call to expire.
+    void schedule(TimerWheelEntry& entry, uint64_t time)
+    {
+        if (entry.scheduled()) {
+            unlink(&entry);
+            _size--;
+        }
+        entry.time = time;
+        place(&entry);
+        _size++;
+    }
+
+    // Cancel entry if it is scheduled.
+    void cancel(TimerWheelEntry& entry)
+    {
+        if (entry.scheduled()) {
+            unlink(&entry);
+            _size--;
+        }
+    }
+
+    // Remove the timers with times up to now and append them to expired.
+    // Assumes now is no earlier than in the previous call.
+    void expire(uint64_t now, vector<TimerWheelEntry*>& expired)
+    {
+        uint64_t target = now >> _tickShift;
+        while (true) {
+            // Timers in the current slot are due unless they are later in the target tick
+            TimerWheelEntry* entry = _slots[0][slotIndex(_curTick, 0)];
+            while (entry != NULL) {
+                TimerWheelEntry* next = entry->next;
+                if (entry->time <= now) {
+                    unlink(entry);
+                    _size--;
+                    expired.push_back(entry);
+                }
+                entry = next;
+            }
+            if (_curTick >= target) {
+                break;
+            }
+            if (_size == 0) {
+                _curTick = target;
+                break;
+            }
+            // Skip to the next slot of the lowest level with timers
+            int emptyLevels = 0;
+            while ((emptyLevels < TIMER_WHEEL_LEVELS) && (_levelCounts[emptyLevels] == 0)) {
+                emptyLevels++;
+            }
+            unsigned int shift = emptyLevels * TIMER_WHEEL_BITS;
+            uint64_t nextTick = ((_curTick >> shift) + 1) << shift;
+            _curTick = (nextTick > target) ? target : nextTick;
+            // Move timers down from the slots that start at the new tick
+            if ((_curTick & ((1ull << (TIMER_WHEEL_LEVELS * TIMER_WHEEL_BITS)) - 1)) == 0) {
+                cascade(&_overflow);
+            }
+            for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+                if ((_curTick & ((1ull << (level * TIMER_WHEEL_BITS)) - 1)) == 0) {
+                    cascade(&_slots[level][slotIndex(_curTick, level)]);
+                }
+            }
+        }
+    }
+
+    bool empty() const { return _size == 0; }
+    size_t size() const { return _size; }
+};
+
+#endif // _TIMER_WHEEL_HPP
@@ -14,6 +14,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <json/json.h>
+#include "SpanTrace.hpp"
 
 using namespace std;
 
@@ -77,6 +78,7 @@ inline string jsonToString(const Json::Value& json)
 // Convert string to json
 inline bool stringToJson(string str, Json::Value& json)
 {
+    TRACE_SPAN("stringToJson");
     Json::Reader reader;
     return reader.parse(str, json);
 }
@@ -0,0 +1,200 @@
+// serializeBinary.hpp - Binary serialization/deserialization helper classes.
+// Values are written in the host's byte order, so serialized data is only meant to be read on the same machine (e.g., checkpoints).
+// Strings and vectors are prefixed with their length.
+//
+// Copyright (c) 2017 Timothy Zhu.
+// Licensed under the MIT License. See LICENSE file for details.
+//
+
+#ifndef _SERIALIZE_BINARY_HPP
+#define _SERIALIZE_BINARY_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Appends values to an in-memory buffer.
+class BinaryWriter
+{
+private:
+    string _buf;
+
+    void writeRaw(const void* p, size_t size) { _buf.append(static_cast<const char*>(p), size); }
+
+public:
+    void write(uint32_t val) { writeRaw(&val, sizeof(val)); }
+    void write(uint64_t val) { writeRaw(&val, sizeof(val)); }
+    void write(double val) { writeRaw(&val, sizeof(val)); }
+    void write(bool val) { write(static_cast<uint32_t>(val ? 1 : 0)); }
+    void write(const string& val)
+    {
+        write(static_cast<uint32_t>(val.size()));
+        _buf.append(val);
+    }
+
+    const char* data() const { return _buf.data(); }
+    size_t size() const { return _buf.size(); }
+    void clear() { _buf.clear(); }
+
+    // Write the buffer to fd. Returns false on error.
+    bool writeFd(int fd) const
+    {
+        size_t offset = 0;
+        while (offset < _buf.size()) {
+            ssize_t n = ::write(fd, _buf.data() + offset, _buf.size() - offset);
+            if (n < 0) {
+                return false;
+            }
+            offset += n;
+        }
+        return true;
+    }
+    // Replace filename with the buffer. The buffer is written to a temporary file that is renamed to filename once it is on disk,
+    // so filename holds either its previous or its new contents if the write is interrupted. Returns false on error.
+    bool writeFile(const string& filename) const
+    {
+        string tmpFilename = filename + ".tmp";
+        int fd = open(tmpFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        bool success = writeFd(fd) && (fsync(fd) == 0);
+        success = (close(fd) == 0) && success;
+        return success && (rename(tmpFilename.c_str(), filename.c_str()) == 0);
+    }
+};
+
+// Reads values from a buffer written by BinaryWriter.
+// Reads past the end of the buffer fail, after which all reads fail, so a sequence of reads can be checked once at the end.
+class BinaryReader
+{
+private:
+    const char* _data;
+    size_t _size;
+    size_t _offset;
+    bool _ok;
+
+    bool readRaw(void* p, size_t size)
+    {
+        if (!_ok || (size > _size - _offset)) {
+            _ok = false;
+            return false;
+        }
+        memcpy(p, _data + _offset, size);
+        _offset += size;
+        return true;
+    }
+
+public:
+    BinaryReader(const char* data, size_t size)
+        : _data(data),
+          _size(size),
+          _offset(0),
+          _ok(true)
+    {}
+
+    bool read(uint32_t& val) { return readRaw(&val, sizeof(val)); }
+    bool read(uint64_t& val) { return readRaw(&val, sizeof(val)); }
+    bool read(double& val) { return readRaw(&val, sizeof(val)); }
+    bool read(bool& val)
+    {
+        uint32_t v = 0;
+        bool success = read(v);
+        val = (v != 0);
+        return success;
+    }
+    bool read(string& val)
+    {
+        uint32_t size = 0;
+        if (!read(size) || (size > _size - _offset)) {
+            _ok = false;
+            return false;
+        }
+        val.assign(_data + _offset, size);
+        _offset += size;
+        return true;
+    }
+    // Read a length written with write(uint32_t) for a sequence of elements of at least minElementSize bytes each.
+    // Fails if the remaining buffer is too short, so that a corrupt length does not cause a huge allocation.
+    bool readCount(uint32_t& count, size_t minElementSize)
+    {
+        if (!read(count) || ((minElementSize > 0) && (count > (_size - _offset) / minElementSize))) {
+            _ok = false;
+            return false;
+        }
+        return true;
+    }
+    // Mark the buffer as malformed (e.g., a value is out of range).
+    void fail() { _ok = false; }
+
+    bool ok() const { return _ok; }
+    bool atEnd() const { return _offset == _size; }
+    size_t offset() const { return _offset; }
+};
+
+// Read-only memory mapping of a file.
+class MappedFile
+{
+private:
+    char* _data;
+    size_t _size;
+
+    // Not copyable
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+public:
+    MappedFile()
+        : _data(NULL),
+          _size(0)
+    {}
+    ~MappedFile() { unmap(); }
+
+    // Map filename. Returns false if the file can not be opened or mapped (errno is set).
+    bool map(const string& filename)
+    {
+        unmap();
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            close(fd);
+            return false;
+        }
+        _size = st.st_size;
+        if (_size > 0) {
+            void* p = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                _size = 0;
+                return false;
+            }
+            _data = static_cast<char*>(p);
+        }
+        close(fd);
+        return true;
+    }
+    void unmap()
+    {
+        if (_data != NULL) {
+            munmap(_data, _size);
+        }
+        _data = NULL;
+        _size = 0;
+    }
+
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+};
+
+#endif // _SERIALIZE_BINARY_HPP
@@ -6,19 +6,28 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "AdmissionController_prot.h"
 #include "../common/common.hpp"
+#include "../common/SpanTrace.hpp"
 #include "AdmissionController_clnt.hpp"
 
 using namespace std;
 
 AdmissionController_clnt::AdmissionController_clnt(string serverAddr, time_t timeoutSec)
 {
-    // Connect to AdmissionController server
-    _cl = clnt_create(serverAddr.c_str(), ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1, "tcp");
+    // Connect to AdmissionController server, falling back to version 1 if the server does not support version 2
+    _cl = clnt_create(serverAddr.c_str(), ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V2, "tcp");
+    _typed = (_cl != NULL) && (admission_controller_null_2(NULL, _cl) == RPC_SUCCESS);
+    if (!_typed) {
+        if (_cl != NULL) {
+            clnt_destroy(_cl);
+        }
+        _cl = clnt_create(serverAddr.c_str(), ADMISSION_CONTROLLER_PROGRAM, ADMISSION_CONTROLLER_V1, "tcp");
+    }
     if (_cl == NULL) {
         clnt_pcreateerror(serverAddr.c_str());
         exit(-1);
@@ -30,6 +39,87 @@ AdmissionController_clnt::AdmissionController_clnt(string serverAddr, time_t tim
     clnt_control(_cl, CLSET_TIMEOUT, reinterpret_cast<char*>(&timeout));
 }
 
+// Copy a string for an XDR argument
+static char* newString(const string& str)
+{
+    char* s = new char[str.length() + 1];
+    strcpy(s, str.c_str());
+    return s;
+}
+
+// Encode a list of JSON clientInfos as typed XDR clientInfos; free with freeClientInfos
+static void encodeClientInfos(AdmissionClientInfos& xdrClientInfos, const Json::Value& clientInfos)
+{
+    xdrClientInfos.AdmissionClientInfos_len = clientInfos.size();
+    xdrClientInfos.AdmissionClientInfos_val = new AdmissionClientInfo[clientInfos.size()];
+    for (unsigned int i = 0; i < clientInfos.size(); i++) {
+        const Json::Value& clientInfo = clientInfos[i];
+        AdmissionClientInfo& xdrClientInfo = xdrClientInfos.AdmissionClientInfos_val[i];
+        xdrClientInfo.name = newString(clientInfo["name"].asString());
+        xdrClientInfo.SLO = clientInfo["SLO"].asDouble();
+        xdrClientInfo.SLOpercentile = clientInfo["SLOpercentile"].asDouble();
+        xdrClientInfo.closedLoop = clientInfo["closedLoop"].asBool();
+        xdrClientInfo.bestEffort = clientInfo["bestEffort"].asBool();
+        xdrClientInfo.admitted = clientInfo["admitted"].asBool();
+        const Json::Value& clientFlows = clientInfo["flows"];
+        xdrClientInfo.flows.flows_len = clientFlows.size();
+        xdrClientInfo.flows.flows_val = new AdmissionFlowInfo[clientFlows.size()];
+        for (unsigned int flowIndex = 0; flowIndex < clientFlows.size(); flowIndex++) {
+            const Json::Value& flowInfo = clientFlows[flowIndex];
+            AdmissionFlowInfo& xdrFlowInfo = xdrClientInfo.flows.flows_val[flowIndex];
+            xdrFlowInfo.name = newString(flowInfo["name"].asString());
+            const Json::Value& flowQueues = flowInfo["queues"];
+            xdrFlowInfo.queues.queues_len = flowQueues.size();
+            xdrFlowInfo.queues.queues_val = new AdmissionName[flowQueues.size()];
+            for (unsigned int index = 0; index < flowQueues.size(); index++) {
+                xdrFlowInfo.queues.queues_val[index] = newString(flowQueues[index].asString());
+            }
+            const Json::Value& arrivalInfo = flowInfo["arrivalInfo"];
+            xdrFlowInfo.arrivalInfo.arrivalInfo_len = arrivalInfo.size();
+            xdrFlowInfo.arrivalInfo.arrivalInfo_val = new AdmissionPointSlope[arrivalInfo.size()];
+            for (unsigned int index = 0; index < arrivalInfo.size(); index++) {
+                const Json::Value& point = arrivalInfo[index];
+                AdmissionPointSlope& xdrPoint = xdrFlowInfo.arrivalInfo.arrivalInfo_val[index];
+                xdrPoint.x = point["x"].asDouble();
+                xdrPoint.y = point["y"].asDouble();
+                xdrPoint.slope = point["slope"].asDouble();
+            }
+            xdrFlowInfo.hasPriority = flowInfo.isMember("priority");
+            xdrFlowInfo.priority = flowInfo["priority"].asUInt();
+            xdrFlowInfo.enforcerType = newString(flowInfo["enforcerType"].asString());
+            xdrFlowInfo.enforcerAddr = newString(flowInfo["enforcerAddr"].asString());
+            xdrFlowInfo.srcAddr = newString(flowInfo["srcAddr"].asString());
+            xdrFlowInfo.dstAddr = newString(flowInfo["dstAddr"].asString());
+            xdrFlowInfo.clientAddr = newString(flowInfo["clientAddr"].asString());
+        }
+    }
+}
+
+// Free typed XDR clientInfos from encodeClientInfos
+static void freeClientInfos(AdmissionClientInfos& xdrClientInfos)
+{
+    for (unsigned int i = 0; i < xdrClientInfos.AdmissionClientInfos_len; i++) {
+        AdmissionClientInfo& xdrClientInfo = xdrClientInfos.AdmissionClientInfos_val[i];
+        for (unsigned int flowIndex = 0; flowIndex < xdrClientInfo.flows.flows_len; flowIndex++) {
+            AdmissionFlowInfo& xdrFlowInfo = xdrClientInfo.flows.flows_val[flowIndex];
+            for (unsigned int index = 0; index < xdrFlowInfo.queues.queues_len; index++) {
+                delete[] xdrFlowInfo.queues.queues_val[index];
+            }
+            delete[] xdrFlowInfo.name;
+            delete[] xdrFlowInfo.queues.queues_val;
+            delete[] xdrFlowInfo.arrivalInfo.arrivalInfo_val;
+            delete[] xdrFlowInfo.enforcerType;
+            delete[] xdrFlowInfo.enforcerAddr;
+            delete[] xdrFlowInfo.srcAddr;
+            delete[] xdrFlowInfo.dstAddr;
+            delete[] xdrFlowInfo.clientAddr;
+        }
+        delete[] xdrClientInfo.name;
+        delete[] xdrClientInfo.flows.flows_val;
+    }
+    delete[] xdrClientInfos.AdmissionClientInfos_val;
+}
+
 AdmissionController_clnt::~AdmissionController_clnt()
 {
     // Destroy client
@@ -39,6 +129,7 @@ AdmissionController_clnt::~AdmissionController_clnt()
 // Add a queue to AdmissionController
 void AdmissionController_clnt::addQueue(const Json::Value& queueInfo)
 {
+    TRACE_SPAN("AdmissionController_clnt::addQueue");
     AdmissionAddQueueArgs args;
     string queueInfoStr = jsonToString(queueInfo);
     args.queueInfo = new char[queueInfoStr.length() + 1];
@@ -65,6 +156,7 @@ void AdmissionController_clnt::addQueues(const Json::Value& queueInfos)
 // Delete a queue from AdmissionController
 void AdmissionController_clnt::delQueue(string name)
 {
+    TRACE_SPAN("AdmissionController_clnt::delQueue");
     AdmissionDelQueueArgs args;
     args.name = new char[name.length() + 1];
     strcpy(args.name, name.c_str());
@@ -89,29 +181,79 @@ bool AdmissionController_clnt::addClient(const Json::Value& clientInfo, bool fas
 // Try to admit a new set of clients
 bool AdmissionController_clnt::addClients(const Json::Value& clientInfos, bool fastFirstFit)
 {
+    Json::Value flowParameters;
+    return addClients(clientInfos, fastFirstFit, flowParameters);
+}
+
+// Try to admit a new set of clients; if admitted, flowParameters is set to the parameters of the re-optimized flows
+bool AdmissionController_clnt::addClients(const Json::Value& clientInfos, bool fastFirstFit, Json::Value& flowParameters)
+{
+    TRACE_SPAN("AdmissionController_clnt::addClients");
     bool admitted = false;
-    // Build RPC parameters
-    AdmissionAddClientsArgs args;
-    string clientInfosStr = jsonToString(clientInfos);
-    args.clientInfos = new char[clientInfosStr.length() + 1];
-    strcpy(args.clientInfos, clientInfosStr.c_str());
-    args.fastFirstFit = fastFirstFit;
     AdmissionAddClientsRes result;
-    enum clnt_stat status = admission_controller_add_clients_1(args, &result, _cl);
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status;
+    if (_typed) {
+        AdmissionAddClientsTypedArgs args;
+        encodeClientInfos(args.clientInfos, clientInfos);
+        args.fastFirstFit = fastFirstFit;
+        status = admission_controller_add_clients_typed_2(args, &result, _cl);
+        freeClientInfos(args.clientInfos);
+    } else {
+        AdmissionAddClientsArgs args;
+        args.clientInfos = newString(jsonToString(clientInfos));
+        args.fastFirstFit = fastFirstFit;
+        status = admission_controller_add_clients_1(args, &result, _cl);
+        delete[] args.clientInfos;
+    }
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed AdmissionController RPC");
-    } else if (result.status != ADMISSION_SUCCESS) {
-        cerr << "AddClients failed with status " << result.status << endl;
     } else {
-        admitted = result.admitted;
+        if (result.status != ADMISSION_SUCCESS) {
+            cerr << "AddClients failed with status " << result.status << endl;
+        } else {
+            admitted = result.admitted;
+            if (admitted && !stringToJson(result.flowParameters, flowParameters)) {
+                cerr << "AddClients returned invalid flowParameters" << endl;
+            }
+        }
+        xdr_free((xdrproc_t)xdr_AdmissionAddClientsRes, (char*)&result);
     }
-    delete[] args.clientInfos;
     return admitted;
 }
 
+// Add a set of clients admitted by another AdmissionController with the same workloads, using its flowParameters from addClients
+void AdmissionController_clnt::applyClients(const Json::Value& clientInfos, const Json::Value& flowParameters)
+{
+    TRACE_SPAN("AdmissionController_clnt::applyClients");
+    AdmissionApplyClientsRes result;
+    enum clnt_stat status;
+    if (_typed) {
+        AdmissionApplyClientsTypedArgs args;
+        encodeClientInfos(args.clientInfos, clientInfos);
+        args.flowParameters = newString(jsonToString(flowParameters));
+        status = admission_controller_apply_clients_typed_2(args, &result, _cl);
+        freeClientInfos(args.clientInfos);
+        delete[] args.flowParameters;
+    } else {
+        AdmissionApplyClientsArgs args;
+        args.clientInfos = newString(jsonToString(clientInfos));
+        args.flowParameters = newString(jsonToString(flowParameters));
+        status = admission_controller_apply_clients_1(args, &result, _cl);
+        delete[] args.clientInfos;
+        delete[] args.flowParameters;
+    }
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed AdmissionController RPC");
+    } else if (result.status != ADMISSION_SUCCESS) {
+        cerr << "ApplyClients failed with status " << result.status << endl;
+    }
+}
+
 // Delete a client from AdmissionController
 void AdmissionController_clnt::delClient(string name)
 {
+    TRACE_SPAN("AdmissionController_clnt::delClient");
     AdmissionDelClientArgs args;
     args.name = new char[name.length() + 1];
     strcpy(args.name, name.c_str());
@@ -124,3 +266,95 @@ void AdmissionController_clnt::delClient(string name)
     }
     delete[] args.name;
 }
+
+// Check if a new client would be admitted without adding it
+bool AdmissionController_clnt::probeClient(const Json::Value& clientInfo, bool fastFirstFit)
+{
+    Json::Value singleClientInfos = Json::arrayValue;
+    singleClientInfos.append(clientInfo);
+    return probeClients(singleClientInfos, fastFirstFit);
+}
+
+// Check if a new set of clients would be admitted without adding them
+bool AdmissionController_clnt::probeClients(const Json::Value& clientInfos, bool fastFirstFit)
+{
+    TRACE_SPAN("AdmissionController_clnt::probeClients");
+    bool admitted = false;
+    AdmissionProbeClientsRes result;
+    enum clnt_stat status;
+    if (_typed) {
+        AdmissionAddClientsTypedArgs args;
+        encodeClientInfos(args.clientInfos, clientInfos);
+        args.fastFirstFit = fastFirstFit;
+        status = admission_controller_probe_clients_typed_2(args, &result, _cl);
+        freeClientInfos(args.clientInfos);
+    } else {
+        AdmissionAddClientsArgs args;
+        args.clientInfos = newString(jsonToString(clientInfos));
+        args.fastFirstFit = fastFirstFit;
+        status = admission_controller_probe_clients_1(args, &result, _cl);
+        delete[] args.clientInfos;
+    }
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed AdmissionController RPC");
+    } else if (result.status != ADMISSION_SUCCESS) {
+        cerr << "ProbeClients failed with status " << result.status << endl;
+    } else {
+        admitted = result.admitted;
+    }
+    return admitted;
+}
+
+// Find the largest scale factor of a new client's arrival curves at which it would be admitted
+double AdmissionController_clnt::headroomClient(const Json::Value& clientInfo, bool fastFirstFit, double minScale, double maxScale, double tolerance)
+{
+    Json::Value singleClientInfos = Json::arrayValue;
+    singleClientInfos.append(clientInfo);
+    return headroomClients(singleClientInfos, fastFirstFit, minScale, maxScale, tolerance);
+}
+
+// Find the largest scale factor of a new set of clients' arrival curves at which they would be admitted
+double AdmissionController_clnt::headroomClients(const Json::Value& clientInfos, bool fastFirstFit, double minScale, double maxScale, double tolerance)
+{
+    TRACE_SPAN("AdmissionController_clnt::headroomClients");
+    if (!_typed) {
+        cerr << "HeadroomClients requires an AdmissionController server with version 2 RPCs" << endl;
+        return 0;
+    }
+    double headroom = 0;
+    AdmissionHeadroomClientsTypedArgs args;
+    encodeClientInfos(args.clientInfos, clientInfos);
+    args.fastFirstFit = fastFirstFit;
+    args.minScale = minScale;
+    args.maxScale = maxScale;
+    args.tolerance = tolerance;
+    AdmissionHeadroomClientsRes result;
+    enum clnt_stat status = admission_controller_headroom_clients_typed_2(args, &result, _cl);
+    freeClientInfos(args.clientInfos);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed AdmissionController RPC");
+    } else if (result.status != ADMISSION_SUCCESS) {
+        cerr << "HeadroomClients failed with status " << result.status << endl;
+    } else {
+        headroom = result.headroom;
+    }
+    return headroom;
+}
+
+// Replace the arrival curves of admitted flows with observed r-b curves
+void AdmissionController_clnt::updateArrivalCurves(const Json::Value& rbCurves)
+{
+    TRACE_SPAN("AdmissionController_clnt::updateArrivalCurves");
+    AdmissionUpdateArrivalCurvesArgs args;
+    string rbCurvesStr = jsonToString(rbCurves);
+    args.rbCurves = new char[rbCurvesStr.length() + 1];
+    strcpy(args.rbCurves, rbCurvesStr.c_str());
+    AdmissionUpdateArrivalCurvesRes result;
+    enum clnt_stat status = admission_controller_update_arrival_curves_1(args, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed AdmissionController RPC");
+    } else if (result.status != ADMISSION_SUCCESS) {
+        cerr << "UpdateArrivalCurves failed with status " << result.status << endl;
+    }
+    delete[] args.rbCurves;
+}
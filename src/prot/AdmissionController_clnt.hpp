@@ -14,10 +14,12 @@
 
 using namespace std;
 
+// Clients are sent with typed XDR encoding (version 2 RPCs) if supported by the server, or else as JSON (version 1 RPCs).
 class AdmissionController_clnt
 {
 private:
     CLIENT* _cl;
+    bool _typed; // server supports version 2 RPCs
 
 public:
     AdmissionController_clnt(string serverAddr, time_t timeoutSec = 36000);
@@ -33,8 +35,23 @@ public:
     bool addClient(const Json::Value& clientInfo, bool fastFirstFit);
     // Try to admit a new set of clients
     bool addClients(const Json::Value& clientInfos, bool fastFirstFit);
+    // Try to admit a new set of clients; if admitted, flowParameters is set to the parameters of the re-optimized flows
+    bool addClients(const Json::Value& clientInfos, bool fastFirstFit, Json::Value& flowParameters);
+    // Add a set of clients admitted by another AdmissionController with the same workloads, using its flowParameters from addClients
+    void applyClients(const Json::Value& clientInfos, const Json::Value& flowParameters);
     // Delete a client from AdmissionController
     void delClient(string name);
+    // Check if a new client would be admitted without adding it
+    bool probeClient(const Json::Value& clientInfo, bool fastFirstFit);
+    // Check if a new set of clients would be admitted without adding them
+    bool probeClients(const Json::Value& clientInfos, bool fastFirstFit);
+    // Find the largest scale factor in [minScale, maxScale] of a new client's arrival curves at which it would be admitted, to within
+    // tolerance times the result, without adding it; returns 0 if it would not be admitted at minScale or if the server does not support version 2 RPCs
+    double headroomClient(const Json::Value& clientInfo, bool fastFirstFit, double minScale, double maxScale, double tolerance);
+    // Same as above for a set of clients whose arrival curves are scaled together
+    double headroomClients(const Json::Value& clientInfos, bool fastFirstFit, double minScale, double maxScale, double tolerance);
+    // Replace the arrival curves of admitted flows with observed r-b curves (see AdmissionUpdateArrivalCurvesArgs)
+    void updateArrivalCurves(const Json::Value& rbCurves);
 };
 
 #endif // _ADMISSION_CONTROLLER_CLNT_HPP
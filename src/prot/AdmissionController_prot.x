@@ -31,6 +31,27 @@ struct AdmissionAddClientsArgs {
 struct AdmissionAddClientsRes {
     AdmissionStatus status;
     bool admitted;
+    /* string encoded JSON of list of flowInfos with the parameters of the re-optimized flows if admitted (see setFlowParameters in DNC-Library/NCConfig.hpp) */
+    string flowParameters<>;
+};
+
+/* Arguments for ApplyClients RPC */
+struct AdmissionApplyClientsArgs {
+    /* string encoded JSON of list of clients (see DNC-Library/NC.hpp) */
+    string clientInfos<>;
+    /* flowParameters from AddClients RPC of another AdmissionController with the same workloads */
+    string flowParameters<>;
+};
+
+/* Results for ApplyClients RPC */
+struct AdmissionApplyClientsRes {
+    AdmissionStatus status;
+};
+
+/* Results for ProbeClients RPC (arguments are AdmissionAddClientsArgs) */
+struct AdmissionProbeClientsRes {
+    AdmissionStatus status;
+    bool admitted;
 };
 
 /* Arguments for DelClient RPC */
@@ -66,6 +87,95 @@ struct AdmissionDelQueueRes {
     AdmissionStatus status;
 };
 
+/* Arguments for UpdateArrivalCurves RPC */
+struct AdmissionUpdateArrivalCurvesArgs {
+    /* string encoded JSON of list of observed r-b curves, each with the "name" of an admitted flow and lists of decreasing "rates" and their "bursts" */
+    string rbCurves<>;
+};
+
+/* Results for UpdateArrivalCurves RPC */
+struct AdmissionUpdateArrivalCurvesRes {
+    AdmissionStatus status;
+};
+
+/*
+ * Typed encoding of clientInfos (see DNC-Library/NC.hpp) for the version 2 RPCs, which avoids formatting and parsing JSON.
+ * Only the members used by AdmissionController are encoded; empty strings and lists denote absent members.
+ */
+
+typedef string AdmissionName<>;
+
+/* Point of an arrival curve (see PointSlope in DNC-Library/DNC.hpp) */
+struct AdmissionPointSlope {
+    double x;
+    double y;
+    double slope;
+};
+
+/* flowInfo */
+struct AdmissionFlowInfo {
+    string name<>;
+    /* names of queues visited by flow */
+    AdmissionName queues<>;
+    /* arrivalInfo curve (see DNC::setArrivalInfo) */
+    AdmissionPointSlope arrivalInfo<>;
+    bool hasPriority;
+    unsigned int priority;
+    /* enforcer members (see AdmissionController.cpp) */
+    string enforcerType<>;
+    string enforcerAddr<>;
+    string srcAddr<>;
+    string dstAddr<>;
+    string clientAddr<>;
+};
+
+/* clientInfo */
+struct AdmissionClientInfo {
+    string name<>;
+    double SLO;
+    /* 0 if unset */
+    double SLOpercentile;
+    bool closedLoop;
+    bool bestEffort;
+    bool admitted;
+    AdmissionFlowInfo flows<>;
+};
+
+typedef AdmissionClientInfo AdmissionClientInfos<>;
+
+/* Arguments for AddClientsTyped and ProbeClientsTyped RPCs */
+struct AdmissionAddClientsTypedArgs {
+    AdmissionClientInfos clientInfos;
+    /* return quickly if client is unlikely to fit */
+    bool fastFirstFit;
+};
+
+/* Arguments for ApplyClientsTyped RPC */
+struct AdmissionApplyClientsTypedArgs {
+    AdmissionClientInfos clientInfos;
+    /* flowParameters from AddClients RPC of another AdmissionController with the same workloads */
+    string flowParameters<>;
+};
+
+/* Arguments for HeadroomClientsTyped RPC */
+struct AdmissionHeadroomClientsTypedArgs {
+    AdmissionClientInfos clientInfos;
+    /* return quickly if clients are unlikely to fit at minScale */
+    bool fastFirstFit;
+    /* range of scale factors of the clients' arrival curves to search */
+    double minScale;
+    double maxScale;
+    /* the search stops once the headroom is known to within tolerance times the headroom */
+    double tolerance;
+};
+
+/* Results for HeadroomClientsTyped RPC */
+struct AdmissionHeadroomClientsRes {
+    AdmissionStatus status;
+    /* largest scale factor in [minScale, maxScale] at which the clients would be admitted, or 0 if they would not be admitted at minScale */
+    double headroom;
+};
+
 /* AdmissionController RPC interface */
 program ADMISSION_CONTROLLER_PROGRAM {
     version ADMISSION_CONTROLLER_V1 {
@@ -87,5 +197,60 @@ program ADMISSION_CONTROLLER_PROGRAM {
         /* Delete a queue */
         AdmissionDelQueueRes
         ADMISSION_CONTROLLER_DEL_QUEUE(AdmissionDelQueueArgs) = 4;
+
+        /* Determine admission control for a set of clients without adding them */
+        AdmissionProbeClientsRes
+        ADMISSION_CONTROLLER_PROBE_CLIENTS(AdmissionAddClientsArgs) = 5;
+
+        /* Add a set of clients admitted by another AdmissionController, using its optimized parameters */
+        AdmissionApplyClientsRes
+        ADMISSION_CONTROLLER_APPLY_CLIENTS(AdmissionApplyClientsArgs) = 6;
+
+        /* Replace the arrival curves of admitted flows with observed r-b curves and re-optimize their parameters */
+        AdmissionUpdateArrivalCurvesRes
+        ADMISSION_CONTROLLER_UPDATE_ARRIVAL_CURVES(AdmissionUpdateArrivalCurvesArgs) = 7;
     } = 1;
+
+    /* Version 2 adds RPCs with typed clientInfos; AdmissionController_clnt falls back to version 1 for older servers */
+    version ADMISSION_CONTROLLER_V2 {
+        void
+        ADMISSION_CONTROLLER_NULL(void) = 0;
+
+        AdmissionAddClientsRes
+        ADMISSION_CONTROLLER_ADD_CLIENTS(AdmissionAddClientsArgs) = 1;
+
+        AdmissionDelClientRes
+        ADMISSION_CONTROLLER_DEL_CLIENT(AdmissionDelClientArgs) = 2;
+
+        AdmissionAddQueueRes
+        ADMISSION_CONTROLLER_ADD_QUEUE(AdmissionAddQueueArgs) = 3;
+
+        AdmissionDelQueueRes
+        ADMISSION_CONTROLLER_DEL_QUEUE(AdmissionDelQueueArgs) = 4;
+
+        AdmissionProbeClientsRes
+        ADMISSION_CONTROLLER_PROBE_CLIENTS(AdmissionAddClientsArgs) = 5;
+
+        AdmissionApplyClientsRes
+        ADMISSION_CONTROLLER_APPLY_CLIENTS(AdmissionApplyClientsArgs) = 6;
+
+        AdmissionUpdateArrivalCurvesRes
+        ADMISSION_CONTROLLER_UPDATE_ARRIVAL_CURVES(AdmissionUpdateArrivalCurvesArgs) = 7;
+
+        /* AddClients with typed clientInfos */
+        AdmissionAddClientsRes
+        ADMISSION_CONTROLLER_ADD_CLIENTS_TYPED(AdmissionAddClientsTypedArgs) = 8;
+
+        /* ProbeClients with typed clientInfos */
+        AdmissionProbeClientsRes
+        ADMISSION_CONTROLLER_PROBE_CLIENTS_TYPED(AdmissionAddClientsTypedArgs) = 9;
+
+        /* ApplyClients with typed clientInfos */
+        AdmissionApplyClientsRes
+        ADMISSION_CONTROLLER_APPLY_CLIENTS_TYPED(AdmissionApplyClientsTypedArgs) = 10;
+
+        /* Find how much the arrival curves of a set of clients could be scaled and still be admitted, without adding them */
+        AdmissionHeadroomClientsRes
+        ADMISSION_CONTROLLER_HEADROOM_CLIENTS_TYPED(AdmissionHeadroomClientsTypedArgs) = 11;
+    } = 2;
 } = 8003;
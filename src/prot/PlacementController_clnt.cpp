@@ -38,8 +38,8 @@ PlacementController_clnt::~PlacementController_clnt()
 }
 
 
-// Add a clientVM to PlacementController
-void PlacementController_clnt::addClientVM(string clientHost, string clientVM)
+// Add a clientVM to PlacementController; returns the RPC's status
+PlacementStatus PlacementController_clnt::addClientVM(string clientHost, string clientVM)
 {
     PlacementAddClientVMArgs args;
     args.clientHost = new char[clientHost.length() + 1];
@@ -47,6 +47,7 @@ void PlacementController_clnt::addClientVM(string clientHost, string clientVM)
     strcpy(args.clientHost, clientHost.c_str());
     strcpy(args.clientVM, clientVM.c_str());
     PlacementAddClientVMRes result;
+    result.status = PLACEMENT_ERR_RPC_FAILED;
     enum clnt_stat status = placement_controller_add_client_vm_1(args, &result, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed PlacementController RPC");
@@ -55,10 +56,11 @@ void PlacementController_clnt::addClientVM(string clientHost, string clientVM)
     }
     delete[] args.clientHost;
     delete[] args.clientVM;
+    return result.status;
 }
 
-// Delete a clientVM from PlacementController
-void PlacementController_clnt::delClientVM(string clientHost, string clientVM)
+// Delete a clientVM from PlacementController; returns the RPC's status
+PlacementStatus PlacementController_clnt::delClientVM(string clientHost, string clientVM)
 {
     PlacementDelClientVMArgs args;
     args.clientHost = new char[clientHost.length() + 1];
@@ -66,6 +68,7 @@ void PlacementController_clnt::delClientVM(string clientHost, string clientVM)
     strcpy(args.clientHost, clientHost.c_str());
     strcpy(args.clientVM, clientVM.c_str());
     PlacementDelClientVMRes result;
+    result.status = PLACEMENT_ERR_RPC_FAILED;
     enum clnt_stat status = placement_controller_del_client_vm_1(args, &result, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed PlacementController RPC");
@@ -74,10 +77,11 @@ void PlacementController_clnt::delClientVM(string clientHost, string clientVM)
     }
     delete[] args.clientHost;
     delete[] args.clientVM;
+    return result.status;
 }
 
-// Add a serverVM to PlacementController
-void PlacementController_clnt::addServerVM(string serverHost, string serverVM)
+// Add a serverVM to PlacementController; returns the RPC's status
+PlacementStatus PlacementController_clnt::addServerVM(string serverHost, string serverVM)
 {
     PlacementAddServerVMArgs args;
     args.serverHost = new char[serverHost.length() + 1];
@@ -85,6 +89,7 @@ void PlacementController_clnt::addServerVM(string serverHost, string serverVM)
     strcpy(args.serverHost, serverHost.c_str());
     strcpy(args.serverVM, serverVM.c_str());
     PlacementAddServerVMRes result;
+    result.status = PLACEMENT_ERR_RPC_FAILED;
     enum clnt_stat status = placement_controller_add_server_vm_1(args, &result, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed PlacementController RPC");
@@ -93,10 +98,11 @@ void PlacementController_clnt::addServerVM(string serverHost, string serverVM)
     }
     delete[] args.serverHost;
     delete[] args.serverVM;
+    return result.status;
 }
 
-// Delete a serverVM from PlacementController
-void PlacementController_clnt::delServerVM(string serverHost, string serverVM)
+// Delete a serverVM from PlacementController; returns the RPC's status
+PlacementStatus PlacementController_clnt::delServerVM(string serverHost, string serverVM)
 {
     PlacementDelServerVMArgs args;
     args.serverHost = new char[serverHost.length() + 1];
@@ -104,6 +110,7 @@ void PlacementController_clnt::delServerVM(string serverHost, string serverVM)
     strcpy(args.serverHost, serverHost.c_str());
     strcpy(args.serverVM, serverVM.c_str());
     PlacementDelServerVMRes result;
+    result.status = PLACEMENT_ERR_RPC_FAILED;
     enum clnt_stat status = placement_controller_del_server_vm_1(args, &result, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed PlacementController RPC");
@@ -112,6 +119,7 @@ void PlacementController_clnt::delServerVM(string serverHost, string serverVM)
     }
     delete[] args.serverHost;
     delete[] args.serverVM;
+    return result.status;
 }
 
 // Try to place a new client and update clientInfo with placement
@@ -171,6 +179,63 @@ bool PlacementController_clnt::addClients(Json::Value& clientInfos, string addrP
     return admitted;
 }
 
+// Try to place each client in a set of clients independently and update clientInfos with placements of admitted clients;
+// returns the number of admitted clients
+unsigned int PlacementController_clnt::placeClients(Json::Value& clientInfos, string addrPrefix, bool enforce, PlacementOrder order)
+{
+    vector<bool> admitted;
+    return placeClients(clientInfos, addrPrefix, enforce, order, admitted);
+}
+
+// Same as above and also sets admitted[i] to whether clientInfos[i] was admitted
+unsigned int PlacementController_clnt::placeClients(Json::Value& clientInfos, string addrPrefix, bool enforce, PlacementOrder order, vector<bool>& admitted)
+{
+    unsigned int numAdmitted = 0;
+    admitted.assign(clientInfos.size(), false);
+    // Build RPC parameters
+    PlacementPlaceClientsArgs args;
+    string clientInfosStr = jsonToString(clientInfos);
+    args.clientInfos = new char[clientInfosStr.length() + 1];
+    strcpy(args.clientInfos, clientInfosStr.c_str());
+    args.addrPrefix = new char[addrPrefix.length() + 1];
+    strcpy(args.addrPrefix, addrPrefix.c_str());
+    args.enforce = enforce;
+    args.order = order;
+    PlacementPlaceClientsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = placement_controller_place_clients_1(args, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed PlacementController RPC");
+    } else if (result.status != PLACEMENT_SUCCESS) {
+        cerr << "PlaceClients failed with status " << result.status << endl;
+    } else {
+        if ((result.admitted.admitted_len == clientInfos.size()) &&
+            (result.clientHosts.clientHosts_len == clientInfos.size()) &&
+            (result.clientVMs.clientVMs_len == clientInfos.size()) &&
+            (result.serverHosts.serverHosts_len == clientInfos.size()) &&
+            (result.serverVMs.serverVMs_len == clientInfos.size())) {
+            for (unsigned int clientInfoIndex = 0; clientInfoIndex < clientInfos.size(); clientInfoIndex++) {
+                if (result.admitted.admitted_val[clientInfoIndex]) {
+                    admitted[clientInfoIndex] = true;
+                    Json::Value& clientInfo = clientInfos[clientInfoIndex];
+                    clientInfo["clientHost"] = Json::Value(result.clientHosts.clientHosts_val[clientInfoIndex]);
+                    clientInfo["clientVM"] = Json::Value(result.clientVMs.clientVMs_val[clientInfoIndex]);
+                    clientInfo["serverHost"] = Json::Value(result.serverHosts.serverHosts_val[clientInfoIndex]);
+                    clientInfo["serverVM"] = Json::Value(result.serverVMs.serverVMs_val[clientInfoIndex]);
+                    numAdmitted++;
+                }
+            }
+        } else {
+            cerr << "PlaceClients returned invalid results" << endl;
+        }
+        // Free result
+        xdr_free((xdrproc_t)xdr_PlacementPlaceClientsRes, (caddr_t)&result);
+    }
+    delete[] args.clientInfos;
+    delete[] args.addrPrefix;
+    return numAdmitted;
+}
+
 // Delete a client from PlacementController
 void PlacementController_clnt::delClient(string name)
 {
@@ -24,18 +24,23 @@ public:
     PlacementController_clnt(string serverAddr, time_t timeoutSec = 36000);
     ~PlacementController_clnt();
 
-    // Add a clientVM to PlacementController
-    void addClientVM(string clientHost, string clientVM);
-    // Delete a clientVM from PlacementController
-    void delClientVM(string clientHost, string clientVM);
-    // Add a serverVM to PlacementController
-    void addServerVM(string serverHost, string serverVM);
-    // Delete a serverVM from PlacementController
-    void delServerVM(string serverHost, string serverVM);
+    // Add a clientVM to PlacementController; returns the RPC's status
+    PlacementStatus addClientVM(string clientHost, string clientVM);
+    // Delete a clientVM from PlacementController; returns the RPC's status
+    PlacementStatus delClientVM(string clientHost, string clientVM);
+    // Add a serverVM to PlacementController; returns the RPC's status
+    PlacementStatus addServerVM(string serverHost, string serverVM);
+    // Delete a serverVM from PlacementController; returns the RPC's status
+    PlacementStatus delServerVM(string serverHost, string serverVM);
     // Try to place a new client and update clientInfo with placement
     bool addClient(Json::Value& clientInfo, string addrPrefix, bool enforce);
     // Try to place a new set of clients and update clientInfos with placements
     bool addClients(Json::Value& clientInfos, string addrPrefix, bool enforce);
+    // Try to place each client in a set of clients independently and update clientInfos with placements of admitted clients;
+    // returns the number of admitted clients
+    unsigned int placeClients(Json::Value& clientInfos, string addrPrefix, bool enforce, PlacementOrder order);
+    // Same as above and also sets admitted[i] to whether clientInfos[i] was admitted
+    unsigned int placeClients(Json::Value& clientInfos, string addrPrefix, bool enforce, PlacementOrder order, vector<bool>& admitted);
     // Delete a client from PlacementController
     void delClient(string name);
     // Delete a vector of clients from PlacementController
@@ -16,7 +16,8 @@ enum PlacementStatus {
     PLACEMENT_ERR_SERVER_VM_ALREADY_EXISTS,
     PLACEMENT_ERR_CLIENT_VM_NONEXISTENT,
     PLACEMENT_ERR_SERVER_VM_NONEXISTENT,
-    PLACEMENT_ERR_SERVER_VM_IN_USE
+    PLACEMENT_ERR_SERVER_VM_IN_USE,
+    PLACEMENT_ERR_RPC_FAILED /* a PlacementController shard could not be reached (see PlacementRouter) */
 };
 
 /* Arguments for AddClients RPC */
@@ -37,6 +38,31 @@ struct PlacementAddClientsRes {
     str serverVMs<>;
 };
 
+/* Order in which PlaceClients RPC places clients */
+enum PlacementOrder {
+    PLACEMENT_ORDER_GIVEN,
+    PLACEMENT_ORDER_DECREASING_LOAD
+};
+
+/* Arguments for PlaceClients RPC */
+struct PlacementPlaceClientsArgs {
+    /* string encoded JSON of list of clients (see DNC-Library/NC.hpp) */
+    str clientInfos;
+    str addrPrefix;
+    bool enforce;
+    PlacementOrder order;
+};
+
+/* Results for PlaceClients RPC; placements of clients that are not admitted are empty strings */
+struct PlacementPlaceClientsRes {
+    PlacementStatus status;
+    bool admitted<>;
+    str clientHosts<>;
+    str clientVMs<>;
+    str serverHosts<>;
+    str serverVMs<>;
+};
+
 /* Arguments for DelClients RPC */
 struct PlacementDelClientsArgs {
     /* list of names of clients to delete */
@@ -121,5 +147,9 @@ program PLACEMENT_CONTROLLER_PROGRAM {
         /* Delete a server VM */
         PlacementDelServerVMRes
         PLACEMENT_CONTROLLER_DEL_SERVER_VM(PlacementDelServerVMArgs) = 6;
+
+        /* Determine placement/admission control for each client in a set of clients independently */
+        PlacementPlaceClientsRes
+        PLACEMENT_CONTROLLER_PLACE_CLIENTS(PlacementPlaceClientsArgs) = 7;
     } = 1;
 } = 8004;
@@ -6,11 +6,13 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "net_prot.h"
 #include "../common/common.hpp"
+#include "../common/SpanTrace.hpp"
 #include "net_clnt.hpp"
 
 using namespace std;
@@ -39,48 +41,76 @@ net_clnt::~net_clnt()
 // Update network QoS parameters for a client
 void net_clnt::updateClient(const Json::Value& flowInfo)
 {
-    NetClientUpdate arg;
-    arg.client.s_dstAddr = addrInfo(flowInfo["dstAddr"].asString());
-    arg.client.s_srcAddr = addrInfo(flowInfo["srcAddr"].asString());
-    arg.priority = flowInfo["priority"].asUInt();
-    if (flowInfo.isMember("rateLimiters")) {
-        const Json::Value& rateLimiters = flowInfo["rateLimiters"];
-        arg.rateLimitRates.rateLimitRates_len = rateLimiters.size();
-        arg.rateLimitRates.rateLimitRates_val = new double[arg.rateLimitRates.rateLimitRates_len];
-        arg.rateLimitBursts.rateLimitBursts_len = arg.rateLimitRates.rateLimitRates_len;
-        arg.rateLimitBursts.rateLimitBursts_val = new double[arg.rateLimitBursts.rateLimitBursts_len];
-        for (unsigned int i = 0; i < rateLimiters.size(); i++) {
-            const Json::Value& rateLimit = rateLimiters[i];
-            arg.rateLimitRates.rateLimitRates_val[i] = rateLimit["rate"].asDouble();
-            arg.rateLimitBursts.rateLimitBursts_val[i] = rateLimit["burst"].asDouble();
+    Json::Value flowInfos = Json::arrayValue;
+    flowInfos.append(flowInfo);
+    updateClients(flowInfos);
+}
+
+// Update network QoS parameters for a list of clients
+bool net_clnt::updateClients(const Json::Value& flowInfos)
+{
+    TRACE_SPAN("net_clnt::updateClients");
+    vector<NetClientUpdate> args(flowInfos.size());
+    for (unsigned int index = 0; index < flowInfos.size(); index++) {
+        const Json::Value& flowInfo = flowInfos[index];
+        NetClientUpdate& arg = args[index];
+        arg.client.s_dstAddr = addrInfo(flowInfo["dstAddr"].asString());
+        arg.client.s_srcAddr = addrInfo(flowInfo["srcAddr"].asString());
+        arg.priority = flowInfo["priority"].asUInt();
+        if (flowInfo.isMember("rateLimiters")) {
+            const Json::Value& rateLimiters = flowInfo["rateLimiters"];
+            arg.rateLimitRates.rateLimitRates_len = rateLimiters.size();
+            arg.rateLimitRates.rateLimitRates_val = new double[arg.rateLimitRates.rateLimitRates_len];
+            arg.rateLimitBursts.rateLimitBursts_len = arg.rateLimitRates.rateLimitRates_len;
+            arg.rateLimitBursts.rateLimitBursts_val = new double[arg.rateLimitBursts.rateLimitBursts_len];
+            for (unsigned int i = 0; i < rateLimiters.size(); i++) {
+                const Json::Value& rateLimit = rateLimiters[i];
+                arg.rateLimitRates.rateLimitRates_val[i] = rateLimit["rate"].asDouble();
+                arg.rateLimitBursts.rateLimitBursts_val[i] = rateLimit["burst"].asDouble();
+            }
+        } else {
+            arg.rateLimitRates.rateLimitRates_len = 0;
+            arg.rateLimitRates.rateLimitRates_val = NULL;
+            arg.rateLimitBursts.rateLimitBursts_len = 0;
+            arg.rateLimitBursts.rateLimitBursts_val = NULL;
         }
-    } else {
-        arg.rateLimitRates.rateLimitRates_len = 0;
-        arg.rateLimitRates.rateLimitRates_val = NULL;
-        arg.rateLimitBursts.rateLimitBursts_len = 0;
-        arg.rateLimitBursts.rateLimitBursts_val = NULL;
     }
-    NetUpdateClientsArgs args = {1, &arg};
-    enum clnt_stat status = net_enforcer_update_clients_1(args, NULL, _cl);
+    NetUpdateClientsArgs argList = {(u_int)args.size(), args.empty() ? NULL : &args[0]};
+    enum clnt_stat status = net_enforcer_update_clients_1(argList, NULL, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed network RPC");
     }
     // Free memory
-    delete[] arg.rateLimitRates.rateLimitRates_val;
-    delete[] arg.rateLimitBursts.rateLimitBursts_val;
+    for (unsigned int index = 0; index < args.size(); index++) {
+        delete[] args[index].rateLimitRates.rateLimitRates_val;
+        delete[] args[index].rateLimitBursts.rateLimitBursts_val;
+    }
+    return (status == RPC_SUCCESS);
 }
 
 // Remove a client and revert its network QoS settings to defaults
 void net_clnt::removeClient(const Json::Value& flowInfo)
 {
-    NetClient arg;
-    arg.s_dstAddr = addrInfo(flowInfo["dstAddr"].asString());
-    arg.s_srcAddr = addrInfo(flowInfo["srcAddr"].asString());
-    NetRemoveClientsArgs args = {1, &arg};
-    enum clnt_stat status = net_enforcer_remove_clients_1(args, NULL, _cl);
+    Json::Value flowInfos = Json::arrayValue;
+    flowInfos.append(flowInfo);
+    removeClients(flowInfos);
+}
+
+// Remove a list of clients and revert their network QoS settings to defaults
+bool net_clnt::removeClients(const Json::Value& flowInfos)
+{
+    TRACE_SPAN("net_clnt::removeClients");
+    vector<NetClient> args(flowInfos.size());
+    for (unsigned int index = 0; index < flowInfos.size(); index++) {
+        args[index].s_dstAddr = addrInfo(flowInfos[index]["dstAddr"].asString());
+        args[index].s_srcAddr = addrInfo(flowInfos[index]["srcAddr"].asString());
+    }
+    NetRemoveClientsArgs argList = {(u_int)args.size(), args.empty() ? NULL : &args[0]};
+    enum clnt_stat status = net_enforcer_remove_clients_1(argList, NULL, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed network RPC");
     }
+    return (status == RPC_SUCCESS);
 }
 
 // Get occupancy of a client
@@ -98,3 +128,64 @@ double net_clnt::getOccupancy(unsigned long dstAddr, unsigned long srcAddr)
         return result.occupancy;
     }
 }
+
+// Get occupancy of clients
+bool net_clnt::getOccupancies(const vector<pair<unsigned long, unsigned long> >& clientAddrs, vector<double>& occupancies, bool refresh)
+{
+    vector<NetClient> clients(clientAddrs.size());
+    for (unsigned int i = 0; i < clientAddrs.size(); i++) {
+        clients[i].s_dstAddr = clientAddrs[i].first;
+        clients[i].s_srcAddr = clientAddrs[i].second;
+    }
+    NetGetOccupanciesArgs args;
+    args.clients.clients_len = clients.size();
+    args.clients.clients_val = clients.empty() ? NULL : &clients[0];
+    args.refresh = refresh;
+    NetGetOccupanciesRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = net_enforcer_get_occupancies_1(args, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed network RPC");
+        return false;
+    }
+    occupancies.assign(result.NetGetOccupanciesRes_val, result.NetGetOccupanciesRes_val + result.NetGetOccupanciesRes_len);
+    // Free memory
+    xdr_free((xdrproc_t)xdr_NetGetOccupanciesRes, (char*)&result);
+    return true;
+}
+
+// Get statistics of clients
+bool net_clnt::getStats(const vector<pair<unsigned long, unsigned long> >& clientAddrs, Json::Value& stats)
+{
+    vector<NetClient> clients(clientAddrs.size());
+    for (unsigned int i = 0; i < clientAddrs.size(); i++) {
+        clients[i].s_dstAddr = clientAddrs[i].first;
+        clients[i].s_srcAddr = clientAddrs[i].second;
+    }
+    NetGetStatsArgs args = {(u_int)clients.size(), clients.empty() ? NULL : &clients[0]};
+    NetGetStatsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = net_enforcer_get_stats_1(args, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed network RPC");
+        return false;
+    }
+    stats = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < result.NetGetStatsRes_len; i++) {
+        const NetClientStats& clientStats = result.NetGetStatsRes_val[i];
+        Json::Value s;
+        s["s_dstAddr"] = (Json::UInt64)clientStats.client.s_dstAddr;
+        s["s_srcAddr"] = (Json::UInt64)clientStats.client.s_srcAddr;
+        s["rateLimited"] = (bool)clientStats.rateLimited;
+        s["sentBytes"] = (Json::UInt64)clientStats.sentBytes;
+        s["sentPackets"] = (Json::UInt64)clientStats.sentPackets;
+        s["droppedPackets"] = (Json::UInt64)clientStats.droppedPackets;
+        s["overlimits"] = (Json::UInt64)clientStats.overlimits;
+        s["backlogBytes"] = (Json::UInt64)clientStats.backlogBytes;
+        s["backlogPackets"] = (Json::UInt64)clientStats.backlogPackets;
+        stats.append(s);
+    }
+    // Free memory
+    xdr_free((xdrproc_t)xdr_NetGetStatsRes, (char*)&result);
+    return true;
+}
@@ -8,6 +8,8 @@
 #define _NET_CLNT_HPP
 
 #include <string>
+#include <vector>
+#include <utility>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "net_prot.h"
@@ -25,10 +27,20 @@ public:
 
     // Update network QoS parameters for a client
     void updateClient(const Json::Value& flowInfo);
+    // Update network QoS parameters for a list of clients (flowInfos) with one RPC. Returns false on error.
+    bool updateClients(const Json::Value& flowInfos);
     // Remove a client and revert its network QoS settings to defaults
     void removeClient(const Json::Value& flowInfo);
+    // Remove a list of clients (flowInfos) with one RPC. Returns false on error.
+    bool removeClients(const Json::Value& flowInfos);
     // Get occupancy of a client
     double getOccupancy(unsigned long dstAddr, unsigned long srcAddr);
+    // Get occupancy of (dst, src) clients with one RPC, reading the TC stats again if refresh is set. Returns false on error.
+    bool getOccupancies(const vector<pair<unsigned long, unsigned long> >& clientAddrs, vector<double>& occupancies, bool refresh = false);
+    // Get statistics of (dst, src) clients, or of all clients if clientAddrs is empty. Returns false on error.
+    // stats is a list of {"s_dstAddr", "s_srcAddr", "rateLimited", "sentBytes", "sentPackets", "droppedPackets", "overlimits", "backlogBytes", "backlogPackets"}
+    // (see NetClientStats in net_prot.x).
+    bool getStats(const vector<pair<unsigned long, unsigned long> >& clientAddrs, Json::Value& stats);
 };
 
 #endif // _NET_CLNT_HPP
@@ -32,6 +32,31 @@ struct NetGetOccupancyRes {
     double occupancy;
 };
 
+/* Clients to get the occupancy of; refresh reads the TC statistics even if they were read within NetEnforcer's statistics interval */
+struct NetGetOccupanciesArgs {
+    NetClient clients<>;
+    bool refresh;
+};
+
+/* Occupancy of each client since the last occupancy RPC for the client, in the order of the clients in the arguments */
+typedef double NetGetOccupanciesRes<>;
+
+/* TC statistics of a client's rate limiting class; counts are cumulative since the class was created */
+struct NetClientStats {
+    NetClient client;
+    bool rateLimited; /* false if the client has no rate limits, in which case its traffic is not counted separately */
+    unsigned hyper sentBytes;
+    unsigned hyper sentPackets;
+    unsigned hyper droppedPackets;
+    unsigned hyper overlimits; /* number of times a packet was delayed by the client's rate limits */
+    unsigned hyper backlogBytes; /* queued bytes */
+    unsigned hyper backlogPackets; /* queued packets */
+};
+
+/* Clients to get statistics for; all clients if empty */
+typedef NetClient NetGetStatsArgs<>;
+typedef NetClientStats NetGetStatsRes<>;
+
 /* NetEnforcer RPC interface */
 program NET_ENFORCER_PROGRAM {
     version NET_ENFORCER_V1 {
@@ -49,5 +74,13 @@ program NET_ENFORCER_PROGRAM {
         /* Get occupancy statistics */
         NetGetOccupancyRes
         NET_ENFORCER_GET_OCCUPANCY(NetGetOccupancyArgs) = 3;
+
+        /* Get statistics of a set of clients */
+        NetGetStatsRes
+        NET_ENFORCER_GET_STATS(NetGetStatsArgs) = 4;
+
+        /* Get occupancy statistics of a set of clients */
+        NetGetOccupanciesRes
+        NET_ENFORCER_GET_OCCUPANCIES(NetGetOccupanciesArgs) = 5;
     } = 1;
 } = 8001;
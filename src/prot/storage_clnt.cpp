@@ -6,11 +6,15 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "storage_prot.h"
 #include "../common/common.hpp"
+#include "../common/time.hpp"
+#include "../common/SpanTrace.hpp"
+#include "../common/LatencyHistogram.hpp"
 #include "storage_clnt.hpp"
 
 using namespace std;
@@ -39,34 +43,54 @@ storage_clnt::~storage_clnt()
 // Update storage QoS parameters for a client
 void storage_clnt::updateClient(const Json::Value& flowInfo)
 {
-    StorageClient arg;
-    arg.s_addr = addrInfo(flowInfo["clientAddr"].asString());
-    arg.priority = flowInfo["priority"].asUInt();
-    if (flowInfo.isMember("rateLimiters")) {
-        const Json::Value& rateLimiters = flowInfo["rateLimiters"];
-        arg.rateLimitRates.rateLimitRates_len = rateLimiters.size();
-        arg.rateLimitRates.rateLimitRates_val = new double[arg.rateLimitRates.rateLimitRates_len];
-        arg.rateLimitBursts.rateLimitBursts_len = arg.rateLimitRates.rateLimitRates_len;
-        arg.rateLimitBursts.rateLimitBursts_val = new double[arg.rateLimitBursts.rateLimitBursts_len];
-        for (unsigned int i = 0; i < rateLimiters.size(); i++) {
-            const Json::Value& rateLimit = rateLimiters[i];
-            arg.rateLimitRates.rateLimitRates_val[i] = rateLimit["rate"].asDouble();
-            arg.rateLimitBursts.rateLimitBursts_val[i] = rateLimit["burst"].asDouble();
+    Json::Value flowInfos = Json::arrayValue;
+    flowInfos.append(flowInfo);
+    updateClients(flowInfos);
+}
+
+// Update storage QoS parameters for a list of clients
+bool storage_clnt::updateClients(const Json::Value& flowInfos)
+{
+    TRACE_SPAN("storage_clnt::updateClients");
+    vector<StorageClient> args(flowInfos.size());
+    for (unsigned int index = 0; index < flowInfos.size(); index++) {
+        const Json::Value& flowInfo = flowInfos[index];
+        StorageClient& arg = args[index];
+        arg.s_addr = addrInfo(flowInfo["clientAddr"].asString());
+        arg.priority = flowInfo["priority"].asUInt();
+        string flowName = flowInfo["name"].asString();
+        arg.flowName = new char[flowName.length() + 1];
+        strcpy(arg.flowName, flowName.c_str());
+        if (flowInfo.isMember("rateLimiters")) {
+            const Json::Value& rateLimiters = flowInfo["rateLimiters"];
+            arg.rateLimitRates.rateLimitRates_len = rateLimiters.size();
+            arg.rateLimitRates.rateLimitRates_val = new double[arg.rateLimitRates.rateLimitRates_len];
+            arg.rateLimitBursts.rateLimitBursts_len = arg.rateLimitRates.rateLimitRates_len;
+            arg.rateLimitBursts.rateLimitBursts_val = new double[arg.rateLimitBursts.rateLimitBursts_len];
+            for (unsigned int i = 0; i < rateLimiters.size(); i++) {
+                const Json::Value& rateLimit = rateLimiters[i];
+                arg.rateLimitRates.rateLimitRates_val[i] = rateLimit["rate"].asDouble();
+                arg.rateLimitBursts.rateLimitBursts_val[i] = rateLimit["burst"].asDouble();
+            }
+        } else {
+            arg.rateLimitRates.rateLimitRates_len = 0;
+            arg.rateLimitRates.rateLimitRates_val = NULL;
+            arg.rateLimitBursts.rateLimitBursts_len = 0;
+            arg.rateLimitBursts.rateLimitBursts_val = NULL;
         }
-    } else {
-        arg.rateLimitRates.rateLimitRates_len = 0;
-        arg.rateLimitRates.rateLimitRates_val = NULL;
-        arg.rateLimitBursts.rateLimitBursts_len = 0;
-        arg.rateLimitBursts.rateLimitBursts_val = NULL;
     }
-    StorageUpdateArgs args = {1, &arg};
-    enum clnt_stat status = storage_enforcer_update_1(args, NULL, _cl);
+    StorageUpdateArgs argList = {(u_int)args.size(), args.empty() ? NULL : &args[0]};
+    enum clnt_stat status = storage_enforcer_update_1(argList, NULL, _cl);
     if (status != RPC_SUCCESS) {
         clnt_perror(_cl, "Failed storage RPC");
     }
     // Free memory
-    delete[] arg.rateLimitRates.rateLimitRates_val;
-    delete[] arg.rateLimitBursts.rateLimitBursts_val;
+    for (unsigned int index = 0; index < args.size(); index++) {
+        delete[] args[index].rateLimitRates.rateLimitRates_val;
+        delete[] args[index].rateLimitBursts.rateLimitBursts_val;
+        delete[] args[index].flowName;
+    }
+    return (status == RPC_SUCCESS);
 }
 
 // Get occupancy of a client
@@ -83,3 +107,53 @@ double storage_clnt::getOccupancy(unsigned long clientAddr)
         return result.occupancy;
     }
 }
+
+// Summarize a latency histogram with its count and quantiles in seconds
+static Json::Value histogramToJson(const StorageHistogram& histogram)
+{
+    vector<uint64_t> counts(histogram.counts.counts_val, histogram.counts.counts_val + histogram.counts.counts_len);
+    uint64_t count = 0;
+    for (unsigned int i = 0; i < counts.size(); i++) {
+        count += counts[i];
+    }
+    Json::Value summary;
+    summary["count"] = (Json::UInt64)count;
+    summary["p50"] = ConvertTimeToSeconds(LatencyHistogram::quantile(histogram.firstBucket, counts, 0.5));
+    summary["p90"] = ConvertTimeToSeconds(LatencyHistogram::quantile(histogram.firstBucket, counts, 0.9));
+    summary["p99"] = ConvertTimeToSeconds(LatencyHistogram::quantile(histogram.firstBucket, counts, 0.99));
+    summary["p999"] = ConvertTimeToSeconds(LatencyHistogram::quantile(histogram.firstBucket, counts, 0.999));
+    summary["max"] = ConvertTimeToSeconds(LatencyHistogram::quantile(histogram.firstBucket, counts, 1));
+    return summary;
+}
+
+// Get telemetry of clients
+bool storage_clnt::getStats(const vector<unsigned long>& clientAddrs, Json::Value& stats)
+{
+    StorageGetStatsArgs arg;
+    arg.s_addrs.s_addrs_len = clientAddrs.size();
+    arg.s_addrs.s_addrs_val = clientAddrs.empty() ? NULL : const_cast<unsigned long*>(&clientAddrs[0]);
+    StorageGetStatsRes result;
+    memset(&result, 0, sizeof(result));
+    enum clnt_stat status = storage_enforcer_get_stats_1(arg, &result, _cl);
+    if (status != RPC_SUCCESS) {
+        clnt_perror(_cl, "Failed storage RPC");
+        return false;
+    }
+    stats = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < result.StorageGetStatsRes_len; i++) {
+        const StorageClientStats& clientStats = result.StorageGetStatsRes_val[i];
+        Json::Value s;
+        s["s_addr"] = (Json::UInt64)clientStats.s_addr;
+        s["queueTime"] = histogramToJson(clientStats.queueTime);
+        s["serviceTime"] = histogramToJson(clientStats.serviceTime);
+        s["conformingJobs"] = (Json::UInt64)clientStats.conformingJobs;
+        s["nonconformingJobs"] = (Json::UInt64)clientStats.nonconformingJobs;
+        s["outstandingJobs"] = clientStats.outstandingJobs;
+        s["pendingJobs"] = clientStats.pendingJobs;
+        s["maxPendingJobs"] = clientStats.maxPendingJobs;
+        stats.append(s);
+    }
+    // Free memory
+    xdr_free((xdrproc_t)xdr_StorageGetStatsRes, (char*)&result);
+    return true;
+}
@@ -8,6 +8,7 @@
 #define _STORAGE_CLNT_HPP
 
 #include <string>
+#include <vector>
 #include <json/json.h>
 #include <rpc/rpc.h>
 #include "storage_prot.h"
@@ -25,8 +26,14 @@ public:
 
     // Update storage QoS parameters for a client
     void updateClient(const Json::Value& flowInfo);
+    // Update storage QoS parameters for a list of clients (flowInfos) with one RPC. Returns false on error.
+    bool updateClients(const Json::Value& flowInfos);
     // Get occupancy of a client
     double getOccupancy(unsigned long clientAddr);
+    // Get telemetry of clients, or of all clients if clientAddrs is empty. Returns false on error.
+    // stats is a list of {"s_addr", "queueTime", "serviceTime", "conformingJobs", "nonconformingJobs", "outstandingJobs", "pendingJobs", "maxPendingJobs"},
+    // where queueTime and serviceTime are {"count", "p50", "p90", "p99", "p999", "max"} with latencies in seconds (see StorageClientStats in storage_prot.x).
+    bool getStats(const vector<unsigned long>& clientAddrs, Json::Value& stats);
 };
 
 #endif // _STORAGE_CLNT_HPP
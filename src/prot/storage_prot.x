@@ -12,6 +12,8 @@ struct StorageClient {
     unsigned int priority;
     double rateLimitRates<>;
     double rateLimitBursts<>;
+    /* name of the client's flow in AdmissionController, used when publishing the client's observed r-b curve */
+    string flowName<>;
 };
 
 typedef StorageClient StorageUpdateArgs<>;
@@ -24,6 +26,31 @@ struct StorageGetOccupancyRes {
     double occupancy;
 };
 
+/* Latency histogram in nanoseconds; counts[i] is the number of samples in bucket firstBucket + i (see common/LatencyHistogram.hpp) */
+struct StorageHistogram {
+    unsigned int firstBucket;
+    unsigned hyper counts<>;
+};
+
+/* Telemetry of a client; histograms and job counts are cumulative */
+struct StorageClientStats {
+    unsigned long s_addr;
+    StorageHistogram queueTime; /* from arrival to being sent to storage */
+    StorageHistogram serviceTime; /* from being sent to storage to completion */
+    unsigned hyper conformingJobs; /* read/write requests sent within the client's rate limits */
+    unsigned hyper nonconformingJobs; /* read/write requests sent over the client's rate limits */
+    int outstandingJobs; /* requests at storage */
+    int pendingJobs; /* requests queued */
+    int maxPendingJobs; /* max requests queued since the last GetStats */
+};
+
+/* Clients to get telemetry for; all clients if empty */
+struct StorageGetStatsArgs {
+    unsigned long s_addrs<>;
+};
+
+typedef StorageClientStats StorageGetStatsRes<>;
+
 program STORAGE_ENFORCER_PROGRAM {
     version STORAGE_ENFORCER_V1 {
         void
@@ -36,5 +63,9 @@ program STORAGE_ENFORCER_PROGRAM {
         /* Get occupancy statistics */
         StorageGetOccupancyRes
         STORAGE_ENFORCER_GET_OCCUPANCY(StorageGetOccupancyArgs) = 2;
+
+        /* Get telemetry of a set of clients */
+        StorageGetStatsRes
+        STORAGE_ENFORCER_GET_STATS(StorageGetStatsArgs) = 3;
     } = 1;
 } = 8002;